@@ -0,0 +1,103 @@
+/* Copyright 2020 Johan Lindquist
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "fixtures.h"
+
+const uint8_t benchRootPublicKey[32] = {
+    0x4d, 0x83, 0x4c, 0x3d, 0x95, 0x70, 0xb3, 0x43, 0x9a, 0xd9, 0xb9, 0xd5, 0xf6, 0xf9, 0x72, 0x09,
+    0x9b, 0xd6, 0xf7, 0x25, 0x27, 0xa5, 0x43, 0xc0, 0xff, 0x25, 0x74, 0x55, 0xc1, 0xc1, 0x27, 0x8c,
+};
+
+const uint8_t benchSingleNonce[64] = {
+    0x01, 0x08, 0x0f, 0x16, 0x1d, 0x24, 0x2b, 0x32, 0x39, 0x40, 0x47, 0x4e, 0x55, 0x5c, 0x63, 0x6a,
+    0x71, 0x78, 0x7f, 0x86, 0x8d, 0x94, 0x9b, 0xa2, 0xa9, 0xb0, 0xb7, 0xbe, 0xc5, 0xcc, 0xd3, 0xda,
+    0xe1, 0xe8, 0xef, 0xf6, 0xfd, 0x04, 0x0b, 0x12, 0x19, 0x20, 0x27, 0x2e, 0x35, 0x3c, 0x43, 0x4a,
+    0x51, 0x58, 0x5f, 0x66, 0x6d, 0x74, 0x7b, 0x82, 0x89, 0x90, 0x97, 0x9e, 0xa5, 0xac, 0xb3, 0xba,
+};
+
+const uint8_t benchSingleResponse[360] = {
+    0x05, 0x00, 0x00, 0x00, 0x40, 0x00, 0x00, 0x00, 0x40, 0x00, 0x00, 0x00, 0xa4, 0x00, 0x00, 0x00,
+    0x3c, 0x01, 0x00, 0x00, 0x53, 0x49, 0x47, 0x00, 0x50, 0x41, 0x54, 0x48, 0x53, 0x52, 0x45, 0x50,
+    0x43, 0x45, 0x52, 0x54, 0x49, 0x4e, 0x44, 0x58, 0x91, 0x98, 0x6d, 0x59, 0x80, 0xfd, 0x57, 0xc0,
+    0x6b, 0x4b, 0x0e, 0x12, 0x70, 0x64, 0xf6, 0x8b, 0xc4, 0x59, 0x3f, 0xb2, 0x40, 0x46, 0x2d, 0x9a,
+    0xa0, 0x8e, 0x8d, 0xbf, 0xcd, 0xd2, 0x5f, 0x72, 0x22, 0xc3, 0x69, 0x5d, 0xe4, 0x00, 0x7b, 0x26,
+    0xdd, 0x82, 0x0e, 0x8a, 0xd7, 0xae, 0x27, 0xbb, 0x20, 0xf5, 0xa9, 0x40, 0x22, 0x56, 0x53, 0x6d,
+    0x81, 0x23, 0x1d, 0x95, 0x5a, 0xca, 0x02, 0x08, 0x03, 0x00, 0x00, 0x00, 0x04, 0x00, 0x00, 0x00,
+    0x0c, 0x00, 0x00, 0x00, 0x52, 0x41, 0x44, 0x49, 0x4d, 0x49, 0x44, 0x50, 0x52, 0x4f, 0x4f, 0x54,
+    0x40, 0x42, 0x0f, 0x00, 0xb9, 0x18, 0x92, 0x79, 0xca, 0xb1, 0x05, 0x00, 0xff, 0x09, 0x43, 0xa4,
+    0xed, 0xa5, 0x4d, 0x03, 0xc4, 0xb7, 0xb3, 0x50, 0xbc, 0x59, 0x32, 0xd0, 0x3b, 0x6e, 0x8e, 0xb0,
+    0xe5, 0x47, 0xa7, 0x70, 0xe4, 0x6b, 0x77, 0x31, 0x69, 0xb0, 0xd4, 0x7f, 0xe1, 0x67, 0xe0, 0x4e,
+    0x5d, 0x47, 0xc8, 0xd6, 0x15, 0x58, 0xab, 0x22, 0xd9, 0xf6, 0x24, 0xed, 0x1e, 0x0e, 0xdb, 0x65,
+    0x67, 0xc1, 0x50, 0x31, 0xb1, 0xf6, 0xb1, 0xc1, 0xef, 0x57, 0x10, 0x9b, 0x02, 0x00, 0x00, 0x00,
+    0x40, 0x00, 0x00, 0x00, 0x53, 0x49, 0x47, 0x00, 0x44, 0x45, 0x4c, 0x45, 0x8e, 0x4c, 0xa2, 0xa9,
+    0x39, 0xf7, 0xd6, 0xa8, 0xb3, 0xbb, 0xee, 0x2c, 0x30, 0xf1, 0xdb, 0x36, 0xe0, 0x54, 0x2c, 0xbb,
+    0x49, 0x32, 0xdc, 0x6f, 0x86, 0xf4, 0x26, 0x84, 0xe9, 0x4c, 0xb0, 0xc2, 0x75, 0x1e, 0x8b, 0x73,
+    0xcf, 0x04, 0x78, 0x95, 0x6b, 0x34, 0xd9, 0xa1, 0xb3, 0x43, 0xce, 0xbf, 0x15, 0x73, 0xc6, 0x9c,
+    0x8a, 0xe2, 0xc8, 0x88, 0x2a, 0x4e, 0x8c, 0x1e, 0xa3, 0xfb, 0xe6, 0x09, 0x03, 0x00, 0x00, 0x00,
+    0x20, 0x00, 0x00, 0x00, 0x28, 0x00, 0x00, 0x00, 0x50, 0x55, 0x42, 0x4b, 0x4d, 0x49, 0x4e, 0x54,
+    0x4d, 0x41, 0x58, 0x54, 0x1d, 0x2f, 0xff, 0xb9, 0x23, 0x86, 0x78, 0xc5, 0x77, 0xcb, 0x3c, 0x02,
+    0x6f, 0x5e, 0x2c, 0xf1, 0x67, 0xfb, 0x7b, 0x8b, 0xb4, 0x22, 0x6d, 0xe8, 0xbe, 0x0f, 0xa2, 0x15,
+    0x18, 0x06, 0x96, 0x78, 0xb9, 0xb8, 0xba, 0x5b, 0xb6, 0xb1, 0x05, 0x00, 0xb9, 0x58, 0xcf, 0xf8,
+    0x25, 0xb4, 0x05, 0x00, 0x00, 0x00, 0x00, 0x00,
+};
+
+const uint8_t benchBatchedNonce[64] = {
+    0x41, 0x48, 0x4f, 0x56, 0x5d, 0x64, 0x6b, 0x72, 0x79, 0x80, 0x87, 0x8e, 0x95, 0x9c, 0xa3, 0xaa,
+    0xb1, 0xb8, 0xbf, 0xc6, 0xcd, 0xd4, 0xdb, 0xe2, 0xe9, 0xf0, 0xf7, 0xfe, 0x05, 0x0c, 0x13, 0x1a,
+    0x21, 0x28, 0x2f, 0x36, 0x3d, 0x44, 0x4b, 0x52, 0x59, 0x60, 0x67, 0x6e, 0x75, 0x7c, 0x83, 0x8a,
+    0x91, 0x98, 0x9f, 0xa6, 0xad, 0xb4, 0xbb, 0xc2, 0xc9, 0xd0, 0xd7, 0xde, 0xe5, 0xec, 0xf3, 0xfa,
+};
+
+const uint8_t benchBatchedResponse[616] = {
+    0x05, 0x00, 0x00, 0x00, 0x40, 0x00, 0x00, 0x00, 0x40, 0x01, 0x00, 0x00, 0xa4, 0x01, 0x00, 0x00,
+    0x3c, 0x02, 0x00, 0x00, 0x53, 0x49, 0x47, 0x00, 0x50, 0x41, 0x54, 0x48, 0x53, 0x52, 0x45, 0x50,
+    0x43, 0x45, 0x52, 0x54, 0x49, 0x4e, 0x44, 0x58, 0xbe, 0xc0, 0x96, 0xe2, 0x9e, 0x4a, 0xdb, 0x9d,
+    0xa8, 0xab, 0x6a, 0xdb, 0x55, 0xd0, 0x54, 0xc0, 0x8d, 0x49, 0x56, 0x01, 0x66, 0x4c, 0x4c, 0xd3,
+    0xc1, 0x20, 0x18, 0xda, 0x77, 0x7f, 0x4c, 0x5c, 0x9f, 0xfb, 0x7c, 0x02, 0xff, 0x1a, 0xce, 0x5d,
+    0x0c, 0xe8, 0xb6, 0xb3, 0x9a, 0x7a, 0xf2, 0xbc, 0x06, 0xe2, 0xf7, 0xc2, 0x90, 0x81, 0x59, 0xb2,
+    0x53, 0x56, 0xc0, 0x48, 0xad, 0x48, 0x3c, 0x07, 0xff, 0x09, 0x43, 0xa4, 0xed, 0xa5, 0x4d, 0x03,
+    0xc4, 0xb7, 0xb3, 0x50, 0xbc, 0x59, 0x32, 0xd0, 0x3b, 0x6e, 0x8e, 0xb0, 0xe5, 0x47, 0xa7, 0x70,
+    0xe4, 0x6b, 0x77, 0x31, 0x69, 0xb0, 0xd4, 0x7f, 0xe1, 0x67, 0xe0, 0x4e, 0x5d, 0x47, 0xc8, 0xd6,
+    0x15, 0x58, 0xab, 0x22, 0xd9, 0xf6, 0x24, 0xed, 0x1e, 0x0e, 0xdb, 0x65, 0x67, 0xc1, 0x50, 0x31,
+    0xb1, 0xf6, 0xb1, 0xc1, 0xef, 0x57, 0x10, 0x9b, 0xb1, 0x42, 0xe4, 0xb0, 0xd4, 0x33, 0xd2, 0xa3,
+    0x06, 0x46, 0xa4, 0x6e, 0x4b, 0xda, 0xfa, 0x8a, 0x64, 0xe4, 0x3f, 0x8f, 0x18, 0xab, 0x48, 0xe9,
+    0x88, 0x78, 0x73, 0x79, 0x01, 0x8c, 0x12, 0x42, 0xd5, 0xd5, 0xfd, 0xdb, 0xec, 0x84, 0xa0, 0x13,
+    0xc7, 0x00, 0xda, 0x35, 0x68, 0x84, 0x2b, 0x5a, 0x8b, 0xf2, 0x99, 0xfc, 0x8a, 0x49, 0xe1, 0x63,
+    0x03, 0x58, 0x59, 0x9c, 0x25, 0x48, 0x56, 0x02, 0xdc, 0xcc, 0x60, 0x79, 0xb5, 0x3d, 0x74, 0xca,
+    0x39, 0x97, 0xa1, 0xb8, 0x50, 0xea, 0x91, 0x09, 0x97, 0x5a, 0x3b, 0x22, 0xde, 0xc0, 0x76, 0xe3,
+    0x16, 0x96, 0x4b, 0xc5, 0x9c, 0xc1, 0xca, 0x70, 0x49, 0x0f, 0x90, 0x22, 0xb7, 0x7e, 0xa6, 0x4e,
+    0x89, 0x37, 0xf5, 0x31, 0x5a, 0x13, 0xe5, 0xd8, 0x6f, 0xaa, 0x72, 0xb5, 0x04, 0x5a, 0xda, 0x70,
+    0xe5, 0x8a, 0x4a, 0xc8, 0xaf, 0xdd, 0x00, 0xf8, 0x68, 0x97, 0x91, 0x56, 0xbb, 0x57, 0x57, 0xf0,
+    0x15, 0x39, 0x61, 0xc9, 0x29, 0xec, 0x65, 0x37, 0xe6, 0x17, 0xaf, 0x57, 0x4a, 0xe9, 0x71, 0xf8,
+    0xcd, 0x2e, 0xaa, 0x2e, 0xaf, 0x26, 0x0f, 0x65, 0x39, 0xea, 0xe9, 0xac, 0x41, 0xed, 0x55, 0x79,
+    0xcd, 0x33, 0x1f, 0x80, 0x36, 0x3b, 0x47, 0x0c, 0xb8, 0x45, 0x61, 0x38, 0xe7, 0x99, 0x09, 0x21,
+    0xdf, 0x16, 0x2b, 0xd0, 0x57, 0xf4, 0xf8, 0x02, 0x03, 0x00, 0x00, 0x00, 0x04, 0x00, 0x00, 0x00,
+    0x0c, 0x00, 0x00, 0x00, 0x52, 0x41, 0x44, 0x49, 0x4d, 0x49, 0x44, 0x50, 0x52, 0x4f, 0x4f, 0x54,
+    0x40, 0x42, 0x0f, 0x00, 0xb9, 0x18, 0x92, 0x79, 0xca, 0xb1, 0x05, 0x00, 0x88, 0xff, 0xf3, 0xd2,
+    0xbe, 0x1b, 0xca, 0x1e, 0x66, 0x57, 0xf3, 0x78, 0x49, 0xe3, 0x54, 0x32, 0x82, 0x0f, 0x05, 0x73,
+    0x10, 0x5b, 0xe6, 0xd5, 0x8f, 0xd0, 0x18, 0x87, 0xb4, 0xbb, 0x5b, 0x90, 0x46, 0x38, 0x05, 0x03,
+    0xad, 0x8b, 0x4d, 0xea, 0x28, 0x83, 0xe3, 0x85, 0x21, 0xae, 0x0e, 0x7d, 0x75, 0x86, 0x94, 0xad,
+    0xce, 0x8b, 0xdf, 0x40, 0xf3, 0x24, 0x0d, 0x1c, 0xc4, 0xbd, 0x73, 0xe3, 0x02, 0x00, 0x00, 0x00,
+    0x40, 0x00, 0x00, 0x00, 0x53, 0x49, 0x47, 0x00, 0x44, 0x45, 0x4c, 0x45, 0x8e, 0x4c, 0xa2, 0xa9,
+    0x39, 0xf7, 0xd6, 0xa8, 0xb3, 0xbb, 0xee, 0x2c, 0x30, 0xf1, 0xdb, 0x36, 0xe0, 0x54, 0x2c, 0xbb,
+    0x49, 0x32, 0xdc, 0x6f, 0x86, 0xf4, 0x26, 0x84, 0xe9, 0x4c, 0xb0, 0xc2, 0x75, 0x1e, 0x8b, 0x73,
+    0xcf, 0x04, 0x78, 0x95, 0x6b, 0x34, 0xd9, 0xa1, 0xb3, 0x43, 0xce, 0xbf, 0x15, 0x73, 0xc6, 0x9c,
+    0x8a, 0xe2, 0xc8, 0x88, 0x2a, 0x4e, 0x8c, 0x1e, 0xa3, 0xfb, 0xe6, 0x09, 0x03, 0x00, 0x00, 0x00,
+    0x20, 0x00, 0x00, 0x00, 0x28, 0x00, 0x00, 0x00, 0x50, 0x55, 0x42, 0x4b, 0x4d, 0x49, 0x4e, 0x54,
+    0x4d, 0x41, 0x58, 0x54, 0x1d, 0x2f, 0xff, 0xb9, 0x23, 0x86, 0x78, 0xc5, 0x77, 0xcb, 0x3c, 0x02,
+    0x6f, 0x5e, 0x2c, 0xf1, 0x67, 0xfb, 0x7b, 0x8b, 0xb4, 0x22, 0x6d, 0xe8, 0xbe, 0x0f, 0xa2, 0x15,
+    0x18, 0x06, 0x96, 0x78, 0xb9, 0xb8, 0xba, 0x5b, 0xb6, 0xb1, 0x05, 0x00, 0xb9, 0x58, 0xcf, 0xf8,
+    0x25, 0xb4, 0x05, 0x00, 0x05, 0x00, 0x00, 0x00,
+};
@@ -13,23 +13,17 @@
  * limitations under the License.
  */
 
-#include <stddef.h>
-#include <stdio.h>
-#include <assert.h>
+#ifndef CRAGGY_BENCH_FIXTURES_H
+#define CRAGGY_BENCH_FIXTURES_H
 
-#include "CraggyCrypto.h"
+#include <stdint.h>
 
-bool craggy_fillRandomBytes(uint8_t *randomBuf, size_t randomBufLen, CraggyResult *result)
-{
-    FILE *f = fopen("/dev/urandom", "rb");
-    if (f == NULL) {
-        *result = CraggyResultInternalError;
-        return false;
-    }
-    size_t read = fread(randomBuf, 1, randomBufLen, f);
-    assert(read == randomBufLen);
-    fclose(f);
-    *result = CraggyResultSuccess;
+// Responses of a test server laid out as real servers lay out theirs: an unbatched response with an empty PATH, and
+// one for the sixth nonce of a batch of 16.  Both are signed with the same root key and delegation.
+extern const uint8_t benchRootPublicKey[32];
+extern const uint8_t benchSingleNonce[64];
+extern const uint8_t benchSingleResponse[360];
+extern const uint8_t benchBatchedNonce[64];
+extern const uint8_t benchBatchedResponse[616];
 
-    return true;
-}
\ No newline at end of file
+#endif // CRAGGY_BENCH_FIXTURES_H
@@ -0,0 +1,563 @@
+/* Copyright 2020 Johan Lindquist
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <arpa/inet.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(CRAGGY_BENCH_OPENSSL)
+#include <openssl/crypto.h>
+#endif
+
+#include "fixtures.h"
+#include "CraggyClient.h"
+#include "CraggyCrypto.h"
+#include "CraggyProtocol.h"
+#include "CraggyTransport.h"
+
+#if !defined(CRAGGY_BENCH_BACKEND)
+#define CRAGGY_BENCH_BACKEND "unknown"
+#endif
+
+// Iterations of each operation unless specified otherwise.  Round trips to the stub server use a tenth of them.
+#define BENCH_DEFAULT_ITERATIONS 10000
+
+// Largest capture accepted.
+#define BENCH_MAX_CAPTURE_SIZE 4096
+
+#define CRAGGY_DELEGATION_CONTEXT "RoughTime v1 delegation signature--"
+
+// A response to replay, along with the nonce and key it was requested with.
+typedef struct
+{
+    const char *name;
+    uint8_t nonce[CRAGGY_ROUGH_TIME_NONCE_LENGTH];
+    craggy_rough_time_public_key_t rootPublicKey;
+    uint8_t response[BENCH_MAX_CAPTURE_SIZE];
+    size_t responseLen;
+
+    // The certificate signature of the response, for benchmarking the crypto backend on its own
+    uint8_t signature[CRAGGY_ROUGH_TIME_SIGNATURE_LENGTH];
+    uint8_t signedData[BENCH_MAX_CAPTURE_SIZE];
+    size_t signedDataLen;
+} BenchResponse;
+
+// An operation to benchmark, returning false if it failed.
+typedef bool (*BenchOp)(void *context);
+
+#if defined(CRAGGY_BENCH_COUNT_ALLOCATIONS)
+// The library's allocations are counted by wrapping the allocator at link time (-Wl,--wrap)
+static uint64_t allocations;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t num, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size)
+{
+    allocations++;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t num, size_t size)
+{
+    allocations++;
+    return __real_calloc(num, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    allocations++;
+    return __real_realloc(ptr, size);
+}
+
+#if defined(CRAGGY_BENCH_OPENSSL)
+// libcrypto is linked dynamically, its allocations go through its own hooks
+static void *CountingCryptoMalloc(size_t size, const char *file, int line)
+{
+    (void)file;
+    (void)line;
+    allocations++;
+    return __real_malloc(size);
+}
+
+static void *CountingCryptoRealloc(void *ptr, size_t size, const char *file, int line)
+{
+    (void)file;
+    (void)line;
+    allocations++;
+    return __real_realloc(ptr, size);
+}
+
+static void CountingCryptoFree(void *ptr, const char *file, int line)
+{
+    (void)file;
+    (void)line;
+    free(ptr);
+}
+#endif
+#endif
+
+static uint64_t MonotonicNs(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static int CompareSamples(const void *a, const void *b)
+{
+    const uint64_t sampleA = *(const uint64_t *)a;
+    const uint64_t sampleB = *(const uint64_t *)b;
+    return sampleA < sampleB ? -1 : sampleA > sampleB;
+}
+
+// Bench runs an operation the number of times specified and reports its mean, median and 99th percentile latency
+// along with the allocations it makes.
+static bool Bench(const char *name, BenchOp op, void *context, size_t iterations)
+{
+    uint64_t *samples = malloc(iterations * sizeof(uint64_t));
+    if (samples == NULL)
+    {
+        return false;
+    }
+
+    // One untimed run to warm up caches of the library and the crypto backend
+    if (!op(context))
+    {
+        printf("%-44s failed\n", name);
+        free(samples);
+        return false;
+    }
+
+#if defined(CRAGGY_BENCH_COUNT_ALLOCATIONS)
+    const uint64_t allocationsBefore = allocations;
+#endif
+    uint64_t total = 0;
+    for (size_t i = 0; i < iterations; i++)
+    {
+        const uint64_t start = MonotonicNs();
+        bool success = op(context);
+        samples[i] = MonotonicNs() - start;
+        total += samples[i];
+        if (!success)
+        {
+            printf("%-44s failed\n", name);
+            free(samples);
+            return false;
+        }
+    }
+
+    qsort(samples, iterations, sizeof(uint64_t), CompareSamples);
+    printf("%-44s %10.1f ns/op  p50 %9" PRIu64 "  p99 %9" PRIu64, name, (double)total / iterations, samples[iterations / 2], samples[iterations * 99 / 100]);
+#if defined(CRAGGY_BENCH_COUNT_ALLOCATIONS)
+    printf("  %6.2f allocs/op\n", (double)(allocations - allocationsBefore) / iterations);
+#else
+    printf("  allocs/op n/a\n");
+#endif
+
+    free(samples);
+    return true;
+}
+
+// PrepareSignature extracts the certificate signature and the data it signs from a response.
+static bool PrepareSignature(BenchResponse *response)
+{
+    CraggyRoughtimeMessage message;
+    CraggyRoughtimeMessage certificate;
+    uint8_t *cert;
+    size_t certLen;
+    uint8_t *signature;
+    uint8_t *delegation;
+    size_t delegationLen;
+
+    if (!craggy_parseMessageInto(response->response, response->responseLen, &message) ||
+        !craggy_getTag(&message, &cert, &certLen, CRAGGY_TAG_CERT) ||
+        !craggy_parseMessageInto(cert, certLen, &certificate) ||
+        !craggy_getFixedLenTag(&certificate, &signature, CRAGGY_TAG_SIG, CRAGGY_ROUGH_TIME_SIGNATURE_LENGTH) ||
+        !craggy_getTag(&certificate, &delegation, &delegationLen, CRAGGY_TAG_DELE) ||
+        sizeof(CRAGGY_DELEGATION_CONTEXT) + delegationLen > sizeof(response->signedData))
+    {
+        return false;
+    }
+
+    memcpy(response->signature, signature, CRAGGY_ROUGH_TIME_SIGNATURE_LENGTH);
+    // The context is followed by its terminating zero
+    memcpy(response->signedData, CRAGGY_DELEGATION_CONTEXT, sizeof(CRAGGY_DELEGATION_CONTEXT));
+    memcpy(response->signedData + sizeof(CRAGGY_DELEGATION_CONTEXT), delegation, delegationLen);
+    response->signedDataLen = sizeof(CRAGGY_DELEGATION_CONTEXT) + delegationLen;
+    return true;
+}
+
+static bool InitResponse(BenchResponse *response, const char *name, const uint8_t *nonce, const uint8_t *rootPublicKey, const uint8_t *data, size_t dataLen)
+{
+    response->name = name;
+    memcpy(response->nonce, nonce, CRAGGY_ROUGH_TIME_NONCE_LENGTH);
+    memcpy(response->rootPublicKey, rootPublicKey, CRAGGY_ROUGH_TIME_PUBLIC_KEY_LENGTH);
+    memcpy(response->response, data, dataLen);
+    response->responseLen = dataLen;
+    return PrepareSignature(response);
+}
+
+// LoadCapture reads a response captured using craggy-cli -w: the nonce, the root public key and the response.
+static bool LoadCapture(BenchResponse *response, const char *path)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        return false;
+    }
+    uint8_t capture[CRAGGY_ROUGH_TIME_NONCE_LENGTH + CRAGGY_ROUGH_TIME_PUBLIC_KEY_LENGTH + BENCH_MAX_CAPTURE_SIZE];
+    size_t captureLen = fread(capture, 1, sizeof(capture), file);
+    fclose(file);
+
+    const size_t headerLen = CRAGGY_ROUGH_TIME_NONCE_LENGTH + CRAGGY_ROUGH_TIME_PUBLIC_KEY_LENGTH;
+    if (captureLen <= headerLen)
+    {
+        return false;
+    }
+    return InitResponse(response, path, capture, capture + CRAGGY_ROUGH_TIME_NONCE_LENGTH, capture + headerLen, captureLen - headerLen);
+}
+
+static bool ParseMessage(void *context)
+{
+    const BenchResponse *response = context;
+    CraggyRoughtimeMessage *message = NULL;
+    bool success = craggy_parseMessage(response->response, response->responseLen, &message);
+    craggy_destroyMessage(message);
+    return success;
+}
+
+static bool ParseMessageInto(void *context)
+{
+    const BenchResponse *response = context;
+    CraggyRoughtimeMessage message;
+    return craggy_parseMessageInto(response->response, response->responseLen, &message);
+}
+
+static bool ProcessResponse(void *context)
+{
+    BenchResponse *response = context;
+    CraggyResult result;
+    craggy_rough_time_t time;
+    craggy_rough_time_radius_t radius;
+    return craggy_processResponse(response->nonce, response->rootPublicKey, response->response, response->responseLen, &result, &time, &radius);
+}
+
+typedef struct
+{
+    BenchResponse *response;
+    CraggyDelegationCache *cache;
+} CachedResponse;
+
+static bool ProcessResponseWithCache(void *context)
+{
+    CachedResponse *cached = context;
+    CraggyResult result;
+    craggy_rough_time_t time;
+    craggy_rough_time_radius_t radius;
+    return craggy_processResponseWithCache(cached->response->nonce, cached->response->rootPublicKey, cached->cache, cached->response->response, cached->response->responseLen, &result, &time, &radius);
+}
+
+static bool VerifySignature(void *context)
+{
+    const BenchResponse *response = context;
+    return craggy_verifySignature(response->rootPublicKey, response->signature, response->signedData, response->signedDataLen);
+}
+
+typedef struct
+{
+    const BenchResponse *response;
+    CraggyPublicKey *key;
+} PreparedSignature;
+
+static bool VerifyPreparedSignature(void *context)
+{
+    const PreparedSignature *prepared = context;
+    return craggy_verifyPreparedSignature(prepared->key, prepared->response->signature, prepared->response->signedData, prepared->response->signedDataLen);
+}
+
+typedef struct
+{
+    uint8_t data[CRAGGY_ROUGH_TIME_MIN_REQUEST_SIZE];
+    size_t len;
+} HashInput;
+
+static bool CalculateSHA512(void *context)
+{
+    const HashInput *input = context;
+    uint8_t hash[CRAGGY_ROUGH_TIME_HASH_LENGTH];
+    return craggy_calculateSHA512(input->data, input->len, hash);
+}
+
+static bool GenerateNonce(void *context)
+{
+    (void)context;
+    CraggyResult result;
+    craggy_rough_time_nonce_t nonce;
+    return craggy_generateNonce(&result, nonce);
+}
+
+static bool CreateRequest(void *context)
+{
+    uint8_t *nonce = context;
+    craggy_rough_time_request_t requestBuf;
+    return craggy_createRequest(nonce, requestBuf);
+}
+
+typedef struct
+{
+    craggy_rough_time_request_t requestBuf;
+    uint8_t nonce[CRAGGY_ROUGH_TIME_NONCE_LENGTH];
+} RequestTemplate;
+
+static bool SetRequestNonce(void *context)
+{
+    RequestTemplate *request = context;
+    craggy_setRequestNonce(request->requestBuf, request->nonce);
+    return true;
+}
+
+static bool ParseRequestNonce(void *context)
+{
+    const RequestTemplate *request = context;
+    const uint8_t *nonce;
+    return craggy_parseRequestNonce(request->requestBuf, CRAGGY_ROUGH_TIME_MIN_REQUEST_SIZE, &nonce);
+}
+
+// The stub server answers every request with the same response, as fast as it can.
+typedef struct
+{
+    int fd;
+    const uint8_t *response;
+    size_t responseLen;
+} StubServer;
+
+static void *RunStubServer(void *context)
+{
+    StubServer *server = context;
+    uint8_t request[2 * CRAGGY_ROUGH_TIME_MIN_REQUEST_SIZE];
+    struct sockaddr_storage from;
+    while (1)
+    {
+        socklen_t fromLen = sizeof(from);
+        ssize_t len = recvfrom(server->fd, request, sizeof(request), 0, (struct sockaddr *)&from, &fromLen);
+        if (len > 0)
+        {
+            sendto(server->fd, server->response, server->responseLen, 0, (struct sockaddr *)&from, fromLen);
+        }
+    }
+    return NULL;
+}
+
+static bool StartStubServer(StubServer *server, char *address, size_t addressLen)
+{
+    server->fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (server->fd < 0)
+    {
+        return false;
+    }
+
+    struct sockaddr_in bound;
+    memset(&bound, 0, sizeof(bound));
+    bound.sin_family = AF_INET;
+    bound.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t boundLen = sizeof(bound);
+    if (bind(server->fd, (struct sockaddr *)&bound, sizeof(bound)) != 0 ||
+        getsockname(server->fd, (struct sockaddr *)&bound, &boundLen) != 0)
+    {
+        close(server->fd);
+        return false;
+    }
+    snprintf(address, addressLen, "127.0.0.1:%u", ntohs(bound.sin_port));
+
+    // Left running until the process exits
+    pthread_t thread;
+    return pthread_create(&thread, NULL, RunStubServer, server) == 0 && pthread_detach(thread) == 0;
+}
+
+typedef struct
+{
+    const char *address;
+    CraggyTransport *transport;
+    craggy_rough_time_request_t requestBuf;
+} RoundTrip;
+
+static bool MakeRequest(void *context)
+{
+    RoundTrip *roundTrip = context;
+    CraggyResult result;
+    craggy_rough_time_response_t responseBuf[BENCH_MAX_CAPTURE_SIZE];
+    size_t responseBufLen = sizeof(responseBuf);
+    return craggy_makeRequest(roundTrip->address, roundTrip->requestBuf, &result, responseBuf, &responseBufLen);
+}
+
+static bool TransportRequest(void *context)
+{
+    RoundTrip *roundTrip = context;
+    CraggyResult result;
+    craggy_rough_time_response_t responseBuf[BENCH_MAX_CAPTURE_SIZE];
+    size_t responseBufLen = sizeof(responseBuf);
+    return craggy_transportRequest(roundTrip->transport, roundTrip->requestBuf, &result, responseBuf, &responseBufLen);
+}
+
+static bool BenchResponses(BenchResponse *response, size_t iterations)
+{
+    char name[256];
+    bool success = true;
+
+    printf("\n%s (%zu bytes)\n", response->name, response->responseLen);
+
+    snprintf(name, sizeof(name), "  craggy_parseMessage");
+    success = Bench(name, ParseMessage, response, iterations) && success;
+    snprintf(name, sizeof(name), "  craggy_parseMessageInto");
+    success = Bench(name, ParseMessageInto, response, iterations) && success;
+
+    snprintf(name, sizeof(name), "  craggy_processResponse");
+    success = Bench(name, ProcessResponse, response, iterations) && success;
+
+    CachedResponse cached = {response, NULL};
+    if (craggy_createDelegationCache(1, &cached.cache))
+    {
+        snprintf(name, sizeof(name), "  craggy_processResponseWithCache (cached)");
+        success = Bench(name, ProcessResponseWithCache, &cached, iterations) && success;
+        craggy_destroyDelegationCache(cached.cache);
+    }
+
+    snprintf(name, sizeof(name), "  craggy_verifySignature");
+    success = Bench(name, VerifySignature, response, iterations) && success;
+
+    PreparedSignature prepared = {response, NULL};
+    if (craggy_publicKeyPrepare(response->rootPublicKey, &prepared.key))
+    {
+        snprintf(name, sizeof(name), "  craggy_verifyPreparedSignature");
+        success = Bench(name, VerifyPreparedSignature, &prepared, iterations) && success;
+        craggy_publicKeyRelease(prepared.key);
+    }
+
+    return success;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t iterations = BENCH_DEFAULT_ITERATIONS;
+
+    int c;
+    while ((c = getopt(argc, argv, "n:")) != -1)
+    {
+        switch (c)
+        {
+        case 'n':
+            iterations = strtoul(optarg, NULL, 10);
+            break;
+
+        default:
+            printf("usage: craggy-bench (-n <iterations>) (<capture file> ...)\n");
+            return 1;
+        }
+    }
+    if (iterations < 10)
+    {
+        iterations = 10;
+    }
+
+#if defined(CRAGGY_BENCH_COUNT_ALLOCATIONS) && defined(CRAGGY_BENCH_OPENSSL)
+    CRYPTO_set_mem_functions(CountingCryptoMalloc, CountingCryptoRealloc, CountingCryptoFree);
+#endif
+
+    printf("craggy-bench, %s crypto backend, %zu iterations\n", CRAGGY_BENCH_BACKEND, iterations);
+
+    const size_t numResponses = 2 + (size_t)(argc - optind);
+    BenchResponse *responses = calloc(numResponses, sizeof(BenchResponse));
+    if (responses == NULL)
+    {
+        return 1;
+    }
+
+    if (!InitResponse(&responses[0], "Unbatched response", benchSingleNonce, benchRootPublicKey, benchSingleResponse, sizeof(benchSingleResponse)) ||
+        !InitResponse(&responses[1], "Batched response (16 requests)", benchBatchedNonce, benchRootPublicKey, benchBatchedResponse, sizeof(benchBatchedResponse)))
+    {
+        printf("Error preparing built-in responses\n");
+        free(responses);
+        return 1;
+    }
+    for (int i = optind; i < argc; i++)
+    {
+        if (!LoadCapture(&responses[2 + i - optind], argv[i]))
+        {
+            printf("Error loading capture %s\n", argv[i]);
+            free(responses);
+            return 1;
+        }
+    }
+
+    bool success = true;
+    for (size_t i = 0; i < numResponses; i++)
+    {
+        success = BenchResponses(&responses[i], iterations) && success;
+    }
+
+    printf("\nHashing\n");
+    HashInput leaf = {{0}, 1 + CRAGGY_ROUGH_TIME_NONCE_LENGTH};
+    success = Bench("  craggy_calculateSHA512 (Merkle leaf)", CalculateSHA512, &leaf, iterations) && success;
+    HashInput request = {{0}, CRAGGY_ROUGH_TIME_MIN_REQUEST_SIZE};
+    success = Bench("  craggy_calculateSHA512 (1024 bytes)", CalculateSHA512, &request, iterations) && success;
+
+    printf("\nRequests\n");
+    success = Bench("  craggy_generateNonce", GenerateNonce, NULL, iterations) && success;
+    success = Bench("  craggy_createRequest", CreateRequest, responses[0].nonce, iterations) && success;
+    RequestTemplate requestTemplate;
+    memcpy(requestTemplate.nonce, responses[0].nonce, CRAGGY_ROUGH_TIME_NONCE_LENGTH);
+    if (craggy_createRequestTemplate(requestTemplate.requestBuf))
+    {
+        success = Bench("  craggy_setRequestNonce", SetRequestNonce, &requestTemplate, iterations) && success;
+        success = Bench("  craggy_parseRequestNonce", ParseRequestNonce, &requestTemplate, iterations) && success;
+    }
+
+    printf("\nRound trips to a local stub server\n");
+    StubServer server = {-1, responses[0].response, responses[0].responseLen};
+    char address[64];
+    RoundTrip roundTrip;
+    memset(&roundTrip, 0, sizeof(roundTrip));
+    roundTrip.address = address;
+    if (StartStubServer(&server, address, sizeof(address)) && craggy_createRequest(responses[0].nonce, roundTrip.requestBuf))
+    {
+        const size_t roundTrips = iterations / 10;
+        success = Bench("  craggy_makeRequest", MakeRequest, &roundTrip, roundTrips) && success;
+
+        CraggyResult result;
+        if (craggy_transportOpen(address, &roundTrip.transport, &result))
+        {
+            success = Bench("  craggy_transportRequest", TransportRequest, &roundTrip, roundTrips) && success;
+            craggy_transportClose(roundTrip.transport);
+        }
+    }
+    else
+    {
+        printf("Error starting stub server\n");
+        success = false;
+    }
+
+    free(responses);
+    return success ? 0 : 1;
+}
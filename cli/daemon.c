@@ -0,0 +1,624 @@
+/* Copyright 2020 Johan Lindquist
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "daemon.h"
+#include "servers.h"
+#include "CraggyAuditLog.h"
+#include "CraggyClockFilter.h"
+#include "CraggyConsensus.h"
+#include "CraggyCrypto.h"
+#include "CraggySharedCache.h"
+#include "CraggyStats.h"
+#include "CraggyTimeCache.h"
+#include "CraggyTimeExport.h"
+#include "CraggyTransport.h"
+#include "CraggyWarmStart.h"
+#include "CraggyClient.h"
+#include "CraggyClock.h"
+
+// Milliseconds to wait for the responses of one poll.
+#define DAEMON_QUERY_TIMEOUT_MS 1000
+
+// Polls are spread by up to this fraction of the interval either way, so many clients do not poll in lockstep.
+#define DAEMON_INTERVAL_JITTER 0.1
+
+// Fewest and most seconds between polls spaced by how fast the uncertainty of the filtered offset grows.
+#define DAEMON_MIN_INTERVAL 16
+#define DAEMON_MAX_INTERVAL 1024
+
+// Seconds a sample another process on the host received stands in for a query of our own.
+#define DAEMON_SHARED_SAMPLE_MAX_AGE DAEMON_MIN_INTERVAL
+
+typedef struct
+{
+    char *address;
+    craggy_rough_time_public_key_t rootPublicKey;
+    // NULL until the transport could be opened, retried every poll
+    CraggyTransport *transport;
+} DaemonServer;
+
+static volatile sig_atomic_t running = 1;
+
+static void StopDaemon(int signal)
+{
+    (void)signal;
+    running = 0;
+}
+
+static void FreeServers(DaemonServer *servers, size_t numServers)
+{
+    for (size_t i = 0; i < numServers; i++)
+    {
+        craggy_transportClose(servers[i].transport);
+        free(servers[i].address);
+    }
+    free(servers);
+}
+
+// LoadServers reads the servers listed in the config file.
+static int LoadServers(const char *configPath, DaemonServer **outServers, size_t *outNumServers)
+{
+    ServerEntry *entries = NULL;
+    size_t numEntries = 0;
+    if (LoadServerList(configPath, &entries, &numEntries) != 0)
+    {
+        return 1;
+    }
+    if (numEntries == 0)
+    {
+        fprintf(stderr, "%s: no servers configured\n", configPath);
+        FreeServerList(entries, numEntries);
+        return 1;
+    }
+
+    DaemonServer *servers = calloc(numEntries, sizeof(DaemonServer));
+    if (servers == NULL)
+    {
+        FreeServerList(entries, numEntries);
+        return 1;
+    }
+    // The addresses are handed over to the servers, only the list itself is freed
+    for (size_t i = 0; i < numEntries; i++)
+    {
+        servers[i].address = entries[i].address;
+        memcpy(servers[i].rootPublicKey, entries[i].rootPublicKey, CRAGGY_ROUGH_TIME_PUBLIC_KEY_LENGTH);
+    }
+    free(entries);
+
+    *outServers = servers;
+    *outNumServers = numEntries;
+    return 0;
+}
+
+// PublishOffset replaces the contents of the output file with the consensus, so readers never see a partial write.
+static void PublishOffset(const char *outputPath, const CraggyConsensus *consensus, size_t numServers, time_t now)
+{
+    size_t tmpPathLen = strlen(outputPath) + sizeof(".tmp");
+    char tmpPath[tmpPathLen];
+    snprintf(tmpPath, tmpPathLen, "%s.tmp", outputPath);
+
+    FILE *file = fopen(tmpPath, "w");
+    if (file == NULL)
+    {
+        printf("Error opening %s: %s\n", tmpPath, strerror(errno));
+        return;
+    }
+    fprintf(file, "time=%" PRId64 "\noffset_us=%" PRId64 "\nuncertainty_us=%" PRIu64 "\nservers=%zu/%zu\n",
+            (int64_t)now, consensus->offset, consensus->uncertainty, consensus->numAgreeing, numServers);
+    if (fclose(file) != 0 || rename(tmpPath, outputPath) != 0)
+    {
+        printf("Error writing %s: %s\n", outputPath, strerror(errno));
+    }
+}
+
+#if defined(CRAGGY_WITH_STATS)
+// Histogram buckets shorter than this many nanoseconds are only exported summed into the first one.
+#define DAEMON_METRICS_MIN_BUCKET 1024
+
+// WriteMetrics replaces the contents of the metrics file with a snapshot of the library's stats in the Prometheus text
+// format, bucketing the durations of each stage by powers of two.
+static void WriteMetrics(const char *metricsPath)
+{
+    size_t tmpPathLen = strlen(metricsPath) + sizeof(".tmp");
+    char tmpPath[tmpPathLen];
+    snprintf(tmpPath, tmpPathLen, "%s.tmp", metricsPath);
+
+    CraggyStatsSnapshot snapshot;
+    craggy_statsSnapshot(&snapshot);
+
+    FILE *file = fopen(tmpPath, "w");
+    if (file == NULL)
+    {
+        printf("Error opening %s: %s\n", tmpPath, strerror(errno));
+        return;
+    }
+
+    fprintf(file, "# HELP craggy_stage_duration_seconds Time spent in each stage of a query.\n"
+                  "# TYPE craggy_stage_duration_seconds histogram\n");
+    for (size_t stage = 0; stage < CraggyStageCount; stage++)
+    {
+        const CraggyStageHistogram *histogram = &snapshot.stages[stage];
+        const char *name = craggy_statsStageName((CraggyStage)stage);
+        // Counted from the buckets, so that the count is the same as that of the +Inf bucket
+        uint64_t count = 0;
+        for (size_t bucket = 0; bucket < CRAGGY_STATS_BUCKETS; bucket++)
+        {
+            count += histogram->buckets[bucket];
+            const uint64_t limit = craggy_statsBucketLimit(bucket);
+            // Durations are whole nanoseconds, those up to a power of two less one are the ones below it
+            if (limit != UINT64_MAX && ((limit + 1) & limit) == 0 && limit + 1 >= DAEMON_METRICS_MIN_BUCKET)
+            {
+                fprintf(file, "craggy_stage_duration_seconds_bucket{stage=\"%s\",le=\"%.9g\"} %" PRIu64 "\n", name,
+                        (double)(limit + 1) / 1e9, count);
+            }
+        }
+        fprintf(file, "craggy_stage_duration_seconds_bucket{stage=\"%s\",le=\"+Inf\"} %" PRIu64 "\n", name, count);
+        fprintf(file, "craggy_stage_duration_seconds_sum{stage=\"%s\"} %.9f\n", name, (double)histogram->sum / 1e9);
+        fprintf(file, "craggy_stage_duration_seconds_count{stage=\"%s\"} %" PRIu64 "\n", name, count);
+    }
+
+    fprintf(file, "# HELP craggy_query_results_total Queries finished, by result code.\n"
+                  "# TYPE craggy_query_results_total counter\n");
+    for (unsigned resultClass = 0; resultClass < CRAGGY_STATS_RESULT_CLASSES; resultClass++)
+    {
+        for (unsigned detail = 0; detail < CRAGGY_STATS_RESULT_DETAILS; detail++)
+        {
+            const CraggyResult code = (CraggyResult)(resultClass * 100 + detail);
+            const uint64_t count = craggy_statsResultCount(&snapshot, code);
+            if (count > 0)
+            {
+                fprintf(file, "craggy_query_results_total{result=\"%d\"} %" PRIu64 "\n", code, count);
+            }
+        }
+    }
+
+    if (fclose(file) != 0 || rename(tmpPath, metricsPath) != 0)
+    {
+        printf("Error writing %s: %s\n", metricsPath, strerror(errno));
+    }
+}
+#endif
+
+// JitteredInterval returns the interval moved randomly by up to DAEMON_INTERVAL_JITTER of itself.
+static double JitteredInterval(double interval)
+{
+    CraggyResult craggyResult;
+    uint32_t random = 0;
+    craggy_fillRandomBytes((uint8_t *)&random, sizeof(random), &craggyResult);
+    double jitter = ((double)random / UINT32_MAX) * 2 - 1;
+    return interval * (1 + DAEMON_INTERVAL_JITTER * jitter);
+}
+
+// AuditPoll appends the verified responses of a poll to the audit log, flushing them to disk.
+static void AuditPoll(CraggyAuditLog *auditLog, DaemonServer *servers, const CraggyServerQuery *queries, const size_t *serverIndex,
+                      const CraggyAuditChain *chains, size_t numQueries)
+{
+    CraggyResult craggyResult;
+    for (size_t i = 0; i < numQueries; i++)
+    {
+        const CraggyServerQuery *query = &queries[i];
+        if (query->result != CraggyResultSuccess || query->responseLen == 0)
+        {
+            continue;
+        }
+        if (!craggy_auditLogAppend(auditLog, &chains[serverIndex[i]], query->nonce, query->rootPublicKey, query->responseBuf,
+                                   query->responseLen, query->receivedAt, &craggyResult))
+        {
+            printf("%s: error appending to audit log: %d\n", servers[serverIndex[i]].address, craggyResult);
+        }
+    }
+    if (!craggy_auditLogSync(auditLog, &craggyResult))
+    {
+        printf("Error flushing audit log: %d\n", craggyResult);
+    }
+}
+
+// ShareSamples publishes the verified samples of a poll in the shared cache, for other processes to take up.
+static void ShareSamples(CraggySharedCache *sharedCache, const CraggyServerQuery *queries, size_t numQueries)
+{
+    // The monotonic clock the responses arrived at, as near as the realtime clock tells
+    const uint64_t monotonic = craggy_monotonicNs();
+    const craggy_rough_time_t now = craggy_realtimeUs();
+    for (size_t i = 0; i < numQueries; i++)
+    {
+        const CraggyServerQuery *query = &queries[i];
+        if (query->result != CraggyResultSuccess)
+        {
+            continue;
+        }
+        CraggySharedSample sample;
+        sample.time = query->time;
+        sample.radius = query->radius;
+        sample.roundTripTime = query->roundTripTime;
+        sample.receivedAt = query->receivedAt;
+        sample.receivedMonotonic = monotonic - (now > query->receivedAt ? now - query->receivedAt : 0) * 1000;
+        craggy_sharedCachePublishSample(sharedCache, query->rootPublicKey, &sample);
+    }
+}
+
+// FindConsensus finds the offset the servers queried and the samples taken from the shared cache agree on.
+static bool FindConsensus(const CraggyServerQuery *queries, size_t numQueries, const CraggySharedSample *shared, size_t numShared,
+                          size_t quorum, CraggyConsensus *consensus)
+{
+    CraggyResult craggyResult;
+    CraggyTimeSample samples[numQueries + numShared];
+    size_t numSamples = 0;
+    for (size_t i = 0; i < numQueries; i++)
+    {
+        if (queries[i].result == CraggyResultSuccess)
+        {
+            craggy_makeTimeSample(queries[i].time, queries[i].radius, queries[i].roundTripTime, queries[i].receivedAt, &samples[numSamples++]);
+        }
+    }
+    for (size_t i = 0; i < numShared; i++)
+    {
+        craggy_makeTimeSample(shared[i].time, shared[i].radius, shared[i].roundTripTime, shared[i].receivedAt, &samples[numSamples++]);
+    }
+    if (numSamples == 0)
+    {
+        memset(consensus, 0, sizeof(CraggyConsensus));
+        return false;
+    }
+    return craggy_findConsensus(samples, numSamples, quorum, consensus, &craggyResult);
+}
+
+static void Poll(DaemonServer *servers, size_t numServers, CraggyDelegationCache *cache, const char *outputPath, CraggyTimeExport *timeExport, CraggyTimeCache *timeCache, CraggyClockFilter *filter, CraggyAuditLog *auditLog,
+                 CraggySharedCache *sharedCache)
+{
+    CraggyResult craggyResult;
+
+    CraggyServerQuery queries[numServers];
+    craggy_rough_time_nonce_t nonces[numServers];
+    size_t serverIndex[numServers];
+    CraggyAuditChain chains[numServers];
+    CraggySharedSample shared[numServers];
+    size_t sharedIndex[numServers];
+
+    // Every poll asks with nonces of its own, replayed responses can not be mistaken for fresh ones.  Audited, the
+    // nonces are derived from the last response kept, chaining the responses of this poll to it.
+    if (auditLog != NULL)
+    {
+        for (size_t i = 0; i < numServers; i++)
+        {
+            if (!craggy_auditLogNextNonce(auditLog, &chains[i], nonces[i], &craggyResult))
+            {
+                printf("Error deriving nonces: %d\n", craggyResult);
+                return;
+            }
+        }
+    }
+    else if (!craggy_generateNonces(&craggyResult, nonces, numServers))
+    {
+        printf("Error generating nonces: %d\n", craggyResult);
+        return;
+    }
+
+    uint8_t (*responses)[CRAGGY_TRANSPORT_MAX_RESPONSE_SIZE] = NULL;
+    if (auditLog != NULL && (responses = malloc(numServers * CRAGGY_TRANSPORT_MAX_RESPONSE_SIZE)) == NULL)
+    {
+        printf("Error allocating response buffers\n");
+        return;
+    }
+
+    size_t numQueries = 0;
+    size_t numShared = 0;
+    for (size_t i = 0; i < numServers; i++)
+    {
+        // Servers another process on the host has just asked are not asked again, unless the responses are audited.  Our
+        // own samples from the poll before are no news, they are in the filter already.
+        if (sharedCache != NULL && auditLog == NULL &&
+            craggy_sharedCacheFindSample(sharedCache, servers[i].rootPublicKey, (uint64_t)DAEMON_SHARED_SAMPLE_MAX_AGE * 1000000000, &shared[numShared]) &&
+            shared[numShared].publisher != getpid())
+        {
+            sharedIndex[numShared++] = i;
+            continue;
+        }
+        if (servers[i].transport == NULL && !craggy_transportOpen(servers[i].address, &servers[i].transport, &craggyResult))
+        {
+            printf("%s: error opening transport: %d\n", servers[i].address, craggyResult);
+            continue;
+        }
+        memset(&queries[numQueries], 0, sizeof(CraggyServerQuery));
+        queries[numQueries].transport = servers[i].transport;
+        queries[numQueries].rootPublicKey = servers[i].rootPublicKey;
+        queries[numQueries].nonce = nonces[i];
+        queries[numQueries].responseBuf = responses != NULL ? responses[i] : NULL;
+        serverIndex[numQueries] = i;
+        numQueries++;
+    }
+
+    // A majority of all servers configured has to agree, not just of those that answered - the rest are not waited for
+    const size_t quorum = numServers / 2 + 1;
+    if (numQueries + numShared < quorum)
+    {
+        printf("No consensus: %zu of %zu servers can be asked\n", numQueries + numShared, numServers);
+        free(responses);
+        return;
+    }
+    CraggyConsensus consensus;
+    bool agreed;
+    if (numShared == 0)
+    {
+        agreed = craggy_queryQuorum(queries, numQueries, cache, quorum, DAEMON_QUERY_TIMEOUT_MS, &consensus);
+    }
+    else
+    {
+        // The quorum counts the samples taken from the shared cache too, so every server asked is waited for
+        if (numQueries > 0)
+        {
+            craggy_queryServers(queries, numQueries, cache, DAEMON_QUERY_TIMEOUT_MS);
+        }
+        agreed = FindConsensus(queries, numQueries, shared, numShared, quorum, &consensus);
+    }
+    if (sharedCache != NULL)
+    {
+        ShareSamples(sharedCache, queries, numQueries);
+    }
+    // Whether or not they agree, responses that verified are evidence of what the servers said
+    if (auditLog != NULL)
+    {
+        AuditPoll(auditLog, servers, queries, serverIndex, chains, numQueries);
+        free(responses);
+    }
+
+    for (size_t i = 0; i < numQueries; i++)
+    {
+        const CraggyServerQuery *query = &queries[i];
+        if (query->result == CraggyResultNetworkTimeout && agreed)
+        {
+            printf("%s: not waited for\n", servers[serverIndex[i]].address);
+            continue;
+        }
+        if (query->result != CraggyResultSuccess)
+        {
+            printf("%s: error %d\n", servers[serverIndex[i]].address, query->result);
+            continue;
+        }
+        CraggyTimeSample sample;
+        craggy_makeTimeSample(query->time, query->radius, query->roundTripTime, query->receivedAt, &sample);
+        printf("%s: offset %" PRId64 "μs ±%" PRIu64 "μs, round trip %" PRIu64 "μs\n", servers[serverIndex[i]].address,
+               sample.offset, sample.uncertainty, query->roundTripTime);
+    }
+    for (size_t i = 0; i < numShared; i++)
+    {
+        CraggyTimeSample sample;
+        craggy_makeTimeSample(shared[i].time, shared[i].radius, shared[i].roundTripTime, shared[i].receivedAt, &sample);
+        printf("%s: offset %" PRId64 "μs ±%" PRIu64 "μs, shared %.1fs ago\n", servers[sharedIndex[i]].address,
+               sample.offset, sample.uncertainty, (double)(craggy_monotonicNs() - shared[i].receivedMonotonic) / 1e9);
+    }
+
+    if (!agreed)
+    {
+        printf("No consensus: %zu of %zu servers agree\n", consensus.numAgreeing, numServers);
+        return;
+    }
+
+    const craggy_rough_time_t now = craggy_realtimeUs();
+    if (timeExport != NULL)
+    {
+        craggy_timeExportPublish(timeExport, now + consensus.offset, consensus.uncertainty, now);
+    }
+    const uint64_t monotonic = craggy_monotonicNs();
+    if (timeCache != NULL)
+    {
+        craggy_timeCacheAdd(timeCache, now + consensus.offset, consensus.uncertainty, monotonic);
+    }
+
+    printf("System clock differs by %" PRId64 "μs ±%" PRIu64 "μs (%zu of %zu servers agree)\n",
+           consensus.offset, consensus.uncertainty, consensus.numAgreeing, numServers);
+
+    // Filtered against the monotonic clock, which steps of the system clock leave alone
+    switch (craggy_clockFilterUpdate(filter, (int64_t)(now + consensus.offset) - (int64_t)(monotonic / 1000), consensus.uncertainty, monotonic / 1000))
+    {
+    case CraggyClockFilterAccepted:
+        break;
+
+    case CraggyClockFilterRejected:
+        printf("Filter rejected the offset as an outlier (%" PRIu64 " so far)\n", filter->rejected);
+        break;
+
+    case CraggyClockFilterRestarted:
+        printf("Filter restarted, the offset jumped\n");
+        break;
+    }
+    int64_t filteredOffset;
+    uint64_t filteredUncertainty;
+    double drift;
+    craggy_clockFilterPredict(filter, monotonic / 1000, &filteredOffset, &filteredUncertainty, &drift);
+    printf("Filtered, system clock differs by %" PRId64 "μs ±%" PRIu64 "μs, monotonic clock drifts by %.3fppm\n",
+           filteredOffset + (int64_t)(monotonic / 1000) - (int64_t)now, filteredUncertainty, drift);
+    if (outputPath != NULL)
+    {
+        PublishOffset(outputPath, &consensus, numServers, (time_t)(now / 1000000));
+    }
+}
+
+// WarmStart restores the state saved by an earlier run, opening the transports from it.  Servers it has nothing on are
+// left to the first poll.
+static void WarmStart(const char *statePath, DaemonServer *servers, size_t numServers, CraggyDelegationCache *cache)
+{
+    CraggyResult craggyResult;
+    CraggyWarmStart *warmStart = NULL;
+    if (!craggy_warmStartLoad(statePath, &warmStart, &craggyResult))
+    {
+        printf("No state restored from %s: %d\n", statePath, craggyResult);
+        return;
+    }
+
+    const craggy_rough_time_t now = craggy_realtimeUs();
+    for (size_t i = 0; i < numServers; i++)
+    {
+        const CraggyTransportState *state = craggy_warmStartRestore(warmStart, servers[i].rootPublicKey, cache, now);
+        if (state != NULL && !craggy_transportOpenFromState(servers[i].address, state, &servers[i].transport, &craggyResult))
+        {
+            servers[i].transport = NULL;
+        }
+    }
+    craggy_warmStartClose(warmStart);
+}
+
+// SaveState saves the state of the servers for the next run to start from.
+static void SaveState(const char *statePath, const DaemonServer *servers, size_t numServers, CraggyDelegationCache *cache)
+{
+    CraggyResult craggyResult;
+    CraggyWarmStartServer states[numServers];
+    for (size_t i = 0; i < numServers; i++)
+    {
+        states[i].rootPublicKey = servers[i].rootPublicKey;
+        states[i].transport = servers[i].transport;
+    }
+    if (!craggy_warmStartSave(statePath, states, numServers, cache, &craggyResult))
+    {
+        printf("Error saving state to %s: %d\n", statePath, craggyResult);
+    }
+}
+
+int RunDaemon(const char *configPath, unsigned interval, const char *outputPath, int shmUnit, const char *statePath,
+              const char *cachePath, unsigned maxUncertaintyMs, const char *metricsPath, const char *auditPath, const char *sharedPath)
+{
+    CraggyResult craggyResult;
+
+    DaemonServer *servers = NULL;
+    size_t numServers = 0;
+    if (LoadServers(configPath, &servers, &numServers) != 0)
+    {
+        return 1;
+    }
+
+    CraggyDelegationCache *cache = NULL;
+    if (!craggy_createDelegationCache(numServers, &cache))
+    {
+        printf("Error creating delegation cache\n");
+        FreeServers(servers, numServers);
+        return 1;
+    }
+
+    CraggyTimeExport *timeExport = NULL;
+    if (shmUnit >= 0 && !craggy_timeExportOpen(shmUnit, &timeExport, &craggyResult))
+    {
+        printf("Error attaching to NTP shared memory unit %d: %d\n", shmUnit, craggyResult);
+        craggy_destroyDelegationCache(cache);
+        FreeServers(servers, numServers);
+        return 1;
+    }
+
+    CraggyClockFilter filter;
+    craggy_clockFilterInit(&filter, CRAGGY_CLOCK_FILTER_DRIFT_NOISE);
+
+    CraggyTimeCache *timeCache = NULL;
+    if (cachePath != NULL && !craggy_timeCacheCreate(cachePath, &timeCache, &craggyResult))
+    {
+        printf("Error creating time cache %s: %d\n", cachePath, craggyResult);
+        craggy_timeExportClose(timeExport);
+        craggy_destroyDelegationCache(cache);
+        FreeServers(servers, numServers);
+        return 1;
+    }
+
+    CraggyAuditLog *auditLog = NULL;
+    if (auditPath != NULL && !craggy_auditLogOpen(auditPath, &auditLog, &craggyResult))
+    {
+        printf("Error opening audit log %s: %d\n", auditPath, craggyResult);
+        craggy_timeCacheClose(timeCache);
+        craggy_timeExportClose(timeExport);
+        craggy_destroyDelegationCache(cache);
+        FreeServers(servers, numServers);
+        return 1;
+    }
+
+    CraggySharedCache *sharedCache = NULL;
+    if (sharedPath != NULL)
+    {
+        if (!craggy_sharedCacheOpen(sharedPath, CRAGGY_SHARED_CACHE_DEFAULT_CAPACITY, &sharedCache, &craggyResult))
+        {
+            printf("Error opening shared cache %s: %d\n", sharedPath, craggyResult);
+            craggy_auditLogClose(auditLog);
+            craggy_timeCacheClose(timeCache);
+            craggy_timeExportClose(timeExport);
+            craggy_destroyDelegationCache(cache);
+            FreeServers(servers, numServers);
+            return 1;
+        }
+        craggy_sharedCacheAttach(sharedCache, cache);
+    }
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = StopDaemon;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    if (statePath != NULL)
+    {
+        WarmStart(statePath, servers, numServers, cache);
+    }
+
+    printf("Polling %zu server(s) every %u seconds\n", numServers, interval);
+
+    while (running)
+    {
+        // A clock running ahead only costs certificate verifies of delegations still good
+        craggy_evictExpiredDelegations(cache, craggy_realtimeUs());
+        Poll(servers, numServers, cache, outputPath, timeExport, timeCache, &filter, auditLog, sharedCache);
+        if (statePath != NULL)
+        {
+            SaveState(statePath, servers, numServers, cache);
+        }
+        if (metricsPath != NULL)
+        {
+#if defined(CRAGGY_WITH_STATS)
+            WriteMetrics(metricsPath);
+#else
+            printf("No metrics written to %s, the library was built without stats\n", metricsPath);
+#endif
+        }
+        fflush(stdout);
+
+        double delay = interval;
+        if (maxUncertaintyMs > 0)
+        {
+            // As long as the filtered offset stays within the uncertainty asked for, counted from the last sample
+            delay = craggy_clockFilterNextPoll(&filter, (uint64_t)maxUncertaintyMs * 1000, DAEMON_MIN_INTERVAL, DAEMON_MAX_INTERVAL) -
+                    (double)(craggy_monotonicUs() - filter.lastUpdate) / 1e6;
+            if (delay < DAEMON_MIN_INTERVAL)
+            {
+                delay = DAEMON_MIN_INTERVAL;
+            }
+        }
+        delay = JitteredInterval(delay);
+        struct timespec sleepTime;
+        sleepTime.tv_sec = (time_t)delay;
+        sleepTime.tv_nsec = (long)((delay - (double)sleepTime.tv_sec) * 1e9);
+        // Interrupted by the signals stopping the daemon
+        nanosleep(&sleepTime, NULL);
+    }
+
+    craggy_destroyDelegationCache(cache);
+    craggy_sharedCacheClose(sharedCache);
+    craggy_auditLogClose(auditLog);
+    craggy_timeCacheClose(timeCache);
+    craggy_timeExportClose(timeExport);
+    FreeServers(servers, numServers);
+    return 0;
+}
@@ -0,0 +1,43 @@
+/* Copyright 2020 Johan Lindquist
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CRAGGY_CLI_DAEMON_H
+#define CRAGGY_CLI_DAEMON_H
+
+// DAEMON_DEFAULT_INTERVAL is the number of seconds between polls unless specified otherwise.
+#define DAEMON_DEFAULT_INTERVAL 64
+
+// DAEMON_LONGEST_INTERVAL is the most seconds between polls that can be specified, a day.
+#define DAEMON_LONGEST_INTERVAL 86400
+
+// RunDaemon polls the servers listed in the config file until interrupted, publishing the offset of the system clock
+// they agree on after every poll.  Each line of the config file holds the address of a server and its base64 encoded
+// public key, separated by whitespace; empty lines and lines starting with # are ignored.  The offset is written to
+// outputPath if specified, to the NTP shared memory segment of shmUnit unless negative, and always to stdout.  With a
+// statePath, the delegations, addresses and round trip estimates of the servers are saved there after every poll and
+// picked up again on the next start, making its first poll as quick as any other.  With a cachePath, the time agreed
+// on is kept there for craggy_now in other processes.  The offsets are filtered, tracking the drift of the clock, and
+// with maxUncertaintyMs the servers are polled again only when the filtered offset would grow more uncertain than that,
+// every 16 to 1024 seconds, rather than every interval.  With a metricsPath, the library's counters and stage latencies
+// are written there in the Prometheus text format after every poll, for node_exporter's textfile collector to pick up.
+// With an auditPath, the nonces are chained to the responses kept in the audit log in that directory, and every
+// verified response is appended to it.  With a sharedPath, the delegations and samples verified are shared with the
+// other processes on the host through the cache kept in that file: delegations verified by one are not verified again,
+// and servers one of them asked within the last 16 seconds are not asked again - unless the responses are audited.
+int RunDaemon(const char *configPath, unsigned interval, const char *outputPath, int shmUnit, const char *statePath,
+              const char *cachePath, unsigned maxUncertaintyMs, const char *metricsPath, const char *auditPath,
+              const char *sharedPath);
+
+#endif // CRAGGY_CLI_DAEMON_H
@@ -19,32 +19,151 @@
 #include <inttypes.h>
 #include <getopt.h>
 #include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
 
 #include <unistd.h>
 
 #include "base64.h"
+#include "daemon.h"
+#include "scan.h"
+#include "CraggyAuditLog.h"
 #include "CraggyTransport.h"
 #include "CraggyClient.h"
+#include "CraggySharedCache.h"
+#include "CraggyTimeCache.h"
+#include "CraggyTimeExport.h"
+#include "CraggyClock.h"
 
-// TimeUs returns the current value of the specified clock in microseconds.
-static uint32_t TimeUs(clockid_t clock)
+// ParseSeconds parses a number of seconds given on the command line, false unless it is a whole number of at most max.
+static bool ParseSeconds(const char *text, unsigned max, unsigned *seconds)
 {
-    struct timespec tv;
-    if (clock_gettime(clock, &tv))
+    // strtoul would take leading whitespace and a minus sign too
+    if (text == NULL || *text < '0' || *text > '9')
     {
-        abort();
+        return false;
     }
-    uint32_t ret = tv.tv_sec;
-    ret *= 1000000;
-    ret += tv.tv_nsec / 1000;
-    return ret;
+    char *end;
+    errno = 0;
+    const unsigned long value = strtoul(text, &end, 10);
+    if (errno != 0 || *end != '\0' || value > max)
+    {
+        return false;
+    }
+    *seconds = (unsigned)value;
+    return true;
+}
+
+// WriteCapture saves a verified response along with the nonce and key it was requested with, for craggy-bench to replay.
+static bool WriteCapture(const char *path, const craggy_rough_time_nonce_t nonce, const craggy_rough_time_public_key_t rootPublicKey, const craggy_rough_time_response_t *responseBuf, size_t responseBufLen)
+{
+    FILE *file = fopen(path, "wb");
+    if (file == NULL)
+    {
+        return false;
+    }
+    bool success = fwrite(nonce, CRAGGY_ROUGH_TIME_NONCE_LENGTH, 1, file) == 1 &&
+                   fwrite(rootPublicKey, CRAGGY_ROUGH_TIME_PUBLIC_KEY_LENGTH, 1, file) == 1 &&
+                   fwrite(responseBuf, responseBufLen, 1, file) == 1;
+    return fclose(file) == 0 && success;
+}
+
+// PrintCachedTime prints the time a daemon keeps in the cache, extrapolated to now.
+static int PrintCachedTime(const char *cachePath)
+{
+    CraggyResult craggyResult;
+    CraggyTimeCache *timeCache = NULL;
+    if (!craggy_timeCacheOpen(cachePath, &timeCache, &craggyResult))
+    {
+        printf("Error opening time cache %s: %d\n", cachePath, craggyResult);
+        return 1;
+    }
+
+    uint64_t time, uncertainty;
+    bool known = craggy_now(timeCache, &time, &uncertainty);
+    craggy_timeCacheClose(timeCache);
+    if (!known)
+    {
+        printf("No time kept in %s yet\n", cachePath);
+        return 1;
+    }
+
+    const int64_t offset = (int64_t)time / 1000 - (int64_t)craggy_realtimeUs();
+    printf("Time %" PRIu64 ".%09" PRIu64 " ±%" PRIu64 "μs, system clock differs by %" PRId64 "μs\n",
+           time / 1000000000, time % 1000000000, uncertainty / 1000, offset);
+    return 0;
 }
 
-// MonotonicUs returns the value of the monotonic clock in microseconds.
-uint32_t MonotonicUs() { return TimeUs(CLOCK_MONOTONIC); }
+// VerifyAuditLog checks every response kept in an audit log, and the chain of nonces linking them.
+static int VerifyAuditLog(const char *auditPath)
+{
+    CraggyResult craggyResult;
+    CraggyAuditLog *auditLog = NULL;
+    if (!craggy_auditLogOpen(auditPath, &auditLog, &craggyResult))
+    {
+        printf("Error opening audit log %s: %d\n", auditPath, craggyResult);
+        return 1;
+    }
 
-// MonotonicUs returns the value of the realtime clock in microseconds.
-uint32_t RealtimeUs() { return TimeUs(CLOCK_REALTIME); }
+    uint64_t numVerified;
+    const bool verified = craggy_auditLogVerify(auditLog, &numVerified, &craggyResult);
+    if (verified)
+    {
+        printf("%" PRIu64 " response(s) verified in %s\n", numVerified, auditPath);
+    }
+    else
+    {
+        printf("Record %" PRIu64 " of %s failed to verify: %d\n", numVerified, auditPath, craggyResult);
+    }
+    craggy_auditLogClose(auditLog);
+    return verified ? 0 : 1;
+}
+
+// PrintSharedCache lists the delegations and samples kept in a shared cache, one line per server.
+static int PrintSharedCache(const char *sharedPath)
+{
+    CraggyResult craggyResult;
+    CraggySharedCache *sharedCache = NULL;
+    if (!craggy_sharedCacheOpen(sharedPath, CRAGGY_SHARED_CACHE_DEFAULT_CAPACITY, &sharedCache, &craggyResult))
+    {
+        printf("Error opening shared cache %s: %d\n", sharedPath, craggyResult);
+        return 1;
+    }
+
+    const craggy_rough_time_t now = craggy_realtimeUs();
+    size_t numServers = 0;
+    for (size_t i = 0; i < craggy_sharedCacheCapacity(sharedCache); i++)
+    {
+        CraggySharedCacheEntry entry;
+        if (!craggy_sharedCacheReadEntry(sharedCache, i, &entry))
+        {
+            continue;
+        }
+        char *publicKey = (char *)base64_encode(entry.rootPublicKey, CRAGGY_ROUGH_TIME_PUBLIC_KEY_LENGTH, NULL);
+        if (publicKey != NULL)
+        {
+            // Encoded with a line break
+            publicKey[strcspn(publicKey, "\n")] = '\0';
+        }
+        printf("%s:", publicKey != NULL ? publicKey : "?");
+        free(publicKey);
+        if (entry.hasDelegation)
+        {
+            printf(" delegation valid %" PRIu64 " to %" PRIu64 "%s,", entry.delegation.minTime, entry.delegation.maxTime,
+                   entry.delegation.maxTime < now ? " (expired)" : "");
+        }
+        if (entry.hasSample)
+        {
+            printf(" time %" PRIu64 "μs ±%uμs received %" PRId64 "μs ago", entry.sample.time, entry.sample.radius,
+                   (int64_t)(now - entry.sample.receivedAt));
+        }
+        printf("\n");
+        numServers++;
+    }
+    printf("%zu server(s) kept in %s\n", numServers, sharedPath);
+    craggy_sharedCacheClose(sharedCache);
+    return 0;
+}
 
 int main(int argc, char *argv[])
 {
@@ -59,21 +178,51 @@ int main(int argc, char *argv[])
         {"nonce", optional_argument, 0, 'n'},
         {"intervals", optional_argument, 0, 'i'},
         {"repreats", optional_argument, 0, 'r'},
+        {"config", required_argument, 0, 'c'},
+        {"output", required_argument, 0, 'o'},
+        {"shm", required_argument, 0, 's'},
+        {"write", required_argument, 0, 'w'},
+        {"scan", required_argument, 0, 'S'},
+        {"concurrency", required_argument, 0, 'j'},
+        {"state", required_argument, 0, 't'},
+        {"cache", required_argument, 0, 'C'},
+        {"max-uncertainty", required_argument, 0, 'U'},
+        {"metrics", required_argument, 0, 'm'},
+        {"audit", required_argument, 0, 'a'},
+        {"shared", required_argument, 0, 'D'},
         {0, 0, 0, 0}};
 
     int c;
 
-    char *hostname = NULL;
-    char *nonce = NULL;
-    char *publicKey = NULL;
+    const char *hostname = NULL;
+    CraggyTransport *transport = NULL;
+    CraggyTimeExport *timeExport = NULL;
+    const char *nonce = NULL;
+    const char *publicKey = NULL;
     uint8_t repeats = 1;
-    uint8_t intervals = 1;
+    unsigned intervals = 1;
+    bool intervalsSpecified = false;
+    char *configPath = NULL;
+    char *outputPath = NULL;
+    int shmUnit = -1;
+    char *capturePath = NULL;
+    char *scanPath = NULL;
+    unsigned concurrency = SCAN_DEFAULT_CONCURRENCY;
+    char *statePath = NULL;
+    char *cachePath = NULL;
+    unsigned maxUncertaintyMs = 0;
+    char *metricsPath = NULL;
+    char *auditPath = NULL;
+    CraggyAuditLog *auditLog = NULL;
+    char *sharedPath = NULL;
+    CraggySharedCache *sharedCache = NULL;
+    CraggyDelegationCache *delegationCache = NULL;
 
     while (1)
     {
 
         int option_index = 0;
-        c = getopt_long(argc, argv, "h:k:n:i:r:", long_options, &option_index);
+        c = getopt_long(argc, argv, "h:k:n:i:r:c:o:s:w:S:j:t:C:U:m:a:D:", long_options, &option_index);
 
         /* Detect the end of the options. */
         if (c == -1)
@@ -92,23 +241,25 @@ int main(int argc, char *argv[])
             break;
 
         case 'h':
-            hostname = malloc(strlen(optarg) + 1);
-            hostname = strcpy(hostname, optarg);
+            hostname = optarg;
             break;
 
         case 'n':
-            nonce = malloc(strlen(optarg) + 1);
-            nonce = strcpy(hostname, optarg);
+            nonce = optarg;
             break;
 
         case 'k':
-            publicKey = malloc(strlen(optarg) + 1);
-            publicKey = strcpy(publicKey, optarg);
+            publicKey = optarg;
             break;
 
         case 'i':
-            intervals = atoi(optarg);
-            printf("Will poll every %d seconds\n",intervals);
+            if (!ParseSeconds(optarg, DAEMON_LONGEST_INTERVAL, &intervals))
+            {
+                printf("Invalid interval %s, expected up to %u seconds\n", optarg != NULL ? optarg : "(none)", DAEMON_LONGEST_INTERVAL);
+                return 1;
+            }
+            intervalsSpecified = true;
+            printf("Will poll every %u seconds\n", intervals);
             break;
 
         case 'r':
@@ -116,6 +267,54 @@ int main(int argc, char *argv[])
             printf("Will poll for %d times\n",repeats);
             break;
 
+        case 'c':
+            configPath = optarg;
+            break;
+
+        case 'o':
+            outputPath = optarg;
+            break;
+
+        case 's':
+            shmUnit = atoi(optarg);
+            break;
+
+        case 'w':
+            capturePath = optarg;
+            break;
+
+        case 'S':
+            scanPath = optarg;
+            break;
+
+        case 'j':
+            concurrency = (unsigned)atoi(optarg);
+            break;
+
+        case 't':
+            statePath = optarg;
+            break;
+
+        case 'C':
+            cachePath = optarg;
+            break;
+
+        case 'U':
+            maxUncertaintyMs = (unsigned)atoi(optarg);
+            break;
+
+        case 'm':
+            metricsPath = optarg;
+            break;
+
+        case 'a':
+            auditPath = optarg;
+            break;
+
+        case 'D':
+            sharedPath = optarg;
+            break;
+
         case '?':
             /* getopt_long already printed an error message. */
             break;
@@ -125,9 +324,51 @@ int main(int argc, char *argv[])
         }
     }
 
+    // Round trips are timed with the CPU's counter where it is reliable, the calibration pays off over several requests
+    if (configPath != NULL || repeats > 1)
+    {
+        craggy_clockCalibrate(&craggyResult);
+    }
+
+    if (configPath != NULL)
+    {
+        if (intervalsSpecified && intervals == 0)
+        {
+            printf("Invalid interval 0, the servers have to be polled at least a second apart\n");
+            return 1;
+        }
+        return RunDaemon(configPath, intervalsSpecified ? intervals : DAEMON_DEFAULT_INTERVAL, outputPath, shmUnit, statePath,
+                         cachePath, maxUncertaintyMs, metricsPath, auditPath, sharedPath);
+    }
+
+    if (scanPath != NULL)
+    {
+        return RunScan(scanPath, concurrency, outputPath);
+    }
+
+    if (cachePath != NULL)
+    {
+        return PrintCachedTime(cachePath);
+    }
+
+    if (auditPath != NULL && hostname == NULL)
+    {
+        return VerifyAuditLog(auditPath);
+    }
+
+    if (sharedPath != NULL && hostname == NULL)
+    {
+        return PrintSharedCache(sharedPath);
+    }
+
     if (publicKey == NULL || hostname == NULL || repeats < 1)
     {
-        printf("usage: craggy -h <hostname:port> -k <public key> (-n <nonce>) - at least one request has to be sent (default is 1)");
+        printf("usage: craggy -h <hostname:port> -k <public key> (-n <nonce>) (-s <NTP SHM unit>) (-w <capture file>) (-a <audit log directory>) (-D <shared cache file>) - at least one request has to be sent (default is 1)\n"
+               "       craggy -c <config file> (-i <interval>) (-o <output file>) (-s <NTP SHM unit>) (-t <state file>) (-C <time cache file>) (-U <max uncertainty in ms, polling only as often as needed>) (-m <Prometheus metrics file>) (-a <audit log directory>) (-D <shared cache file>) - poll the servers listed until interrupted\n"
+               "       craggy -C <time cache file> - print the time kept by a daemon polling with the cache, without a query\n"
+               "       craggy -a <audit log directory> - verify the responses kept in an audit log and the chain linking them\n"
+               "       craggy -D <shared cache file> - list the delegations and samples shared by the processes using the cache\n"
+               "       craggy -S <server list> (-j <concurrency>) (-o <output file>) - query the servers listed once each, one line per server");
         return 1;
     }
 
@@ -154,7 +395,7 @@ int main(int argc, char *argv[])
     if (nonce != NULL)
     {
         size_t outLen = 0;
-        unsigned char *decodedNonceBytes = base64_decode((unsigned char *)nonce, strlen(nonce), &outLen);
+        unsigned char *decodedNonceBytes = base64_decode((const unsigned char *)nonce, strlen(nonce), &outLen);
         if (outLen != CRAGGY_ROUGH_TIME_NONCE_LENGTH)
         {
             printf("Nonce length must be %d byte(s) (got %zu after base64 decoding)", CRAGGY_ROUGH_TIME_NONCE_LENGTH, outLen);
@@ -172,38 +413,117 @@ int main(int argc, char *argv[])
         }
     }
 
+    if (auditPath != NULL && !craggy_auditLogOpen(auditPath, &auditLog, &craggyResult))
+    {
+        printf("Error opening audit log %s: %d", auditPath, craggyResult);
+        goto error;
+    }
+
+    // Delegations verified by other processes on the host are taken up, and those verified here left for them
+    if (sharedPath != NULL)
+    {
+        if (!craggy_sharedCacheOpen(sharedPath, CRAGGY_SHARED_CACHE_DEFAULT_CAPACITY, &sharedCache, &craggyResult))
+        {
+            printf("Error opening shared cache %s: %d", sharedPath, craggyResult);
+            goto error;
+        }
+        if (!craggy_createDelegationCache(1, &delegationCache))
+        {
+            printf("Error creating delegation cache");
+            goto error;
+        }
+        craggy_sharedCacheAttach(sharedCache, delegationCache);
+    }
+
+    if (!craggy_transportOpen(hostname, &transport, &craggyResult))
+    {
+        printf("Error opening transport: %d", craggyResult);
+        goto error;
+    }
+
+    if (shmUnit >= 0 && !craggy_timeExportOpen(shmUnit, &timeExport, &craggyResult))
+    {
+        printf("Error attaching to NTP shared memory unit %d: %d", shmUnit, craggyResult);
+        goto error;
+    }
+
+    // Kernel timestamps keep scheduling delays out of the round-trip time, where the platform offers them
+    craggy_transportEnableTimestamps(transport, false, &craggyResult);
+
     while (repeats > 0)
     {
 
+        // Unless given one, each request is chained to the response kept last
+        CraggyAuditChain chain;
+        if (auditLog != NULL && nonce == NULL && !craggy_auditLogNextNonce(auditLog, &chain, nonceBytes, &craggyResult))
+        {
+            printf("Error deriving nonce: %d", craggyResult);
+            goto error;
+        }
+
         if (craggy_createRequest(nonceBytes, requestBuf))
         {
 
             printf("--------------- START ---------------\n");
-            const uint32_t start_us = MonotonicUs();
+            const uint64_t start_us = craggy_monotonicUs();
 
             craggy_rough_time_t timestamp;
             uint32_t radius;
 
             size_t responseBufLen = CRAGGY_ROUGH_TIME_MIN_REQUEST_SIZE * 3;
             craggy_rough_time_response_t responseBuf[responseBufLen];
+            CraggyTransportTimestamps timestamps;
 
-            if (craggy_makeRequest(hostname, requestBuf, &craggyResult, responseBuf, &responseBufLen))
+            if (craggy_transportRequestWithTimestamps(transport, requestBuf, &craggyResult, responseBuf, &responseBufLen, &timestamps))
             {
 
-                if (!craggy_processResponse(nonceBytes, rootPublicKey, responseBuf, responseBufLen, &craggyResult, &timestamp, &radius))
+                if (!craggy_processResponseWithCache(nonceBytes, rootPublicKey, delegationCache, responseBuf, responseBufLen, &craggyResult, &timestamp, &radius))
                 {
                     printf("Error parsing response: %d", craggyResult);
                     goto error;
                 }
 
-                const uint32_t end_us = MonotonicUs();
-                const uint32_t end_realtime_us = RealtimeUs();
+                if (capturePath != NULL && !WriteCapture(capturePath, nonceBytes, rootPublicKey, responseBuf, responseBufLen))
+                {
+                    printf("Error writing capture to %s\n", capturePath);
+                }
+
+                if (auditLog != NULL &&
+                    !craggy_auditLogAppend(auditLog, nonce == NULL ? &chain : NULL, nonceBytes, rootPublicKey, responseBuf, responseBufLen,
+                                           timestamps.received != 0 ? timestamps.received / 1000 : craggy_realtimeUs(), &craggyResult))
+                {
+                    printf("Error appending to audit log: %d\n", craggyResult);
+                }
+
+                uint64_t round_trip_us = craggy_monotonicUs() - start_us;
+                uint64_t end_realtime_us = craggy_realtimeUs();
+                if (timestamps.sent != 0 && timestamps.received != 0)
+                {
+                    round_trip_us = (timestamps.received - timestamps.sent) / 1000;
+                    end_realtime_us = timestamps.received / 1000;
+                }
+
+                if (sharedCache != NULL)
+                {
+                    CraggySharedSample sample;
+                    sample.time = timestamp;
+                    sample.radius = radius;
+                    sample.roundTripTime = round_trip_us;
+                    sample.receivedAt = end_realtime_us;
+                    const craggy_rough_time_t now_us = craggy_realtimeUs();
+                    sample.receivedMonotonic = craggy_monotonicNs() - (now_us > end_realtime_us ? now_us - end_realtime_us : 0) * 1000;
+                    craggy_sharedCachePublishSample(sharedCache, rootPublicKey, &sample);
+                }
 
                 // We assume that the path to the Roughtime server is symmetric and thus add
                 // half the round-trip time to the server's timestamp to produce our estimate
                 // of the current time.
-                timestamp += (end_us - start_us) / 2;
-                printf("Received reply in %" PRIu64 "μs.\n", end_us - start_us);
+                timestamp += round_trip_us / 2;
+                if (timeExport != NULL)
+                {
+                    craggy_timeExportPublish(timeExport, timestamp, radius, end_realtime_us);
+                }
+                printf("Received reply in %" PRIu64 "μs.\n", round_trip_us);
                 printf("Current time is %" PRIu64 "μs from the epoch, ±%uμs \n", timestamp, radius);
                 int64_t system_offset = timestamp - end_realtime_us;
                 printf("System clock differs from that estimate by %" PRId64 "μs.\n", system_offset);
@@ -231,8 +551,11 @@ error:
     assert(result != 0);
 
 exit:
-    free(hostname);
-    free(publicKey);
+    craggy_destroyDelegationCache(delegationCache);
+    craggy_sharedCacheClose(sharedCache);
+    craggy_auditLogClose(auditLog);
+    craggy_timeExportClose(timeExport);
+    craggy_transportClose(transport);
 
     return result;
 }
\ No newline at end of file
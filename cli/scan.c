@@ -0,0 +1,132 @@
+/* Copyright 2020 Johan Lindquist
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "scan.h"
+#include "servers.h"
+#include "CraggyConsensus.h"
+#include "CraggyTransport.h"
+#include "CraggyClient.h"
+
+// Milliseconds to wait for the responses of the servers queried at once.
+#define SCAN_QUERY_TIMEOUT_MS 1000
+
+// ServerEntrys queries the servers given all at once and writes a line for each.  Transports are opened for the one
+// query only, so no more sockets are open than servers are queried at a time.  Returns the number of servers without
+// a valid response.
+static size_t ServerEntrys(const ServerEntry *servers, size_t numServers, FILE *output)
+{
+    CraggyResult craggyResult;
+
+    CraggyTransport *transports[numServers];
+    CraggyServerQuery queries[numServers];
+    // Query of each server, NULL if its transport could not be opened
+    const CraggyServerQuery *serverQuery[numServers];
+    CraggyResult openResult[numServers];
+    craggy_rough_time_nonce_t nonces[numServers];
+
+    if (!craggy_generateNonces(&craggyResult, nonces, numServers))
+    {
+        fprintf(stderr, "Error generating nonces: %d\n", craggyResult);
+        return numServers;
+    }
+
+    size_t numQueries = 0;
+    for (size_t i = 0; i < numServers; i++)
+    {
+        transports[i] = NULL;
+        serverQuery[i] = NULL;
+        if (!craggy_transportOpen(servers[i].address, &transports[i], &openResult[i]))
+        {
+            continue;
+        }
+        CraggyServerQuery *query = &queries[numQueries++];
+        memset(query, 0, sizeof(CraggyServerQuery));
+        query->transport = transports[i];
+        query->rootPublicKey = servers[i].rootPublicKey;
+        query->nonce = nonces[i];
+        serverQuery[i] = query;
+    }
+
+    if (numQueries > 0)
+    {
+        craggy_queryServers(queries, numQueries, NULL, SCAN_QUERY_TIMEOUT_MS);
+    }
+
+    size_t numFailed = 0;
+    for (size_t i = 0; i < numServers; i++)
+    {
+        const CraggyServerQuery *query = serverQuery[i];
+        if (query == NULL || query->result != CraggyResultSuccess)
+        {
+            fprintf(output, "address=%s result=%d\n", servers[i].address, query == NULL ? openResult[i] : query->result);
+            numFailed++;
+        }
+        else
+        {
+            CraggyTimeSample sample;
+            craggy_makeTimeSample(query->time, query->radius, query->roundTripTime, query->receivedAt, &sample);
+            fprintf(output, "address=%s result=%d rtt_us=%" PRIu64 " midpoint_us=%" PRIu64 " radius_us=%" PRIu32 " offset_us=%" PRId64 "\n",
+                    servers[i].address, query->result, query->roundTripTime, query->time, query->radius, sample.offset);
+        }
+        craggy_transportClose(transports[i]);
+    }
+    return numFailed;
+}
+
+int RunScan(const char *listPath, unsigned concurrency, const char *outputPath)
+{
+    ServerEntry *servers = NULL;
+    size_t numServers = 0;
+    if (LoadServerList(listPath, &servers, &numServers) != 0)
+    {
+        return 1;
+    }
+
+    FILE *output = stdout;
+    if (outputPath != NULL && (output = fopen(outputPath, "w")) == NULL)
+    {
+        fprintf(stderr, "Error opening %s: %s\n", outputPath, strerror(errno));
+        FreeServerList(servers, numServers);
+        return 1;
+    }
+
+    if (concurrency == 0)
+    {
+        concurrency = SCAN_DEFAULT_CONCURRENCY;
+    }
+
+    size_t numFailed = 0;
+    for (size_t first = 0; first < numServers; first += concurrency)
+    {
+        size_t count = numServers - first < concurrency ? numServers - first : concurrency;
+        numFailed += ServerEntrys(&servers[first], count, output);
+        fflush(output);
+    }
+
+    int result = numFailed == 0 ? 0 : 1;
+    if (output != stdout && fclose(output) != 0)
+    {
+        fprintf(stderr, "Error writing %s: %s\n", outputPath, strerror(errno));
+        result = 1;
+    }
+    FreeServerList(servers, numServers);
+    return result;
+}
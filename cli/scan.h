@@ -0,0 +1,28 @@
+/* Copyright 2020 Johan Lindquist
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CRAGGY_CLI_SCAN_H
+#define CRAGGY_CLI_SCAN_H
+
+// SCAN_DEFAULT_CONCURRENCY is the number of servers queried at once unless specified otherwise.
+#define SCAN_DEFAULT_CONCURRENCY 64
+
+// RunScan queries every server listed once, up to concurrency of them at a time, and writes one line per server to
+// outputPath, or stdout if NULL.  The list is in the format of the daemon's config file.  Each line holds key=value
+// fields: the address and result code, and for a valid response the round trip time, midpoint, radius and offset of
+// the system clock, all in microseconds.  Returns 0 if every server gave a valid response.
+int RunScan(const char *listPath, unsigned concurrency, const char *outputPath);
+
+#endif // CRAGGY_CLI_SCAN_H
@@ -0,0 +1,108 @@
+/* Copyright 2020 Johan Lindquist
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "base64.h"
+#include "servers.h"
+
+// Longest line accepted in a server list.
+#define SERVERS_MAX_LINE 1024
+
+void FreeServerList(ServerEntry *servers, size_t numServers)
+{
+    for (size_t i = 0; i < numServers; i++)
+    {
+        free(servers[i].address);
+    }
+    free(servers);
+}
+
+int LoadServerList(const char *path, ServerEntry **outServers, size_t *outNumServers)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+    {
+        fprintf(stderr, "Error opening %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+
+    ServerEntry *servers = NULL;
+    size_t numServers = 0;
+    int result = 0;
+    char line[SERVERS_MAX_LINE];
+    size_t lineNumber = 0;
+
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        lineNumber++;
+
+        char *address = strtok(line, " \t\r\n");
+        if (address == NULL || address[0] == '#')
+        {
+            continue;
+        }
+        char *publicKey = strtok(NULL, " \t\r\n");
+        if (publicKey == NULL)
+        {
+            fprintf(stderr, "%s:%zu: missing public key\n", path, lineNumber);
+            result = 1;
+            break;
+        }
+
+        size_t publicKeyLen = 0;
+        unsigned char *decodedPublicKey = base64_decode((const unsigned char *)publicKey, strlen(publicKey), &publicKeyLen);
+        if (decodedPublicKey == NULL || publicKeyLen != CRAGGY_ROUGH_TIME_PUBLIC_KEY_LENGTH)
+        {
+            fprintf(stderr, "%s:%zu: public key length must be %d byte(s) (got %zu after base64 decoding)\n", path, lineNumber, CRAGGY_ROUGH_TIME_PUBLIC_KEY_LENGTH, publicKeyLen);
+            free(decodedPublicKey);
+            result = 1;
+            break;
+        }
+
+        ServerEntry *grown = realloc(servers, (numServers + 1) * sizeof(ServerEntry));
+        if (grown == NULL)
+        {
+            free(decodedPublicKey);
+            result = 1;
+            break;
+        }
+        servers = grown;
+
+        ServerEntry *server = &servers[numServers++];
+        memcpy(server->rootPublicKey, decodedPublicKey, CRAGGY_ROUGH_TIME_PUBLIC_KEY_LENGTH);
+        free(decodedPublicKey);
+        server->address = strdup(address);
+        if (server->address == NULL)
+        {
+            result = 1;
+            break;
+        }
+    }
+    fclose(file);
+
+    if (result != 0)
+    {
+        FreeServerList(servers, numServers);
+        return result;
+    }
+
+    *outServers = servers;
+    *outNumServers = numServers;
+    return 0;
+}
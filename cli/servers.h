@@ -0,0 +1,39 @@
+/* Copyright 2020 Johan Lindquist
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CRAGGY_CLI_SERVERS_H
+#define CRAGGY_CLI_SERVERS_H
+
+#include <stddef.h>
+
+#include "CraggyTypes.h"
+
+// ServerEntry is a server listed in a config file.
+typedef struct
+{
+    char *address;
+    craggy_rough_time_public_key_t rootPublicKey;
+} ServerEntry;
+
+// LoadServerList reads the servers listed in a file, the daemon's config file or the scanner's list.  Each line holds
+// the address of a server and its base64 encoded public key, separated by whitespace; empty lines and lines starting
+// with # are ignored.  Errors are reported on stderr, naming the line.  Returns 0 if successful, the servers then being
+// the caller's to free using FreeServerList.
+int LoadServerList(const char *path, ServerEntry **servers, size_t *numServers);
+
+// FreeServerList frees the servers loaded by LoadServerList, NULL being accepted.
+void FreeServerList(ServerEntry *servers, size_t numServers);
+
+#endif // CRAGGY_CLI_SERVERS_H
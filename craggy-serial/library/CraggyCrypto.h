@@ -1,58 +0,0 @@
-/* Copyright 2020 Johan Lindquist
- *
- * Licensed under the Apache License, Version 2.0 (the "License");
- * you may not use this file except in compliance with the License.
- * You may obtain a copy of the License at
- *
- *   http://www.apache.org/licenses/LICENSE-2.0
- *
- * Unless required by applicable law or agreed to in writing, software
- * distributed under the License is distributed on an "AS IS" BASIS,
- * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
- * See the License for the specific language governing permissions and
- * limitations under the License.
- */
-
-#ifndef CRAGGY_CRAGGYCRYPTO_H
-#define CRAGGY_CRAGGYCRYPTO_H
-
-#ifdef __cplusplus
-extern "C" {
-#endif
-
-#include <stdbool.h>
-#include "CraggyTypes.h"
-
-/**
- *
- * @param rootPublicKey
- * @param signature
- * @param msg
- * @param msgLen
- * @return
- */
-bool craggy_verifySignature(const craggy_rough_time_public_key_t rootPublicKey, const uint8_t *signature, const uint8_t *msg, size_t msgLen);
-
-/**
- *
- * @param msg
- * @param msgLen
- * @param hash
- * @return
- */
-bool craggy_calculateSHA512(const uint8_t *msg, size_t msgLen, uint8_t hash[CRAGGY_ROUGH_TIME_HASH_LENGTH]);
-
-/**
- *
- * @param randomBuf
- * @param randomBufLen
- * @param result
- * @return
- */
-bool craggy_fillRandomBytes(uint8_t *randomBuf, size_t randomBufLen, CraggyResult *result);
-
-#ifdef __cplusplus
-}
-#endif
-
-#endif //CRAGGY_CRAGGYCRYPTO_H
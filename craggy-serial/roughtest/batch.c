@@ -0,0 +1,431 @@
+/* Copyright 2020 Johan Lindquist
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "batch.h"
+#include "capture.h"
+#include "ubx_framer.h"
+
+// Epochs a file's results grow by at a time
+#define BATCH_EPOCH_GROWTH 4096
+
+typedef struct
+{
+    gtime_t time;
+    // Order of the epoch within its file, keeping epochs of the same time in the order they were decoded
+    size_t sequence;
+    int file;
+    int observations;
+    // Monotonic time the frame completing the epoch was read at, 0 in a raw receiver log
+    uint64_t received_us;
+    int solved;
+    timesol_t timing;
+} BatchEpoch;
+
+typedef struct
+{
+    const char *path;
+    BatchEpoch *epochs;
+    size_t numEpochs;
+    size_t capacity;
+    size_t bytes;
+    unsigned long frames;
+    unsigned long malformed;
+    // Set once the file was decoded to its end, otherwise errno tells why it was not
+    int decoded;
+    int error;
+} BatchFile;
+
+typedef struct
+{
+    BatchFile *files;
+    int numFiles;
+    // Next file to be taken by a worker
+    atomic_int next;
+    const timeopt_t *timingOptions;
+} Batch;
+
+// What a worker decodes a file with, started afresh for every file
+typedef struct
+{
+    raw_t raw;
+    ephc_t orbits[MAXSAT];
+    ubx_framer_t framer;
+} BatchWorkerState;
+
+// AddEpoch keeps the epoch of raw measurements just decoded, solving for the receiver clock bias if asked to.
+static int AddEpoch(Batch *batch, int file, BatchWorkerState *state, uint64_t received_us)
+{
+    BatchFile *batchFile = &batch->files[file];
+    if (batchFile->numEpochs == batchFile->capacity)
+    {
+        size_t capacity = batchFile->capacity + BATCH_EPOCH_GROWTH;
+        BatchEpoch *epochs = realloc(batchFile->epochs, capacity * sizeof(BatchEpoch));
+        if (epochs == NULL)
+        {
+            return 0;
+        }
+        batchFile->epochs = epochs;
+        batchFile->capacity = capacity;
+    }
+
+    BatchEpoch *epoch = &batchFile->epochs[batchFile->numEpochs];
+    epoch->time = state->raw.time;
+    epoch->sequence = batchFile->numEpochs++;
+    epoch->file = file;
+    epoch->observations = state->raw.obs.n;
+    epoch->received_us = received_us;
+    epoch->solved = 0;
+    if (batch->timingOptions != NULL)
+    {
+        char msg[128];
+        epoch->solved = timesol(state->raw.obs.data, state->raw.obs.n, &state->raw.nav, state->orbits,
+                                batch->timingOptions, &epoch->timing, msg);
+    }
+    return 1;
+}
+
+// DecodeFrame decodes a UBX frame of a file, keeping the epoch it completes if any.
+static int DecodeFrame(Batch *batch, int file, BatchWorkerState *state, const unsigned char *frame, size_t len, uint64_t received_us)
+{
+    BatchFile *batchFile = &batch->files[file];
+    batchFile->frames++;
+    int status = input_ubx_frame(&state->raw, frame, len);
+    if (status < 0)
+    {
+        batchFile->malformed++;
+    }
+    else if (status == 1)
+    {
+        return AddEpoch(batch, file, state, received_us);
+    }
+    return 1;
+}
+
+// DecodeCapture decodes the frames of the first receiver of a session, in place in the mapping of the capture.
+static int DecodeCapture(Batch *batch, int file, BatchWorkerState *state)
+{
+    BatchFile *batchFile = &batch->files[file];
+    capture_reader_t reader;
+    if (!capture_reader_open(&reader, batchFile->path))
+    {
+        return 0;
+    }
+    batchFile->bytes = reader.size;
+
+    int success = 1;
+    capture_record_t record;
+    while (success && capture_reader_next(&reader, &record))
+    {
+        if (record.type == CAPTURE_UBX_FRAME && record.source == 0)
+        {
+            success = DecodeFrame(batch, file, state, record.data, record.length, record.timestamp_us);
+        }
+    }
+    capture_reader_close(&reader);
+    if (!success)
+    {
+        errno = ENOMEM;
+    }
+    return success;
+}
+
+// DecodeLog frames a raw receiver log from its mapping, the checksums checked by the framer.
+static int DecodeLog(Batch *batch, int file, BatchWorkerState *state, int fd, size_t size)
+{
+    BatchFile *batchFile = &batch->files[file];
+    batchFile->bytes = size;
+    if (size == 0)
+    {
+        return 1;
+    }
+    const unsigned char *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED)
+    {
+        return 0;
+    }
+    // Read front to back, once
+    madvise((void *)map, size, MADV_SEQUENTIAL);
+
+    int success = 1;
+    size_t offset = 0;
+    ubx_framer_init(&state->framer);
+    while (success)
+    {
+        offset += ubx_framer_push(&state->framer, map + offset, size - offset);
+        unsigned char *frame;
+        size_t len;
+        while (success && ubx_framer_next(&state->framer, &frame, &len))
+        {
+            success = DecodeFrame(batch, file, state, frame, len, 0);
+        }
+        if (offset == size)
+        {
+            break;
+        }
+    }
+    munmap((void *)map, size);
+    if (!success)
+    {
+        errno = ENOMEM;
+    }
+    return success;
+}
+
+// DecodeFile decodes a file from its start, telling a session from a raw log by the magic a capture starts with.
+static void DecodeFile(Batch *batch, int file, BatchWorkerState *state)
+{
+    BatchFile *batchFile = &batch->files[file];
+    int fd = open(batchFile->path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0)
+    {
+        batchFile->error = errno;
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        return;
+    }
+
+    // The ephemerides and orbits of one file are not carried over to the next
+    if (!init_raw(&state->raw))
+    {
+        batchFile->error = ENOMEM;
+        close(fd);
+        return;
+    }
+    memset(state->orbits, 0, sizeof(state->orbits));
+
+    char magic[sizeof(CAPTURE_MAGIC)];
+    int success;
+    if (pread(fd, magic, sizeof(magic), 0) == (ssize_t)sizeof(magic) && memcmp(magic, CAPTURE_MAGIC, sizeof(magic)) == 0)
+    {
+        close(fd);
+        success = DecodeCapture(batch, file, state);
+    }
+    else
+    {
+        success = DecodeLog(batch, file, state, fd, (size_t)st.st_size);
+        close(fd);
+    }
+    batchFile->decoded = success;
+    if (!success)
+    {
+        batchFile->error = errno;
+    }
+    free_raw(&state->raw);
+}
+
+static void *BatchWorker(void *arg)
+{
+    Batch *batch = arg;
+    // A raw_t and a framer are far too large for a thread's stack
+    BatchWorkerState *state = malloc(sizeof(BatchWorkerState));
+    if (state == NULL)
+    {
+        return NULL;
+    }
+    for (;;)
+    {
+        int file = atomic_fetch_add_explicit(&batch->next, 1, memory_order_relaxed);
+        if (file >= batch->numFiles)
+        {
+            break;
+        }
+        DecodeFile(batch, file, state);
+    }
+    free(state);
+    return NULL;
+}
+
+static int CompareEpochs(const void *a, const void *b)
+{
+    const BatchEpoch *epochA = *(const BatchEpoch *const *)a;
+    const BatchEpoch *epochB = *(const BatchEpoch *const *)b;
+    double diff = timediff(epochA->time, epochB->time);
+    if (diff != 0.0)
+    {
+        return diff < 0.0 ? -1 : 1;
+    }
+    if (epochA->file != epochB->file)
+    {
+        return epochA->file < epochB->file ? -1 : 1;
+    }
+    return epochA->sequence < epochB->sequence ? -1 : epochA->sequence > epochB->sequence;
+}
+
+static void WriteEpoch(FILE *output, const Batch *batch, const BatchEpoch *epoch)
+{
+    fprintf(output, "epoch=%.6f file=%s obs=%d", (double)epoch->time.time + epoch->time.sec,
+            batch->files[epoch->file].path, epoch->observations);
+    if (epoch->received_us != 0)
+    {
+        fprintf(output, " received_us=%" PRIu64, epoch->received_us);
+    }
+    if (epoch->solved)
+    {
+        fprintf(output, " bias_ns=%.1f std_ns=%.1f sats=%d rejected=%d rms_m=%.2f", epoch->timing.dtr * 1e9,
+                epoch->timing.std * 1e9, epoch->timing.ns, epoch->timing.nrej, epoch->timing.rms);
+    }
+    else if (batch->timingOptions != NULL)
+    {
+        fprintf(output, " bias_ns=none");
+    }
+    fprintf(output, "\n");
+}
+
+int RunBatch(char *const *paths, int numPaths, unsigned workers, const timeopt_t *timingOptions, const char *outputPath)
+{
+    int result = 1;
+    Batch batch;
+    batch.files = calloc((size_t)numPaths, sizeof(BatchFile));
+    batch.numFiles = numPaths;
+    atomic_init(&batch.next, 0);
+    batch.timingOptions = timingOptions;
+    pthread_t *threads = NULL;
+    const BatchEpoch **order = NULL;
+    FILE *output = stdout;
+    if (batch.files == NULL)
+    {
+        fprintf(stderr, "Error allocating %d files\n", numPaths);
+        return 1;
+    }
+    for (int i = 0; i < numPaths; i++)
+    {
+        batch.files[i].path = paths[i];
+    }
+
+    if (workers == 0)
+    {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        workers = cores > 0 ? (unsigned)cores : 1;
+    }
+    if (workers > (unsigned)numPaths)
+    {
+        workers = (unsigned)numPaths;
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    threads = calloc(workers, sizeof(pthread_t));
+    if (threads == NULL)
+    {
+        fprintf(stderr, "Error allocating %u workers\n", workers);
+        goto exit;
+    }
+    unsigned started = 0;
+    while (started < workers && pthread_create(&threads[started], NULL, BatchWorker, &batch) == 0)
+    {
+        started++;
+    }
+    if (started == 0)
+    {
+        fprintf(stderr, "Error starting workers: %s\n", strerror(errno));
+        goto exit;
+    }
+    for (unsigned i = 0; i < started; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    // The epochs of all files, merged in time order
+    size_t numEpochs = 0;
+    size_t bytes = 0;
+    unsigned long frames = 0;
+    unsigned long malformed = 0;
+    int failed = 0;
+    for (int i = 0; i < numPaths; i++)
+    {
+        const BatchFile *batchFile = &batch.files[i];
+        if (!batchFile->decoded)
+        {
+            // Left over by workers that could not allocate their state
+            fprintf(stderr, "Could not read %s: %s\n", batchFile->path, strerror(batchFile->error != 0 ? batchFile->error : ENOMEM));
+            failed++;
+        }
+        numEpochs += batchFile->numEpochs;
+        bytes += batchFile->bytes;
+        frames += batchFile->frames;
+        malformed += batchFile->malformed;
+    }
+    order = malloc((numEpochs > 0 ? numEpochs : 1) * sizeof(BatchEpoch *));
+    if (order == NULL)
+    {
+        fprintf(stderr, "Error allocating %zu epochs\n", numEpochs);
+        goto exit;
+    }
+    size_t merged = 0;
+    for (int i = 0; i < numPaths; i++)
+    {
+        for (size_t j = 0; j < batch.files[i].numEpochs; j++)
+        {
+            order[merged++] = &batch.files[i].epochs[j];
+        }
+    }
+    qsort(order, numEpochs, sizeof(BatchEpoch *), CompareEpochs);
+
+    if (outputPath != NULL && (output = fopen(outputPath, "w")) == NULL)
+    {
+        fprintf(stderr, "Error opening %s: %s\n", outputPath, strerror(errno));
+        output = stdout;
+        goto exit;
+    }
+    for (size_t i = 0; i < numEpochs; i++)
+    {
+        WriteEpoch(output, &batch, order[i]);
+    }
+    if (output != stdout && fclose(output) != 0)
+    {
+        fprintf(stderr, "Error writing %s: %s\n", outputPath, strerror(errno));
+        output = stdout;
+        goto exit;
+    }
+    output = stdout;
+
+    double seconds = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+    fprintf(stderr, "Decoded %lu UBX frames (%lu malformed) and %zu epochs from %d files, %.1f MiB in %.2fs on %u workers (%.1f MiB/s)\n",
+            frames, malformed, numEpochs, numPaths - failed, bytes / 1048576.0, seconds, started,
+            seconds > 0 ? bytes / 1048576.0 / seconds : 0.0);
+    result = failed > 0;
+
+exit:
+    if (output != stdout)
+    {
+        fclose(output);
+    }
+    free(order);
+    free(threads);
+    for (int i = 0; i < numPaths; i++)
+    {
+        free(batch.files[i].epochs);
+    }
+    free(batch.files);
+    return result;
+}
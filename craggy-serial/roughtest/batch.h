@@ -0,0 +1,30 @@
+/* Copyright 2020 Johan Lindquist
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ROUGHTEST_BATCH_H
+#define ROUGHTEST_BATCH_H
+
+#include "rtklib.h"
+
+// RunBatch decodes the UBX frames of every file given, sessions recorded with -w or raw receiver logs, on up to
+// workers threads at a time, and writes one line per epoch of raw measurements to outputPath, or stdout if NULL, in
+// the order of the epochs' GNSS time across all files.  Each file is mapped and decoded from its start by a worker of
+// its own, so the ephemerides of a file are those broadcast within it.  Each line holds key=value fields: the epoch in
+// seconds of GPST, the file and the number of observations, the monotonic time the frame completing the epoch was
+// read at for a session, and with timingOptions the receiver clock bias solved for.  Returns 0 if every file could be
+// read.
+int RunBatch(char *const *paths, int numPaths, unsigned workers, const timeopt_t *timingOptions, const char *outputPath);
+
+#endif // ROUGHTEST_BATCH_H
@@ -0,0 +1,233 @@
+/*------------------------------------------------------------------------------
+* ephemeris.c : satellite ephemeris and clock functions
+*
+*          Copyright (C) 2010-2018 by T.TAKASU, All rights reserved.
+*
+* references :
+*     [1] IS-GPS-200D, Navstar GPS Space Segment/Navigation User Interfaces,
+*         7 March, 2006
+*     [2] European GNSS (Galileo) Open Service Signal In Space Interface Control
+*         Document, Issue 1, February, 2010
+*     [3] Quasi-Zenith Satellite System Navigation Service Interface Control
+*         Specification for QZSS (IS-QZSS) V1.1, Japan Aerospace Exploration
+*         Agency, July 31, 2009
+*     [4] BeiDou navigation satellite system signal in space interface control
+*         document open service signal B1I (version 1.0), China Satellite
+*         Navigation office, December 2012
+*
+* notes  : only the broadcast ephemerides of GPS, Galileo, QZSS and BeiDou
+*          (eph2clk(), eph2pos(), eph2posc()) are provided, as used by the timing
+*          solution in timesol.c
+*
+* version : $Revision:$ $Date:$
+* history : 2010/07/28 1.1  moved from rtkcmn.c
+*           2013/01/10 1.3  support beidou (compass)
+*           2014/11/30 1.4  fix bug on beidou geo satellite position
+*           2020/03/02 1.5  broadcast ephemerides only, for timesol()
+*           2020/03/09 1.6  add api eph2ephc(),eph2posc()
+*-----------------------------------------------------------------------------*/
+#include "rtklib.h"
+
+/* constants and macros ------------------------------------------------------*/
+
+#define SQR(x)   ((x)*(x))
+
+#define MU_GPS   3.9860050E14     /* gravitational constant         ref [1] */
+#define MU_GAL   3.986004418E14   /* earth gravitational constant   ref [2] */
+#define MU_CMP   3.986004418E14   /* earth gravitational constant   ref [4] */
+
+#define OMGE_GAL 7.2921151467E-5  /* earth angular velocity (rad/s) ref [2] */
+#define OMGE_CMP 7.292115E-5      /* earth angular velocity (rad/s) ref [4] */
+
+#define SIN_5 -0.0871557427476582 /* sin(-5.0 deg) */
+#define COS_5  0.9961946980917456 /* cos(-5.0 deg) */
+
+#define RTOL_KEPLER 1E-13         /* relative tolerance for Kepler equation */
+
+#define MAX_ITER_KEPLER 30        /* max number of iteration of Kelpler */
+
+#define STD_GAL_NAPA 500.0        /* error of galileo ephemeris for NAPA (m) */
+
+/* variance by ura ephemeris (ref [1] 20.3.3.3.1.1) --------------------------*/
+static double var_uraeph(int sys, int ura)
+{
+    const double ura_value[]={
+        2.4,3.4,4.85,6.85,9.65,13.65,24.0,48.0,96.0,192.0,384.0,768.0,1536.0,
+        3072.0,6144.0
+    };
+    if (sys==SYS_GAL) { /* galileo sisa (ref [2] 5.1.11) */
+        if (ura<= 49) return SQR(ura*0.01);
+        if (ura<= 74) return SQR(0.5+(ura- 50)*0.02);
+        if (ura<= 99) return SQR(1.0+(ura- 75)*0.04);
+        if (ura<=125) return SQR(2.0+(ura-100)*0.16);
+        return SQR(STD_GAL_NAPA);
+    }
+    else { /* gps ura */
+        return ura<0||14<ura?SQR(6144.0):SQR(ura_value[ura]);
+    }
+}
+/* broadcast ephemeris to satellite clock bias ---------------------------------
+* compute satellite clock bias with broadcast ephemeris (gps, galileo, qzss)
+* args   : gtime_t time     I   time by satellite clock (gpst)
+*          eph_t *eph       I   broadcast ephemeris
+* return : satellite clock bias (s) without relativeity correction
+* notes  : see ref [1],[2],[3]
+*          satellite clock does not include relativity correction and tdg
+*-----------------------------------------------------------------------------*/
+extern double eph2clk(gtime_t time, const eph_t *eph)
+{
+    double t;
+    int i;
+
+    t=timediff(time,eph->toc);
+
+    for (i=0;i<2;i++) {
+        t-=eph->f0+eph->f1*t+eph->f2*t*t;
+    }
+    return eph->f0+eph->f1*t+eph->f2*t*t;
+}
+/* broadcast ephemeris to orbit constants -------------------------------------
+* compute the terms of the satellite position that depend on the ephemeris
+* only, once for each ephemeris
+* args   : eph_t *eph       I   broadcast ephemeris
+*          ephc_t *ephc     O   orbit constants
+* return : none
+*-----------------------------------------------------------------------------*/
+extern void eph2ephc(const eph_t *eph, ephc_t *ephc)
+{
+    double mu,omge;
+    int sys,prn;
+
+    trace(4,"eph2ephc: sat=%2d iode=%d\n",eph->sat,eph->iode);
+
+    switch ((sys=satsys(eph->sat,&prn))) {
+        case SYS_GAL: mu=MU_GAL; omge=OMGE_GAL; break;
+        case SYS_CMP: mu=MU_CMP; omge=OMGE_CMP; break;
+        default:      mu=MU_GPS; omge=OMGE;     break;
+    }
+    ephc->sat=eph->sat;
+    ephc->iode=eph->iode;
+    ephc->toe=eph->toe;
+    ephc->A=eph->A;
+    ephc->geo=sys==SYS_CMP&&prn<=5;
+    ephc->omge=omge;
+    if (eph->A<=0.0) {
+        ephc->n=ephc->sqrt1e2=ephc->OMGd=ephc->OMG0=ephc->frel=ephc->var=0.0;
+        return;
+    }
+    ephc->n=sqrt(mu/(eph->A*eph->A*eph->A))+eph->deln;
+    ephc->sqrt1e2=sqrt(1.0-eph->e*eph->e);
+    ephc->OMGd=ephc->geo?eph->OMGd:eph->OMGd-omge;
+    ephc->OMG0=eph->OMG0-omge*eph->toes;
+    ephc->frel=-2.0*sqrt(mu*eph->A)*eph->e/SQR(CLIGHT);
+    ephc->var=var_uraeph(sys,eph->sva);
+}
+/* satellite position and clock bias by orbit constants ----------------------*/
+static void ephc2pos(gtime_t time, const eph_t *eph, const ephc_t *ephc,
+                     double *rs, double *dts, double *var)
+{
+    double tk,M,E,Ek,sinE,cosE,u,r,i,O,sin2u,cos2u,x,y,sinO,cosO,cosi;
+    double xg,yg,zg,sino,coso;
+    int n;
+
+    if (eph->A<=0.0) {
+        rs[0]=rs[1]=rs[2]=*dts=*var=0.0;
+        return;
+    }
+    tk=timediff(time,eph->toe);
+    M=eph->M0+ephc->n*tk;
+
+    for (n=0,E=M,Ek=0.0;fabs(E-Ek)>RTOL_KEPLER&&n<MAX_ITER_KEPLER;n++) {
+        Ek=E; E-=(E-eph->e*sin(E)-M)/(1.0-eph->e*cos(E));
+    }
+    if (n>=MAX_ITER_KEPLER) {
+        trace(2,"eph2pos: kepler iteration overflow sat=%2d\n",eph->sat);
+        rs[0]=rs[1]=rs[2]=*dts=*var=0.0;
+        return;
+    }
+    sinE=sin(E); cosE=cos(E);
+
+    u=atan2(ephc->sqrt1e2*sinE,cosE-eph->e)+eph->omg;
+    r=eph->A*(1.0-eph->e*cosE);
+    i=eph->i0+eph->idot*tk;
+    sin2u=sin(2.0*u); cos2u=cos(2.0*u);
+    u+=eph->cus*sin2u+eph->cuc*cos2u;
+    r+=eph->crs*sin2u+eph->crc*cos2u;
+    i+=eph->cis*sin2u+eph->cic*cos2u;
+    x=r*cos(u); y=r*sin(u); cosi=cos(i);
+
+    O=ephc->OMG0+ephc->OMGd*tk;
+    sinO=sin(O); cosO=cos(O);
+
+    /* beidou geo satellite (ref [4]) */
+    if (ephc->geo) {
+        xg=x*cosO-y*cosi*sinO;
+        yg=x*sinO+y*cosi*cosO;
+        zg=y*sin(i);
+        sino=sin(ephc->omge*tk); coso=cos(ephc->omge*tk);
+        rs[0]= xg*coso+yg*sino*COS_5+zg*sino*SIN_5;
+        rs[1]=-xg*sino+yg*coso*COS_5+zg*coso*SIN_5;
+        rs[2]=-yg*SIN_5+zg*COS_5;
+    }
+    else {
+        rs[0]=x*cosO-y*cosi*sinO;
+        rs[1]=x*sinO+y*cosi*cosO;
+        rs[2]=y*sin(i);
+    }
+    tk=timediff(time,eph->toc);
+    *dts=eph->f0+eph->f1*tk+eph->f2*tk*tk;
+
+    /* relativity correction */
+    *dts+=ephc->frel*sinE;
+
+    /* position and clock error variance */
+    *var=ephc->var;
+}
+/* broadcast ephemeris to satellite position and clock bias by constants -------
+* compute satellite position and clock bias with broadcast ephemeris and its
+* orbit constants, which are computed first if they are not for the ephemeris
+* args   : gtime_t time     I   time (gpst)
+*          eph_t *eph       I   broadcast ephemeris
+*          ephc_t *ephc     IO  orbit constants
+*          double *rs       O   satellite position (ecef) {x,y,z} (m)
+*          double *dts      O   satellite clock bias (s)
+*          double *var      O   satellite position and clock variance (m^2)
+* return : none
+* notes  : the constants are taken as being for the ephemeris while its
+*          satellite, iode, toe and semi-major axis are unchanged
+*-----------------------------------------------------------------------------*/
+extern void eph2posc(gtime_t time, const eph_t *eph, ephc_t *ephc, double *rs,
+                     double *dts, double *var)
+{
+    if (ephc->sat!=eph->sat||ephc->iode!=eph->iode||ephc->A!=eph->A||
+        timediff(ephc->toe,eph->toe)!=0.0) {
+        eph2ephc(eph,ephc);
+    }
+    ephc2pos(time,eph,ephc,rs,dts,var);
+}
+/* broadcast ephemeris to satellite position and clock bias --------------------
+* compute satellite position and clock bias with broadcast ephemeris (gps,
+* galileo, qzss)
+* args   : gtime_t time     I   time (gpst)
+*          eph_t *eph       I   broadcast ephemeris
+*          double *rs       O   satellite position (ecef) {x,y,z} (m)
+*          double *dts      O   satellite clock bias (s)
+*          double *var      O   satellite position and clock variance (m^2)
+* return : none
+* notes  : see ref [1],[2],[3]
+*          satellite clock includes relativity correction without code bias
+*          (tgd or bgd)
+*          the orbit constants are computed for the call, eph2posc() keeps
+*          them for satellites evaluated repeatedly, and traces nothing:
+*          formatting the time of the trace alone costs more than the orbit
+*-----------------------------------------------------------------------------*/
+extern void eph2pos(gtime_t time, const eph_t *eph, double *rs, double *dts,
+                    double *var)
+{
+    ephc_t ephc;
+
+    trace(4,"eph2pos : time=%s sat=%2d\n",time_str(time,3),eph->sat);
+
+    eph2ephc(eph,&ephc);
+    ephc2pos(time,eph,&ephc,rs,dts,var);
+}
@@ -16,22 +16,40 @@ Requirements: STANDARD POSIX code!! no wierd linux magic, no wierd mcu stuff.
 #include <getopt.h>
 #include <assert.h>
 #include <signal.h>
+#include <errno.h>
 
 #include <unistd.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
 
 #include "rtklib.h"
 
 #include "timepps.h"
+#include "pps.h"
+#include "sampler.h"
+#include "ubx_framer.h"
+#include "capture.h"
+#include "rt_thread.h"
 #include "serial-driver.h"
+#include "batch.h"
 #include "rtklib.h"
 #include "base64.h"
 #include "CraggyTransport.h"
+#include "CraggyWarmStart.h"
 #include "CraggyClient.h"
+#include "CraggyProtocol.h"
+#include "CraggyClock.h"
 
 
 int run = 1;
 
+// How long a Roughtime query may take before it is given up
+#define ROUGHTIME_TIMEOUT_US 10000000
+
+// Appended to the warm start file for the ephemerides, kept by RTKLIB in a file of its own
+#define WARM_NAV_SUFFIX ".nav"
+
 
 void sig_handler(int sig)
 {
@@ -43,6 +61,258 @@ void sig_handler(int sig)
 }
 
 
+static void ReportSample(const sampler_sample_t *sample)
+{
+    // GNSS time runs ahead of UTC by the leap seconds, as kept up to date by NAV-TIMELS or a leap second table
+    gtime_t gnss = {(time_t)(sample->gnss_us / 1000000), 0.0};
+    double leaps = -timediff(gpst2utc(gnss), gnss);
+    int64_t system_offset = (int64_t)(sample->roughtime_us + leaps * 1e6 - sample->gnss_us);
+    printf("\nGPS Time: %.6f%s\n", sample->gnss_us / 1e6, sample->interpolated ? "" : " (extrapolated)");
+    printf("GPS clock differs from Roughtime by %" PRId64 "μs, ±%uμs.\n", system_offset, sample->radius_us);
+}
+
+// With the antenna position known, every epoch of raw measurements gives the receiver clock bias independently
+// of the receiver's own solution
+static int holdPosition = 0;
+static timeopt_t timingOptions;
+// Orbit constants of the ephemerides in use, by satellite, so each epoch evaluates the satellites from them
+static ephc_t timingOrbits[MAXSAT];
+
+// UBX-CFG-MSG rates, on UART1 and USB, of the messages decoded: raw measurements and subframes for the timing
+// solution, NAV-PVT for the fix and NAV-TIMELS for leap seconds on, all others decoded off
+static const char *const receiverMessages[] = {
+    "CFG-MSG 2 21 0 1 0 1 0 0", /* RXM-RAWX */
+    "CFG-MSG 2 19 0 1 0 1 0 0", /* RXM-SFRBX */
+    "CFG-MSG 1 7 0 1 0 1 0 0",  /* NAV-PVT */
+    "CFG-MSG 1 38 0 1 0 1 0 0", /* NAV-TIMELS */
+    "CFG-MSG 2 16 0 0 0 0 0 0", /* RXM-RAW */
+    "CFG-MSG 2 17 0 0 0 0 0 0", /* RXM-SFRB */
+    "CFG-MSG 1 3 0 0 0 0 0 0",  /* NAV-STATUS */
+    "CFG-MSG 1 4 0 0 0 0 0 0",  /* NAV-DOP */
+    "CFG-MSG 1 6 0 0 0 0 0 0",  /* NAV-SOL */
+    "CFG-MSG 1 32 0 0 0 0 0 0", /* NAV-TIMEGPS */
+    "CFG-MSG 1 34 0 0 0 0 0 0", /* NAV-CLOCK */
+    "CFG-MSG 1 35 0 0 0 0 0 0", /* NAV-TIMEGLO */
+    "CFG-MSG 1 36 0 0 0 0 0 0", /* NAV-TIMEBDS */
+    "CFG-MSG 1 37 0 0 0 0 0 0", /* NAV-TIMEGAL */
+};
+
+static int SendUbx(int fd, const char *msg)
+{
+    unsigned char buff[1024];
+    int n = gen_ubx(msg, buff);
+    return n > 0 && write(fd, buff, n) == n;
+}
+
+// Switches the receiver's UART1 to the baud rate given, sending only UBX, then cuts its messages down to those
+// decoded. The port configuration goes out at the rate the port was opened at and again at the new one, so a
+// receiver left at the new rate by an earlier run is configured too.
+static int ConfigureReceiver(serial_port_t *port, unsigned int baud)
+{
+    char msg[64];
+    int fd = port->port_descriptor;
+
+    // 8N1, anything in, UBX out
+    snprintf(msg, sizeof(msg), "CFG-PRT 1 0 0 2256 %u 7 1 0 0", baud);
+    SendUbx(fd, msg);
+    tcdrain(fd);
+    // The receiver acknowledges at the old rate before switching
+    usleep(100000);
+    if (set_interface_attribs(fd, serial_baud_to_speed(baud), 0) != 0)
+    {
+        return 0;
+    }
+    port->speed = serial_baud_to_speed(baud);
+    if (!SendUbx(fd, msg))
+    {
+        return 0;
+    }
+    for (size_t i = 0; i < sizeof(receiverMessages) / sizeof(receiverMessages[0]); i++)
+    {
+        if (!SendUbx(fd, receiverMessages[i]))
+        {
+            return 0;
+        }
+    }
+    tcdrain(fd);
+    return 1;
+}
+
+// Session being recorded, if any
+static capture_writer_t recording = {-1};
+// SBAS messages being logged, if any, in the binary form read back by sbsreadmsgt
+static FILE *sbasLog;
+
+static void OnUbxMessage(raw_t *raw, int status)
+{
+    if (status < 0)
+    {
+        printf("Dropped a malformed UBX message\n");
+    }
+    else if (status == 3 && sbasLog != NULL)
+    {
+        if (!sbsoutmsgb(sbasLog, &raw->sbsmsg))
+        {
+            printf("Could not log an SBAS message: %s\n", strerror(errno));
+        }
+    }
+    else if (status == 1 && holdPosition)
+    {
+        timesol_t timing;
+        char msg[128];
+        if (timesol(raw->obs.data, raw->obs.n, &raw->nav, timingOrbits, &timingOptions, &timing, msg))
+        {
+            printf("Receiver clock bias %.1fns ±%.1fns from %d satellites (%d rejected), residuals %.1fm rms\n",
+                   timing.dtr * 1e9, timing.std * 1e9, timing.ns, timing.nrej, timing.rms);
+        }
+        else
+        {
+            printf("No timing solution: %s\n", msg);
+        }
+    }
+}
+
+// Records the request of a query as it is sent, or its response, whether valid or not, as it is received
+static void RecordPackets(const CraggyRequest *query, u_int64_t at_us, capture_record_type_t type)
+{
+    const uint8_t *requestBuf;
+    const craggy_rough_time_response_t *responseBuf;
+    size_t requestLen;
+    size_t responseLen;
+    if (recording.fd < 0)
+    {
+        return;
+    }
+    craggy_requestGetPackets(query, &requestBuf, &requestLen, &responseBuf, &responseLen);
+    if (type == CAPTURE_ROUGHTIME_REQUEST)
+    {
+        capture_write(&recording, type, 0, at_us, requestBuf, requestLen);
+    }
+    else if (responseBuf != NULL)
+    {
+        capture_write(&recording, type, 0, at_us, responseBuf, responseLen);
+    }
+}
+
+// Feeds a recorded session through the decoder and the verification of its responses again, at the pace it was
+// recorded or as fast as the capture can be read. Results are stamped from the recorded times, so a replay gives
+// the results of the session. The PPS edges of the session are not recorded, so epochs are placed at message arrival
+static int ReplayCapture(const char *path, bool realtime, craggy_rough_time_public_key_t rootPublicKey, uint8_t intervals)
+{
+    capture_reader_t reader;
+    if (!capture_reader_open(&reader, path))
+    {
+        printf("Could not read the capture %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+
+    raw_t gnss_raw;
+    init_raw(&gnss_raw);
+    sampler_t sampler;
+    sampler_init(&sampler, (uint64_t)intervals * 1000000, 0);
+    capture_pacer_t pacer;
+    capture_pacer_init(&pacer);
+    gtime_t last_epoch = {0};
+
+    craggy_rough_time_nonce_t nonceBytes;
+    bool requested = false;
+    u_int64_t sent_us = 0;
+    u_int64_t now_us = 0;
+    unsigned long frames = 0;
+    unsigned long responses = 0;
+    unsigned long invalid = 0;
+
+    capture_record_t record;
+    while (run > 0 && capture_reader_next(&reader, &record))
+    {
+        if (realtime)
+        {
+            capture_pace(&pacer, record.timestamp_us);
+        }
+        now_us = record.timestamp_us;
+
+        switch (record.type)
+        {
+        case CAPTURE_UBX_FRAME:
+            // Of the first receiver only, if roughtime-tester recorded several
+            if (record.source != 0)
+            {
+                break;
+            }
+            frames++;
+            OnUbxMessage(&gnss_raw, input_ubx_frame(&gnss_raw, record.data, record.length));
+            if (gnss_raw.time.time != last_epoch.time || gnss_raw.time.sec != last_epoch.sec)
+            {
+                last_epoch = gnss_raw.time;
+                sampler_add_fix(&sampler, record.timestamp_us, (gnss_raw.time.time + gnss_raw.time.sec) * 1e6);
+            }
+            break;
+
+        case CAPTURE_ROUGHTIME_REQUEST:
+        {
+            const uint8_t *nonce;
+            requested = craggy_parseRequestNonce(record.data, record.length, &nonce);
+            if (requested)
+            {
+                memcpy(nonceBytes, nonce, CRAGGY_ROUGH_TIME_NONCE_LENGTH);
+                sent_us = record.timestamp_us;
+            }
+            break;
+        }
+
+        case CAPTURE_ROUGHTIME_RESPONSE:
+        {
+            if (!requested)
+            {
+                break;
+            }
+            requested = false;
+            responses++;
+            craggy_rough_time_t timestamp;
+            craggy_rough_time_radius_t radius;
+            CraggyResult craggyResult;
+            // The response is only read by the verification, straight from the mapping of the capture
+            if (!craggy_processResponse(nonceBytes, rootPublicKey, (craggy_rough_time_response_t *)record.data, record.length, &craggyResult, &timestamp, &radius))
+            {
+                printf("Error parsing response: %d\n", craggyResult);
+                invalid++;
+                break;
+            }
+            sampler_sample_t sample;
+            sample.roughtime_us = timestamp;
+            sample.radius_us = radius;
+            sample.round_trip_us = record.timestamp_us - sent_us;
+            sample.midpoint_us = sent_us + sample.round_trip_us / 2;
+            sampler_add_sample(&sampler, &sample);
+            break;
+        }
+
+        default:
+            // Records of later versions of the testers
+            break;
+        }
+
+        sampler_sample_t sample;
+        while (sampler_next_result(&sampler, now_us, false, &sample))
+        {
+            ReportSample(&sample);
+        }
+    }
+
+    sampler_sample_t sample_left;
+    while (sampler_next_result(&sampler, now_us, true, &sample_left))
+    {
+        ReportSample(&sample_left);
+    }
+    if (reader.offset != reader.size)
+    {
+        printf("The capture ends with a record cut short\n");
+    }
+    printf("Replayed %lu UBX frames and %lu responses, %lu of them invalid\n", frames, responses, invalid);
+    capture_reader_close(&reader);
+    return 0;
+}
+
 int main(int argc, char *argv[])
 {
     signal(SIGINT, sig_handler);
@@ -57,6 +327,21 @@ int main(int argc, char *argv[])
         {"intervals", optional_argument, 0, 'i'},
         {"repreats", optional_argument, 0, 'r'},
         {"gpsport", optional_argument, 0, 'p'},
+        {"pps", required_argument, 0, 'P'},
+        {"antenna", required_argument, 0, 'a'},
+        {"record", required_argument, 0, 'w'},
+        {"replay", required_argument, 0, 'R'},
+        {"realtime", no_argument, 0, 'T'},
+        {"core", required_argument, 0, 'C'},
+        {"fifo", required_argument, 0, 'F'},
+        {"lock-memory", no_argument, 0, 'L'},
+        {"sbas", required_argument, 0, 'S'},
+        {"leaps", required_argument, 0, 'l'},
+        {"warm", required_argument, 0, 'W'},
+        {"baud", required_argument, 0, 'b'},
+        {"batch", no_argument, 0, 'B'},
+        {"workers", required_argument, 0, 'j'},
+        {"output", required_argument, 0, 'o'},
         {0, 0, 0, 0}};
 
     int c;
@@ -65,22 +350,40 @@ int main(int argc, char *argv[])
     char *nonce = NULL;
     char *publicKey = NULL;
     char *gpsPort = NULL;
+    char *ppsPath = NULL;
+    char *recordPath = NULL;
+    char *replayPath = NULL;
+    char *sbasPath = NULL;
+    const char *warmPath = NULL;
+    char navPath[1024] = "";
+    CraggyDelegationCache *cache = NULL;
+    bool realtime = false;
+    bool lockMemory = false;
+    unsigned int baud = 0;
+    bool batch = false;
+    unsigned int workers = 0;
+    const char *outputPath = NULL;
+    rt_thread_config_t rt;
+    rt_thread_config_init(&rt);
     uint8_t repeats = 1;
     uint8_t intervals = 1;
 
-    char byte;
+    // The receiver is read straight into the ring of the framer, 80 KiB, so it is not kept on the stack
+    static ubx_framer_t framer;
     int avb = 0;
 
     raw_t gnss_raw;
     int ret;
     serial_port_t serial_port;
+    pps_capture_t pps;
+    u_int64_t rx_us = 0;
 
 
     while (1)
     {
 
         int option_index = 0;
-        c = getopt_long(argc, argv, "h:k:n:i:r:p:", long_options, &option_index);
+        c = getopt_long(argc, argv, "h:k:n:i:r:p:P:a:w:R:TC:F:LS:l:W:b:Bj:o:", long_options, &option_index);
 
         /* Detect the end of the options. */
         if (c == -1)
@@ -118,6 +421,98 @@ int main(int argc, char *argv[])
             gpsPort = strcpy(gpsPort, optarg);
             break;
 
+        case 'P':
+            ppsPath = malloc(strlen(optarg) + 1);
+            ppsPath = strcpy(ppsPath, optarg);
+            break;
+
+        case 'a':
+        {
+            double antenna[3];
+            if (sscanf(optarg, "%lf,%lf,%lf", &antenna[0], &antenna[1], &antenna[2]) != 3)
+            {
+                printf("The antenna position must be given as x,y,z in metres (ECEF)\n");
+                return 1;
+            }
+            timeoptdefault(&timingOptions, antenna);
+            holdPosition = 1;
+            break;
+        }
+
+        case 'w':
+            recordPath = malloc(strlen(optarg) + 1);
+            recordPath = strcpy(recordPath, optarg);
+            break;
+
+        case 'R':
+            replayPath = malloc(strlen(optarg) + 1);
+            replayPath = strcpy(replayPath, optarg);
+            break;
+
+        case 'T':
+            // Replays at the pace the session was recorded
+            realtime = true;
+            break;
+
+        case 'C':
+            // Core to pin the threads reading the receiver and the PPS source to
+            rt.core = atoi(optarg);
+            break;
+
+        case 'F':
+            // SCHED_FIFO priority of the same threads
+            rt.priority = atoi(optarg);
+            break;
+
+        case 'L':
+            // Keeps page faults out of them
+            lockMemory = true;
+            break;
+
+        case 'S':
+            sbasPath = malloc(strlen(optarg) + 1);
+            sbasPath = strcpy(sbasPath, optarg);
+            break;
+
+        case 'l':
+            // Leap second table, year month day hour min sec UTC-GPST per line, newest first
+            if (!read_leaps(optarg))
+            {
+                printf("Could not read leap seconds from %s\n", optarg);
+                return 1;
+            }
+            break;
+
+        case 'W':
+            // State kept across runs: the server's delegation, address and round trip, and the ephemerides
+            warmPath = optarg;
+            snprintf(navPath, sizeof(navPath), "%s" WARM_NAV_SUFFIX, optarg);
+            break;
+
+        case 'b':
+            // Baud rate to switch the receiver to, turning off the UBX messages not decoded
+            baud = (unsigned int)strtoul(optarg, NULL, 10);
+            if (serial_baud_to_speed(baud) == B0)
+            {
+                printf("Unsupported baud rate %s\n", optarg);
+                return 1;
+            }
+            break;
+
+        case 'B':
+            // Decodes the captures and receiver logs given after the options, not a receiver
+            batch = true;
+            break;
+
+        case 'j':
+            // Threads decoding them, one per core unless given
+            workers = (unsigned int)strtoul(optarg, NULL, 10);
+            break;
+
+        case 'o':
+            outputPath = optarg;
+            break;
+
         case 'i':
             intervals = atoi(optarg);
             printf("Will poll every %d seconds\n", intervals);
@@ -137,19 +532,16 @@ int main(int argc, char *argv[])
         }
     }
 
-    if (publicKey == NULL || hostname == NULL || gpsPort == NULL)
+    if (batch && optind < argc)
     {
-        printf("usage: roughtimetester -h <hostname:port> -k <public key> -p </dev/gps>");
-        return 1;
+        return RunBatch(argv + optind, argc - optind, workers, holdPosition ? &timingOptions : NULL, outputPath);
     }
 
-    // Prepare GNSS receiver: per every navigation update, we need to request a roughtime time. As long as we don't have a GNSS valid position, we consider that we are in cold start. In cold start we should not accept any GNSS info until we actually validate it.
-    // Process: open serial port, verify flow and synchronize to packet header. After that, start processing the packets we are interested in. Probably the best way is to use rtklib
-    init_raw(&gnss_raw);
-    serial_port_init_port(gpsPort, &serial_port);
-    if (serial_port_open_port(&serial_port))
+    if (publicKey == NULL || (replayPath == NULL && (hostname == NULL || gpsPort == NULL)))
     {
-        printf("failed to open the serial port, check the serial port config string </dev/gps>\n");
+        printf("usage: roughtimetester -h <hostname:port> -k <public key> -p </dev/gps> (-P </dev/pps0>) (-a <x,y,z>) (-C <core>) (-F <SCHED_FIFO priority>) (-L, lock memory) (-w <capture to record>) (-S <SBAS messages to log, .sbb>) (-l <leap seconds table>) (-W <warm start file>) (-b <baud, e.g. 460800, configuring the receiver>)\n"
+               "       roughtimetester -k <public key> -R <capture to replay> (-T, in real time) (-a <x,y,z>) (-l <leap seconds table>)\n"
+               "       roughtimetester -B (-j <workers>) (-o <output file>) (-a <x,y,z>) (-l <leap seconds table>) <capture or UBX log>... - decode the files in parallel, one line per epoch in time order");
         return 1;
     }
 
@@ -165,8 +557,55 @@ int main(int argc, char *argv[])
     memcpy(&rootPublicKey, base64DecodedRootPublicKey, CRAGGY_ROUGH_TIME_PUBLIC_KEY_LENGTH);
     free(base64DecodedRootPublicKey);
 
-    craggy_rough_time_request_t requestBuf;
-    memset(requestBuf, 0, sizeof(craggy_rough_time_request_t));
+    if (replayPath != NULL)
+    {
+        ReplayCapture(replayPath, realtime, rootPublicKey, intervals);
+        goto exit;
+    }
+
+    // Prepare GNSS receiver: per every navigation update, we need to request a roughtime time. As long as we don't have a GNSS valid position, we consider that we are in cold start. In cold start we should not accept any GNSS info until we actually validate it.
+    // Process: open serial port, verify flow and synchronize to packet header. After that, start processing the packets we are interested in. Probably the best way is to use rtklib
+    init_raw(&gnss_raw);
+    if (warmPath != NULL && readnav(navPath, &gnss_raw.nav) && gnss_raw.nav.leaps > 0)
+    {
+        // Ephemerides good for hours spare waiting for the subframes, a leap second announced since the table was
+        // written is taken to be in effect already
+        gtime_t ev0 = {0};
+        update_leaps(utc2gpst(timeget()), -gnss_raw.nav.leaps, ev0, 0.0);
+    }
+    serial_port_init_port(gpsPort, &serial_port);
+    if (serial_port_open_port(&serial_port))
+    {
+        printf("failed to open the serial port, check the serial port config string </dev/gps>\n");
+        return 1;
+    }
+    if (baud != 0 && !ConfigureReceiver(&serial_port, baud))
+    {
+        printf("could not configure the receiver: %s\n", strerror(errno));
+    }
+    // The receiver's PPS output marks the start of each GNSS second far more precisely than its messages arrive
+    rt.prefault_stack = lockMemory ? RT_THREAD_PREFAULT_STACK : 0;
+    if (ppsPath != NULL && pps_capture_start(&pps, ppsPath, &rt))
+    {
+        printf("failed to capture the PPS source, check the PPS device </dev/pps0>\n");
+        return 1;
+    }
+    // Locked once the PPS thread is up, as a thread created after mlockall fails where its stack is over RLIMIT_MEMLOCK
+    if (lockMemory && (ret = rt_lock_memory()) != 0)
+    {
+        printf("could not lock memory: %s\n", strerror(ret));
+    }
+    // Set up before calibrating, so the counter is calibrated on the core it is read on
+    if ((ret = rt_thread_setup(&rt, "roughtest")) != 0)
+    {
+        printf("could not set up the timing thread (core %d, priority %d): %s\n", rt.core, rt.priority, strerror(ret));
+    }
+    // Every message and round trip is timestamped, reading the TSC is far cheaper than a system call
+    char calibrationError[256];
+    if (CalibrateTimestampCounter(calibrationError, sizeof(calibrationError)))
+    {
+        printf("timestamping with clock_gettime, the TSC is unusable: %s\n", calibrationError);
+    }
 
     craggy_rough_time_nonce_t nonceBytes;
     memset(nonceBytes, 1, CRAGGY_ROUGH_TIME_NONCE_LENGTH);
@@ -192,64 +631,234 @@ int main(int argc, char *argv[])
         }
     }
 
-    do
+    const CraggyTransportState *transportState = NULL;
+    CraggyWarmStart *warmStart = NULL;
+    if (!craggy_createDelegationCache(1, &cache))
+    {
+        printf("Error creating delegation cache\n");
+        goto error;
+    }
+    if (warmPath != NULL && craggy_warmStartLoad(warmPath, &warmStart, &craggyResult))
+    {
+        transportState = craggy_warmStartRestore(warmStart, rootPublicKey, cache, craggy_realtimeUs());
+    }
+    CraggyTransport *transport = NULL;
+    bool opened = craggy_transportOpenFromState(hostname, transportState, &transport, &craggyResult);
+    craggy_warmStartClose(warmStart);
+    if (!opened)
+    {
+        printf("Error connecting to %s: %d", hostname, craggyResult);
+        goto error;
+    }
+    if (recordPath != NULL && !capture_open(&recording, recordPath))
+    {
+        printf("Could not record to %s: %s\n", recordPath, strerror(errno));
+        goto error;
+    }
+    if (sbasPath != NULL && (sbasLog = fopen(sbasPath, "r+b")) == NULL && (sbasLog = fopen(sbasPath, "w+b")) == NULL)
+    {
+        printf("Could not log SBAS messages to %s: %s\n", sbasPath, strerror(errno));
+        goto error;
+    }
+    ubx_framer_init(&framer);
+
+    // Queries go out at their own rate, at most one at a time, while the receiver keeps being read. Each result
+    // is compared with the GNSS time interpolated between the epochs either side of it
+    sampler_t sampler;
+    sampler_init(&sampler, (uint64_t)intervals * 1000000, 0);
+    CraggyRequest *query = NULL;
+    u_int64_t start_us = 0;
+    gtime_t last_epoch = {0};
+
+    enum { POLL_SERIAL, POLL_ROUGHTIME, POLL_PPS, POLL_COUNT };
+    struct pollfd fds[POLL_COUNT] = {
+        [POLL_SERIAL] = {.fd = serial_port.port_descriptor, .events = POLLIN},
+        [POLL_ROUGHTIME] = {.fd = -1, .events = POLLIN},
+        [POLL_PPS] = {.fd = ppsPath != NULL ? pps_capture_fd(&pps) : -1, .events = POLLIN},
+    };
+
+    while (run > 0)
     {
-        while(avb == 0) {
+        int timeoutMs = -1;
+        u_int64_t now_us = MonotonicUs();
+        if (query != NULL)
+        {
+            u_int64_t elapsed_us = now_us - start_us;
+            timeoutMs = elapsed_us >= ROUGHTIME_TIMEOUT_US ? 0 : (int)((ROUGHTIME_TIMEOUT_US - elapsed_us + 999) / 1000);
+        }
+        else if (sampler.num_fixes > 0)
+        {
+            timeoutMs = sampler_wait_ms(&sampler, now_us);
+        }
+        if (sampler.num_pending > 0 && (timeoutMs < 0 || timeoutMs > SAMPLER_MAX_PENDING_US / 1000))
+        {
+            // A result waiting for its next epoch is stamped by extrapolation if that never comes
+            timeoutMs = SAMPLER_MAX_PENDING_US / 1000;
+        }
+        // A signal interrupts the wait, so SIGINT is noticed straight away
+        if (poll(fds, POLL_COUNT, timeoutMs) < 0)
+        {
+            continue;
+        }
+
+        if (fds[POLL_SERIAL].revents & POLLIN)
+        {
+            rx_us = MonotonicUs();
             ioctl(serial_port.port_descriptor, FIONREAD, &avb);
-            sleep(0.001);
+            printf("AVB : %d\n", avb);
+            // Whatever arrived is read into the framer in as few reads as the ring allows, and decoded a frame at a time
+            while (avb > 0)
+            {
+                ret = ubx_framer_fill(&framer, serial_port.port_descriptor);
+                if (ret <= 0)
+                {
+                    break;
+                }
+                avb -= ret;
+            }
+            avb = 0;
+            unsigned char *frame;
+            size_t frameLen;
+            while (ubx_framer_next(&framer, &frame, &frameLen))
+            {
+                if (recordPath != NULL)
+                {
+                    capture_write(&recording, CAPTURE_UBX_FRAME, 0, rx_us, frame, frameLen);
+                }
+                OnUbxMessage(&gnss_raw, input_ubx_frame(&gnss_raw, frame, frameLen));
+            }
+
+            if (gnss_raw.time.time != last_epoch.time || gnss_raw.time.sec != last_epoch.sec)
+            {
+                last_epoch = gnss_raw.time;
+                u_int64_t epoch_us = rx_us;
+                double gps_time = gnss_raw.time.time + gnss_raw.time.sec;
+                pps_edge_t edge;
+                if (ppsPath != NULL && pps_capture_edge_before(&pps, rx_us * 1000, &edge) == 0 && rx_us * 1000 - edge.assert_monotonic_ns < 1000000000)
+                {
+                    // The messages just read are for the second this edge started, so the epoch is placed at the
+                    // edge rather than at their arrival and the serial latency drops out
+                    epoch_us = edge.assert_monotonic_ns / 1000;
+                    gps_time = (double)gnss_raw.time.time + (gnss_raw.time.sec >= 0.5 ? 1 : 0);
+                    printf("PPS edge %lu, %" PRIu64 "μs before the messages\n", edge.sequence, rx_us - edge.assert_monotonic_ns / 1000);
+                }
+                sampler_add_fix(&sampler, epoch_us, gps_time * 1e6);
+            }
         }
-        printf("AVB : %d\n", avb);
-        for (int i = 0; i < avb; ++i)
+
+        if (fds[POLL_PPS].revents & POLLIN)
         {
-            ret = read(serial_port.port_descriptor, &byte, sizeof(byte));
-            input_ubx(&gnss_raw, byte);
+            pps_capture_drain(&pps);
         }
 
-        const u_int64_t start_us = MonotonicUs();
-       
-        if (craggy_createRequest(nonceBytes, requestBuf))
+        sampler_sample_t sample;
+        while (sampler_next_result(&sampler, MonotonicUs(), false, &sample))
         {
+            ReportSample(&sample);
+        }
 
+        if (query == NULL && sampler_due(&sampler, MonotonicUs()))
+        {
             printf("--------------- START ---------------\n");
-            craggy_rough_time_t timestamp;
-            uint32_t radius;
+            start_us = MonotonicUs();
+            sampler_query_started(&sampler, start_us);
+            // The request has a socket of its own, watched by the loop until it is answered
+            if (craggy_requestStart(transport, rootPublicKey, nonceBytes, cache, ROUGHTIME_TIMEOUT_US / 1000, &query, &craggyResult))
+            {
+                fds[POLL_ROUGHTIME].fd = craggy_requestGetFd(query);
+                RecordPackets(query, start_us, CAPTURE_ROUGHTIME_REQUEST);
+                continue;
+            }
+            printf("Error making request: %d\n", craggyResult);
+            printf("--------------- STOP ---------------\n");
+        }
 
-            size_t responseBufLen = CRAGGY_ROUGH_TIME_MIN_REQUEST_SIZE * 3;
-            craggy_rough_time_response_t responseBuf[responseBufLen];
+        if (query == NULL)
+        {
+            continue;
+        }
 
-            if (craggy_makeRequest(hostname, requestBuf, &craggyResult, responseBuf, &responseBufLen))
+        if (fds[POLL_ROUGHTIME].revents & POLLIN)
+        {
+            CraggyRequestState state = craggy_requestOnReadable(query);
+            const u_int64_t end_us = MonotonicUs();
+            if (state == CraggyRequestStatePending)
             {
+                // A spurious wakeup, or an ICMP error reported for the request
+                continue;
+            }
+            RecordPackets(query, end_us, CAPTURE_ROUGHTIME_RESPONSE);
 
-                if (!craggy_processResponse(nonceBytes, rootPublicKey, responseBuf, responseBufLen, &craggyResult, &timestamp, &radius))
+            craggy_rough_time_t timestamp;
+            craggy_rough_time_radius_t radius;
+            uint64_t roundTripTime;
+            bool answered = craggy_requestGetResponse(query, &craggyResult, &timestamp, &radius, &roundTripTime);
+            craggy_requestDestroy(query);
+            query = NULL;
+            fds[POLL_ROUGHTIME].fd = -1;
+            if (!answered)
+            {
+                if (craggyResult == CraggyResultNetworkInternalError)
                 {
-                    printf("Error parsing response: %d", craggyResult);
-                    goto error;
+                    printf("Error making request: %d\n", craggyResult);
+                    printf("--------------- STOP ---------------\n");
+                    continue;
                 }
-
-                // We assume that the path to the Roughtime server is symmetric and thus add
-                // half the round-trip time to the server's timestamp to produce our estimate
-                // of the current time.
-                const u_int64_t end_us = MonotonicUs();
-                timestamp += (end_us - start_us) / 2 - (start_us - gnss_raw.pvt.timestamp_arrival);
-                printf("Current time is %" PRIu64 "μs from the epoch, ±%uμs \n", timestamp, radius);
-                int64_t system_offset = (timestamp + 18e6) - (gnss_raw.time.time + gnss_raw.time.sec)*1e6;
-                printf("GPS clock differs from that estimate by %" PRId64 "μs.\n", system_offset);
-
-            }
-            else
-            {
-                printf("Error making request: %d", craggyResult);
+                printf("Error parsing response: %d", craggyResult);
                 goto error;
             }
-            printf("\nGPS Time: %.15f\n", gnss_raw.time.time + gnss_raw.time.sec);
-            printf("NAVIGATION Status: %d\n", gnss_raw.rxstat.gpsFix);
+
+            // The server's midpoint is compared with GNSS at the middle of the round trip
+            sample.roughtime_us = timestamp;
+            sample.radius_us = radius;
+            sample.round_trip_us = end_us - start_us;
+            sample.midpoint_us = start_us + sample.round_trip_us / 2;
+            sampler_add_sample(&sampler, &sample);
+
+            // We assume that the path to the Roughtime server is symmetric and thus add
+            // half the round-trip time to the server's timestamp to produce our estimate
+            // of the current time.
+            printf("Current time is %" PRIu64 "μs from the epoch, ±%uμs \n", timestamp + sample.round_trip_us / 2, radius);
             printf("--------------- STOP ---------------\n");
         }
-        avb = 0;
-        sleep(0.100);
-    } while (run > 0);
+        else if (MonotonicUs() - start_us >= ROUGHTIME_TIMEOUT_US)
+        {
+            // The next query goes out when the sampler has it due
+            printf("Error making request: %d", CraggyResultNetworkTimeout);
+            printf("\n--------------- STOP ---------------\n");
+            craggy_requestDestroy(query);
+            query = NULL;
+            fds[POLL_ROUGHTIME].fd = -1;
+        }
+    }
+    // Results still waiting for their next epoch are stamped from the epochs there are
+    sampler_sample_t sample_left;
+    while (sampler_next_result(&sampler, MonotonicUs(), true, &sample_left))
+    {
+        ReportSample(&sample_left);
+    }
+    craggy_requestDestroy(query);
+    if (warmPath != NULL)
+    {
+        CraggyWarmStartServer server = {rootPublicKey, transport};
+        if (!craggy_warmStartSave(warmPath, &server, 1, cache, &craggyResult) || !savenav(navPath, &gnss_raw.nav))
+        {
+            printf("Could not save the warm start state to %s\n", warmPath);
+        }
+    }
+    craggy_transportClose(transport);
+    craggy_destroyDelegationCache(cache);
+    capture_close(&recording);
+    if (sbasLog != NULL)
+    {
+        fclose(sbasLog);
+    }
 
     printf("Terminating.... \n");
+    if (ppsPath != NULL)
+    {
+        pps_capture_stop(&pps);
+    }
     serial_port_close(&serial_port);
 
     goto exit;
@@ -259,5 +868,9 @@ error:
 exit:
     free(hostname);
     free(publicKey);
+    free(ppsPath);
+    free(recordPath);
+    free(replayPath);
+    free(sbasPath);
     return 0;
 }
@@ -860,7 +860,7 @@ extern int init_raw(raw_t *raw)
     lexmsg_t lexmsg0={0};
     int i,j,sys;
     
-    fprintf(stdout,"init_raw:\n");
+    trace(3,"init_raw:\n");
     
     raw->time=time0;
     raw->ephsat=0;
@@ -868,6 +868,7 @@ extern int init_raw(raw_t *raw)
     raw->msgtype[0]='\0';
     for (i=0;i<MAXSAT;i++) {
         for (j=0;j<380;j++) raw->subfrm[i][j]=0;
+        for (j=0;j<64;j++) raw->almfp[i][j]=0;
         for (j=0;j<NFREQ+NEXOBS;j++) {
             raw->tobs [i][j]=time0;
             raw->lockt[i][j]=0.0;
@@ -905,6 +906,7 @@ extern int init_raw(raw_t *raw)
     }
     raw->obs.n =0;
     raw->obuf.n=0;
+    raw->obsv.n=0;
     raw->nav.n =MAXSAT;
     raw->nav.na=MAXSAT;
     raw->nav.ng=NSATGLO;
@@ -936,7 +938,7 @@ extern int init_raw(raw_t *raw)
 *-----------------------------------------------------------------------------*/
 extern void free_raw(raw_t *raw)
 {
-    fprintf(stdout,"free_raw:\n");
+    trace(3,"free_raw:\n");
     
     free(raw->obs.data ); raw->obs.data =NULL; raw->obs.n =0;
     free(raw->obuf.data); raw->obuf.data=NULL; raw->obuf.n=0;
@@ -109,6 +109,9 @@
 *           2018/01/29 1.32 chanage api crc16() -> rtk_crc16()
 *                           chanage api crc32() -> rtk_crc32()
 *                           chanage api crc24q() -> rtk_crc24q()
+*                           cache leap second in effect in gpst2utc(),
+*                           utc2gpst()
+*                           add api update_leaps()
 *-----------------------------------------------------------------------------*/
 #define _POSIX_C_SOURCE 199309
 #include <stdarg.h>
@@ -120,7 +123,9 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #endif
+#include <stdatomic.h>
 #include "rtklib.h"
+#include "bitfield.h"
 
 static const char rcsid[]="$Id: rtkcmn.c,v 1.1 2008/07/17 21:48:06 ttaka Exp ttaka $";
 
@@ -129,6 +134,9 @@ static const char rcsid[]="$Id: rtkcmn.c,v 1.1 2008/07/17 21:48:06 ttaka Exp tta
 #define POLYCRC32   0xEDB88320u /* CRC32 polynomial */
 #define POLYCRC24Q  0x1864CFBu  /* CRC24Q polynomial */
 
+#define MAXSTKMAT   32          /* max size of matrices kept on stack in lsq(),
+                                   filter() and matinv() */
+
 const static double gpst0[]={1980,1, 6,0,0,0}; /* gps time reference */
 const static double gst0 []={1999,8,22,0,0,0}; /* galileo system time reference */
 const static double bdt0 []={2006,1, 1,0,0,0}; /* beidou time reference */
@@ -608,13 +616,13 @@ extern int getcodepri(int sys, unsigned char code, const char *opt)
 *          int    pos    I      bit position from start of data (bits)
 *          int    len    I      bit length (bits) (len<=32)
 * return : extracted unsigned/signed bits
+* notes  : the bytes spanned are read as one word by bitfield_get(), shared
+*          with the gpsd decoders of roughtime-tester
 *-----------------------------------------------------------------------------*/
 extern unsigned int getbitu(const unsigned char *buff, int pos, int len)
 {
-    unsigned int bits=0;
-    int i;
-    for (i=pos;i<pos+len;i++) bits=(bits<<1)+((buff[i/8]>>(7-i%8))&1u);
-    return bits;
+    if (len<=0) return 0;
+    return (unsigned int)bitfield_get(buff,(unsigned int)pos,(unsigned int)len);
 }
 extern int getbits(const unsigned char *buff, int pos, int len)
 {
@@ -940,15 +948,15 @@ extern void matmul(const char *tr, int n, int k, int m, double alpha,
     }
 }
 /* LU decomposition ----------------------------------------------------------*/
-static int ludcmp(double *A, int n, int *indx, double *d)
+static int ludcmp(double *A, int n, int *indx, double *d, double *vv)
 {
-    double big,s,tmp,*vv=mat(n,1);
+    double big,s,tmp;
     int i,imax=0,j,k;
     
     *d=1.0;
     for (i=0;i<n;i++) {
         big=0.0; for (j=0;j<n;j++) if ((tmp=fabs(A[i+j*n]))>big) big=tmp;
-        if (big>0.0) vv[i]=1.0/big; else {free(vv); return -1;}
+        if (big>0.0) vv[i]=1.0/big; else return -1;
     }
     for (j=0;j<n;j++) {
         for (i=0;i<j;i++) {
@@ -966,12 +974,11 @@ static int ludcmp(double *A, int n, int *indx, double *d)
             *d=-(*d); vv[imax]=vv[j];
         }
         indx[j]=imax;
-        if (A[j+j*n]==0.0) {free(vv); return -1;}
+        if (A[j+j*n]==0.0) return -1;
         if (j!=n-1) {
             tmp=1.0/A[j+j*n]; for (i=j+1;i<n;i++) A[i+j*n]*=tmp;
         }
     }
-    free(vv);
     return 0;
 }
 /* LU back-substitution ------------------------------------------------------*/
@@ -990,20 +997,31 @@ static void lubksb(const double *A, int n, const int *indx, double *b)
     }
 }
 /* inverse of matrix ---------------------------------------------------------*/
-extern int matinv(double *A, int n)
+static int matinv_(double *A, int n, double *B, int *indx, double *vv)
 {
-    double d,*B;
-    int i,j,*indx;
+    double d;
+    int i,j;
     
-    indx=imat(n,1); B=mat(n,n); matcpy(B,A,n,n);
-    if (ludcmp(B,n,indx,&d)) {free(indx); free(B); return -1;}
+    matcpy(B,A,n,n);
+    if (ludcmp(B,n,indx,&d,vv)) return -1;
     for (j=0;j<n;j++) {
         for (i=0;i<n;i++) A[i+j*n]=0.0; A[j+j*n]=1.0;
         lubksb(B,n,indx,A+j*n);
     }
-    free(indx); free(B);
     return 0;
 }
+extern int matinv(double *A, int n)
+{
+    double B[MAXSTKMAT*MAXSTKMAT],vv[MAXSTKMAT],*B_,*vv_;
+    int indx[MAXSTKMAT],*indx_,info;
+    
+    if (n<=MAXSTKMAT) return matinv_(A,n,B,indx,vv);
+    
+    indx_=imat(n,1); B_=mat(n,n); vv_=mat(n,1);
+    info=matinv_(A,n,B_,indx_,vv_);
+    free(indx_); free(B_); free(vv_);
+    return info;
+}
 /* solve linear equation -----------------------------------------------------*/
 extern int solve(const char *tr, const double *A, const double *Y, int n,
                  int m, double *X)
@@ -1019,6 +1037,91 @@ extern int solve(const char *tr, const double *A, const double *Y, int n,
 #endif
 /* end of matrix routines ----------------------------------------------------*/
 
+/* fixed-size matrix kernels ---------------------------------------------------
+* least square and kalman filter kernels for 4 (position and clock) and 8
+* (plus velocity and clock drift) parameters, generated for each size by
+* FIXMAT_KERNELS(N). all storage is on the stack and the loops over the
+* parameters have constant bounds, so compilers unroll and vectorize them.
+* the matrices are column-major as for matmul(), with the number of
+* measurements m limited to MAXSTKMAT
+*-----------------------------------------------------------------------------*/
+#define FIXMAT_KERNELS(N)                                                      \
+/* A=A^-1 by gauss-jordan elimination with partial pivoting */                 \
+static int matinv##N(double *A)                                                \
+{                                                                              \
+    double B[N*N],tmp,piv;                                                     \
+    int i,j,k,p;                                                               \
+                                                                               \
+    memcpy(B,A,sizeof(B));                                                     \
+    for (j=0;j<N;j++) for (i=0;i<N;i++) A[i+j*N]=i==j?1.0:0.0;                 \
+    for (k=0;k<N;k++) {                                                        \
+        for (p=k,i=k+1;i<N;i++) if (fabs(B[i+k*N])>fabs(B[p+k*N])) p=i;        \
+        if (B[p+k*N]==0.0) return -1;                                          \
+        if (p!=k) for (j=0;j<N;j++) {                                          \
+            tmp=B[k+j*N]; B[k+j*N]=B[p+j*N]; B[p+j*N]=tmp;                     \
+            tmp=A[k+j*N]; A[k+j*N]=A[p+j*N]; A[p+j*N]=tmp;                     \
+        }                                                                      \
+        piv=1.0/B[k+k*N];                                                      \
+        for (j=0;j<N;j++) {B[k+j*N]*=piv; A[k+j*N]*=piv;}                      \
+        for (i=0;i<N;i++) {                                                    \
+            if (i==k||B[i+k*N]==0.0) continue;                                 \
+            tmp=B[i+k*N];                                                      \
+            for (j=0;j<N;j++) {B[i+j*N]-=tmp*B[k+j*N]; A[i+j*N]-=tmp*A[k+j*N];}\
+        }                                                                      \
+    }                                                                          \
+    return 0;                                                                  \
+}                                                                              \
+/* x=(A*A')^-1*A*y, Q=(A*A')^-1 with A (N x m) */                              \
+static int lsq##N(const double *A, const double *y, int m, double *x,          \
+                  double *Q)                                                   \
+{                                                                              \
+    double Ay[N]={0};                                                          \
+    int i,j,k;                                                                 \
+                                                                               \
+    for (j=0;j<N*N;j++) Q[j]=0.0;                                              \
+    for (k=0;k<m;k++) {                                                        \
+        const double *a=A+k*N;                                                 \
+        for (i=0;i<N;i++) Ay[i]+=a[i]*y[k];                                    \
+        for (j=0;j<N;j++) for (i=0;i<N;i++) Q[i+j*N]+=a[i]*a[j];               \
+    }                                                                          \
+    if (matinv##N(Q)) return -1;                                               \
+    for (i=0;i<N;i++) x[i]=0.0;                                                \
+    for (j=0;j<N;j++) for (i=0;i<N;i++) x[i]+=Q[i+j*N]*Ay[j];                  \
+    return 0;                                                                  \
+}                                                                              \
+/* kalman filter update as filter_() with N states and m (<=MAXSTKMAT)         \
+   measurements */                                                             \
+static int filter##N(const double *x, const double *P, const double *H,        \
+                     const double *v, const double *R, int m, double *xp,      \
+                     double *Pp)                                               \
+{                                                                              \
+    double F[N*MAXSTKMAT]={0},Q[MAXSTKMAT*MAXSTKMAT],K[N*MAXSTKMAT]={0};       \
+    double I[N*N];                                                             \
+    int i,j,k;                                                                 \
+                                                                               \
+    memcpy(Q,R,sizeof(double)*m*m);                                            \
+    for (i=0;i<N;i++) xp[i]=x[i];                                              \
+    for (j=0;j<m;j++) for (k=0;k<N;k++)      /* F=P*H */                       \
+        for (i=0;i<N;i++) F[i+j*N]+=P[i+k*N]*H[k+j*N];                         \
+    for (j=0;j<m;j++) for (i=0;i<m;i++)      /* Q=H'*P*H+R */                  \
+        for (k=0;k<N;k++) Q[i+j*m]+=H[k+i*N]*F[k+j*N];                         \
+    if (matinv(Q,m)) return -1;                                                \
+    for (j=0;j<m;j++) for (k=0;k<m;k++)      /* K=P*H*Q^-1 */                  \
+        for (i=0;i<N;i++) K[i+j*N]+=F[i+k*N]*Q[k+j*m];                         \
+    for (j=0;j<m;j++)                        /* xp=x+K*v */                    \
+        for (i=0;i<N;i++) xp[i]+=K[i+j*N]*v[j];                                \
+    for (j=0;j<N;j++) for (i=0;i<N;i++) I[i+j*N]=i==j?1.0:0.0;                 \
+    for (k=0;k<m;k++)                        /* I=I-K*H' */                    \
+        for (j=0;j<N;j++) for (i=0;i<N;i++) I[i+j*N]-=K[i+k*N]*H[j+k*N];       \
+    for (j=0;j<N*N;j++) Pp[j]=0.0;                                             \
+    for (j=0;j<N;j++) for (k=0;k<N;k++)      /* Pp=I*P */                      \
+        for (i=0;i<N;i++) Pp[i+j*N]+=I[i+k*N]*P[k+j*N];                        \
+    return 0;                                                                  \
+}
+
+FIXMAT_KERNELS(4)
+FIXMAT_KERNELS(8)
+
 /* least square estimation -----------------------------------------------------
 * least square estimation by solving normal equation (x=(A*A')^-1*A*y)
 * args   : double *A        I   transpose of (weighted) design matrix (n x m)
@@ -1037,6 +1140,8 @@ extern int lsq(const double *A, const double *y, int n, int m, double *x,
     int info;
     
     if (m<n) return -1;
+    if (n==4) return lsq4(A,y,m,x,Q);
+    if (n==8) return lsq8(A,y,m,x,Q);
     Ay=mat(n,1);
     matmul("NN",n,1,m,1.0,A,y,0.0,Ay); /* Ay=A*y */
     matmul("NT",n,n,m,1.0,A,A,0.0,Q);  /* Q=A*A' */
@@ -1084,22 +1189,35 @@ static int filter_(const double *x, const double *P, const double *H,
 extern int filter(double *x, double *P, const double *H, const double *v,
                   const double *R, int n, int m)
 {
+    double sx[8],sxp[8],sP[64],sPp[64],sH[8*MAXSTKMAT];
     double *x_,*xp_,*P_,*Pp_,*H_;
-    int i,j,k,info,*ix;
+    int i,j,k,info,six[8],*ix,stk;
     
-    ix=imat(n,1); for (i=k=0;i<n;i++) if (x[i]!=0.0&&P[i+i*n]>0.0) ix[k++]=i;
-    x_=mat(k,1); xp_=mat(k,1); P_=mat(k,k); Pp_=mat(k,k); H_=mat(k,m);
+    /* up to 8 states and MAXSTKMAT measurements are kept on the stack */
+    stk=n<=8&&m<=MAXSTKMAT;
+    ix=stk?six:imat(n,1);
+    for (i=k=0;i<n;i++) if (x[i]!=0.0&&P[i+i*n]>0.0) ix[k++]=i;
+    if (stk) {
+        x_=sx; xp_=sxp; P_=sP; Pp_=sPp; H_=sH;
+    }
+    else {
+        x_=mat(k,1); xp_=mat(k,1); P_=mat(k,k); Pp_=mat(k,k); H_=mat(k,m);
+    }
     for (i=0;i<k;i++) {
         x_[i]=x[ix[i]];
         for (j=0;j<k;j++) P_[i+j*k]=P[ix[i]+ix[j]*n];
         for (j=0;j<m;j++) H_[i+j*k]=H[ix[i]+j*n];
     }
-    info=filter_(x_,P_,H_,v,R,k,m,xp_,Pp_);
+    if      (stk&&k==4) info=filter4(x_,P_,H_,v,R,m,xp_,Pp_);
+    else if (stk&&k==8) info=filter8(x_,P_,H_,v,R,m,xp_,Pp_);
+    else                info=filter_(x_,P_,H_,v,R,k,m,xp_,Pp_);
     for (i=0;i<k;i++) {
         x[ix[i]]=xp_[i];
         for (j=0;j<k;j++) P[ix[i]+ix[j]*n]=Pp_[i+j*k];
     }
-    free(ix); free(x_); free(xp_); free(P_); free(Pp_); free(H_);
+    if (!stk) {
+        free(ix); free(x_); free(xp_); free(P_); free(Pp_); free(H_);
+    }
     return info;
 }
 /* smoother --------------------------------------------------------------------
@@ -1408,6 +1526,96 @@ extern void timeset(gtime_t t)
 {
     timeoffset_+=timediff(t,timeget());
 }
+/* the table is shared by the decoders of all threads and changed under its
+   lock, each thread caches the entry in effect until the table changes */
+static pthread_mutex_t lock_leaps=PTHREAD_MUTEX_INITIALIZER;
+static atomic_uint leapgen;     /* changes of the table */
+
+static _Thread_local struct {   /* leap second in effect, cached */
+    int valid;          /* cached (0:no,1:yes) */
+    unsigned int gen;   /* changes of the table when cached */
+    time_t t0,t1;       /* gpst span [t0,t1) (t1=0: no end) */
+    time_t u0,u1;       /* utc span [u0,u1) (u1=0: no end) */
+    double utc_gpst;    /* utc-gpst (s) */
+} leapc;
+
+/* leap second cached still in effect ----------------------------------------*/
+static int leapcached(void)
+{
+    return leapc.valid&&
+           leapc.gen==atomic_load_explicit(&leapgen,memory_order_acquire);
+}
+/* cache leap second table entry (table locked) ------------------------------*/
+static void cacheleap(int i)
+{
+    leapc.gen=atomic_load_explicit(&leapgen,memory_order_relaxed);
+    leapc.utc_gpst=leaps[i][6];
+    leapc.u0=epoch2time(leaps[i]).time;
+    leapc.t0=leapc.u0-(time_t)leaps[i][6];
+    if (i>0) {
+        leapc.u1=epoch2time(leaps[i-1]).time;
+        leapc.t1=leapc.u1-(time_t)leaps[i-1][6];
+    }
+    else leapc.u1=leapc.t1=0;
+    leapc.valid=1;
+}
+/* add leap second table entry -----------------------------------------------*/
+static int addleap(const double *ep, double utc_gpst)
+{
+    gtime_t t=epoch2time(ep);
+    int i,j,n;
+    
+    for (n=0;n<MAXLEAPS&&leaps[n][0]>0;n++) ;
+    
+    for (i=0;i<n;i++) {
+        if (timediff(t,epoch2time(leaps[i]))>=0.0) break;
+    }
+    if (i<n&&timediff(t,epoch2time(leaps[i]))==0.0) {
+        if (leaps[i][6]==utc_gpst) return 0;
+    }
+    else {
+        if (n==MAXLEAPS) n--; /* drop the oldest */
+        if (i>=MAXLEAPS) return 0;
+        for (j=n;j>i;j--) memcpy(leaps[j],leaps[j-1],sizeof(leaps[0]));
+        for (j=0;j<7;j++) leaps[n+1][j]=0.0;
+        for (j=0;j<6;j++) leaps[i][j]=ep[j];
+    }
+    leaps[i][6]=utc_gpst;
+    atomic_fetch_add_explicit(&leapgen,1,memory_order_release);
+    return 1;
+}
+/* update leap seconds ---------------------------------------------------------
+* update leap seconds table from leap seconds reported by a receiver
+* args   : gtime_t time     I   time the report applies to (gpst)
+*          double  utc_gpst I   utc-gpst at time (s)
+*          gtime_t tev      I   time of the upcoming leap second event (gpst)
+*                               ({0}: none)
+*          double  utc_gpst_ev I utc-gpst from tev on (s)
+* return : status (1:table changed,0:unchanged)
+* notes  : an offset missing from the table is taken to start at time
+*-----------------------------------------------------------------------------*/
+extern int update_leaps(gtime_t time, double utc_gpst, gtime_t tev,
+                        double utc_gpst_ev)
+{
+    double ep[6];
+    int stat=0;
+    
+    if (timediff(gpst2utc(time),time)!=utc_gpst) {
+        time2epoch(timeadd(time,utc_gpst),ep);
+        ep[5]=floor(ep[5]);
+        pthread_mutex_lock(&lock_leaps);
+        stat|=addleap(ep,utc_gpst);
+        pthread_mutex_unlock(&lock_leaps);
+    }
+    if (tev.time!=0&&timediff(gpst2utc(tev),tev)!=utc_gpst_ev) {
+        time2epoch(timeadd(tev,utc_gpst_ev),ep);
+        ep[5]=floor(ep[5]+0.5);
+        pthread_mutex_lock(&lock_leaps);
+        stat|=addleap(ep,utc_gpst_ev);
+        pthread_mutex_unlock(&lock_leaps);
+    }
+    return stat;
+}
 /* read leap seconds table -----------------------------------------------------
 * read leap seconds table
 * args   : char    *file    I   leap seconds table file
@@ -1425,6 +1633,7 @@ extern int read_leaps(const char *file)
     
     if (!(fp=fopen(file,"r"))) return 0;
     
+    pthread_mutex_lock(&lock_leaps);
     while (fgets(buff,sizeof(buff),fp)&&n<MAXLEAPS) {
         if ((p=strchr(buff,'#'))) *p='\0';
         if (sscanf(buff,"%d %d %d %d %d %d %d",ep,ep+1,ep+2,ep+3,ep+4,ep+5,
@@ -1433,6 +1642,8 @@ extern int read_leaps(const char *file)
         leaps[n++][6]=ls;
     }
     for (i=0;i<7;i++) leaps[n][i]=0.0;
+    atomic_fetch_add_explicit(&leapgen,1,memory_order_release);
+    pthread_mutex_unlock(&lock_leaps);
     fclose(fp);
     return 1;
 }
@@ -1441,16 +1652,28 @@ extern int read_leaps(const char *file)
 * args   : gtime_t t        I   time expressed in gpstime
 * return : time expressed in utc
 * notes  : ignore slight time offset under 100 ns
+*          the leap second in effect is cached, the table only searched when
+*          t falls outside its span
 *-----------------------------------------------------------------------------*/
 extern gtime_t gpst2utc(gtime_t t)
 {
     gtime_t tu;
     int i;
     
+    if (leapcached()&&t.time>=leapc.t0&&(leapc.t1==0||t.time<leapc.t1)) {
+        t.time+=(time_t)leapc.utc_gpst;
+        return t;
+    }
+    pthread_mutex_lock(&lock_leaps);
     for (i=0;leaps[i][0]>0;i++) {
         tu=timeadd(t,leaps[i][6]);
-        if (timediff(tu,epoch2time(leaps[i]))>=0.0) return tu;
+        if (timediff(tu,epoch2time(leaps[i]))>=0.0) {
+            cacheleap(i);
+            pthread_mutex_unlock(&lock_leaps);
+            return tu;
+        }
     }
+    pthread_mutex_unlock(&lock_leaps);
     return t;
 }
 /* utc to gpstime --------------------------------------------------------------
@@ -1463,9 +1686,20 @@ extern gtime_t utc2gpst(gtime_t t)
 {
     int i;
     
+    if (leapcached()&&t.time>=leapc.u0&&(leapc.u1==0||t.time<leapc.u1)) {
+        t.time-=(time_t)leapc.utc_gpst;
+        return t;
+    }
+    pthread_mutex_lock(&lock_leaps);
     for (i=0;leaps[i][0]>0;i++) {
-        if (timediff(t,epoch2time(leaps[i]))>=0.0) return timeadd(t,-leaps[i][6]);
+        if (timediff(t,epoch2time(leaps[i]))>=0.0) {
+            cacheleap(i);
+            t=timeadd(t,-leaps[i][6]);
+            pthread_mutex_unlock(&lock_leaps);
+            return t;
+        }
     }
+    pthread_mutex_unlock(&lock_leaps);
     return t;
 }
 /* gpstime to bdt --------------------------------------------------------------
@@ -1544,10 +1778,11 @@ extern void time2str(gtime_t t, char *s, int n)
 *          int    n         I   number of decimals
 * return : time string
 * notes  : not reentrant, do not use multiple in a function
+*          a buffer of its own on each thread
 *-----------------------------------------------------------------------------*/
 extern char *time_str(gtime_t t, int n)
 {
-    static char buff[64];
+    static _Thread_local char buff[64];
     time2str(t,buff,n);
     return buff;
 }
@@ -493,6 +493,15 @@ typedef struct {        /* observation data */
     obsd_t *data;       /* observation data records */
 } obs_t;
 
+typedef struct {        /* observation data of an epoch, one array per field */
+    int n;              /* number of observation data */
+    double P[MAXOBS];   /* pseudorange (m) */
+    double L[MAXOBS];   /* carrier-phase (cycle) */
+    float  D[MAXOBS];   /* doppler frequency (Hz) */
+    float  cn0[MAXOBS]; /* signal strength (dBHz) */
+    unsigned char sat[MAXOBS]; /* satellite number */
+} obsv_t;
+
 typedef struct {        /* earth rotation parameter data type */
     double mjd;         /* mjd (days) */
     double xp,yp;       /* pole offset (rad) */
@@ -555,6 +564,20 @@ typedef struct {        /* GPS/QZS/GAL broadcast ephemeris type */
     double Adot,ndot;   /* Adot,ndot for CNAV */
 } eph_t;
 
+typedef struct {        /* broadcast ephemeris orbit constants type */
+    int sat,iode;       /* satellite number and IODE of the ephemeris (0:none) */
+    gtime_t toe;        /* Toe of the ephemeris */
+    double A;           /* semi-major axis of the ephemeris (m) */
+    int geo;            /* CMP: geo satellite */
+    double n;           /* corrected mean motion (rad/s) */
+    double sqrt1e2;     /* sqrt(1-e^2) */
+    double OMGd;        /* rate of longitude of ascending node in ecef (rad/s) */
+    double OMG0;        /* longitude of ascending node at Toe in ecef (rad) */
+    double omge;        /* earth angular velocity of the system (rad/s) */
+    double frel;        /* relativity correction per sin(E) (s) */
+    double var;         /* satellite position and clock variance (m^2) */
+} ephc_t;
+
 typedef struct {        /* GLONASS broadcast ephemeris type */
     int sat;            /* satellite number */
     int iode;           /* IODE (0-6 bit of tb field) */
@@ -861,6 +884,22 @@ typedef struct {        /* solution type */
     float ratio;        /* AR ratio factor for valiation */
 } sol_t;
 
+typedef struct {        /* timing solution options type */
+    double rr[3];       /* known antenna position (ecef) (m) */
+    double elmin;       /* elevation mask angle (rad) */
+    double maxres;      /* max residual from the solved clock bias (m) */
+    int navsys;         /* navigation systems (SYS_???), on one time scale */
+} timeopt_t;
+
+typedef struct {        /* timing solution type */
+    gtime_t time;       /* receiver time of the epoch, clock bias removed (GPST) */
+    double dtr;         /* receiver clock bias (s) */
+    double std;         /* standard deviation of dtr (s) */
+    double rms;         /* rms of residuals after the fit (m) */
+    int ns;             /* number of satellites used */
+    int nrej;           /* number of satellites rejected as outliers */
+} timesol_t;
+
 typedef struct {        /* solution buffer type */
     int n,nmax;         /* number of solution/max number of buffer */
     int cyclic;         /* cyclic buffer flag */
@@ -1201,6 +1240,7 @@ typedef struct {        /* receiver raw data control type */
     gtime_t tobs[MAXSAT][NFREQ+NEXOBS]; /* observation data time */
     obs_t obs;          /* observation data */
     obs_t obuf;         /* observation data buffer */
+    obsv_t obsv;        /* observation data of the last RXM-RAWX epoch, by field */
     nav_t nav;          /* satellite ephemerides */
     sta_t sta;          /* station parameters */
     solpvt_t pvt;       /*PVT solution */
@@ -1210,6 +1250,7 @@ typedef struct {        /* receiver raw data control type */
     sbsmsg_t sbsmsg;    /* SBAS message */
     char msgtype[256];  /* last message type */
     unsigned char subfrm[MAXSAT][380];  /* subframe buffer */
+    unsigned int almfp[MAXSAT][64]; /* fingerprints of gps/qzss almanac pages decoded, by page sv id */
     lexmsg_t lexmsg;    /* LEX message */
     double lockt[MAXSAT][NFREQ+NEXOBS]; /* lock time (s) */
     double icpp[MAXSAT],off[MAXSAT],icpc; /* carrier params for ss2 */
@@ -1317,6 +1358,7 @@ typedef struct {        /* RTK server type */
 
 /*Timing functions -----------------------------------------------------------*/
 static u_int64_t TimeUs(clockid_t clock);
+int CalibrateTimestampCounter(char *err_msg, int err_msg_size);
 u_int64_t MonotonicUs();
 u_int64_t RealtimeUs();
 
@@ -1393,6 +1435,8 @@ extern void    timeset  (gtime_t t);
 extern double  time2doy (gtime_t t);
 extern double  utc2gmst (gtime_t t, double ut1_utc);
 extern int read_leaps(const char *file);
+extern int update_leaps(gtime_t time, double utc_gpst, gtime_t tev,
+                        double utc_gpst_ev);
 
 extern int adjgpsweek(int week);
 extern unsigned int tickget(void);
@@ -1538,6 +1582,9 @@ extern double geph2clk(gtime_t time, const geph_t *geph);
 extern double seph2clk(gtime_t time, const seph_t *seph);
 extern void eph2pos (gtime_t time, const eph_t  *eph,  double *rs, double *dts,
                      double *var);
+extern void eph2ephc(const eph_t *eph, ephc_t *ephc);
+extern void eph2posc(gtime_t time, const eph_t *eph, ephc_t *ephc, double *rs,
+                     double *dts, double *var);
 extern void geph2pos(gtime_t time, const geph_t *geph, double *rs, double *dts,
                      double *var);
 extern void seph2pos(gtime_t time, const seph_t *seph, double *rs, double *dts,
@@ -1587,6 +1634,7 @@ extern int input_rawf (raw_t *raw, int format, FILE *fp);
 extern int input_oem4  (raw_t *raw, unsigned char data);
 extern int input_oem3  (raw_t *raw, unsigned char data);
 extern int input_ubx   (raw_t *raw, unsigned char data);
+extern int input_ubx_frame(raw_t *raw, const unsigned char *frame, size_t len);
 extern int input_ss2   (raw_t *raw, unsigned char data);
 extern int input_cres  (raw_t *raw, unsigned char data);
 extern int input_stq   (raw_t *raw, unsigned char data);
@@ -1668,6 +1716,7 @@ extern int  sbsreadmsg (const char *file, int sel, sbs_t *sbs);
 extern int  sbsreadmsgt(const char *file, int sel, gtime_t ts, gtime_t te,
                         sbs_t *sbs);
 extern void sbsoutmsg(FILE *fp, sbsmsg_t *sbsmsg);
+extern int  sbsoutmsgb(FILE *fp, const sbsmsg_t *sbsmsg);
 extern int  sbsdecodemsg(gtime_t time, int prn, const unsigned int *words,
                          sbsmsg_t *sbsmsg);
 extern int sbsupdatecorr(const sbsmsg_t *msg, nav_t *nav);
@@ -1720,6 +1769,11 @@ extern int pntpos(const obsd_t *obs, int n, const nav_t *nav,
                   const prcopt_t *opt, sol_t *sol, double *azel,
                   ssat_t *ssat, char *msg);
 
+/* timing solution (position hold) -------------------------------------------*/
+extern void timeoptdefault(timeopt_t *opt, const double *rr);
+extern int timesol(const obsd_t *obs, int n, const nav_t *nav, ephc_t *ephc,
+                   const timeopt_t *opt, timesol_t *sol, char *msg);
+
 /* precise positioning -------------------------------------------------------*/
 extern void rtkinit(rtk_t *rtk, const prcopt_t *opt);
 extern void rtkfree(rtk_t *rtk);
@@ -35,7 +35,14 @@
 *           2011/01/15 1.8  use api ionppp()
 *                           add prn mask of qzss for qzss L1SAIF
 *           2018/01/29 1.9  crc24q() -> rtk_crc24q()
+*                           added api:
+*                               sbsoutmsgb()
+*                           read binary sbas message file (.sbb)
 *-----------------------------------------------------------------------------*/
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "rtklib.h"
 
 static const char rcsid[]="$Id: sbas.c,v 1.1 2008/07/17 21:48:06 ttaka Exp $";
@@ -450,11 +457,107 @@ extern int sbsupdatecorr(const sbsmsg_t *msg, nav_t *nav)
     }
     return stat?type:-1;
 }
+/* binary sbas message file ---------------------------------------------------
+* header of 16 bytes: "SBB1", flags, 0 padding. records of 40 bytes: week
+* (16 bits), prn (16 bits), tow (32 bits) and the 29 message bytes, padded.
+* records are written as received, so normally in time order and the file
+* is its own index. one written out of order sets SBB_UNSORTED in the flags
+*-----------------------------------------------------------------------------*/
+#define SBB_HEADLEN 16          /* binary sbas file header length (bytes) */
+#define SBB_RECLEN  40          /* binary sbas file record length (bytes) */
+#define SBB_UNSORTED 1          /* flag: records not in time order */
+
+/* add sbas message ----------------------------------------------------------*/
+static sbsmsg_t *addmsg(sbs_t *sbs)
+{
+    sbsmsg_t *sbs_msgs;
+    
+    if (sbs->n>=sbs->nmax) {
+        sbs->nmax=sbs->nmax==0?1024:sbs->nmax*2;
+        if (!(sbs_msgs=(sbsmsg_t *)realloc(sbs->msgs,sbs->nmax*sizeof(sbsmsg_t)))) {
+            trace(1,"readsbsmsg malloc error: nmax=%d\n",sbs->nmax);
+            free(sbs->msgs); sbs->msgs=NULL; sbs->n=sbs->nmax=0;
+            return NULL;
+        }
+        sbs->msgs=sbs_msgs;
+    }
+    return sbs->msgs+sbs->n++;
+}
+/* time of binary sbas message record ----------------------------------------*/
+static gtime_t sbbtime(const unsigned char *p)
+{
+    return gpst2time((int)getbitu(p,0,16),(double)getbitu(p,32,32));
+}
+/* read binary sbas message file ---------------------------------------------*/
+static void readmsgsb(const char *file, int sel, gtime_t ts, gtime_t te,
+                      sbs_t *sbs)
+{
+    struct stat st;
+    sbsmsg_t *msg;
+    unsigned char *buff,*p;
+    int fd,i,n,lo,hi,mid,sorted;
+    
+    trace(3,"readmsgsb: file=%s sel=%d\n",file,sel);
+    
+    if ((fd=open(file,O_RDONLY))<0) {
+        trace(2,"sbas message file open error: %s\n",file);
+        return;
+    }
+    if (fstat(fd,&st)<0||st.st_size<SBB_HEADLEN||
+        (st.st_size-SBB_HEADLEN)%SBB_RECLEN) {
+        trace(2,"sbas message file size error: %s\n",file);
+        close(fd);
+        return;
+    }
+    n=(int)((st.st_size-SBB_HEADLEN)/SBB_RECLEN);
+    if (n==0) {
+        close(fd);
+        return;
+    }
+    buff=(unsigned char *)mmap(NULL,st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+    close(fd);
+    if (buff==MAP_FAILED) {
+        trace(2,"sbas message file map error: %s\n",file);
+        return;
+    }
+    if (memcmp(buff,"SBB1",4)) {
+        trace(2,"sbas message file format error: %s\n",file);
+        munmap(buff,st.st_size);
+        return;
+    }
+    sorted=!(getbitu(buff,32,32)&SBB_UNSORTED);
+    p=buff+SBB_HEADLEN;
+    
+    /* first record not before the start time */
+    lo=0;
+    if (sorted&&ts.time!=0) {
+        for (hi=n;lo<hi;) {
+            mid=lo+(hi-lo)/2;
+            if (timediff(sbbtime(p+mid*SBB_RECLEN),ts)<-DTTOL) lo=mid+1;
+            else hi=mid;
+        }
+    }
+    for (i=lo;i<n;i++) {
+        unsigned char *q=p+i*SBB_RECLEN;
+        gtime_t time=sbbtime(q);
+        
+        if (sorted&&te.time!=0&&timediff(time,te)>=DTTOL) break;
+        if (sel!=0&&sel!=(int)getbitu(q,16,16)) continue;
+        if (!screent(time,ts,te,0.0)) continue;
+        
+        if (!(msg=addmsg(sbs))) break;
+        msg->week=(int)getbitu(q,0,16);
+        msg->prn=(int)getbitu(q,16,16);
+        msg->tow=(int)getbitu(q,32,32);
+        memcpy(msg->msg,q+8,29);
+    }
+    munmap(buff,st.st_size);
+}
 /* read sbas log file --------------------------------------------------------*/
 static void readmsgs(const char *file, int sel, gtime_t ts, gtime_t te,
                      sbs_t *sbs)
 {
-    sbsmsg_t *sbs_msgs;
+    sbsmsg_t *sbs_msg;
     int i,week,prn,ch,msg;
     unsigned int b;
     double tow,ep[6]={0};
@@ -500,23 +603,15 @@ static void readmsgs(const char *file, int sel, gtime_t ts, gtime_t te,
         
         if (!screent(time,ts,te,0.0)) continue;
         
-        if (sbs->n>=sbs->nmax) {
-            sbs->nmax=sbs->nmax==0?1024:sbs->nmax*2;
-            if (!(sbs_msgs=(sbsmsg_t *)realloc(sbs->msgs,sbs->nmax*sizeof(sbsmsg_t)))) {
-                trace(1,"readsbsmsg malloc error: nmax=%d\n",sbs->nmax);
-                free(sbs->msgs); sbs->msgs=NULL; sbs->n=sbs->nmax=0;
-                return;
-            }
-            sbs->msgs=sbs_msgs;
-        }
-        sbs->msgs[sbs->n].week=week;
-        sbs->msgs[sbs->n].tow=(int)(tow+0.5);
-        sbs->msgs[sbs->n].prn=prn;
-        for (i=0;i<29;i++) sbs->msgs[sbs->n].msg[i]=0;
+        if (!(sbs_msg=addmsg(sbs))) break;
+        sbs_msg->week=week;
+        sbs_msg->tow=(int)(tow+0.5);
+        sbs_msg->prn=prn;
+        for (i=0;i<29;i++) sbs_msg->msg[i]=0;
         for (i=0;*(p-1)&&*p&&i<29;p+=2,i++) {
-            if (sscanf(p,"%2X",&b)==1) sbs->msgs[sbs->n].msg[i]=(unsigned char)b;
+            if (sscanf(p,"%2X",&b)==1) sbs_msg->msg[i]=(unsigned char)b;
         }
-        sbs->msgs[sbs->n++].msg[28]&=0xC0;
+        sbs_msg->msg[28]&=0xC0;
     }
     fclose(fp);
 }
@@ -540,7 +635,7 @@ static int cmpmsgs(const void *p1, const void *p2)
 *          sbs->n=sbs->nmax=0, sbs->msgs=NULL)
 *          only the following file extentions after wild card expanded are valid
 *          to read. others are skipped
-*          .sbs, .SBS, .ems, .EMS
+*          .sbs, .SBS, .ems, .EMS, .sbb, .SBB (binary, see sbsoutmsgb())
 *-----------------------------------------------------------------------------*/
 extern int sbsreadmsgt(const char *file, int sel, gtime_t ts, gtime_t te,
                        sbs_t *sbs)
@@ -561,6 +656,10 @@ extern int sbsreadmsgt(const char *file, int sel, gtime_t ts, gtime_t te,
     
     for (i=0;i<n;i++) {
         if (!(ext=strrchr(efiles[i],'.'))) continue;
+        if (!strcmp(ext,".sbb")||!strcmp(ext,".SBB")) {
+            readmsgsb(efiles[i],sel,ts,te,sbs);
+            continue;
+        }
         if (strcmp(ext,".sbs")&&strcmp(ext,".SBS")&&
             strcmp(ext,".ems")&&strcmp(ext,".EMS")) continue;
         
@@ -598,6 +697,50 @@ extern void sbsoutmsg(FILE *fp, sbsmsg_t *sbsmsg)
     for (i=0;i<29;i++) fprintf(fp,"%02X",sbsmsg->msg[i]);
     fprintf(fp,"\n");
 }
+/* output binary sbas messages -------------------------------------------------
+* append sbas message record to binary sbas message file (.sbb), read back by
+* sbsreadmsgt() without parsing and searched by time
+* args   : FILE   *fp       I   output file pointer, opened for update ("w+b"
+*                               or "r+b")
+*          sbsmsg_t *sbsmsg I   sbas messages
+* return : status (1:ok,0:error)
+*-----------------------------------------------------------------------------*/
+extern int sbsoutmsgb(FILE *fp, const sbsmsg_t *sbsmsg)
+{
+    unsigned char buff[SBB_RECLEN]={0};
+    long size;
+    
+    trace(4,"sbsoutmsgb:\n");
+    
+    if (fseek(fp,0,SEEK_END)||(size=ftell(fp))<0) return 0;
+    
+    if (size<SBB_HEADLEN) {
+        memcpy(buff,"SBB1",4);
+        if (fseek(fp,0,SEEK_SET)||
+            fwrite(buff,SBB_HEADLEN,1,fp)!=1) return 0;
+        memset(buff,0,sizeof(buff));
+        size=SBB_HEADLEN;
+    }
+    else if (size>=SBB_HEADLEN+SBB_RECLEN) {
+        /* mark the file unsorted if the message is older than the last */
+        if (fseek(fp,size-SBB_RECLEN,SEEK_SET)||
+            fread(buff,8,1,fp)!=1) return 0;
+        if ((int)getbitu(buff,0,16)*604800+(int)getbitu(buff,32,32)>
+            sbsmsg->week*604800+sbsmsg->tow) {
+            if (fseek(fp,4,SEEK_SET)||fread(buff,4,1,fp)!=1) return 0;
+            setbitu(buff,0,32,getbitu(buff,0,32)|SBB_UNSORTED);
+            if (fseek(fp,4,SEEK_SET)||fwrite(buff,4,1,fp)!=1) return 0;
+        }
+        memset(buff,0,sizeof(buff));
+    }
+    setbitu(buff, 0,16,(unsigned int)sbsmsg->week);
+    setbitu(buff,16,16,(unsigned int)sbsmsg->prn);
+    setbitu(buff,32,32,(unsigned int)sbsmsg->tow);
+    memcpy(buff+8,sbsmsg->msg,29);
+    
+    if (fseek(fp,size,SEEK_SET)||fwrite(buff,SBB_RECLEN,1,fp)!=1) return 0;
+    return fflush(fp)==0;
+}
 /* search igps ---------------------------------------------------------------*/
 static void searchigp(gtime_t time, const double *pos, const sbsion_t *ion,
                       const sbsigp_t **igp, double *x, double *y)
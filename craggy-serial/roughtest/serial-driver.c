@@ -10,6 +10,7 @@ int serial_port_init_port(char *port_name, serial_port_t *serial_port_config){
     serial_port_config->port_descriptor = 0;
     serial_port_config->port_status = 0;
     serial_port_config->is_open = 0;
+    serial_port_config->speed = B115200;
 
     serial_port_config->rp = &(serial_port_config->rbuf[BLEN]);
     return 0;
@@ -66,6 +67,21 @@ int set_interface_attribs (int fd, int speed, int parity)
     return 0;
 }
 
+speed_t serial_baud_to_speed(unsigned int baud)
+{
+    switch (baud) {
+    case 9600: return B9600;
+    case 19200: return B19200;
+    case 38400: return B38400;
+    case 57600: return B57600;
+    case 115200: return B115200;
+    case 230400: return B230400;
+    case 460800: return B460800;
+    case 921600: return B921600;
+    default: return B0;
+    }
+}
+
 void set_blocking (int fd, int should_block)
 {
     struct termios tty;
@@ -92,7 +108,7 @@ int serial_port_open_port(serial_port_t *serial_port_config){
         fprintf(stderr, "Could not open port %s : %m\n",serial_port_config->port_name);
         return 1;
     } else {
-        set_interface_attribs (serial_port_config->port_descriptor, B115200, 0);
+        set_interface_attribs (serial_port_config->port_descriptor, serial_port_config->speed, 0);
         if (tcgetattr (serial_port_config->port_descriptor, &(serial_port_config->options)) != 0)
         {
             fprintf(stderr,"error %d from tggetattr\n", errno);
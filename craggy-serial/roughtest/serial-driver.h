@@ -21,6 +21,8 @@ typedef struct {
     int port_descriptor;
     int port_status;
     int is_open;
+    // Termios speed the port is opened at, B115200 unless changed between init and open
+    int speed;
     struct termios options;
 
     unsigned char rbuf[BLEN];
@@ -42,6 +44,11 @@ int serial_port_open_port(serial_port_t *serial_port_config);
 
 int set_interface_attribs (int fd, int speed, int parity);
 void set_blocking (int fd, int should_block);
+
+/*
+ * Termios speed of a baud rate a u-blox receiver supports, B0 for any other rate
+ */
+speed_t serial_baud_to_speed(unsigned int baud);
 unsigned char getbyte(serial_port_t *serial_port_config);
 
 
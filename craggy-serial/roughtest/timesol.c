@@ -0,0 +1,182 @@
+/*------------------------------------------------------------------------------
+* timesol.c : timing solution with a known antenna position
+*
+* notes  : in position hold the antenna coordinates are known, so the only
+*          unknown of an epoch is the receiver clock bias. each pseudorange
+*          corrected by the broadcast orbit, satellite clock, group delay,
+*          klobuchar ionosphere and saastamoinen troposphere is a direct
+*          measurement of it, and the solution is their weighted mean.
+*          it takes a single satellite, and more give a check on each other.
+*
+*          the bias is relative to the time scale of the observations (GPST).
+*          satellites of systems on another time scale (galileo, beidou) add
+*          the offset between the scales to their residuals, so only systems
+*          sharing one are to be selected together (e.g. gps and qzss).
+*
+*          only the first frequency of each observation is used.
+*-----------------------------------------------------------------------------*/
+#include "rtklib.h"
+
+/* constants -----------------------------------------------------------------*/
+
+#define SQR(x)      ((x)*(x))
+
+#define ERR_CODE    0.3         /* code measurement error factor (m) */
+#define ERR_BRDCI   0.5         /* broadcast ionosphere model error factor */
+#define ERR_SAAS    0.3         /* saastamoinen model error std (m) */
+#define REL_HUMI    0.7         /* relative humidity for saastamoinen model */
+#define MAXITR      4           /* max number of clock bias iterations */
+#define CONV_CLK    1E-4        /* clock bias convergence threshold (m) */
+#define MINSAT_REJ  3           /* min number of satellites to reject from */
+
+/* set default timing solution options -----------------------------------------
+* args   : timeopt_t *opt   O   options
+*          double *rr       I   antenna position (ecef) {x,y,z} (m)
+* return : none
+*-----------------------------------------------------------------------------*/
+extern void timeoptdefault(timeopt_t *opt, const double *rr)
+{
+    matcpy(opt->rr,rr,3,1);
+    opt->elmin=15.0*D2R;
+    opt->maxres=30.0;
+    opt->navsys=SYS_GPS;
+}
+/* select ephemeris ------------------------------------------------------------
+* ephemerides are kept at the index of their satellite, as the receiver
+* decoders store them, and used while the satellite is healthy and within
+* the validity of the ephemeris
+*-----------------------------------------------------------------------------*/
+static const eph_t *seleph(gtime_t time, int sat, const nav_t *nav)
+{
+    const eph_t *eph;
+    double tmax;
+
+    if (sat<=0||sat>nav->n) return NULL;
+    eph=nav->eph+sat-1;
+    if (eph->sat!=sat||eph->A<=0.0||eph->svh) return NULL;
+
+    switch (satsys(sat,NULL)) {
+        case SYS_QZS: tmax=MAXDTOE_QZS; break;
+        case SYS_GAL: tmax=MAXDTOE_GAL; break;
+        case SYS_CMP: tmax=MAXDTOE_CMP; break;
+        default:      tmax=MAXDTOE;     break;
+    }
+    if (fabs(timediff(time,eph->toe))>tmax+1.0) return NULL;
+    return eph;
+}
+/* pseudorange residual --------------------------------------------------------
+* residual of the corrected pseudorange to the geometric range, which is the
+* receiver clock bias (m). the transmission time, and so the satellite
+* position, depends on the clock bias (dtr) assumed so far
+*-----------------------------------------------------------------------------*/
+static int resobs(const obsd_t *obs, const nav_t *nav, ephc_t *ephc,
+                  const timeopt_t *opt, const double *pos, double dtr, double *v,
+                  double *var)
+{
+    const eph_t *eph;
+    gtime_t time;
+    double P,rs[3],dts,vare,e[3],azel[2],r,el,dion,dtrp;
+    int sys;
+
+    if (!(sys=satsys(obs->sat,NULL))||!(sys&opt->navsys)) return 0;
+    if ((P=obs->P[0])==0.0) return 0;
+    if (!(eph=seleph(obs->time,obs->sat,nav))) return 0;
+
+    /* transmission time by satellite clock, then by gpst */
+    time=timeadd(obs->time,-dtr-P/CLIGHT);
+    time=timeadd(time,-eph2clk(time,eph));
+    if (ephc) eph2posc(time,eph,ephc+obs->sat-1,rs,&dts,&vare);
+    else eph2pos(time,eph,rs,&dts,&vare);
+
+    if ((r=geodist(rs,opt->rr,e))<=0.0) return 0;
+    if ((el=satazel(pos,e,azel))<opt->elmin) return 0;
+
+    /* klobuchar delay is for L1, scaled to the first frequency of beidou */
+    dion=ionmodel(obs->time,nav->ion_gps,pos,azel);
+    if (sys==SYS_CMP) dion*=SQR(FREQ1/FREQ1_CMP);
+    dtrp=tropmodel(obs->time,pos,azel,REL_HUMI);
+
+    /* single frequency code: tgd (gps/qzss), bgd (galileo), tgd1 (beidou) */
+    P-=CLIGHT*eph->tgd[0];
+
+    *v=P-(r-CLIGHT*dts+dion+dtrp);
+    *var=SQR(ERR_CODE)+SQR(ERR_CODE/sin(el))+vare+SQR(dion*ERR_BRDCI)+
+         SQR(ERR_SAAS/(sin(el)+0.1));
+    return 1;
+}
+/* timing solution -------------------------------------------------------------
+* compute receiver clock bias by pseudoranges at a known antenna position
+* args   : obsd_t *obs      I   observation data of an epoch
+*          int    n         I   number of observation data
+*          nav_t  *nav      I   navigation data
+*          ephc_t *ephc     IO  orbit constants by satellite ([MAXSAT]) or NULL
+*          timeopt_t *opt   I   timing solution options
+*          timesol_t *sol   O   timing solution
+*          char   *msg      O   error message for error exit
+* return : status(1:ok,0:error)
+* notes  : the satellite worst off the solution is rejected and the solution
+*          repeated while it is more than opt->maxres off and at least
+*          MINSAT_REJ satellites are left
+*          with ephc, the orbit constants of an ephemeris are computed when it
+*          is first used and kept until the receiver decodes a new one
+*-----------------------------------------------------------------------------*/
+extern int timesol(const obsd_t *obs, int n, const nav_t *nav, ephc_t *ephc,
+                   const timeopt_t *opt, timesol_t *sol, char *msg)
+{
+    double pos[3],v[MAXOBS],var[MAXOBS],dtr=0.0,x=0.0,sw,swv,dv,dvmax,rms;
+    int i,j,iter,ns=0,nrej=0,used[MAXOBS],rej[MAXOBS]={0};
+
+    trace(3,"timesol : n=%d\n",n);
+
+    sol->time=n>0?obs[0].time:(gtime_t){0};
+    sol->dtr=sol->std=sol->rms=0.0;
+    sol->ns=sol->nrej=0;
+    msg[0]='\0';
+
+    if (n<=0) {
+        strcpy(msg,"no observation data");
+        return 0;
+    }
+    if (n>MAXOBS) n=MAXOBS;
+    ecef2pos(opt->rr,pos);
+
+    for (iter=0;iter<MAXITR;iter++) {
+        for (i=0;i<n;i++) {
+            used[i]=!rej[i]&&resobs(obs+i,nav,ephc,opt,pos,dtr,v+i,var+i);
+        }
+        for (;;) {
+            for (i=ns=0,sw=swv=0.0;i<n;i++) {
+                if (!used[i]) continue;
+                sw+=1.0/var[i]; swv+=v[i]/var[i]; ns++;
+            }
+            if (ns<=0) {
+                sprintf(msg,"no usable satellite (n=%d)",n);
+                return 0;
+            }
+            x=swv/sw;
+
+            if (ns<MINSAT_REJ) break;
+            for (i=0,j=-1,dvmax=0.0;i<n;i++) {
+                if (used[i]&&(dv=fabs(v[i]-x))>dvmax) {dvmax=dv; j=i;}
+            }
+            if (dvmax<=opt->maxres) break;
+
+            trace(2,"timesol: outlier rejected sat=%2d res=%.1f\n",obs[j].sat,
+                  v[j]-x);
+            used[j]=0; rej[j]=1; nrej++;
+        }
+        dv=x-CLIGHT*dtr;
+        dtr=x/CLIGHT;
+        if (fabs(dv)<CONV_CLK) break;
+    }
+    for (i=0,rms=0.0;i<n;i++) {
+        if (used[i]) rms+=SQR(v[i]-x);
+    }
+    sol->time=timeadd(obs[0].time,-dtr);
+    sol->dtr=dtr;
+    sol->std=sqrt(1.0/sw)/CLIGHT;
+    sol->rms=sqrt(rms/ns);
+    sol->ns=ns;
+    sol->nrej=nrej;
+    return 1;
+}
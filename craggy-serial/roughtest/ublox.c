@@ -57,6 +57,8 @@
  *           2017/06/10 1.24 output half-cycle-subtracted flag
  *-----------------------------------------------------------------------------*/
 #include "rtklib.h"
+#include "wtmlib.h"
+#include "CraggyTrace.h"
 
 #define UBXSYNC1 0xB5 /* ubx message sync code 1 */
 #define UBXSYNC2 0x62 /* ubx message sync code 2 */
@@ -69,6 +71,7 @@
 #define ID_NAVTIME 0x0120  /* ubx message id: nav time gps */
 #define ID_NAVDOPS 0x0104  /* ubx message id: gps dops */
 #define ID_NAVCLOCK 0x0122 /* ubx message id: clock solution */
+#define ID_NAVTIMELS 0x0126 /* ubx message id: leap second event info */
 
 #define ID_TIMEGLO 0x0123 /* ubx message id: nav time gps */
 #define ID_TIMEGST 0x0125 /* ubx message id: nav time galileo */
@@ -99,7 +102,7 @@
 
 #define ROUND(x) (int)floor((x) + 0.5)
 
-#define dbg
+/* trace every message decoded to stdout, build with -Ddbg */
 
 /* get fields (little-endian) ------------------------------------------------*/
 #define U1(p) (*((unsigned char *)(p)))
@@ -210,8 +213,48 @@ static u_int64_t TimeUs(clockid_t clock)
     return ret;
 }
 
+#if defined(WTMLIB_ARCH_X86_64) || defined(WTMLIB_ARCH_AARCH64)
+static wtmlib_TSCConversionParams_t tsc_conversion;
+static u_int64_t tsc_base;
+static u_int64_t tsc_base_monotonic_ns;
+static int tsc_calibrated = 0;
+
+// CalibrateTimestampCounter lets MonotonicUs read the TSC instead of making a system call.
+// The counter is anchored to CLOCK_MONOTONIC, so its timestamps compare with those of the
+// PPS capture. Returns 0 on success, otherwise MonotonicUs keeps using clock_gettime.
+int CalibrateTimestampCounter(char *err_msg, int err_msg_size)
+{
+    uint64_t secs_before_wrap;
+    if (wtmlib_GetTSCToNsecConversionParams(&tsc_conversion, &secs_before_wrap, err_msg, err_msg_size))
+    {
+        return -1;
+    }
+    tsc_base_monotonic_ns = TimeUs(CLOCK_MONOTONIC) * 1000;
+    tsc_base = WTMLIB_GET_TSC();
+    tsc_calibrated = 1;
+    return 0;
+}
+
+// MonotonicUs returns the value of the monotonic clock in microseconds.
+u_int64_t MonotonicUs()
+{
+    if (!tsc_calibrated)
+    {
+        return TimeUs(CLOCK_MONOTONIC);
+    }
+    u_int64_t ticks = WTMLIB_GET_TSC() - tsc_base;
+    return (tsc_base_monotonic_ns + WTMLIB_TSC_TO_NSEC(ticks, &tsc_conversion)) / 1000;
+}
+#else
+int CalibrateTimestampCounter(char *err_msg, int err_msg_size)
+{
+    snprintf(err_msg, err_msg_size, "no timestamp counter on this architecture");
+    return -1;
+}
+
 // MonotonicUs returns the value of the monotonic clock in microseconds.
 u_int64_t MonotonicUs() { return TimeUs(CLOCK_MONOTONIC); }
+#endif
 
 // MonotonicUs returns the value of the realtime clock in microseconds.
 u_int64_t RealtimeUs() { return TimeUs(CLOCK_REALTIME); }
@@ -475,10 +518,17 @@ static int decode_rxmrawx(raw_t *raw)
             raw->obs.data[n].SNR[j] = raw->obs.data[n].LLI[j] = 0;
             raw->obs.data[n].code[j] = CODE_NONE;
         }
+        /* same again by field, for loops over the satellites of the epoch */
+        raw->obsv.sat[n] = (unsigned char)sat;
+        raw->obsv.P[n] = raw->obs.data[n].P[0];
+        raw->obsv.L[n] = raw->obs.data[n].L[0];
+        raw->obsv.D[n] = raw->obs.data[n].D[0];
+        raw->obsv.cn0[n] = (float)U1(p + 26);
         n++;
     }
     raw->time = time;
     raw->obs.n = n;
+    raw->obsv.n = n;
     return 1;
 }
 
@@ -523,6 +573,9 @@ static int decode_ephem(int sat, raw_t *raw)
         decode_frame(raw->subfrm[sat - 1] + 60, &eph, NULL, NULL, NULL, NULL) != 3)
         return 0;
 
+    /* clear subframe 1-3 changed flags */
+    raw->subfrm[sat - 1][150] = 0;
+
     if (!strstr(raw->opt, "-EPHALL"))
     {
         if (eph.iode == raw->nav.eph[sat - 1].iode &&
@@ -752,6 +805,50 @@ static int decode_navtime(raw_t *raw)
     return 0;
 }
 
+/* decode ubx-nav-timels: leap second event info ---------------------------*/
+static int decode_navtimels(raw_t *raw)
+{
+    gtime_t time, tev = {0};
+    double tow;
+    int week, valid, currls, lschange, tolsev;
+    unsigned char *p = raw->buff + 6;
+
+#ifdef dbg
+    fprintf(stdout, "decode_navtimels: len=%d\n", raw->len);
+#endif
+
+    if (raw->len < 32)
+    {
+        return -1;
+    }
+    if (raw->outtype)
+    {
+        sprintf(raw->msgtype, "UBX NAV-TIMELS (%4d):", raw->len);
+    }
+    valid = U1(p + 23);
+    if (!(valid & 1) || raw->time.time == 0)
+    {
+        return 0;
+    }
+    /* time of week of the message in the week of the last epoch */
+    tow = time2gpst(raw->time, &week);
+    if (U4(p) * 1E-3 < tow - 302400.0)
+        week++;
+    else if (U4(p) * 1E-3 > tow + 302400.0)
+        week--;
+    time = gpst2time(week, U4(p) * 1E-3);
+
+    currls = I1(p + 9);   /* gps-utc (s) */
+    lschange = I1(p + 11);
+    tolsev = I4(p + 12);  /* time to the event, or since the last (s) */
+    if ((valid & 2) && lschange != 0 && tolsev > 0)
+    {
+        tev = timeadd(time, tolsev);
+    }
+    update_leaps(time, -currls, tev, -(currls + lschange));
+    return 0;
+}
+
 static int decode_navtime_gal(raw_t *raw)
 {
     int galWno, galTow, fGalTow, leaps;
@@ -840,7 +937,7 @@ static int decode_navtime_glo(raw_t *raw)
 /* decode ubx-trk-meas: trace measurement data -------------------------------*/
 static int decode_trkmeas(raw_t *raw)
 {
-    static double adrs[MAXSAT] = {0};
+    static _Thread_local double adrs[MAXSAT] = {0};
     gtime_t time;
     double ts, tr = -1.0, t, tau, utc_gpst, snr, adr, dop;
     int i, j, n = 0, nch, sys, prn, sat, qi, frq, flag, lock1, lock2, week;
@@ -995,7 +1092,7 @@ static int decode_trkmeas(raw_t *raw)
 /* decode ubx-trkd5: trace measurement data ----------------------------------*/
 static int decode_trkd5(raw_t *raw)
 {
-    static double adrs[MAXSAT] = {0};
+    static _Thread_local double adrs[MAXSAT] = {0};
     gtime_t time;
     double ts, tr = -1.0, t, tau, adr, dop, snr, utc_gpst;
     int i, j, n = 0, type, off, len, sys, prn, sat, qi, frq, flag, week;
@@ -1148,6 +1245,48 @@ static int decode_trkd5(raw_t *raw)
     return 1;
 }
 
+/* fingerprint of words 3-10 of a subframe (fnv-1a) --------------------------*/
+static unsigned int subfrm_fp(const unsigned char *frm)
+{
+    unsigned int fp = 2166136261u;
+    int i;
+
+    for (i = 6; i < 30; i++)
+        fp = (fp ^ frm[i]) * 16777619u;
+    return fp | 1; /* 0: no page seen */
+}
+
+/* save gps/qzss subframe and test whether its decoding would repeat the last.
+ * the tow in the how changes every subframe, so only words 3-10 are compared.
+ * ephemeris subframes 1-3 are flagged when changed in subframe buffer[150],
+ * almanac pages are fingerprinted by page sv id ------------------------------*/
+static int save_navsubfrm(raw_t *raw, int sat, int id, const unsigned int *words)
+{
+    unsigned char buff[30], *frm = raw->subfrm[sat - 1];
+    unsigned int fp;
+    int i, svid;
+
+    for (i = 0; i < 10; i++)
+    {
+        setbitu(buff, i * 24, 24, words[i]);
+    }
+    if (id <= 3)
+    {
+        if (memcmp(frm + (id - 1) * 30 + 6, buff + 6, 24))
+            frm[150] |= 1 << (id - 1);
+        memcpy(frm + (id - 1) * 30, buff, 30);
+        return id == 3 && !frm[150];
+    }
+    memcpy(frm + (id - 1) * 30, buff, 30);
+
+    svid = getbitu(buff, 50, 6);
+    fp = subfrm_fp(buff);
+    if (raw->almfp[sat - 1][svid] == fp)
+        return 1;
+    raw->almfp[sat - 1][svid] = fp;
+    return 0;
+}
+
 /* decode gps and qzss navigation data ---------------------------------------*/
 static int decode_nav(raw_t *raw, int sat, int off)
 {
@@ -1173,10 +1312,10 @@ static int decode_nav(raw_t *raw, int sat, int off)
 #endif
         return -1;
     }
-    for (i = 0; i < 10; i++)
-    {
-        setbitu(raw->subfrm[sat - 1] + (id - 1) * 30, i * 24, 24, words[i]);
-    }
+    /* skip subframe repeating the one decoded last, nav data unchanged */
+    if (save_navsubfrm(raw, sat, id, words))
+        return 0;
+
     if (id == 3)
         return decode_ephem(sat, raw);
     if (id == 4)
@@ -1190,7 +1329,7 @@ static int decode_nav(raw_t *raw, int sat, int off)
 static int decode_enav(raw_t *raw, int sat, int off)
 {
     eph_t eph = {0};
-    unsigned char *p = raw->buff + 6 + off, buff[32], crc_buff[26] = {0};
+    unsigned char *p = raw->buff + 6 + off, buff[32], crc_buff[26] = {0}, page[16];
     int i, j, k, part1, page1, part2, page2, type;
 
     if (raw->len < 44 + off)
@@ -1247,20 +1386,30 @@ static int decode_enav(raw_t *raw, int sat, int off)
     /* save page data (112 + 16 bits) to frame buffer */
     k = type * 16;
     for (i = 0, j = 2; i < 14; i++, j += 8)
-        raw->subfrm[sat - 1][k++] = getbitu(buff, j, 8);
+        page[i] = getbitu(buff, j, 8);
     for (i = 0, j = 2; i < 2; i++, j += 8)
-        raw->subfrm[sat - 1][k++] = getbitu(buff + 16, j, 8);
+        page[14 + i] = getbitu(buff + 16, j, 8);
+
+    /* set ephemeris word 1-4 changed flags, words 0, 5, 6 carry time */
+    if (1 <= type && type <= 4 && memcmp(raw->subfrm[sat - 1] + k, page, 16))
+        raw->subfrm[sat - 1][113] |= (1 << type);
+    memcpy(raw->subfrm[sat - 1] + k, page, 16);
 
     /* test word 0-6 flags */
     raw->subfrm[sat - 1][112] |= (1 << type);
     if (raw->subfrm[sat - 1][112] != 0x7F)
         return 0;
 
+    /* skip ephemeris words repeating those decoded last */
+    if (!raw->subfrm[sat - 1][113])
+        return 0;
+
     /* decode galileo inav ephemeris */
     if (!decode_gal_inav(raw->subfrm[sat - 1], &eph))
     {
         return 0;
     }
+    raw->subfrm[sat - 1][113] = 0;
     /* test svid consistency */
     if (eph.sat != sat)
     {
@@ -1589,20 +1738,14 @@ static int decode_navclock(raw_t *raw)
     return 0;
 }
 
-/* decode ublox raw message --------------------------------------------------*/
-static int decode_ubx(raw_t *raw)
+/* decode ublox raw message with a checked checksum -------------------------*/
+static int decode_ubx_msg(raw_t *raw)
 {
     int type = (U1(raw->buff + 2) << 8) + U1(raw->buff + 3);
 #ifdef dbg
     fprintf(stdout, "decode_ubx: type=%04x len=%d\n", type, raw->len);
 #endif
 
-    /* checksum */
-    if (!checksum(raw->buff, raw->len))
-    {
-        fprintf(stdout, "ubx checksum error: type=%04x len=%d\n", type, raw->len);
-        return -1;
-    }
     switch (type)
     {
     case ID_RXMRAW:
@@ -1617,6 +1760,8 @@ static int decode_ubx(raw_t *raw)
         return decode_navsol(raw);
     case ID_NAVSTAT:
         return decode_navstat(raw);
+    case ID_NAVTIMELS:
+        return decode_navtimels(raw);
     case ID_NAVTIME:
         return decode_navtime(raw);
     case ID_TRKMEAS:
@@ -1648,6 +1793,19 @@ static int decode_ubx(raw_t *raw)
     return 0;
 }
 
+/* decode ublox raw message --------------------------------------------------*/
+static int decode_ubx(raw_t *raw)
+{
+    /* checksum */
+    if (!checksum(raw->buff, raw->len))
+    {
+        fprintf(stdout, "ubx checksum error: type=%04x len=%d\n",
+                (U1(raw->buff + 2) << 8) + U1(raw->buff + 3), raw->len);
+        return -1;
+    }
+    return decode_ubx_msg(raw);
+}
+
 /* sync code -----------------------------------------------------------------*/
 static int sync_ubx(unsigned char *buff, unsigned char data)
 {
@@ -1713,7 +1871,39 @@ extern int input_ubx(raw_t *raw, unsigned char data)
     raw->nbyte = 0;
 
     /* decode ublox raw message */
-    return decode_ubx(raw);
+    CRAGGY_PROBE2(ubx_frame__start, (U1(raw->buff + 2) << 8) + U1(raw->buff + 3), raw->len);
+    int status = decode_ubx(raw);
+    CRAGGY_PROBE1(ubx_frame__done, status);
+    return status;
+}
+
+/* input ublox raw message from a frame ---------------------------------------
+ * input a ublox raw message found by the UBX framer of craggy-gnss, which
+ * reads the stream a block at a time and checks the frames itself
+ * args   : raw_t *raw   IO     receiver raw data control struct
+ *          unsigned char *frame I frame from sync code to checksum
+ *          size_t len     I     frame length (bytes)
+ * return : status as input_ubx()
+ * notes  : the checksum is not checked again
+ *-----------------------------------------------------------------------------*/
+extern int input_ubx_frame(raw_t *raw, const unsigned char *frame, size_t len)
+{
+    if (len < 8 || len > MAXRAWLEN)
+    {
+#ifdef dbg
+        fprintf(stdout, "ubx length error: len=%d\n", (int)len);
+#endif
+        return -1;
+    }
+    memcpy(raw->buff, frame, len);
+    raw->len = (int)len;
+    raw->nbyte = 0;
+
+    /* decode ublox raw message */
+    CRAGGY_PROBE2(ubx_frame__start, (U1(raw->buff + 2) << 8) + U1(raw->buff + 3), raw->len);
+    int status = decode_ubx_msg(raw);
+    CRAGGY_PROBE1(ubx_frame__done, status);
+    return status;
 }
 
 /* input ublox raw message from file -------------------------------------------
@@ -1721,6 +1911,9 @@ extern int input_ubx(raw_t *raw, unsigned char data)
  * args   : raw_t  *raw   IO     receiver raw data control struct
  *          FILE   *fp    I      file pointer
  * return : status(-2: end of file, -1...9: same as above)
+ * notes  : for raw receiver logs; sessions recorded by roughtest (-w) carry
+ *          receive times and are replayed frame by frame from a mapping of
+ *          the capture (capture.h) with input_ubx_frame()
  *-----------------------------------------------------------------------------*/
 extern int input_ubxf(raw_t *raw, FILE *fp)
 {
@@ -105,7 +105,7 @@
    and context switches. WTMLIB accounts for these negative effects by doing multiple
    measurements and applying some basic statistics to the measured values
 */
-#define WTMLIB_TSC_PER_SEC_SAMPLE_COUNT 30
+#define WTMLIB_TSC_PER_SEC_SAMPLE_COUNT 10
 /*
    System time period (in microseconds) that will be matched with a change of TSC. This
    value is used when calculating how many TSC ticks pass during a second-long time period
@@ -114,7 +114,7 @@
 	 second but with the specified time period. Then tsc-per-this-time-period is converted
 	 into tsc-per-second
 */
-#define WTMLIB_TIME_PERIOD_TO_MATCH_WITH_TSC 500000
+#define WTMLIB_TIME_PERIOD_TO_MATCH_WITH_TSC 100000
 /*
    A time period (measured in seconds) used to calculate TSC-to-nanoseconds conversion
    parameters
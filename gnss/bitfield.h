@@ -0,0 +1,64 @@
+#ifndef BITFIELD_H
+#define BITFIELD_H
+
+#include <stdint.h>
+
+/*
+ * Widest field bitfield_get extracts: any bit offset into a byte plus the width fits one 64-bit word.
+ */
+#define BITFIELD_MAX_WIDTH 57
+
+/*
+ * Extracts the width bits (0 to BITFIELD_MAX_WIDTH) starting start bits into buf, most significant bit
+ * first, as GNSS navigation data is laid out.
+ *
+ * The bytes the field spans are gathered into one big-endian word and the field is shifted out of it,
+ * instead of being assembled a bit at a time. No byte past the end of the field is read, so callers need not pad
+ * their buffers.
+ */
+static inline uint64_t bitfield_get(const unsigned char *buf, unsigned int start, unsigned int width)
+{
+    const unsigned char *p = buf + start / 8;
+    unsigned int skip = start % 8;
+    unsigned int nbytes = (skip + width + 7) / 8;
+    uint64_t word = 0;
+
+    if (width == 0 || width > BITFIELD_MAX_WIDTH)
+    {
+        return 0;
+    }
+    switch (nbytes)
+    {
+    case 8: word |= (uint64_t)p[7];
+    /* fall through */
+    case 7: word |= (uint64_t)p[6] << 8;
+    /* fall through */
+    case 6: word |= (uint64_t)p[5] << 16;
+    /* fall through */
+    case 5: word |= (uint64_t)p[4] << 24;
+    /* fall through */
+    case 4: word |= (uint64_t)p[3] << 32;
+    /* fall through */
+    case 3: word |= (uint64_t)p[2] << 40;
+    /* fall through */
+    case 2: word |= (uint64_t)p[1] << 48;
+    /* fall through */
+    default: word |= (uint64_t)p[0] << 56;
+    }
+    return (word << skip) >> (64 - width);
+}
+
+/*
+ * As bitfield_get, sign extending the field from its top bit.
+ */
+static inline int64_t bitfield_get_signed(const unsigned char *buf, unsigned int start, unsigned int width)
+{
+    uint64_t field = bitfield_get(buf, start, width);
+    if (width == 0 || width > BITFIELD_MAX_WIDTH || !(field >> (width - 1)))
+    {
+        return (int64_t)field;
+    }
+    return (int64_t)(field | ~0ULL << width);
+}
+
+#endif /* BITFIELD_H */
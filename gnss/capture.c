@@ -0,0 +1,261 @@
+/*H**********************************************************************
+ * FILENAME :        capture.c
+ *
+ * DESCRIPTION :
+ *       Recording and replay of the UBX frames and Roughtime packets of a session.
+ *
+ * PUBLIC FUNCTIONS :
+ *       bool capture_open(capture_writer_t *writer, const char *path)
+ *       bool capture_write(capture_writer_t *writer, capture_record_type_t type, unsigned int source, uint64_t timestamp_us, const void *data, size_t len)
+ *       void capture_close(capture_writer_t *writer)
+ *       bool capture_reader_open(capture_reader_t *reader, const char *path)
+ *       bool capture_reader_next(capture_reader_t *reader, capture_record_t *record)
+ *       void capture_reader_close(capture_reader_t *reader)
+ *       void capture_pacer_init(capture_pacer_t *pacer)
+ *       void capture_pace(capture_pacer_t *pacer, uint64_t timestamp_us)
+ *
+ * NOTES :
+ *       Records are only ever appended. A reader stops at a record cut short, so a capture can be
+ *       replayed while it is still being written, or after its writer died.
+ *
+ *H*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include "capture.h"
+
+#define CAPTURE_ALIGN 8
+
+typedef struct
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+} capture_file_header_t;
+
+typedef struct
+{
+    uint16_t type;
+    uint16_t source;
+    uint32_t length;
+    uint64_t timestamp_us;
+} capture_record_header_t;
+
+_Static_assert(sizeof(capture_file_header_t) % CAPTURE_ALIGN == 0, "records must start aligned");
+_Static_assert(sizeof(capture_record_header_t) % CAPTURE_ALIGN == 0, "payloads must start aligned");
+
+static size_t padded(size_t len)
+{
+    return (len + CAPTURE_ALIGN - 1) & ~(size_t)(CAPTURE_ALIGN - 1);
+}
+
+static bool header_valid(const capture_file_header_t *header)
+{
+    // A capture from a host of the other byte order fails on its version
+    return memcmp(header->magic, CAPTURE_MAGIC, sizeof(header->magic)) == 0 && header->version == CAPTURE_VERSION;
+}
+
+/*
+ * Where the complete records of a mapped capture end
+ */
+static size_t records_end(const unsigned char *map, size_t size)
+{
+    capture_reader_t reader = {map, size, sizeof(capture_file_header_t)};
+    capture_record_t record;
+    while (capture_reader_next(&reader, &record))
+    {
+    }
+    return reader.offset;
+}
+
+bool capture_open(capture_writer_t *writer, const char *path)
+{
+    writer->fd = open(path, O_RDWR | O_CREAT | O_APPEND, 0644);
+    if (writer->fd < 0)
+    {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(writer->fd, &st) != 0)
+    {
+        goto error;
+    }
+    if (st.st_size == 0)
+    {
+        capture_file_header_t header = {CAPTURE_MAGIC, CAPTURE_VERSION, 0};
+        if (write(writer->fd, &header, sizeof(header)) != (ssize_t)sizeof(header))
+        {
+            goto error;
+        }
+        return true;
+    }
+    if ((size_t)st.st_size < sizeof(capture_file_header_t))
+    {
+        goto error;
+    }
+
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, writer->fd, 0);
+    if (map == MAP_FAILED)
+    {
+        goto error;
+    }
+    bool valid = header_valid(map);
+    size_t end = valid ? records_end(map, (size_t)st.st_size) : 0;
+    munmap(map, (size_t)st.st_size);
+    if (!valid)
+    {
+        errno = EINVAL;
+        goto error;
+    }
+    // New records are to follow the last complete one, not the remains of a torn one
+    if (end < (size_t)st.st_size && ftruncate(writer->fd, (off_t)end) != 0)
+    {
+        goto error;
+    }
+    return true;
+
+error:
+    close(writer->fd);
+    writer->fd = -1;
+    return false;
+}
+
+bool capture_write(capture_writer_t *writer, capture_record_type_t type, unsigned int source, uint64_t timestamp_us, const void *data, size_t len)
+{
+    static const unsigned char padding[CAPTURE_ALIGN];
+
+    if (writer->fd < 0 || len > CAPTURE_MAX_RECORD || source > UINT16_MAX)
+    {
+        return false;
+    }
+    capture_record_header_t header = {(uint16_t)type, (uint16_t)source, (uint32_t)len, timestamp_us};
+    struct iovec iov[3] = {
+        {&header, sizeof(header)},
+        {(void *)data, len},
+        {(void *)padding, padded(len) - len},
+    };
+    ssize_t total = (ssize_t)(sizeof(header) + padded(len));
+    ssize_t n;
+    do
+    {
+        n = writev(writer->fd, iov, 3);
+    } while (n < 0 && errno == EINTR);
+    return n == total;
+}
+
+void capture_close(capture_writer_t *writer)
+{
+    if (writer->fd >= 0)
+    {
+        close(writer->fd);
+    }
+    writer->fd = -1;
+}
+
+bool capture_reader_open(capture_reader_t *reader, const char *path)
+{
+    reader->map = NULL;
+    reader->size = 0;
+    reader->offset = 0;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(capture_file_header_t))
+    {
+        close(fd);
+        errno = EINVAL;
+        return false;
+    }
+    // The mapping outlives the descriptor
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        return false;
+    }
+    if (!header_valid(map))
+    {
+        munmap(map, (size_t)st.st_size);
+        errno = EINVAL;
+        return false;
+    }
+    // Records are read front to back, once
+    madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+    reader->map = map;
+    reader->size = (size_t)st.st_size;
+    reader->offset = sizeof(capture_file_header_t);
+    return true;
+}
+
+bool capture_reader_next(capture_reader_t *reader, capture_record_t *record)
+{
+    if (reader->size - reader->offset < sizeof(capture_record_header_t))
+    {
+        return false;
+    }
+    const capture_record_header_t *header = (const capture_record_header_t *)(reader->map + reader->offset);
+    if (header->length > CAPTURE_MAX_RECORD ||
+        reader->size - reader->offset - sizeof(capture_record_header_t) < padded(header->length))
+    {
+        return false;
+    }
+    record->type = header->type;
+    record->source = header->source;
+    record->length = header->length;
+    record->timestamp_us = header->timestamp_us;
+    record->data = reader->map + reader->offset + sizeof(capture_record_header_t);
+    reader->offset += sizeof(capture_record_header_t) + padded(header->length);
+    return true;
+}
+
+void capture_reader_close(capture_reader_t *reader)
+{
+    if (reader->map != NULL)
+    {
+        munmap((void *)reader->map, reader->size);
+    }
+    reader->map = NULL;
+    reader->size = 0;
+    reader->offset = 0;
+}
+
+void capture_pacer_init(capture_pacer_t *pacer)
+{
+    pacer->started = false;
+    pacer->first_record_us = 0;
+    pacer->start_us = 0;
+}
+
+void capture_pace(capture_pacer_t *pacer, uint64_t timestamp_us)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (!pacer->started)
+    {
+        pacer->started = true;
+        pacer->first_record_us = timestamp_us;
+        pacer->start_us = (uint64_t)now.tv_sec * 1000000 + (uint64_t)now.tv_nsec / 1000;
+        return;
+    }
+    if (timestamp_us <= pacer->first_record_us)
+    {
+        return;
+    }
+    uint64_t due_us = pacer->start_us + (timestamp_us - pacer->first_record_us);
+    struct timespec due = {(time_t)(due_us / 1000000), (long)(due_us % 1000000) * 1000};
+    // A signal cuts the wait short, for the caller to notice
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &due, NULL);
+}
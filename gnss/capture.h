@@ -0,0 +1,107 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * A capture is an append-only log of what a tester received and sent, for replaying a session
+ * deterministically. It starts with a header of 16 bytes:
+ *
+ *     magic "CRGYCAP\0" (8), version (u32), reserved (u32)
+ *
+ * followed by records, each a header of 16 bytes and its payload padded to a multiple of 8 bytes:
+ *
+ *     type (u16), source (u16), payload length (u32), timestamp in microseconds of the monotonic clock (u64)
+ *
+ * The source tells apart the receivers of a tester reading several. Roughtime records are of source 0.
+ *
+ * Integers are in the byte order of the host that wrote the capture. Every record starts 8-byte aligned,
+ * so a capture mapped into memory is read in place.
+ */
+#define CAPTURE_MAGIC "CRGYCAP"
+#define CAPTURE_VERSION 2
+
+/*
+ * Largest payload accepted, more than the largest UBX frame or Roughtime packet.
+ */
+#define CAPTURE_MAX_RECORD 65536
+
+typedef enum
+{
+    /* A UBX frame, sync word to checksum, stamped when the bytes completing it were read */
+    CAPTURE_UBX_FRAME = 1,
+    /* A Roughtime request as sent, stamped when it was sent */
+    CAPTURE_ROUGHTIME_REQUEST = 2,
+    /* The response to the request before it, stamped when it was received */
+    CAPTURE_ROUGHTIME_RESPONSE = 3,
+} capture_record_type_t;
+
+typedef struct
+{
+    uint16_t type;
+    uint16_t source;
+    uint32_t length;
+    uint64_t timestamp_us;
+    /* Points into the mapping of the capture, valid until the reader is closed */
+    const unsigned char *data;
+} capture_record_t;
+
+/*
+ * Appends records to a capture. Each record goes out in a single writev on a descriptor opened with
+ * O_APPEND, so threads may share a writer.
+ */
+typedef struct
+{
+    int fd;
+} capture_writer_t;
+
+/*
+ * Opens a capture for appending, creating it if needed. An existing capture must be of this version;
+ * a record cut short at its end, as left by a writer that was killed, is dropped.
+ */
+bool capture_open(capture_writer_t *writer, const char *path);
+
+bool capture_write(capture_writer_t *writer, capture_record_type_t type, unsigned int source, uint64_t timestamp_us, const void *data, size_t len);
+
+void capture_close(capture_writer_t *writer);
+
+/*
+ * Reads a capture through a read-only mapping, handing out records without copying them.
+ */
+typedef struct
+{
+    const unsigned char *map;
+    size_t size;
+    /* Of the next record */
+    size_t offset;
+} capture_reader_t;
+
+bool capture_reader_open(capture_reader_t *reader, const char *path);
+
+/*
+ * Returns the next record, or false at the end of the capture or at a record cut short.
+ */
+bool capture_reader_next(capture_reader_t *reader, capture_record_t *record);
+
+void capture_reader_close(capture_reader_t *reader);
+
+/*
+ * Spaces out records replayed in real time as they were recorded.
+ */
+typedef struct
+{
+    bool started;
+    uint64_t first_record_us;
+    uint64_t start_us;
+} capture_pacer_t;
+
+void capture_pacer_init(capture_pacer_t *pacer);
+
+/*
+ * Sleeps until as long after the first record paced as the one given was recorded after it.
+ */
+void capture_pace(capture_pacer_t *pacer, uint64_t timestamp_us);
+
+#endif /* CAPTURE_H */
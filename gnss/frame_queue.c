@@ -0,0 +1,181 @@
+/*H**********************************************************************
+ * FILENAME :        frame_queue.c
+ *
+ * DESCRIPTION :
+ *       Single-producer single-consumer queue of timestamped frames.
+ *
+ * PUBLIC FUNCTIONS :
+ *       bool frame_queue_init(frame_queue_t *queue)
+ *       void frame_queue_destroy(frame_queue_t *queue)
+ *       bool frame_queue_push(frame_queue_t *queue, const unsigned char *frame, size_t len, uint64_t rx_us)
+ *       bool frame_queue_peek(frame_queue_t *queue, unsigned char **frame, size_t *len, uint64_t *rx_us)
+ *       void frame_queue_pop(frame_queue_t *queue)
+ *       bool frame_queue_wait(frame_queue_t *queue, int timeout_ms)
+ *
+ * NOTES :
+ *       A frame is stored whole behind a header of 16 bytes. One that would run over the end of the
+ *       ring starts again at its beginning, behind a header marking the rest of the ring skipped, so
+ *       every frame is read as one contiguous view.
+ *
+ *H*/
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "frame_queue.h"
+
+#define FRAME_QUEUE_MASK (FRAME_QUEUE_SIZE - 1)
+#define FRAME_QUEUE_ALIGN 16
+#define FRAME_QUEUE_SKIP UINT32_MAX
+
+typedef struct
+{
+    uint32_t length;
+    uint32_t reserved;
+    uint64_t rx_us;
+} frame_header_t;
+
+_Static_assert((FRAME_QUEUE_SIZE & FRAME_QUEUE_MASK) == 0, "the queue size must be a power of two");
+_Static_assert(sizeof(frame_header_t) == FRAME_QUEUE_ALIGN, "a header must fit wherever the rest of the ring is skipped");
+
+static size_t padded(size_t len)
+{
+    return (len + FRAME_QUEUE_ALIGN - 1) & ~(size_t)(FRAME_QUEUE_ALIGN - 1);
+}
+
+static bool queued(frame_queue_t *queue)
+{
+    return atomic_load(&queue->head) != atomic_load_explicit(&queue->tail, memory_order_relaxed);
+}
+
+bool frame_queue_init(frame_queue_t *queue)
+{
+    queue->ring = aligned_alloc(64, FRAME_QUEUE_SIZE);
+    if (queue->ring == NULL)
+    {
+        return false;
+    }
+    atomic_init(&queue->head, 0);
+    atomic_init(&queue->tail, 0);
+    queue->dropped = 0;
+    atomic_init(&queue->sleeping, false);
+    if (sem_init(&queue->wakeup, 0, 0) != 0)
+    {
+        free(queue->ring);
+        queue->ring = NULL;
+        return false;
+    }
+    return true;
+}
+
+void frame_queue_destroy(frame_queue_t *queue)
+{
+    if (queue->ring == NULL)
+    {
+        return;
+    }
+    sem_destroy(&queue->wakeup);
+    free(queue->ring);
+    queue->ring = NULL;
+}
+
+bool frame_queue_push(frame_queue_t *queue, const unsigned char *frame, size_t len, uint64_t rx_us)
+{
+    size_t need = sizeof(frame_header_t) + padded(len);
+    if (need > FRAME_QUEUE_SIZE / 2)
+    {
+        queue->dropped++;
+        return false;
+    }
+
+    size_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+    size_t offset = head & FRAME_QUEUE_MASK;
+    size_t skip = FRAME_QUEUE_SIZE - offset < need ? FRAME_QUEUE_SIZE - offset : 0;
+    if (FRAME_QUEUE_SIZE - (head - tail) < skip + need)
+    {
+        queue->dropped++;
+        return false;
+    }
+    if (skip > 0)
+    {
+        frame_header_t marker = {FRAME_QUEUE_SKIP, 0, 0};
+        memcpy(queue->ring + offset, &marker, sizeof(marker));
+        offset = 0;
+    }
+    frame_header_t header = {(uint32_t)len, 0, rx_us};
+    memcpy(queue->ring + offset, &header, sizeof(header));
+    memcpy(queue->ring + offset + sizeof(header), frame, len);
+
+    // Sequentially consistent, against the consumer storing sleeping before it looks at head
+    atomic_store(&queue->head, head + skip + need);
+    // Only a consumer gone to sleep needs waking, which keeps the semaphore off the common path
+    if (atomic_exchange(&queue->sleeping, false))
+    {
+        sem_post(&queue->wakeup);
+    }
+    return true;
+}
+
+bool frame_queue_peek(frame_queue_t *queue, unsigned char **frame, size_t *len, uint64_t *rx_us)
+{
+    size_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&queue->head, memory_order_acquire);
+    if (tail == head)
+    {
+        return false;
+    }
+    frame_header_t header;
+    memcpy(&header, queue->ring + (tail & FRAME_QUEUE_MASK), sizeof(header));
+    if (header.length == FRAME_QUEUE_SKIP)
+    {
+        // The producer publishes the marker together with the frame after it
+        tail += FRAME_QUEUE_SIZE - (tail & FRAME_QUEUE_MASK);
+        atomic_store_explicit(&queue->tail, tail, memory_order_release);
+        memcpy(&header, queue->ring, sizeof(header));
+    }
+    *frame = queue->ring + (tail & FRAME_QUEUE_MASK) + sizeof(header);
+    *len = header.length;
+    *rx_us = header.rx_us;
+    return true;
+}
+
+void frame_queue_pop(frame_queue_t *queue)
+{
+    size_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    frame_header_t header;
+    memcpy(&header, queue->ring + (tail & FRAME_QUEUE_MASK), sizeof(header));
+    atomic_store_explicit(&queue->tail, tail + sizeof(header) + padded(header.length), memory_order_release);
+}
+
+bool frame_queue_wait(frame_queue_t *queue, int timeout_ms)
+{
+    if (queued(queue))
+    {
+        return true;
+    }
+    atomic_store(&queue->sleeping, true);
+    if (queued(queue))
+    {
+        atomic_store(&queue->sleeping, false);
+        return true;
+    }
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000)
+    {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+    while (sem_timedwait(&queue->wakeup, &deadline) != 0 && errno == EINTR)
+    {
+    }
+    // A post left over from a wait that timed out only wakes the next one early
+    atomic_store(&queue->sleeping, false);
+    return queued(queue);
+}
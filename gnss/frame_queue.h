@@ -0,0 +1,62 @@
+#ifndef FRAME_QUEUE_H
+#define FRAME_QUEUE_H
+
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Bytes of frames queued between the thread reading a receiver and the one decoding it, several
+ * seconds of a receiver at 115200 baud. Power of two.
+ */
+#define FRAME_QUEUE_SIZE 65536
+
+/*
+ * Hands frames from one thread to another without locks. The producer copies each frame, with the
+ * time it arrived, into a ring allocated up front; the consumer reads it in place. A frame that does
+ * not fit is dropped and counted rather than waited for, so the producer never blocks.
+ *
+ * The consumer sleeps on a semaphore when the ring is empty. Only a consumer that went to sleep is
+ * posted, so a producer keeping up pays no system call.
+ */
+typedef struct
+{
+    unsigned char *ring;
+    /* Stream positions, wrapped on access only. Each is written by one side, on a cache line of its own */
+    _Alignas(64) atomic_size_t head;
+    _Alignas(64) atomic_size_t tail;
+    /* The producer's alone */
+    _Alignas(64) unsigned long dropped;
+    atomic_bool sleeping;
+    sem_t wakeup;
+} frame_queue_t;
+
+bool frame_queue_init(frame_queue_t *queue);
+
+void frame_queue_destroy(frame_queue_t *queue);
+
+/*
+ * Queues a copy of a frame, from the producer. Returns false if there is no room for it.
+ */
+bool frame_queue_push(frame_queue_t *queue, const unsigned char *frame, size_t len, uint64_t rx_us);
+
+/*
+ * Finds the oldest frame queued, for the consumer. The view stays valid until frame_queue_pop.
+ * Returns false if the queue is empty.
+ */
+bool frame_queue_peek(frame_queue_t *queue, unsigned char **frame, size_t *len, uint64_t *rx_us);
+
+/*
+ * Releases the frame last peeked at.
+ */
+void frame_queue_pop(frame_queue_t *queue);
+
+/*
+ * Sleeps until a frame is queued or timeout_ms passed, for the consumer. Returns whether the queue
+ * holds a frame.
+ */
+bool frame_queue_wait(frame_queue_t *queue, int timeout_ms);
+
+#endif /* FRAME_QUEUE_H */
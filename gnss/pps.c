@@ -0,0 +1,296 @@
+//
+// Created by marco on 2021-01-15.
+//
+
+/*
+ * ppstest.c -- simple tool to monitor PPS timestamps
+ *
+ * Copyright (C) 2005-2007   Rodolfo Giometti <giometti@linux.it>
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <string.h>
+#include <time.h>
+
+#include "pps.h"
+
+#if defined(__linux__)
+
+/* How long the capture thread waits for an edge before checking whether to stop */
+#define PPS_FETCH_TIMEOUT_S 1
+/* Poll period where the source cannot wait for edges */
+#define PPS_POLL_PERIOD_US 50000
+
+static struct timespec offset_assert = {0, 0};
+
+int find_source(char *path, pps_handle_t *handle, int *avail_mode)
+{
+    pps_params_t params;
+    int ret;
+
+    printf("trying PPS source \"%s\"\n", path);
+
+    /* Try to find the source by using the supplied "path" name */
+    ret = open(path, O_RDWR);
+    if (ret < 0) {
+        fprintf(stderr, "unable to open device \"%s\" (%m)\n", path);
+        return ret;
+    }
+
+    /* Open the PPS source (and check the file descriptor) */
+    ret = time_pps_create(ret, handle);
+    if (ret < 0) {
+        fprintf(stderr, "cannot create a PPS source from device "
+                        "\"%s\" (%m)\n", path);
+        return -1;
+    }
+    printf("found PPS source \"%s\"\n", path);
+
+    /* Find out what features are supported */
+    ret = time_pps_getcap(*handle, avail_mode);
+    if (ret < 0) {
+        fprintf(stderr, "cannot get capabilities (%m)\n");
+        return -1;
+    }
+    if ((*avail_mode & PPS_CAPTUREASSERT) == 0) {
+        fprintf(stderr, "cannot CAPTUREASSERT\n");
+        return -1;
+    }
+
+    /* Capture assert timestamps */
+    ret = time_pps_getparams(*handle, &params);
+    if (ret < 0) {
+        fprintf(stderr, "cannot get parameters (%m)\n");
+        return -1;
+    }
+    params.mode |= PPS_CAPTUREASSERT;
+    /* Override any previous offset if possible */
+    if ((*avail_mode & PPS_OFFSETASSERT) != 0) {
+        params.mode |= PPS_OFFSETASSERT;
+        params.assert_offset = offset_assert;
+    }
+    ret = time_pps_setparams(*handle, &params);
+    if (ret < 0) {
+        fprintf(stderr, "cannot set parameters (%m)\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+int fetch_source(int i, pps_handle_t *handle, int *avail_mode, pps_info_t *infobuf)
+{
+    struct timespec timeout;
+    int ret;
+
+    /* create a zero-valued timeout */
+    timeout.tv_sec = 3;
+    timeout.tv_nsec = 0;
+
+    retry:
+    if (*avail_mode & PPS_CANWAIT) /* waits for the next event */
+        ret = time_pps_fetch(*handle, PPS_TSFMT_TSPEC, infobuf,
+                             &timeout);
+    else {
+        sleep(1);
+        ret = time_pps_fetch(*handle, PPS_TSFMT_TSPEC, infobuf,
+                             &timeout);
+    }
+    if (ret < 0) {
+        if (ret == -EINTR) {
+            fprintf(stderr, "time_pps_fetch() got a signal!\n");
+            goto retry;
+        }
+
+        fprintf(stderr, "time_pps_fetch() error %d (%m)\n", ret);
+        return -1;
+    }
+
+    printf("source %d - "
+           "assert %ld.%09ld, sequence: %ld - "
+           "clear  %ld.%09ld, sequence: %ld\n",
+           i,
+           infobuf->assert_timestamp.tv_sec,
+           infobuf->assert_timestamp.tv_nsec,
+           infobuf->assert_sequence,
+           infobuf->clear_timestamp.tv_sec,
+           infobuf->clear_timestamp.tv_nsec, infobuf->clear_sequence);
+    fflush(stdout);
+
+    return 0;
+}
+
+static void *pps_capture_thread(void *arg)
+{
+    pps_capture_t *capture = arg;
+    pps_info_t info;
+    pps_seq_t last_sequence = 0;
+    struct timespec timeout;
+    struct timespec realtime;
+    struct timespec monotonic;
+    struct timespec monotonic_after;
+    int can_wait = capture->avail_mode & PPS_CANWAIT;
+    int ret;
+
+    /* Ahead of other threads, the edge is carried over to the monotonic clock as soon as it is fetched */
+    ret = rt_thread_setup(&capture->rt, "pps-capture");
+    if (ret != 0) {
+        fprintf(stderr, "cannot set up the PPS capture thread (%s)\n", strerror(ret));
+    }
+
+    while (!capture->exit) {
+        if (can_wait) {
+            /* Sleeps in the kernel until the next edge */
+            timeout.tv_sec = PPS_FETCH_TIMEOUT_S;
+            timeout.tv_nsec = 0;
+        } else {
+            usleep(PPS_POLL_PERIOD_US);
+            timeout.tv_sec = 0;
+            timeout.tv_nsec = 0;
+        }
+        ret = time_pps_fetch(capture->handle, PPS_TSFMT_TSPEC, &info, &timeout);
+        if (ret < 0) {
+            if (errno != EINTR && errno != ETIMEDOUT) {
+                fprintf(stderr, "time_pps_fetch() error %d (%m)\n", ret);
+                sleep(1);
+            }
+            continue;
+        }
+        if (info.assert_sequence == last_sequence) {
+            continue;
+        }
+        last_sequence = info.assert_sequence;
+
+        /* Carry the edge over to the monotonic clock, as it is the clock Roughtime samples are taken
+         * with. The realtime clock is read between two reads of the monotonic one, whose mean is the
+         * same instant to within half the gap */
+        clock_gettime(CLOCK_MONOTONIC, &monotonic);
+        clock_gettime(CLOCK_REALTIME, &realtime);
+        clock_gettime(CLOCK_MONOTONIC, &monotonic_after);
+
+        pps_edge_t edge;
+        edge.assert_realtime_ns = (u_int64_t)info.assert_timestamp.tv_sec * 1000000000 +
+                                  info.assert_timestamp.tv_nsec;
+        u_int64_t realtime_ns = (u_int64_t)realtime.tv_sec * 1000000000 + realtime.tv_nsec;
+        u_int64_t monotonic_ns = ((u_int64_t)monotonic.tv_sec * 1000000000 + monotonic.tv_nsec) / 2 +
+                                 ((u_int64_t)monotonic_after.tv_sec * 1000000000 + monotonic_after.tv_nsec) / 2;
+        edge.assert_monotonic_ns = monotonic_ns - (realtime_ns - edge.assert_realtime_ns);
+        edge.sequence = info.assert_sequence;
+
+        pthread_mutex_lock(&capture->lock);
+        memmove(&capture->edges[1], &capture->edges[0], sizeof(capture->edges) - sizeof(capture->edges[0]));
+        capture->edges[0] = edge;
+        if (capture->num_edges < PPS_EDGE_HISTORY) {
+            capture->num_edges++;
+        }
+        pthread_mutex_unlock(&capture->lock);
+
+        /* A full pipe already has a notification pending, so losing this one is harmless */
+        char byte = 0;
+        if (write(capture->notify[1], &byte, 1) < 0 && errno != EAGAIN) {
+            fprintf(stderr, "cannot notify of PPS edge (%m)\n");
+        }
+    }
+    return NULL;
+}
+
+int pps_capture_start(pps_capture_t *capture, char *path, const rt_thread_config_t *rt)
+{
+    memset(capture, 0, sizeof(*capture));
+    capture->rt = *rt;
+    if (find_source(path, &capture->handle, &capture->avail_mode) < 0) {
+        return -1;
+    }
+    if ((capture->avail_mode & PPS_CANWAIT) == 0) {
+        fprintf(stderr, "PPS source cannot wait for edges, polling every %d us\n", PPS_POLL_PERIOD_US);
+    }
+
+    if (pipe(capture->notify) < 0) {
+        fprintf(stderr, "cannot create the PPS notification pipe (%m)\n");
+        time_pps_destroy(capture->handle);
+        return -1;
+    }
+    fcntl(capture->notify[0], F_SETFL, O_NONBLOCK);
+    fcntl(capture->notify[1], F_SETFL, O_NONBLOCK);
+
+    pthread_mutex_init(&capture->lock, NULL);
+    if (pthread_create(&capture->thread, NULL, pps_capture_thread, capture) != 0) {
+        fprintf(stderr, "cannot start the PPS capture thread\n");
+        pthread_mutex_destroy(&capture->lock);
+        close(capture->notify[0]);
+        close(capture->notify[1]);
+        time_pps_destroy(capture->handle);
+        return -1;
+    }
+    return 0;
+}
+
+void pps_capture_stop(pps_capture_t *capture)
+{
+    capture->exit = 1;
+    pthread_join(capture->thread, NULL);
+    pthread_mutex_destroy(&capture->lock);
+    close(capture->notify[0]);
+    close(capture->notify[1]);
+    time_pps_destroy(capture->handle);
+}
+
+#else
+
+int pps_capture_start(pps_capture_t *capture, char *path, const rt_thread_config_t *rt)
+{
+    (void)rt;
+    memset(capture, 0, sizeof(*capture));
+    fprintf(stderr, "cannot capture \"%s\", PPS sources are read through LinuxPPS only\n", path);
+    return -1;
+}
+
+void pps_capture_stop(pps_capture_t *capture)
+{
+    (void)capture;
+}
+
+#endif
+
+int pps_capture_fd(pps_capture_t *capture)
+{
+    return capture->notify[0];
+}
+
+void pps_capture_drain(pps_capture_t *capture)
+{
+    char bytes[16];
+    while (read(capture->notify[0], bytes, sizeof(bytes)) > 0)
+        ;
+}
+
+int pps_capture_edge_before(pps_capture_t *capture, u_int64_t monotonic_ns, pps_edge_t *edge)
+{
+    int ret = -1;
+
+    pthread_mutex_lock(&capture->lock);
+    for (int i = 0; i < capture->num_edges; i++) {
+        if (capture->edges[i].assert_monotonic_ns <= monotonic_ns) {
+            *edge = capture->edges[i];
+            ret = 0;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&capture->lock);
+    return ret;
+}
@@ -0,0 +1,81 @@
+//
+// Created by marco on 2021-01-15.
+//
+
+#ifndef DEMO_PPS_PPS_H
+#define DEMO_PPS_PPS_H
+
+#include <pthread.h>
+#include <sys/types.h>
+
+#if defined(__linux__)
+#include "timepps.h"
+#else
+typedef int pps_handle_t; /* no source can be opened but through LinuxPPS */
+#endif
+#include "rt_thread.h"
+
+/*
+ * Edges remembered, enough to cover a Roughtime sample waiting for the fix after it.
+ */
+#define PPS_EDGE_HISTORY 8
+
+/*
+ * One assert edge of the PPS signal, the start of a GNSS second.
+ */
+typedef struct {
+    u_int64_t assert_realtime_ns; /* kernel timestamp of the edge, CLOCK_REALTIME */
+    u_int64_t assert_monotonic_ns; /* the same instant on the monotonic clock */
+    unsigned long sequence;
+} pps_edge_t;
+
+/*
+ * Captures PPS edges in a thread of its own. The thread sleeps in time_pps_fetch
+ * until the kernel has timestamped the next edge, so the timestamps carry no
+ * serial or scheduling latency.
+ */
+typedef struct {
+    pps_handle_t handle;
+    int avail_mode;
+    pthread_t thread;
+    rt_thread_config_t rt; /* how the capture thread runs */
+    pthread_mutex_t lock;
+    volatile int exit;
+
+    /* Last edges captured, the latest first */
+    pps_edge_t edges[PPS_EDGE_HISTORY];
+    int num_edges;
+
+    /* A byte is written to notify[1] for every edge captured */
+    int notify[2];
+} pps_capture_t;
+
+/*
+ * Opens the PPS source at path and starts capturing its assert edges, in a
+ * thread set up as rt asks. Returns 0 if successful.
+ */
+int pps_capture_start(pps_capture_t *capture, char *path, const rt_thread_config_t *rt);
+
+/*
+ * Stops the capture thread and closes the source.
+ */
+void pps_capture_stop(pps_capture_t *capture);
+
+/*
+ * Descriptor that becomes readable when an edge has been captured, for poll.
+ * Call pps_capture_drain once it is.
+ */
+int pps_capture_fd(pps_capture_t *capture);
+
+/*
+ * Consumes the notifications pending on pps_capture_fd.
+ */
+void pps_capture_drain(pps_capture_t *capture);
+
+/*
+ * Finds the latest edge captured at or before the given monotonic time, in
+ * nanoseconds. Returns 0 if there is one.
+ */
+int pps_capture_edge_before(pps_capture_t *capture, u_int64_t monotonic_ns, pps_edge_t *edge);
+
+#endif //DEMO_PPS_PPS_H
@@ -0,0 +1,138 @@
+/*H**********************************************************************
+ * FILENAME :        rt_thread.c
+ *
+ * DESCRIPTION :
+ *       Set-up of the threads that timestamp receiver messages and Roughtime round trips.
+ *
+ * PUBLIC FUNCTIONS :
+ *       void rt_thread_config_init(rt_thread_config_t *config)
+ *       int rt_thread_setup(const rt_thread_config_t *config, const char *name)
+ *       int rt_thread_set_name(const char *name)
+ *       int rt_thread_pin(int core)
+ *       int rt_thread_set_priority(int priority)
+ *       void rt_thread_prefault_stack(size_t bytes)
+ *       int rt_lock_memory(void)
+ *
+ * NOTES :
+ *       Affinity and thread names are Linux extensions; elsewhere pinning fails with ENOSYS and naming
+ *       does nothing.
+ *
+ *H*/
+
+#if defined(__linux__)
+#define _GNU_SOURCE
+#include <sched.h>
+#endif
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+#include "rt_thread.h"
+
+void rt_thread_config_init(rt_thread_config_t *config)
+{
+    config->core = -1;
+    config->priority = 0;
+    config->prefault_stack = 0;
+}
+
+int rt_thread_setup(const rt_thread_config_t *config, const char *name)
+{
+    int result = name != NULL ? rt_thread_set_name(name) : 0;
+    if (config->core >= 0)
+    {
+        int r = rt_thread_pin(config->core);
+        result = result != 0 ? result : r;
+    }
+    if (config->priority > 0)
+    {
+        int r = rt_thread_set_priority(config->priority);
+        result = result != 0 ? result : r;
+    }
+    if (config->prefault_stack > 0)
+    {
+        rt_thread_prefault_stack(config->prefault_stack);
+    }
+    return result;
+}
+
+int rt_thread_set_name(const char *name)
+{
+#if defined(__linux__)
+    char truncated[16];
+    snprintf(truncated, sizeof(truncated), "%s", name);
+    return pthread_setname_np(pthread_self(), truncated);
+#else
+    (void)name;
+    return 0;
+#endif
+}
+
+int rt_thread_pin(int core)
+{
+#if defined(__linux__)
+    if (core < 0 || core >= CPU_SETSIZE)
+    {
+        return EINVAL;
+    }
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(core, &cpuset);
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset);
+#else
+    (void)core;
+    return ENOSYS;
+#endif
+}
+
+int rt_thread_set_priority(int priority)
+{
+    struct sched_param param;
+    memset(&param, 0, sizeof(param));
+    if (priority == 0)
+    {
+        return pthread_setschedparam(pthread_self(), SCHED_OTHER, &param);
+    }
+    if (priority < sched_get_priority_min(SCHED_FIFO) || priority > sched_get_priority_max(SCHED_FIFO))
+    {
+        return EINVAL;
+    }
+    param.sched_priority = priority;
+    return pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+}
+
+void rt_thread_prefault_stack(size_t bytes)
+{
+    if (bytes == 0)
+    {
+        return;
+    }
+    // A page at a time, the barrier making the compiler assume the array is read so the writes are kept
+    unsigned char stack[bytes];
+    for (size_t i = 0; i < bytes; i += 4096)
+    {
+        stack[i] = 0;
+    }
+    __asm__ volatile("" : : "r"(stack) : "memory");
+}
+
+int rt_lock_memory(void)
+{
+#if defined(__GLIBC__)
+    // Freed memory is kept for later allocations rather than unmapped, and none is mapped apart from the heap,
+    // which would have to be faulted in and locked anew
+    mallopt(M_TRIM_THRESHOLD, -1);
+    mallopt(M_MMAP_MAX, 0);
+#endif
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+    {
+        return errno;
+    }
+    return 0;
+}
@@ -0,0 +1,65 @@
+#ifndef RT_THREAD_H
+#define RT_THREAD_H
+
+#include <stddef.h>
+
+/*
+ * Stack faulted in by timing-critical threads when memory is locked, enough for the parsing and
+ * verification they do.
+ */
+#define RT_THREAD_PREFAULT_STACK (128 * 1024)
+
+/*
+ * How a timing-critical thread - one that timestamps what it reads or sends - is to run.
+ */
+typedef struct
+{
+    /* Core to pin the thread to, -1 to leave it to the scheduler */
+    int core;
+    /* SCHED_FIFO priority, 0 for the default policy */
+    int priority;
+    /* Bytes of stack to fault in up front, 0 for none */
+    size_t prefault_stack;
+} rt_thread_config_t;
+
+/*
+ * Leaves everything to the defaults.
+ */
+void rt_thread_config_init(rt_thread_config_t *config);
+
+/*
+ * Names the calling thread and applies the configuration to it. Every step is tried; the result is that of
+ * the first to fail, 0 if none did, or an error number. Priorities and locked memory usually need
+ * CAP_SYS_NICE and CAP_IPC_LOCK, the callers carry on at the defaults without them.
+ */
+int rt_thread_setup(const rt_thread_config_t *config, const char *name);
+
+/*
+ * Names the calling thread, as shown by top -H and gdb. Linux keeps 15 characters of it.
+ */
+int rt_thread_set_name(const char *name);
+
+/*
+ * Pins the calling thread to a core, so it is not migrated away from its caches.
+ */
+int rt_thread_pin(int core);
+
+/*
+ * Runs the calling thread under SCHED_FIFO at the priority given, ahead of every thread of the default
+ * policy. 0 puts it back to the default policy.
+ */
+int rt_thread_set_priority(int priority);
+
+/*
+ * Touches the bytes of stack below the caller, so they are mapped - and locked if memory is - before
+ * the thread needs them.
+ */
+void rt_thread_prefault_stack(size_t bytes);
+
+/*
+ * Locks all pages of the process into memory, those mapped now and those mapped later, and has malloc
+ * keep the memory it frees, so timing-critical threads are not held up by page faults.
+ */
+int rt_lock_memory(void);
+
+#endif /* RT_THREAD_H */
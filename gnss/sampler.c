@@ -0,0 +1,179 @@
+/*H**********************************************************************
+ * FILENAME :        sampler.c
+ *
+ * DESCRIPTION :
+ *       Scheduling of Roughtime queries, and interpolation of their
+ *       results onto the GNSS time line.
+ *
+ * PUBLIC FUNCTIONS :
+ *       void sampler_init(sampler_t *sampler, uint64_t interval_us, double drift_threshold_us)
+ *       void sampler_add_fix(sampler_t *sampler, uint64_t monotonic_us, double gnss_us)
+ *       bool sampler_due(const sampler_t *sampler, uint64_t now_us)
+ *       int sampler_wait_ms(const sampler_t *sampler, uint64_t now_us)
+ *       void sampler_query_started(sampler_t *sampler, uint64_t now_us)
+ *       bool sampler_add_sample(sampler_t *sampler, const sampler_sample_t *sample)
+ *       bool sampler_next_result(sampler_t *sampler, uint64_t now_us, bool flush, sampler_sample_t *sample)
+ *
+ * NOTES :
+ *       A query is answered somewhere between two fixes. Its GNSS time is interpolated between them once the
+ *       second one is in, so the comparison does not depend on how the query lines up with the navigation rate.
+ *
+ *H*/
+
+#include <math.h>
+#include <string.h>
+
+#include "sampler.h"
+
+static const sampler_fix_t *fix_at(const sampler_t *sampler, unsigned int i)
+{
+    return &sampler->fixes[(sampler->fix_head + i) % SAMPLER_FIX_HISTORY];
+}
+
+void sampler_init(sampler_t *sampler, uint64_t interval_us, double drift_threshold_us)
+{
+    memset(sampler, 0, sizeof(*sampler));
+    sampler->base_interval_us = interval_us;
+    sampler->min_interval_us = interval_us / SAMPLER_MIN_INTERVAL_DIVISOR;
+    sampler->interval_us = interval_us;
+    sampler->drift_threshold_us = drift_threshold_us;
+}
+
+void sampler_add_fix(sampler_t *sampler, uint64_t monotonic_us, double gnss_us)
+{
+    sampler_fix_t fix = {monotonic_us, gnss_us};
+    if (sampler->num_fixes < SAMPLER_FIX_HISTORY)
+    {
+        sampler->fixes[(sampler->fix_head + sampler->num_fixes++) % SAMPLER_FIX_HISTORY] = fix;
+    }
+    else
+    {
+        sampler->fixes[sampler->fix_head] = fix;
+        sampler->fix_head = (sampler->fix_head + 1) % SAMPLER_FIX_HISTORY;
+    }
+}
+
+bool sampler_due(const sampler_t *sampler, uint64_t now_us)
+{
+    return sampler->num_fixes > 0 && now_us >= sampler->next_due_us;
+}
+
+int sampler_wait_ms(const sampler_t *sampler, uint64_t now_us)
+{
+    if (now_us >= sampler->next_due_us)
+    {
+        return 0;
+    }
+    return (int)((sampler->next_due_us - now_us + 999) / 1000);
+}
+
+void sampler_query_started(sampler_t *sampler, uint64_t now_us)
+{
+    sampler->next_due_us = now_us + sampler->interval_us;
+}
+
+bool sampler_add_sample(sampler_t *sampler, const sampler_sample_t *sample)
+{
+    if (sampler->num_pending == SAMPLER_MAX_PENDING)
+    {
+        return false;
+    }
+    sampler->pending[sampler->num_pending++] = *sample;
+    return true;
+}
+
+/*
+ * GNSS time at a monotonic instant: linear between the fixes either side of it, otherwise from the nearest
+ * fix at one second per second. False without any fix, or when there is no later fix and wait_for_later is set.
+ */
+static bool gnss_time_at(const sampler_t *sampler, uint64_t monotonic_us, bool wait_for_later, double *gnss_us, bool *interpolated)
+{
+    const sampler_fix_t *before = NULL;
+    const sampler_fix_t *after = NULL;
+    for (unsigned int i = 0; i < sampler->num_fixes; i++)
+    {
+        const sampler_fix_t *fix = fix_at(sampler, i);
+        if (fix->monotonic_us <= monotonic_us)
+        {
+            before = fix;
+        }
+        else
+        {
+            after = fix;
+            break;
+        }
+    }
+
+    *interpolated = before != NULL && after != NULL;
+    if (*interpolated)
+    {
+        double fraction = (double)(monotonic_us - before->monotonic_us) / (double)(after->monotonic_us - before->monotonic_us);
+        *gnss_us = before->gnss_us + fraction * (after->gnss_us - before->gnss_us);
+        return true;
+    }
+    if (after != NULL)
+    {
+        *gnss_us = after->gnss_us - (double)(after->monotonic_us - monotonic_us);
+        return true;
+    }
+    if (before != NULL && !wait_for_later)
+    {
+        *gnss_us = before->gnss_us + (double)(monotonic_us - before->monotonic_us);
+        return true;
+    }
+    return false;
+}
+
+bool sampler_next_result(sampler_t *sampler, uint64_t now_us, bool flush, sampler_sample_t *sample)
+{
+    if (sampler->num_pending == 0)
+    {
+        return false;
+    }
+
+    sampler_sample_t *oldest = &sampler->pending[0];
+    bool wait_for_later = !flush && now_us - oldest->midpoint_us < SAMPLER_MAX_PENDING_US;
+    if (!gnss_time_at(sampler, oldest->midpoint_us, wait_for_later, &oldest->gnss_us, &oldest->interpolated))
+    {
+        if (wait_for_later)
+        {
+            return false;
+        }
+        // No fix at all: nothing to compare with, but the sample is still handed out
+        oldest->gnss_us = NAN;
+    }
+    oldest->offset_us = (double)oldest->roughtime_us - oldest->gnss_us;
+    *sample = *oldest;
+    memmove(&sampler->pending[0], &sampler->pending[1], --sampler->num_pending * sizeof(sampler_sample_t));
+
+    if (sampler->drift_threshold_us > 0 && !isnan(sample->offset_us))
+    {
+        if (sampler->have_offset && fabs(sample->offset_us - sampler->last_offset_us) > sampler->drift_threshold_us)
+        {
+            sampler->interval_us /= 2;
+            if (sampler->interval_us < sampler->min_interval_us)
+            {
+                sampler->interval_us = sampler->min_interval_us;
+            }
+        }
+        else if (sampler->interval_us < sampler->base_interval_us)
+        {
+            sampler->interval_us *= 2;
+            if (sampler->interval_us > sampler->base_interval_us)
+            {
+                sampler->interval_us = sampler->base_interval_us;
+            }
+        }
+        // A shorter interval takes effect straight away rather than after the query already scheduled
+        if (sampler->next_due_us > now_us + sampler->interval_us)
+        {
+            sampler->next_due_us = now_us + sampler->interval_us;
+        }
+    }
+    if (!isnan(sample->offset_us))
+    {
+        sampler->have_offset = true;
+        sampler->last_offset_us = sample->offset_us;
+    }
+    return true;
+}
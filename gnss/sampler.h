@@ -0,0 +1,114 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * GNSS fixes remembered for interpolation. Enough for a few seconds at a 10 Hz navigation rate.
+ */
+#define SAMPLER_FIX_HISTORY 64
+
+/*
+ * Roughtime samples waiting for the fix that follows them.
+ */
+#define SAMPLER_MAX_PENDING 8
+
+/*
+ * How long a sample waits for a later fix before its GNSS time is extrapolated instead.
+ */
+#define SAMPLER_MAX_PENDING_US 2000000
+
+/*
+ * Under adaptive sampling the interval shrinks to no less than this fraction of the configured one.
+ */
+#define SAMPLER_MIN_INTERVAL_DIVISOR 8
+
+/*
+ * A GNSS fix, and when it arrived on the monotonic clock.
+ */
+typedef struct
+{
+    uint64_t monotonic_us;
+    double gnss_us; /* UTC, microseconds from the epoch */
+} sampler_fix_t;
+
+/*
+ * A Roughtime sample, stamped with the GNSS time at the middle of its round trip.
+ */
+typedef struct
+{
+    uint64_t roughtime_us;  /* server midpoint */
+    uint32_t radius_us;
+    uint64_t midpoint_us;   /* monotonic clock */
+    uint64_t round_trip_us;
+    double gnss_us;         /* filled in by sampler_next_result */
+    double offset_us;       /* roughtime_us - gnss_us */
+    bool interpolated;      /* between two fixes, rather than extrapolated from one */
+} sampler_sample_t;
+
+/*
+ * Schedules Roughtime queries independently of the GNSS message rate, and relates their results to the
+ * GNSS time line.
+ *
+ * Queries are due every interval. With a drift threshold, the interval halves whenever the offset between
+ * Roughtime and GNSS moved by more than the threshold since the previous sample, and doubles back towards
+ * the configured interval while it does not.
+ */
+typedef struct
+{
+    uint64_t base_interval_us;
+    uint64_t min_interval_us;
+    uint64_t interval_us;
+    uint64_t next_due_us;
+    double drift_threshold_us; /* 0 for a fixed rate */
+
+    bool have_offset;
+    double last_offset_us;
+
+    /* Ring of the latest fixes, oldest first from fix_head */
+    sampler_fix_t fixes[SAMPLER_FIX_HISTORY];
+    unsigned int fix_head;
+    unsigned int num_fixes;
+
+    /* In the order the queries were made */
+    sampler_sample_t pending[SAMPLER_MAX_PENDING];
+    unsigned int num_pending;
+} sampler_t;
+
+void sampler_init(sampler_t *sampler, uint64_t interval_us, double drift_threshold_us);
+
+/*
+ * Records a fix. Fixes must be added in the order they arrived.
+ */
+void sampler_add_fix(sampler_t *sampler, uint64_t monotonic_us, double gnss_us);
+
+/*
+ * True if a query is due: at least one fix is known and the interval since the last query has passed.
+ */
+bool sampler_due(const sampler_t *sampler, uint64_t now_us);
+
+/*
+ * Milliseconds until the next query is due, rounded up; 0 if it is due already.
+ */
+int sampler_wait_ms(const sampler_t *sampler, uint64_t now_us);
+
+/*
+ * Marks a query as made at now_us, scheduling the next one.
+ */
+void sampler_query_started(sampler_t *sampler, uint64_t now_us);
+
+/*
+ * Queues the result of a query until a fix following its midpoint arrives. Returns false if too many are
+ * queued already.
+ */
+bool sampler_add_sample(sampler_t *sampler, const sampler_sample_t *sample);
+
+/*
+ * Takes the oldest queued sample once it can be stamped: when a later fix is known, or it has waited
+ * SAMPLER_MAX_PENDING_US, or flush is set. Its GNSS time, offset and the sampling interval are updated.
+ * Returns false if no sample is ready.
+ */
+bool sampler_next_result(sampler_t *sampler, uint64_t now_us, bool flush, sampler_sample_t *sample);
+
+#endif /* SAMPLER_H */
@@ -0,0 +1,88 @@
+/*H**********************************************************************
+ * FILENAME :        time_tag.c
+ *
+ * DESCRIPTION :
+ *       Tagging of PPS edges with the GNSS time the receiver put on them.
+ *
+ * PUBLIC FUNCTIONS :
+ *       void time_tagger_init(time_tagger_t *tagger)
+ *       void time_tagger_destroy(time_tagger_t *tagger)
+ *       void time_tagger_announce(time_tagger_t *tagger, uint64_t rx_monotonic_ns, uint64_t utc_ns, int32_t qerr_ps)
+ *       bool time_tagger_tag(time_tagger_t *tagger, uint64_t pulse_realtime_ns, uint64_t pulse_monotonic_ns, unsigned long sequence, time_tag_t *tag)
+ *       int64_t time_tag_utc_ns(const time_tag_t *tag, uint64_t monotonic_ns)
+ *
+ * NOTES :
+ *       The edge is timestamped by the kernel as the pulse comes in, the announcement travels over the
+ *       serial line with hundreds of milliseconds of jitter. Its arrival only tells which pulse it is
+ *       for: the first after it.
+ *
+ *H*/
+
+#include "time_tag.h"
+
+void time_tagger_init(time_tagger_t *tagger)
+{
+    pthread_mutex_init(&tagger->lock, NULL);
+    tagger->head = 0;
+    tagger->count = 0;
+}
+
+void time_tagger_destroy(time_tagger_t *tagger)
+{
+    pthread_mutex_destroy(&tagger->lock);
+}
+
+void time_tagger_announce(time_tagger_t *tagger, uint64_t rx_monotonic_ns, uint64_t utc_ns, int32_t qerr_ps)
+{
+    pthread_mutex_lock(&tagger->lock);
+    unsigned int slot = (tagger->head + tagger->count) % TIME_TAG_ANNOUNCEMENTS;
+    if (tagger->count == TIME_TAG_ANNOUNCEMENTS)
+    {
+        tagger->head = (tagger->head + 1) % TIME_TAG_ANNOUNCEMENTS;
+    }
+    else
+    {
+        tagger->count++;
+    }
+    tagger->announcements[slot].rx_monotonic_ns = rx_monotonic_ns;
+    tagger->announcements[slot].utc_ns = utc_ns;
+    tagger->announcements[slot].qerr_ps = qerr_ps;
+    pthread_mutex_unlock(&tagger->lock);
+}
+
+bool time_tagger_tag(time_tagger_t *tagger, uint64_t pulse_realtime_ns, uint64_t pulse_monotonic_ns,
+                     unsigned long sequence, time_tag_t *tag)
+{
+    bool found = false;
+
+    pthread_mutex_lock(&tagger->lock);
+    // Newest first: the one received last before the edge is the one for it
+    for (unsigned int i = tagger->count; i-- > 0;)
+    {
+        unsigned int slot = (tagger->head + i) % TIME_TAG_ANNOUNCEMENTS;
+        uint64_t rx_ns = tagger->announcements[slot].rx_monotonic_ns;
+        if (rx_ns > pulse_monotonic_ns)
+        {
+            continue;
+        }
+        if (pulse_monotonic_ns - rx_ns <= TIME_TAG_MAX_LEAD_NS)
+        {
+            tag->pulse_realtime_ns = pulse_realtime_ns;
+            tag->pulse_monotonic_ns = pulse_monotonic_ns;
+            tag->gnss_utc_ns = tagger->announcements[slot].utc_ns;
+            tag->qerr_ps = tagger->announcements[slot].qerr_ps;
+            tag->sequence = sequence;
+            found = true;
+        }
+        break;
+    }
+    pthread_mutex_unlock(&tagger->lock);
+    return found;
+}
+
+int64_t time_tag_utc_ns(const time_tag_t *tag, uint64_t monotonic_ns)
+{
+    // Rounded to the nanosecond, well under what the edge timestamp resolves
+    int64_t qerr_ns = (tag->qerr_ps >= 0 ? tag->qerr_ps + 500 : tag->qerr_ps - 500) / 1000;
+    return (int64_t)tag->gnss_utc_ns + ((int64_t)monotonic_ns - (int64_t)tag->pulse_monotonic_ns) + qerr_ns;
+}
@@ -0,0 +1,75 @@
+#ifndef TIME_TAG_H
+#define TIME_TAG_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Time pulse announcements remembered. The receiver describes each pulse shortly before it sends it.
+ */
+#define TIME_TAG_ANNOUNCEMENTS 8
+
+/*
+ * Longest an announcement is taken to come ahead of its pulse.
+ */
+#define TIME_TAG_MAX_LEAD_NS 1100000000ULL
+
+/*
+ * A time pulse, as captured and as the receiver described it: the reference a Roughtime sample is
+ * compared with.
+ */
+typedef struct
+{
+    /* Kernel timestamp of the edge, CLOCK_REALTIME */
+    uint64_t pulse_realtime_ns;
+    /* The same instant on the monotonic clock */
+    uint64_t pulse_monotonic_ns;
+    /* UTC the receiver meant the pulse for, nanoseconds from the epoch */
+    uint64_t gnss_utc_ns;
+    /* How late the receiver put out the pulse, its quantization error, in picoseconds */
+    int32_t qerr_ps;
+    unsigned long sequence;
+} time_tag_t;
+
+/*
+ * Pairs PPS edges with the UBX-TIM-TP announcements of the pulses. Announcements come from the thread
+ * decoding the receiver and edges are tagged by whichever thread compares, hence the lock.
+ */
+typedef struct
+{
+    pthread_mutex_t lock;
+    /* Ring of the latest announcements, oldest first from head */
+    struct
+    {
+        uint64_t rx_monotonic_ns;
+        uint64_t utc_ns;
+        int32_t qerr_ps;
+    } announcements[TIME_TAG_ANNOUNCEMENTS];
+    unsigned int head;
+    unsigned int count;
+} time_tagger_t;
+
+void time_tagger_init(time_tagger_t *tagger);
+
+void time_tagger_destroy(time_tagger_t *tagger);
+
+/*
+ * Records the announcement of the next pulse, received at rx_monotonic_ns.
+ */
+void time_tagger_announce(time_tagger_t *tagger, uint64_t rx_monotonic_ns, uint64_t utc_ns, int32_t qerr_ps);
+
+/*
+ * Tags an edge with the announcement received last before it, no more than TIME_TAG_MAX_LEAD_NS ahead.
+ * Returns false if there is none: the receiver was not announcing pulses, or not on a UTC time base.
+ */
+bool time_tagger_tag(time_tagger_t *tagger, uint64_t pulse_realtime_ns, uint64_t pulse_monotonic_ns,
+                     unsigned long sequence, time_tag_t *tag);
+
+/*
+ * GNSS UTC at an instant of the monotonic clock, in nanoseconds from the epoch. It is counted from the
+ * pulse, set back by its quantization error to the true top of the second.
+ */
+int64_t time_tag_utc_ns(const time_tag_t *tag, uint64_t monotonic_ns);
+
+#endif /* TIME_TAG_H */
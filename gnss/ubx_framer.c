@@ -0,0 +1,167 @@
+/*H**********************************************************************
+ * FILENAME :        ubx_framer.c
+ *
+ * DESCRIPTION :
+ *       Reassembly of UBX frames from the serial byte stream.
+ *
+ * PUBLIC FUNCTIONS :
+ *       void ubx_framer_init(ubx_framer_t *framer)
+ *       ssize_t ubx_framer_fill(ubx_framer_t *framer, int fd)
+ *       size_t ubx_framer_push(ubx_framer_t *framer, const unsigned char *data, size_t len)
+ *       bool ubx_framer_next(ubx_framer_t *framer, unsigned char **frame, size_t *len)
+ *
+ * NOTES :
+ *       A read may end anywhere - in the middle of a frame, or after several frames - so
+ *       frames are found in the buffered stream rather than assumed to start each read.
+ *
+ *H*/
+
+#include <string.h>
+#include <unistd.h>
+
+#include "ubx_framer.h"
+
+#define UBX_SYNC_1 0xb5
+#define UBX_SYNC_2 0x62
+#define RING_MASK (UBX_FRAMER_RING_SIZE - 1)
+
+_Static_assert((UBX_FRAMER_RING_SIZE & RING_MASK) == 0, "UBX_FRAMER_RING_SIZE must be a power of two");
+_Static_assert(UBX_FRAMER_MAX_FRAME <= UBX_FRAMER_RING_SIZE, "frames must fit the ring");
+
+static unsigned char byte_at(const ubx_framer_t *framer, size_t offset)
+{
+    return framer->ring[(framer->tail + offset) & RING_MASK];
+}
+
+void ubx_framer_init(ubx_framer_t *framer)
+{
+    framer->head = 0;
+    framer->tail = 0;
+    framer->held = 0;
+    framer->frames = 0;
+    framer->bad_checksums = 0;
+    framer->skipped_bytes = 0;
+}
+
+ssize_t ubx_framer_fill(ubx_framer_t *framer, int fd)
+{
+    size_t space = UBX_FRAMER_RING_SIZE - (framer->head - framer->tail);
+    size_t start = framer->head & RING_MASK;
+    if (space == 0)
+    {
+        return 0;
+    }
+    // Up to the end of the ring; the rest of the free space is filled by the next read
+    if (start + space > UBX_FRAMER_RING_SIZE)
+    {
+        space = UBX_FRAMER_RING_SIZE - start;
+    }
+
+    ssize_t n = read(fd, &framer->ring[start], space);
+    if (n > 0)
+    {
+        framer->head += (size_t)n;
+    }
+    return n;
+}
+
+size_t ubx_framer_push(ubx_framer_t *framer, const unsigned char *data, size_t len)
+{
+    size_t space = UBX_FRAMER_RING_SIZE - (framer->head - framer->tail);
+    if (len > space)
+    {
+        len = space;
+    }
+    for (size_t copied = 0; copied < len;)
+    {
+        size_t start = framer->head & RING_MASK;
+        size_t chunk = UBX_FRAMER_RING_SIZE - start;
+        if (chunk > len - copied)
+        {
+            chunk = len - copied;
+        }
+        memcpy(&framer->ring[start], data + copied, chunk);
+        framer->head += chunk;
+        copied += chunk;
+    }
+    return len;
+}
+
+bool ubx_framer_next(ubx_framer_t *framer, unsigned char **frame, size_t *len)
+{
+    framer->tail += framer->held;
+    framer->held = 0;
+
+    for (;;)
+    {
+        size_t avail = framer->head - framer->tail;
+
+        // Skip to the next sync word, keeping a lone first sync byte at the end for the next read
+        while (avail > 0 && byte_at(framer, 0) != UBX_SYNC_1)
+        {
+            framer->tail++;
+            framer->skipped_bytes++;
+            avail--;
+        }
+        if (avail < 2)
+        {
+            return false;
+        }
+        if (byte_at(framer, 1) != UBX_SYNC_2)
+        {
+            framer->tail++;
+            framer->skipped_bytes++;
+            continue;
+        }
+        if (avail < UBX_FRAME_OVERHEAD)
+        {
+            return false;
+        }
+
+        size_t frame_len = (byte_at(framer, 4) | (size_t)byte_at(framer, 5) << 8) + UBX_FRAME_OVERHEAD;
+        if (frame_len > UBX_FRAMER_MAX_FRAME)
+        {
+            framer->tail++;
+            framer->skipped_bytes++;
+            continue;
+        }
+        if (avail < frame_len)
+        {
+            return false;
+        }
+
+        // 8-bit Fletcher over class, id, length and payload
+        unsigned char ck_a = 0;
+        unsigned char ck_b = 0;
+        for (size_t i = 2; i < frame_len - 2; i++)
+        {
+            ck_a += byte_at(framer, i);
+            ck_b += ck_a;
+        }
+        if (ck_a != byte_at(framer, frame_len - 2) || ck_b != byte_at(framer, frame_len - 1))
+        {
+            // Resynchronise from the byte after this sync word, the real frame may start inside the bad one
+            framer->bad_checksums++;
+            framer->tail++;
+            framer->skipped_bytes++;
+            continue;
+        }
+
+        size_t start = framer->tail & RING_MASK;
+        if (start + frame_len <= UBX_FRAMER_RING_SIZE)
+        {
+            *frame = &framer->ring[start];
+        }
+        else
+        {
+            size_t first = UBX_FRAMER_RING_SIZE - start;
+            memcpy(framer->scratch, &framer->ring[start], first);
+            memcpy(framer->scratch + first, framer->ring, frame_len - first);
+            *frame = framer->scratch;
+        }
+        *len = frame_len;
+        framer->held = frame_len;
+        framer->frames++;
+        return true;
+    }
+}
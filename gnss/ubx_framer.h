@@ -0,0 +1,66 @@
+#ifndef UBX_FRAMER_H
+#define UBX_FRAMER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+/*
+ * Bytes buffered between reads from the receiver and the parser. Power of two.
+ */
+#define UBX_FRAMER_RING_SIZE 65536
+
+/*
+ * Largest frame accepted: sync, class, id, length, payload and checksum. A length field
+ * beyond this is taken for a false sync in the middle of some other frame.
+ */
+#define UBX_FRAMER_MAX_FRAME 16384
+
+/*
+ * UBX framing overhead: 2 sync, class, id, 2 length bytes and 2 checksum bytes
+ */
+#define UBX_FRAME_OVERHEAD 8
+
+/*
+ * Reassembles UBX frames from a byte stream read in arbitrary pieces.
+ *
+ * Bytes are read straight into a ring buffer. Frames are found by their sync word and checked
+ * against their Fletcher checksum; a frame is then handed out as a view into the ring, or,
+ * in the rare case that it wraps around the end of the ring, into a scratch copy.
+ */
+typedef struct
+{
+    unsigned char ring[UBX_FRAMER_RING_SIZE];
+    /* Stream positions of the next byte to be written and the next to be framed, wrapped on access only */
+    size_t head;
+    size_t tail;
+    /* Length of the frame last handed out, consumed by the next call to ubx_framer_next */
+    size_t held;
+    unsigned char scratch[UBX_FRAMER_MAX_FRAME];
+
+    unsigned long frames;
+    unsigned long bad_checksums;
+    unsigned long skipped_bytes;
+} ubx_framer_t;
+
+void ubx_framer_init(ubx_framer_t *framer);
+
+/*
+ * Reads whatever is available from fd (one read call) into the free space of the ring.
+ * Returns the result of read, or 0 if the ring is full.
+ */
+ssize_t ubx_framer_fill(ubx_framer_t *framer, int fd);
+
+/*
+ * Appends bytes from memory, such as a capture. Returns how many fitted.
+ */
+size_t ubx_framer_push(ubx_framer_t *framer, const unsigned char *data, size_t len);
+
+/*
+ * Finds the next complete frame with a valid checksum. The view, sync word to checksum
+ * included as ubx_parse expects, stays valid until the next call to ubx_framer_next - fill
+ * and push never overwrite it. Returns false if no complete frame is buffered yet.
+ */
+bool ubx_framer_next(ubx_framer_t *framer, unsigned char **frame, size_t *len);
+
+#endif /* UBX_FRAMER_H */
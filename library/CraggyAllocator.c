@@ -0,0 +1,208 @@
+/* Copyright 2020 Johan Lindquist
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+
+#include "CraggyAllocator.h"
+#include "CraggyOS.h"
+
+// Blocks and arena allocations are aligned for any type, as the C library's are
+#define CRAGGY_ALLOCATION_ALIGNMENT alignof(max_align_t)
+
+static void *craggy_libcMalloc(void *context, size_t size) {
+    (void) context;
+    return malloc(size);
+}
+
+static void *craggy_libcCalloc(void *context, size_t count, size_t size) {
+    (void) context;
+    return calloc(count, size);
+}
+
+static void craggy_libcFree(void *context, void *ptr) {
+    (void) context;
+    free(ptr);
+}
+
+static const CraggyAllocator libcAllocator = {craggy_libcMalloc, craggy_libcCalloc, craggy_libcFree, NULL};
+
+static _Atomic(const CraggyAllocator *) processAllocator = &libcAllocator;
+static _Thread_local const CraggyAllocator *threadAllocator;
+
+void craggy_setAllocator(const CraggyAllocator *allocator) {
+    atomic_store(&processAllocator, allocator != NULL ? allocator : &libcAllocator);
+}
+
+const CraggyAllocator *craggy_setThreadAllocator(const CraggyAllocator *allocator) {
+    const CraggyAllocator *previous = threadAllocator;
+    threadAllocator = allocator;
+    return previous;
+}
+
+const CraggyAllocator *craggy_getAllocator(void) {
+    return threadAllocator != NULL ? threadAllocator : atomic_load_explicit(&processAllocator, memory_order_acquire);
+}
+
+void *craggy_malloc(size_t size) {
+    const CraggyAllocator *allocator = craggy_getAllocator();
+    return allocator->malloc(allocator->context, size);
+}
+
+void *craggy_calloc(size_t count, size_t size) {
+    const CraggyAllocator *allocator = craggy_getAllocator();
+    return allocator->calloc(allocator->context, count, size);
+}
+
+void craggy_free(void *ptr) {
+    if (ptr != NULL) {
+        const CraggyAllocator *allocator = craggy_getAllocator();
+        allocator->free(allocator->context, ptr);
+    }
+}
+
+static size_t craggy_alignUp(size_t value) {
+    return (value + CRAGGY_ALLOCATION_ALIGNMENT - 1) & ~(size_t) (CRAGGY_ALLOCATION_ALIGNMENT - 1);
+}
+
+static bool craggy_isWithin(const uint8_t *storage, size_t storageLen, const void *ptr) {
+    return (uintptr_t) ptr >= (uintptr_t) storage && (uintptr_t) ptr < (uintptr_t) storage + storageLen;
+}
+
+bool craggy_initPool(CraggyPool *pool, void *storage, size_t storageLen, size_t blockSize) {
+
+    const size_t misalignment = craggy_alignUp((uintptr_t) storage) - (uintptr_t) storage;
+    // Free blocks hold the pointer to the next free block
+    blockSize = craggy_alignUp(blockSize < sizeof(void *) ? sizeof(void *) : blockSize);
+
+    craggy_memset(pool, 0, sizeof(CraggyPool));
+    if (storage == NULL || blockSize == 0 || storageLen < misalignment + blockSize) {
+        return false;
+    }
+
+    pool->storage = (uint8_t *) storage + misalignment;
+    pool->blockSize = blockSize;
+    pool->numFree = (storageLen - misalignment) / blockSize;
+    pool->storageLen = pool->numFree * blockSize;
+
+    // Thread the free list through the blocks in address order
+    for (size_t i = pool->numFree; i > 0; i--) {
+        void *block = pool->storage + (i - 1) * blockSize;
+        craggy_memcpy(block, &pool->freeList, sizeof(void *));
+        pool->freeList = block;
+    }
+    return true;
+}
+
+size_t craggy_getPoolFreeBlocks(const CraggyPool *pool) {
+    return pool->numFree;
+}
+
+static void *craggy_poolMalloc(void *context, size_t size) {
+    CraggyPool *pool = context;
+    void *block = pool->freeList;
+    if (size > pool->blockSize || block == NULL) {
+        return NULL;
+    }
+    craggy_memcpy(&pool->freeList, block, sizeof(void *));
+    pool->numFree--;
+    return block;
+}
+
+static void *craggy_poolCalloc(void *context, size_t count, size_t size) {
+    CraggyPool *pool = context;
+    if (size != 0 && count > pool->blockSize / size) {
+        return NULL;
+    }
+    void *block = craggy_poolMalloc(context, count * size);
+    if (block != NULL) {
+        craggy_memset(block, 0, count * size);
+    }
+    return block;
+}
+
+static void craggy_poolFree(void *context, void *ptr) {
+    CraggyPool *pool = context;
+    if (!craggy_isWithin(pool->storage, pool->storageLen, ptr)) {
+        free(ptr);
+        return;
+    }
+    craggy_memcpy(ptr, &pool->freeList, sizeof(void *));
+    pool->freeList = ptr;
+    pool->numFree++;
+}
+
+void craggy_getPoolAllocator(CraggyPool *pool, CraggyAllocator *allocator) {
+    allocator->malloc = craggy_poolMalloc;
+    allocator->calloc = craggy_poolCalloc;
+    allocator->free = craggy_poolFree;
+    allocator->context = pool;
+}
+
+void craggy_initArena(CraggyArena *arena, void *storage, size_t storageLen) {
+    arena->storage = storage;
+    arena->storageLen = storage != NULL ? storageLen : 0;
+    arena->used = 0;
+    arena->highWater = 0;
+}
+
+void craggy_resetArena(CraggyArena *arena) {
+    arena->used = 0;
+}
+
+size_t craggy_getArenaHighWater(const CraggyArena *arena) {
+    return arena->highWater;
+}
+
+static void *craggy_arenaMalloc(void *context, size_t size) {
+    CraggyArena *arena = context;
+    // Aligning the address, rather than the offset, copes with storage that is not aligned itself
+    const size_t start = craggy_alignUp((uintptr_t) arena->storage + arena->used) - (uintptr_t) arena->storage;
+    if (start > arena->storageLen || size > arena->storageLen - start) {
+        return NULL;
+    }
+    arena->used = start + size;
+    if (arena->used > arena->highWater) {
+        arena->highWater = arena->used;
+    }
+    return arena->storage + start;
+}
+
+static void *craggy_arenaCalloc(void *context, size_t count, size_t size) {
+    if (size != 0 && count > SIZE_MAX / size) {
+        return NULL;
+    }
+    // The storage is reused after every reset, so has to be cleared here
+    void *ptr = craggy_arenaMalloc(context, count * size);
+    if (ptr != NULL) {
+        craggy_memset(ptr, 0, count * size);
+    }
+    return ptr;
+}
+
+static void craggy_arenaFree(void *context, void *ptr) {
+    CraggyArena *arena = context;
+    if (!craggy_isWithin(arena->storage, arena->storageLen, ptr)) {
+        free(ptr);
+    }
+}
+
+void craggy_getArenaAllocator(CraggyArena *arena, CraggyAllocator *allocator) {
+    allocator->malloc = craggy_arenaMalloc;
+    allocator->calloc = craggy_arenaCalloc;
+    allocator->free = craggy_arenaFree;
+    allocator->context = arena;
+}
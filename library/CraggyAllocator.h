@@ -0,0 +1,150 @@
+/* Copyright 2020 Johan Lindquist
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CRAGGY_CRAGGYALLOCATOR_H
+#define CRAGGY_CRAGGYALLOCATOR_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "CraggyProtocol.h"
+
+/** Size of the blocks of a pool holding parsed messages and message builders, see {@link craggy_initPool}. */
+#define CRAGGY_POOL_MESSAGE_BLOCK_SIZE (sizeof(CraggyRoughtimeMessage) > sizeof(CraggyRoughtimeMessageBuilder) ? \
+                                        sizeof(CraggyRoughtimeMessage) : sizeof(CraggyRoughtimeMessageBuilder))
+
+/** Memory allocator used by the library for all of its own allocations.  Allocations made inside the crypto backend
+ * (OpenSSL) are not covered.
+ */
+typedef struct {
+    void *(*malloc)(void *context, size_t size);
+    void *(*calloc)(void *context, size_t count, size_t size);
+    void (*free)(void *context, void *ptr);
+    /** Passed to every function of the allocator */
+    void *context;
+} CraggyAllocator;
+
+/** Sets the allocator of the process, used by threads without an allocator of their own.  Meant to be called once,
+ * before anything else in the library.
+ *
+ * @param allocator Allocator to use, which must outlive its use, or NULL to go back to the C library
+ */
+void craggy_setAllocator(const CraggyAllocator *allocator);
+
+/** Sets the allocator of the calling thread, taking precedence over that of the process.  Objects must be released by
+ * the allocator they came from: a thread switching allocators must do so between, not during, uses of an object.
+ *
+ * Objects holding on to memory across calls, like {@link CraggyDelegationCache}, keep using the allocator current
+ * when they were created.
+ *
+ * @param allocator Allocator to use, which must outlive its use, or NULL to go back to the allocator of the process
+ * @return Allocator of the thread replaced, for restoring it later
+ */
+const CraggyAllocator *craggy_setThreadAllocator(const CraggyAllocator *allocator);
+
+/**
+ *
+ * @return Allocator of the calling thread
+ */
+const CraggyAllocator *craggy_getAllocator(void);
+
+/** Fixed size blocks carved out of storage provided by the caller.  Allocating and releasing a block takes constant
+ * time and never touches the heap.  Not thread safe - meant to be the allocator of one thread.  Fixed size, so it can
+ * live on the stack; the fields are not meant to be accessed directly.
+ */
+typedef struct {
+    uint8_t *storage;
+    size_t storageLen;
+    size_t blockSize;
+    void *freeList;
+    size_t numFree;
+} CraggyPool;
+
+/** Initialises a pool over the storage specified.
+ *
+ * @param pool Pool to initialise
+ * @param storage Storage to carve the blocks out of, which must outlive the pool
+ * @param storageLen Size of the storage
+ * @param blockSize Size of every block, for example {@link CRAGGY_POOL_MESSAGE_BLOCK_SIZE}
+ * @return True if the storage holds at least one block, otherwise false
+ */
+bool craggy_initPool(CraggyPool *pool, void *storage, size_t storageLen, size_t blockSize);
+
+/**
+ *
+ * @param pool
+ * @return Number of blocks not allocated
+ */
+size_t craggy_getPoolFreeBlocks(const CraggyPool *pool);
+
+/** Sets up an allocator handing out blocks of the pool.  Requests larger than a block fail; pointers not from the
+ * pool are passed on to the C library when released.
+ *
+ * @param pool Pool to allocate from
+ * @param allocator Allocator set up
+ */
+void craggy_getPoolAllocator(CraggyPool *pool, CraggyAllocator *allocator);
+
+/** Bump allocator over storage provided by the caller: allocating only moves a pointer, releasing does nothing and
+ * {@link craggy_resetArena} releases everything at once, for example after each response processed.  Not thread safe
+ * - meant to be the allocator of one thread.  Fixed size, so it can live on the stack; the fields are not meant to be
+ * accessed directly.
+ */
+typedef struct {
+    uint8_t *storage;
+    size_t storageLen;
+    size_t used;
+    size_t highWater;
+} CraggyArena;
+
+/** Initialises an arena over the storage specified.
+ *
+ * @param arena Arena to initialise
+ * @param storage Storage to allocate from, which must outlive the arena
+ * @param storageLen Size of the storage
+ */
+void craggy_initArena(CraggyArena *arena, void *storage, size_t storageLen);
+
+/** Releases everything allocated from the arena.
+ *
+ * @param arena
+ */
+void craggy_resetArena(CraggyArena *arena);
+
+/**
+ *
+ * @param arena
+ * @return Largest number of bytes ever in use at once, for sizing the storage of the arena
+ */
+size_t craggy_getArenaHighWater(const CraggyArena *arena);
+
+/** Sets up an allocator handing out memory of the arena.  Requests it has no room left for fail; pointers not from
+ * the arena are passed on to the C library when released.
+ *
+ * @param arena Arena to allocate from
+ * @param allocator Allocator set up
+ */
+void craggy_getArenaAllocator(CraggyArena *arena, CraggyAllocator *allocator);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //CRAGGY_CRAGGYALLOCATOR_H
@@ -0,0 +1,661 @@
+/* Copyright 2020 Johan Lindquist
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "CraggyAuditLog.h"
+
+#include "CraggyClient.h"
+#include "CraggyClock.h"
+#include "CraggyCrypto.h"
+#include "CraggyOS.h"
+
+#define ERROR_OCCURRED(x) *result = x; goto error;
+
+#define CRAGGY_AUDIT_RECORD_MAGIC "CRAR"
+#define CRAGGY_AUDIT_INDEX_MAGIC "CRAI"
+
+/** Changed whenever the index entries do */
+#define CRAGGY_AUDIT_INDEX_VERSION 1
+
+/** Index entries the index file grows by at a time */
+#define CRAGGY_AUDIT_INDEX_GROWTH 4096
+
+/* A record in a segment: the header below, in little-endian byte order, followed by the response. */
+#define CRAGGY_AUDIT_OFFSET_MAGIC 0
+#define CRAGGY_AUDIT_OFFSET_RESPONSE_LEN 4
+#define CRAGGY_AUDIT_OFFSET_RECEIVED_AT 8
+#define CRAGGY_AUDIT_OFFSET_PREVIOUS 16
+#define CRAGGY_AUDIT_OFFSET_ROOT_PUBLIC_KEY 24
+#define CRAGGY_AUDIT_OFFSET_NONCE (CRAGGY_AUDIT_OFFSET_ROOT_PUBLIC_KEY + CRAGGY_ROUGH_TIME_PUBLIC_KEY_LENGTH)
+#define CRAGGY_AUDIT_OFFSET_BLIND (CRAGGY_AUDIT_OFFSET_NONCE + CRAGGY_ROUGH_TIME_NONCE_LENGTH)
+#define CRAGGY_AUDIT_HEADER_LEN (CRAGGY_AUDIT_OFFSET_BLIND + CRAGGY_ROUGH_TIME_NONCE_LENGTH)
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    // Size of an entry, telling layouts of other machines apart
+    uint32_t entryLength;
+    uint32_t reserved;
+    uint64_t numEntries;
+} CraggyAuditIndexHeader;
+
+typedef struct {
+    // Time the record is found by, never going back from one entry to the next
+    craggy_rough_time_t time;
+    uint64_t offset;
+    uint32_t segment;
+    // Length of the record, header included
+    uint32_t length;
+} CraggyAuditIndexEntry;
+
+struct CraggyAuditLog {
+    char *directory;
+    // Index, mapped to hold capacity entries
+    int indexFd;
+    CraggyAuditIndexHeader *index;
+    size_t capacity;
+    // Segment appended to, -1 until the first record is
+    int segmentFd;
+    uint32_t segment;
+    uint64_t segmentSize;
+    // SHA-512 of the last response, nonces are derived from
+    uint8_t lastHash[CRAGGY_ROUGH_TIME_HASH_LENGTH];
+    // Records appended since the last flush, and when the first of them was, from the monotonic clock in microseconds
+    size_t unsynced;
+    uint64_t unsyncedSince;
+};
+
+static void craggy_auditStore32(uint8_t *out, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        out[i] = (uint8_t) (value >> (8 * i));
+    }
+}
+
+static void craggy_auditStore64(uint8_t *out, uint64_t value) {
+    for (int i = 0; i < 8; i++) {
+        out[i] = (uint8_t) (value >> (8 * i));
+    }
+}
+
+static uint32_t craggy_auditLoad32(const uint8_t *in) {
+    uint32_t value = 0;
+    for (int i = 3; i >= 0; i--) {
+        value = (value << 8) | in[i];
+    }
+    return value;
+}
+
+static uint64_t craggy_auditLoad64(const uint8_t *in) {
+    uint64_t value = 0;
+    for (int i = 7; i >= 0; i--) {
+        value = (value << 8) | in[i];
+    }
+    return value;
+}
+
+static CraggyAuditIndexEntry *craggy_auditEntries(const CraggyAuditLog *log) {
+    return (CraggyAuditIndexEntry *) (log->index + 1);
+}
+
+static size_t craggy_auditIndexLen(size_t capacity) {
+    return sizeof(CraggyAuditIndexHeader) + capacity * sizeof(CraggyAuditIndexEntry);
+}
+
+static void craggy_auditPath(const CraggyAuditLog *log, const char *name, char *path, size_t pathLen) {
+    snprintf(path, pathLen, "%s/%s", log->directory, name);
+}
+
+static void craggy_auditSegmentPath(const CraggyAuditLog *log, uint32_t segment, char *path, size_t pathLen) {
+    snprintf(path, pathLen, "%s/%08u.log", log->directory, segment);
+}
+
+/* Flushes the directory, for a segment created in it to survive a crash. */
+static void craggy_auditSyncDirectory(const CraggyAuditLog *log) {
+    int fd = open(log->directory, O_RDONLY);
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+}
+
+/* Maps the index to hold at least capacity entries, growing the file if need be. */
+static bool craggy_auditMapIndex(CraggyAuditLog *log, size_t capacity) {
+    if (log->index != NULL) {
+        munmap(log->index, craggy_auditIndexLen(log->capacity));
+        log->index = NULL;
+    }
+    struct stat st;
+    if (fstat(log->indexFd, &st) != 0) {
+        return false;
+    }
+    if ((size_t) st.st_size < craggy_auditIndexLen(capacity) && ftruncate(log->indexFd, (off_t) craggy_auditIndexLen(capacity)) != 0) {
+        return false;
+    }
+    void *mapping = mmap(NULL, craggy_auditIndexLen(capacity), PROT_READ | PROT_WRITE, MAP_SHARED, log->indexFd, 0);
+    if (mapping == MAP_FAILED) {
+        return false;
+    }
+    log->index = mapping;
+    log->capacity = capacity;
+    return true;
+}
+
+static bool craggy_auditAddEntry(CraggyAuditLog *log, craggy_rough_time_t time, uint32_t segment, uint64_t offset, uint32_t length) {
+    const uint64_t numEntries = log->index->numEntries;
+    if (numEntries == log->capacity && !craggy_auditMapIndex(log, log->capacity + CRAGGY_AUDIT_INDEX_GROWTH)) {
+        return false;
+    }
+    CraggyAuditIndexEntry *entries = craggy_auditEntries(log);
+    if (numEntries > 0 && entries[numEntries - 1].time > time) {
+        time = entries[numEntries - 1].time;
+    }
+    entries[numEntries].time = time;
+    entries[numEntries].segment = segment;
+    entries[numEntries].offset = offset;
+    entries[numEntries].length = length;
+    // Counted only once the entry is complete
+    log->index->numEntries = numEntries + 1;
+    return true;
+}
+
+/* Indexes the records of a segment from an offset on, cutting off a record torn by a crash.  Returns the size of the
+ * segment, 0 if it does not exist. */
+static bool craggy_auditScanSegment(CraggyAuditLog *log, uint32_t segment, uint64_t offset, uint64_t *size) {
+
+    char path[PATH_MAX];
+    craggy_auditSegmentPath(log, segment, path, sizeof(path));
+    *size = 0;
+    int fd = open(path, O_RDWR);
+    if (fd < 0) {
+        return errno == ENOENT;
+    }
+
+    bool success = false;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        goto exit;
+    }
+
+    uint8_t header[CRAGGY_AUDIT_HEADER_LEN];
+    while (offset + CRAGGY_AUDIT_HEADER_LEN <= (uint64_t) st.st_size) {
+        if (pread(fd, header, sizeof(header), (off_t) offset) != (ssize_t) sizeof(header) ||
+            craggy_memcmp(header + CRAGGY_AUDIT_OFFSET_MAGIC, CRAGGY_AUDIT_RECORD_MAGIC, 4) != 0) {
+            break;
+        }
+        const uint32_t responseLen = craggy_auditLoad32(header + CRAGGY_AUDIT_OFFSET_RESPONSE_LEN);
+        const uint32_t length = CRAGGY_AUDIT_HEADER_LEN + responseLen;
+        if (responseLen > CRAGGY_AUDIT_MAX_RESPONSE_SIZE || offset + length > (uint64_t) st.st_size) {
+            break;
+        }
+        if (!craggy_auditAddEntry(log, craggy_auditLoad64(header + CRAGGY_AUDIT_OFFSET_RECEIVED_AT), segment, offset, length)) {
+            goto exit;
+        }
+        offset += length;
+    }
+    if (offset < (uint64_t) st.st_size && ftruncate(fd, (off_t) offset) != 0) {
+        goto exit;
+    }
+    *size = offset;
+    success = true;
+
+exit:
+    close(fd);
+    return success;
+}
+
+static bool craggy_auditSegmentExists(const CraggyAuditLog *log, uint32_t segment) {
+    char path[PATH_MAX];
+    craggy_auditSegmentPath(log, segment, path, sizeof(path));
+    return access(path, F_OK) == 0;
+}
+
+/* Brings the index in line with the segments: entries of records lost in a crash are dropped, records written but not
+ * indexed before it are indexed. */
+static bool craggy_auditRecover(CraggyAuditLog *log) {
+
+    CraggyAuditIndexEntry *entries = craggy_auditEntries(log);
+    while (log->index->numEntries > 0) {
+        const CraggyAuditIndexEntry *last = &entries[log->index->numEntries - 1];
+        char path[PATH_MAX];
+        craggy_auditSegmentPath(log, last->segment, path, sizeof(path));
+        struct stat st;
+        if (stat(path, &st) == 0 && last->offset + last->length <= (uint64_t) st.st_size) {
+            break;
+        }
+        log->index->numEntries--;
+    }
+
+    uint32_t segment = 0;
+    uint64_t offset = 0;
+    if (log->index->numEntries > 0) {
+        const CraggyAuditIndexEntry *last = &entries[log->index->numEntries - 1];
+        segment = last->segment;
+        offset = last->offset + last->length;
+    }
+
+    // The segment of the last entry, and any written after it
+    log->segment = segment;
+    log->segmentSize = 0;
+    for (;; segment++, offset = 0) {
+        if (segment != log->segment && !craggy_auditSegmentExists(log, segment)) {
+            break;
+        }
+        uint64_t size;
+        if (!craggy_auditScanSegment(log, segment, offset, &size)) {
+            return false;
+        }
+        log->segment = segment;
+        log->segmentSize = size;
+    }
+    return true;
+}
+
+static bool craggy_auditOpenSegment(CraggyAuditLog *log, CraggyResult *result) {
+    char path[PATH_MAX];
+    craggy_auditSegmentPath(log, log->segment, path, sizeof(path));
+    log->segmentFd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0600);
+    if (log->segmentFd < 0) {
+        *result = CraggyResultGeneralError;
+        return false;
+    }
+    if (log->segmentSize == 0) {
+        craggy_auditSyncDirectory(log);
+    }
+    return true;
+}
+
+/* Reads the header of a record and, if response is not NULL, its response. */
+static bool craggy_auditReadRecord(const CraggyAuditLog *log, const CraggyAuditIndexEntry *entry, uint8_t header[CRAGGY_AUDIT_HEADER_LEN], uint8_t *response, CraggyResult *result) {
+
+    *result = CraggyResultGeneralError;
+
+    char path[PATH_MAX];
+    craggy_auditSegmentPath(log, entry->segment, path, sizeof(path));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        ERROR_OCCURRED(CraggyResultGeneralError);
+    }
+    if (entry->length < CRAGGY_AUDIT_HEADER_LEN || pread(fd, header, CRAGGY_AUDIT_HEADER_LEN, (off_t) entry->offset) != CRAGGY_AUDIT_HEADER_LEN) {
+        ERROR_OCCURRED(CraggyResultParseError);
+    }
+    const uint32_t responseLen = craggy_auditLoad32(header + CRAGGY_AUDIT_OFFSET_RESPONSE_LEN);
+    if (craggy_memcmp(header + CRAGGY_AUDIT_OFFSET_MAGIC, CRAGGY_AUDIT_RECORD_MAGIC, 4) != 0 ||
+        responseLen > CRAGGY_AUDIT_MAX_RESPONSE_SIZE || CRAGGY_AUDIT_HEADER_LEN + responseLen != entry->length) {
+        ERROR_OCCURRED(CraggyResultParseError);
+    }
+    if (response != NULL && pread(fd, response, responseLen, (off_t) (entry->offset + CRAGGY_AUDIT_HEADER_LEN)) != (ssize_t) responseLen) {
+        ERROR_OCCURRED(CraggyResultParseError);
+    }
+
+    *result = CraggyResultSuccess;
+
+error:
+    if (fd >= 0) {
+        close(fd);
+    }
+    return *result == CraggyResultSuccess;
+}
+
+bool craggy_auditLogOpen(const char *directory, CraggyAuditLog **log, CraggyResult *result) {
+
+    *result = CraggyResultGeneralError;
+
+    *log = craggy_calloc(1, sizeof(CraggyAuditLog));
+    if (*log == NULL) {
+        ERROR_OCCURRED(CraggyResultInternalError);
+    }
+    (*log)->indexFd = -1;
+    (*log)->segmentFd = -1;
+    (*log)->directory = craggy_malloc(strlen(directory) + 1);
+    if ((*log)->directory == NULL) {
+        ERROR_OCCURRED(CraggyResultInternalError);
+    }
+    strcpy((*log)->directory, directory);
+
+    if (mkdir(directory, 0700) != 0 && errno != EEXIST) {
+        ERROR_OCCURRED(CraggyResultGeneralError);
+    }
+
+    char path[PATH_MAX];
+    craggy_auditPath(*log, "index", path, sizeof(path));
+    (*log)->indexFd = open(path, O_RDWR | O_CREAT, 0600);
+    if ((*log)->indexFd < 0) {
+        ERROR_OCCURRED(CraggyResultGeneralError);
+    }
+    // Held until closed, a second writer would interleave records
+    if (flock((*log)->indexFd, LOCK_EX | LOCK_NB) != 0) {
+        ERROR_OCCURRED(CraggyResultGeneralError);
+    }
+
+    struct stat st;
+    if (fstat((*log)->indexFd, &st) != 0) {
+        ERROR_OCCURRED(CraggyResultGeneralError);
+    }
+    const bool created = (size_t) st.st_size < sizeof(CraggyAuditIndexHeader);
+    size_t capacity = created ? 0 : ((size_t) st.st_size - sizeof(CraggyAuditIndexHeader)) / sizeof(CraggyAuditIndexEntry);
+    if (capacity < CRAGGY_AUDIT_INDEX_GROWTH) {
+        capacity = CRAGGY_AUDIT_INDEX_GROWTH;
+    }
+    if (!craggy_auditMapIndex(*log, capacity)) {
+        ERROR_OCCURRED(CraggyResultInternalError);
+    }
+
+    CraggyAuditIndexHeader *header = (*log)->index;
+    if (created) {
+        craggy_memset(header, 0, sizeof(CraggyAuditIndexHeader));
+        craggy_memcpy(header->magic, CRAGGY_AUDIT_INDEX_MAGIC, sizeof(header->magic));
+        header->version = CRAGGY_AUDIT_INDEX_VERSION;
+        header->entryLength = sizeof(CraggyAuditIndexEntry);
+    } else if (craggy_memcmp(header->magic, CRAGGY_AUDIT_INDEX_MAGIC, sizeof(header->magic)) != 0 ||
+               header->version != CRAGGY_AUDIT_INDEX_VERSION || header->entryLength != sizeof(CraggyAuditIndexEntry) ||
+               header->numEntries > capacity) {
+        ERROR_OCCURRED(CraggyResultParseError);
+    }
+
+    if (!craggy_auditRecover(*log)) {
+        ERROR_OCCURRED(CraggyResultGeneralError);
+    }
+
+    // Recovery may have mapped the index afresh, header is not to be used from here on
+    if ((*log)->index->numEntries > 0) {
+        uint8_t recordHeader[CRAGGY_AUDIT_HEADER_LEN];
+        uint8_t response[CRAGGY_AUDIT_MAX_RESPONSE_SIZE];
+        const CraggyAuditIndexEntry *last = &craggy_auditEntries(*log)[(*log)->index->numEntries - 1];
+        if (!craggy_auditReadRecord(*log, last, recordHeader, response, result)) {
+            goto error;
+        }
+        if (!craggy_calculateSHA512(response, last->length - CRAGGY_AUDIT_HEADER_LEN, (*log)->lastHash)) {
+            ERROR_OCCURRED(CraggyResultInternalError);
+        }
+        if (!craggy_auditOpenSegment(*log, result)) {
+            goto error;
+        }
+    }
+
+    *result = CraggyResultSuccess;
+    goto exit;
+
+error:
+    craggy_auditLogClose(*log);
+    *log = NULL;
+
+exit:
+    return *result == CraggyResultSuccess;
+}
+
+bool craggy_auditLogNextNonce(CraggyAuditLog *log, CraggyAuditChain *chain, craggy_rough_time_nonce_t nonce, CraggyResult *result) {
+
+    const uint64_t numEntries = log->index->numEntries;
+    if (numEntries == 0) {
+        chain->previous = CRAGGY_AUDIT_NO_PREVIOUS;
+        craggy_memset(chain->blind, 0, sizeof(chain->blind));
+        return craggy_generateNonce(result, nonce);
+    }
+
+    chain->previous = numEntries - 1;
+    if (!craggy_fillRandomBytes(chain->blind, sizeof(chain->blind), result)) {
+        return false;
+    }
+    uint8_t hashed[CRAGGY_ROUGH_TIME_HASH_LENGTH + CRAGGY_ROUGH_TIME_NONCE_LENGTH];
+    craggy_memcpy(hashed, log->lastHash, CRAGGY_ROUGH_TIME_HASH_LENGTH);
+    craggy_memcpy(hashed + CRAGGY_ROUGH_TIME_HASH_LENGTH, chain->blind, CRAGGY_ROUGH_TIME_NONCE_LENGTH);
+    if (!craggy_calculateSHA512(hashed, sizeof(hashed), nonce)) {
+        *result = CraggyResultInternalError;
+        return false;
+    }
+    *result = CraggyResultSuccess;
+    return true;
+}
+
+/* Cuts what was written of a record off the segment, so that the next record starts where the index expects it.  If
+ * that fails, the next record starts a segment of its own, leaving the bytes behind where no record is looked for. */
+static void craggy_auditCutSegment(CraggyAuditLog *log) {
+    if (ftruncate(log->segmentFd, (off_t) log->segmentSize) != 0) {
+        close(log->segmentFd);
+        log->segmentFd = -1;
+        log->segment++;
+        log->segmentSize = 0;
+    }
+}
+
+bool craggy_auditLogAppend(CraggyAuditLog *log, const CraggyAuditChain *chain, const craggy_rough_time_nonce_t nonce, const craggy_rough_time_public_key_t rootPublicKey, const craggy_rough_time_response_t *response, size_t responseLen, craggy_rough_time_t receivedAt, CraggyResult *result) {
+
+    *result = CraggyResultGeneralError;
+
+    if (responseLen > CRAGGY_AUDIT_MAX_RESPONSE_SIZE) {
+        ERROR_OCCURRED(CraggyResultGeneralError);
+    }
+    if (chain != NULL && chain->previous != CRAGGY_AUDIT_NO_PREVIOUS && chain->previous >= log->index->numEntries) {
+        ERROR_OCCURRED(CraggyResultGeneralError);
+    }
+
+    uint8_t header[CRAGGY_AUDIT_HEADER_LEN];
+    craggy_memcpy(header + CRAGGY_AUDIT_OFFSET_MAGIC, CRAGGY_AUDIT_RECORD_MAGIC, 4);
+    craggy_auditStore32(header + CRAGGY_AUDIT_OFFSET_RESPONSE_LEN, (uint32_t) responseLen);
+    craggy_auditStore64(header + CRAGGY_AUDIT_OFFSET_RECEIVED_AT, receivedAt);
+    craggy_auditStore64(header + CRAGGY_AUDIT_OFFSET_PREVIOUS, chain != NULL ? chain->previous : CRAGGY_AUDIT_NO_PREVIOUS);
+    craggy_memcpy(header + CRAGGY_AUDIT_OFFSET_ROOT_PUBLIC_KEY, rootPublicKey, CRAGGY_ROUGH_TIME_PUBLIC_KEY_LENGTH);
+    craggy_memcpy(header + CRAGGY_AUDIT_OFFSET_NONCE, nonce, CRAGGY_ROUGH_TIME_NONCE_LENGTH);
+    if (chain != NULL) {
+        craggy_memcpy(header + CRAGGY_AUDIT_OFFSET_BLIND, chain->blind, CRAGGY_ROUGH_TIME_NONCE_LENGTH);
+    } else {
+        craggy_memset(header + CRAGGY_AUDIT_OFFSET_BLIND, 0, CRAGGY_ROUGH_TIME_NONCE_LENGTH);
+    }
+    const uint32_t length = (uint32_t) (CRAGGY_AUDIT_HEADER_LEN + responseLen);
+
+    uint8_t hash[CRAGGY_ROUGH_TIME_HASH_LENGTH];
+    if (!craggy_calculateSHA512(response, responseLen, hash)) {
+        ERROR_OCCURRED(CraggyResultInternalError);
+    }
+
+    if (log->segmentFd >= 0 && log->segmentSize > 0 && log->segmentSize + length > CRAGGY_AUDIT_SEGMENT_SIZE) {
+        // The full segment is flushed before the next one is started, records are never lost out of order
+        if (!craggy_auditLogSync(log, result)) {
+            goto error;
+        }
+        close(log->segmentFd);
+        log->segmentFd = -1;
+        log->segment++;
+        log->segmentSize = 0;
+    }
+    if (log->segmentFd < 0 && !craggy_auditOpenSegment(log, result)) {
+        goto error;
+    }
+
+    // One write, so that a crash tears at most this record
+    struct iovec vectors[2];
+    vectors[0].iov_base = header;
+    vectors[0].iov_len = sizeof(header);
+    vectors[1].iov_base = (void *) response;
+    vectors[1].iov_len = responseLen;
+    ssize_t written;
+    do {
+        written = writev(log->segmentFd, vectors, 2);
+    } while (written == -1 && errno == EINTR);
+    if (written != (ssize_t) length) {
+        if (written > 0) {
+            craggy_auditCutSegment(log);
+        }
+        ERROR_OCCURRED(CraggyResultGeneralError);
+    }
+
+    if (!craggy_auditAddEntry(log, receivedAt, log->segment, log->segmentSize, length)) {
+        // Not indexed, so not kept either
+        craggy_auditCutSegment(log);
+        ERROR_OCCURRED(CraggyResultInternalError);
+    }
+    log->segmentSize += length;
+    craggy_memcpy(log->lastHash, hash, CRAGGY_ROUGH_TIME_HASH_LENGTH);
+
+    const uint64_t now = craggy_monotonicUs();
+    if (log->unsynced++ == 0) {
+        log->unsyncedSince = now;
+    }
+    if (log->unsynced >= CRAGGY_AUDIT_SYNC_RECORDS || now - log->unsyncedSince >= (uint64_t) CRAGGY_AUDIT_SYNC_INTERVAL_MS * 1000) {
+        return craggy_auditLogSync(log, result);
+    }
+
+    *result = CraggyResultSuccess;
+
+error:
+    return *result == CraggyResultSuccess;
+}
+
+bool craggy_auditLogSync(CraggyAuditLog *log, CraggyResult *result) {
+    // Records before the index, so that the index never refers to a record lost
+    if (log->segmentFd >= 0 && fdatasync(log->segmentFd) != 0) {
+        *result = CraggyResultGeneralError;
+        return false;
+    }
+    if (msync(log->index, craggy_auditIndexLen(log->capacity), MS_SYNC) != 0) {
+        *result = CraggyResultGeneralError;
+        return false;
+    }
+    log->unsynced = 0;
+    *result = CraggyResultSuccess;
+    return true;
+}
+
+uint64_t craggy_auditLogCount(const CraggyAuditLog *log) {
+    return log->index->numEntries;
+}
+
+/* First entry indexed at or after a time. */
+static uint64_t craggy_auditLowerBound(const CraggyAuditLog *log, craggy_rough_time_t time) {
+    const CraggyAuditIndexEntry *entries = craggy_auditEntries(log);
+    uint64_t low = 0;
+    uint64_t high = log->index->numEntries;
+    while (low < high) {
+        const uint64_t middle = low + (high - low) / 2;
+        if (entries[middle].time < time) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+uint64_t craggy_auditLogFind(const CraggyAuditLog *log, craggy_rough_time_t from, craggy_rough_time_t to, uint64_t *first) {
+    *first = craggy_auditLowerBound(log, from);
+    if (to < from) {
+        return 0;
+    }
+    const uint64_t end = to == UINT64_MAX ? log->index->numEntries : craggy_auditLowerBound(log, to + 1);
+    return end - *first;
+}
+
+bool craggy_auditLogRead(const CraggyAuditLog *log, uint64_t index, CraggyAuditRecord *record, CraggyResult *result) {
+
+    if (index >= log->index->numEntries) {
+        *result = CraggyResultGeneralError;
+        return false;
+    }
+    const CraggyAuditIndexEntry *entry = &craggy_auditEntries(log)[index];
+    uint8_t header[CRAGGY_AUDIT_HEADER_LEN];
+    if (!craggy_auditReadRecord(log, entry, header, record->response, result)) {
+        return false;
+    }
+
+    record->receivedAt = craggy_auditLoad64(header + CRAGGY_AUDIT_OFFSET_RECEIVED_AT);
+    record->chain.previous = craggy_auditLoad64(header + CRAGGY_AUDIT_OFFSET_PREVIOUS);
+    craggy_memcpy(record->chain.blind, header + CRAGGY_AUDIT_OFFSET_BLIND, CRAGGY_ROUGH_TIME_NONCE_LENGTH);
+    craggy_memcpy(record->rootPublicKey, header + CRAGGY_AUDIT_OFFSET_ROOT_PUBLIC_KEY, CRAGGY_ROUGH_TIME_PUBLIC_KEY_LENGTH);
+    craggy_memcpy(record->nonce, header + CRAGGY_AUDIT_OFFSET_NONCE, CRAGGY_ROUGH_TIME_NONCE_LENGTH);
+    record->responseLen = entry->length - CRAGGY_AUDIT_HEADER_LEN;
+    return true;
+}
+
+bool craggy_auditLogVerify(const CraggyAuditLog *log, uint64_t *numVerified, CraggyResult *result) {
+
+    *result = CraggyResultGeneralError;
+    *numVerified = 0;
+
+    CraggyAuditRecord *record = craggy_malloc(sizeof(CraggyAuditRecord));
+    CraggyAuditRecord *previous = craggy_malloc(sizeof(CraggyAuditRecord));
+    if (record == NULL || previous == NULL) {
+        ERROR_OCCURRED(CraggyResultInternalError);
+    }
+
+    for (uint64_t i = 0; i < log->index->numEntries; i++) {
+        if (!craggy_auditLogRead(log, i, record, result)) {
+            goto error;
+        }
+
+        craggy_rough_time_t time;
+        craggy_rough_time_radius_t radius;
+        if (!craggy_processResponse(record->nonce, record->rootPublicKey, record->response, record->responseLen, result, &time, &radius)) {
+            goto error;
+        }
+
+        if (record->chain.previous != CRAGGY_AUDIT_NO_PREVIOUS) {
+            if (record->chain.previous >= i) {
+                ERROR_OCCURRED(CraggyResultAuthenticationHashError);
+            }
+            if (!craggy_auditLogRead(log, record->chain.previous, previous, result)) {
+                goto error;
+            }
+            uint8_t hashed[CRAGGY_ROUGH_TIME_HASH_LENGTH + CRAGGY_ROUGH_TIME_NONCE_LENGTH];
+            uint8_t nonce[CRAGGY_ROUGH_TIME_NONCE_LENGTH];
+            if (!craggy_calculateSHA512(previous->response, previous->responseLen, hashed)) {
+                ERROR_OCCURRED(CraggyResultInternalError);
+            }
+            craggy_memcpy(hashed + CRAGGY_ROUGH_TIME_HASH_LENGTH, record->chain.blind, CRAGGY_ROUGH_TIME_NONCE_LENGTH);
+            if (!craggy_calculateSHA512(hashed, sizeof(hashed), nonce)) {
+                ERROR_OCCURRED(CraggyResultInternalError);
+            }
+            if (craggy_memcmp(nonce, record->nonce, CRAGGY_ROUGH_TIME_NONCE_LENGTH) != 0) {
+                ERROR_OCCURRED(CraggyResultAuthenticationHashError);
+            }
+        }
+        *numVerified = i + 1;
+    }
+
+    *result = CraggyResultSuccess;
+
+error:
+    craggy_free(previous);
+    craggy_free(record);
+    return *result == CraggyResultSuccess;
+}
+
+void craggy_auditLogClose(CraggyAuditLog *log) {
+    if (log == NULL) {
+        return;
+    }
+    if (log->index != NULL) {
+        CraggyResult result;
+        craggy_auditLogSync(log, &result);
+        munmap(log->index, craggy_auditIndexLen(log->capacity));
+    }
+    if (log->segmentFd >= 0) {
+        close(log->segmentFd);
+    }
+    if (log->indexFd >= 0) {
+        close(log->indexFd);
+    }
+    craggy_free(log->directory);
+    craggy_free(log);
+}
@@ -0,0 +1,164 @@
+/* Copyright 2020 Johan Lindquist
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CRAGGY_CRAGGYAUDITLOG_H
+#define CRAGGY_CRAGGYAUDITLOG_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "CraggyTypes.h"
+
+/** Size a segment grows to before the next record goes into a new one, in bytes */
+#define CRAGGY_AUDIT_SEGMENT_SIZE (64 * 1024 * 1024)
+
+/** Records appended before they are flushed to disk, whatever the time */
+#define CRAGGY_AUDIT_SYNC_RECORDS 32
+
+/** Longest a record appended waits to be flushed to disk, checked as the next one is appended */
+#define CRAGGY_AUDIT_SYNC_INTERVAL_MS 1000
+
+/** Largest response kept */
+#define CRAGGY_AUDIT_MAX_RESPONSE_SIZE (3 * CRAGGY_ROUGH_TIME_MIN_REQUEST_SIZE)
+
+/** Record of a nonce not derived from an earlier response */
+#define CRAGGY_AUDIT_NO_PREVIOUS UINT64_MAX
+
+/** Verified responses kept as proof of time, in a directory of segments appended to and an index of them by time.
+ *
+ * Responses are chained as Roughtime proposes: the nonce of a request is the SHA-512 of the previous response's
+ * SHA-512 and a random blind, kept with the record.  Each response, signed by its server, then proves it was made
+ * after the one before - a server answering with a time earlier than that of another server's response preceding it
+ * has misbehaved, and the log shows it without trusting whoever kept it.
+ *
+ * Segments are written with O_APPEND and flushed to disk in batches, a record at a time in little-endian byte order
+ * so that the log can be checked anywhere.  The index is mapped and kept in the layout of the machine writing it; it
+ * is rebuilt from the segments as far as it falls behind them.  One process at a time has the log open. */
+typedef struct CraggyAuditLog CraggyAuditLog;
+
+/** What a nonce was derived from. */
+typedef struct {
+    /** Record whose response the nonce was derived from, CRAGGY_AUDIT_NO_PREVIOUS if none */
+    uint64_t previous;
+    /** Random blind hashed with the response, zeroes if there is none */
+    uint8_t blind[CRAGGY_ROUGH_TIME_NONCE_LENGTH];
+} CraggyAuditChain;
+
+/** A record read back from the log. */
+typedef struct {
+    /** Local realtime clock when the response was received, in microseconds from the epoch */
+    craggy_rough_time_t receivedAt;
+    CraggyAuditChain chain;
+    /** The root public key of the server, identifying it */
+    craggy_rough_time_public_key_t rootPublicKey;
+    craggy_rough_time_nonce_t nonce;
+    size_t responseLen;
+    uint8_t response[CRAGGY_AUDIT_MAX_RESPONSE_SIZE];
+} CraggyAuditRecord;
+
+/** Opens the log in a directory, creating both if need be, and recovers it after a crash: a record torn by it is cut
+ * off and records missing from the index are added back.
+ *
+ * @param directory Directory of the log
+ * @param log Log opened
+ * @param result Result of the operation - CraggyResultParseError if the index was not written by this version of the
+ * library, on this machine, and CraggyResultGeneralError if another process has the log open
+ * @return True if successful, otherwise false and {@link result} will indicate the error
+ */
+bool craggy_auditLogOpen(const char *directory, CraggyAuditLog **log, CraggyResult *result);
+
+/** Derives a nonce from the last response appended, with a blind of its own - any number of requests may be sent
+ * with nonces derived from the same response.  Before the first response the nonce is random.
+ *
+ * @param log Log opened using {@link craggy_auditLogOpen}
+ * @param chain What the nonce was derived from, to append the response with
+ * @param nonce Nonce derived
+ * @param result Result of the operation
+ * @return True if successful, otherwise false and {@link result} will indicate the error
+ */
+bool craggy_auditLogNextNonce(CraggyAuditLog *log, CraggyAuditChain *chain, craggy_rough_time_nonce_t nonce, CraggyResult *result);
+
+/** Appends a response verified using {@link craggy_processResponse} or its like.  The record is flushed to disk along
+ * with {@link CRAGGY_AUDIT_SYNC_RECORDS} others, or once {@link CRAGGY_AUDIT_SYNC_INTERVAL_MS} has passed, or by
+ * {@link craggy_auditLogSync}.
+ *
+ * @param log Log opened using {@link craggy_auditLogOpen}
+ * @param chain What the nonce was derived from, as of {@link craggy_auditLogNextNonce}, or NULL if the nonce was not
+ * derived by the log
+ * @param nonce Nonce the response was requested with
+ * @param rootPublicKey The root public key of the server
+ * @param response Response as received
+ * @param responseLen Length of the response, at most {@link CRAGGY_AUDIT_MAX_RESPONSE_SIZE}
+ * @param receivedAt Local realtime clock when the response was received, in microseconds from the epoch
+ * @param result Result of the operation
+ * @return True if successful, otherwise false and {@link result} will indicate the error
+ */
+bool craggy_auditLogAppend(CraggyAuditLog *log, const CraggyAuditChain *chain, const craggy_rough_time_nonce_t nonce, const craggy_rough_time_public_key_t rootPublicKey, const craggy_rough_time_response_t *response, size_t responseLen, craggy_rough_time_t receivedAt, CraggyResult *result);
+
+/** Flushes the records appended to disk.
+ *
+ * @param log Log opened using {@link craggy_auditLogOpen}
+ * @param result Result of the operation
+ * @return True if successful, otherwise false and {@link result} will indicate the error
+ */
+bool craggy_auditLogSync(CraggyAuditLog *log, CraggyResult *result);
+
+/**
+ *
+ * @param log
+ * @return Number of records in the log, numbered from 0 in the order they were appended
+ */
+uint64_t craggy_auditLogCount(const CraggyAuditLog *log);
+
+/** Finds the records received within a range of time, searching the index.  Records are indexed by the time they
+ * were received, or by that of the record before them if the clock went back in between.
+ *
+ * @param log Log opened using {@link craggy_auditLogOpen}
+ * @param from Start of the range, in microseconds from the epoch
+ * @param to End of the range, included, in microseconds from the epoch
+ * @param first First record in the range
+ * @return Number of records in the range, following on from the first
+ */
+uint64_t craggy_auditLogFind(const CraggyAuditLog *log, craggy_rough_time_t from, craggy_rough_time_t to, uint64_t *first);
+
+/** Reads a record back.
+ *
+ * @param log Log opened using {@link craggy_auditLogOpen}
+ * @param index Number of the record
+ * @param record Record read
+ * @param result Result of the operation - CraggyResultParseError if the record is damaged
+ * @return True if successful, otherwise false and {@link result} will indicate the error
+ */
+bool craggy_auditLogRead(const CraggyAuditLog *log, uint64_t index, CraggyAuditRecord *record, CraggyResult *result);
+
+/** Checks every record: that its response is valid for its nonce and server, and that its nonce was derived from the
+ * earlier response it names.
+ *
+ * @param log Log opened using {@link craggy_auditLogOpen}
+ * @param numVerified Records checked before the first that failed, all of them if successful
+ * @param result Result of the operation - CraggyResultAuthenticationHashError if a nonce was not derived as its record
+ * says, otherwise as of {@link craggy_processResponse}
+ * @return True if every record checks out, otherwise false and {@link result} will indicate the error
+ */
+bool craggy_auditLogVerify(const CraggyAuditLog *log, uint64_t *numVerified, CraggyResult *result);
+
+/** Flushes the records appended and closes the log.
+ *
+ * @param log
+ */
+void craggy_auditLogClose(CraggyAuditLog *log);
+
+#endif //CRAGGY_CRAGGYAUDITLOG_H
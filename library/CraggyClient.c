@@ -15,11 +15,16 @@
  */
 
 #include <memory.h>
+#include <string.h>
 #include <assert.h>
 
 #include "CraggyClient.h"
 #include "CraggyProtocol.h"
 #include "CraggyCrypto.h"
+#include "CraggyMerkle.h"
+#include "CraggyAllocator.h"
+#include "CraggyStats.h"
+#include "CraggyTrace.h"
 
 #include "CraggyOS.h"
 
@@ -29,231 +34,721 @@ bool craggy_generateNonce(CraggyResult *result, craggy_rough_time_nonce_t nonce)
     return *result == CraggyResultSuccess;
 }
 
-bool craggy_createRequest(craggy_rough_time_nonce_t nonce, craggy_rough_time_request_t requestBuf) {
+bool craggy_generateNonces(CraggyResult *result, craggy_rough_time_nonce_t *nonces, size_t numNonces)
+{
+    // The nonces are contiguous, so they all come out of one fill
+    craggy_fillRandomBytes((uint8_t *) nonces, numNonces * CRAGGY_ROUGH_TIME_NONCE_LENGTH, result);
+    return *result == CraggyResultSuccess;
+}
 
-    bool success = false;
+bool craggy_createRequestTemplate(craggy_rough_time_request_t requestBuf) {
+    return craggy_buildStandardRequest(NULL, requestBuf);
+}
 
-    size_t requestBufLen = 0;
-    size_t paddingLen = CRAGGY_ROUGH_TIME_MIN_REQUEST_SIZE - (craggy_messageHeaderLen(3) + CRAGGY_ROUGH_TIME_NONCE_LENGTH + sizeof(uint32_t));
-    uint8_t padding[paddingLen];
-    craggy_memset(padding, 0, paddingLen);
-
-    CraggyRoughtimeMessageBuilder *builder = NULL;
-
-    if (craggy_createMessageBuilder(3, requestBuf, CRAGGY_ROUGH_TIME_MIN_REQUEST_SIZE, &builder)) {
-        if (craggy_addTagData(builder, CRAGGY_TAG_PAD, padding, paddingLen)) {
-            uint32_t version = 1;
-            if (craggy_addTagData(builder, CRAGGY_TAG_VER, (uint8_t *) &version, sizeof(uint32_t))) {
-                if (craggy_addTagData(builder, CRAGGY_TAG_NONCE, nonce, CRAGGY_ROUGH_TIME_NONCE_LENGTH)) {
-                    success = craggy_finish(builder, &requestBufLen);
-                    assert(requestBufLen == CRAGGY_ROUGH_TIME_MIN_REQUEST_SIZE);
-                }
-            }
-        }
-        craggy_destroyMessageBuilder(builder);
-    }
-    return success;
+void craggy_setRequestNonce(craggy_rough_time_request_t requestBuf, const craggy_rough_time_nonce_t nonce) {
+    craggy_memcpy(requestBuf + CRAGGY_ROUGH_TIME_REQUEST_NONCE_OFFSET, nonce, CRAGGY_ROUGH_TIME_NONCE_LENGTH);
 }
 
-static bool craggy_verifySignatureWithContext(const craggy_rough_time_public_key_t rootPublicKey, const char *context, const uint8_t *signature, const uint8_t *msg, const size_t msgLen) {
+bool craggy_createRequest(craggy_rough_time_nonce_t nonce, craggy_rough_time_request_t requestBuf) {
+    return craggy_buildStandardRequest(nonce, requestBuf);
+}
 
-    size_t signedDataLen = strlen(context) + 1 + msgLen;
-    uint8_t signedData[signedDataLen];
+#define CRAGGY_DELEGATION_CONTEXT "RoughTime v1 delegation signature--"
+#define CRAGGY_RESPONSE_CONTEXT "RoughTime v1 response signature"
 
+static size_t craggy_signedDataLen(const char *context, const size_t msgLen) {
+    return strlen(context) + 1 + msgLen;
+}
+
+static void craggy_writeSignedData(uint8_t *signedData, const char *context, const uint8_t *msg, const size_t msgLen) {
     craggy_memcpy(signedData, context, strlen(context));
     craggy_memset(signedData + strlen(context), 0, 1);
     craggy_memcpy(signedData + strlen(context) + 1 , msg, msgLen);
+}
 
-    return craggy_verifySignature(rootPublicKey, signature, signedData, signedDataLen);
+/* Verifies using the prepared key when there is one, otherwise the raw public key.  The context (with its
+ * terminating zero) and the message are passed as segments rather than copied together. */
+static bool craggy_verifySignatureWithContext(const craggy_rough_time_public_key_t publicKey, const CraggyPublicKey *preparedKey, const char *context, const uint8_t *signature, const uint8_t *msg, const size_t msgLen) {
+
+    const CraggyMessageSegment segments[] = {
+        { (const uint8_t *) context, strlen(context) + 1 },
+        { msg, msgLen },
+    };
+
+    if (preparedKey != NULL) {
+        return craggy_verifyPreparedSignatureSegments(preparedKey, signature, segments, 2);
+    }
+    return craggy_verifySignatureSegments(publicKey, signature, segments, 2);
 }
 
 #define ERROR_OCCURRED(x) *result = x; goto error;
-#define HASH_NODE(hash, scratch,left, right) scratch[0] = '\x01'; craggy_memcpy((scratch)+1, (left), CRAGGY_ROUGH_TIME_HASH_LENGTH); craggy_memcpy((scratch)+1+CRAGGY_ROUGH_TIME_HASH_LENGTH, (right), CRAGGY_ROUGH_TIME_HASH_LENGTH); if (!craggy_calculateSHA512(scratch, (2*CRAGGY_ROUGH_TIME_HASH_LENGTH)+1, (hash))) { ERROR_OCCURRED(CraggyResultInternalError) };
-#define HASH_LEAF(hash, scratch,leaf) scratch[0] = '\x00'; craggy_memcpy((scratch)+1,(leaf), CRAGGY_ROUGH_TIME_HASH_LENGTH); if (!craggy_calculateSHA512((scratch), CRAGGY_ROUGH_TIME_HASH_LENGTH+1, (hash))) { ERROR_OCCURRED(CraggyResultInternalError) };
 
-bool craggy_processResponse(craggy_rough_time_nonce_t nonce, craggy_rough_time_public_key_t rootPublicKey, craggy_rough_time_response_t *response, size_t responseLen, CraggyResult *result, craggy_rough_time_t *outTime, craggy_rough_time_radius_t *outRadius) {
+/** The parts of a response needed to verify it, all pointing into the response buffer. */
+typedef struct {
+    const uint8_t *delegation;
+    size_t delegationLen;
+    const uint8_t *delegationSignature;
+    const uint8_t *delegationPublicKey;
+    const uint8_t *srep;
+    size_t srepLen;
+    const uint8_t *srepSignature;
+    const uint8_t *rootHash;
+    uint32_t index;
+    const uint8_t *path;
+    size_t pathLen;
+    craggy_rough_time_t midPoint;
+    craggy_rough_time_t minTime;
+    craggy_rough_time_t maxTime;
+    craggy_rough_time_radius_t radius;
+} CraggyResponseFields;
+
+/** State of one response while it is being verified. */
+typedef struct {
+    CraggyResponseFields fields;
+    bool delegationCached;
+    // Set if the delegation came from the store backing the cache, to be stored in the cache once the response verifies
+    bool delegationLoaded;
+    // Prepared delegation public key held by the cache, if the delegation is cached
+    const CraggyPublicKey *delegationKey;
+    uint8_t delegationHash[CRAGGY_ROUGH_TIME_HASH_LENGTH];
+} CraggyResponseState;
+
+#if defined(CRAGGY_WITH_MESSAGE_FAST_PATH)
+
+/* The layout of responses from the common servers: every message has exactly the tags the client reads, so
+ * everything but the length of the path is at a fixed offset.  The lengths are those of the tags themselves, headers
+ * included. */
+#define STANDARD_RESPONSE_HEADER_LEN 40
+#define STANDARD_SREP_LEN 100
+#define STANDARD_CERT_LEN 152
+#define STANDARD_DELE_LEN 72
+
+static uint32_t craggy_load32(const uint8_t *in) {
+    uint32_t value;
+    craggy_memcpy(&value, in, sizeof(uint32_t));
+    return value;
+}
 
-    *result = CraggyResultGeneralError;
+/* Fills in the fields of a response in the standard layout, checking the same as the generic parser would.  Returns
+ * false if the response is laid out any other way, leaving it to the generic parser - which also reports the error
+ * of a response that is malformed. */
+static bool craggy_parseStandardResponse(const uint8_t *response, const size_t responseLen, CraggyResponseFields *fields) {
 
-/**
-    1. Verify the signature in the certificate of the delegation message.
-    2. Verify the top-level signature of the signed response message using the public key from the delegation.
-    3. Verify that the nonce from the request is included in the Merkle tree.
-    4. Verify that the midpoint is within the valid bounds of the delegation.
-    5. Return the midpoint and radius.
- */
+    if (responseLen < STANDARD_RESPONSE_HEADER_LEN + CRAGGY_ROUGH_TIME_SIGNATURE_LENGTH + STANDARD_SREP_LEN + STANDARD_CERT_LEN + sizeof(uint32_t)) {
+        return false;
+    }
 
-    CraggyRoughtimeMessage *message = NULL;
-    CraggyRoughtimeMessage *certMessage = NULL;
-    CraggyRoughtimeMessage *delegationMessage = NULL;
-    CraggyRoughtimeMessage *srepMessage = NULL;
+    // Top level: SIG, PATH, SREP, CERT and INDX
+    const uint8_t *data = response + STANDARD_RESPONSE_HEADER_LEN;
+    const uint32_t srepOffset = craggy_load32(response + 8);
+    const uint32_t certOffset = craggy_load32(response + 12);
+    const uint32_t indxOffset = craggy_load32(response + 16);
+    if (craggy_load32(response) != 5 ||
+        craggy_load32(response + 4) != CRAGGY_ROUGH_TIME_SIGNATURE_LENGTH ||
+        srepOffset < CRAGGY_ROUGH_TIME_SIGNATURE_LENGTH || srepOffset % 4 != 0 ||
+        certOffset != srepOffset + STANDARD_SREP_LEN ||
+        indxOffset != certOffset + STANDARD_CERT_LEN ||
+        responseLen != STANDARD_RESPONSE_HEADER_LEN + indxOffset + sizeof(uint32_t) ||
+        craggy_load32(response + 20) != CRAGGY_TAG_SIG ||
+        craggy_load32(response + 24) != CRAGGY_TAG_PATH ||
+        craggy_load32(response + 28) != CRAGGY_TAG_SREP ||
+        craggy_load32(response + 32) != CRAGGY_TAG_CERT ||
+        craggy_load32(response + 36) != CRAGGY_TAG_INDX) {
+        return false;
+    }
 
-    uint8_t *nestedData = NULL;
-    size_t nestedDataSize = 0;
+    // SREP: RADI, MIDP and ROOT
+    const uint8_t *srep = data + srepOffset;
+    if (craggy_load32(srep) != 3 ||
+        craggy_load32(srep + 4) != sizeof(craggy_rough_time_radius_t) ||
+        craggy_load32(srep + 8) != sizeof(craggy_rough_time_radius_t) + sizeof(craggy_rough_time_t) ||
+        craggy_load32(srep + 12) != CRAGGY_TAG_RADI ||
+        craggy_load32(srep + 16) != CRAGGY_TAG_MIDP ||
+        craggy_load32(srep + 20) != CRAGGY_TAG_ROOT) {
+        return false;
+    }
 
-    uint8_t *signature = NULL;
-    uint8_t *delegationPublicKey = NULL;
+    // CERT: SIG and DELE, DELE: PUBK, MINT and MAXT
+    const uint8_t *cert = data + certOffset;
+    const uint8_t *dele = cert + 16 + CRAGGY_ROUGH_TIME_SIGNATURE_LENGTH;
+    if (craggy_load32(cert) != 2 ||
+        craggy_load32(cert + 4) != CRAGGY_ROUGH_TIME_SIGNATURE_LENGTH ||
+        craggy_load32(cert + 8) != CRAGGY_TAG_SIG ||
+        craggy_load32(cert + 12) != CRAGGY_TAG_DELE ||
+        craggy_load32(dele) != 3 ||
+        craggy_load32(dele + 4) != CRAGGY_ROUGH_TIME_PUBLIC_KEY_LENGTH ||
+        craggy_load32(dele + 8) != CRAGGY_ROUGH_TIME_PUBLIC_KEY_LENGTH + sizeof(craggy_rough_time_t) ||
+        craggy_load32(dele + 12) != CRAGGY_TAG_PUBK ||
+        craggy_load32(dele + 16) != CRAGGY_TAG_MINT ||
+        craggy_load32(dele + 20) != CRAGGY_TAG_MAXT) {
+        return false;
+    }
 
-    uint8_t *rootHash = NULL;
-    uint8_t *path = NULL;
-    uint32_t index = 0;
+    fields->delegation = dele;
+    fields->delegationLen = STANDARD_DELE_LEN;
+    fields->srep = srep;
+    fields->srepLen = STANDARD_SREP_LEN;
+
+    fields->delegationSignature = cert + 16;
+    fields->delegationPublicKey = dele + 24;
+    fields->srepSignature = data;
+    fields->rootHash = srep + 24 + sizeof(craggy_rough_time_radius_t) + sizeof(craggy_rough_time_t);
+    fields->index = craggy_load32(data + indxOffset);
+    fields->path = data + CRAGGY_ROUGH_TIME_SIGNATURE_LENGTH;
+    fields->pathLen = srepOffset - CRAGGY_ROUGH_TIME_SIGNATURE_LENGTH;
+    craggy_memcpy(&fields->midPoint, srep + 24 + sizeof(craggy_rough_time_radius_t), sizeof(craggy_rough_time_t));
+    craggy_memcpy(&fields->minTime, dele + 24 + CRAGGY_ROUGH_TIME_PUBLIC_KEY_LENGTH, sizeof(craggy_rough_time_t));
+    craggy_memcpy(&fields->maxTime, dele + 24 + CRAGGY_ROUGH_TIME_PUBLIC_KEY_LENGTH + sizeof(craggy_rough_time_t), sizeof(craggy_rough_time_t));
+    craggy_memcpy(&fields->radius, srep + 24, sizeof(craggy_rough_time_radius_t));
+    return true;
+}
 
-    if (!craggy_parseMessage(response, responseLen, &message)) {
-        ERROR_OCCURRED(CraggyResultParseError);
-    }
+#endif
 
-    // Validate the tags are present and accounted for - we do them all here to somewhat simplify the flow in the code
+static bool craggy_parseResponseFields(const craggy_rough_time_response_t *response, size_t responseLen, CraggyResponseFields *fields, CraggyResult *result) {
 
-    if (!craggy_hasTag(message, CRAGGY_TAG_SREP) || !craggy_hasTag(message, CRAGGY_TAG_SIG) || !craggy_hasTag(message, CRAGGY_TAG_INDX) ||
-        !craggy_hasTag(message, CRAGGY_TAG_PATH) || !craggy_hasTag(message, CRAGGY_TAG_CERT)) {
-        ERROR_OCCURRED(CraggyResultParseErrorMissingTags);
-    }
+    *result = CraggyResultGeneralError;
 
-    // Validate the CERT message tags
-    if (!craggy_getTag(message, &nestedData, &nestedDataSize, CRAGGY_TAG_CERT)) {
-        ERROR_OCCURRED(CraggyResultParseError);
+#if defined(CRAGGY_WITH_MESSAGE_FAST_PATH)
+    if (craggy_parseStandardResponse((const uint8_t *) response, responseLen, fields)) {
+        *result = CraggyResultSuccess;
+        return true;
     }
-    if (!craggy_parseMessage(nestedData, nestedDataSize, &certMessage)) {
+#endif
+
+    // Views onto the response buffer, nothing is allocated
+    CraggyRoughtimeMessage message;
+    CraggyRoughtimeMessage certMessage;
+    CraggyRoughtimeMessage delegationMessage;
+    CraggyRoughtimeMessage srepMessage;
+
+    // The tags wanted from each message, in increasing tag order as craggy_getTags requires
+    enum { MESSAGE_SIG, MESSAGE_PATH, MESSAGE_SREP, MESSAGE_CERT, MESSAGE_INDX, MESSAGE_TAGS };
+    CraggyTagSlice messageTags[MESSAGE_TAGS] = {
+        { CRAGGY_TAG_SIG, CRAGGY_ROUGH_TIME_SIGNATURE_LENGTH, NULL, 0 },
+        { CRAGGY_TAG_PATH, CRAGGY_TAG_ANY_LENGTH, NULL, 0 },
+        { CRAGGY_TAG_SREP, CRAGGY_TAG_ANY_LENGTH, NULL, 0 },
+        { CRAGGY_TAG_CERT, CRAGGY_TAG_ANY_LENGTH, NULL, 0 },
+        { CRAGGY_TAG_INDX, sizeof(uint32_t), NULL, 0 },
+    };
+
+    enum { CERT_SIG, CERT_DELE, CERT_TAGS };
+    CraggyTagSlice certTags[CERT_TAGS] = {
+        { CRAGGY_TAG_SIG, CRAGGY_ROUGH_TIME_SIGNATURE_LENGTH, NULL, 0 },
+        { CRAGGY_TAG_DELE, CRAGGY_TAG_ANY_LENGTH, NULL, 0 },
+    };
+
+    enum { DELEGATION_PUBK, DELEGATION_MINT, DELEGATION_MAXT, DELEGATION_TAGS };
+    CraggyTagSlice delegationTags[DELEGATION_TAGS] = {
+        { CRAGGY_TAG_PUBK, CRAGGY_ROUGH_TIME_PUBLIC_KEY_LENGTH, NULL, 0 },
+        { CRAGGY_TAG_MINT, sizeof(craggy_rough_time_t), NULL, 0 },
+        { CRAGGY_TAG_MAXT, sizeof(craggy_rough_time_t), NULL, 0 },
+    };
+
+    enum { SREP_RADI, SREP_MIDP, SREP_ROOT, SREP_TAGS };
+    CraggyTagSlice srepTags[SREP_TAGS] = {
+        { CRAGGY_TAG_RADI, sizeof(craggy_rough_time_radius_t), NULL, 0 },
+        { CRAGGY_TAG_MIDP, sizeof(craggy_rough_time_t), NULL, 0 },
+        { CRAGGY_TAG_ROOT, CRAGGY_ROUGH_TIME_HASH_LENGTH, NULL, 0 },
+    };
+
+    if (!craggy_parseMessageInto(response, responseLen, &message)) {
         ERROR_OCCURRED(CraggyResultParseError);
     }
-
-    if (!craggy_hasTag(certMessage, CRAGGY_TAG_SIG) || !craggy_hasTag(certMessage, CRAGGY_TAG_DELE)) {
-        ERROR_OCCURRED(CraggyResultParseErrorMissingTags);
+    if (!craggy_getTags(&message, messageTags, MESSAGE_TAGS, result)) {
+        goto error;
     }
 
-    if (!craggy_getTag(certMessage, &nestedData, &nestedDataSize, CRAGGY_TAG_DELE)) {
+    if (!craggy_parseMessageInto(messageTags[MESSAGE_CERT].data, messageTags[MESSAGE_CERT].len, &certMessage)) {
         ERROR_OCCURRED(CraggyResultParseError);
     }
+    if (!craggy_getTags(&certMessage, certTags, CERT_TAGS, result)) {
+        goto error;
+    }
 
-    if (!craggy_parseMessage(nestedData, nestedDataSize, &delegationMessage)) {
+    if (!craggy_parseMessageInto(certTags[CERT_DELE].data, certTags[CERT_DELE].len, &delegationMessage)) {
         ERROR_OCCURRED(CraggyResultParseError);
     }
-
-    if (!craggy_hasTag(delegationMessage, CRAGGY_TAG_MINT) || !craggy_hasTag(delegationMessage, CRAGGY_TAG_MAXT) || !craggy_hasTag(delegationMessage, CRAGGY_TAG_PUBK)) {
-        ERROR_OCCURRED(CraggyResultParseErrorMissingTags);
+    if (!craggy_getTags(&delegationMessage, delegationTags, DELEGATION_TAGS, result)) {
+        goto error;
     }
 
-    if (!craggy_getTag(message, &nestedData, &nestedDataSize, CRAGGY_TAG_SREP)) {
+    if (!craggy_parseMessageInto(messageTags[MESSAGE_SREP].data, messageTags[MESSAGE_SREP].len, &srepMessage)) {
         ERROR_OCCURRED(CraggyResultParseError);
     }
+    if (!craggy_getTags(&srepMessage, srepTags, SREP_TAGS, result)) {
+        goto error;
+    }
 
-    if (!craggy_parseMessage(nestedData, nestedDataSize, &srepMessage)) {
-        ERROR_OCCURRED(CraggyResultParseError);
+    fields->delegation = craggy_getMessageBuffer(&delegationMessage);
+    fields->delegationLen = craggy_getMessageBufferSize(&delegationMessage);
+    fields->srep = craggy_getMessageBuffer(&srepMessage);
+    fields->srepLen = craggy_getMessageBufferSize(&srepMessage);
+
+    fields->delegationSignature = certTags[CERT_SIG].data;
+    fields->delegationPublicKey = delegationTags[DELEGATION_PUBK].data;
+    fields->srepSignature = messageTags[MESSAGE_SIG].data;
+    fields->rootHash = srepTags[SREP_ROOT].data;
+    craggy_memcpy(&fields->index, messageTags[MESSAGE_INDX].data, sizeof(uint32_t));
+    fields->path = messageTags[MESSAGE_PATH].data;
+    fields->pathLen = messageTags[MESSAGE_PATH].len;
+    craggy_memcpy(&fields->midPoint, srepTags[SREP_MIDP].data, sizeof(craggy_rough_time_t));
+    craggy_memcpy(&fields->minTime, delegationTags[DELEGATION_MINT].data, sizeof(craggy_rough_time_t));
+    craggy_memcpy(&fields->maxTime, delegationTags[DELEGATION_MAXT].data, sizeof(craggy_rough_time_t));
+    craggy_memcpy(&fields->radius, srepTags[SREP_RADI].data, sizeof(craggy_rough_time_radius_t));
+
+    *result = CraggyResultSuccess;
+    goto exit;
+
+error:
+    assert(*result != CraggyResultSuccess);
+
+exit:
+    return *result == CraggyResultSuccess;
+}
+
+static bool craggy_parseResponse(const craggy_rough_time_response_t *response, size_t responseLen, CraggyResponseFields *fields, CraggyResult *result) {
+    CRAGGY_STATS_START(start);
+    const bool parsed = craggy_parseResponseFields(response, responseLen, fields, result);
+    CRAGGY_STATS_RECORD(CraggyStageParse, start);
+    return parsed;
+}
+
+static bool craggy_lookupResponseDelegation(const craggy_rough_time_public_key_t rootPublicKey, CraggyDelegationCache *cache, CraggyResponseState *state, CraggyResult *result) {
+
+    state->delegationCached = false;
+    state->delegationLoaded = false;
+    state->delegationKey = NULL;
+
+    if (cache != NULL) {
+        if (!craggy_calculateSHA512(state->fields.delegation, state->fields.delegationLen, state->delegationHash)) {
+            *result = CraggyResultInternalError;
+            return false;
+        }
+        const CraggyDelegation *delegation = craggy_lookupDelegation(cache, rootPublicKey, state->delegationHash);
+        if (delegation != NULL) {
+            state->delegationCached = true;
+            state->delegationKey = delegation->preparedPublicKey;
+        } else {
+            // Verified by another cache sharing the store.  The cache is left as it is until the response verifies:
+            // storing now could release keys that responses looked up before this one are still to be verified with.
+            CraggyDelegation loaded;
+            state->delegationLoaded = craggy_loadDelegation(cache, rootPublicKey, state->delegationHash, &loaded);
+            state->delegationCached = state->delegationLoaded;
+        }
     }
-    if (!craggy_hasTag(srepMessage, CRAGGY_TAG_ROOT) || !craggy_hasTag(srepMessage, CRAGGY_TAG_MIDP) || !craggy_hasTag(srepMessage, CRAGGY_TAG_RADI)) {
-        ERROR_OCCURRED(CraggyResultParseErrorMissingTags);
+    return true;
+}
+
+/** Checks what costs no signature to check - steps 1 and 2 - so that a forged or stale response is rejected before
+ * any signature is verified.  Only the nonce being in the tree and the midpoint being in bounds are trusted once both
+ * signatures are valid too. */
+static bool craggy_checkResponse(const craggy_rough_time_nonce_t nonce, const CraggyResponseFields *fields, CraggyResult *result) {
+
+    /** 1. Verify that the nonce from the request is included in the Merkle tree, the path and index being consistent. */
+
+    CRAGGY_PROBE1(verify_merkle__start, fields->pathLen / CRAGGY_ROUGH_TIME_HASH_LENGTH);
+    CRAGGY_STATS_START(start);
+    const bool included = craggy_verifyMerklePath(nonce, fields->index, fields->path, fields->pathLen, fields->rootHash, result);
+    CRAGGY_STATS_RECORD(CraggyStageMerklePath, start);
+    CRAGGY_PROBE1(verify_merkle__done, included);
+    if (!included) {
+        return false;
+    }
+
+    /** 2. Verify that the midpoint is within the valid bounds of the delegation. */
+
+    if (fields->midPoint < fields->minTime || fields->midPoint > fields->maxTime) {
+        // A cached delegation is kept all the same: the response is not authenticated and a forged one must not evict
+        // it.  Expired delegations are left to the caller's craggy_evictExpiredDelegations.
+        *result = CraggyResultAuthenticationPublicKeyUsageOutOfBounds;
+        return false;
     }
+    return true;
+}
+
+/** Completes verification of a response that passed all checks and whose signatures have been verified - step 5. */
+static bool craggy_finishResponse(const craggy_rough_time_public_key_t rootPublicKey, CraggyDelegationCache *cache, const CraggyResponseState *state, CraggyResult *result, craggy_rough_time_t *outTime, craggy_rough_time_radius_t *outRadius) {
 
-    // At this point we should have all the tags validated (not for length though)
-    assert(srepMessage != NULL && delegationMessage != NULL);
+    const CraggyResponseFields *fields = &state->fields;
 
-    /** 1. Verify the signature in the certificate of the delegation message. */
-    if (!craggy_getFixedLenTag(certMessage, &signature, CRAGGY_TAG_SIG, CRAGGY_ROUGH_TIME_SIGNATURE_LENGTH)) {
-        ERROR_OCCURRED(CraggyResultParseErrorTagSizeMismatch);
+    if (cache != NULL && (!state->delegationCached || state->delegationLoaded)) {
+        CraggyDelegation delegation;
+        craggy_memcpy(delegation.rootPublicKey, rootPublicKey, CRAGGY_ROUGH_TIME_PUBLIC_KEY_LENGTH);
+        craggy_memcpy(delegation.delegationHash, state->delegationHash, CRAGGY_ROUGH_TIME_HASH_LENGTH);
+        craggy_memcpy(delegation.delegationPublicKey, fields->delegationPublicKey, CRAGGY_ROUGH_TIME_PUBLIC_KEY_LENGTH);
+        delegation.preparedPublicKey = NULL;
+        delegation.minTime = fields->minTime;
+        delegation.maxTime = fields->maxTime;
+        craggy_storeDelegation(cache, &delegation);
     }
 
-    if (!craggy_verifySignatureWithContext(rootPublicKey, "RoughTime v1 delegation signature--", signature, craggy_getMessageBuffer(delegationMessage), craggy_getMessageBufferSize(delegationMessage))) {
-        ERROR_OCCURRED(CraggyResultAuthenticationSignatureError);
+    /** 5. Return the midpoint and radius. */
+
+    *outRadius = fields->radius;
+    *outTime = fields->midPoint;
+    *result = CraggyResultSuccess;
+    return true;
+}
+
+bool craggy_responseIncludesNonce(const uint8_t *nonce, const craggy_rough_time_response_t *response, size_t responseLen, CraggyResult *result) {
+
+    CraggyResponseFields fields;
+    if (!craggy_parseResponse(response, responseLen, &fields, result)) {
+        return false;
     }
+    return craggy_verifyMerklePath(nonce, fields.index, fields.path, fields.pathLen, fields.rootHash, result);
+}
 
-    /** 2. Verify the top-level signature of the signed response message using the public key from the delegation. */
+bool craggy_getResponseMerkleRoot(const craggy_rough_time_response_t *response, size_t responseLen, const uint8_t **root, size_t *depth, CraggyResult *result) {
 
-    if (!craggy_getFixedLenTag(delegationMessage, &delegationPublicKey, CRAGGY_TAG_PUBK, CRAGGY_ROUGH_TIME_PUBLIC_KEY_LENGTH)) {
-        ERROR_OCCURRED(CraggyResultParseErrorTagSizeMismatch);
+    CraggyResponseFields fields;
+    if (!craggy_parseResponse(response, responseLen, &fields, result)) {
+        return false;
     }
-    if (!craggy_getFixedLenTag(message, &signature, CRAGGY_TAG_SIG, CRAGGY_ROUGH_TIME_SIGNATURE_LENGTH)) {
-        ERROR_OCCURRED(CraggyResultParseErrorTagSizeMismatch);
+    if (fields.pathLen % CRAGGY_ROUGH_TIME_HASH_LENGTH != 0) {
+        *result = CraggyResultParseErrorTagSizeMismatch;
+        return false;
     }
+    *root = fields.rootHash;
+    *depth = fields.pathLen / CRAGGY_ROUGH_TIME_HASH_LENGTH;
+    return true;
+}
+
+bool craggy_processResponse(craggy_rough_time_nonce_t nonce, craggy_rough_time_public_key_t rootPublicKey, craggy_rough_time_response_t *response, size_t responseLen, CraggyResult *result, craggy_rough_time_t *outTime, craggy_rough_time_radius_t *outRadius) {
+    return craggy_processResponseWithCache(nonce, rootPublicKey, NULL, response, responseLen, result, outTime, outRadius);
+}
+
+/** Verifies a response, the delegation with the prepared root key if there is one. */
+static bool craggy_verifyResponseWithKey(craggy_rough_time_nonce_t nonce, craggy_rough_time_public_key_t rootPublicKey, const CraggyPublicKey *preparedRootKey, CraggyDelegationCache *cache, craggy_rough_time_response_t *response, size_t responseLen, CraggyResult *result, craggy_rough_time_t *outTime, craggy_rough_time_radius_t *outRadius) {
+
+    *result = CraggyResultGeneralError;
+
+/**
+    1. Verify that the nonce from the request is included in the Merkle tree.
+    2. Verify that the midpoint is within the valid bounds of the delegation.
+    3. Verify the signature in the certificate of the delegation message.
+    4. Verify the top-level signature of the signed response message using the public key from the delegation.
+    5. Return the midpoint and radius.
+
+    The signatures, by far the most expensive, are verified last.
+ */
+
+    CraggyResponseState state;
 
-    if (!craggy_verifySignatureWithContext(delegationPublicKey, "RoughTime v1 response signature", signature, craggy_getMessageBuffer(srepMessage), craggy_getMessageBufferSize(srepMessage))) {
-        ERROR_OCCURRED(CraggyResultAuthenticationSignatureError);
+    if (!craggy_parseResponse(response, responseLen, &state.fields, result) ||
+        !craggy_checkResponse(nonce, &state.fields, result)) {
+        return false;
     }
 
-    /** 3. Verify that the nonce from the request is included in the Merkle tree. */
+    /** 3. Verify the signature in the certificate of the delegation message - unless this exact delegation has been verified before. */
 
-    if (!craggy_getFixedLenTag(srepMessage, &rootHash, CRAGGY_TAG_ROOT, CRAGGY_ROUGH_TIME_HASH_LENGTH)) {
-        ERROR_OCCURRED(CraggyResultParseErrorTagSizeMismatch);
+    if (!craggy_lookupResponseDelegation(rootPublicKey, cache, &state, result)) {
+        return false;
     }
 
-    if (!craggy_getFixedLenTag(message, &nestedData, CRAGGY_TAG_INDX, sizeof(uint32_t))) {
-        ERROR_OCCURRED(CraggyResultParseErrorTagSizeMismatch);
+    if (!state.delegationCached) {
+        CRAGGY_PROBE(verify_delegation__start);
+        CRAGGY_STATS_START(delegationStart);
+        const bool delegationValid = craggy_verifySignatureWithContext(rootPublicKey, preparedRootKey, CRAGGY_DELEGATION_CONTEXT, state.fields.delegationSignature, state.fields.delegation, state.fields.delegationLen);
+        CRAGGY_STATS_RECORD(CraggyStageDelegationVerify, delegationStart);
+        CRAGGY_PROBE1(verify_delegation__done, delegationValid);
+        if (!delegationValid) {
+            *result = CraggyResultAuthenticationSignatureError;
+            return false;
+        }
     }
-    craggy_memcpy(&index, nestedData, sizeof(uint32_t));
 
-    if (!craggy_getTag(message, &nestedData, &nestedDataSize, CRAGGY_TAG_PATH)) {
-        ERROR_OCCURRED(CraggyResultParseError);
+    /** 4. Verify the top-level signature of the signed response message using the public key from the delegation. */
+
+    CRAGGY_PROBE(verify_response__start);
+    CRAGGY_STATS_START(responseStart);
+    const bool responseValid = craggy_verifySignatureWithContext(state.fields.delegationPublicKey, state.delegationKey, CRAGGY_RESPONSE_CONTEXT, state.fields.srepSignature, state.fields.srep, state.fields.srepLen);
+    CRAGGY_STATS_RECORD(CraggyStageResponseVerify, responseStart);
+    CRAGGY_PROBE1(verify_response__done, responseValid);
+    if (!responseValid) {
+        *result = CraggyResultAuthenticationSignatureError;
+        return false;
     }
-    assert((nestedDataSize & (uint32_t) CRAGGY_ROUGH_TIME_HASH_LENGTH) == 0);
 
-    uint8_t hash[CRAGGY_ROUGH_TIME_HASH_LENGTH];
-    uint8_t scratch[CRAGGY_ROUGH_TIME_HASH_LENGTH + CRAGGY_ROUGH_TIME_HASH_LENGTH + 1];
+    return craggy_finishResponse(rootPublicKey, cache, &state, result, outTime, outRadius);
+}
 
-    HASH_LEAF(hash, scratch, nonce);
+/** Processes a response, verifying the delegation with the prepared root key if there is one. */
+static bool craggy_processResponseWithKey(craggy_rough_time_nonce_t nonce, craggy_rough_time_public_key_t rootPublicKey, const CraggyPublicKey *preparedRootKey, CraggyDelegationCache *cache, craggy_rough_time_response_t *response, size_t responseLen, CraggyResult *result, craggy_rough_time_t *outTime, craggy_rough_time_radius_t *outRadius) {
+    CRAGGY_PROBE1(process_response__entry, responseLen);
+    const bool verified = craggy_verifyResponseWithKey(nonce, rootPublicKey, preparedRootKey, cache, response, responseLen, result, outTime, outRadius);
+    CRAGGY_PROBE1(process_response__return, *result);
+    return verified;
+}
 
-    while (nestedDataSize > 0) {
-        const bool isRight = (index & (uint32_t )1);
-        if (isRight) {
-            HASH_NODE(hash, scratch, hash, nestedData);
-        } else {
-            HASH_NODE(hash, scratch, nestedData, hash);
+bool craggy_processResponseWithCache(craggy_rough_time_nonce_t nonce, craggy_rough_time_public_key_t rootPublicKey, CraggyDelegationCache *cache, craggy_rough_time_response_t *response, size_t responseLen, CraggyResult *result, craggy_rough_time_t *outTime, craggy_rough_time_radius_t *outRadius) {
+    return craggy_processResponseWithKey(nonce, rootPublicKey, NULL, cache, response, responseLen, result, outTime, outRadius);
+}
+
+bool craggy_processResponses(CraggyServerResponse *responses, size_t numResponses, CraggyDelegationCache *cache) {
+
+    bool success = false;
+
+    CraggyResponseState *states = craggy_calloc(numResponses, sizeof(CraggyResponseState));
+    // At most two signatures per response - the delegation and the signed response
+    CraggySignatureBatchEntry *signatures = craggy_calloc(2 * numResponses, sizeof(CraggySignatureBatchEntry));
+    uint8_t *signedData = NULL;
+
+    if (states == NULL || signatures == NULL) {
+        for (size_t i = 0; i < numResponses; i++) {
+            responses[i].result = CraggyResultInternalError;
         }
-        index >>= (uint32_t) 1;
-        nestedDataSize -= CRAGGY_ROUGH_TIME_HASH_LENGTH;
-        nestedData += CRAGGY_ROUGH_TIME_HASH_LENGTH;
+        goto exit;
     }
 
-    assert(nestedDataSize == 0);
+    size_t signedDataLen = 0;
+    for (size_t i = 0; i < numResponses; i++) {
+        CraggyServerResponse *response = &responses[i];
+        if (!craggy_parseResponse(response->response, response->responseLen, &states[i].fields, &response->result) ||
+            !craggy_checkResponse(response->nonce, &states[i].fields, &response->result) ||
+            !craggy_lookupResponseDelegation(response->rootPublicKey, cache, &states[i], &response->result)) {
+            continue;
+        }
+        response->result = CraggyResultGeneralError;
+        if (!states[i].delegationCached) {
+            signedDataLen += craggy_signedDataLen(CRAGGY_DELEGATION_CONTEXT, states[i].fields.delegationLen);
+        }
+        signedDataLen += craggy_signedDataLen(CRAGGY_RESPONSE_CONTEXT, states[i].fields.srepLen);
+    }
 
-    if (craggy_memcmp(rootHash, hash, CRAGGY_ROUGH_TIME_HASH_LENGTH) != 0) {
-        ERROR_OCCURRED(CraggyResultAuthenticationHashError);
+    signedData = craggy_malloc(signedDataLen > 0 ? signedDataLen : 1);
+    if (signedData == NULL) {
+        for (size_t i = 0; i < numResponses; i++) {
+            responses[i].result = CraggyResultInternalError;
+        }
+        goto exit;
     }
 
-    /** 4. Verify that the midpoint is within the valid bounds of the delegation. */
+    /** 3. & 4. Gather the delegation and response signatures of all responses and verify them in one go. */
 
-    craggy_rough_time_t midPoint;
-    if (!craggy_getFixedLenTag(srepMessage, &nestedData, CRAGGY_TAG_MIDP, sizeof(craggy_rough_time_t))) {
-        ERROR_OCCURRED(CraggyResultParseErrorTagSizeMismatch);
+    size_t numSignatures = 0;
+    uint8_t *nextSignedData = signedData;
+    for (size_t i = 0; i < numResponses; i++) {
+        if (responses[i].result != CraggyResultGeneralError) {
+            continue;
+        }
+        const CraggyResponseFields *fields = &states[i].fields;
+        CraggySignatureBatchEntry *entry;
+
+        if (!states[i].delegationCached) {
+            entry = &signatures[numSignatures++];
+            entry->publicKey = responses[i].rootPublicKey;
+            entry->signature = fields->delegationSignature;
+            entry->msg = nextSignedData;
+            entry->msgLen = craggy_signedDataLen(CRAGGY_DELEGATION_CONTEXT, fields->delegationLen);
+            craggy_writeSignedData(nextSignedData, CRAGGY_DELEGATION_CONTEXT, fields->delegation, fields->delegationLen);
+            nextSignedData += entry->msgLen;
+        }
+
+        entry = &signatures[numSignatures++];
+        entry->publicKey = fields->delegationPublicKey;
+        entry->preparedKey = states[i].delegationKey;
+        entry->signature = fields->srepSignature;
+        entry->msg = nextSignedData;
+        entry->msgLen = craggy_signedDataLen(CRAGGY_RESPONSE_CONTEXT, fields->srepLen);
+        craggy_writeSignedData(nextSignedData, CRAGGY_RESPONSE_CONTEXT, fields->srep, fields->srepLen);
+        nextSignedData += entry->msgLen;
     }
-    craggy_memcpy(&midPoint, nestedData, sizeof(craggy_rough_time_t));
 
-    craggy_rough_time_t minTime;
-    if (!craggy_getFixedLenTag(delegationMessage, &nestedData, CRAGGY_TAG_MINT, sizeof(craggy_rough_time_t))) {
-        ERROR_OCCURRED(CraggyResultParseErrorTagSizeMismatch);
+    craggy_verifySignatureBatch(signatures, numSignatures);
+
+    /** 5. Complete the responses whose signatures are all valid. */
+
+    size_t nextSignature = 0;
+    success = true;
+    for (size_t i = 0; i < numResponses; i++) {
+        CraggyServerResponse *response = &responses[i];
+        if (response->result != CraggyResultGeneralError) {
+            success = false;
+            continue;
+        }
+
+        bool signaturesValid = true;
+        if (!states[i].delegationCached) {
+            signaturesValid = signatures[nextSignature++].valid;
+        }
+        signaturesValid = signatures[nextSignature++].valid && signaturesValid;
+
+        if (!signaturesValid) {
+            response->result = CraggyResultAuthenticationSignatureError;
+            success = false;
+            continue;
+        }
+
+        if (!craggy_finishResponse(response->rootPublicKey, cache, &states[i], &response->result, &response->time, &response->radius)) {
+            success = false;
+        }
     }
-    craggy_memcpy(&minTime, nestedData, sizeof(craggy_rough_time_t));
 
-    craggy_rough_time_t maxTime;
-    if (!craggy_getFixedLenTag(delegationMessage, &nestedData, CRAGGY_TAG_MAXT, sizeof(craggy_rough_time_t))) {
-        ERROR_OCCURRED(CraggyResultParseErrorTagSizeMismatch);
+exit:
+    craggy_free(signedData);
+    craggy_free(signatures);
+    craggy_free(states);
+
+    return success;
+}
+
+bool craggy_createBatchRequest(const CraggyMerkleTree *tree, craggy_rough_time_request_t requestBuf) {
+    // The root of the batch tree goes out as the nonce of a single request
+    craggy_rough_time_nonce_t batchNonce;
+    craggy_memcpy(batchNonce, craggy_getMerkleRoot(tree), CRAGGY_ROUGH_TIME_NONCE_LENGTH);
+    return craggy_createRequest(batchNonce, requestBuf);
+}
+
+bool craggy_processBatchResponse(const CraggyMerkleTree *tree, craggy_rough_time_public_key_t rootPublicKey, CraggyDelegationCache *cache, craggy_rough_time_response_t *responseBuf, size_t responseBufLen, CraggyResult *result, craggy_rough_time_t *time, craggy_rough_time_radius_t *radius) {
+    craggy_rough_time_nonce_t batchNonce;
+    craggy_memcpy(batchNonce, craggy_getMerkleRoot(tree), CRAGGY_ROUGH_TIME_NONCE_LENGTH);
+    return craggy_processResponseWithCache(batchNonce, rootPublicKey, cache, responseBuf, responseBufLen, result, time, radius);
+}
+
+bool craggy_processBatchMemberResponse(craggy_rough_time_nonce_t nonce, uint32_t batchIndex, const uint8_t *batchPath, size_t batchPathLen, craggy_rough_time_public_key_t rootPublicKey, craggy_rough_time_response_t *responseBuf, size_t responseBufLen, CraggyResult *result, craggy_rough_time_t *time, craggy_rough_time_radius_t *radius) {
+    craggy_rough_time_nonce_t batchNonce;
+    if (!craggy_computeMerkleRoot(nonce, batchIndex, batchPath, batchPathLen, batchNonce, result)) {
+        return false;
     }
-    craggy_memcpy(&maxTime, nestedData, sizeof(craggy_rough_time_t));
+    return craggy_processResponse(batchNonce, rootPublicKey, responseBuf, responseBufLen, result, time, radius);
+}
+
+struct CraggyRootKeySet {
+    size_t numKeys;
+    craggy_rough_time_public_key_t *publicKeys;
+    CraggyPublicKey **preparedKeys;
+};
+
+bool craggy_createRootKeySet(const craggy_rough_time_public_key_t *rootPublicKeys, size_t numKeys, CraggyRootKeySet **keys, CraggyResult *result) {
+
+    *result = CraggyResultGeneralError;
 
-    if (midPoint < minTime || midPoint > maxTime) {
-        ERROR_OCCURRED(CraggyResultAuthenticationPublicKeyUsageOutOfBounds)
+    *keys = craggy_calloc(1, sizeof(CraggyRootKeySet));
+    if (*keys == NULL) {
+        ERROR_OCCURRED(CraggyResultInternalError);
     }
 
-    /** 5. Return the midpoint and radius. */
+    (*keys)->publicKeys = craggy_calloc(numKeys > 0 ? numKeys : 1, sizeof(craggy_rough_time_public_key_t));
+    (*keys)->preparedKeys = craggy_calloc(numKeys > 0 ? numKeys : 1, sizeof(CraggyPublicKey *));
+    if ((*keys)->publicKeys == NULL || (*keys)->preparedKeys == NULL) {
+        ERROR_OCCURRED(CraggyResultInternalError);
+    }
 
-    if (!craggy_getFixedLenTag(srepMessage, &nestedData, CRAGGY_TAG_RADI, sizeof(craggy_rough_time_radius_t)))
-    {
-        ERROR_OCCURRED(CraggyResultParseErrorTagSizeMismatch);
+    for (size_t i = 0; i < numKeys; i++) {
+        if (!craggy_publicKeyPrepare(rootPublicKeys[i], &(*keys)->preparedKeys[i])) {
+            ERROR_OCCURRED(CraggyResultInternalError);
+        }
+        craggy_memcpy((*keys)->publicKeys[i], rootPublicKeys[i], CRAGGY_ROUGH_TIME_PUBLIC_KEY_LENGTH);
+        (*keys)->numKeys++;
     }
 
-    craggy_memcpy(outRadius, nestedData, sizeof(craggy_rough_time_radius_t));
-    craggy_memcpy(outTime, &midPoint, sizeof(craggy_rough_time_t));
     *result = CraggyResultSuccess;
     goto exit;
 
 error:
-    assert(*result != CraggyResultSuccess);
+    craggy_destroyRootKeySet(*keys);
+    *keys = NULL;
 
 exit:
+    return *result == CraggyResultSuccess;
+}
+
+static const CraggyPublicKey *craggy_findRootKey(const CraggyRootKeySet *keys, const craggy_rough_time_public_key_t rootPublicKey) {
+    if (keys != NULL) {
+        for (size_t i = 0; i < keys->numKeys; i++) {
+            if (craggy_memcmp(keys->publicKeys[i], rootPublicKey, CRAGGY_ROUGH_TIME_PUBLIC_KEY_LENGTH) == 0) {
+                return keys->preparedKeys[i];
+            }
+        }
+    }
+    return NULL;
+}
+
+void craggy_destroyRootKeySet(CraggyRootKeySet *keys) {
+    if (keys != NULL) {
+        for (size_t i = 0; i < keys->numKeys; i++) {
+            craggy_publicKeyRelease(keys->preparedKeys[i]);
+        }
+        craggy_free(keys->preparedKeys);
+        craggy_free(keys->publicKeys);
+    }
+    craggy_free(keys);
+}
+
+struct CraggyClientContext {
+    const CraggyRootKeySet *rootKeys;
+    CraggyDelegationCache *cache;
+    // NULL to use whatever allocator the calling thread has
+    const CraggyAllocator *allocator;
+};
+
+bool craggy_createClientContext(const CraggyRootKeySet *rootKeys, size_t cacheCapacity, const CraggyAllocator *allocator, CraggyClientContext **context, CraggyResult *result) {
+
+    *result = CraggyResultGeneralError;
+
+    // Everything the context owns comes from its own allocator, the context itself included
+    const CraggyAllocator *threadAllocator = allocator != NULL ? craggy_setThreadAllocator(allocator) : NULL;
+
+    *context = craggy_calloc(1, sizeof(CraggyClientContext));
+    if (*context == NULL) {
+        ERROR_OCCURRED(CraggyResultInternalError);
+    }
+    (*context)->rootKeys = rootKeys;
+    (*context)->allocator = allocator;
 
-    craggy_destroyMessage(delegationMessage);
-    craggy_destroyMessage(certMessage);
-    craggy_destroyMessage(srepMessage);
-    craggy_destroyMessage(message);
+    if (cacheCapacity > 0 && !craggy_createDelegationCache(cacheCapacity, &(*context)->cache)) {
+        ERROR_OCCURRED(CraggyResultInternalError);
+    }
+
+    *result = CraggyResultSuccess;
+    goto exit;
+
+error:
+    craggy_free(*context);
+    *context = NULL;
 
+exit:
+    if (allocator != NULL) {
+        craggy_setThreadAllocator(threadAllocator);
+    }
     return *result == CraggyResultSuccess;
+}
+
+CraggyDelegationCache *craggy_getClientContextCache(CraggyClientContext *context) {
+    return context->cache;
+}
 
+bool craggy_contextGenerateNonces(CraggyClientContext *context, craggy_rough_time_nonce_t *nonces, size_t numNonces, CraggyResult *result) {
+    (void) context;
+    // The entropy pool behind the nonces is per thread already, see craggy_fillRandomBytes
+    return craggy_generateNonces(result, nonces, numNonces);
+}
+
+bool craggy_contextProcessResponse(CraggyClientContext *context, craggy_rough_time_nonce_t nonce, craggy_rough_time_public_key_t rootPublicKey, craggy_rough_time_response_t *response, size_t responseLen, CraggyResult *result, craggy_rough_time_t *outTime, craggy_rough_time_radius_t *outRadius) {
+
+    const CraggyAllocator *threadAllocator = context->allocator != NULL ? craggy_setThreadAllocator(context->allocator) : NULL;
+
+    bool success = craggy_processResponseWithKey(nonce, rootPublicKey, craggy_findRootKey(context->rootKeys, rootPublicKey), context->cache, response, responseLen, result, outTime, outRadius);
+
+    if (context->allocator != NULL) {
+        craggy_setThreadAllocator(threadAllocator);
+    }
+    return success;
+}
+
+void craggy_destroyClientContext(CraggyClientContext *context) {
+    if (context != NULL) {
+        // The cache releases its memory through the allocator it was created with
+        craggy_destroyDelegationCache(context->cache);
+        craggy_releaseThreadCryptoState();
+
+        const CraggyAllocator *allocator = context->allocator;
+        const CraggyAllocator *threadAllocator = allocator != NULL ? craggy_setThreadAllocator(allocator) : NULL;
+        craggy_free(context);
+        if (allocator != NULL) {
+            craggy_setThreadAllocator(threadAllocator);
+        }
+    }
 }
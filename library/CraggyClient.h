@@ -21,6 +21,27 @@
 #include <stdlib.h>
 
 #include "CraggyTypes.h"
+#include "CraggyDelegationCache.h"
+#include "CraggyMerkle.h"
+#include "CraggyAllocator.h"
+
+/** Offset of the nonce in a request.  NONC sorts after PAD and VER, so its data comes last. */
+#define CRAGGY_ROUGH_TIME_REQUEST_NONCE_OFFSET (CRAGGY_ROUGH_TIME_MIN_REQUEST_SIZE - CRAGGY_ROUGH_TIME_NONCE_LENGTH)
+
+/** Lays out a request with an all zero nonce, to be reused for any number of requests by replacing the nonce only -
+ * using {@link craggy_setRequestNonce}, or by writing it in place at {@link CRAGGY_ROUGH_TIME_REQUEST_NONCE_OFFSET}.
+ *
+ * @param requestBuf Buffer for the request
+ * @return True if the request creation was successful, otherwise false
+ */
+bool craggy_createRequestTemplate(craggy_rough_time_request_t requestBuf);
+
+/** Replaces the nonce of a request created by {@link craggy_createRequestTemplate} or {@link craggy_createRequest}.
+ *
+ * @param requestBuf Request to update
+ * @param nonce The nonce to include in the request
+ */
+void craggy_setRequestNonce(craggy_rough_time_request_t requestBuf, const craggy_rough_time_nonce_t nonce);
 
 /** Creates a new Roughtime request message containing the specified nonce.
  *
@@ -44,6 +65,118 @@ bool craggy_createRequest(craggy_rough_time_nonce_t nonce, craggy_rough_time_req
  */
 bool craggy_processResponse(craggy_rough_time_nonce_t nonce, craggy_rough_time_public_key_t rootPublicKey, craggy_rough_time_response_t *responseBuf, size_t responseBufLen, CraggyResult *result, craggy_rough_time_t *time, craggy_rough_time_radius_t *radius);
 
+/** Processes a response from the server as {@link craggy_processResponse} does, using the delegation cache specified to
+ * skip the certificate signature verification for delegations that have already been verified.  Delegations verified
+ * as part of this call, or found in the second tier the cache is backed with, are added to the cache.  A response whose
+ * midpoint lies outside the validity window of its delegation is rejected, but leaves the cached delegation in place -
+ * the response is not authenticated, and a forged one must not evict it.  Expired delegations stay in the cache until
+ * least recently used, unless the caller removes them using {@link craggy_evictExpiredDelegations} - as the daemon
+ * does before each poll.
+ *
+ * @param nonce The nonce originally used for creating the request
+ * @param rootPublicKey Root public key of the server in question
+ * @param cache Delegation cache to use, or NULL for no caching
+ * @param responseBuf Response to be processed
+ * @param responseBufLen Size of the response to be processed
+ * @param result Result of response processing
+ * @param time Time reported by the server
+ * @param radius Radius reported by the server
+ * @return True if the response was successfully processed, otherwise false and {@link result} will signal the error
+ */
+bool craggy_processResponseWithCache(craggy_rough_time_nonce_t nonce, craggy_rough_time_public_key_t rootPublicKey, CraggyDelegationCache *cache, craggy_rough_time_response_t *responseBuf, size_t responseBufLen, CraggyResult *result, craggy_rough_time_t *time, craggy_rough_time_radius_t *radius);
+
+/** Checks whether a response is one to the nonce specified, by parsing it and verifying only that the nonce is
+ * included in its Merkle tree.  No signatures are verified - a match still has to be processed in full.
+ *
+ * @param nonce The nonce to check for
+ * @param responseBuf Response to check
+ * @param responseBufLen Size of the response
+ * @param result Result of the check
+ * @return True if the response includes the nonce, otherwise false and {@link result} will signal why not
+ */
+bool craggy_responseIncludesNonce(const uint8_t *nonce, const craggy_rough_time_response_t *responseBuf, size_t responseBufLen, CraggyResult *result);
+
+/** Finds the root of the Merkle tree of a response and the depth of the nonce in it, for telling which request a
+ * response is for without trying nonces.  A response to a request the server did not batch with others has a path of
+ * depth zero, its root being {@link craggy_hashMerkleLeaf} of the nonce.  Nothing is verified.
+ *
+ * @param responseBuf Response to look into
+ * @param responseBufLen Size of the response
+ * @param root Root of the tree, pointing into the response
+ * @param depth Number of hashes in the path from the nonce to the root
+ * @param result Result of parsing the response
+ * @return True if the response parsed, otherwise false and {@link result} will signal why not
+ */
+bool craggy_getResponseMerkleRoot(const craggy_rough_time_response_t *responseBuf, size_t responseBufLen, const uint8_t **root, size_t *depth, CraggyResult *result);
+
+/** A response from one server, as processed by {@link craggy_processResponses}. */
+typedef struct {
+    /** The nonce originally used for creating the request */
+    const uint8_t *nonce;
+    /** Root public key of the server in question */
+    const uint8_t *rootPublicKey;
+    /** Response to be processed */
+    const craggy_rough_time_response_t *response;
+    /** Size of the response to be processed */
+    size_t responseLen;
+    /** Result of response processing */
+    CraggyResult result;
+    /** Time reported by the server, if successful */
+    craggy_rough_time_t time;
+    /** Radius reported by the server, if successful */
+    craggy_rough_time_radius_t radius;
+} CraggyServerResponse;
+
+/** Processes responses from several servers at once.  The signatures of all responses are verified together
+ * using {@link craggy_verifySignatureBatch}, which is cheaper than verifying each response on its own.
+ *
+ * @param responses Responses to process; the result, time and radius of each are filled in
+ * @param numResponses Number of responses
+ * @param cache Delegation cache to use, or NULL for no caching
+ * @return True if all responses were successfully processed, otherwise false and the result of each response will signal any error
+ */
+bool craggy_processResponses(CraggyServerResponse *responses, size_t numResponses, CraggyDelegationCache *cache);
+
+/** Creates a single request covering a whole batch of nonces - the root of the batch tree is sent as the nonce.
+ *
+ * @param tree Tree built over the nonces of the batch, see {@link craggy_createMerkleTree}
+ * @param requestBuf Buffer for the request
+ * @return True if the request creation was successful, otherwise false
+ */
+bool craggy_createBatchRequest(const CraggyMerkleTree *tree, craggy_rough_time_request_t requestBuf);
+
+/** Processes the response to a batch request.  If successful, the time and radius apply to every nonce in the batch;
+ * each member can be handed its index and path ({@link craggy_getMerklePath}) along with the response as proof.
+ *
+ * @param tree Tree the batch request was created from
+ * @param rootPublicKey Root public key of the server in question
+ * @param cache Delegation cache to use, or NULL for no caching
+ * @param responseBuf Response to be processed
+ * @param responseBufLen Size of the response to be processed
+ * @param result Result of response processing
+ * @param time Time reported by the server
+ * @param radius Radius reported by the server
+ * @return True if the response was successfully processed, otherwise false and {@link result} will signal the error
+ */
+bool craggy_processBatchResponse(const CraggyMerkleTree *tree, craggy_rough_time_public_key_t rootPublicKey, CraggyDelegationCache *cache, craggy_rough_time_response_t *responseBuf, size_t responseBufLen, CraggyResult *result, craggy_rough_time_t *time, craggy_rough_time_radius_t *radius);
+
+/** Processes a batch response on behalf of one member of the batch, verifying that its nonce is included in the batch
+ * tree and that the batch root is included in the server response.
+ *
+ * @param nonce The nonce of the batch member
+ * @param batchIndex Index of the nonce in the batch tree
+ * @param batchPath Path from the nonce up to the batch root
+ * @param batchPathLen Length of the path in bytes
+ * @param rootPublicKey Root public key of the server in question
+ * @param responseBuf Response to be processed
+ * @param responseBufLen Size of the response to be processed
+ * @param result Result of response processing
+ * @param time Time reported by the server
+ * @param radius Radius reported by the server
+ * @return True if the response was successfully processed, otherwise false and {@link result} will signal the error
+ */
+bool craggy_processBatchMemberResponse(craggy_rough_time_nonce_t nonce, uint32_t batchIndex, const uint8_t *batchPath, size_t batchPathLen, craggy_rough_time_public_key_t rootPublicKey, craggy_rough_time_response_t *responseBuf, size_t responseBufLen, CraggyResult *result, craggy_rough_time_t *time, craggy_rough_time_radius_t *radius);
+
 /** Generates a new nonce value, placing it in the nonce specified.
  *
  * @param result Result of the nonce creation
@@ -52,4 +185,90 @@ bool craggy_processResponse(craggy_rough_time_nonce_t nonce, craggy_rough_time_p
  */
 bool craggy_generateNonce(CraggyResult *result, craggy_rough_time_nonce_t nonce);
 
+/** Generates several nonces at once.
+ *
+ * @param result Result of the nonce creation
+ * @param nonces Nonces to place the generated values in
+ * @param numNonces Number of nonces
+ * @return True if successful, otherwise false and {@link result} will indicate the error
+ */
+bool craggy_generateNonces(CraggyResult *result, craggy_rough_time_nonce_t *nonces, size_t numNonces);
+
+/** Root public keys prepared once for verification.  Immutable once created, so any number of threads may share a
+ * set, and the contexts using it, read-only.
+ */
+typedef struct CraggyRootKeySet CraggyRootKeySet;
+
+/** Prepares the root public keys of the servers to be queried.
+ *
+ * @param rootPublicKeys Root public keys
+ * @param numKeys Number of keys
+ * @param keys Set created
+ * @param result Result of the operation
+ * @return True if successful, otherwise false and {@link result} will indicate the error
+ */
+bool craggy_createRootKeySet(const craggy_rough_time_public_key_t *rootPublicKeys, size_t numKeys, CraggyRootKeySet **keys, CraggyResult *result);
+
+/**
+ *
+ * @param keys
+ */
+void craggy_destroyRootKeySet(CraggyRootKeySet *keys);
+
+/** Everything one thread needs to verify responses without locking: a delegation cache of its own, an optional
+ * allocator and the shared root keys.  The digest contexts of the crypto backend and the entropy pool behind nonces
+ * are kept per thread by the backend itself.  A context is not thread safe - use one per thread.
+ */
+typedef struct CraggyClientContext CraggyClientContext;
+
+/** Creates a context for the calling thread.
+ *
+ * @param rootKeys Prepared root keys, shared with other contexts, or NULL if none.  Must outlive the context.
+ * @param cacheCapacity Number of delegations to cache, 0 for no caching
+ * @param allocator Allocator for everything the context does, or NULL for that of the calling thread.  Must outlive the context.
+ * @param context Context created
+ * @param result Result of the operation
+ * @return True if successful, otherwise false and {@link result} will indicate the error
+ */
+bool craggy_createClientContext(const CraggyRootKeySet *rootKeys, size_t cacheCapacity, const CraggyAllocator *allocator, CraggyClientContext **context, CraggyResult *result);
+
+/**
+ *
+ * @param context
+ * @return Delegation cache of the context, NULL if it has none
+ */
+CraggyDelegationCache *craggy_getClientContextCache(CraggyClientContext *context);
+
+/** As {@link craggy_generateNonces}, on behalf of the context.
+ *
+ * @param context Context of the calling thread
+ * @param nonces Nonces to place the generated values in
+ * @param numNonces Number of nonces
+ * @param result Result of the nonce creation
+ * @return True if successful, otherwise false and {@link result} will indicate the error
+ */
+bool craggy_contextGenerateNonces(CraggyClientContext *context, craggy_rough_time_nonce_t *nonces, size_t numNonces, CraggyResult *result);
+
+/** As {@link craggy_processResponseWithCache}, using the cache and allocator of the context and its prepared form of
+ * the root key, if the root key is one of its set.
+ *
+ * @param context Context of the calling thread
+ * @param nonce The nonce originally used for creating the request
+ * @param rootPublicKey Root public key of the server in question
+ * @param responseBuf Response to be processed
+ * @param responseBufLen Size of the response to be processed
+ * @param result Result of response processing
+ * @param time Time reported by the server
+ * @param radius Radius reported by the server
+ * @return True if the response was successfully processed, otherwise false and {@link result} will signal the error
+ */
+bool craggy_contextProcessResponse(CraggyClientContext *context, craggy_rough_time_nonce_t nonce, craggy_rough_time_public_key_t rootPublicKey, craggy_rough_time_response_t *responseBuf, size_t responseBufLen, CraggyResult *result, craggy_rough_time_t *time, craggy_rough_time_radius_t *radius);
+
+/** Destroys a context, releasing the crypto state the backend keeps for the calling thread as well (see
+ * {@link craggy_releaseThreadCryptoState}).
+ *
+ * @param context
+ */
+void craggy_destroyClientContext(CraggyClientContext *context);
+
 #endif //CRAGGY_CRAGGYCLIENT_H
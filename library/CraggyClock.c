@@ -0,0 +1,306 @@
+/* Copyright 2020 Johan Lindquist
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <assert.h>
+#include <math.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#if defined(__x86_64__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
+
+#include "CraggyClock.h"
+
+#define ERROR_OCCURRED(x) *result = x; goto error;
+
+/** How long the counter is measured against CLOCK_MONOTONIC */
+#define CRAGGY_CLOCK_CALIBRATION_MS 20
+
+/** Reads of the clock bracketed by counter reads; the tightest bracket is kept */
+#define CRAGGY_CLOCK_SAMPLE_TRIES 8
+
+/** How often the counter is anchored to CLOCK_MONOTONIC afresh, following the slewing of the clock and the drift of
+ * the counter against it */
+#define CRAGGY_CLOCK_ANCHOR_INTERVAL_MS 1000
+
+/** Most the rate of the conversion is steered off that measured, closing on CLOCK_MONOTONIC by the next anchoring, in
+ * parts per million.  Further apart than that, the conversion steps forward to the clock. */
+#define CRAGGY_CLOCK_MAX_STEER_PPM 500
+
+#if defined(__x86_64__) || defined(__aarch64__)
+#define CRAGGY_HAVE_COUNTER
+#endif
+
+typedef struct {
+    CraggyCounterConversion conversion;
+    // Counter and the time it converts to, timestamps are taken relative to them
+    uint64_t baseTicks;
+    uint64_t baseNs;
+    // Ticks past the base by which the counter is due to be anchored again
+    uint64_t anchorTicks;
+} CraggyClockState;
+
+static CraggyClockState clockState;
+// Odd while the state is published, readers retry until they see the same even value before and after
+static _Atomic uint32_t clockSequence;
+// Held by the thread anchoring the counter, the others carry on with the state as it is
+static atomic_flag anchoring = ATOMIC_FLAG_INIT;
+// Counter and CLOCK_MONOTONIC as read at the last anchoring, the rate of the counter is measured from them.  Only
+// touched holding anchoring.
+static uint64_t anchorTicks;
+static uint64_t anchorNs;
+static atomic_bool useCounter;
+
+static uint64_t craggy_clockGettimeNs(clockid_t clock) {
+    struct timespec now;
+    clock_gettime(clock, &now);
+    return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+#if defined(CRAGGY_HAVE_COUNTER)
+
+static inline uint64_t craggy_readCounter(void) {
+#if defined(__x86_64__)
+    return __rdtsc();
+#else
+    uint64_t ticks;
+    __asm__ __volatile__("isb; mrs %0, cntvct_el0" : "=r"(ticks));
+    return ticks;
+#endif
+}
+
+/* A counter stopping in sleep states or changing rate with the CPU frequency is no clock */
+static bool craggy_counterIsInvariant(void) {
+#if defined(__x86_64__)
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx)) {
+        return false;
+    }
+    return (edx & (1u << 8)) != 0;
+#else
+    // The ARM generic timer runs at a fixed frequency
+    return true;
+#endif
+}
+
+/* Reads CLOCK_MONOTONIC along with the counter at the same moment, as nearly as the bracketing reads allow. */
+static void craggy_sampleClock(uint64_t *ticks, uint64_t *ns) {
+    uint64_t bestWindow = UINT64_MAX;
+    for (int i = 0; i < CRAGGY_CLOCK_SAMPLE_TRIES; i++) {
+        const uint64_t before = craggy_readCounter();
+        const uint64_t clockNs = craggy_clockGettimeNs(CLOCK_MONOTONIC);
+        const uint64_t after = craggy_readCounter();
+        if (after - before < bestWindow) {
+            bestWindow = after - before;
+            *ticks = before + (after - before) / 2;
+            *ns = clockNs;
+        }
+    }
+}
+
+static uint64_t craggy_ticksToNs(const CraggyCounterConversion *conversion, uint64_t ticks) {
+    return (ticks >> conversion->remainderBits) * conversion->nsPerModulus +
+           (((ticks & conversion->remainderMask) * conversion->mult) >> conversion->shift);
+}
+
+static void craggy_makeConversion(double nsPerTick, CraggyCounterConversion *conversion) {
+    conversion->shift = 32;
+    conversion->mult = (uint64_t) llround(nsPerTick * 4294967296.0);
+
+    // As many remainder bits as the product with the multiplier has room for
+    int multBits = 0;
+    while (multBits < 64 && (conversion->mult >> multBits) != 0) {
+        multBits++;
+    }
+    conversion->remainderBits = 63 - multBits;
+    conversion->remainderMask = ((uint64_t) 1 << conversion->remainderBits) - 1;
+    conversion->nsPerModulus = (uint64_t) llround(ldexp(nsPerTick, conversion->remainderBits));
+    conversion->ticksPerSecond = (uint64_t) llround(1e9 / nsPerTick);
+}
+
+static void craggy_publishClockState(const CraggyClockState *state) {
+    const uint32_t sequence = atomic_load_explicit(&clockSequence, memory_order_relaxed);
+    atomic_store_explicit(&clockSequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    clockState = *state;
+    atomic_store_explicit(&clockSequence, sequence + 2, memory_order_release);
+}
+
+static void craggy_readClockState(CraggyClockState *state) {
+    uint32_t before, after;
+    do {
+        before = atomic_load_explicit(&clockSequence, memory_order_acquire);
+        *state = clockState;
+        atomic_thread_fence(memory_order_acquire);
+        after = atomic_load_explicit(&clockSequence, memory_order_relaxed);
+    } while ((before & 1U) != 0 || before != after);
+}
+
+static uint64_t craggy_anchorIntervalTicks(const CraggyCounterConversion *conversion) {
+    return conversion->ticksPerSecond * CRAGGY_CLOCK_ANCHOR_INTERVAL_MS / 1000;
+}
+
+/* Anchors the counter to CLOCK_MONOTONIC afresh: the rate of the counter is measured since the last anchoring, and
+ * steered for the time converted to meet the clock by the next one.  The time converted carries on from where it was,
+ * never stepping back.  Whichever thread finds the anchoring due does it, the others go on without waiting. */
+static void craggy_anchorCounter(void) {
+
+    if (atomic_flag_test_and_set_explicit(&anchoring, memory_order_acquire)) {
+        return;
+    }
+
+    CraggyClockState state;
+    craggy_readClockState(&state);
+    uint64_t ticks, ns;
+    craggy_sampleClock(&ticks, &ns);
+    // Anchored by another thread since this one found it due
+    if (ticks <= state.baseTicks || ticks - state.baseTicks < state.anchorTicks) {
+        atomic_flag_clear_explicit(&anchoring, memory_order_release);
+        return;
+    }
+
+    double nsPerTick = 1e9 / (double) state.conversion.ticksPerSecond;
+    if (ticks > anchorTicks && ns > anchorNs) {
+        nsPerTick = (double) (ns - anchorNs) / (double) (ticks - anchorTicks);
+    }
+
+    const uint64_t convertedNs = state.baseNs + craggy_ticksToNs(&state.conversion, ticks - state.baseTicks);
+    const double intervalNs = CRAGGY_CLOCK_ANCHOR_INTERVAL_MS * 1e6;
+    const double maxSteer = CRAGGY_CLOCK_MAX_STEER_PPM * 1e-6;
+    double steer = ((double) ns - (double) convertedNs) / intervalNs;
+    state.baseNs = convertedNs;
+    if (steer > maxSteer) {
+        // Too far behind to catch up by steering, the timestamps skip ahead to the clock
+        state.baseNs = ns;
+        steer = 0;
+    }
+    steer = fmax(-maxSteer, fmin(maxSteer, steer));
+
+    craggy_makeConversion(nsPerTick * (1 + steer), &state.conversion);
+    state.baseTicks = ticks;
+    state.anchorTicks = craggy_anchorIntervalTicks(&state.conversion);
+    craggy_publishClockState(&state);
+
+    anchorTicks = ticks;
+    anchorNs = ns;
+    atomic_flag_clear_explicit(&anchoring, memory_order_release);
+}
+
+#endif
+
+bool craggy_clockUseConversion(const CraggyCounterConversion *conversion, CraggyResult *result) {
+
+    *result = CraggyResultGeneralError;
+
+#if defined(CRAGGY_HAVE_COUNTER)
+    if (conversion->remainderBits <= 0 || conversion->remainderBits >= 64 || conversion->shift < 0 || conversion->shift >= 64) {
+        ERROR_OCCURRED(CraggyResultGeneralError);
+    }
+
+    // Waits for an anchoring under way, the conversion given replaces the one it would publish
+    while (atomic_flag_test_and_set_explicit(&anchoring, memory_order_acquire)) {
+    }
+
+    CraggyClockState state;
+    state.conversion = *conversion;
+    craggy_sampleClock(&state.baseTicks, &state.baseNs);
+    state.anchorTicks = craggy_anchorIntervalTicks(conversion);
+    craggy_publishClockState(&state);
+    anchorTicks = state.baseTicks;
+    anchorNs = state.baseNs;
+    atomic_store_explicit(&useCounter, true, memory_order_release);
+
+    atomic_flag_clear_explicit(&anchoring, memory_order_release);
+
+    *result = CraggyResultSuccess;
+    goto exit;
+#else
+    (void) conversion;
+    ERROR_OCCURRED(CraggyResultGeneralError);
+#endif
+
+error:
+    assert(*result != CraggyResultSuccess);
+
+exit:
+    return *result == CraggyResultSuccess;
+}
+
+bool craggy_clockCalibrate(CraggyResult *result) {
+
+    *result = CraggyResultGeneralError;
+
+#if defined(CRAGGY_HAVE_COUNTER)
+    if (!craggy_counterIsInvariant()) {
+        ERROR_OCCURRED(CraggyResultGeneralError);
+    }
+
+    uint64_t startTicks, startNs, endTicks, endNs;
+    craggy_sampleClock(&startTicks, &startNs);
+    const struct timespec interval = {0, CRAGGY_CLOCK_CALIBRATION_MS * 1000000L};
+    nanosleep(&interval, NULL);
+    craggy_sampleClock(&endTicks, &endNs);
+
+    if (endNs <= startNs || endTicks <= startTicks) {
+        ERROR_OCCURRED(CraggyResultGeneralError);
+    }
+    const double ticksPerSecond = (double) (endTicks - startTicks) * 1e9 / (double) (endNs - startNs);
+    // Anything outside 1 MHz to 10 GHz is not a clock this conversion is meant for
+    if (ticksPerSecond < 1e6 || ticksPerSecond > 1e10) {
+        ERROR_OCCURRED(CraggyResultGeneralError);
+    }
+
+    CraggyCounterConversion conversion;
+    craggy_makeConversion(1e9 / ticksPerSecond, &conversion);
+    return craggy_clockUseConversion(&conversion, result);
+#else
+    ERROR_OCCURRED(CraggyResultGeneralError);
+#endif
+
+error:
+    assert(*result != CraggyResultSuccess);
+    return false;
+}
+
+bool craggy_clockUsesCounter(void) {
+    return atomic_load_explicit(&useCounter, memory_order_relaxed);
+}
+
+uint64_t craggy_monotonicNs(void) {
+#if defined(CRAGGY_HAVE_COUNTER)
+    if (atomic_load_explicit(&useCounter, memory_order_acquire)) {
+        CraggyClockState state;
+        craggy_readClockState(&state);
+        const uint64_t ticks = craggy_readCounter();
+        // Counters of different cores may be a few ticks apart, never go back past the base for it
+        const uint64_t elapsed = ticks > state.baseTicks ? ticks - state.baseTicks : 0;
+        if (elapsed >= state.anchorTicks) {
+            craggy_anchorCounter();
+        }
+        return state.baseNs + craggy_ticksToNs(&state.conversion, elapsed);
+    }
+#endif
+    return craggy_clockGettimeNs(CLOCK_MONOTONIC);
+}
+
+uint64_t craggy_monotonicUs(void) {
+    return craggy_monotonicNs() / 1000;
+}
+
+craggy_rough_time_t craggy_realtimeUs(void) {
+    return craggy_clockGettimeNs(CLOCK_REALTIME) / 1000;
+}
@@ -0,0 +1,71 @@
+/* Copyright 2020 Johan Lindquist
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CRAGGY_CRAGGYCLOCK_H
+#define CRAGGY_CRAGGYCLOCK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "CraggyTypes.h"
+
+/** Conversion of counter ticks to nanoseconds, without overflow for any number of ticks:
+ * (ticks >> remainderBits) * nsPerModulus + (((ticks & remainderMask) * mult) >> shift).  The same parameters as
+ * wtmlib's wtmlib_TSCConversionParams_t, so a conversion calibrated by wtmlib can be handed over field by field. */
+typedef struct {
+    uint64_t mult;
+    int shift;
+    uint64_t nsPerModulus;
+    int remainderBits;
+    uint64_t remainderMask;
+    uint64_t ticksPerSecond;
+} CraggyCounterConversion;
+
+/** Calibrates the CPU's time-stamp counter (cntvct_el0 on ARM) against CLOCK_MONOTONIC, taking about
+ * {@link CRAGGY_CLOCK_CALIBRATION_MS} milliseconds.  From then on {@link craggy_monotonicNs} and
+ * {@link craggy_monotonicUs} read the counter rather than calling clock_gettime, anchoring it to CLOCK_MONOTONIC afresh
+ * every second or so - the counter's rate is measured again and the conversion steered to follow the clock, slewed as
+ * it may be, within a few microseconds.  May be called again at any time.
+ *
+ * @param result CraggyResultGeneralError if the platform has no counter that runs at a constant rate
+ * @return True if the counter is used from now on, otherwise false and timestamps keep coming from clock_gettime
+ */
+bool craggy_clockCalibrate(CraggyResult *result);
+
+/** Like {@link craggy_clockCalibrate}, with a conversion calibrated elsewhere - by wtmlib's cross-CPU checks, say.  The
+ * conversion is used until the counter is first anchored again, its rate measured afresh from then on.
+ *
+ * @param conversion Conversion of the counter of this platform to nanoseconds
+ * @param result CraggyResultGeneralError if the platform has no counter or the conversion is not usable
+ * @return True if the counter is used from now on, otherwise false
+ */
+bool craggy_clockUseConversion(const CraggyCounterConversion *conversion, CraggyResult *result);
+
+/** @return True if timestamps are taken from the calibrated counter */
+bool craggy_clockUsesCounter(void);
+
+/** @return Current time of the monotonic clock in nanoseconds */
+uint64_t craggy_monotonicNs(void);
+
+/** @return Current time of the monotonic clock in microseconds */
+uint64_t craggy_monotonicUs(void);
+
+/** Always clock_gettime - a counter calibrated once would not follow adjustments of the realtime clock.
+ *
+ * @return Current time of the realtime clock in microseconds from the epoch
+ */
+craggy_rough_time_t craggy_realtimeUs(void);
+
+#endif //CRAGGY_CRAGGYCLOCK_H
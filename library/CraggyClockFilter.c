@@ -0,0 +1,158 @@
+/* Copyright 2020 Johan Lindquist
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <math.h>
+
+#include "CraggyClockFilter.h"
+
+#include "CraggyOS.h"
+
+/** Bisection steps finding the next poll, narrowing it to a billionth of the range of intervals */
+#define CRAGGY_CLOCK_FILTER_SEARCH_STEPS 30
+
+void craggy_clockFilterInit(CraggyClockFilter *filter, double driftNoise) {
+    craggy_memset(filter, 0, sizeof(CraggyClockFilter));
+    filter->driftNoise = driftNoise;
+}
+
+/* Starts over from a single sample, knowing nothing of the drift. */
+static void craggy_clockFilterRestart(CraggyClockFilter *filter, int64_t offset, double variance, uint64_t monotonic) {
+    filter->initialised = true;
+    filter->lastUpdate = monotonic;
+    filter->base = offset;
+    filter->offset = 0;
+    filter->drift = 0;
+    filter->covariance[0][0] = variance;
+    filter->covariance[0][1] = filter->covariance[1][0] = 0;
+    filter->covariance[1][1] = (double) CRAGGY_CLOCK_FILTER_MAX_DRIFT * CRAGGY_CLOCK_FILTER_MAX_DRIFT;
+    filter->numOutliers = 0;
+}
+
+static double craggy_elapsedSeconds(const CraggyClockFilter *filter, uint64_t monotonic) {
+    return monotonic > filter->lastUpdate ? (double) (monotonic - filter->lastUpdate) / 1e6 : 0;
+}
+
+/* Covariance after dt seconds without a sample: the offset moves by the drift, which itself wanders as a random walk. */
+static void craggy_clockFilterPropagate(const CraggyClockFilter *filter, double dt, double covariance[2][2]) {
+    const double q = filter->driftNoise;
+    const double p00 = filter->covariance[0][0];
+    const double p01 = filter->covariance[0][1];
+    const double p11 = filter->covariance[1][1];
+
+    covariance[0][0] = p00 + 2 * dt * p01 + dt * dt * p11 + q * dt * dt * dt / 3;
+    covariance[0][1] = covariance[1][0] = p01 + dt * p11 + q * dt * dt / 2;
+    covariance[1][1] = p11 + q * dt;
+}
+
+/* Tells if an outlier agrees with the one before it, as far as a clock drifting by no more than the kernel slews it
+ * could have moved in between. */
+static bool craggy_outlierAgrees(const CraggyClockFilter *filter, int64_t offset, double variance, uint64_t monotonic) {
+
+    if (filter->numOutliers == 0) {
+        return false;
+    }
+    const double dt = monotonic > filter->outlierUpdate ? (double) (monotonic - filter->outlierUpdate) / 1e6 : 0;
+    const double difference = (double) (offset - filter->outlierOffset);
+    const double driftVariance = (double) CRAGGY_CLOCK_FILTER_MAX_DRIFT * CRAGGY_CLOCK_FILTER_MAX_DRIFT * dt * dt;
+    const double differenceVariance = filter->outlierVariance + variance + driftVariance;
+    return difference * difference <= CRAGGY_CLOCK_FILTER_OUTLIER * CRAGGY_CLOCK_FILTER_OUTLIER * differenceVariance;
+}
+
+CraggyClockFilterOutcome craggy_clockFilterUpdate(CraggyClockFilter *filter, int64_t offset, uint64_t uncertainty, uint64_t monotonic) {
+
+    const double variance = (double) uncertainty * uncertainty;
+    if (!filter->initialised) {
+        craggy_clockFilterRestart(filter, offset, variance, monotonic);
+        return CraggyClockFilterAccepted;
+    }
+
+    const double dt = craggy_elapsedSeconds(filter, monotonic);
+    double predicted[2][2];
+    craggy_clockFilterPropagate(filter, dt, predicted);
+    const double predictedOffset = filter->offset + filter->drift * dt;
+
+    const double innovation = (double) (offset - filter->base) - predictedOffset;
+    const double innovationVariance = predicted[0][0] + variance;
+    if (innovation * innovation > CRAGGY_CLOCK_FILTER_OUTLIER * CRAGGY_CLOCK_FILTER_OUTLIER * innovationVariance) {
+        // A single server off, or a bad round trip, is left out; a clock stepped keeps disagreeing the same way
+        filter->numOutliers = craggy_outlierAgrees(filter, offset, variance, monotonic) ? filter->numOutliers + 1 : 1;
+        filter->outlierOffset = offset;
+        filter->outlierVariance = variance;
+        filter->outlierUpdate = monotonic;
+        filter->rejected++;
+        if (filter->numOutliers < CRAGGY_CLOCK_FILTER_RESTART_OUTLIERS) {
+            return CraggyClockFilterRejected;
+        }
+        craggy_clockFilterRestart(filter, offset, variance, monotonic);
+        return CraggyClockFilterRestarted;
+    }
+    filter->numOutliers = 0;
+
+    const double gainOffset = predicted[0][0] / innovationVariance;
+    const double gainDrift = predicted[0][1] / innovationVariance;
+    filter->offset = predictedOffset + gainOffset * innovation;
+    filter->drift += gainDrift * innovation;
+    filter->covariance[0][0] = (1 - gainOffset) * predicted[0][0];
+    filter->covariance[0][1] = filter->covariance[1][0] = (1 - gainOffset) * predicted[0][1];
+    filter->covariance[1][1] = predicted[1][1] - gainDrift * predicted[0][1];
+    filter->lastUpdate = monotonic;
+    return CraggyClockFilterAccepted;
+}
+
+void craggy_clockFilterPredict(const CraggyClockFilter *filter, uint64_t monotonic, int64_t *offset, uint64_t *uncertainty, double *drift) {
+
+    const double dt = craggy_elapsedSeconds(filter, monotonic);
+    double predicted[2][2];
+    craggy_clockFilterPropagate(filter, dt, predicted);
+
+    *offset = filter->base + llround(filter->offset + filter->drift * dt);
+    *uncertainty = (uint64_t) ceil(sqrt(predicted[0][0]));
+    if (drift != NULL) {
+        *drift = filter->drift;
+    }
+}
+
+double craggy_clockFilterNextPoll(const CraggyClockFilter *filter, uint64_t maxUncertainty, double minInterval, double maxInterval) {
+
+    if (!filter->initialised) {
+        return minInterval;
+    }
+
+    const double maxVariance = (double) maxUncertainty * maxUncertainty;
+    double predicted[2][2];
+
+    craggy_clockFilterPropagate(filter, minInterval, predicted);
+    if (predicted[0][0] >= maxVariance) {
+        return minInterval;
+    }
+    craggy_clockFilterPropagate(filter, maxInterval, predicted);
+    if (predicted[0][0] <= maxVariance) {
+        return maxInterval;
+    }
+
+    // Beyond the shortest interval the variance grows with time, the drift outweighing all else, so bisection finds it
+    double shorter = minInterval;
+    double longer = maxInterval;
+    for (int i = 0; i < CRAGGY_CLOCK_FILTER_SEARCH_STEPS; i++) {
+        const double interval = (shorter + longer) / 2;
+        craggy_clockFilterPropagate(filter, interval, predicted);
+        if (predicted[0][0] <= maxVariance) {
+            shorter = interval;
+        } else {
+            longer = interval;
+        }
+    }
+    return shorter;
+}
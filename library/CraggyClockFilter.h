@@ -0,0 +1,116 @@
+/* Copyright 2020 Johan Lindquist
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CRAGGY_CRAGGYCLOCKFILTER_H
+#define CRAGGY_CRAGGYCLOCKFILTER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/** Variance the drift of a free running quartz clock wanders by, in ppm² per second: about 0.01 ppm over a quarter of
+ * an hour */
+#define CRAGGY_CLOCK_FILTER_DRIFT_NOISE 1e-7
+
+/** Drift assumed of a clock before a second sample tells, in ppm - the most the kernel slews a clock by */
+#define CRAGGY_CLOCK_FILTER_MAX_DRIFT 500
+
+/** Samples further off the prediction than this many of its standard deviations are rejected as outliers */
+#define CRAGGY_CLOCK_FILTER_OUTLIER 5
+
+/** Consecutive outliers, each agreeing with the one before, that restart the filter from the last of them - the clock
+ * having been stepped or its rate changed rather than a server being off */
+#define CRAGGY_CLOCK_FILTER_RESTART_OUTLIERS 3
+
+/** What became of a sample added to a filter. */
+typedef enum {
+    /** The sample agreed with the prediction and narrowed the estimate */
+    CraggyClockFilterAccepted,
+    /** The sample was too far off the prediction and left the estimate alone */
+    CraggyClockFilterRejected,
+    /** The sample was the last of {@link CRAGGY_CLOCK_FILTER_RESTART_OUTLIERS} agreeing outliers and restarted the
+     * filter */
+    CraggyClockFilterRestarted
+} CraggyClockFilterOutcome;
+
+/** Kalman filter over the offset of a clock and its drift, sampled against the monotonic clock.  Every sample narrows
+ * the estimate, and between samples the uncertainty grows as fast as the drift is known to - which tells a client
+ * how long it can go without asking the servers again. */
+typedef struct {
+    bool initialised;
+    /** Monotonic clock of the last sample, in microseconds */
+    uint64_t lastUpdate;
+    /** Offset of the first sample, the state being relative to it so that doubles hold it exactly, in microseconds */
+    int64_t base;
+    /** Offset at the last sample less base, in microseconds */
+    double offset;
+    /** Drift of the offset, in ppm */
+    double drift;
+    /** Covariance of offset and drift */
+    double covariance[2][2];
+    /** Variance the drift wanders by, in ppm² per second */
+    double driftNoise;
+    /** Outliers since the last sample accepted, each agreeing with the one before */
+    unsigned numOutliers;
+    /** Offset of the last of them, in microseconds */
+    int64_t outlierOffset;
+    /** Variance of the last of them */
+    double outlierVariance;
+    /** Monotonic clock of the last of them, in microseconds */
+    uint64_t outlierUpdate;
+    /** Outliers rejected since the filter was set up */
+    uint64_t rejected;
+} CraggyClockFilter;
+
+/** Sets up a filter without samples.
+ *
+ * @param filter Filter to set up
+ * @param driftNoise Variance the drift wanders by, in ppm² per second, {@link CRAGGY_CLOCK_FILTER_DRIFT_NOISE} unless
+ * the clock is known to be better or worse
+ */
+void craggy_clockFilterInit(CraggyClockFilter *filter, double driftNoise);
+
+/** Adds a sample.
+ *
+ * @param filter Filter set up using {@link craggy_clockFilterInit}
+ * @param offset Offset measured, in microseconds
+ * @param uncertainty Uncertainty of the offset, in microseconds, taken as its standard deviation - the radius plus half
+ * the round trip of a {@link CraggyTimeSample}
+ * @param monotonic Monotonic clock when the offset was measured, in microseconds
+ * @return What became of the sample
+ */
+CraggyClockFilterOutcome craggy_clockFilterUpdate(CraggyClockFilter *filter, int64_t offset, uint64_t uncertainty, uint64_t monotonic);
+
+/** Predicts the offset at a moment after the last sample.
+ *
+ * @param filter Filter with at least one sample
+ * @param monotonic Monotonic clock of the moment, in microseconds
+ * @param offset Offset predicted, in microseconds
+ * @param uncertainty Standard deviation of the offset predicted, in microseconds
+ * @param drift Drift estimated, in ppm, or NULL
+ */
+void craggy_clockFilterPredict(const CraggyClockFilter *filter, uint64_t monotonic, int64_t *offset, uint64_t *uncertainty, double *drift);
+
+/** Tells when to sample next for the uncertainty of the prediction to stay within a bound.
+ *
+ * @param filter Filter set up using {@link craggy_clockFilterInit}
+ * @param maxUncertainty Largest uncertainty accepted, in microseconds
+ * @param minInterval Shortest interval returned, in seconds
+ * @param maxInterval Longest interval returned, in seconds
+ * @return Seconds from the last sample until the uncertainty exceeds the bound, within the limits given -
+ * minInterval if the filter has no samples
+ */
+double craggy_clockFilterNextPoll(const CraggyClockFilter *filter, uint64_t maxUncertainty, double minInterval, double maxInterval);
+
+#endif //CRAGGY_CRAGGYCLOCKFILTER_H
@@ -0,0 +1,102 @@
+/* Copyright 2020 Johan Lindquist
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+
+#include "CraggyConsensus.h"
+
+#include "CraggyOS.h"
+
+#define ERROR_OCCURRED(x) *result = x; goto error;
+
+typedef struct {
+    int64_t value;
+    // +1 where an interval starts, -1 where one ends
+    int type;
+} CraggyIntervalEdge;
+
+static int craggy_compareEdges(const void *a, const void *b) {
+    const CraggyIntervalEdge *edgeA = a;
+    const CraggyIntervalEdge *edgeB = b;
+    if (edgeA->value != edgeB->value) {
+        return edgeA->value < edgeB->value ? -1 : 1;
+    }
+    // Starts before ends, so intervals just touching count as intersecting
+    return edgeB->type - edgeA->type;
+}
+
+void craggy_makeTimeSample(craggy_rough_time_t time, craggy_rough_time_radius_t radius, uint64_t roundTripTime, craggy_rough_time_t receivedAt, CraggyTimeSample *sample) {
+    // The server read its clock somewhere between sending and receiving - halfway on a symmetric path
+    sample->offset = (int64_t) (time + roundTripTime / 2) - (int64_t) receivedAt;
+    sample->uncertainty = radius + roundTripTime / 2;
+}
+
+bool craggy_findConsensus(const CraggyTimeSample *samples, size_t numSamples, size_t minAgreeing, CraggyConsensus *consensus, CraggyResult *result) {
+
+    *result = CraggyResultGeneralError;
+
+    consensus->offset = 0;
+    consensus->uncertainty = 0;
+    consensus->numAgreeing = 0;
+
+    CraggyIntervalEdge *edges = NULL;
+
+    if (numSamples == 0) {
+        ERROR_OCCURRED(CraggyResultConsensusError);
+    }
+
+    edges = craggy_calloc(2 * numSamples, sizeof(CraggyIntervalEdge));
+    if (edges == NULL) {
+        ERROR_OCCURRED(CraggyResultInternalError);
+    }
+
+    for (size_t i = 0; i < numSamples; i++) {
+        edges[2 * i].value = samples[i].offset - (int64_t) samples[i].uncertainty;
+        edges[2 * i].type = 1;
+        edges[2 * i + 1].value = samples[i].offset + (int64_t) samples[i].uncertainty;
+        edges[2 * i + 1].type = -1;
+    }
+    qsort(edges, 2 * numSamples, sizeof(CraggyIntervalEdge), craggy_compareEdges);
+
+    size_t count = 0;
+    int64_t low = 0;
+    int64_t high = 0;
+    for (size_t i = 0; i < 2 * numSamples; i++) {
+        if (edges[i].type < 0) {
+            count--;
+            continue;
+        }
+        count++;
+        if (count > consensus->numAgreeing) {
+            // Every start is followed by at least its own end
+            consensus->numAgreeing = count;
+            low = edges[i].value;
+            high = edges[i + 1].value;
+        }
+    }
+
+    consensus->offset = low + (high - low) / 2;
+    consensus->uncertainty = (uint64_t) (high - low) / 2;
+
+    if (consensus->numAgreeing < minAgreeing) {
+        ERROR_OCCURRED(CraggyResultConsensusError);
+    }
+
+    *result = CraggyResultSuccess;
+
+error:
+    craggy_free(edges);
+    return *result == CraggyResultSuccess;
+}
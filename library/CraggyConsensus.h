@@ -0,0 +1,65 @@
+/* Copyright 2020 Johan Lindquist
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef CRAGGY_CRAGGYCONSENSUS_H
+#define CRAGGY_CRAGGYCONSENSUS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "CraggyTypes.h"
+
+/** The offset of a server's time from the local clock, as measured by one request. */
+typedef struct {
+    /** Server time minus local time, in microseconds */
+    int64_t offset;
+    /** Largest error of the offset, in microseconds - the radius of the response plus half the round trip, as the
+     * path to the server may be anything but symmetric */
+    uint64_t uncertainty;
+} CraggyTimeSample;
+
+/** The offset agreed on by a set of samples. */
+typedef struct {
+    /** Midpoint of the largest intersection of sample intervals, in microseconds */
+    int64_t offset;
+    /** Half the width of that intersection, in microseconds */
+    uint64_t uncertainty;
+    /** Number of samples whose intervals contain the intersection */
+    size_t numAgreeing;
+} CraggyConsensus;
+
+/** Builds a sample from a verified response.
+ *
+ * @param time Midpoint of the response
+ * @param radius Radius of the response
+ * @param roundTripTime Time from sending the request to receiving the response, in microseconds
+ * @param receivedAt Local realtime clock when the response arrived, in microseconds from the epoch
+ * @param sample Resulting sample
+ */
+void craggy_makeTimeSample(craggy_rough_time_t time, craggy_rough_time_radius_t radius, uint64_t roundTripTime, craggy_rough_time_t receivedAt, CraggyTimeSample *sample);
+
+/** Finds the offset most samples agree on using Marzullo's algorithm: the intersection of the intervals
+ * offset ± uncertainty contained in the largest number of samples.  Samples that do not overlap it are falsetickers.
+ *
+ * @param samples Samples, at least one
+ * @param numSamples Number of samples
+ * @param minAgreeing Number of samples that have to agree for a consensus, usually a majority
+ * @param consensus The consensus found, set even if fewer than {@link minAgreeing} samples agree
+ * @param result Result of the operation
+ * @return True if at least {@link minAgreeing} samples agree, otherwise false and {@link result} will indicate the error
+ */
+bool craggy_findConsensus(const CraggyTimeSample *samples, size_t numSamples, size_t minAgreeing, CraggyConsensus *consensus, CraggyResult *result);
+
+#endif //CRAGGY_CRAGGYCONSENSUS_H
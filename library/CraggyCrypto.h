@@ -33,6 +33,121 @@ extern "C" {
  */
 bool craggy_verifySignature(const craggy_rough_time_public_key_t rootPublicKey, const uint8_t *signature, const uint8_t *msg, size_t msgLen);
 
+/** One piece of a message held in several buffers. */
+typedef struct {
+    const uint8_t *data;
+    size_t len;
+} CraggyMessageSegment;
+
+/** Verifies a signature over the concatenation of the segments specified, without the caller having to copy them
+ * into one buffer.
+ *
+ * @param publicKey Public key to verify with
+ * @param signature Signature to verify
+ * @param segments Segments of the message signed, in order
+ * @param numSegments Number of segments
+ * @return True if the signature is valid, otherwise false
+ */
+bool craggy_verifySignatureSegments(const craggy_rough_time_public_key_t publicKey, const uint8_t *signature, const CraggyMessageSegment *segments, size_t numSegments);
+
+/** A public key parsed once into the form the crypto backend verifies with, see {@link craggy_publicKeyPrepare}. */
+typedef struct CraggyPublicKey CraggyPublicKey;
+
+/** Prepares a public key for repeated verification.  With the ORLP and libsodium backends, verifying with a prepared key
+ * does not allocate; OpenSSL allocates within each verification all the same.
+ *
+ * @param publicKey Raw Ed25519 public key
+ * @param key Prepared key
+ * @return True if successful, otherwise false
+ */
+bool craggy_publicKeyPrepare(const craggy_rough_time_public_key_t publicKey, CraggyPublicKey **key);
+
+/** Verifies a signature using a prepared public key.  Safe to call from several threads using the same key.
+ *
+ * @param key Key prepared using {@link craggy_publicKeyPrepare}
+ * @param signature Signature to verify
+ * @param msg Message signed
+ * @param msgLen Length of the message
+ * @return True if the signature is valid, otherwise false
+ */
+bool craggy_verifyPreparedSignature(const CraggyPublicKey *key, const uint8_t *signature, const uint8_t *msg, size_t msgLen);
+
+/** As {@link craggy_verifySignatureSegments}, using a prepared public key.
+ *
+ * @param key Key prepared using {@link craggy_publicKeyPrepare}
+ * @param signature Signature to verify
+ * @param segments Segments of the message signed, in order
+ * @param numSegments Number of segments
+ * @return True if the signature is valid, otherwise false
+ */
+bool craggy_verifyPreparedSignatureSegments(const CraggyPublicKey *key, const uint8_t *signature, const CraggyMessageSegment *segments, size_t numSegments);
+
+/**
+ *
+ * @param key
+ */
+void craggy_publicKeyRelease(CraggyPublicKey *key);
+
+/** Length of the seed an Ed25519 private key is derived from. */
+#define CRAGGY_ROUGH_TIME_PRIVATE_KEY_SEED_LENGTH 32
+
+/** A private key for signing, as needed by servers (and tests) rather than clients. */
+typedef struct CraggyPrivateKey CraggyPrivateKey;
+
+/** Derives a private key and its public key from a seed.
+ *
+ * @param seed Random seed of the key, kept secret
+ * @param key Private key created
+ * @param publicKey Public key of the private key
+ * @return True if successful, otherwise false
+ */
+bool craggy_privateKeyCreate(const uint8_t seed[CRAGGY_ROUGH_TIME_PRIVATE_KEY_SEED_LENGTH], CraggyPrivateKey **key, craggy_rough_time_public_key_t publicKey);
+
+/** Signs the concatenation of the segments specified.  Safe to call from several threads using the same key.
+ *
+ * @param key Key created using {@link craggy_privateKeyCreate}
+ * @param segments Segments of the message to sign, in order
+ * @param numSegments Number of segments
+ * @param signature Resulting signature
+ * @return True if successful, otherwise false
+ */
+bool craggy_signSegments(const CraggyPrivateKey *key, const CraggyMessageSegment *segments, size_t numSegments, uint8_t signature[CRAGGY_ROUGH_TIME_SIGNATURE_LENGTH]);
+
+/**
+ *
+ * @param key
+ */
+void craggy_privateKeyRelease(CraggyPrivateKey *key);
+
+/** Releases what the crypto backend keeps for the calling thread, such as the digest contexts of recently used
+ * prepared keys.  Anything released is set up again when next needed, so it is safe to call at any time; threads
+ * should call it before exiting.
+ */
+void craggy_releaseThreadCryptoState(void);
+
+/** A signature to verify as part of a batch. */
+typedef struct {
+    const uint8_t *publicKey;
+    /** Optional prepared form of {@link publicKey}, NULL if none */
+    const CraggyPublicKey *preparedKey;
+    const uint8_t *signature;
+    const uint8_t *msg;
+    size_t msgLen;
+    /** Set by {@link craggy_verifySignatureBatch} */
+    bool valid;
+} CraggySignatureBatchEntry;
+
+/** Verifies several signatures at once, setting the valid flag of every entry.
+ *
+ * Backends able to do so check the whole batch with a single random linear combination, falling back to checking
+ * signatures one by one only when the batch as a whole fails.
+ *
+ * @param entries Signatures to verify
+ * @param numEntries Number of signatures
+ * @return True if all signatures are valid, otherwise false
+ */
+bool craggy_verifySignatureBatch(CraggySignatureBatchEntry *entries, size_t numEntries);
+
 /**
  *
  * @param msg
@@ -42,6 +157,48 @@ bool craggy_verifySignature(const craggy_rough_time_public_key_t rootPublicKey,
  */
 bool craggy_calculateSHA512(const uint8_t *msg, size_t msgLen, uint8_t hash[CRAGGY_ROUGH_TIME_HASH_LENGTH]);
 
+/** State of an incremental SHA512 calculation.  Large enough for the context of any crypto backend, so it can live on the stack. */
+typedef struct {
+    uint64_t opaque[32];
+} CraggySHA512Context;
+
+/** Starts an incremental SHA512 calculation.
+ *
+ * @param context Context to initialise
+ * @return True if successful, otherwise false
+ */
+bool craggy_initSHA512(CraggySHA512Context *context);
+
+/** Adds data to an incremental SHA512 calculation.
+ *
+ * @param context Context initialised by {@link craggy_initSHA512}
+ * @param msg Data to hash
+ * @param msgLen Length of the data
+ * @return True if successful, otherwise false
+ */
+bool craggy_updateSHA512(CraggySHA512Context *context, const uint8_t *msg, size_t msgLen);
+
+/** Completes an incremental SHA512 calculation.
+ *
+ * @param context Context initialised by {@link craggy_initSHA512}
+ * @param hash Resulting hash
+ * @return True if successful, otherwise false
+ */
+bool craggy_finalSHA512(CraggySHA512Context *context, uint8_t hash[CRAGGY_ROUGH_TIME_HASH_LENGTH]);
+
+/** Calculates the SHA512 of several messages of the same length, each preceded by a prefix byte - the shape of the
+ * leaves and of each level of a Merkle tree.  Where the CPU allows, several messages are hashed at once using vector
+ * instructions (AVX-512 or AVX2 on x86-64, NEON on AArch64), the rest one at a time by the crypto backend.
+ *
+ * @param prefix Byte hashed ahead of every message
+ * @param data Messages, one after the other
+ * @param msgLen Length of each message
+ * @param numMsgs Number of messages
+ * @param hashes Resulting hashes, one per message, not overlapping the messages
+ * @return True if successful, otherwise false
+ */
+bool craggy_calculateSHA512Batch(uint8_t prefix, const uint8_t *data, size_t msgLen, size_t numMsgs, uint8_t (*hashes)[CRAGGY_ROUGH_TIME_HASH_LENGTH]);
+
 /**
  *
  * @param randomBuf
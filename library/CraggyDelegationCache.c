@@ -0,0 +1,178 @@
+/* Copyright 2020 Johan Lindquist
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <memory.h>
+
+#include "CraggyAllocator.h"
+#include "CraggyDelegationCache.h"
+
+#include "CraggyOS.h"
+
+typedef struct {
+    CraggyDelegation delegation;
+    uint64_t lastUsed;
+    bool valid;
+} CraggyDelegationCacheEntry;
+
+struct CraggyDelegationCache {
+    size_t capacity;
+    uint64_t useCounter;
+    CraggyDelegationCacheEntry *entries;
+    // Prepared keys outlive the call storing them, so come from the allocator the cache was created with rather
+    // than whichever is current - which may be an arena reset after every response
+    const CraggyAllocator *allocator;
+    // Store backing the cache, NULL if none
+    const CraggyDelegationStoreOps *storeOps;
+    void *storeContext;
+};
+
+bool craggy_createDelegationCache(size_t capacity, CraggyDelegationCache **cache) {
+
+    if (capacity == 0) {
+        return false;
+    }
+
+    *cache = craggy_calloc(1, sizeof(CraggyDelegationCache));
+    if (*cache == NULL) {
+        return false;
+    }
+
+    (*cache)->entries = craggy_calloc(capacity, sizeof(CraggyDelegationCacheEntry));
+    if ((*cache)->entries == NULL) {
+        craggy_free(*cache);
+        *cache = NULL;
+        return false;
+    }
+    (*cache)->capacity = capacity;
+    (*cache)->allocator = craggy_getAllocator();
+
+    return true;
+}
+
+static void releaseEntry(const CraggyDelegationCache *cache, CraggyDelegationCacheEntry *entry) {
+    const CraggyAllocator *allocator = craggy_setThreadAllocator(cache->allocator);
+    craggy_publicKeyRelease((CraggyPublicKey *) entry->delegation.preparedPublicKey);
+    craggy_setThreadAllocator(allocator);
+    entry->delegation.preparedPublicKey = NULL;
+    entry->valid = false;
+}
+
+static CraggyDelegationCacheEntry *findEntry(CraggyDelegationCache *cache, const craggy_rough_time_public_key_t rootPublicKey) {
+    for (size_t i = 0; i < cache->capacity; i++) {
+        CraggyDelegationCacheEntry *entry = &cache->entries[i];
+        if (entry->valid && craggy_memcmp(entry->delegation.rootPublicKey, rootPublicKey, CRAGGY_ROUGH_TIME_PUBLIC_KEY_LENGTH) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+const CraggyDelegation *craggy_lookupDelegation(CraggyDelegationCache *cache, const craggy_rough_time_public_key_t rootPublicKey, const uint8_t delegationHash[CRAGGY_ROUGH_TIME_HASH_LENGTH]) {
+
+    CraggyDelegationCacheEntry *entry = findEntry(cache, rootPublicKey);
+    if (entry == NULL || craggy_memcmp(entry->delegation.delegationHash, delegationHash, CRAGGY_ROUGH_TIME_HASH_LENGTH) != 0) {
+        return NULL;
+    }
+    entry->lastUsed = ++cache->useCounter;
+    return &entry->delegation;
+}
+
+bool craggy_loadDelegation(const CraggyDelegationCache *cache, const craggy_rough_time_public_key_t rootPublicKey, const uint8_t delegationHash[CRAGGY_ROUGH_TIME_HASH_LENGTH], CraggyDelegation *delegation) {
+    if (cache->storeOps == NULL || !cache->storeOps->load(cache->storeContext, rootPublicKey, delegationHash, delegation)) {
+        return false;
+    }
+    delegation->preparedPublicKey = NULL;
+    return true;
+}
+
+const CraggyDelegation *craggy_findDelegation(CraggyDelegationCache *cache, const craggy_rough_time_public_key_t rootPublicKey) {
+    CraggyDelegationCacheEntry *entry = findEntry(cache, rootPublicKey);
+    return entry != NULL ? &entry->delegation : NULL;
+}
+
+void craggy_storeDelegation(CraggyDelegationCache *cache, const CraggyDelegation *delegation) {
+
+    // Same server, new delegation - replace the one we have
+    CraggyDelegationCacheEntry *entry = findEntry(cache, delegation->rootPublicKey);
+
+    if (entry == NULL) {
+        // Pick a free slot, or failing that, the least recently used one
+        entry = &cache->entries[0];
+        for (size_t i = 0; i < cache->capacity; i++) {
+            if (!cache->entries[i].valid) {
+                entry = &cache->entries[i];
+                break;
+            }
+            if (cache->entries[i].lastUsed < entry->lastUsed) {
+                entry = &cache->entries[i];
+            }
+        }
+    }
+
+    CraggyPublicKey *preparedPublicKey = NULL;
+    if (entry->valid && craggy_memcmp(entry->delegation.delegationPublicKey, delegation->delegationPublicKey, CRAGGY_ROUGH_TIME_PUBLIC_KEY_LENGTH) == 0) {
+        // Same delegated key, keep the prepared one
+        preparedPublicKey = (CraggyPublicKey *) entry->delegation.preparedPublicKey;
+        entry->delegation.preparedPublicKey = NULL;
+    } else {
+        const CraggyAllocator *allocator = craggy_setThreadAllocator(cache->allocator);
+        if (!craggy_publicKeyPrepare(delegation->delegationPublicKey, &preparedPublicKey)) {
+            preparedPublicKey = NULL;
+        }
+        craggy_setThreadAllocator(allocator);
+    }
+    releaseEntry(cache, entry);
+
+    craggy_memcpy(&entry->delegation, delegation, sizeof(CraggyDelegation));
+    entry->delegation.preparedPublicKey = preparedPublicKey;
+    entry->lastUsed = ++cache->useCounter;
+    entry->valid = true;
+
+    if (cache->storeOps != NULL) {
+        cache->storeOps->store(cache->storeContext, &entry->delegation);
+    }
+}
+
+void craggy_delegationCacheBackWith(CraggyDelegationCache *cache, const CraggyDelegationStoreOps *ops, void *context) {
+    cache->storeOps = ops;
+    cache->storeContext = context;
+}
+
+void craggy_evictDelegation(CraggyDelegationCache *cache, const craggy_rough_time_public_key_t rootPublicKey) {
+    CraggyDelegationCacheEntry *entry = findEntry(cache, rootPublicKey);
+    if (entry != NULL) {
+        releaseEntry(cache, entry);
+    }
+}
+
+void craggy_evictExpiredDelegations(CraggyDelegationCache *cache, craggy_rough_time_t now) {
+    for (size_t i = 0; i < cache->capacity; i++) {
+        if (cache->entries[i].valid && cache->entries[i].delegation.maxTime < now) {
+            releaseEntry(cache, &cache->entries[i]);
+        }
+    }
+}
+
+void craggy_destroyDelegationCache(CraggyDelegationCache *cache) {
+    if (cache != NULL) {
+        for (size_t i = 0; i < cache->capacity; i++) {
+            releaseEntry(cache, &cache->entries[i]);
+        }
+        const CraggyAllocator *allocator = craggy_setThreadAllocator(cache->allocator);
+        craggy_free(cache->entries);
+        craggy_free(cache);
+        craggy_setThreadAllocator(allocator);
+    }
+}
@@ -0,0 +1,132 @@
+/* Copyright 2020 Johan Lindquist
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef CRAGGY_CRAGGYDELEGATIONCACHE_H
+#define CRAGGY_CRAGGYDELEGATIONCACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "CraggyTypes.h"
+#include "CraggyCrypto.h"
+
+/** Cache of delegations (DELE messages) whose certificate signature has already been verified with a root key.
+ *
+ * Entries are keyed by the root public key and the SHA512 hash of the DELE bytes, and hold the MINT/MAXT window
+ * and delegated public key.  At most one delegation is kept per root public key - a new delegation from the same
+ * server replaces the previous one.  A cache is not thread-safe; use one cache per thread.
+ */
+typedef struct CraggyDelegationCache CraggyDelegationCache;
+
+/** A verified delegation as held by the cache. */
+typedef struct {
+    craggy_rough_time_public_key_t rootPublicKey;
+    uint8_t delegationHash[CRAGGY_ROUGH_TIME_HASH_LENGTH];
+    craggy_rough_time_public_key_t delegationPublicKey;
+    /** Prepared form of the delegation public key, owned by the cache and set when the delegation is stored.  NULL if the key could not be prepared. */
+    const CraggyPublicKey *preparedPublicKey;
+    craggy_rough_time_t minTime;
+    craggy_rough_time_t maxTime;
+} CraggyDelegation;
+
+/** A second tier behind a cache, one shared with other processes for instance.  Both operations are called on the
+ * thread using the cache. */
+typedef struct {
+    /** Looks up a delegation verified elsewhere, as {@link craggy_lookupDelegation} does.
+     *
+     * @param delegation Delegation found, all but its preparedPublicKey filled in
+     * @return True if found, otherwise false
+     */
+    bool (*load)(void *context, const craggy_rough_time_public_key_t rootPublicKey, const uint8_t delegationHash[CRAGGY_ROUGH_TIME_HASH_LENGTH], CraggyDelegation *delegation);
+    /** Passes on a delegation stored in the cache using {@link craggy_storeDelegation}. */
+    void (*store)(void *context, const CraggyDelegation *delegation);
+} CraggyDelegationStoreOps;
+
+/** Creates a new delegation cache.
+ *
+ * @param capacity Maximum number of delegations (servers) to hold
+ * @param cache Cache created
+ * @return True if successful, otherwise false
+ */
+bool craggy_createDelegationCache(size_t capacity, CraggyDelegationCache **cache);
+
+/** Looks up a verified delegation.
+ *
+ * @param cache Cache to search
+ * @param rootPublicKey Root public key of the server
+ * @param delegationHash SHA512 hash of the DELE message bytes
+ * @return The cached delegation if found, otherwise NULL.  Valid until the cache is next modified.
+ */
+const CraggyDelegation *craggy_lookupDelegation(CraggyDelegationCache *cache, const craggy_rough_time_public_key_t rootPublicKey, const uint8_t delegationHash[CRAGGY_ROUGH_TIME_HASH_LENGTH]);
+
+/** Looks up a verified delegation in the store backing the cache, leaving the cache as it is - a delegation found there
+ * is only stored in the cache once a response signed with its key has been verified, using
+ * {@link craggy_storeDelegation}.
+ *
+ * @param cache Cache whose store to search
+ * @param rootPublicKey Root public key of the server
+ * @param delegationHash SHA512 hash of the DELE message bytes
+ * @param delegation Delegation found, its preparedPublicKey NULL
+ * @return True if found, false if not or if the cache is not backed by a store
+ */
+bool craggy_loadDelegation(const CraggyDelegationCache *cache, const craggy_rough_time_public_key_t rootPublicKey, const uint8_t delegationHash[CRAGGY_ROUGH_TIME_HASH_LENGTH], CraggyDelegation *delegation);
+
+/** Looks up the delegation held for a server, whichever it is.
+ *
+ * @param cache Cache to search
+ * @param rootPublicKey Root public key of the server
+ * @return The cached delegation if there is one, otherwise NULL.  Valid until the cache is next modified.
+ */
+const CraggyDelegation *craggy_findDelegation(CraggyDelegationCache *cache, const craggy_rough_time_public_key_t rootPublicKey);
+
+/** Stores a delegation whose certificate signature has been verified, replacing any previous delegation for the same root public key.
+ * The delegation public key is prepared for verification, any preparedPublicKey passed in is ignored.
+ *
+ * @param cache Cache to store the delegation in
+ * @param delegation Delegation to store
+ */
+void craggy_storeDelegation(CraggyDelegationCache *cache, const CraggyDelegation *delegation);
+
+/** Removes the delegation held for the root public key specified, if any.
+ *
+ * @param cache Cache to remove the delegation from
+ * @param rootPublicKey Root public key of the server
+ */
+void craggy_evictDelegation(CraggyDelegationCache *cache, const craggy_rough_time_public_key_t rootPublicKey);
+
+/** Removes all delegations whose MAXT lies before the time specified.
+ *
+ * @param cache Cache to purge
+ * @param now Current time, in microseconds from the epoch
+ */
+void craggy_evictExpiredDelegations(CraggyDelegationCache *cache, craggy_rough_time_t now);
+
+/** Backs the cache with a second tier: delegations missing from the cache can be looked up there using
+ * {@link craggy_loadDelegation}, and those stored in the cache are passed on to it.
+ *
+ * @param cache Cache to back
+ * @param ops Operations of the store, must outlive the cache, or NULL to detach the one there is
+ * @param context Passed to the operations
+ */
+void craggy_delegationCacheBackWith(CraggyDelegationCache *cache, const CraggyDelegationStoreOps *ops, void *context);
+
+/** Frees the cache and the delegations it holds, releasing their prepared public keys, using the allocator the
+ * cache was created with.  The second tier it is backed with, if any, is left alone.
+ *
+ * @param cache Cache to destroy, or NULL, in which case nothing is done
+ */
+void craggy_destroyDelegationCache(CraggyDelegationCache *cache);
+
+#endif //CRAGGY_CRAGGYDELEGATIONCACHE_H
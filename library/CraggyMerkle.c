@@ -0,0 +1,193 @@
+/* Copyright 2020 Johan Lindquist
+ * Copyright 2016 The Roughtime Authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <memory.h>
+
+#include "CraggyMerkle.h"
+#include "CraggyCrypto.h"
+
+#include "CraggyOS.h"
+
+#define ERROR_OCCURRED(x) *result = x; goto error;
+
+struct CraggyMerkleTree {
+    size_t numNonces;
+    size_t numLeaves;
+    size_t depth;
+    // All levels of the tree, leaves first, root last
+    uint8_t (*nodes)[CRAGGY_ROUGH_TIME_HASH_LENGTH];
+};
+
+static const uint8_t leafPrefix = 0x00;
+static const uint8_t nodePrefix = 0x01;
+
+bool craggy_hashMerkleLeaf(const uint8_t nonce[CRAGGY_ROUGH_TIME_NONCE_LENGTH], uint8_t hash[CRAGGY_ROUGH_TIME_HASH_LENGTH]) {
+    CraggySHA512Context context;
+    return craggy_initSHA512(&context) &&
+           craggy_updateSHA512(&context, &leafPrefix, 1) &&
+           craggy_updateSHA512(&context, nonce, CRAGGY_ROUGH_TIME_NONCE_LENGTH) &&
+           craggy_finalSHA512(&context, hash);
+}
+
+bool craggy_hashMerkleNode(const uint8_t left[CRAGGY_ROUGH_TIME_HASH_LENGTH], const uint8_t right[CRAGGY_ROUGH_TIME_HASH_LENGTH], uint8_t hash[CRAGGY_ROUGH_TIME_HASH_LENGTH]) {
+    // Both children are hashed before the result is written, so hash may alias either of them
+    CraggySHA512Context context;
+    return craggy_initSHA512(&context) &&
+           craggy_updateSHA512(&context, &nodePrefix, 1) &&
+           craggy_updateSHA512(&context, left, CRAGGY_ROUGH_TIME_HASH_LENGTH) &&
+           craggy_updateSHA512(&context, right, CRAGGY_ROUGH_TIME_HASH_LENGTH) &&
+           craggy_finalSHA512(&context, hash);
+}
+
+bool craggy_computeMerkleRoot(const uint8_t nonce[CRAGGY_ROUGH_TIME_NONCE_LENGTH], uint32_t index, const uint8_t *path, size_t pathLen, uint8_t root[CRAGGY_ROUGH_TIME_HASH_LENGTH], CraggyResult *result) {
+
+    *result = CraggyResultGeneralError;
+
+    if (pathLen % CRAGGY_ROUGH_TIME_HASH_LENGTH != 0 || pathLen / CRAGGY_ROUGH_TIME_HASH_LENGTH > CRAGGY_ROUGH_TIME_MAX_TREE_DEPTH) {
+        ERROR_OCCURRED(CraggyResultParseErrorTagSizeMismatch);
+    }
+
+    uint8_t hash[CRAGGY_ROUGH_TIME_HASH_LENGTH];
+    if (!craggy_hashMerkleLeaf(nonce, hash)) {
+        ERROR_OCCURRED(CraggyResultInternalError);
+    }
+
+    while (pathLen > 0) {
+        // A zero bit means we are the left child, with the sibling from the path on the right
+        const bool isRight = (index & (uint32_t) 1);
+        const bool ok = isRight ? craggy_hashMerkleNode(path, hash, hash) : craggy_hashMerkleNode(hash, path, hash);
+        if (!ok) {
+            ERROR_OCCURRED(CraggyResultInternalError);
+        }
+        index >>= (uint32_t) 1;
+        pathLen -= CRAGGY_ROUGH_TIME_HASH_LENGTH;
+        path += CRAGGY_ROUGH_TIME_HASH_LENGTH;
+    }
+    // Bits of the index beyond the depth of the path place the leaf in no tree the path leads up
+    if (index != 0) {
+        ERROR_OCCURRED(CraggyResultAuthenticationHashError);
+    }
+
+    craggy_memcpy(root, hash, CRAGGY_ROUGH_TIME_HASH_LENGTH);
+    *result = CraggyResultSuccess;
+
+error:
+    return *result == CraggyResultSuccess;
+}
+
+bool craggy_verifyMerklePath(const uint8_t nonce[CRAGGY_ROUGH_TIME_NONCE_LENGTH], uint32_t index, const uint8_t *path, size_t pathLen, const uint8_t root[CRAGGY_ROUGH_TIME_HASH_LENGTH], CraggyResult *result) {
+
+    uint8_t hash[CRAGGY_ROUGH_TIME_HASH_LENGTH];
+    if (!craggy_computeMerkleRoot(nonce, index, path, pathLen, hash, result)) {
+        return false;
+    }
+
+    if (craggy_memcmp(root, hash, CRAGGY_ROUGH_TIME_HASH_LENGTH) != 0) {
+        *result = CraggyResultAuthenticationHashError;
+        return false;
+    }
+    return true;
+}
+
+bool craggy_createMerkleTree(const craggy_rough_time_nonce_t *nonces, size_t numNonces, CraggyMerkleTree **tree, CraggyResult *result) {
+
+    *result = CraggyResultGeneralError;
+    *tree = NULL;
+
+    if (numNonces == 0 || numNonces > ((size_t) 1 << (CRAGGY_ROUGH_TIME_MAX_TREE_DEPTH - 1))) {
+        ERROR_OCCURRED(CraggyResultGeneralError);
+    }
+
+    size_t numLeaves = 1;
+    size_t depth = 0;
+    while (numLeaves < numNonces) {
+        numLeaves <<= (size_t) 1;
+        depth++;
+    }
+
+    *tree = craggy_calloc(1, sizeof(CraggyMerkleTree));
+    if (*tree == NULL) {
+        ERROR_OCCURRED(CraggyResultInternalError);
+    }
+
+    (*tree)->nodes = craggy_calloc(2 * numLeaves - 1, CRAGGY_ROUGH_TIME_HASH_LENGTH);
+    if ((*tree)->nodes == NULL) {
+        ERROR_OCCURRED(CraggyResultInternalError);
+    }
+    (*tree)->numNonces = numNonces;
+    (*tree)->numLeaves = numLeaves;
+    (*tree)->depth = depth;
+
+    // Each level is hashed in one go - the children of a node lie next to each other, so every level is a run of
+    // equally sized messages for the multi-buffer SHA512
+    if (!craggy_calculateSHA512Batch(leafPrefix, (const uint8_t *) nonces, CRAGGY_ROUGH_TIME_NONCE_LENGTH, numNonces, (*tree)->nodes)) {
+        ERROR_OCCURRED(CraggyResultInternalError);
+    }
+
+    uint8_t (*level)[CRAGGY_ROUGH_TIME_HASH_LENGTH] = (*tree)->nodes;
+    for (size_t width = numLeaves; width > 1; width >>= (size_t) 1) {
+        uint8_t (*parent)[CRAGGY_ROUGH_TIME_HASH_LENGTH] = level + width;
+        if (!craggy_calculateSHA512Batch(nodePrefix, level[0], 2 * CRAGGY_ROUGH_TIME_HASH_LENGTH, width / 2, parent)) {
+            ERROR_OCCURRED(CraggyResultInternalError);
+        }
+        level = parent;
+    }
+
+    *result = CraggyResultSuccess;
+    goto exit;
+
+error:
+    craggy_destroyMerkleTree(*tree);
+    *tree = NULL;
+
+exit:
+    return *result == CraggyResultSuccess;
+}
+
+const uint8_t *craggy_getMerkleRoot(const CraggyMerkleTree *tree) {
+    return tree->nodes[2 * tree->numLeaves - 2];
+}
+
+size_t craggy_getMerkleTreeSize(const CraggyMerkleTree *tree) {
+    return tree->numNonces;
+}
+
+size_t craggy_getMerklePathLength(const CraggyMerkleTree *tree) {
+    return tree->depth * CRAGGY_ROUGH_TIME_HASH_LENGTH;
+}
+
+bool craggy_getMerklePath(const CraggyMerkleTree *tree, size_t index, uint8_t *path, size_t pathLen) {
+
+    if (index >= tree->numNonces || pathLen < craggy_getMerklePathLength(tree)) {
+        return false;
+    }
+
+    const uint8_t (*level)[CRAGGY_ROUGH_TIME_HASH_LENGTH] = (const uint8_t (*)[CRAGGY_ROUGH_TIME_HASH_LENGTH]) tree->nodes;
+    for (size_t width = tree->numLeaves; width > 1; width >>= (size_t) 1) {
+        craggy_memcpy(path, level[index ^ (size_t) 1], CRAGGY_ROUGH_TIME_HASH_LENGTH);
+        path += CRAGGY_ROUGH_TIME_HASH_LENGTH;
+        level += width;
+        index >>= (size_t) 1;
+    }
+    return true;
+}
+
+void craggy_destroyMerkleTree(CraggyMerkleTree *tree) {
+    if (tree != NULL) {
+        craggy_free(tree->nodes);
+    }
+    craggy_free(tree);
+}
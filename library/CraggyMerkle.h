@@ -0,0 +1,123 @@
+/* Copyright 2020 Johan Lindquist
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef CRAGGY_CRAGGYMERKLE_H
+#define CRAGGY_CRAGGYMERKLE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "CraggyTypes.h"
+
+/** Maximum depth of a Roughtime Merkle tree - the INDX tag is 32 bits wide, one bit per level. */
+#define CRAGGY_ROUGH_TIME_MAX_TREE_DEPTH 32
+
+/** Merkle tree over a batch of nonces, built the same way a Roughtime server builds its tree.
+ *
+ * Leaves are H(0x00 || nonce), nodes H(0x01 || left || right).  The number of leaves is rounded up to the next power
+ * of two, unused leaves being all zero.
+ */
+typedef struct CraggyMerkleTree CraggyMerkleTree;
+
+/** Hashes a nonce into a leaf of the tree.
+ *
+ * @param nonce Nonce to hash
+ * @param hash Resulting leaf hash
+ * @return True if successful, otherwise false
+ */
+bool craggy_hashMerkleLeaf(const uint8_t nonce[CRAGGY_ROUGH_TIME_NONCE_LENGTH], uint8_t hash[CRAGGY_ROUGH_TIME_HASH_LENGTH]);
+
+/** Hashes two children into their parent node.
+ *
+ * @param left Left child hash
+ * @param right Right child hash
+ * @param hash Resulting node hash (may alias either child)
+ * @return True if successful, otherwise false
+ */
+bool craggy_hashMerkleNode(const uint8_t left[CRAGGY_ROUGH_TIME_HASH_LENGTH], const uint8_t right[CRAGGY_ROUGH_TIME_HASH_LENGTH], uint8_t hash[CRAGGY_ROUGH_TIME_HASH_LENGTH]);
+
+/** Computes the root of the tree from a nonce, its index in the tree and the path of sibling hashes (PATH) leading up to the root.
+ *
+ * @param nonce Nonce at the leaf
+ * @param index Index of the leaf (INDX)
+ * @param path Sibling hashes, leaf level first
+ * @param pathLen Length of the path in bytes, a multiple of {@link CRAGGY_ROUGH_TIME_HASH_LENGTH}
+ * @param root Resulting root hash
+ * @param result Result of the operation - CraggyResultAuthenticationHashError if the index has bits set beyond the
+ * depth of the path
+ * @return True if successful, otherwise false and {@link result} will indicate the error
+ */
+bool craggy_computeMerkleRoot(const uint8_t nonce[CRAGGY_ROUGH_TIME_NONCE_LENGTH], uint32_t index, const uint8_t *path, size_t pathLen, uint8_t root[CRAGGY_ROUGH_TIME_HASH_LENGTH], CraggyResult *result);
+
+/** Verifies that a nonce is included in the tree with the root specified.
+ *
+ * @param nonce Nonce at the leaf
+ * @param index Index of the leaf (INDX)
+ * @param path Sibling hashes, leaf level first
+ * @param pathLen Length of the path in bytes
+ * @param root Expected root hash (ROOT)
+ * @param result Result of the verification
+ * @return True if the nonce is included, otherwise false and {@link result} will indicate the error
+ */
+bool craggy_verifyMerklePath(const uint8_t nonce[CRAGGY_ROUGH_TIME_NONCE_LENGTH], uint32_t index, const uint8_t *path, size_t pathLen, const uint8_t root[CRAGGY_ROUGH_TIME_HASH_LENGTH], CraggyResult *result);
+
+/** Builds a tree over the nonces specified.
+ *
+ * @param nonces Nonces to include, in leaf order
+ * @param numNonces Number of nonces, at least one
+ * @param tree Tree created
+ * @param result Result of the operation
+ * @return True if successful, otherwise false and {@link result} will indicate the error
+ */
+bool craggy_createMerkleTree(const craggy_rough_time_nonce_t *nonces, size_t numNonces, CraggyMerkleTree **tree, CraggyResult *result);
+
+/**
+ *
+ * @param tree
+ * @return Root hash of the tree
+ */
+const uint8_t *craggy_getMerkleRoot(const CraggyMerkleTree *tree);
+
+/**
+ *
+ * @param tree
+ * @return Number of nonces in the tree
+ */
+size_t craggy_getMerkleTreeSize(const CraggyMerkleTree *tree);
+
+/**
+ *
+ * @param tree
+ * @return Length in bytes of the path of every leaf in the tree
+ */
+size_t craggy_getMerklePathLength(const CraggyMerkleTree *tree);
+
+/** Copies out the path of sibling hashes from the leaf specified up to the root.
+ *
+ * @param tree Tree to extract the path from
+ * @param index Index of the leaf
+ * @param path Buffer for the path, at least {@link craggy_getMerklePathLength} bytes
+ * @param pathLen Size of the path buffer
+ * @return True if successful, otherwise false
+ */
+bool craggy_getMerklePath(const CraggyMerkleTree *tree, size_t index, uint8_t *path, size_t pathLen);
+
+/**
+ *
+ * @param tree
+ */
+void craggy_destroyMerkleTree(CraggyMerkleTree *tree);
+
+#endif //CRAGGY_CRAGGYMERKLE_H
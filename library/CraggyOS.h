@@ -16,10 +16,13 @@
 #define CRAGGY_CRAGGYOS_H
 
 #include <memory.h>
+#include <stddef.h>
+
+/* Allocations of the library go through the allocator of the calling thread, see CraggyAllocator.h */
+void *craggy_malloc(size_t size);
+void *craggy_calloc(size_t count, size_t size);
+void craggy_free(void *ptr);
 
-#define craggy_malloc malloc
-#define craggy_calloc calloc
-#define craggy_free free
 #define craggy_memset memset
 #define craggy_memcpy memcpy
 #define craggy_memcmp memcmp
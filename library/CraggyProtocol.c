@@ -20,40 +20,6 @@
 
 #include "CraggyOS.h"
 
-struct CraggyRoughtimeMessage {
-    const uint8_t *buffer;
-    size_t bufferLen;
-    uint32_t numTags;
-    uint8_t *tags;
-    uint8_t *offsets;
-    uint8_t *data;
-    size_t dataLen;
-    bool valid;
-};
-
-struct CraggyRoughtimeMessageBuilder {
-
-    const uint8_t *out;
-    size_t outLen;
-
-    uint32_t numTags;
-    uint32_t tagsAdded;
-
-    uint32_t nextTagDataOffset;
-
-    bool havePreviousTag;
-    craggy_tag_t previousTag;
-
-    size_t len;
-    size_t headerLen;
-
-    uint8_t *tags;
-    uint8_t *offsets;
-    uint8_t *data;
-
-    bool valid;
-};
-
 
 static void advance(uint8_t **ptr, size_t *len, size_t bytes) {
     *ptr += bytes;
@@ -79,12 +45,7 @@ static int tag_cmp(const void *keyp, const void *memberp) {
     return key < member ? -1 : 1;
 }
 
-bool craggy_getTag(const CraggyRoughtimeMessage *message, uint8_t **outData, size_t *outLen, craggy_tag_t tag) {
-    uint8_t *tagPtr = bsearch(&tag, message->tags, message->numTags, sizeof(craggy_tag_t), tag_cmp);
-    if (tagPtr == NULL) {
-        return false;
-    }
-    size_t tagNumber = (tagPtr - message->tags) / sizeof(uint32_t);
+static void tagData(const CraggyRoughtimeMessage *message, size_t tagNumber, uint8_t **outData, size_t *outLen) {
     uint32_t offset = 0;
     if (tagNumber != 0) {
         craggy_memcpy(&offset, message->offsets + sizeof(uint32_t) * (tagNumber - 1), sizeof(uint32_t));
@@ -97,6 +58,53 @@ bool craggy_getTag(const CraggyRoughtimeMessage *message, uint8_t **outData, siz
         craggy_memcpy(&next_offset, message->offsets + sizeof(uint32_t) * tagNumber, sizeof(uint32_t));
         *outLen = next_offset - offset;
     }
+}
+
+bool craggy_getTag(const CraggyRoughtimeMessage *message, uint8_t **outData, size_t *outLen, craggy_tag_t tag) {
+    uint8_t *tagPtr = bsearch(&tag, message->tags, message->numTags, sizeof(craggy_tag_t), tag_cmp);
+    if (tagPtr == NULL) {
+        return false;
+    }
+    tagData(message, (tagPtr - message->tags) / sizeof(uint32_t), outData, outLen);
+    return true;
+}
+
+bool craggy_getTags(const CraggyRoughtimeMessage *message, CraggyTagSlice *slices, size_t numSlices, CraggyResult *result) {
+
+    bool sizeMismatch = false;
+    size_t tagNumber = 0;
+
+    // Both the tags of the message and the tags wanted are sorted, so one merge finds them all
+    for (size_t i = 0; i < numSlices; i++) {
+        if (i > 0 && slices[i].tag <= slices[i - 1].tag) {
+            *result = CraggyResultGeneralError;
+            return false;
+        }
+
+        craggy_tag_t tag = 0;
+        for (; tagNumber < message->numTags; tagNumber++) {
+            craggy_memcpy(&tag, message->tags + sizeof(craggy_tag_t) * tagNumber, sizeof(craggy_tag_t));
+            if (tag >= slices[i].tag) {
+                break;
+            }
+        }
+        if (tagNumber == message->numTags || tag != slices[i].tag) {
+            *result = CraggyResultParseErrorMissingTags;
+            return false;
+        }
+
+        tagData(message, tagNumber, &slices[i].data, &slices[i].len);
+        if (slices[i].expectedLen != CRAGGY_TAG_ANY_LENGTH && slices[i].len != slices[i].expectedLen) {
+            sizeMismatch = true;
+        }
+    }
+
+    if (sizeMismatch) {
+        *result = CraggyResultParseErrorTagSizeMismatch;
+        return false;
+    }
+
+    *result = CraggyResultSuccess;
     return true;
 }
 
@@ -115,9 +123,30 @@ bool craggy_getFixedLenTag(const CraggyRoughtimeMessage *message, uint8_t **outD
 
 bool craggy_parseMessage(const uint8_t *in, const  size_t inLen, CraggyRoughtimeMessage **message) {
 
+    *message = craggy_calloc(1, sizeof(CraggyRoughtimeMessage));
+    if (*message == NULL) {
+        return false;
+    }
+
+    if (!craggy_parseMessageInto(in, inLen, *message)) {
+        craggy_free(*message);
+        *message = NULL;
+        return false;
+    }
+    return true;
+}
+
+bool craggy_parseMessageInto(const uint8_t *in, const  size_t inLen, CraggyRoughtimeMessage *message) {
+
     uint8_t *ourIn = (uint8_t*)in;
     size_t ourInLen = inLen;
 
+    message->valid = false;
+
+    if (ourInLen < sizeof(uint32_t)) {
+        return false;
+    }
+
     uint32_t numTags = 0;
     craggy_memcpy(&numTags, ourIn, sizeof(uint32_t));
     advance(&ourIn, &ourInLen, sizeof(uint32_t));
@@ -130,7 +159,7 @@ bool craggy_parseMessage(const uint8_t *in, const  size_t inLen, CraggyRoughtime
 
     // Validate table of offsets.
     const size_t numOffsets = numMessageOffsets(numTags);
-    if (inLen < numOffsets * sizeof(uint32_t)) {
+    if (ourInLen < numOffsets * sizeof(uint32_t)) {
         return false;
     }
 
@@ -150,7 +179,7 @@ bool craggy_parseMessage(const uint8_t *in, const  size_t inLen, CraggyRoughtime
     uint32_t lastOffset = previousOffset;
 
     // Validate list of tags.  Tags must be in increasing order.
-    if (inLen < numTags * sizeof(craggy_tag_t)) {
+    if (ourInLen < numTags * sizeof(craggy_tag_t)) {
         return false;
     }
 
@@ -167,21 +196,20 @@ bool craggy_parseMessage(const uint8_t *in, const  size_t inLen, CraggyRoughtime
     }
 
     // Make sure the offset table doesn't point past the end of the data.
-    if (inLen < lastOffset) {
+    if (ourInLen < lastOffset) {
         return false;
     }
 
     uint8_t *dataPtr = ourIn;
 
-    *message = craggy_calloc(1, sizeof(CraggyRoughtimeMessage));
-    (*message)->buffer = in;
-    (*message)->bufferLen = inLen;
-    (*message)->offsets = offsetsPtr;
-    (*message)->numTags = numTags;
-    (*message)->tags = tagsPtr;
-    (*message)->data = dataPtr;
-    (*message)->dataLen = ourInLen;
-    (*message)->valid = true;
+    message->buffer = in;
+    message->bufferLen = inLen;
+    message->offsets = offsetsPtr;
+    message->numTags = numTags;
+    message->tags = tagsPtr;
+    message->data = dataPtr;
+    message->dataLen = ourInLen;
+    message->valid = true;
 
     return true;
 
@@ -200,38 +228,81 @@ void craggy_destroyMessage(CraggyRoughtimeMessage *message) {
     craggy_free(message);
 }
 
-bool craggy_createMessageBuilder(const size_t numTags, uint8_t *out, size_t outLen,
-                                 CraggyRoughtimeMessageBuilder **builder) {
+bool craggy_initMessageBuilder(const size_t numTags, uint8_t *out, size_t outLen, CraggyRoughtimeMessageBuilder *builder) {
 
     size_t headerLen = craggy_messageHeaderLen(numTags);
 
+    builder->valid = false;
+
     if (outLen < sizeof(uint32_t) || outLen < headerLen || 0xffff < numTags) {
-        return NULL;
+        return false;
     }
 
-    *builder = craggy_calloc(1, sizeof(CraggyRoughtimeMessageBuilder));
-    (*builder)->valid = false;
-
     const uint32_t numTags32 = numTags;
     craggy_memcpy(out, &numTags32, sizeof(uint32_t));
 
-    (*builder)->headerLen = headerLen;
-    (*builder)->out = out;
-    (*builder)->data = out + headerLen;
-    (*builder)->len = outLen - headerLen;
+    builder->headerLen = headerLen;
+    builder->out = out;
+    builder->data = out + headerLen;
+    builder->len = outLen - headerLen;
 
-    (*builder)->offsets = out + sizeof(uint32_t);
-    (*builder)->tags = out + sizeof(uint32_t) * (1 + numMessageOffsets(numTags));
+    builder->offsets = out + sizeof(uint32_t);
+    builder->tags = out + sizeof(uint32_t) * (1 + numMessageOffsets(numTags));
 
-    (*builder)->numTags = numTags;
-    (*builder)->out = out;
-    (*builder)->outLen = outLen;
+    builder->numTags = numTags;
+    builder->tagsAdded = 0;
+    builder->nextTagDataOffset = 0;
+    builder->havePreviousTag = false;
+    builder->previousTag = 0;
+    builder->outLen = outLen;
 
-    (*builder)->valid = true;
+    builder->valid = true;
 
     return true;
 }
 
+bool craggy_createMessageBuilder(const size_t numTags, uint8_t *out, size_t outLen,
+                                 CraggyRoughtimeMessageBuilder **builder) {
+
+    *builder = craggy_malloc(sizeof(CraggyRoughtimeMessageBuilder));
+    if (*builder == NULL) {
+        return false;
+    }
+
+    if (!craggy_initMessageBuilder(numTags, out, outLen, *builder)) {
+        craggy_free(*builder);
+        *builder = NULL;
+        return false;
+    }
+    return true;
+}
+
+bool craggy_buildMessage(CraggyTagData *tags, const size_t numTags, uint8_t *out, size_t outLen, size_t *messageLen) {
+
+    // Messages have a handful of tags, for which an insertion sort is as quick as anything
+    for (size_t i = 1; i < numTags; i++) {
+        const CraggyTagData tag = tags[i];
+        size_t j = i;
+        while (j > 0 && tags[j - 1].tag > tag.tag) {
+            tags[j] = tags[j - 1];
+            j--;
+        }
+        tags[j] = tag;
+    }
+
+    // Adding the tags rejects duplicates (tags not in strictly ascending order), lengths not a multiple of four and data not fitting
+    CraggyRoughtimeMessageBuilder builder;
+    if (!craggy_initMessageBuilder(numTags, out, outLen, &builder)) {
+        return false;
+    }
+    for (size_t i = 0; i < numTags; i++) {
+        if (!craggy_addTagData(&builder, tags[i].tag, tags[i].data, tags[i].len)) {
+            return false;
+        }
+    }
+    return craggy_finish(&builder, messageLen);
+}
+
 bool craggy_addTag(CraggyRoughtimeMessageBuilder *builder, uint8_t **out_data, craggy_tag_t tag, size_t len) {
 
     if (!builder->valid || len % 4 != 0 || builder->len < len || builder->tagsAdded >= builder->numTags ||
@@ -277,4 +348,89 @@ bool craggy_finish(CraggyRoughtimeMessageBuilder *builder, size_t *outLen) {
 
 void craggy_destroyMessageBuilder(CraggyRoughtimeMessageBuilder *builder) {
     craggy_free(builder);
-}
\ No newline at end of file
+}
+
+// A standard request is PAD, VER and NONC - in that order, as NONC sorts last - filling the minimum request size
+#define STANDARD_REQUEST_NUM_TAGS 3
+#define STANDARD_REQUEST_VERSION_OFFSET (CRAGGY_ROUGH_TIME_MIN_REQUEST_SIZE - CRAGGY_ROUGH_TIME_NONCE_LENGTH - sizeof(uint32_t))
+#define STANDARD_REQUEST_PADDING_LEN (STANDARD_REQUEST_VERSION_OFFSET - craggy_messageHeaderLen(STANDARD_REQUEST_NUM_TAGS))
+
+#if defined(CRAGGY_WITH_MESSAGE_FAST_PATH)
+
+static uint32_t load32(const uint8_t *in) {
+    uint32_t value;
+    craggy_memcpy(&value, in, sizeof(uint32_t));
+    return value;
+}
+
+static void store32(uint8_t *out, uint32_t value) {
+    craggy_memcpy(out, &value, sizeof(uint32_t));
+}
+
+// The header of a standard request is fixed - tag count, two offsets and three tags at known places
+static bool isStandardRequest(const uint8_t *in, const size_t inLen) {
+    return inLen == CRAGGY_ROUGH_TIME_MIN_REQUEST_SIZE &&
+           load32(in) == STANDARD_REQUEST_NUM_TAGS &&
+           load32(in + 4) == STANDARD_REQUEST_PADDING_LEN &&
+           load32(in + 8) == STANDARD_REQUEST_PADDING_LEN + sizeof(uint32_t) &&
+           load32(in + 12) == CRAGGY_TAG_PAD &&
+           load32(in + 16) == CRAGGY_TAG_VER &&
+           load32(in + 20) == CRAGGY_TAG_NONCE;
+}
+
+#endif
+
+bool craggy_buildStandardRequest(const uint8_t *nonce, craggy_rough_time_request_t requestBuf) {
+
+    // Zeroing the whole request up front leaves the padding (and the nonce, if none is given) zero without writing them separately
+    craggy_memset(requestBuf, 0, CRAGGY_ROUGH_TIME_MIN_REQUEST_SIZE);
+
+    uint32_t version = 1;
+
+#if defined(CRAGGY_WITH_MESSAGE_FAST_PATH)
+    store32(requestBuf, STANDARD_REQUEST_NUM_TAGS);
+    store32(requestBuf + 4, STANDARD_REQUEST_PADDING_LEN);
+    store32(requestBuf + 8, STANDARD_REQUEST_PADDING_LEN + sizeof(uint32_t));
+    store32(requestBuf + 12, CRAGGY_TAG_PAD);
+    store32(requestBuf + 16, CRAGGY_TAG_VER);
+    store32(requestBuf + 20, CRAGGY_TAG_NONCE);
+    store32(requestBuf + STANDARD_REQUEST_VERSION_OFFSET, version);
+#else
+    CraggyRoughtimeMessageBuilder builder;
+    uint8_t *data;
+    size_t requestLen;
+
+    if (!craggy_initMessageBuilder(STANDARD_REQUEST_NUM_TAGS, requestBuf, CRAGGY_ROUGH_TIME_MIN_REQUEST_SIZE, &builder) ||
+        !craggy_addTag(&builder, &data, CRAGGY_TAG_PAD, STANDARD_REQUEST_PADDING_LEN) ||
+        !craggy_addTagData(&builder, CRAGGY_TAG_VER, (uint8_t *) &version, sizeof(uint32_t)) ||
+        !craggy_addTag(&builder, &data, CRAGGY_TAG_NONCE, CRAGGY_ROUGH_TIME_NONCE_LENGTH) ||
+        !craggy_finish(&builder, &requestLen)) {
+        return false;
+    }
+#endif
+
+    if (nonce != NULL) {
+        craggy_memcpy(requestBuf + CRAGGY_ROUGH_TIME_MIN_REQUEST_SIZE - CRAGGY_ROUGH_TIME_NONCE_LENGTH, nonce, CRAGGY_ROUGH_TIME_NONCE_LENGTH);
+    }
+    return true;
+}
+
+bool craggy_parseRequestNonce(const uint8_t *in, const size_t inLen, const uint8_t **nonce) {
+
+#if defined(CRAGGY_WITH_MESSAGE_FAST_PATH)
+    if (isStandardRequest(in, inLen)) {
+        *nonce = in + CRAGGY_ROUGH_TIME_MIN_REQUEST_SIZE - CRAGGY_ROUGH_TIME_NONCE_LENGTH;
+        return true;
+    }
+#endif
+
+    // Any other layout, such as that of clients sending their tags in another order or with more padding
+    CraggyRoughtimeMessage message;
+    uint8_t *data;
+    if (!craggy_parseMessageInto(in, inLen, &message) ||
+        !craggy_getFixedLenTag(&message, &data, CRAGGY_TAG_NONCE, CRAGGY_ROUGH_TIME_NONCE_LENGTH)) {
+        return false;
+    }
+    *nonce = data;
+    return true;
+}
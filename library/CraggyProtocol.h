@@ -20,6 +20,8 @@
 #ifndef CRAGGY_PROTOCOL_H
 #define CRAGGY_PROTOCOL_H
 
+#include "CraggyTypes.h"
+
 // Parser decodes requests from a time server client.
 //
 //  0                   1                   2                   3
@@ -69,8 +71,64 @@ typedef uint32_t craggy_tag_t;
 #define CRAGGY_TAG_MAXT MAKE_TAG("MAXT")
 #define CRAGGY_TAG_DELE MAKE_TAG("DELE")
 
-typedef struct CraggyRoughtimeMessage CraggyRoughtimeMessage;
-typedef struct CraggyRoughtimeMessageBuilder CraggyRoughtimeMessageBuilder;
+/** A parsed message - a view onto the buffer parsed, which must outlive it.  Fixed size, so it can live on the stack
+ * (see {@link craggy_parseMessageInto}); the fields are not meant to be accessed directly.
+ */
+typedef struct CraggyRoughtimeMessage {
+    const uint8_t *buffer;
+    size_t bufferLen;
+    uint32_t numTags;
+    uint8_t *tags;
+    uint8_t *offsets;
+    uint8_t *data;
+    size_t dataLen;
+    bool valid;
+} CraggyRoughtimeMessage;
+
+/** Builds a message into a buffer provided by the caller.  Fixed size, so it can live on the stack (see
+ * {@link craggy_initMessageBuilder}); the fields are not meant to be accessed directly.
+ */
+typedef struct CraggyRoughtimeMessageBuilder {
+    const uint8_t *out;
+    size_t outLen;
+
+    uint32_t numTags;
+    uint32_t tagsAdded;
+
+    uint32_t nextTagDataOffset;
+
+    bool havePreviousTag;
+    craggy_tag_t previousTag;
+
+    size_t len;
+    size_t headerLen;
+
+    uint8_t *tags;
+    uint8_t *offsets;
+    uint8_t *data;
+
+    bool valid;
+} CraggyRoughtimeMessageBuilder;
+
+/** A tag to write, see {@link craggy_buildMessage}. */
+typedef struct {
+    craggy_tag_t tag;
+    const uint8_t *data;
+    size_t len;
+} CraggyTagData;
+
+/** Expected length of a {@link CraggyTagSlice} whose data may be of any length */
+#define CRAGGY_TAG_ANY_LENGTH SIZE_MAX
+
+/** A tag wanted from a message, see {@link craggy_getTags}. */
+typedef struct {
+    craggy_tag_t tag;
+    /** Required length of the data, or {@link CRAGGY_TAG_ANY_LENGTH} */
+    size_t expectedLen;
+    /** Set to the data of the tag */
+    uint8_t *data;
+    size_t len;
+} CraggyTagSlice;
 
 /**
  *
@@ -81,6 +139,16 @@ typedef struct CraggyRoughtimeMessageBuilder CraggyRoughtimeMessageBuilder;
  */
 bool craggy_parseMessage(const uint8_t *in, size_t inLen, CraggyRoughtimeMessage **message);
 
+/** Parses a message into storage provided by the caller, without allocating.  The message must not be passed to
+ * {@link craggy_destroyMessage}.
+ *
+ * @param in Buffer holding the message
+ * @param inLen Length of the message
+ * @param message Message to parse into
+ * @return True if the message is well formed, otherwise false
+ */
+bool craggy_parseMessageInto(const uint8_t *in, size_t inLen, CraggyRoughtimeMessage *message);
+
 /**
  *
  * @param message
@@ -99,6 +167,37 @@ bool craggy_hasTag(const CraggyRoughtimeMessage *message, craggy_tag_t tag);
  */
 bool craggy_getFixedLenTag(const CraggyRoughtimeMessage *message, uint8_t **outData, craggy_tag_t tag, size_t expectedLen);
 
+/** Looks up several tags at once, in a single pass over the tags of the message.
+ *
+ * @param message Message to look up the tags in
+ * @param slices Tags wanted, in increasing tag order.  Their data and length are filled in.
+ * @param numSlices Number of tags wanted
+ * @param result CraggyResultParseErrorMissingTags if any tag is missing, otherwise CraggyResultParseErrorTagSizeMismatch
+ * if any tag has other than its expected length
+ * @return True if all tags were found with the expected lengths, otherwise false and {@link result} will indicate the error
+ */
+bool craggy_getTags(const CraggyRoughtimeMessage *message, CraggyTagSlice *slices, size_t numSlices, CraggyResult *result);
+
+/** Builds a request in the standard layout - PAD, VER and NONC tags filling {@link CRAGGY_ROUGH_TIME_MIN_REQUEST_SIZE}
+ * bytes, the nonce last.  Built with {@link CRAGGY_WITH_MESSAGE_FAST_PATH}, the fixed header is written directly
+ * rather than through a message builder.
+ *
+ * @param nonce Nonce of the request, or NULL to leave the nonce zero
+ * @param requestBuf Buffer for the request
+ * @return True if successful, otherwise false
+ */
+bool craggy_buildStandardRequest(const uint8_t *nonce, craggy_rough_time_request_t requestBuf);
+
+/** Finds the nonce of a request, as a server would.  Built with {@link CRAGGY_WITH_MESSAGE_FAST_PATH}, requests in the
+ * standard layout are recognised by a handful of fixed offset loads; any other layout goes through the generic parser.
+ *
+ * @param in Buffer holding the request
+ * @param inLen Length of the request
+ * @param nonce Set to the nonce, pointing into the request
+ * @return True if the request is well formed and holds a nonce, otherwise false
+ */
+bool craggy_parseRequestNonce(const uint8_t *in, size_t inLen, const uint8_t **nonce);
+
 /**
  *
  * @param message
@@ -166,6 +265,30 @@ size_t craggy_messageHeaderLen(size_t num_tags);
  */
 bool craggy_createMessageBuilder(size_t numTags, uint8_t *out, size_t outLen, CraggyRoughtimeMessageBuilder **builder);
 
+/** Starts building a message into storage provided by the caller, without allocating.  The builder must not be passed
+ * to {@link craggy_destroyMessageBuilder}.
+ *
+ * @param numTags Number of tags the message will hold
+ * @param out Buffer to build the message in
+ * @param outLen Size of the buffer
+ * @param builder Builder to initialise
+ * @return True if the header of the message fits the buffer, otherwise false
+ */
+bool craggy_initMessageBuilder(size_t numTags, uint8_t *out, size_t outLen, CraggyRoughtimeMessageBuilder *builder);
+
+/** Builds a whole message in one go.  The tags are sorted into the order the protocol requires first, so they can be
+ * specified in any order.
+ *
+ * @param tags Tags of the message, sorted in place
+ * @param numTags Number of tags
+ * @param out Buffer to build the message in
+ * @param outLen Size of the buffer
+ * @param messageLen Length of the message built
+ * @return True if successful, otherwise false - if a tag appears twice, the length of any tag is not a multiple of
+ *         four or the message does not fit the buffer
+ */
+bool craggy_buildMessage(CraggyTagData *tags, size_t numTags, uint8_t *out, size_t outLen, size_t *messageLen);
+
 /**
  *
  * @param builder
@@ -0,0 +1,414 @@
+/* Copyright 2020 Johan Lindquist
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "CraggySharedCache.h"
+
+#include "CraggyClock.h"
+#include "CraggyOS.h"
+
+#define ERROR_OCCURRED(x) *result = x; goto error;
+
+#define CRAGGY_SHARED_CACHE_MAGIC "CRSC"
+
+/** Changed whenever the layout of the file is */
+#define CRAGGY_SHARED_CACHE_VERSION 2
+
+#define CRAGGY_SHARED_CACHE_HAS_DELEGATION 1U
+#define CRAGGY_SHARED_CACHE_HAS_SAMPLE 2U
+
+/** What the file holds for a server, in the layout of the machine. */
+typedef struct {
+    // Zero while the entry holds no server
+    uint32_t flags;
+    uint32_t radius;
+    craggy_rough_time_public_key_t rootPublicKey;
+    uint8_t delegationHash[CRAGGY_ROUGH_TIME_HASH_LENGTH];
+    craggy_rough_time_public_key_t delegationPublicKey;
+    uint64_t minTime;
+    uint64_t maxTime;
+    uint64_t time;
+    uint64_t roundTripTime;
+    uint64_t receivedAt;
+    uint64_t receivedMonotonic;
+    // Process that published the sample
+    uint64_t publisher;
+    // Monotonic clock when last written, the entry written longest ago making way for a server once all are taken
+    uint64_t updated;
+} CraggySharedCacheRecord;
+
+typedef struct {
+    // Odd while a writer updates the record, readers retry until they see the same even value before and after
+    _Atomic uint32_t sequence;
+    uint32_t reserved;
+    CraggySharedCacheRecord record;
+} CraggySharedCacheSlot;
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t capacity;
+    // Tells apart builds laying the slots out differently
+    uint32_t slotLength;
+    CraggySharedCacheSlot slots[];
+} CraggySharedCacheFile;
+
+struct CraggySharedCache {
+    CraggySharedCacheFile *file;
+    size_t fileLen;
+    // As of the header when opened, should another process overwrite it
+    size_t capacity;
+    // Kept open for the writers' lock
+    int fd;
+};
+
+static size_t craggy_sharedCacheFileLength(size_t capacity) {
+    return sizeof(CraggySharedCacheFile) + capacity * sizeof(CraggySharedCacheSlot);
+}
+
+bool craggy_sharedCacheOpen(const char *path, size_t capacity, CraggySharedCache **cache, CraggyResult *result) {
+
+    *result = CraggyResultGeneralError;
+
+    *cache = craggy_calloc(1, sizeof(CraggySharedCache));
+    if (*cache == NULL) {
+        ERROR_OCCURRED(CraggyResultInternalError);
+    }
+    (*cache)->fd = open(path, O_RDWR | O_CREAT | O_NOFOLLOW | O_CLOEXEC, 0600);
+    if ((*cache)->fd < 0) {
+        ERROR_OCCURRED(CraggyResultGeneralError);
+    }
+
+    // Whoever gets here first lays the file out, the others wait for it to be
+    if (flock((*cache)->fd, LOCK_EX) != 0) {
+        ERROR_OCCURRED(CraggyResultGeneralError);
+    }
+
+    struct stat st;
+    if (fstat((*cache)->fd, &st) != 0) {
+        ERROR_OCCURRED(CraggyResultGeneralError);
+    }
+    // Delegations are taken from the file as verified: anyone else able to write it could have them accept forged
+    // responses
+    if (!S_ISREG(st.st_mode) || st.st_uid != geteuid() || (st.st_mode & (S_IWGRP | S_IWOTH)) != 0) {
+        ERROR_OCCURRED(CraggyResultGeneralError);
+    }
+
+    CraggySharedCacheFile header;
+    if (st.st_size == 0) {
+        if (capacity == 0 || capacity > UINT32_MAX) {
+            ERROR_OCCURRED(CraggyResultGeneralError);
+        }
+        // Extended with zeroes, no slot holds a server yet
+        if (ftruncate((*cache)->fd, (off_t) craggy_sharedCacheFileLength(capacity)) != 0) {
+            ERROR_OCCURRED(CraggyResultGeneralError);
+        }
+        craggy_memcpy(header.magic, CRAGGY_SHARED_CACHE_MAGIC, sizeof(header.magic));
+        header.version = CRAGGY_SHARED_CACHE_VERSION;
+        header.capacity = (uint32_t) capacity;
+        header.slotLength = sizeof(CraggySharedCacheSlot);
+        if (pwrite((*cache)->fd, &header, sizeof(header), 0) != (ssize_t) sizeof(header)) {
+            ERROR_OCCURRED(CraggyResultGeneralError);
+        }
+    } else if ((size_t) st.st_size < sizeof(header) || pread((*cache)->fd, &header, sizeof(header), 0) != (ssize_t) sizeof(header)) {
+        ERROR_OCCURRED(CraggyResultParseError);
+    }
+
+    if (craggy_memcmp(header.magic, CRAGGY_SHARED_CACHE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != CRAGGY_SHARED_CACHE_VERSION || header.slotLength != sizeof(CraggySharedCacheSlot) ||
+        header.capacity == 0) {
+        ERROR_OCCURRED(CraggyResultParseError);
+    }
+    (*cache)->capacity = header.capacity;
+    (*cache)->fileLen = craggy_sharedCacheFileLength(header.capacity);
+    if (fstat((*cache)->fd, &st) != 0) {
+        ERROR_OCCURRED(CraggyResultGeneralError);
+    }
+    if ((size_t) st.st_size != (*cache)->fileLen) {
+        ERROR_OCCURRED(CraggyResultParseError);
+    }
+
+    void *mapping = mmap(NULL, (*cache)->fileLen, PROT_READ | PROT_WRITE, MAP_SHARED, (*cache)->fd, 0);
+    if (mapping == MAP_FAILED) {
+        ERROR_OCCURRED(CraggyResultInternalError);
+    }
+    (*cache)->file = mapping;
+
+    *result = CraggyResultSuccess;
+    goto exit;
+
+error:
+    // Closing the file releases the lock
+    craggy_sharedCacheClose(*cache);
+    *cache = NULL;
+
+exit:
+    if (*cache != NULL) {
+        flock((*cache)->fd, LOCK_UN);
+    }
+    return *result == CraggyResultSuccess;
+}
+
+/* Copies the record of a slot, consistent however often writers update it meanwhile.  A writer that stopped midway
+ * leaves the slot odd until the next writer comes by - readers give up on it rather than wait. */
+static bool craggy_readSlot(const CraggySharedCacheSlot *slot, CraggySharedCacheRecord *record) {
+
+    for (unsigned attempt = 0; attempt < CRAGGY_SHARED_CACHE_READ_ATTEMPTS; attempt++) {
+        const uint32_t before = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        craggy_memcpy(record, &slot->record, sizeof(CraggySharedCacheRecord));
+        atomic_thread_fence(memory_order_acquire);
+        const uint32_t after = atomic_load_explicit(&slot->sequence, memory_order_relaxed);
+        if ((before & 1U) == 0 && before == after) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Where a server's probing starts, keys being random enough to take their first bytes as they are. */
+static size_t craggy_homeSlot(const CraggySharedCache *cache, const craggy_rough_time_public_key_t rootPublicKey) {
+    uint64_t hash;
+    craggy_memcpy(&hash, rootPublicKey, sizeof(hash));
+    return (size_t) (hash % cache->capacity);
+}
+
+/* Copies the record of a server.  Slots never go back to holding none, so probing stops at the first empty one. */
+static bool craggy_findRecord(const CraggySharedCache *cache, const craggy_rough_time_public_key_t rootPublicKey, CraggySharedCacheRecord *record) {
+
+    const CraggySharedCacheFile *file = cache->file;
+    const size_t home = craggy_homeSlot(cache, rootPublicKey);
+    for (size_t i = 0; i < cache->capacity; i++) {
+        if (!craggy_readSlot(&file->slots[(home + i) % cache->capacity], record)) {
+            continue;
+        }
+        if (record->flags == 0) {
+            return false;
+        }
+        if (craggy_memcmp(record->rootPublicKey, rootPublicKey, CRAGGY_ROUGH_TIME_PUBLIC_KEY_LENGTH) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Picks the slot to write a server to, holding the writers' lock: the one holding the server, else the first empty
+ * one, else the one written longest ago. */
+static CraggySharedCacheSlot *craggy_claimSlot(CraggySharedCache *cache, const craggy_rough_time_public_key_t rootPublicKey) {
+
+    CraggySharedCacheFile *file = cache->file;
+    const size_t home = craggy_homeSlot(cache, rootPublicKey);
+    CraggySharedCacheSlot *oldest = &file->slots[home];
+    for (size_t i = 0; i < cache->capacity; i++) {
+        CraggySharedCacheSlot *slot = &file->slots[(home + i) % cache->capacity];
+        if (slot->record.flags == 0 ||
+            craggy_memcmp(slot->record.rootPublicKey, rootPublicKey, CRAGGY_ROUGH_TIME_PUBLIC_KEY_LENGTH) == 0) {
+            return slot;
+        }
+        if (slot->record.updated < oldest->record.updated) {
+            oldest = slot;
+        }
+    }
+    return oldest;
+}
+
+/* Makes the slot odd for readers to keep off it.  One left odd by a writer that stopped midway stays odd. */
+static uint32_t craggy_beginWrite(CraggySharedCacheSlot *slot) {
+    const uint32_t sequence = atomic_load_explicit(&slot->sequence, memory_order_relaxed) | 1U;
+    atomic_store_explicit(&slot->sequence, sequence, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    return sequence;
+}
+
+static void craggy_endWrite(CraggySharedCacheSlot *slot, uint32_t sequence) {
+    atomic_store_explicit(&slot->sequence, sequence + 1, memory_order_release);
+}
+
+/* Takes the slot over for the server, dropping whatever another server left there. */
+static void craggy_resetRecord(CraggySharedCacheRecord *record, const craggy_rough_time_public_key_t rootPublicKey) {
+    if (record->flags != 0 && craggy_memcmp(record->rootPublicKey, rootPublicKey, CRAGGY_ROUGH_TIME_PUBLIC_KEY_LENGTH) == 0) {
+        return;
+    }
+    craggy_memset(record, 0, sizeof(CraggySharedCacheRecord));
+    craggy_memcpy(record->rootPublicKey, rootPublicKey, CRAGGY_ROUGH_TIME_PUBLIC_KEY_LENGTH);
+}
+
+bool craggy_sharedCacheLoadDelegation(const CraggySharedCache *cache, const craggy_rough_time_public_key_t rootPublicKey, const uint8_t *delegationHash, CraggyDelegation *delegation) {
+
+    CraggySharedCacheRecord record;
+    if (!craggy_findRecord(cache, rootPublicKey, &record) || (record.flags & CRAGGY_SHARED_CACHE_HAS_DELEGATION) == 0) {
+        return false;
+    }
+    if (delegationHash != NULL && craggy_memcmp(record.delegationHash, delegationHash, CRAGGY_ROUGH_TIME_HASH_LENGTH) != 0) {
+        return false;
+    }
+    craggy_memcpy(delegation->rootPublicKey, record.rootPublicKey, CRAGGY_ROUGH_TIME_PUBLIC_KEY_LENGTH);
+    craggy_memcpy(delegation->delegationHash, record.delegationHash, CRAGGY_ROUGH_TIME_HASH_LENGTH);
+    craggy_memcpy(delegation->delegationPublicKey, record.delegationPublicKey, CRAGGY_ROUGH_TIME_PUBLIC_KEY_LENGTH);
+    delegation->preparedPublicKey = NULL;
+    delegation->minTime = record.minTime;
+    delegation->maxTime = record.maxTime;
+    return true;
+}
+
+void craggy_sharedCacheStoreDelegation(CraggySharedCache *cache, const CraggyDelegation *delegation) {
+
+    if (flock(cache->fd, LOCK_EX) != 0) {
+        return;
+    }
+
+    CraggySharedCacheSlot *slot = craggy_claimSlot(cache, delegation->rootPublicKey);
+    const uint32_t sequence = craggy_beginWrite(slot);
+    craggy_resetRecord(&slot->record, delegation->rootPublicKey);
+    craggy_memcpy(slot->record.delegationHash, delegation->delegationHash, CRAGGY_ROUGH_TIME_HASH_LENGTH);
+    craggy_memcpy(slot->record.delegationPublicKey, delegation->delegationPublicKey, CRAGGY_ROUGH_TIME_PUBLIC_KEY_LENGTH);
+    slot->record.minTime = delegation->minTime;
+    slot->record.maxTime = delegation->maxTime;
+    slot->record.updated = craggy_monotonicNs();
+    slot->record.flags |= CRAGGY_SHARED_CACHE_HAS_DELEGATION;
+    craggy_endWrite(slot, sequence);
+
+    flock(cache->fd, LOCK_UN);
+}
+
+void craggy_sharedCachePublishSample(CraggySharedCache *cache, const craggy_rough_time_public_key_t rootPublicKey, const CraggySharedSample *sample) {
+
+    if (flock(cache->fd, LOCK_EX) != 0) {
+        return;
+    }
+
+    CraggySharedCacheSlot *slot = craggy_claimSlot(cache, rootPublicKey);
+    const CraggySharedCacheRecord *held = &slot->record;
+    const bool later = (held->flags & CRAGGY_SHARED_CACHE_HAS_SAMPLE) != 0 &&
+                       craggy_memcmp(held->rootPublicKey, rootPublicKey, CRAGGY_ROUGH_TIME_PUBLIC_KEY_LENGTH) == 0 &&
+                       held->receivedMonotonic > sample->receivedMonotonic;
+    if (!later) {
+        const uint32_t sequence = craggy_beginWrite(slot);
+        craggy_resetRecord(&slot->record, rootPublicKey);
+        slot->record.time = sample->time;
+        slot->record.radius = sample->radius;
+        slot->record.roundTripTime = sample->roundTripTime;
+        slot->record.receivedAt = sample->receivedAt;
+        slot->record.receivedMonotonic = sample->receivedMonotonic;
+        slot->record.publisher = (uint64_t) getpid();
+        slot->record.updated = craggy_monotonicNs();
+        slot->record.flags |= CRAGGY_SHARED_CACHE_HAS_SAMPLE;
+        craggy_endWrite(slot, sequence);
+    }
+
+    flock(cache->fd, LOCK_UN);
+}
+
+bool craggy_sharedCacheFindSample(const CraggySharedCache *cache, const craggy_rough_time_public_key_t rootPublicKey, uint64_t maxAge, CraggySharedSample *sample) {
+
+    CraggySharedCacheRecord record;
+    if (!craggy_findRecord(cache, rootPublicKey, &record) || (record.flags & CRAGGY_SHARED_CACHE_HAS_SAMPLE) == 0) {
+        return false;
+    }
+
+    const uint64_t monotonic = craggy_monotonicNs();
+    if (monotonic < record.receivedMonotonic || monotonic - record.receivedMonotonic > maxAge) {
+        return false;
+    }
+    // A sample from before the machine last started looks as recent as any to the monotonic clock, not to the realtime
+    // one
+    const craggy_rough_time_t now = craggy_realtimeUs();
+    const uint64_t maxAgeUs = maxAge / 1000;
+    if (now + maxAgeUs < record.receivedAt || now > record.receivedAt + maxAgeUs) {
+        return false;
+    }
+
+    sample->time = record.time;
+    sample->radius = record.radius;
+    sample->roundTripTime = record.roundTripTime;
+    sample->receivedAt = record.receivedAt;
+    sample->receivedMonotonic = record.receivedMonotonic;
+    sample->publisher = (pid_t) record.publisher;
+    return true;
+}
+
+size_t craggy_sharedCacheCapacity(const CraggySharedCache *cache) {
+    return cache->capacity;
+}
+
+bool craggy_sharedCacheReadEntry(const CraggySharedCache *cache, size_t index, CraggySharedCacheEntry *entry) {
+
+    CraggySharedCacheRecord record;
+    if (index >= cache->capacity || !craggy_readSlot(&cache->file->slots[index], &record) || record.flags == 0) {
+        return false;
+    }
+
+    craggy_memset(entry, 0, sizeof(CraggySharedCacheEntry));
+    craggy_memcpy(entry->rootPublicKey, record.rootPublicKey, CRAGGY_ROUGH_TIME_PUBLIC_KEY_LENGTH);
+    entry->hasDelegation = (record.flags & CRAGGY_SHARED_CACHE_HAS_DELEGATION) != 0;
+    if (entry->hasDelegation) {
+        craggy_memcpy(entry->delegation.rootPublicKey, record.rootPublicKey, CRAGGY_ROUGH_TIME_PUBLIC_KEY_LENGTH);
+        craggy_memcpy(entry->delegation.delegationHash, record.delegationHash, CRAGGY_ROUGH_TIME_HASH_LENGTH);
+        craggy_memcpy(entry->delegation.delegationPublicKey, record.delegationPublicKey, CRAGGY_ROUGH_TIME_PUBLIC_KEY_LENGTH);
+        entry->delegation.minTime = record.minTime;
+        entry->delegation.maxTime = record.maxTime;
+    }
+    entry->hasSample = (record.flags & CRAGGY_SHARED_CACHE_HAS_SAMPLE) != 0;
+    if (entry->hasSample) {
+        entry->sample.time = record.time;
+        entry->sample.radius = record.radius;
+        entry->sample.roundTripTime = record.roundTripTime;
+        entry->sample.receivedAt = record.receivedAt;
+        entry->sample.receivedMonotonic = record.receivedMonotonic;
+        entry->sample.publisher = (pid_t) record.publisher;
+    }
+    return true;
+}
+
+static bool craggy_sharedCacheLoad(void *context, const craggy_rough_time_public_key_t rootPublicKey, const uint8_t delegationHash[CRAGGY_ROUGH_TIME_HASH_LENGTH], CraggyDelegation *delegation) {
+    return craggy_sharedCacheLoadDelegation(context, rootPublicKey, delegationHash, delegation);
+}
+
+static void craggy_sharedCacheStore(void *context, const CraggyDelegation *delegation) {
+    CraggySharedCache *cache = context;
+    CraggyDelegation held;
+    // Taken from the shared cache in the first place, or stored there by another process since
+    if (craggy_sharedCacheLoadDelegation(cache, delegation->rootPublicKey, delegation->delegationHash, &held)) {
+        return;
+    }
+    craggy_sharedCacheStoreDelegation(cache, delegation);
+}
+
+static const CraggyDelegationStoreOps craggy_sharedCacheOps = {
+    .load = craggy_sharedCacheLoad,
+    .store = craggy_sharedCacheStore,
+};
+
+void craggy_sharedCacheAttach(CraggySharedCache *cache, CraggyDelegationCache *delegationCache) {
+    craggy_delegationCacheBackWith(delegationCache, &craggy_sharedCacheOps, cache);
+}
+
+void craggy_sharedCacheClose(CraggySharedCache *cache) {
+    if (cache == NULL) {
+        return;
+    }
+    if (cache->file != NULL) {
+        munmap(cache->file, cache->fileLen);
+    }
+    if (cache->fd >= 0) {
+        close(cache->fd);
+    }
+    craggy_free(cache);
+}
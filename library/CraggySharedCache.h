@@ -0,0 +1,156 @@
+/* Copyright 2020 Johan Lindquist
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CRAGGY_CRAGGYSHAREDCACHE_H
+#define CRAGGY_CRAGGYSHAREDCACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "CraggyTypes.h"
+#include "CraggyDelegationCache.h"
+
+/** Servers a cache holds unless created with another capacity */
+#define CRAGGY_SHARED_CACHE_DEFAULT_CAPACITY 64
+
+/** Times a reader copies a server's entry while it is being written before giving up on it */
+#define CRAGGY_SHARED_CACHE_READ_ATTEMPTS 1000
+
+/** Verified delegations and the latest verified sample of each server, kept in a file mapped by every process on the
+ * host that opens it - a daemon polling the servers, the tools asking them now and then.  A delegation verified by one
+ * process is taken up by the others without verifying its certificate signature again, and a sample recently received
+ * by one spares the others a query of their own.
+ *
+ * Each server has an entry of its own, copied by readers under a sequence lock, without a system call or a lock that a
+ * process stopping midway would leave held.  Writers take turns through an advisory lock on the file.  The entries
+ * are only as good as the processes able to write the file: it is created readable and writable by its owner alone,
+ * and only opened if owned by the effective user and writable by no one else - processes of one user share it.  A cache
+ * is not thread-safe; open one per thread. */
+typedef struct CraggySharedCache CraggySharedCache;
+
+/** A verified response as kept for a server. */
+typedef struct {
+    /** Midpoint of the response */
+    craggy_rough_time_t time;
+    /** Radius of the response */
+    craggy_rough_time_radius_t radius;
+    /** Time from sending the request to receiving the response, in microseconds */
+    uint64_t roundTripTime;
+    /** Local realtime clock when the response arrived, in microseconds from the epoch */
+    craggy_rough_time_t receivedAt;
+    /** Monotonic clock when the response arrived, in nanoseconds as of {@link craggy_monotonicNs}, common to all
+     * processes until the machine restarts */
+    uint64_t receivedMonotonic;
+    /** Process that published the sample, set by {@link craggy_sharedCachePublishSample} - a process polling the servers
+     * tells its own samples from those of others by it */
+    pid_t publisher;
+} CraggySharedSample;
+
+/** What a cache holds for a server. */
+typedef struct {
+    craggy_rough_time_public_key_t rootPublicKey;
+    /** Set if the delegation is */
+    bool hasDelegation;
+    /** Delegation of the server, without a prepared key */
+    CraggyDelegation delegation;
+    /** Set if the sample is */
+    bool hasSample;
+    CraggySharedSample sample;
+} CraggySharedCacheEntry;
+
+/** Opens the cache kept in a file, creating the file if there is none.
+ *
+ * @param path File of the cache
+ * @param capacity Servers the cache holds if the file is created, otherwise the capacity it was created with stands
+ * @param cache Cache opened
+ * @param result Result of the operation - CraggyResultGeneralError if the file is not a regular file owned by the
+ * effective user and writable by its owner alone, CraggyResultParseError if it was not created by this version of the
+ * library
+ * @return True if successful, otherwise false and {@link result} will indicate the error
+ */
+bool craggy_sharedCacheOpen(const char *path, size_t capacity, CraggySharedCache **cache, CraggyResult *result);
+
+/** Looks up a delegation of a server.
+ *
+ * @param cache Cache opened using {@link craggy_sharedCacheOpen}
+ * @param rootPublicKey Root public key of the server
+ * @param delegationHash SHA512 hash of the DELE message bytes, or NULL for the delegation held whichever it is
+ * @param delegation Delegation found, without a prepared key
+ * @return True if found, otherwise false
+ */
+bool craggy_sharedCacheLoadDelegation(const CraggySharedCache *cache, const craggy_rough_time_public_key_t rootPublicKey, const uint8_t *delegationHash, CraggyDelegation *delegation);
+
+/** Stores a delegation whose certificate signature has been verified, replacing the one held for the server.  The
+ * server's sample is kept.
+ *
+ * @param cache Cache opened using {@link craggy_sharedCacheOpen}
+ * @param delegation Delegation to store, its prepared key is ignored
+ */
+void craggy_sharedCacheStoreDelegation(CraggySharedCache *cache, const CraggyDelegation *delegation);
+
+/** Publishes a sample of a server, verified using {@link craggy_processResponse} or its like, in place of the one
+ * held unless that was received later.  The server's delegation is kept, and the publisher of the sample is taken to
+ * be the calling process.
+ *
+ * @param cache Cache opened using {@link craggy_sharedCacheOpen}
+ * @param rootPublicKey Root public key of the server
+ * @param sample Sample to publish
+ */
+void craggy_sharedCachePublishSample(CraggySharedCache *cache, const craggy_rough_time_public_key_t rootPublicKey, const CraggySharedSample *sample);
+
+/** Finds the latest sample of a server, as long as it was received recently enough.
+ *
+ * @param cache Cache opened using {@link craggy_sharedCacheOpen}
+ * @param rootPublicKey Root public key of the server
+ * @param maxAge Longest since the sample was received, in nanoseconds of the monotonic clock
+ * @param sample Sample found
+ * @return True if found, otherwise false
+ */
+bool craggy_sharedCacheFindSample(const CraggySharedCache *cache, const craggy_rough_time_public_key_t rootPublicKey, uint64_t maxAge, CraggySharedSample *sample);
+
+/** Tells how many servers the cache holds at most, as it was created with.
+ *
+ * @param cache Cache opened using {@link craggy_sharedCacheOpen}
+ * @return Number of entries of the cache, each holding a server or none
+ */
+size_t craggy_sharedCacheCapacity(const CraggySharedCache *cache);
+
+/** Reads an entry of the cache, listing the servers it holds.
+ *
+ * @param cache Cache opened using {@link craggy_sharedCacheOpen}
+ * @param index Number of the entry, less than {@link craggy_sharedCacheCapacity}
+ * @param entry Entry read
+ * @return True if the entry holds a server, otherwise false
+ */
+bool craggy_sharedCacheReadEntry(const CraggySharedCache *cache, size_t index, CraggySharedCacheEntry *entry);
+
+/** Backs a delegation cache with the shared cache: delegations it misses are looked up in the shared cache, and those
+ * it stores are stored there too.  The shared cache has to outlive the delegation cache, or be detached from it
+ * using {@link craggy_delegationCacheBackWith}.
+ *
+ * @param cache Cache opened using {@link craggy_sharedCacheOpen}
+ * @param delegationCache Delegation cache of the same thread
+ */
+void craggy_sharedCacheAttach(CraggySharedCache *cache, CraggyDelegationCache *delegationCache);
+
+/** Unmaps the cache, leaving the file to the other processes.
+ *
+ * @param cache
+ */
+void craggy_sharedCacheClose(CraggySharedCache *cache);
+
+#endif //CRAGGY_CRAGGYSHAREDCACHE_H
@@ -0,0 +1,157 @@
+/* Copyright 2020 Johan Lindquist
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdatomic.h>
+
+#include "CraggyStats.h"
+
+#define CRAGGY_STATS_SUB_BUCKETS (1u << CRAGGY_STATS_SUB_BUCKET_BITS)
+
+typedef struct {
+    _Atomic uint64_t count;
+    _Atomic uint64_t sum;
+    _Atomic uint64_t max;
+    _Atomic uint64_t buckets[CRAGGY_STATS_BUCKETS];
+} CraggyStageCounters;
+
+// Counters of the whole process, only ever updated with relaxed atomics: nothing else is published through them
+static CraggyStageCounters stageCounters[CraggyStageCount];
+static _Atomic uint64_t resultCounters[CRAGGY_STATS_RESULT_CLASSES * CRAGGY_STATS_RESULT_DETAILS];
+
+static const char *const stageNames[CraggyStageCount] = {
+        "dns",
+        "socket",
+        "send",
+        "wait",
+        "parse",
+        "cert_verify",
+        "srep_verify",
+        "merkle"
+};
+
+/* Durations below the sub-buckets have a bucket each, above that every power of two is split into as many. */
+static size_t craggy_statsBucket(uint64_t duration) {
+    if (duration < CRAGGY_STATS_SUB_BUCKETS) {
+        return (size_t) duration;
+    }
+    if (duration >> CRAGGY_STATS_MAX_BITS) {
+        return CRAGGY_STATS_BUCKETS - 1;
+    }
+    const unsigned int msb = 63 - (unsigned int) __builtin_clzll(duration);
+    const unsigned int shift = msb - CRAGGY_STATS_SUB_BUCKET_BITS;
+    return ((size_t) (shift + 1) << CRAGGY_STATS_SUB_BUCKET_BITS) + (size_t) ((duration >> shift) & (CRAGGY_STATS_SUB_BUCKETS - 1));
+}
+
+static size_t craggy_statsResultIndex(CraggyResult result) {
+    const unsigned int resultClass = (unsigned int) result / 100;
+    const unsigned int detail = (unsigned int) result % 100;
+    if (resultClass >= CRAGGY_STATS_RESULT_CLASSES || detail >= CRAGGY_STATS_RESULT_DETAILS) {
+        // Not a result of this version of the library, counted as an error all the same
+        return craggy_statsResultIndex(CraggyResultGeneralError);
+    }
+    return resultClass * CRAGGY_STATS_RESULT_DETAILS + detail;
+}
+
+void craggy_statsRecord(CraggyStage stage, uint64_t duration) {
+    CraggyStageCounters *counters = &stageCounters[stage];
+    atomic_fetch_add_explicit(&counters->buckets[craggy_statsBucket(duration)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&counters->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&counters->sum, duration, memory_order_relaxed);
+
+    uint64_t max = atomic_load_explicit(&counters->max, memory_order_relaxed);
+    while (duration > max && !atomic_compare_exchange_weak_explicit(&counters->max, &max, duration, memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+void craggy_statsCountResult(CraggyResult result) {
+    atomic_fetch_add_explicit(&resultCounters[craggy_statsResultIndex(result)], 1, memory_order_relaxed);
+}
+
+void craggy_statsSnapshot(CraggyStatsSnapshot *snapshot) {
+    for (size_t stage = 0; stage < CraggyStageCount; stage++) {
+        CraggyStageCounters *counters = &stageCounters[stage];
+        CraggyStageHistogram *histogram = &snapshot->stages[stage];
+        histogram->count = atomic_load_explicit(&counters->count, memory_order_relaxed);
+        histogram->sum = atomic_load_explicit(&counters->sum, memory_order_relaxed);
+        histogram->max = atomic_load_explicit(&counters->max, memory_order_relaxed);
+        for (size_t bucket = 0; bucket < CRAGGY_STATS_BUCKETS; bucket++) {
+            histogram->buckets[bucket] = atomic_load_explicit(&counters->buckets[bucket], memory_order_relaxed);
+        }
+    }
+    for (size_t i = 0; i < CRAGGY_STATS_RESULT_CLASSES * CRAGGY_STATS_RESULT_DETAILS; i++) {
+        snapshot->results[i] = atomic_load_explicit(&resultCounters[i], memory_order_relaxed);
+    }
+}
+
+void craggy_statsReset(void) {
+    for (size_t stage = 0; stage < CraggyStageCount; stage++) {
+        CraggyStageCounters *counters = &stageCounters[stage];
+        atomic_store_explicit(&counters->count, 0, memory_order_relaxed);
+        atomic_store_explicit(&counters->sum, 0, memory_order_relaxed);
+        atomic_store_explicit(&counters->max, 0, memory_order_relaxed);
+        for (size_t bucket = 0; bucket < CRAGGY_STATS_BUCKETS; bucket++) {
+            atomic_store_explicit(&counters->buckets[bucket], 0, memory_order_relaxed);
+        }
+    }
+    for (size_t i = 0; i < CRAGGY_STATS_RESULT_CLASSES * CRAGGY_STATS_RESULT_DETAILS; i++) {
+        atomic_store_explicit(&resultCounters[i], 0, memory_order_relaxed);
+    }
+}
+
+uint64_t craggy_statsBucketLimit(size_t bucket) {
+    if (bucket < CRAGGY_STATS_SUB_BUCKETS) {
+        return bucket;
+    }
+    if (bucket >= CRAGGY_STATS_BUCKETS - 1) {
+        return UINT64_MAX;
+    }
+    const unsigned int shift = (unsigned int) (bucket >> CRAGGY_STATS_SUB_BUCKET_BITS) - 1;
+    const uint64_t subBucket = bucket & (CRAGGY_STATS_SUB_BUCKETS - 1);
+    return ((CRAGGY_STATS_SUB_BUCKETS + subBucket + 1) << shift) - 1;
+}
+
+uint64_t craggy_statsPercentile(const CraggyStageHistogram *histogram, double percentile) {
+
+    // The buckets rather than the count, which may be out of step with them
+    uint64_t total = 0;
+    for (size_t bucket = 0; bucket < CRAGGY_STATS_BUCKETS; bucket++) {
+        total += histogram->buckets[bucket];
+    }
+    if (total == 0) {
+        return 0;
+    }
+
+    uint64_t rank = (uint64_t) (percentile / 100 * (double) total + 0.5);
+    if (rank == 0) {
+        rank = 1;
+    }
+    uint64_t seen = 0;
+    for (size_t bucket = 0; bucket < CRAGGY_STATS_BUCKETS; bucket++) {
+        seen += histogram->buckets[bucket];
+        if (seen >= rank) {
+            const uint64_t limit = craggy_statsBucketLimit(bucket);
+            return limit < histogram->max ? limit : histogram->max;
+        }
+    }
+    return histogram->max;
+}
+
+uint64_t craggy_statsResultCount(const CraggyStatsSnapshot *snapshot, CraggyResult result) {
+    return snapshot->results[craggy_statsResultIndex(result)];
+}
+
+const char *craggy_statsStageName(CraggyStage stage) {
+    return stage < CraggyStageCount ? stageNames[stage] : "unknown";
+}
@@ -0,0 +1,143 @@
+/* Copyright 2020 Johan Lindquist
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CRAGGY_CRAGGYSTATS_H
+#define CRAGGY_CRAGGYSTATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "CraggyTypes.h"
+
+/** Stages of a query timed by the library */
+typedef enum {
+    /** Resolving the name of a server */
+    CraggyStageNameLookup,
+    /** Opening a socket to a server, racing the address families if the name resolves to both */
+    CraggyStageSocketSetup,
+    /** Handing a request to the kernel */
+    CraggyStageSend,
+    /** Waiting for a response */
+    CraggyStageWait,
+    /** Parsing a response */
+    CraggyStageParse,
+    /** Verifying the signature on the delegation in the certificate, one response at a time - signatures verified in
+     * a batch by craggy_processResponses are not timed apart */
+    CraggyStageDelegationVerify,
+    /** Verifying the signature on the signed response */
+    CraggyStageResponseVerify,
+    /** Walking the Merkle path from the nonce to the root */
+    CraggyStageMerklePath,
+    CraggyStageCount
+} CraggyStage;
+
+/** Bits of a duration below its most significant one telling its bucket apart: each power of two is split into
+ * 2^CRAGGY_STATS_SUB_BUCKET_BITS buckets, so a duration is known to within 12.5% */
+#define CRAGGY_STATS_SUB_BUCKET_BITS 3
+
+/** Durations of 2^CRAGGY_STATS_MAX_BITS nanoseconds - a minute or so - and longer land in the last bucket */
+#define CRAGGY_STATS_MAX_BITS 36
+
+#define CRAGGY_STATS_BUCKETS ((CRAGGY_STATS_MAX_BITS - CRAGGY_STATS_SUB_BUCKET_BITS + 1) << CRAGGY_STATS_SUB_BUCKET_BITS)
+
+/** Result codes counted - every CraggyResult is a class in the hundreds plus a detail below this */
+#define CRAGGY_STATS_RESULT_DETAILS 8
+#define CRAGGY_STATS_RESULT_CLASSES 6
+
+/** Durations of one stage, bucketed log-linearly the way HdrHistogram does */
+typedef struct {
+    /** Durations recorded */
+    uint64_t count;
+    /** Sum of the durations, in nanoseconds */
+    uint64_t sum;
+    /** Longest duration, in nanoseconds */
+    uint64_t max;
+    /** Durations in each bucket, see {@link craggy_statsBucketLimit} */
+    uint64_t buckets[CRAGGY_STATS_BUCKETS];
+} CraggyStageHistogram;
+
+typedef struct {
+    CraggyStageHistogram stages[CraggyStageCount];
+    /** Queries finished with each result, see {@link craggy_statsResultCount} */
+    uint64_t results[CRAGGY_STATS_RESULT_CLASSES * CRAGGY_STATS_RESULT_DETAILS];
+} CraggyStatsSnapshot;
+
+/** Adds the duration of a stage to its histogram.  Lock-free, any thread may record at any time.
+ *
+ * @param stage Stage timed
+ * @param duration Duration, in nanoseconds
+ */
+void craggy_statsRecord(CraggyStage stage, uint64_t duration);
+
+/** Counts a query finished.  Lock-free, like {@link craggy_statsRecord}.
+ *
+ * @param result Result the query finished with
+ */
+void craggy_statsCountResult(CraggyResult result);
+
+/** Copies the counters of the whole process.  Each counter is read atomically, but recording goes on meanwhile: the
+ * count of a histogram may be a little ahead of or behind its buckets.
+ *
+ * @param snapshot Counters copied
+ */
+void craggy_statsSnapshot(CraggyStatsSnapshot *snapshot);
+
+/** Zeroes all counters, for a benchmark say.  Durations recorded meanwhile may be partly lost.
+ */
+void craggy_statsReset(void);
+
+/** Tells the durations a bucket holds.
+ *
+ * @param bucket Index of the bucket, below {@link CRAGGY_STATS_BUCKETS}
+ * @return Longest duration in the bucket, in nanoseconds - UINT64_MAX for the last one
+ */
+uint64_t craggy_statsBucketLimit(size_t bucket);
+
+/** Estimates a percentile of the durations of a stage.
+ *
+ * @param histogram Histogram of a snapshot
+ * @param percentile Percentile, from 0 to 100
+ * @return Duration below which the percentile falls, to within a bucket, in nanoseconds - 0 if none was recorded
+ */
+uint64_t craggy_statsPercentile(const CraggyStageHistogram *histogram, double percentile);
+
+/** Tells how many queries of a snapshot finished with a result.
+ *
+ * @param snapshot Counters copied
+ * @param result Result asked for
+ * @return Queries finished with the result
+ */
+uint64_t craggy_statsResultCount(const CraggyStatsSnapshot *snapshot, CraggyResult result);
+
+/**
+ *
+ * @param stage
+ * @return Name of the stage in lower case, as exporters label it
+ */
+const char *craggy_statsStageName(CraggyStage stage);
+
+/** Time the stages in code built with stats, and do nothing otherwise. */
+#if defined(CRAGGY_WITH_STATS)
+#include "CraggyClock.h"
+#define CRAGGY_STATS_START(start) const uint64_t start = craggy_monotonicNs()
+#define CRAGGY_STATS_RECORD(stage, start) craggy_statsRecord(stage, craggy_monotonicNs() - (start))
+#define CRAGGY_STATS_COUNT_RESULT(result) craggy_statsCountResult(result)
+#else
+#define CRAGGY_STATS_START(start)
+#define CRAGGY_STATS_RECORD(stage, start)
+#define CRAGGY_STATS_COUNT_RESULT(result)
+#endif
+
+#endif //CRAGGY_CRAGGYSTATS_H
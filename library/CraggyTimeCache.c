@@ -0,0 +1,347 @@
+/* Copyright 2020 Johan Lindquist
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <math.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "CraggyTimeCache.h"
+
+#include "CraggyClock.h"
+#include "CraggyOS.h"
+
+#define ERROR_OCCURRED(x) *result = x; goto error;
+
+#define CRAGGY_TIME_CACHE_MAGIC "CRTC"
+
+/** Changed whenever the fit does */
+#define CRAGGY_TIME_CACHE_VERSION 1
+
+/** The fit as published, the same layout in the file and in memory.  Time at monotonic clock m is
+ * refTime + (m - refMonotonic) * (1 + drift), give or take baseUncertainty + (m - refMonotonic) * driftUncertainty. */
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    // Odd while the writer updates the fit, readers retry until they see the same even value before and after
+    _Atomic uint32_t sequence;
+    // Zero until the first sample is added
+    uint32_t numSamples;
+    uint64_t refMonotonic;
+    uint64_t refTime;
+    double drift;
+    uint64_t baseUncertainty;
+    double driftUncertainty;
+} CraggyTimeCacheFit;
+
+typedef struct {
+    uint64_t monotonic;
+    // Time less the monotonic clock, in nanoseconds
+    int64_t offset;
+    uint64_t radius;
+} CraggyTimeCacheSample;
+
+struct CraggyTimeCache {
+    CraggyTimeCacheFit *fit;
+    // Set if the fit is mapped from a file rather than allocated
+    bool mapped;
+    // File the writer removes when closed, NULL for readers and caches of one process
+    char *path;
+    CraggyTimeCacheSample samples[CRAGGY_TIME_CACHE_SAMPLES];
+    size_t numSamples;
+    size_t nextSample;
+};
+
+bool craggy_timeCacheCreate(const char *path, CraggyTimeCache **cache, CraggyResult *result) {
+
+    *result = CraggyResultGeneralError;
+
+    int fd = -1;
+
+    *cache = craggy_calloc(1, sizeof(CraggyTimeCache));
+    if (*cache == NULL) {
+        ERROR_OCCURRED(CraggyResultInternalError);
+    }
+
+    if (path == NULL) {
+        (*cache)->fit = craggy_calloc(1, sizeof(CraggyTimeCacheFit));
+        if ((*cache)->fit == NULL) {
+            ERROR_OCCURRED(CraggyResultInternalError);
+        }
+    } else {
+        // Not truncated: readers may have the file of an earlier writer mapped, and would fault on the pages cut off
+        fd = open(path, O_RDWR | O_CREAT | O_NOFOLLOW | O_CLOEXEC, 0600);
+        if (fd < 0) {
+            ERROR_OCCURRED(CraggyResultGeneralError);
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            ERROR_OCCURRED(CraggyResultGeneralError);
+        }
+        if (!S_ISREG(st.st_mode) || st.st_uid != geteuid() || (st.st_mode & (S_IWGRP | S_IWOTH)) != 0) {
+            ERROR_OCCURRED(CraggyResultGeneralError);
+        }
+        if ((size_t) st.st_size != sizeof(CraggyTimeCacheFit) && ftruncate(fd, sizeof(CraggyTimeCacheFit)) != 0) {
+            ERROR_OCCURRED(CraggyResultGeneralError);
+        }
+        void *mapping = mmap(NULL, sizeof(CraggyTimeCacheFit), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (mapping == MAP_FAILED) {
+            ERROR_OCCURRED(CraggyResultInternalError);
+        }
+        (*cache)->fit = mapping;
+        (*cache)->mapped = true;
+
+        (*cache)->path = craggy_malloc(strlen(path) + 1);
+        if ((*cache)->path == NULL) {
+            ERROR_OCCURRED(CraggyResultInternalError);
+        }
+        strcpy((*cache)->path, path);
+    }
+    // Readers of an earlier writer's fit see it go, until the first sample is added
+    CraggyTimeCacheFit *fit = (*cache)->fit;
+    const uint32_t sequence = atomic_load_explicit(&fit->sequence, memory_order_relaxed) | 1U;
+    atomic_store_explicit(&fit->sequence, sequence, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    fit->numSamples = 0;
+    fit->version = CRAGGY_TIME_CACHE_VERSION;
+    craggy_memcpy(fit->magic, CRAGGY_TIME_CACHE_MAGIC, sizeof(fit->magic));
+    atomic_store_explicit(&fit->sequence, sequence + 1, memory_order_release);
+
+    *result = CraggyResultSuccess;
+    goto exit;
+
+error:
+    craggy_timeCacheClose(*cache);
+    *cache = NULL;
+
+exit:
+    if (fd >= 0) {
+        close(fd);
+    }
+    return *result == CraggyResultSuccess;
+}
+
+bool craggy_timeCacheOpen(const char *path, CraggyTimeCache **cache, CraggyResult *result) {
+
+    *result = CraggyResultGeneralError;
+
+    int fd = -1;
+
+    *cache = craggy_calloc(1, sizeof(CraggyTimeCache));
+    if (*cache == NULL) {
+        ERROR_OCCURRED(CraggyResultInternalError);
+    }
+
+    fd = open(path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0) {
+        ERROR_OCCURRED(CraggyResultGeneralError);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        ERROR_OCCURRED(CraggyResultGeneralError);
+    }
+    // The time is taken from the file as verified: anyone else able to write it could have readers take a forged one
+    if (!S_ISREG(st.st_mode) || st.st_uid != geteuid() || (st.st_mode & (S_IWGRP | S_IWOTH)) != 0) {
+        ERROR_OCCURRED(CraggyResultGeneralError);
+    }
+    if ((size_t) st.st_size != sizeof(CraggyTimeCacheFit)) {
+        ERROR_OCCURRED(CraggyResultParseError);
+    }
+
+    void *mapping = mmap(NULL, sizeof(CraggyTimeCacheFit), PROT_READ, MAP_SHARED, fd, 0);
+    if (mapping == MAP_FAILED) {
+        ERROR_OCCURRED(CraggyResultInternalError);
+    }
+    (*cache)->fit = mapping;
+    (*cache)->mapped = true;
+
+    if (craggy_memcmp((*cache)->fit->magic, CRAGGY_TIME_CACHE_MAGIC, sizeof((*cache)->fit->magic)) != 0 ||
+        (*cache)->fit->version != CRAGGY_TIME_CACHE_VERSION) {
+        ERROR_OCCURRED(CraggyResultParseError);
+    }
+
+    *result = CraggyResultSuccess;
+    goto exit;
+
+error:
+    craggy_timeCacheClose(*cache);
+    *cache = NULL;
+
+exit:
+    if (fd >= 0) {
+        close(fd);
+    }
+    return *result == CraggyResultSuccess;
+}
+
+/* Weighted least squares fit of the offsets against the monotonic clock, relative to the newest sample so that doubles
+ * hold the differences exactly.  The samples' radii weigh them.  Each sample bounds the offset at the newest one by its
+ * radius, its residual and the drift uncertainty over the time since - the tightest of these bounds is kept. */
+static void craggy_fitSamples(const CraggyTimeCache *cache, CraggyTimeCacheFit *fit) {
+
+    const double maxDrift = CRAGGY_TIME_CACHE_MAX_DRIFT_PPM * 1e-6;
+    const CraggyTimeCacheSample *newest = &cache->samples[(cache->nextSample + CRAGGY_TIME_CACHE_SAMPLES - 1) % CRAGGY_TIME_CACHE_SAMPLES];
+
+    double sumWeights = 0, sumX = 0, sumY = 0;
+    for (size_t i = 0; i < cache->numSamples; i++) {
+        const CraggyTimeCacheSample *sample = &cache->samples[i];
+        const double radius = sample->radius > 0 ? (double) sample->radius : 1;
+        const double weight = 1 / (radius * radius);
+        sumWeights += weight;
+        sumX += weight * (double) (int64_t) (sample->monotonic - newest->monotonic);
+        sumY += weight * (double) (sample->offset - newest->offset);
+    }
+    const double meanX = sumX / sumWeights;
+    const double meanY = sumY / sumWeights;
+
+    double sumXX = 0, sumXY = 0;
+    for (size_t i = 0; i < cache->numSamples; i++) {
+        const CraggyTimeCacheSample *sample = &cache->samples[i];
+        const double radius = sample->radius > 0 ? (double) sample->radius : 1;
+        const double weight = 1 / (radius * radius);
+        const double x = (double) (int64_t) (sample->monotonic - newest->monotonic) - meanX;
+        sumXX += weight * x * x;
+        sumXY += weight * x * ((double) (sample->offset - newest->offset) - meanY);
+    }
+
+    // A single sample, or samples all at once, tell nothing of the drift
+    double drift = 0;
+    double driftUncertainty = maxDrift;
+    if (sumXX > 0) {
+        drift = fmax(-maxDrift, fmin(maxDrift, sumXY / sumXX));
+        driftUncertainty = fmin(maxDrift, sqrt(1 / sumXX));
+    }
+    const double intercept = meanY - drift * meanX;
+
+    double baseUncertainty = INFINITY;
+    for (size_t i = 0; i < cache->numSamples; i++) {
+        const CraggyTimeCacheSample *sample = &cache->samples[i];
+        const double x = (double) (int64_t) (sample->monotonic - newest->monotonic);
+        const double residual = (double) (sample->offset - newest->offset) - (intercept + drift * x);
+        baseUncertainty = fmin(baseUncertainty, (double) sample->radius + fabs(residual) + fabs(x) * driftUncertainty);
+    }
+
+    fit->refMonotonic = newest->monotonic;
+    fit->refTime = newest->monotonic + (uint64_t) (newest->offset + llround(intercept));
+    fit->drift = drift;
+    fit->baseUncertainty = (uint64_t) ceil(baseUncertainty);
+    fit->driftUncertainty = driftUncertainty;
+    fit->numSamples = (uint32_t) cache->numSamples;
+}
+
+void craggy_timeCacheAdd(CraggyTimeCache *cache, craggy_rough_time_t time, uint64_t radius, uint64_t receivedAt) {
+
+    CraggyTimeCacheSample *sample = &cache->samples[cache->nextSample];
+    sample->monotonic = receivedAt;
+    sample->offset = (int64_t) (time * 1000 - receivedAt);
+    sample->radius = radius * 1000;
+    cache->nextSample = (cache->nextSample + 1) % CRAGGY_TIME_CACHE_SAMPLES;
+    if (cache->numSamples < CRAGGY_TIME_CACHE_SAMPLES) {
+        cache->numSamples++;
+    }
+
+    CraggyTimeCacheFit fit;
+    craggy_fitSamples(cache, &fit);
+
+    CraggyTimeCacheFit *published = cache->fit;
+    // Left odd by a writer that stopped midway, the sequence stays odd
+    const uint32_t sequence = atomic_load_explicit(&published->sequence, memory_order_relaxed) | 1U;
+    atomic_store_explicit(&published->sequence, sequence, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    published->refMonotonic = fit.refMonotonic;
+    published->refTime = fit.refTime;
+    published->drift = fit.drift;
+    published->baseUncertainty = fit.baseUncertainty;
+    published->driftUncertainty = fit.driftUncertainty;
+    published->numSamples = fit.numSamples;
+
+    atomic_store_explicit(&published->sequence, sequence + 1, memory_order_release);
+}
+
+/* Copies the fit as published, consistent however often the writer updates it meanwhile.  A writer that stopped midway
+ * leaves the fit odd until the next one starts - readers give up on it rather than wait. */
+static bool craggy_readFit(const CraggyTimeCache *cache, CraggyTimeCacheFit *fit) {
+
+    CraggyTimeCacheFit *published = cache->fit;
+    for (unsigned attempt = 0; attempt < CRAGGY_TIME_CACHE_READ_ATTEMPTS; attempt++) {
+        const uint32_t before = atomic_load_explicit(&published->sequence, memory_order_acquire);
+        fit->refMonotonic = published->refMonotonic;
+        fit->refTime = published->refTime;
+        fit->drift = published->drift;
+        fit->baseUncertainty = published->baseUncertainty;
+        fit->driftUncertainty = published->driftUncertainty;
+        fit->numSamples = published->numSamples;
+        atomic_thread_fence(memory_order_acquire);
+        const uint32_t after = atomic_load_explicit(&published->sequence, memory_order_relaxed);
+        if ((before & 1U) == 0 && before == after) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool craggy_now(const CraggyTimeCache *cache, uint64_t *time, uint64_t *uncertainty) {
+
+    CraggyTimeCacheFit fit;
+    if (!craggy_readFit(cache, &fit)) {
+        return false;
+    }
+
+    const uint64_t now = craggy_monotonicNs();
+    // A fit from before the machine last started would be read against a clock started afresh
+    if (fit.numSamples == 0 || now < fit.refMonotonic) {
+        return false;
+    }
+
+    const uint64_t elapsed = now - fit.refMonotonic;
+    *time = fit.refTime + elapsed + (uint64_t) llround((double) elapsed * fit.drift);
+    *uncertainty = fit.baseUncertainty + (uint64_t) ceil((double) elapsed * fit.driftUncertainty);
+    return true;
+}
+
+uint64_t craggy_timeCacheRefreshDue(const CraggyTimeCache *cache, uint64_t maxUncertainty) {
+
+    uint64_t time, uncertainty;
+    if (!craggy_now(cache, &time, &uncertainty) || uncertainty >= maxUncertainty) {
+        return 0;
+    }
+
+    CraggyTimeCacheFit fit;
+    if (!craggy_readFit(cache, &fit)) {
+        return 0;
+    }
+    const double due = (double) (maxUncertainty - uncertainty) / fit.driftUncertainty;
+    return due < (double) UINT64_MAX ? (uint64_t) due : UINT64_MAX;
+}
+
+void craggy_timeCacheClose(CraggyTimeCache *cache) {
+    if (cache == NULL) {
+        return;
+    }
+    if (cache->mapped) {
+        munmap(cache->fit, sizeof(CraggyTimeCacheFit));
+    } else {
+        craggy_free(cache->fit);
+    }
+    if (cache->path != NULL) {
+        unlink(cache->path);
+        craggy_free(cache->path);
+    }
+    craggy_free(cache);
+}
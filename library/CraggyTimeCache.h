@@ -0,0 +1,102 @@
+/* Copyright 2020 Johan Lindquist
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CRAGGY_CRAGGYTIMECACHE_H
+#define CRAGGY_CRAGGYTIMECACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "CraggyTypes.h"
+
+/** Verified samples kept, the oldest being replaced by the newest */
+#define CRAGGY_TIME_CACHE_SAMPLES 16
+
+/** Rate, in parts per million, at which the uncertainty of a single sample grows: the most the kernel slews the
+ * monotonic clock by, as good a bound on its drift as any */
+#define CRAGGY_TIME_CACHE_MAX_DRIFT_PPM 500
+
+/** Times a reader copies the fit while it is being published before giving up on it */
+#define CRAGGY_TIME_CACHE_READ_ATTEMPTS 1000
+
+/** Verified time as seen through the monotonic clock.  One writer adds samples as queries are verified, fitting the
+ * offset of the monotonic clock and its drift to the last {@link CRAGGY_TIME_CACHE_SAMPLES} of them; any number of
+ * readers ask {@link craggy_now} for the time, extrapolated from the fit without a query of their own.
+ *
+ * Kept in a file, the fit is shared by all processes mapping it - the writer, a daemon polling the servers, and
+ * readers in other processes, which never make a system call to read it.  The monotonic clock restarts with the
+ * machine, so the file is only good until then: the writer starts it afresh and removes it when closed.  The time is
+ * only as good as the processes able to write the file: it is created readable and writable by its owner alone, and
+ * only opened if owned by the effective user and writable by no one else - processes of one user share it. */
+typedef struct CraggyTimeCache CraggyTimeCache;
+
+/** Creates a cache to add samples to, starting afresh any file there is.  The file is reused rather than replaced,
+ * readers that have it mapped seeing no samples until the first is added.
+ *
+ * @param path File readers in other processes open, or NULL for a cache of this process only
+ * @param cache Cache created
+ * @param result Result of the operation - CraggyResultGeneralError if the file is not a regular file owned by the
+ * effective user and writable by its owner alone
+ * @return True if successful, otherwise false and {@link result} will indicate the error
+ */
+bool craggy_timeCacheCreate(const char *path, CraggyTimeCache **cache, CraggyResult *result);
+
+/** Maps the file of a cache created by another process, for reading only.
+ *
+ * @param path File of the cache
+ * @param cache Cache opened
+ * @param result Result of the operation - CraggyResultGeneralError if the file is not a regular file owned by the
+ * effective user and writable by its owner alone, CraggyResultParseError if it was not created by this version of the
+ * library
+ * @return True if successful, otherwise false and {@link result} will indicate the error
+ */
+bool craggy_timeCacheOpen(const char *path, CraggyTimeCache **cache, CraggyResult *result);
+
+/** Adds a verified sample and publishes the fit of all samples held.
+ *
+ * @param cache Cache created using {@link craggy_timeCacheCreate}
+ * @param time Time when the response was received, in microseconds from the epoch
+ * @param radius Uncertainty of the time, in microseconds
+ * @param receivedAt Monotonic clock when the response was received, in nanoseconds as of {@link craggy_monotonicNs}
+ */
+void craggy_timeCacheAdd(CraggyTimeCache *cache, craggy_rough_time_t time, uint64_t radius, uint64_t receivedAt);
+
+/** Extrapolates the verified time to now, making no query and, once the clock is calibrated, no system call.
+ *
+ * @param cache Cache created or opened
+ * @param time Current time, in nanoseconds from the epoch
+ * @param uncertainty Uncertainty of the time, in nanoseconds, growing from the last sample on at the rate the drift of
+ * the monotonic clock is known to
+ * @return True if successful, false if no sample has been added yet or the writer stopped midway through publishing
+ * the fit - ask the servers instead
+ */
+bool craggy_now(const CraggyTimeCache *cache, uint64_t *time, uint64_t *uncertainty);
+
+/** Tells when the servers have to be asked again for the uncertainty to stay within a bound.
+ *
+ * @param cache Cache created or opened
+ * @param maxUncertainty Largest uncertainty accepted, in nanoseconds
+ * @return Nanoseconds until the uncertainty of {@link craggy_now} exceeds the bound, 0 if it does already, no
+ * sample has been added yet or the fit could not be read
+ */
+uint64_t craggy_timeCacheRefreshDue(const CraggyTimeCache *cache, uint64_t maxUncertainty);
+
+/**
+ *
+ * @param cache
+ */
+void craggy_timeCacheClose(CraggyTimeCache *cache);
+
+#endif //CRAGGY_CRAGGYTIMECACHE_H
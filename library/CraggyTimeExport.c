@@ -0,0 +1,134 @@
+/* Copyright 2020 Johan Lindquist
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <time.h>
+
+#include "CraggyTimeExport.h"
+
+#include "CraggyOS.h"
+
+#define ERROR_OCCURRED(x) *result = x; goto error;
+
+/** Layout of the segment, shared with ntpd's refclock_shm.c and chrony's refclock_shm.c */
+typedef struct {
+    int mode;
+    volatile int count;
+    time_t clockTimeStampSec;
+    int clockTimeStampUSec;
+    time_t receiveTimeStampSec;
+    int receiveTimeStampUSec;
+    int leap;
+    int precision;
+    int nsamples;
+    volatile int valid;
+    unsigned clockTimeStampNSec;
+    unsigned receiveTimeStampNSec;
+    int dummy[8];
+} CraggyNTPSharedMemory;
+
+/** Mode 1: readers check that count is unchanged across their read */
+#define CRAGGY_NTP_SHM_MODE 1
+
+/** No leap second pending */
+#define CRAGGY_NTP_LEAP_NOWARNING 0
+
+struct CraggyTimeExport {
+    CraggyNTPSharedMemory *shm;
+};
+
+bool craggy_timeExportOpen(int unit, CraggyTimeExport **timeExport, CraggyResult *result) {
+
+    *result = CraggyResultGeneralError;
+
+    *timeExport = craggy_calloc(1, sizeof(CraggyTimeExport));
+    if (*timeExport == NULL) {
+        ERROR_OCCURRED(CraggyResultInternalError);
+    }
+
+    const int permissions = unit < 2 ? 0600 : 0666;
+    int id = shmget(CRAGGY_TIME_EXPORT_SHM_KEY + unit, sizeof(CraggyNTPSharedMemory), IPC_CREAT | permissions);
+    if (id < 0) {
+        ERROR_OCCURRED(CraggyResultInternalError);
+    }
+
+    void *shm = shmat(id, NULL, 0);
+    if (shm == (void *) -1) {
+        ERROR_OCCURRED(CraggyResultInternalError);
+    }
+    (*timeExport)->shm = shm;
+    (*timeExport)->shm->mode = CRAGGY_NTP_SHM_MODE;
+    (*timeExport)->shm->valid = 0;
+
+    *result = CraggyResultSuccess;
+    goto exit;
+
+error:
+    craggy_timeExportClose(*timeExport);
+    *timeExport = NULL;
+
+exit:
+    return *result == CraggyResultSuccess;
+}
+
+/* Precision as the SHM driver expects it, the base 2 logarithm of the uncertainty in seconds, rounded up. */
+static int craggy_precision(uint64_t radius) {
+    if (radius > UINT32_MAX) {
+        radius = UINT32_MAX;
+    }
+    // Both in units of 2^-20 microseconds, limit being 2^precision seconds
+    const uint64_t scaledRadius = radius << 20U;
+    uint64_t limit = 1000000;
+    int precision = -20;
+    while (limit < scaledRadius) {
+        limit <<= 1U;
+        precision++;
+    }
+    return precision;
+}
+
+void craggy_timeExportPublish(CraggyTimeExport *timeExport, craggy_rough_time_t time, uint64_t radius, craggy_rough_time_t receivedAt) {
+
+    CraggyNTPSharedMemory *shm = timeExport->shm;
+
+    // An odd count tells readers an update is in progress, an unchanged one that their read was consistent
+    shm->valid = 0;
+    shm->count++;
+    atomic_thread_fence(memory_order_seq_cst);
+
+    shm->clockTimeStampSec = (time_t) (time / 1000000);
+    shm->clockTimeStampUSec = (int) (time % 1000000);
+    shm->clockTimeStampNSec = (unsigned) (time % 1000000) * 1000;
+    shm->receiveTimeStampSec = (time_t) (receivedAt / 1000000);
+    shm->receiveTimeStampUSec = (int) (receivedAt % 1000000);
+    shm->receiveTimeStampNSec = (unsigned) (receivedAt % 1000000) * 1000;
+    shm->leap = CRAGGY_NTP_LEAP_NOWARNING;
+    shm->precision = craggy_precision(radius);
+    shm->nsamples = 1;
+
+    atomic_thread_fence(memory_order_seq_cst);
+    shm->count++;
+    shm->valid = 1;
+}
+
+void craggy_timeExportClose(CraggyTimeExport *timeExport) {
+    if (timeExport != NULL && timeExport->shm != NULL) {
+        shmdt(timeExport->shm);
+    }
+    craggy_free(timeExport);
+}
@@ -0,0 +1,57 @@
+/* Copyright 2020 Johan Lindquist
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef CRAGGY_CRAGGYTIMEEXPORT_H
+#define CRAGGY_CRAGGYTIMEEXPORT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "CraggyTypes.h"
+
+/** Key of the first NTP shared memory segment ("NTP0").  Unit n uses the key plus n. */
+#define CRAGGY_TIME_EXPORT_SHM_KEY 0x4e545030
+
+/** Export of verified time samples through the shared memory segment of the NTP SHM reference clock driver, as read
+ * by ntpd and chrony ("refclock SHM <unit>").  Consumers read samples straight from memory, guarded by the segment's
+ * count field - publishing a sample makes no system calls. */
+typedef struct CraggyTimeExport CraggyTimeExport;
+
+/** Attaches to the NTP shared memory segment of the unit specified, creating it if needed.  Units 0 and 1 are only
+ * accessible to root, as ntpd and chrony expect.
+ *
+ * @param unit Unit of the segment
+ * @param timeExport Export opened
+ * @param result Result of the operation
+ * @return True if successful, otherwise false and {@link result} will indicate the error
+ */
+bool craggy_timeExportOpen(int unit, CraggyTimeExport **timeExport, CraggyResult *result);
+
+/** Publishes a sample, replacing the previous one.
+ *
+ * @param timeExport Export opened using {@link craggy_timeExportOpen}
+ * @param time Time estimated from the response at the moment it was received - the midpoint corrected by half the
+ * round trip - in microseconds from the epoch
+ * @param radius Uncertainty of the time, in microseconds, published as the precision of the sample
+ * @param receivedAt Local realtime clock when the response was received, in microseconds from the epoch
+ */
+void craggy_timeExportPublish(CraggyTimeExport *timeExport, craggy_rough_time_t time, uint64_t radius, craggy_rough_time_t receivedAt);
+
+/**
+ *
+ * @param timeExport
+ */
+void craggy_timeExportClose(CraggyTimeExport *timeExport);
+
+#endif //CRAGGY_CRAGGYTIMEEXPORT_H
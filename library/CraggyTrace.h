@@ -0,0 +1,41 @@
+/* Copyright 2020 Johan Lindquist
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CRAGGY_CRAGGYTRACE_H
+#define CRAGGY_CRAGGYTRACE_H
+
+/** Static tracepoints (USDT) of the provider craggy, for bpftrace, perf or SystemTap to attach to:
+ *
+ *     bpftrace -e 'usdt:./craggy-cli:craggy:process_response__entry { @start[tid] = nsecs; }
+ *                  usdt:./craggy-cli:craggy:process_response__return { @us = hist((nsecs - @start[tid]) / 1000); }'
+ *
+ * A probe is a single nop until something attaches, its arguments only evaluated then.  Built where sys/sdt.h is
+ * there - systemtap-sdt-dev(el) - unless CRAGGY_WITH_TRACEPOINTS is turned off, and compiled out otherwise.
+ *
+ * Names ending in __entry and __return, or __start and __done, bracket what they name.  Arguments are integers. */
+#if defined(CRAGGY_WITH_TRACEPOINTS)
+#include <sys/sdt.h>
+#define CRAGGY_PROBE(name) DTRACE_PROBE(craggy, name)
+#define CRAGGY_PROBE1(name, a) DTRACE_PROBE1(craggy, name, a)
+#define CRAGGY_PROBE2(name, a, b) DTRACE_PROBE2(craggy, name, a, b)
+#define CRAGGY_PROBE3(name, a, b, c) DTRACE_PROBE3(craggy, name, a, b, c)
+#else
+#define CRAGGY_PROBE(name)
+#define CRAGGY_PROBE1(name, a)
+#define CRAGGY_PROBE2(name, a, b)
+#define CRAGGY_PROBE3(name, a, b, c)
+#endif
+
+#endif //CRAGGY_CRAGGYTRACE_H
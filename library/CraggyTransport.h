@@ -18,6 +18,34 @@
 #include <stdbool.h>
 
 #include "CraggyClient.h"
+#include "CraggyConsensus.h"
+#include "CraggyVerifyPool.h"
+
+/** Seconds after which a transport resolves the name of its server again.  The resolver does not expose the TTL of the records. */
+#define CRAGGY_TRANSPORT_RESOLVE_INTERVAL 300
+
+/** Milliseconds a transport waits for the first address of its server to answer a request before sending the request
+ * to one of the other family too (RFC 8305) */
+#define CRAGGY_TRANSPORT_RACE_DELAY_MS 250
+
+/** Milliseconds a transport waits for either address family to answer a request raced over both, before leaving the
+ * request to the address still waiting for a reply */
+#define CRAGGY_TRANSPORT_RACE_TIMEOUT_MS 1000
+
+/** Round trip times remembered per transport, for the percentiles hedged queries wait for. */
+#define CRAGGY_TRANSPORT_ROUND_TRIP_HISTORY 64
+
+/** Fewest round trips a percentile is taken from. */
+#define CRAGGY_TRANSPORT_MIN_ROUND_TRIPS 8
+
+/** Percentile of a server's round trips a hedged query waits for before asking the next server. */
+#define CRAGGY_HEDGE_PERCENTILE 95
+
+/** Milliseconds a hedged query waits for a server with too few round trips on record for a percentile. */
+#define CRAGGY_HEDGE_DEFAULT_DELAY_MS 250
+
+/** A transport to one server, holding its resolved address and connected socket between requests. */
+typedef struct CraggyTransport CraggyTransport;
 
 /** Send a Roughtime request to the server and return the response received.
  *
@@ -30,4 +58,455 @@
  */
 bool craggy_makeRequest(const char *address, const craggy_rough_time_request_t requestBuf, CraggyResult *result, craggy_rough_time_response_t *responseBuf, size_t *responseBufLen);
 
+/** Opens a transport to the server specified, resolving its name and connecting a socket.
+ *
+ * @param address The host/port of the server.  In the form of <hostname> or <hostname:port>.  If port is omitted, the transports default value will be used.
+ * @param transport Transport opened
+ * @param result Result of transport operation
+ * @return True if successful, otherwise false (and result will indicate the error)
+ */
+bool craggy_transportOpen(const char *address, CraggyTransport **transport, CraggyResult *result);
+
+/** Send a Roughtime request over an open transport and return the response received.  The socket is reused between
+ * requests; after a failure, or once {@link CRAGGY_TRANSPORT_RESOLVE_INTERVAL} has passed, the next request resolves
+ * the name of the server again and reconnects.
+ *
+ * @param transport Transport opened using {@link craggy_transportOpen}
+ * @param requestBuf Buffer containing the request to send.
+ * @param result Result of transport operation
+ * @param responseBuf Buffer used for response
+ * @param responseBufLen Size of the response buffer.  If a response is successfully received, the corresponding size of the response is signalled here too.
+ * @return True if the request is successful, otherwise false (and result will indicate the error)
+ */
+bool craggy_transportRequest(CraggyTransport *transport, const craggy_rough_time_request_t requestBuf, CraggyResult *result, craggy_rough_time_response_t *responseBuf, size_t *responseBufLen);
+
+/** Kernel timestamps of a request and its response, in nanoseconds from the epoch.  Zero if not available. */
+typedef struct {
+    uint64_t sent;
+    uint64_t received;
+} CraggyTransportTimestamps;
+
+/** Has the kernel timestamp the requests sent and responses received over a transport (SO_TIMESTAMPING), so the
+ * round trip can be measured on the wire rather than around the request in user space.
+ *
+ * @param transport Transport opened using {@link craggy_transportOpen}
+ * @param hardware Use the timestamps of the network interface rather than those of the kernel.  The interface has to be
+ * configured for timestamping separately (SIOCSHWTSTAMP).
+ * @param result Result of transport operation
+ * @return True if successful, otherwise false (and result will indicate the error)
+ */
+bool craggy_transportEnableTimestamps(CraggyTransport *transport, bool hardware, CraggyResult *result);
+
+/** Send a Roughtime request as {@link craggy_transportRequest} does, also returning the kernel timestamps of the request
+ * and response if enabled with {@link craggy_transportEnableTimestamps}.
+ *
+ * @param transport Transport opened using {@link craggy_transportOpen}
+ * @param requestBuf Buffer containing the request to send.
+ * @param result Result of transport operation
+ * @param responseBuf Buffer used for response
+ * @param responseBufLen Size of the response buffer.  If a response is successfully received, the corresponding size of the response is signalled here too.
+ * @param timestamps Timestamps of the request and response, each zero if not available
+ * @return True if the request is successful, otherwise false (and result will indicate the error)
+ */
+bool craggy_transportRequestWithTimestamps(CraggyTransport *transport, const craggy_rough_time_request_t requestBuf, CraggyResult *result, craggy_rough_time_response_t *responseBuf, size_t *responseBufLen, CraggyTransportTimestamps *timestamps);
+
+/** Operations of a transport carried by the host's own network stack rather than the library's sockets - the raw API
+ * of lwIP, say.  Responses are lent by the stack and verified where they lie, never copied by the library except into
+ * the caller's buffer by {@link craggy_transportRequest}.  All are called on the thread using the transport. */
+typedef struct {
+    /** Sends a request to the server.  The request is only lent for the call.
+     *
+     * @return True if sent, otherwise false (and result will indicate the error)
+     */
+    bool (*send)(void *context, const uint8_t *requestBuf, size_t requestBufLen, CraggyResult *result);
+    /** Waits for a datagram from the server, up to the timeout specified - 0 to only take one already there.
+     *
+     * @param responseBuf Datagram received, lent until handed back through release
+     * @param timestamps Times the request was sent and the datagram received, in nanoseconds from the epoch, each zero
+     * if not known
+     * @return True if a datagram was received, otherwise false (and result will indicate the error,
+     * CraggyResultNetworkTimeout if none arrived)
+     */
+    bool (*receive)(void *context, int timeoutMs, const uint8_t **responseBuf, size_t *responseBufLen, CraggyTransportTimestamps *timestamps, CraggyResult *result);
+    /** Hands back a datagram lent by receive.  NULL if there is nothing to hand back. */
+    void (*release)(void *context, const uint8_t *responseBuf);
+    /** Descriptor that polls readable when a datagram is there, letting {@link craggy_queryServers} wait on several
+     * transports at once.  NULL, or -1 returned, if there is none: such transports are asked every
+     * {@link CRAGGY_TRANSPORT_POLL_INTERVAL_MS} instead. */
+    int (*getFd)(void *context);
+    /** Releases the context as the transport is closed.  NULL if there is nothing to release. */
+    void (*close)(void *context);
+} CraggyTransportOps;
+
+/** Milliseconds between asking transports without a descriptor for responses while waiting on several */
+#define CRAGGY_TRANSPORT_POLL_INTERVAL_MS 1
+
+/** Opens a transport carried by the operations given instead of a socket.  Such a transport works with
+ * {@link craggy_transportRequest}, {@link craggy_transportQuery}, {@link craggy_queryServers} and
+ * {@link craggy_queryHedged}; {@link craggy_requestStart} and the batch transport need sockets of their own and fail
+ * with CraggyResultGeneralError.
+ *
+ * @param ops Operations of the transport, must outlive it
+ * @param context Passed to the operations
+ * @param transport Transport opened
+ * @param result Result of transport operation
+ * @return True if successful, otherwise false (and result will indicate the error)
+ */
+bool craggy_transportOpenWith(const CraggyTransportOps *ops, void *context, CraggyTransport **transport, CraggyResult *result);
+
+/** Largest response received */
+#define CRAGGY_TRANSPORT_MAX_RESPONSE_SIZE (3 * CRAGGY_ROUGH_TIME_MIN_REQUEST_SIZE)
+
+/** A query of one server, as made by {@link craggy_queryServers}. */
+typedef struct {
+    /** Transport to the server, opened using {@link craggy_transportOpen} */
+    CraggyTransport *transport;
+    /** The root public key of the server */
+    const uint8_t *rootPublicKey;
+    /** Nonce to send the server */
+    const uint8_t *nonce;
+    /** Result of the query - CraggyResultNetworkTimeout if no response arrived in time */
+    CraggyResult result;
+    /** Midpoint of the response */
+    craggy_rough_time_t time;
+    /** Radius of the response */
+    craggy_rough_time_radius_t radius;
+    /** Time from sending the request to receiving the response, in microseconds */
+    uint64_t roundTripTime;
+    /** Local realtime clock when the response arrived, in microseconds from the epoch */
+    craggy_rough_time_t receivedAt;
+    /** Buffer of {@link CRAGGY_TRANSPORT_MAX_RESPONSE_SIZE} bytes to keep a valid response in, for auditing, or NULL */
+    uint8_t *responseBuf;
+    /** Length of the response kept, 0 if none was */
+    size_t responseLen;
+} CraggyServerQuery;
+
+/** Queries several servers at once.  Requests are sent to all servers up front and responses are collected as they
+ * arrive, each being verified using {@link craggy_processResponseWithCache} straight away.  The first response from
+ * a server decides its result.
+ *
+ * @param queries Servers to query, each receiving its own result
+ * @param numQueries Number of servers
+ * @param cache Delegation cache to use, or NULL
+ * @param timeoutMs Time to wait for all responses, in milliseconds
+ * @return True if every server responded with a valid response, otherwise false
+ */
+bool craggy_queryServers(CraggyServerQuery *queries, size_t numQueries, CraggyDelegationCache *cache, int timeoutMs);
+
+/** As {@link craggy_queryServers}, with the responses verified on the workers of a pool while the calling thread
+ * carries on receiving - keeping the round trip times of late responses clear of the verification of earlier ones.
+ * The workers use delegation caches of their own.
+ *
+ * @param queries Servers to query, each receiving its own result
+ * @param numQueries Number of servers
+ * @param pool Pool to verify the responses on
+ * @param timeoutMs Time to wait for all responses, in milliseconds
+ * @return True if every server responded with a valid response, otherwise false
+ */
+bool craggy_queryServersOnPool(CraggyServerQuery *queries, size_t numQueries, CraggyVerifyPool *pool, int timeoutMs);
+
+/** As {@link craggy_queryServers}, but done as soon as a quorum of the verified responses agree - their intervals
+ * midpoint ± radius, widened by half the round trip as in {@link craggy_makeTimeSample}, sharing a common part - rather
+ * than waiting for the slowest server.  It also gives up once too few servers are left to make a quorum.
+ *
+ * @param queries Servers to query, each receiving its own result.  Those not waited for once a quorum agreed are left
+ * with CraggyResultNetworkTimeout, those that answered keep their results for auditing.
+ * @param numQueries Number of servers
+ * @param cache Delegation cache to use, or NULL
+ * @param quorum Number of servers that have to agree, from 1 to numQueries
+ * @param timeoutMs Time to wait for a quorum, in milliseconds
+ * @param consensus Consensus of the responses received, set even if no quorum agreed
+ * @return True if a quorum agreed, otherwise false
+ */
+bool craggy_queryQuorum(CraggyServerQuery *queries, size_t numQueries, CraggyDelegationCache *cache, size_t quorum, int timeoutMs, CraggyConsensus *consensus);
+
+/** Queries redundant servers for one verified response, hedging against a server that is slow or loses a packet.
+ * The servers are asked in order: the first straight away, each next one once the server asked last has not answered
+ * within the {@link CRAGGY_HEDGE_PERCENTILE}th percentile of its round trips, or at once if it failed.  The first valid
+ * response wins and the requests still outstanding are dropped.
+ *
+ * @param queries Servers to query, in order of preference, each with a nonce of its own.  Servers not asked, or not
+ * answering before the winner, are left with CraggyResultNetworkTimeout.
+ * @param numQueries Number of servers
+ * @param cache Delegation cache to use, or NULL
+ * @param timeoutMs Time to wait for a valid response, in milliseconds
+ * @param answered Index of the query that was answered, numQueries if none was
+ * @return True if a server responded with a valid response, otherwise false
+ */
+bool craggy_queryHedged(CraggyServerQuery *queries, size_t numQueries, CraggyDelegationCache *cache, int timeoutMs, size_t *answered);
+
+/** Records the round trip time of a response received over a transport.  Queries made by the library record theirs;
+ * hosts driving a {@link CraggyRequest} of their own can record its round trip here.
+ *
+ * @param transport Transport the request was made on
+ * @param roundTripTime Time from sending the request to receiving the response, in microseconds
+ */
+void craggy_transportRecordRoundTrip(CraggyTransport *transport, uint64_t roundTripTime);
+
+/** Retransmission timeout of a transport before its first response, in milliseconds */
+#define CRAGGY_TRANSPORT_INITIAL_RTO_MS 1000
+
+/** Least retransmission timeout, in milliseconds, leaving room for servers that batch requests */
+#define CRAGGY_TRANSPORT_MIN_RTO_MS 100
+
+/** Most retransmission timeout, in milliseconds, however far backed off */
+#define CRAGGY_TRANSPORT_MAX_RTO_MS 10000
+
+/** Most attempts {@link craggy_transportQuery} makes */
+#define CRAGGY_TRANSPORT_MAX_ATTEMPTS 8
+
+/** Round trip estimate of a transport (RFC 6298), from responses to queries made by the library and those recorded using
+ * {@link craggy_transportRecordRoundTrip}.  Times are in microseconds. */
+typedef struct {
+    /** Smoothed round trip time, 0 before the first response */
+    uint64_t smoothedRoundTrip;
+    /** Mean deviation of the round trip time */
+    uint64_t roundTripVariation;
+    /** Time to wait for a response before sending the request again */
+    uint64_t retransmissionTimeout;
+    /** Round trips on record, up to {@link CRAGGY_TRANSPORT_ROUND_TRIP_HISTORY} */
+    size_t numRoundTrips;
+    /** Attempts of {@link craggy_transportQuery} that went unanswered */
+    uint64_t timeouts;
+    /** Requests sent again by {@link craggy_transportQuery} */
+    uint64_t retransmissions;
+} CraggyTransportStats;
+
+/** Returns the round trip estimate of a transport, for hosts choosing between servers.
+ *
+ * @param transport Transport opened using {@link craggy_transportOpen}
+ * @param stats Estimate of the transport
+ */
+void craggy_transportGetStats(const CraggyTransport *transport, CraggyTransportStats *stats);
+
+/** Room for the address of a server in {@link CraggyTransportState}, that of IPv6 with some to spare */
+#define CRAGGY_TRANSPORT_STATE_PEER_LENGTH 32
+
+/** What a transport has learnt about its server that is worth keeping across restarts: the address its name resolved
+ * to and the round trip estimate.  Plain data, to be written to a file as it is. */
+typedef struct {
+    /** Address of the server as a struct sockaddr, peerLen bytes of it */
+    uint8_t peer[CRAGGY_TRANSPORT_STATE_PEER_LENGTH];
+    /** Length of the address, zero if the name has not been resolved */
+    uint32_t peerLen;
+    /** Local realtime clock when the name was resolved, in microseconds from the epoch */
+    craggy_rough_time_t resolvedAt;
+    /** As in {@link CraggyTransportStats}, in microseconds */
+    uint64_t smoothedRoundTrip;
+    uint64_t roundTripVariation;
+    uint64_t retransmissionTimeout;
+} CraggyTransportState;
+
+/** Returns what a transport has learnt about its server, for {@link craggy_transportOpenFromState} to start from.
+ *
+ * @param transport Transport opened using {@link craggy_transportOpen}
+ * @param state State of the transport
+ */
+void craggy_transportGetState(const CraggyTransport *transport, CraggyTransportState *state);
+
+/** As {@link craggy_transportOpen}, starting from a state saved by an earlier run.  An address resolved less than
+ * {@link CRAGGY_TRANSPORT_RESOLVE_INTERVAL} ago is connected to without resolving the name, which is resolved again
+ * once the interval is up.  The round trip estimate is taken over, so the first requests do not wait out the initial
+ * retransmission timeout.
+ *
+ * @param address The host/port of the server, as for {@link craggy_transportOpen}
+ * @param state State saved using {@link craggy_transportGetState}, or NULL to start cold
+ * @param transport Transport opened
+ * @param result Result of transport operation
+ * @return True if successful, otherwise false (and result will indicate the error)
+ */
+bool craggy_transportOpenFromState(const char *address, const CraggyTransportState *state, CraggyTransport **transport, CraggyResult *result);
+
+/** Queries a server for a verified response, sending the request again whenever it goes unanswered for the
+ * retransmission timeout of the transport.  Each retransmission carries a fresh nonce and doubles the timeout, and a
+ * late response to an earlier attempt is as good as one to the latest.
+ *
+ * @param transport Transport opened using {@link craggy_transportOpen}
+ * @param rootPublicKey Long-term public key of the server
+ * @param cache Delegation cache to use, or NULL
+ * @param maxAttempts Most requests to send, 1 to {@link CRAGGY_TRANSPORT_MAX_ATTEMPTS}
+ * @param nonce Nonce of the first request.  Holds the nonce of the one answered on return, or of the last one sent.
+ * @param result Result of the query
+ * @param time Time from the response
+ * @param radius Radius from the response
+ * @param roundTripTime Round trip time of the request answered, in microseconds
+ * @return True if the server responded with a valid response, otherwise false
+ */
+bool craggy_transportQuery(CraggyTransport *transport, const craggy_rough_time_public_key_t rootPublicKey, CraggyDelegationCache *cache, unsigned int maxAttempts, craggy_rough_time_nonce_t nonce, CraggyResult *result, craggy_rough_time_t *time, craggy_rough_time_radius_t *radius, uint64_t *roundTripTime);
+
+/** Returns a percentile of the latest {@link CRAGGY_TRANSPORT_ROUND_TRIP_HISTORY} round trips over a transport.
+ *
+ * @param transport Transport opened using {@link craggy_transportOpen}
+ * @param percentile Percentile, 0 to 100
+ * @return The percentile in microseconds, 0 if fewer than {@link CRAGGY_TRANSPORT_MIN_ROUND_TRIPS} round trips are on record
+ */
+uint64_t craggy_transportGetRoundTripPercentile(const CraggyTransport *transport, unsigned int percentile);
+
+/** A single request made without blocking, for hosts driving many requests from their own event loop (epoll, libuv
+ * and the like).  Each request has a socket of its own for the host to watch, connected to the server of the
+ * transport it was started on. */
+typedef struct CraggyRequest CraggyRequest;
+
+/** Progress of a {@link CraggyRequest}. */
+typedef enum {
+    /** Waiting for the response */
+    CraggyRequestStatePending,
+    /** A valid response was received */
+    CraggyRequestStateComplete,
+    /** The request failed, timed out or was answered with an invalid response */
+    CraggyRequestStateFailed
+} CraggyRequestState;
+
+/** Sends a request without waiting for its response.  The name of the server is resolved only if the transport is due
+ * to do so, see {@link craggy_transportRequest}.
+ *
+ * @param transport Transport to the server, opened using {@link craggy_transportOpen}.  Any number of requests may be
+ * outstanding on one transport.
+ * @param rootPublicKey The root public key of the server
+ * @param nonce Nonce to send the server
+ * @param cache Delegation cache to verify the response with, or NULL.  Must outlive the request.
+ * @param timeoutMs Time to wait for the response, in milliseconds
+ * @param request Request started
+ * @param result Result of transport operation
+ * @return True if the request was sent, otherwise false (and result will indicate the error)
+ */
+bool craggy_requestStart(CraggyTransport *transport, const craggy_rough_time_public_key_t rootPublicKey, const craggy_rough_time_nonce_t nonce, CraggyDelegationCache *cache, int timeoutMs, CraggyRequest **request, CraggyResult *result);
+
+/**
+ *
+ * @param request
+ * @return Descriptor for the host to watch for readability
+ */
+int craggy_requestGetFd(const CraggyRequest *request);
+
+/**
+ *
+ * @param request
+ * @return Time by which the response must arrive, in microseconds of CLOCK_MONOTONIC
+ */
+uint64_t craggy_requestGetDeadline(const CraggyRequest *request);
+
+/** Reads and verifies the response once the descriptor of the request is readable.  Never blocks.  The first response
+ * decides the outcome of the request.
+ *
+ * @param request Request started using {@link craggy_requestStart}
+ * @return State of the request - still pending if nothing was there to read
+ */
+CraggyRequestState craggy_requestOnReadable(CraggyRequest *request);
+
+/** Fails the request with CraggyResultNetworkTimeout if its deadline has passed without a response.
+ *
+ * @param request Request started using {@link craggy_requestStart}
+ * @return State of the request
+ */
+CraggyRequestState craggy_requestOnDeadline(CraggyRequest *request);
+
+/** Returns the outcome of a request that is no longer pending.
+ *
+ * @param request Request started using {@link craggy_requestStart}
+ * @param result Result of the request
+ * @param time Midpoint of the response
+ * @param radius Radius of the response
+ * @param roundTripTime Time from sending the request to receiving the response, in microseconds
+ * @return True if the request completed with a valid response, otherwise false (and result will indicate the error)
+ */
+bool craggy_requestGetResponse(const CraggyRequest *request, CraggyResult *result, craggy_rough_time_t *time, craggy_rough_time_radius_t *radius, uint64_t *roundTripTime);
+
+/** Returns the packets a request exchanged with its server, as sent and as received, for recording them.
+ *
+ * @param request Request started using {@link craggy_requestStart}
+ * @param requestBuf The request sent, valid until the request is destroyed
+ * @param requestBufLen Size of the request
+ * @param responseBuf The response received, whether valid or not, or NULL if none was.  Valid until the request is destroyed.
+ * @param responseBufLen Size of the response, 0 if none was received
+ */
+void craggy_requestGetPackets(const CraggyRequest *request, const uint8_t **requestBuf, size_t *requestBufLen, const craggy_rough_time_response_t **responseBuf, size_t *responseBufLen);
+
+/**
+ *
+ * @param request
+ */
+void craggy_requestDestroy(CraggyRequest *request);
+
+/** A transport for sending requests to many servers in batches, using as few system calls as possible (sendmmsg and
+ * recvmmsg where available, or io_uring when built with CRAGGY_WITH_IO_URING and the kernel allows).  Replies are
+ * matched to the requests outstanding by nonce. */
+typedef struct CraggyBatchTransport CraggyBatchTransport;
+
+/** A request to send using {@link craggy_batchTransportSend}. */
+typedef struct {
+    /** Server to send to, its address as resolved by {@link craggy_transportOpen} */
+    const CraggyTransport *server;
+    /** Nonce in the request */
+    const uint8_t *nonce;
+    /** Request prepared using {@link craggy_createRequest} */
+    const uint8_t *requestBuf;
+    /** Identifies the request in its reply */
+    uint64_t requestId;
+} CraggyBatchRequest;
+
+/** A reply received by {@link craggy_batchTransportReceive}. */
+typedef struct {
+    uint64_t requestId;
+    /** Points into the transport's response buffers, valid until the next receive */
+    const craggy_rough_time_response_t *response;
+    size_t responseLen;
+    /** Time from sending the request to receiving the reply, in microseconds */
+    uint64_t roundTripTime;
+} CraggyBatchReply;
+
+/** Opens a batch transport.
+ *
+ * @param maxOutstanding Maximum number of requests awaiting a reply
+ * @param numResponseBuffers Number of response buffers, the most replies one receive can return
+ * @param batch Transport opened
+ * @param result Result of transport operation
+ * @return True if successful, otherwise false (and result will indicate the error)
+ */
+bool craggy_batchTransportOpen(size_t maxOutstanding, size_t numResponseBuffers, CraggyBatchTransport **batch, CraggyResult *result);
+
+/** Sends requests, as many per system call as possible.
+ *
+ * @param batch Batch transport
+ * @param requests Requests to send
+ * @param numRequests Number of requests
+ * @param numSent Number of requests sent - fewer than requested if too many requests are outstanding or sending failed
+ * @param result Result of transport operation
+ * @return True if all requests were sent, otherwise false (and result will indicate the error)
+ */
+bool craggy_batchTransportSend(CraggyBatchTransport *batch, const CraggyBatchRequest *requests, size_t numRequests, size_t *numSent, CraggyResult *result);
+
+/** Receives the replies available, waiting up to the timeout specified for the first.  Replies not matching any
+ * outstanding request are dropped.  Replies still have to be verified, see {@link craggy_processResponseWithCache}.
+ *
+ * @param batch Batch transport
+ * @param timeoutMs Time to wait for replies, in milliseconds
+ * @param replies Replies received
+ * @param maxReplies Size of the replies array
+ * @param numReplies Number of replies received
+ * @param result Result of transport operation
+ * @return True if successful (even if no replies arrived), otherwise false (and result will indicate the error)
+ */
+bool craggy_batchTransportReceive(CraggyBatchTransport *batch, int timeoutMs, CraggyBatchReply *replies, size_t maxReplies, size_t *numReplies, CraggyResult *result);
+
+/** Gives up on requests that have been outstanding for longer than the age specified.
+ *
+ * @param batch Batch transport
+ * @param maxAgeMs Maximum age of an outstanding request, in milliseconds
+ * @return Number of requests given up on
+ */
+size_t craggy_batchTransportExpire(CraggyBatchTransport *batch, int maxAgeMs);
+
+/**
+ *
+ * @param batch
+ */
+void craggy_batchTransportClose(CraggyBatchTransport *batch);
+
+/**
+ *
+ * @param transport
+ */
+void craggy_transportClose(CraggyTransport *transport);
+
 #endif //CRAGGY_UDPTRANSPORT_H
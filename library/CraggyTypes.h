@@ -31,7 +31,8 @@ typedef enum {
     CraggyResultNetworkInternalError = 401,
     CraggyResultNetworkNameLookupError = 402,
     CraggyResultNetworkTimeout = 403,
-    CraggyResultNetworkConnectionError = 404
+    CraggyResultNetworkConnectionError = 404,
+    CraggyResultConsensusError = 500
 } CraggyResult;
 
 #define CRAGGY_ROUGH_TIME_MIN_REQUEST_SIZE 1024
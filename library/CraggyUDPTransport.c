@@ -14,67 +14,221 @@
  * limitations under the License.
  */
 
+#if defined(__linux__)
+#define _GNU_SOURCE // sendmmsg and recvmmsg
+#endif
+
 #include <memory.h>
 #include <arpa/inet.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
 #include <stdbool.h>
 #include <assert.h>
 
+#if defined(__linux__)
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+#endif
+
 #include "CraggyTransport.h"
 #include "CraggyTypes.h"
 #include "CraggyClient.h"
+#include "CraggyClock.h"
 #include "CraggyOS.h"
+#include "CraggyStats.h"
+#include "CraggyTrace.h"
+
+#if defined(CRAGGY_WITH_IO_URING)
+#include "CraggyUring.h"
+#endif
 
 #define ERROR_OCCURRED(x) *result = x; goto error;
 
-bool craggy_createSocket(int *outSocket, const char *address, CraggyResult *result) {
+#define CRAGGY_UDP_DEFAULT_PORT "2002"
 
-    *result = CraggyResultGeneralError;
+/** Largest response accepted */
+#define CRAGGY_UDP_MAX_RESPONSE_SIZE CRAGGY_TRANSPORT_MAX_RESPONSE_SIZE
+
+/** Seconds to wait for a response */
+#define CRAGGY_UDP_RECEIVE_TIMEOUT 10
+
+/** Most requests handed to the kernel in one sendmmsg call */
+#define CRAGGY_UDP_SEND_VECTOR_LENGTH 64
+
+struct CraggyTransport {
+    // Operations carrying the transport in place of the socket, NULL for the socket
+    const CraggyTransportOps *ops;
+    void *context;
+    // host and port both point into this buffer
+    char *address;
+    const char *host;
+    const char *port;
+    int fd;
+    struct timespec resolvedAt;
+    // SO_TIMESTAMPING flags to apply whenever the socket is (re)created, zero if not timestamping
+    int timestampFlags;
+    // Address the socket is connected to, also the destination for batched requests
+    struct sockaddr_storage peer;
+    socklen_t peerLen;
+    // Address family that answered first when both were raced, AF_UNSPEC until one did
+    int family;
+    // Address of the other family, raced against peer with each request until one of them answers, length zero if none
+    struct sockaddr_storage alternative;
+    socklen_t alternativeLen;
+    // Monotonic clock when the latest request was sent, in microseconds - to the address that won, if raced
+    uint64_t sentAt;
+    // Round trip times of the latest responses in microseconds, nextRoundTrip being the oldest once all are used
+    uint64_t roundTrips[CRAGGY_TRANSPORT_ROUND_TRIP_HISTORY];
+    size_t numRoundTrips;
+    size_t nextRoundTrip;
+    // Round trip estimate and retransmission timeout, in microseconds (RFC 6298)
+    uint64_t smoothedRoundTrip;
+    uint64_t roundTripVariation;
+    uint64_t retransmissionTimeout;
+    uint64_t timeouts;
+    uint64_t retransmissions;
+};
+
+typedef struct {
+    bool waiting;
+    uint64_t requestId;
+    craggy_rough_time_nonce_t nonce;
+    // Leaf of the nonce in the Merkle tree, the root of a reply to the request alone
+    uint8_t leaf[CRAGGY_ROUGH_TIME_HASH_LENGTH];
+    struct sockaddr_storage peer;
+    socklen_t peerLen;
+    uint64_t sentAt;
+} CraggyOutstandingRequest;
 
-    char *host = malloc(strlen(address) + 1);
-    host = strcpy(host, address);
-    char *port = "2002";
+struct CraggyRequest {
+    // Socket of the request alone, non-blocking and connected to the server
+    int fd;
+    craggy_rough_time_nonce_t nonce;
+    craggy_rough_time_public_key_t rootPublicKey;
+    CraggyDelegationCache *cache;
+    uint64_t sentAt;
+    uint64_t deadline;
+    CraggyRequestState state;
+    CraggyResult result;
+    craggy_rough_time_t time;
+    craggy_rough_time_radius_t radius;
+    uint64_t roundTripTime;
+    // The packets exchanged, for hosts recording them
+    craggy_rough_time_request_t requestBuf;
+    craggy_rough_time_response_t responseBuf[CRAGGY_UDP_MAX_RESPONSE_SIZE];
+    size_t responseLen;
+};
 
-    char* colonPtr = strchr(address,':');
-    if (colonPtr != NULL)
-    {
-        port = colonPtr+1;
-        host[colonPtr - address] = '\0';
+struct CraggyBatchTransport {
+    // One unconnected socket per address family, opened when first needed
+    int fd4;
+    int fd6;
+
+    // Requests in the order sent, oldest at head.  Requests answered stay in place until those before them are done.
+    CraggyOutstandingRequest *outstanding;
+    size_t maxOutstanding;
+    size_t head;
+    size_t numOutstanding;
+
+    // Open addressing table of the requests waiting, keyed by the first bytes of their leaves, with linear probing.
+    // Each slot holds the index of its request plus one, zero if empty.  Twice as many slots as requests, a power of two.
+    size_t *pending;
+    size_t pendingMask;
+
+    size_t numResponseBuffers;
+    craggy_rough_time_response_t *responseBuffers;
+    struct sockaddr_storage *responseAddresses;
+#if defined(__linux__)
+    struct mmsghdr *responseMessages;
+    struct iovec *responseVectors;
+#endif
+#if defined(CRAGGY_WITH_IO_URING)
+    // Sends and receives in place of sendmmsg and recvmmsg if the kernel allows, otherwise NULL
+    CraggyUring *uring;
+#endif
+};
+
+/* Opens a socket connected to an address, -1 if that fails. */
+static int craggy_openSocket(const struct addrinfo *addr) {
+    int sock = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+    if (sock < 0) {
+        return -1;
+    }
+    if (connect(sock, addr->ai_addr, addr->ai_addrlen)) {
+        close(sock);
+        return -1;
     }
 
+    struct timeval timeout;
+    timeout.tv_sec = CRAGGY_UDP_RECEIVE_TIMEOUT;
+    timeout.tv_usec = 0;
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    return sock;
+}
+
+/* Resolves a server and opens a socket connected to it.  Where the name resolves to both address families and none is
+ * known to work, an address of the other one is left in alternative for the requests to race against the first. */
+static bool craggy_createSocket(int *outSocket, const char *host, const char *port, int family, struct sockaddr_storage *peer, socklen_t *peerLen, struct sockaddr_storage *alternative, socklen_t *alternativeLen, CraggyResult *result) {
+
+    *result = CraggyResultGeneralError;
+
+    int sock = -1;
+
     struct addrinfo hints;
     craggy_memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
     hints.ai_socktype = SOCK_DGRAM;
     hints.ai_protocol = IPPROTO_UDP;
     hints.ai_flags = AI_NUMERICSERV;
 
-    // FIXME: Handle IPV6
-
     struct addrinfo* addrs = NULL;
+    CRAGGY_STATS_START(lookupStart);
     int r = getaddrinfo(host, port, &hints, &addrs);
+    CRAGGY_STATS_RECORD(CraggyStageNameLookup, lookupStart);
     if (r != 0) {
+        addrs = NULL;
         ERROR_OCCURRED(CraggyResultNetworkNameLookupError);
     }
 
-    int sock = socket(addrs->ai_family, addrs->ai_socktype, addrs->ai_protocol);
-    if (sock < 0) {
-        ERROR_OCCURRED(CraggyResultNetworkInternalError);
+    CRAGGY_STATS_START(setupStart);
+
+    // The family that won before is used straight away, if the name still resolves to it
+    const struct addrinfo *chosen = NULL;
+    const struct addrinfo *other = NULL;
+    for (const struct addrinfo *addr = addrs; addr != NULL; addr = addr->ai_next) {
+        if (addr->ai_family == family) {
+            chosen = addr;
+            break;
+        }
+        if (other == NULL && addr->ai_family != addrs->ai_family) {
+            other = addr;
+        }
     }
 
-    if (connect(sock, addrs->ai_addr, addrs->ai_addrlen)) {
+    *alternativeLen = 0;
+    if (chosen == NULL) {
+        // In the order the resolver sorted them (RFC 6724), IPv6 first where it is expected to work
+        chosen = addrs;
+        if (other != NULL) {
+            craggy_memcpy(alternative, other->ai_addr, other->ai_addrlen);
+            *alternativeLen = other->ai_addrlen;
+        }
+    }
+    sock = craggy_openSocket(chosen);
+    CRAGGY_STATS_RECORD(CraggyStageSocketSetup, setupStart);
+    if (sock < 0) {
         ERROR_OCCURRED(CraggyResultNetworkConnectionError);
     }
 
-    char dest_str[INET6_ADDRSTRLEN];
-    r = getnameinfo(addrs->ai_addr, addrs->ai_addrlen, dest_str, sizeof(dest_str),NULL /* don't want port information */, 0, NI_NUMERICHOST);
-
-    if (r != 0) {
-        ERROR_OCCURRED(CraggyResultNetworkNameLookupError)
-    }
+    craggy_memcpy(peer, chosen->ai_addr, chosen->ai_addrlen);
+    *peerLen = chosen->ai_addrlen;
 
     *outSocket = sock;
     *result = CraggyResultSuccess;
@@ -83,57 +237,1736 @@ bool craggy_createSocket(int *outSocket, const char *address, CraggyResult *resu
 
 error:
     assert(*result != CraggyResultSuccess);
-    close(sock);
 
 exit:
-    freeaddrinfo(addrs);
-    craggy_free(host);
+    if (addrs != NULL) {
+        freeaddrinfo(addrs);
+    }
     return *result == CraggyResultSuccess;
 }
 
-bool craggy_makeRequest(const char *address, const craggy_rough_time_request_t requestBuf, CraggyResult *result, craggy_rough_time_response_t *responseBuf, size_t *responseBufLen) {
+static void craggy_closeSocket(CraggyTransport *transport) {
+    if (transport->fd >= 0) {
+        close(transport->fd);
+        transport->fd = -1;
+    }
+}
+
+/* Closes the socket after a failure.  The family raced for may be the one broken now, so it is raced for again. */
+static void craggy_disconnect(CraggyTransport *transport) {
+    craggy_closeSocket(transport);
+    transport->family = AF_UNSPEC;
+}
+
+static bool craggy_connect(CraggyTransport *transport, CraggyResult *result) {
+    craggy_closeSocket(transport);
+    if (!craggy_createSocket(&transport->fd, transport->host, transport->port, transport->family, &transport->peer, &transport->peerLen, &transport->alternative, &transport->alternativeLen, result)) {
+        transport->fd = -1;
+        return false;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &transport->resolvedAt);
+
+#if defined(SO_TIMESTAMPING)
+    if (transport->timestampFlags != 0 &&
+        setsockopt(transport->fd, SOL_SOCKET, SO_TIMESTAMPING, &transport->timestampFlags, sizeof(transport->timestampFlags)) != 0) {
+        craggy_disconnect(transport);
+        *result = CraggyResultNetworkInternalError;
+        return false;
+    }
+#endif
+    return true;
+}
+
+bool craggy_transportEnableTimestamps(CraggyTransport *transport, bool hardware, CraggyResult *result) {
+
+    if (transport->ops != NULL) {
+        // Timestamped, if at all, by the operations' receive
+        *result = CraggyResultSuccess;
+        return true;
+    }
 
+#if defined(SO_TIMESTAMPING)
+    int flags = SOF_TIMESTAMPING_OPT_TSONLY;
+    if (hardware) {
+        flags |= SOF_TIMESTAMPING_TX_HARDWARE | SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE;
+    } else {
+        flags |= SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+    }
+    transport->timestampFlags = flags;
+
+    if (transport->fd >= 0 && setsockopt(transport->fd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) != 0) {
+        transport->timestampFlags = 0;
+        *result = CraggyResultNetworkInternalError;
+        return false;
+    }
+    *result = CraggyResultSuccess;
+    return true;
+#else
+    (void) transport;
+    (void) hardware;
     *result = CraggyResultGeneralError;
+    return false;
+#endif
+}
 
-    int fd = 0;
-    if (!craggy_createSocket(&fd, address,result)) {
-        ERROR_OCCURRED(*result);
+#if defined(SO_TIMESTAMPING)
+/* Extracts the timestamp from the control messages of a message received, software or hardware as configured. */
+static uint64_t craggy_extractTimestamp(const CraggyTransport *transport, struct msghdr *message) {
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(message); cmsg != NULL; cmsg = CMSG_NXTHDR(message, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPING) {
+            struct scm_timestamping timestamping;
+            craggy_memcpy(&timestamping, CMSG_DATA(cmsg), sizeof(timestamping));
+            const struct timespec *ts = (transport->timestampFlags & SOF_TIMESTAMPING_RAW_HARDWARE) ? &timestamping.ts[2] : &timestamping.ts[0];
+            return (uint64_t) ts->tv_sec * 1000000000 + ts->tv_nsec;
+        }
     }
+    return 0;
+}
+#endif
 
-    struct timeval timeout;
-    timeout.tv_sec = 10;
-    timeout.tv_usec = 0;
-    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+static uint64_t craggy_clampTimeout(uint64_t timeout) {
+    if (timeout < (uint64_t) CRAGGY_TRANSPORT_MIN_RTO_MS * 1000) {
+        return (uint64_t) CRAGGY_TRANSPORT_MIN_RTO_MS * 1000;
+    }
+    if (timeout > (uint64_t) CRAGGY_TRANSPORT_MAX_RTO_MS * 1000) {
+        return (uint64_t) CRAGGY_TRANSPORT_MAX_RTO_MS * 1000;
+    }
+    return timeout;
+}
+
+_Static_assert(sizeof(struct sockaddr_in6) <= CRAGGY_TRANSPORT_STATE_PEER_LENGTH, "CRAGGY_TRANSPORT_STATE_PEER_LENGTH too small for IPv6");
+
+/* Connects to the address a transport resolved its name to in an earlier run, if that is recent enough. */
+static bool craggy_connectFromState(CraggyTransport *transport, const CraggyTransportState *state) {
+
+    if (state->peerLen == 0 || state->peerLen > sizeof(state->peer) || state->peerLen > sizeof(transport->peer)) {
+        return false;
+    }
+    const craggy_rough_time_t now = craggy_realtimeUs();
+    if (state->resolvedAt > now || now - state->resolvedAt >= (craggy_rough_time_t) CRAGGY_TRANSPORT_RESOLVE_INTERVAL * 1000000) {
+        return false;
+    }
+
+    struct addrinfo addr;
+    craggy_memset(&transport->peer, 0, sizeof(transport->peer));
+    craggy_memcpy(&transport->peer, state->peer, state->peerLen);
+    craggy_memset(&addr, 0, sizeof(addr));
+    addr.ai_family = transport->peer.ss_family;
+    addr.ai_socktype = SOCK_DGRAM;
+    addr.ai_protocol = IPPROTO_UDP;
+    addr.ai_addr = (struct sockaddr *) &transport->peer;
+    addr.ai_addrlen = state->peerLen;
+    if (addr.ai_family != AF_INET && addr.ai_family != AF_INET6) {
+        return false;
+    }
+
+    transport->fd = craggy_openSocket(&addr);
+    if (transport->fd < 0) {
+        return false;
+    }
+    transport->peerLen = state->peerLen;
+    // The family that answered then is taken to work still
+    transport->family = addr.ai_family;
+
+    // Resolved again when it would have been, had the run gone on
+    const uint64_t age = now - state->resolvedAt;
+    clock_gettime(CLOCK_MONOTONIC, &transport->resolvedAt);
+    transport->resolvedAt.tv_sec -= (time_t) (age / 1000000);
+    return true;
+}
+
+bool craggy_transportOpen(const char *address, CraggyTransport **transport, CraggyResult *result) {
+    return craggy_transportOpenFromState(address, NULL, transport, result);
+}
+
+bool craggy_transportOpenFromState(const char *address, const CraggyTransportState *state, CraggyTransport **transport, CraggyResult *result) {
+
+    *result = CraggyResultGeneralError;
+
+    *transport = craggy_calloc(1, sizeof(CraggyTransport));
+    if (*transport == NULL) {
+        ERROR_OCCURRED(CraggyResultInternalError);
+    }
+    (*transport)->fd = -1;
+    (*transport)->family = AF_UNSPEC;
+    (*transport)->retransmissionTimeout = (uint64_t) CRAGGY_TRANSPORT_INITIAL_RTO_MS * 1000;
+
+    (*transport)->address = craggy_malloc(strlen(address) + 1);
+    if ((*transport)->address == NULL) {
+        ERROR_OCCURRED(CraggyResultInternalError);
+    }
+    strcpy((*transport)->address, address);
+
+    (*transport)->host = (*transport)->address;
+    (*transport)->port = CRAGGY_UDP_DEFAULT_PORT;
+
+    char *colonPtr = strchr((*transport)->address, ':');
+    if (colonPtr != NULL) {
+        *colonPtr = '\0';
+        (*transport)->port = colonPtr + 1;
+    }
+
+    if (state != NULL && state->retransmissionTimeout > 0) {
+        (*transport)->smoothedRoundTrip = state->smoothedRoundTrip;
+        (*transport)->roundTripVariation = state->roundTripVariation;
+        (*transport)->retransmissionTimeout = craggy_clampTimeout(state->retransmissionTimeout);
+    }
+
+    if ((state == NULL || !craggy_connectFromState(*transport, state)) && !craggy_connect(*transport, result)) {
+        goto error;
+    }
+
+    *result = CraggyResultSuccess;
+    goto exit;
+
+error:
+    assert(*result != CraggyResultSuccess);
+    craggy_transportClose(*transport);
+    *transport = NULL;
+
+exit:
+    return *result == CraggyResultSuccess;
+}
+
+bool craggy_transportOpenWith(const CraggyTransportOps *ops, void *context, CraggyTransport **transport, CraggyResult *result) {
+
+    *transport = craggy_calloc(1, sizeof(CraggyTransport));
+    if (*transport == NULL) {
+        *result = CraggyResultInternalError;
+        return false;
+    }
+    (*transport)->ops = ops;
+    (*transport)->context = context;
+    (*transport)->fd = -1;
+    (*transport)->family = AF_UNSPEC;
+    (*transport)->retransmissionTimeout = (uint64_t) CRAGGY_TRANSPORT_INITIAL_RTO_MS * 1000;
+    *result = CraggyResultSuccess;
+    return true;
+}
+
+/* Descriptor to poll for a response on the transport, -1 if there is none to poll. */
+static int craggy_transportFd(const CraggyTransport *transport) {
+    if (transport->ops != NULL) {
+        return transport->ops->getFd != NULL ? transport->ops->getFd(transport->context) : -1;
+    }
+    return transport->fd;
+}
+
+/* Waits up to the timeout for a datagram on the transport, 0 to only take one already there.  The socket receives
+ * into the buffer given, operations lend one of their own until craggy_releaseResponse.  Returns 1 if a datagram was
+ * received, 0 if none was there in time, -1 if receiving failed. */
+static int craggy_awaitResponse(CraggyTransport *transport, int timeoutMs, craggy_rough_time_response_t *buffer, size_t bufferLen, const craggy_rough_time_response_t **response, size_t *responseLen) {
+
+    if (transport->ops != NULL) {
+        CraggyTransportTimestamps timestamps;
+        CraggyResult result;
+        CRAGGY_STATS_START(start);
+        const bool received = transport->ops->receive(transport->context, timeoutMs, response, responseLen, &timestamps, &result);
+        if (timeoutMs > 0) {
+            CRAGGY_STATS_RECORD(CraggyStageWait, start);
+        }
+        if (received) {
+            CRAGGY_PROBE1(request__receive, *responseLen);
+            return 1;
+        }
+        return result == CraggyResultNetworkTimeout ? 0 : -1;
+    }
+
+    if (timeoutMs > 0) {
+        struct pollfd fd;
+        fd.fd = transport->fd;
+        fd.events = POLLIN;
+        fd.revents = 0;
+        CRAGGY_STATS_START(start);
+        int r = poll(&fd, 1, timeoutMs);
+        CRAGGY_STATS_RECORD(CraggyStageWait, start);
+        if (r < 0 && errno != EINTR) {
+            return -1;
+        }
+        if (r <= 0) {
+            return 0;
+        }
+    }
+
+    ssize_t bufLen = recv(transport->fd, buffer, bufferLen, MSG_DONTWAIT);
+    if (bufLen < 0) {
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ? 0 : -1;
+    }
+    *response = buffer;
+    *responseLen = bufLen;
+    CRAGGY_PROBE1(request__receive, bufLen);
+    return 1;
+}
+
+/* Hands a datagram received by craggy_awaitResponse back to the operations that lent it. */
+static void craggy_releaseResponse(CraggyTransport *transport, const craggy_rough_time_response_t *response) {
+    if (transport->ops != NULL && transport->ops->release != NULL) {
+        transport->ops->release(transport->context, response);
+    }
+}
+
+/* Sends a datagram to the server of a connected transport. */
+static bool craggy_sendDatagram(CraggyTransport *transport, const craggy_rough_time_request_t requestBuf, CraggyResult *result) {
+
+    CRAGGY_PROBE1(request__send, sizeof(craggy_rough_time_request_t));
+    CRAGGY_STATS_START(start);
+    transport->sentAt = craggy_monotonicUs();
+    if (transport->ops != NULL) {
+        const bool sent = transport->ops->send(transport->context, requestBuf, sizeof(craggy_rough_time_request_t), result);
+        CRAGGY_STATS_RECORD(CraggyStageSend, start);
+        return sent;
+    }
 
     ssize_t r;
     do {
-        r = send(fd, requestBuf, sizeof(craggy_rough_time_request_t), 0 /* flags */);
+        r = send(transport->fd, requestBuf, sizeof(craggy_rough_time_request_t), 0 /* flags */);
     } while (r == -1 && errno == EINTR);
+    CRAGGY_STATS_RECORD(CraggyStageSend, start);
 
-    if (r < 0 || r != sizeof(craggy_rough_time_request_t)) {
-        ERROR_OCCURRED(CraggyResultNetworkInternalError);
+    if (r != sizeof(craggy_rough_time_request_t)) {
+        *result = CraggyResultNetworkInternalError;
+        return false;
+    }
+    *result = CraggyResultSuccess;
+    return true;
+}
+
+/* Sends a request to the peer and, unless a reply to it arrives within CRAGGY_TRANSPORT_RACE_DELAY_MS or sending fails
+ * outright, to the alternative address too (RFC 8305).  The first reply including the nonce of the request is left
+ * queued for the caller, on the socket that becomes the transport's, and its family is used from then on; datagrams
+ * not including it are dropped.  If neither answers in CRAGGY_TRANSPORT_RACE_TIMEOUT_MS the transport keeps to the
+ * peer, unless only the alternative could be sent to, and the next request races them again. */
+static bool craggy_raceRequest(CraggyTransport *transport, const craggy_rough_time_request_t requestBuf, CraggyResult *result) {
+
+    const uint8_t *nonce = requestBuf + CRAGGY_ROUGH_TIME_REQUEST_NONCE_OFFSET;
+    int socks[2] = {transport->fd, -1};
+    uint64_t sentAt[2] = {0, 0};
+    struct pollfd fds[2];
+    int started = 0;
+    int winner = -1;
+    craggy_rough_time_response_t responseBuf[CRAGGY_UDP_MAX_RESPONSE_SIZE];
+
+    struct addrinfo alternative;
+    craggy_memset(&alternative, 0, sizeof(alternative));
+    alternative.ai_family = transport->alternative.ss_family;
+    alternative.ai_socktype = SOCK_DGRAM;
+    alternative.ai_protocol = IPPROTO_UDP;
+    alternative.ai_addr = (struct sockaddr *) &transport->alternative;
+    alternative.ai_addrlen = transport->alternativeLen;
+
+    CRAGGY_STATS_START(raceStart);
+    const uint64_t startedAt = craggy_monotonicUs();
+    const uint64_t raceAt = startedAt + (uint64_t) CRAGGY_TRANSPORT_RACE_DELAY_MS * 1000;
+    const uint64_t deadline = startedAt + (uint64_t) CRAGGY_TRANSPORT_RACE_TIMEOUT_MS * 1000;
+
+    while (winner < 0) {
+        const uint64_t now = craggy_monotonicUs();
+        if (now >= deadline) {
+            break;
+        }
+
+        if (started < 2 && (started == 0 || now >= raceAt || fds[0].fd < 0)) {
+            fds[started].fd = -1;
+            fds[started].events = POLLIN;
+            fds[started].revents = 0;
+            if (started == 0) {
+                if (craggy_sendDatagram(transport, requestBuf, result)) {
+                    fds[0].fd = socks[0];
+                }
+                sentAt[0] = transport->sentAt;
+            } else {
+                socks[1] = craggy_openSocket(&alternative);
+#if defined(SO_TIMESTAMPING)
+                if (socks[1] >= 0 && transport->timestampFlags != 0 &&
+                    setsockopt(socks[1], SOL_SOCKET, SO_TIMESTAMPING, &transport->timestampFlags, sizeof(transport->timestampFlags)) != 0) {
+                    close(socks[1]);
+                    socks[1] = -1;
+                }
+#endif
+                sentAt[1] = craggy_monotonicUs();
+                if (socks[1] >= 0 && send(socks[1], requestBuf, sizeof(craggy_rough_time_request_t), 0 /* flags */) == sizeof(craggy_rough_time_request_t)) {
+                    fds[1].fd = socks[1];
+                }
+            }
+            started++;
+            continue;
+        }
+        if (started == 2 && fds[0].fd < 0 && fds[1].fd < 0) {
+            break;
+        }
+
+        const uint64_t wakeAt = started < 2 ? raceAt : deadline;
+        int r = poll(fds, started, (int) ((wakeAt - now + 999) / 1000));
+        if (r < 0 && errno != EINTR) {
+            break;
+        }
+
+        for (int i = 0; i < started && r > 0; i++) {
+            if (fds[i].fd < 0 || fds[i].revents == 0) {
+                continue;
+            }
+            ssize_t bufLen = recv(fds[i].fd, responseBuf, sizeof(responseBuf), MSG_PEEK | MSG_DONTWAIT);
+            if (bufLen >= 0) {
+                CraggyResult checked;
+                if (craggy_responseIncludesNonce(nonce, responseBuf, (size_t) bufLen, &checked)) {
+                    winner = i;
+                    break;
+                }
+                // Not a reply to the request, and no one else's either on a connected socket
+                recv(fds[i].fd, responseBuf, sizeof(responseBuf), MSG_DONTWAIT);
+            } else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                // Unreachable, refused and the like, reported back for the request sent
+                fds[i].fd = -1;
+            }
+        }
+    }
+    CRAGGY_STATS_RECORD(CraggyStageSocketSetup, raceStart);
+
+    // Without a winner, the address still waiting for a reply is kept
+    int kept = winner;
+    if (kept < 0) {
+        kept = fds[0].fd < 0 && started == 2 && fds[1].fd >= 0 ? 1 : 0;
+    }
+    if (kept == 1) {
+        close(socks[0]);
+        transport->fd = socks[1];
+        craggy_memcpy(&transport->peer, &transport->alternative, transport->alternativeLen);
+        transport->peerLen = transport->alternativeLen;
+    } else if (socks[1] >= 0) {
+        close(socks[1]);
+    }
+    transport->sentAt = sentAt[kept];
+    if (winner >= 0) {
+        transport->family = transport->peer.ss_family;
+        transport->alternativeLen = 0;
+    }
+
+    if (fds[kept].fd < 0) {
+        *result = CraggyResultNetworkInternalError;
+        return false;
+    }
+    *result = CraggyResultSuccess;
+    return true;
+}
+
+/* Reconnects the transport if it is not connected or its server's name is due to be resolved again. */
+static bool craggy_refreshConnection(CraggyTransport *transport, CraggyResult *result) {
+    if (transport->ops != NULL) {
+        // Connected for as long as the operations are there
+        *result = CraggyResultSuccess;
+        return true;
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (transport->fd < 0 || now.tv_sec - transport->resolvedAt.tv_sec >= CRAGGY_TRANSPORT_RESOLVE_INTERVAL) {
+        return craggy_connect(transport, result);
+    }
+    *result = CraggyResultSuccess;
+    return true;
+}
+
+/* Makes sure the transport is connected and sends it a request, leaving the response to the caller. */
+static bool craggy_sendRequest(CraggyTransport *transport, const craggy_rough_time_request_t requestBuf, CraggyResult *result) {
+
+    *result = CraggyResultGeneralError;
+
+    if (!craggy_refreshConnection(transport, result)) {
+        goto error;
+    }
+
+    // Discard anything left over from an earlier request that timed out, it can only fail verification
+    if (transport->ops != NULL) {
+        const craggy_rough_time_response_t *leftOver;
+        size_t leftOverLen;
+        while (craggy_awaitResponse(transport, 0, NULL, 0, &leftOver, &leftOverLen) > 0) {
+            craggy_releaseResponse(transport, leftOver);
+        }
+    } else {
+        uint8_t discard;
+        while (recv(transport->fd, &discard, sizeof(discard), MSG_DONTWAIT) >= 0) {
+        }
+#if defined(MSG_ERRQUEUE)
+        if (transport->timestampFlags != 0) {
+            while (recv(transport->fd, &discard, sizeof(discard), MSG_DONTWAIT | MSG_ERRQUEUE) >= 0) {
+            }
+        }
+#endif
+    }
+
+    // Until one of the families has answered, the request itself races them
+    if (transport->alternativeLen != 0) {
+        if (!craggy_raceRequest(transport, requestBuf, result)) {
+            goto error;
+        }
+    } else if (!craggy_sendDatagram(transport, requestBuf, result)) {
+        goto error;
+    }
+
+    *result = CraggyResultSuccess;
+    goto exit;
+
+error:
+    assert(*result != CraggyResultSuccess);
+    craggy_disconnect(transport);
+
+exit:
+    return *result == CraggyResultSuccess;
+}
+
+bool craggy_transportRequest(CraggyTransport *transport, const craggy_rough_time_request_t requestBuf, CraggyResult *result, craggy_rough_time_response_t *responseBuf, size_t *responseBufLen) {
+    return craggy_transportRequestWithTimestamps(transport, requestBuf, result, responseBuf, responseBufLen, NULL);
+}
+
+bool craggy_transportRequestWithTimestamps(CraggyTransport *transport, const craggy_rough_time_request_t requestBuf, CraggyResult *result, craggy_rough_time_response_t *responseBuf, size_t *responseBufLen, CraggyTransportTimestamps *timestamps) {
+
+    *result = CraggyResultGeneralError;
+
+    if (timestamps != NULL) {
+        timestamps->sent = 0;
+        timestamps->received = 0;
     }
 
+    if (!craggy_sendRequest(transport, requestBuf, result)) {
+        return false;
+    }
+
+    if (transport->ops != NULL) {
+        const uint8_t *received;
+        size_t receivedLen;
+        CraggyTransportTimestamps receivedTimestamps;
+        CRAGGY_STATS_START(waitStart);
+        const bool receivedAny = transport->ops->receive(transport->context, CRAGGY_UDP_RECEIVE_TIMEOUT * 1000, &received, &receivedLen, &receivedTimestamps, result);
+        CRAGGY_STATS_RECORD(CraggyStageWait, waitStart);
+        if (!receivedAny) {
+            return false;
+        }
+        CRAGGY_PROBE1(request__receive, receivedLen);
+        const bool fits = receivedLen <= *responseBufLen;
+        if (fits) {
+            craggy_memcpy(responseBuf, received, receivedLen);
+            *responseBufLen = receivedLen;
+            if (timestamps != NULL) {
+                *timestamps = receivedTimestamps;
+            }
+        }
+        craggy_releaseResponse(transport, received);
+        *result = fits ? CraggyResultSuccess : CraggyResultGeneralError;
+        return fits;
+    }
+
+    struct iovec vector;
+    vector.iov_base = responseBuf;
+    vector.iov_len = *responseBufLen;
+
+    uint8_t control[256];
+    struct msghdr message;
+    craggy_memset(&message, 0, sizeof(message));
+    message.msg_iov = &vector;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
     ssize_t bufLen;
+    CRAGGY_STATS_START(start);
     do {
-        bufLen = recv(fd, responseBuf, CRAGGY_ROUGH_TIME_MIN_REQUEST_SIZE, 0 /* flags */);
+        bufLen = recvmsg(transport->fd, &message, 0 /* flags */);
     } while (bufLen == -1 && errno == EINTR);
+    CRAGGY_STATS_RECORD(CraggyStageWait, start);
+    CRAGGY_PROBE1(request__receive, bufLen);
 
     if (bufLen == -1) {
-        if (errno == EINTR) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
             ERROR_OCCURRED(CraggyResultNetworkTimeout);
         }
         ERROR_OCCURRED(CraggyResultNetworkInternalError);
     }
 
+#if defined(SO_TIMESTAMPING)
+    if (timestamps != NULL && transport->timestampFlags != 0) {
+        timestamps->received = craggy_extractTimestamp(transport, &message);
+
+        // The transmit timestamp is looped back on the error queue - long since there by the time the response is in
+        struct msghdr errorMessage;
+        craggy_memset(&errorMessage, 0, sizeof(errorMessage));
+        errorMessage.msg_control = control;
+        errorMessage.msg_controllen = sizeof(control);
+        if (recvmsg(transport->fd, &errorMessage, MSG_ERRQUEUE | MSG_DONTWAIT) >= 0) {
+            timestamps->sent = craggy_extractTimestamp(transport, &errorMessage);
+        }
+    }
+#endif
+
     *responseBufLen = bufLen;
     *result = CraggyResultSuccess;
     goto exit;
 
 error:
     assert(*result != CraggyResultSuccess);
+    // The server may have moved - resolve its name again next time
+    craggy_disconnect(transport);
 
 exit:
-    close(fd);
     return *result == CraggyResultSuccess;
 }
+
+/* Responses are verified straight away, or handed to the pool if there is one and collected once receiving is done.
+ * Given a quorum, responses verified straight away are also checked for agreement as they come in, and receiving stops
+ * once that many agree. */
+static bool craggy_queryServersWith(CraggyServerQuery *queries, size_t numQueries, CraggyDelegationCache *cache, CraggyVerifyPool *pool, int timeoutMs, size_t quorum, CraggyConsensus *consensus) {
+
+    bool success = true;
+    bool agreed = false;
+
+    struct pollfd *fds = craggy_calloc(numQueries, sizeof(struct pollfd));
+    // Start time of each query, in microseconds
+    uint64_t *sentAt = craggy_calloc(numQueries, sizeof(uint64_t));
+    CraggyVerifyJob *jobs = pool != NULL ? craggy_malloc(numQueries * sizeof(CraggyVerifyJob)) : NULL;
+    size_t numSubmitted = 0;
+    CraggyTimeSample *samples = quorum > 0 ? craggy_malloc(numQueries * sizeof(CraggyTimeSample)) : NULL;
+    size_t numSamples = 0;
+    if (consensus != NULL) {
+        craggy_memset(consensus, 0, sizeof(CraggyConsensus));
+    }
+    if (fds == NULL || sentAt == NULL || (pool != NULL && jobs == NULL) || (quorum > 0 && samples == NULL)) {
+        for (size_t i = 0; i < numQueries; i++) {
+            queries[i].result = CraggyResultInternalError;
+            queries[i].responseLen = 0;
+        }
+        success = false;
+        goto exit;
+    }
+
+    craggy_rough_time_request_t requestBuf;
+    if (!craggy_createRequestTemplate(requestBuf)) {
+        for (size_t i = 0; i < numQueries; i++) {
+            queries[i].result = CraggyResultInternalError;
+            queries[i].responseLen = 0;
+        }
+        success = false;
+        goto exit;
+    }
+
+    size_t pending = 0;
+    // Pending queries whose transports have no descriptor, and have to be asked for responses instead
+    size_t unpolled = 0;
+    for (size_t i = 0; i < numQueries; i++) {
+        CraggyServerQuery *query = &queries[i];
+        fds[i].fd = -1;
+        query->responseLen = 0;
+
+        craggy_setRequestNonce(requestBuf, query->nonce);
+        if (!craggy_sendRequest(query->transport, requestBuf, &query->result)) {
+            continue;
+        }
+        sentAt[i] = query->transport->sentAt;
+        query->result = CraggyResultNetworkTimeout;
+        // A query is pending while it has events to poll for, even if its transport has no descriptor to poll
+        fds[i].fd = craggy_transportFd(query->transport);
+        fds[i].events = POLLIN;
+        if (fds[i].fd < 0) {
+            unpolled++;
+        }
+        pending++;
+    }
+
+    const uint64_t deadline = craggy_monotonicUs() + (uint64_t) timeoutMs * 1000;
+    craggy_rough_time_response_t responseBuf[CRAGGY_UDP_MAX_RESPONSE_SIZE];
+
+    while (pending > 0 && !agreed) {
+        const uint64_t now = craggy_monotonicUs();
+        if (now >= deadline) {
+            break;
+        }
+        // Each response still to come can add at most one to the largest agreement
+        if (quorum > 0 && consensus->numAgreeing + pending < quorum) {
+            break;
+        }
+
+        int pollTimeout = (int) ((deadline - now + 999) / 1000);
+        if (unpolled > 0 && pollTimeout > CRAGGY_TRANSPORT_POLL_INTERVAL_MS) {
+            pollTimeout = CRAGGY_TRANSPORT_POLL_INTERVAL_MS;
+        }
+        CRAGGY_STATS_START(waitStart);
+        int r = poll(fds, numQueries, pollTimeout);
+        CRAGGY_STATS_RECORD(CraggyStageWait, waitStart);
+        if (r < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        if (r == 0 && unpolled == 0) {
+            continue;
+        }
+
+        for (size_t i = 0; i < numQueries; i++) {
+            if (fds[i].events == 0 || (fds[i].fd >= 0 && fds[i].revents == 0)) {
+                continue;
+            }
+
+            CraggyServerQuery *query = &queries[i];
+            const craggy_rough_time_response_t *response;
+            size_t bufLen;
+            int received = craggy_awaitResponse(query->transport, 0, responseBuf, sizeof(responseBuf), &response, &bufLen);
+            if (received == 0) {
+                continue;
+            }
+
+            if (fds[i].fd < 0) {
+                unpolled--;
+            }
+            fds[i].fd = -1;
+            fds[i].events = 0;
+            pending--;
+
+            if (received < 0) {
+                query->result = CraggyResultNetworkInternalError;
+                craggy_disconnect(query->transport);
+                continue;
+            }
+
+            query->roundTripTime = craggy_monotonicUs() - sentAt[i];
+            query->receivedAt = craggy_realtimeUs();
+            craggy_transportRecordRoundTrip(query->transport, query->roundTripTime);
+            if (pool == NULL) {
+                bool verified = craggy_processResponseWithCache((uint8_t *) query->nonce, (uint8_t *) query->rootPublicKey, cache, (craggy_rough_time_response_t *) response, bufLen, &query->result, &query->time, &query->radius);
+                if (verified && query->responseBuf != NULL) {
+                    craggy_memcpy(query->responseBuf, response, bufLen);
+                    query->responseLen = bufLen;
+                }
+                if (verified && quorum > 0) {
+                    craggy_makeTimeSample(query->time, query->radius, query->roundTripTime, query->receivedAt, &samples[numSamples++]);
+                    CraggyResult consensusResult;
+                    agreed = craggy_findConsensus(samples, numSamples, quorum, consensus, &consensusResult);
+                }
+            } else if (bufLen > CRAGGY_VERIFY_JOB_MAX_RESPONSE_SIZE) {
+                query->result = CraggyResultParseError;
+            } else {
+                CraggyVerifyJob *job = &jobs[numSubmitted++];
+                craggy_memcpy(job->nonce, query->nonce, CRAGGY_ROUGH_TIME_NONCE_LENGTH);
+                craggy_memcpy(job->rootPublicKey, query->rootPublicKey, CRAGGY_ROUGH_TIME_PUBLIC_KEY_LENGTH);
+                craggy_memcpy(job->response, response, bufLen);
+                job->responseLen = bufLen;
+                job->userData = query;
+                craggy_verifyPoolSubmit(pool, job);
+            }
+            craggy_releaseResponse(query->transport, response);
+            if (agreed) {
+                break;
+            }
+        }
+    }
+
+    for (size_t collected = 0; collected < numSubmitted; collected++) {
+        CraggyVerifyJob *job = craggy_verifyPoolWait(pool, -1);
+        CraggyServerQuery *query = job->userData;
+        query->result = job->result;
+        query->time = job->time;
+        query->radius = job->radius;
+        if (job->result == CraggyResultSuccess && query->responseBuf != NULL) {
+            craggy_memcpy(query->responseBuf, job->response, job->responseLen);
+            query->responseLen = job->responseLen;
+        }
+    }
+
+    for (size_t i = 0; i < numQueries; i++) {
+        // Servers not waited for once a quorum agreed may well be there
+        const bool abandoned = queries[i].result == CraggyResultNetworkTimeout && agreed && fds[i].events != 0;
+        if (!abandoned) {
+            CRAGGY_STATS_COUNT_RESULT(queries[i].result);
+        }
+        if (queries[i].result != CraggyResultSuccess) {
+            if (queries[i].result == CraggyResultNetworkTimeout && !abandoned) {
+                // The server may have moved - resolve its name again next time
+                craggy_disconnect(queries[i].transport);
+            }
+            success = false;
+        }
+    }
+    if (quorum > 0) {
+        success = agreed;
+    }
+
+exit:
+    craggy_free(samples);
+    craggy_free(jobs);
+    craggy_free(sentAt);
+    craggy_free(fds);
+    return success;
+}
+
+bool craggy_queryServers(CraggyServerQuery *queries, size_t numQueries, CraggyDelegationCache *cache, int timeoutMs) {
+    return craggy_queryServersWith(queries, numQueries, cache, NULL, timeoutMs, 0, NULL);
+}
+
+bool craggy_queryQuorum(CraggyServerQuery *queries, size_t numQueries, CraggyDelegationCache *cache, size_t quorum, int timeoutMs, CraggyConsensus *consensus) {
+    if (quorum == 0 || quorum > numQueries) {
+        craggy_memset(consensus, 0, sizeof(CraggyConsensus));
+        for (size_t i = 0; i < numQueries; i++) {
+            queries[i].result = CraggyResultGeneralError;
+        }
+        return false;
+    }
+    return craggy_queryServersWith(queries, numQueries, cache, NULL, timeoutMs, quorum, consensus);
+}
+
+bool craggy_queryServersOnPool(CraggyServerQuery *queries, size_t numQueries, CraggyVerifyPool *pool, int timeoutMs) {
+    return craggy_queryServersWith(queries, numQueries, NULL, pool, timeoutMs, 0, NULL);
+}
+
+/* Backs the retransmission timeout off after a request went unanswered, until a response brings it back. */
+static void craggy_transportRecordTimeout(CraggyTransport *transport) {
+    transport->timeouts++;
+    transport->retransmissionTimeout = craggy_clampTimeout(2 * transport->retransmissionTimeout);
+}
+
+void craggy_transportRecordRoundTrip(CraggyTransport *transport, uint64_t roundTripTime) {
+    if (transport->numRoundTrips == 0) {
+        transport->smoothedRoundTrip = roundTripTime;
+        transport->roundTripVariation = roundTripTime / 2;
+    } else {
+        uint64_t deviation = transport->smoothedRoundTrip > roundTripTime ? transport->smoothedRoundTrip - roundTripTime : roundTripTime - transport->smoothedRoundTrip;
+        transport->roundTripVariation = (3 * transport->roundTripVariation + deviation) / 4;
+        transport->smoothedRoundTrip = (7 * transport->smoothedRoundTrip + roundTripTime) / 8;
+    }
+    transport->retransmissionTimeout = craggy_clampTimeout(transport->smoothedRoundTrip + 4 * transport->roundTripVariation);
+
+    transport->roundTrips[transport->nextRoundTrip] = roundTripTime;
+    transport->nextRoundTrip = (transport->nextRoundTrip + 1) % CRAGGY_TRANSPORT_ROUND_TRIP_HISTORY;
+    if (transport->numRoundTrips < CRAGGY_TRANSPORT_ROUND_TRIP_HISTORY) {
+        transport->numRoundTrips++;
+    }
+}
+
+uint64_t craggy_transportGetRoundTripPercentile(const CraggyTransport *transport, unsigned int percentile) {
+    if (transport->numRoundTrips < CRAGGY_TRANSPORT_MIN_ROUND_TRIPS || percentile > 100) {
+        return 0;
+    }
+
+    // Few enough to sort on every call
+    uint64_t sorted[CRAGGY_TRANSPORT_ROUND_TRIP_HISTORY];
+    size_t n = transport->numRoundTrips;
+    for (size_t i = 0; i < n; i++) {
+        uint64_t rtt = transport->roundTrips[i];
+        size_t j = i;
+        for (; j > 0 && sorted[j - 1] > rtt; j--) {
+            sorted[j] = sorted[j - 1];
+        }
+        sorted[j] = rtt;
+    }
+    size_t rank = (n * percentile + 99) / 100;
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+/* Microseconds a hedged query waits for a server before asking the next one. */
+static uint64_t craggy_hedgeDelay(const CraggyTransport *transport) {
+    uint64_t delay = craggy_transportGetRoundTripPercentile(transport, CRAGGY_HEDGE_PERCENTILE);
+    return delay > 0 ? delay : (uint64_t) CRAGGY_HEDGE_DEFAULT_DELAY_MS * 1000;
+}
+
+bool craggy_queryHedged(CraggyServerQuery *queries, size_t numQueries, CraggyDelegationCache *cache, int timeoutMs, size_t *answered) {
+
+    bool success = false;
+    *answered = numQueries;
+
+    struct pollfd *fds = craggy_calloc(numQueries, sizeof(struct pollfd));
+    uint64_t *sentAt = craggy_calloc(numQueries, sizeof(uint64_t));
+    craggy_rough_time_request_t requestBuf;
+    if (fds == NULL || sentAt == NULL || !craggy_createRequestTemplate(requestBuf)) {
+        for (size_t i = 0; i < numQueries; i++) {
+            queries[i].result = CraggyResultInternalError;
+            queries[i].responseLen = 0;
+        }
+        goto exit;
+    }
+    for (size_t i = 0; i < numQueries; i++) {
+        queries[i].result = CraggyResultNetworkTimeout;
+        queries[i].responseLen = 0;
+        fds[i].fd = -1;
+    }
+
+    const uint64_t deadline = craggy_monotonicUs() + (uint64_t) timeoutMs * 1000;
+    craggy_rough_time_response_t responseBuf[CRAGGY_UDP_MAX_RESPONSE_SIZE];
+    // The next server to ask, and when to, unless an answer comes first
+    size_t next = 0;
+    uint64_t hedgeAt = 0;
+    size_t pending = 0;
+    // Pending queries whose transports have no descriptor, and have to be asked for responses instead
+    size_t unpolled = 0;
+
+    while (*answered == numQueries) {
+        uint64_t now = craggy_monotonicUs();
+        if (now >= deadline) {
+            break;
+        }
+
+        // A server that failed outright is not waited for
+        while (next < numQueries && (now >= hedgeAt || pending == 0)) {
+            CraggyServerQuery *query = &queries[next];
+            craggy_setRequestNonce(requestBuf, query->nonce);
+            if (craggy_sendRequest(query->transport, requestBuf, &query->result)) {
+                sentAt[next] = query->transport->sentAt;
+                query->result = CraggyResultNetworkTimeout;
+                fds[next].fd = craggy_transportFd(query->transport);
+                fds[next].events = POLLIN;
+                if (fds[next].fd < 0) {
+                    unpolled++;
+                }
+                hedgeAt = sentAt[next] + craggy_hedgeDelay(query->transport);
+                pending++;
+            }
+            next++;
+        }
+        if (pending == 0) {
+            break;
+        }
+
+        uint64_t wakeAt = next < numQueries && hedgeAt < deadline ? hedgeAt : deadline;
+        now = craggy_monotonicUs();
+        int pollTimeout = wakeAt > now ? (int) ((wakeAt - now + 999) / 1000) : 0;
+        if (unpolled > 0 && pollTimeout > CRAGGY_TRANSPORT_POLL_INTERVAL_MS) {
+            pollTimeout = CRAGGY_TRANSPORT_POLL_INTERVAL_MS;
+        }
+        CRAGGY_STATS_START(waitStart);
+        int r = poll(fds, next, pollTimeout);
+        CRAGGY_STATS_RECORD(CraggyStageWait, waitStart);
+        if (r < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        if (r == 0 && unpolled == 0) {
+            continue;
+        }
+
+        for (size_t i = 0; i < next; i++) {
+            if (fds[i].events == 0 || (fds[i].fd >= 0 && fds[i].revents == 0)) {
+                continue;
+            }
+
+            CraggyServerQuery *query = &queries[i];
+            const craggy_rough_time_response_t *response;
+            size_t bufLen;
+            int received = craggy_awaitResponse(query->transport, 0, responseBuf, sizeof(responseBuf), &response, &bufLen);
+            if (received == 0) {
+                continue;
+            }
+
+            if (fds[i].fd < 0) {
+                unpolled--;
+            }
+            fds[i].fd = -1;
+            fds[i].events = 0;
+            pending--;
+
+            if (received < 0) {
+                query->result = CraggyResultNetworkInternalError;
+                craggy_disconnect(query->transport);
+                continue;
+            }
+
+            query->roundTripTime = craggy_monotonicUs() - sentAt[i];
+            query->receivedAt = craggy_realtimeUs();
+            craggy_transportRecordRoundTrip(query->transport, query->roundTripTime);
+            bool verified = craggy_processResponseWithCache((uint8_t *) query->nonce, (uint8_t *) query->rootPublicKey, cache, (craggy_rough_time_response_t *) response, bufLen, &query->result, &query->time, &query->radius);
+            if (verified && query->responseBuf != NULL) {
+                craggy_memcpy(query->responseBuf, response, bufLen);
+                query->responseLen = bufLen;
+            }
+            craggy_releaseResponse(query->transport, response);
+            if (verified) {
+                // The requests still out are dropped, what they bring in is discarded by the next request on their transports
+                *answered = i;
+                success = true;
+                break;
+            }
+        }
+    }
+
+    // Servers not asked are not counted, nor are those still pending when another answered
+    for (size_t i = 0; i < next; i++) {
+        if (!success || i == *answered || queries[i].result != CraggyResultNetworkTimeout) {
+            CRAGGY_STATS_COUNT_RESULT(queries[i].result);
+        }
+    }
+
+    if (!success) {
+        for (size_t i = 0; i < next; i++) {
+            if (queries[i].result == CraggyResultNetworkTimeout) {
+                // The server may have moved - resolve its name again next time
+                craggy_disconnect(queries[i].transport);
+            }
+        }
+    }
+
+exit:
+    craggy_free(sentAt);
+    craggy_free(fds);
+    return success;
+}
+
+void craggy_transportGetState(const CraggyTransport *transport, CraggyTransportState *state) {
+    craggy_memset(state, 0, sizeof(CraggyTransportState));
+    if (transport->ops == NULL && transport->fd >= 0 && transport->peerLen <= sizeof(state->peer)) {
+        craggy_memcpy(state->peer, &transport->peer, transport->peerLen);
+        state->peerLen = transport->peerLen;
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        state->resolvedAt = craggy_realtimeUs() - (craggy_rough_time_t) (now.tv_sec - transport->resolvedAt.tv_sec) * 1000000;
+    }
+    state->smoothedRoundTrip = transport->smoothedRoundTrip;
+    state->roundTripVariation = transport->roundTripVariation;
+    state->retransmissionTimeout = transport->retransmissionTimeout;
+}
+
+void craggy_transportGetStats(const CraggyTransport *transport, CraggyTransportStats *stats) {
+    stats->smoothedRoundTrip = transport->smoothedRoundTrip;
+    stats->roundTripVariation = transport->roundTripVariation;
+    stats->retransmissionTimeout = transport->retransmissionTimeout;
+    stats->numRoundTrips = transport->numRoundTrips;
+    stats->timeouts = transport->timeouts;
+    stats->retransmissions = transport->retransmissions;
+}
+
+bool craggy_transportQuery(CraggyTransport *transport, const craggy_rough_time_public_key_t rootPublicKey, CraggyDelegationCache *cache, unsigned int maxAttempts, craggy_rough_time_nonce_t nonce, CraggyResult *result, craggy_rough_time_t *time, craggy_rough_time_radius_t *radius, uint64_t *roundTripTime) {
+
+    *result = CraggyResultGeneralError;
+
+    // Every attempt has a nonce of its own, so a late response still tells which attempt it answers
+    craggy_rough_time_nonce_t nonces[CRAGGY_TRANSPORT_MAX_ATTEMPTS];
+    uint64_t sentAt[CRAGGY_TRANSPORT_MAX_ATTEMPTS];
+    craggy_rough_time_request_t requestBuf;
+    craggy_rough_time_response_t responseBuf[CRAGGY_UDP_MAX_RESPONSE_SIZE];
+    // What the last response that failed verification failed with, reported rather than the timeout
+    CraggyResult rejected = CraggyResultNetworkTimeout;
+    unsigned int attempts = 0;
+    uint64_t retransmitAt = 0;
+
+    if (maxAttempts == 0 || maxAttempts > CRAGGY_TRANSPORT_MAX_ATTEMPTS) {
+        ERROR_OCCURRED(CraggyResultGeneralError);
+    }
+    craggy_memcpy(nonces[0], nonce, CRAGGY_ROUGH_TIME_NONCE_LENGTH);
+    if (!craggy_createRequest(nonces[0], requestBuf)) {
+        ERROR_OCCURRED(CraggyResultInternalError);
+    }
+
+    for (;;) {
+        uint64_t now = craggy_monotonicUs();
+        if (now >= retransmitAt) {
+            if (attempts > 0) {
+                craggy_transportRecordTimeout(transport);
+            }
+            if (attempts == maxAttempts) {
+                ERROR_OCCURRED(rejected);
+            }
+            if (attempts == 0) {
+                if (!craggy_sendRequest(transport, requestBuf, result)) {
+                    goto error;
+                }
+            } else {
+                if (!craggy_generateNonce(result, nonces[attempts])) {
+                    goto error;
+                }
+                craggy_setRequestNonce(requestBuf, nonces[attempts]);
+                // Not through craggy_sendRequest, which would discard a response to an earlier attempt still on its way
+                if (!craggy_sendDatagram(transport, requestBuf, result)) {
+                    goto error;
+                }
+                transport->retransmissions++;
+            }
+            now = craggy_monotonicUs();
+            sentAt[attempts++] = transport->sentAt;
+            retransmitAt = now + transport->retransmissionTimeout;
+        }
+
+        const craggy_rough_time_response_t *response;
+        size_t bufLen;
+        int received = craggy_awaitResponse(transport, (int) ((retransmitAt - now + 999) / 1000), responseBuf, sizeof(responseBuf), &response, &bufLen);
+        if (received < 0) {
+            ERROR_OCCURRED(CraggyResultNetworkInternalError);
+        }
+        if (received == 0) {
+            continue;
+        }
+        const uint64_t receivedAt = craggy_monotonicUs();
+
+        // Newest first, the attempt most likely answered
+        bool answered = false;
+        for (unsigned int i = attempts; i-- > 0;) {
+            CraggyResult verified;
+            if (craggy_processResponseWithCache(nonces[i], (uint8_t *) rootPublicKey, cache, (craggy_rough_time_response_t *) response, bufLen, &verified, time, radius)) {
+                *roundTripTime = receivedAt - sentAt[i];
+                craggy_transportRecordRoundTrip(transport, *roundTripTime);
+                craggy_memcpy(nonce, nonces[i], CRAGGY_ROUGH_TIME_NONCE_LENGTH);
+                answered = true;
+                break;
+            }
+            if (i == attempts - 1) {
+                rejected = verified;
+            }
+        }
+        craggy_releaseResponse(transport, response);
+        if (answered) {
+            *result = CraggyResultSuccess;
+            goto exit;
+        }
+        // A stray or forged packet, the server may still answer
+    }
+
+error:
+    assert(*result != CraggyResultSuccess);
+    if (attempts > 0) {
+        craggy_memcpy(nonce, nonces[attempts - 1], CRAGGY_ROUGH_TIME_NONCE_LENGTH);
+    }
+    // The server may have moved - resolve its name again next time
+    craggy_disconnect(transport);
+
+exit:
+    CRAGGY_STATS_COUNT_RESULT(*result);
+    return *result == CraggyResultSuccess;
+}
+
+bool craggy_requestStart(CraggyTransport *transport, const craggy_rough_time_public_key_t rootPublicKey, const craggy_rough_time_nonce_t nonce, CraggyDelegationCache *cache, int timeoutMs, CraggyRequest **request, CraggyResult *result) {
+
+    *result = CraggyResultGeneralError;
+
+    *request = craggy_calloc(1, sizeof(CraggyRequest));
+    if (*request == NULL) {
+        ERROR_OCCURRED(CraggyResultInternalError);
+    }
+    (*request)->fd = -1;
+    (*request)->state = CraggyRequestStatePending;
+    (*request)->result = CraggyResultNetworkTimeout;
+    (*request)->cache = cache;
+    craggy_memcpy((*request)->nonce, nonce, CRAGGY_ROUGH_TIME_NONCE_LENGTH);
+    craggy_memcpy((*request)->rootPublicKey, rootPublicKey, CRAGGY_ROUGH_TIME_PUBLIC_KEY_LENGTH);
+
+    if (!craggy_createRequest((*request)->nonce, (*request)->requestBuf)) {
+        ERROR_OCCURRED(CraggyResultInternalError);
+    }
+
+    // A request has a socket of its own, which operations cannot provide
+    if (transport->ops != NULL) {
+        ERROR_OCCURRED(CraggyResultGeneralError);
+    }
+
+    // Only the name lookup may block, and only when it is due again - the socket of the request itself never does
+    if (!craggy_refreshConnection(transport, result)) {
+        goto error;
+    }
+
+    (*request)->fd = socket(transport->peer.ss_family, SOCK_DGRAM, IPPROTO_UDP);
+    if ((*request)->fd < 0) {
+        ERROR_OCCURRED(CraggyResultNetworkInternalError);
+    }
+
+    int flags = fcntl((*request)->fd, F_GETFL, 0);
+    if (flags < 0 || fcntl((*request)->fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        ERROR_OCCURRED(CraggyResultNetworkInternalError);
+    }
+
+    if (connect((*request)->fd, (const struct sockaddr *) &transport->peer, transport->peerLen)) {
+        ERROR_OCCURRED(CraggyResultNetworkConnectionError);
+    }
+
+    (*request)->sentAt = craggy_monotonicUs();
+    (*request)->deadline = (*request)->sentAt + (uint64_t) timeoutMs * 1000;
+
+    ssize_t r;
+    CRAGGY_STATS_START(sendStart);
+    do {
+        r = send((*request)->fd, (*request)->requestBuf, sizeof(craggy_rough_time_request_t), 0 /* flags */);
+    } while (r == -1 && errno == EINTR);
+    CRAGGY_STATS_RECORD(CraggyStageSend, sendStart);
+
+    if (r != sizeof(craggy_rough_time_request_t)) {
+        ERROR_OCCURRED(CraggyResultNetworkInternalError);
+    }
+
+    *result = CraggyResultSuccess;
+    goto exit;
+
+error:
+    assert(*result != CraggyResultSuccess);
+    CRAGGY_STATS_COUNT_RESULT(*result);
+    craggy_requestDestroy(*request);
+    *request = NULL;
+
+exit:
+    return *result == CraggyResultSuccess;
+}
+
+int craggy_requestGetFd(const CraggyRequest *request) {
+    return request->fd;
+}
+
+uint64_t craggy_requestGetDeadline(const CraggyRequest *request) {
+    return request->deadline;
+}
+
+CraggyRequestState craggy_requestOnReadable(CraggyRequest *request) {
+
+    if (request->state != CraggyRequestStatePending) {
+        return request->state;
+    }
+
+    ssize_t bufLen;
+    do {
+        bufLen = recv(request->fd, request->responseBuf, sizeof(request->responseBuf), 0 /* flags */);
+    } while (bufLen == -1 && errno == EINTR);
+
+    if (bufLen < 0) {
+        // Woken up without anything to read, or an ICMP error for an earlier datagram - keep waiting for the response
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ECONNREFUSED) {
+            return craggy_requestOnDeadline(request);
+        }
+        request->result = CraggyResultNetworkInternalError;
+        request->state = CraggyRequestStateFailed;
+        CRAGGY_STATS_COUNT_RESULT(request->result);
+        return request->state;
+    }
+
+    request->roundTripTime = craggy_monotonicUs() - request->sentAt;
+    request->responseLen = (size_t) bufLen;
+    if (craggy_processResponseWithCache(request->nonce, request->rootPublicKey, request->cache, request->responseBuf, request->responseLen, &request->result, &request->time, &request->radius)) {
+        request->state = CraggyRequestStateComplete;
+    } else {
+        request->state = CraggyRequestStateFailed;
+    }
+    CRAGGY_STATS_COUNT_RESULT(request->result);
+    return request->state;
+}
+
+CraggyRequestState craggy_requestOnDeadline(CraggyRequest *request) {
+    if (request->state == CraggyRequestStatePending && craggy_monotonicUs() >= request->deadline) {
+        request->result = CraggyResultNetworkTimeout;
+        request->state = CraggyRequestStateFailed;
+        CRAGGY_STATS_COUNT_RESULT(request->result);
+    }
+    return request->state;
+}
+
+bool craggy_requestGetResponse(const CraggyRequest *request, CraggyResult *result, craggy_rough_time_t *time, craggy_rough_time_radius_t *radius, uint64_t *roundTripTime) {
+    *result = request->state == CraggyRequestStatePending ? CraggyResultGeneralError : request->result;
+    if (request->state != CraggyRequestStateComplete) {
+        return false;
+    }
+    *time = request->time;
+    *radius = request->radius;
+    *roundTripTime = request->roundTripTime;
+    return true;
+}
+
+void craggy_requestGetPackets(const CraggyRequest *request, const uint8_t **requestBuf, size_t *requestBufLen, const craggy_rough_time_response_t **responseBuf, size_t *responseBufLen) {
+    *requestBuf = request->requestBuf;
+    *requestBufLen = sizeof(craggy_rough_time_request_t);
+    *responseBuf = request->responseLen > 0 ? request->responseBuf : NULL;
+    *responseBufLen = request->responseLen;
+}
+
+void craggy_requestDestroy(CraggyRequest *request) {
+    if (request != NULL && request->fd >= 0) {
+        close(request->fd);
+    }
+    craggy_free(request);
+}
+
+bool craggy_batchTransportOpen(size_t maxOutstanding, size_t numResponseBuffers, CraggyBatchTransport **batch, CraggyResult *result) {
+
+    *result = CraggyResultGeneralError;
+
+    if (maxOutstanding == 0 || numResponseBuffers == 0) {
+        *batch = NULL;
+        ERROR_OCCURRED(CraggyResultGeneralError);
+    }
+
+    *batch = craggy_calloc(1, sizeof(CraggyBatchTransport));
+    if (*batch == NULL) {
+        ERROR_OCCURRED(CraggyResultInternalError);
+    }
+    (*batch)->fd4 = -1;
+    (*batch)->fd6 = -1;
+    (*batch)->maxOutstanding = maxOutstanding;
+    (*batch)->numResponseBuffers = numResponseBuffers;
+
+    size_t numPending = 2;
+    while (numPending < 2 * maxOutstanding) {
+        numPending <<= (size_t) 1;
+    }
+    (*batch)->pending = craggy_calloc(numPending, sizeof(size_t));
+    (*batch)->pendingMask = numPending - 1;
+
+    (*batch)->outstanding = craggy_calloc(maxOutstanding, sizeof(CraggyOutstandingRequest));
+    (*batch)->responseBuffers = craggy_malloc(numResponseBuffers * CRAGGY_UDP_MAX_RESPONSE_SIZE);
+    (*batch)->responseAddresses = craggy_calloc(numResponseBuffers, sizeof(struct sockaddr_storage));
+    if ((*batch)->pending == NULL || (*batch)->outstanding == NULL || (*batch)->responseBuffers == NULL || (*batch)->responseAddresses == NULL) {
+        ERROR_OCCURRED(CraggyResultInternalError);
+    }
+
+#if defined(__linux__)
+    (*batch)->responseMessages = craggy_calloc(numResponseBuffers, sizeof(struct mmsghdr));
+    (*batch)->responseVectors = craggy_calloc(numResponseBuffers, sizeof(struct iovec));
+    if ((*batch)->responseMessages == NULL || (*batch)->responseVectors == NULL) {
+        ERROR_OCCURRED(CraggyResultInternalError);
+    }
+#endif
+
+#if defined(CRAGGY_WITH_IO_URING)
+    // Receives into buffers of its own, the response buffers being left unused
+    craggy_uringOpen(numResponseBuffers, CRAGGY_UDP_MAX_RESPONSE_SIZE, &(*batch)->uring);
+#endif
+
+    *result = CraggyResultSuccess;
+    goto exit;
+
+error:
+    assert(*result != CraggyResultSuccess);
+    craggy_batchTransportClose(*batch);
+    *batch = NULL;
+
+exit:
+    return *result == CraggyResultSuccess;
+}
+
+static int craggy_batchSocket(CraggyBatchTransport *batch, int family) {
+    int *fd = family == AF_INET6 ? &batch->fd6 : &batch->fd4;
+    if (*fd < 0 && (family == AF_INET || family == AF_INET6)) {
+        *fd = socket(family, SOCK_DGRAM, IPPROTO_UDP);
+#if defined(CRAGGY_WITH_IO_URING)
+        if (*fd >= 0 && batch->uring != NULL) {
+            craggy_uringWatch(batch->uring, *fd);
+        }
+#endif
+    }
+    return *fd;
+}
+
+static bool craggy_sameAddress(const struct sockaddr_storage *a, const struct sockaddr_storage *b) {
+    if (a->ss_family != b->ss_family) {
+        return false;
+    }
+    if (a->ss_family == AF_INET) {
+        const struct sockaddr_in *a4 = (const struct sockaddr_in *) a;
+        const struct sockaddr_in *b4 = (const struct sockaddr_in *) b;
+        return a4->sin_port == b4->sin_port && a4->sin_addr.s_addr == b4->sin_addr.s_addr;
+    }
+    if (a->ss_family == AF_INET6) {
+        const struct sockaddr_in6 *a6 = (const struct sockaddr_in6 *) a;
+        const struct sockaddr_in6 *b6 = (const struct sockaddr_in6 *) b;
+        return a6->sin6_port == b6->sin6_port && craggy_memcmp(&a6->sin6_addr, &b6->sin6_addr, sizeof(a6->sin6_addr)) == 0;
+    }
+    return false;
+}
+
+static size_t craggy_pendingSlot(const CraggyBatchTransport *batch, const uint8_t *leaf) {
+    // The leaf is a hash already
+    uint64_t key;
+    craggy_memcpy(&key, leaf, sizeof(key));
+    return (size_t) key & batch->pendingMask;
+}
+
+static void craggy_addPending(CraggyBatchTransport *batch, size_t index) {
+    size_t slot = craggy_pendingSlot(batch, batch->outstanding[index].leaf);
+    while (batch->pending[slot] != 0) {
+        slot = (slot + 1) & batch->pendingMask;
+    }
+    batch->pending[slot] = index + 1;
+}
+
+static void craggy_removePending(CraggyBatchTransport *batch, size_t index) {
+    size_t slot = craggy_pendingSlot(batch, batch->outstanding[index].leaf);
+    while (batch->pending[slot] != index + 1) {
+        slot = (slot + 1) & batch->pendingMask;
+    }
+
+    // Shift back the requests after it that would no longer be found, leaving no tombstones behind
+    size_t next = slot;
+    for (;;) {
+        batch->pending[slot] = 0;
+        size_t home;
+        do {
+            next = (next + 1) & batch->pendingMask;
+            if (batch->pending[next] == 0) {
+                return;
+            }
+            home = craggy_pendingSlot(batch, batch->outstanding[batch->pending[next] - 1].leaf);
+            // Stays put if its home lies cyclically in (slot, next]
+        } while (slot <= next ? (slot < home && home <= next) : (slot < home || home <= next));
+        batch->pending[slot] = batch->pending[next];
+        slot = next;
+    }
+}
+
+/* Finds the request waiting whose leaf is the root of a reply from the address given. */
+static CraggyOutstandingRequest *craggy_findPending(CraggyBatchTransport *batch, const struct sockaddr_storage *from, const uint8_t *root) {
+    // Several requests may have the same leaf, one nonce having gone to several servers
+    for (size_t slot = craggy_pendingSlot(batch, root); batch->pending[slot] != 0; slot = (slot + 1) & batch->pendingMask) {
+        CraggyOutstandingRequest *entry = &batch->outstanding[batch->pending[slot] - 1];
+        if (craggy_memcmp(entry->leaf, root, CRAGGY_ROUGH_TIME_HASH_LENGTH) == 0 && craggy_sameAddress(&entry->peer, from)) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static void craggy_releaseAnswered(CraggyBatchTransport *batch) {
+    while (batch->numOutstanding > 0 && !batch->outstanding[batch->head].waiting) {
+        batch->head = (batch->head + 1) % batch->maxOutstanding;
+        batch->numOutstanding--;
+    }
+}
+
+bool craggy_batchTransportSend(CraggyBatchTransport *batch, const CraggyBatchRequest *requests, size_t numRequests, size_t *numSent, CraggyResult *result) {
+
+    *result = CraggyResultGeneralError;
+    *numSent = 0;
+
+    // The batch sends from sockets of its own, to addresses operations do not have
+    for (size_t i = 0; i < numRequests; i++) {
+        if (requests[i].server->ops != NULL) {
+            ERROR_OCCURRED(CraggyResultGeneralError);
+        }
+    }
+
+    while (*numSent < numRequests) {
+
+        // Requests of one address family, as many as fit in one call and in the outstanding requests
+        const int family = requests[*numSent].server->peer.ss_family;
+        size_t numChunk = 0;
+        while (*numSent + numChunk < numRequests && numChunk < CRAGGY_UDP_SEND_VECTOR_LENGTH &&
+               batch->numOutstanding + numChunk < batch->maxOutstanding &&
+               requests[*numSent + numChunk].server->peer.ss_family == family) {
+            numChunk++;
+        }
+        if (numChunk == 0) {
+            // Too many requests outstanding
+            ERROR_OCCURRED(CraggyResultGeneralError);
+        }
+
+        const int fd = craggy_batchSocket(batch, family);
+        if (fd < 0) {
+            ERROR_OCCURRED(CraggyResultNetworkInternalError);
+        }
+
+        const CraggyBatchRequest *chunk = requests + *numSent;
+        const uint64_t sentAt = craggy_monotonicUs();
+        size_t numChunkSent = 0;
+
+#if defined(__linux__)
+        struct mmsghdr messages[CRAGGY_UDP_SEND_VECTOR_LENGTH];
+        struct iovec vectors[CRAGGY_UDP_SEND_VECTOR_LENGTH];
+        craggy_memset(messages, 0, sizeof(messages));
+        for (size_t i = 0; i < numChunk; i++) {
+            vectors[i].iov_base = (void *) chunk[i].requestBuf;
+            vectors[i].iov_len = sizeof(craggy_rough_time_request_t);
+            messages[i].msg_hdr.msg_name = (void *) &chunk[i].server->peer;
+            messages[i].msg_hdr.msg_namelen = chunk[i].server->peerLen;
+            messages[i].msg_hdr.msg_iov = &vectors[i];
+            messages[i].msg_hdr.msg_iovlen = 1;
+        }
+
+#if defined(CRAGGY_WITH_IO_URING)
+        if (batch->uring != NULL) {
+            numChunkSent = craggy_uringSend(batch->uring, fd, messages, numChunk);
+        } else
+#endif
+        {
+            int r;
+            do {
+                r = sendmmsg(fd, messages, numChunk, 0 /* flags */);
+            } while (r == -1 && errno == EINTR);
+            numChunkSent = r < 0 ? 0 : (size_t) r;
+        }
+#else
+        for (; numChunkSent < numChunk; numChunkSent++) {
+            ssize_t r;
+            do {
+                r = sendto(fd, chunk[numChunkSent].requestBuf, sizeof(craggy_rough_time_request_t), 0 /* flags */,
+                           (const struct sockaddr *) &chunk[numChunkSent].server->peer, chunk[numChunkSent].server->peerLen);
+            } while (r == -1 && errno == EINTR);
+            if (r != sizeof(craggy_rough_time_request_t)) {
+                break;
+            }
+        }
+#endif
+
+        for (size_t i = 0; i < numChunkSent; i++) {
+            const size_t index = (batch->head + batch->numOutstanding) % batch->maxOutstanding;
+            CraggyOutstandingRequest *entry = &batch->outstanding[index];
+            entry->waiting = true;
+            entry->requestId = chunk[i].requestId;
+            craggy_memcpy(entry->nonce, chunk[i].nonce, CRAGGY_ROUGH_TIME_NONCE_LENGTH);
+            craggy_hashMerkleLeaf(entry->nonce, entry->leaf);
+            craggy_memcpy(&entry->peer, &chunk[i].server->peer, chunk[i].server->peerLen);
+            entry->peerLen = chunk[i].server->peerLen;
+            entry->sentAt = sentAt;
+            craggy_addPending(batch, index);
+            batch->numOutstanding++;
+        }
+        *numSent += numChunkSent;
+
+        if (numChunkSent < numChunk) {
+            ERROR_OCCURRED(CraggyResultNetworkInternalError);
+        }
+    }
+
+    *result = CraggyResultSuccess;
+
+error:
+    return *result == CraggyResultSuccess;
+}
+
+/* Finds the outstanding request a reply is for.  A reply to a request the server answered alone is looked up by its
+ * root; one from a batch of the server's is checked against the requests from the same address, oldest first as
+ * replies mostly arrive in the order sent. */
+static CraggyOutstandingRequest *craggy_matchReply(CraggyBatchTransport *batch, const struct sockaddr_storage *from, const craggy_rough_time_response_t *response, size_t responseLen) {
+    CraggyResult result;
+    const uint8_t *root;
+    size_t depth;
+    if (!craggy_getResponseMerkleRoot(response, responseLen, &root, &depth, &result)) {
+        return NULL;
+    }
+    if (depth == 0) {
+        return craggy_findPending(batch, from, root);
+    }
+
+    for (size_t i = 0; i < batch->numOutstanding; i++) {
+        CraggyOutstandingRequest *entry = &batch->outstanding[(batch->head + i) % batch->maxOutstanding];
+        if (entry->waiting && craggy_sameAddress(&entry->peer, from) && craggy_responseIncludesNonce(entry->nonce, response, responseLen, &result)) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static size_t craggy_receiveReplies(CraggyBatchTransport *batch, int fd, size_t firstBuffer, size_t maxBuffers, size_t *responseLens) {
+
+    size_t numReceived = 0;
+
+#if defined(__linux__)
+    struct mmsghdr *messages = batch->responseMessages + firstBuffer;
+    struct iovec *vectors = batch->responseVectors + firstBuffer;
+    for (size_t i = 0; i < maxBuffers; i++) {
+        craggy_memset(&messages[i], 0, sizeof(struct mmsghdr));
+        vectors[i].iov_base = batch->responseBuffers + (firstBuffer + i) * CRAGGY_UDP_MAX_RESPONSE_SIZE;
+        vectors[i].iov_len = CRAGGY_UDP_MAX_RESPONSE_SIZE;
+        messages[i].msg_hdr.msg_name = &batch->responseAddresses[firstBuffer + i];
+        messages[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+        messages[i].msg_hdr.msg_iov = &vectors[i];
+        messages[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    int r;
+    do {
+        r = recvmmsg(fd, messages, maxBuffers, MSG_DONTWAIT, NULL);
+    } while (r == -1 && errno == EINTR);
+    numReceived = r < 0 ? 0 : (size_t) r;
+
+    for (size_t i = 0; i < numReceived; i++) {
+        responseLens[i] = messages[i].msg_len;
+    }
+#else
+    for (; numReceived < maxBuffers; numReceived++) {
+        socklen_t fromLen = sizeof(struct sockaddr_storage);
+        ssize_t r = recvfrom(fd, batch->responseBuffers + (firstBuffer + numReceived) * CRAGGY_UDP_MAX_RESPONSE_SIZE, CRAGGY_UDP_MAX_RESPONSE_SIZE,
+                             MSG_DONTWAIT, (struct sockaddr *) &batch->responseAddresses[firstBuffer + numReceived], &fromLen);
+        if (r < 0) {
+            break;
+        }
+        responseLens[numReceived] = r;
+    }
+#endif
+
+    return numReceived;
+}
+
+/* Hands a reply on if it is for a request outstanding. */
+static void craggy_deliverReply(CraggyBatchTransport *batch, const struct sockaddr_storage *from, const craggy_rough_time_response_t *response, size_t responseLen, uint64_t now, CraggyBatchReply *replies, size_t *numReplies) {
+    CraggyOutstandingRequest *entry = craggy_matchReply(batch, from, response, responseLen);
+    if (entry == NULL) {
+        return;
+    }
+    entry->waiting = false;
+    craggy_removePending(batch, entry - batch->outstanding);
+
+    CraggyBatchReply *reply = &replies[(*numReplies)++];
+    reply->requestId = entry->requestId;
+    reply->response = response;
+    reply->responseLen = responseLen;
+    reply->roundTripTime = now - entry->sentAt;
+}
+
+#if defined(CRAGGY_WITH_IO_URING)
+/* Takes the replies from the ring, where they arrived without a system call each. */
+static void craggy_receiveUring(CraggyBatchTransport *batch, int timeoutMs, CraggyBatchReply *replies, size_t maxReplies, size_t *numReplies) {
+
+    // Those handed out by the last receive are done with
+    craggy_uringRecycle(batch->uring);
+
+    CraggyUringDatagram datagrams[CRAGGY_UDP_SEND_VECTOR_LENGTH];
+    while (*numReplies < maxReplies) {
+        size_t room = maxReplies - *numReplies;
+        if (room > CRAGGY_UDP_SEND_VECTOR_LENGTH) {
+            room = CRAGGY_UDP_SEND_VECTOR_LENGTH;
+        }
+
+        // Waiting only for the first
+        const size_t numReceived = craggy_uringReceive(batch->uring, timeoutMs, datagrams, room);
+        if (numReceived == 0) {
+            break;
+        }
+        timeoutMs = 0;
+
+        const uint64_t now = craggy_monotonicUs();
+        for (size_t i = 0; i < numReceived; i++) {
+            craggy_deliverReply(batch, datagrams[i].from, datagrams[i].data, datagrams[i].len, now, replies, numReplies);
+        }
+    }
+
+    craggy_releaseAnswered(batch);
+}
+#endif
+
+bool craggy_batchTransportReceive(CraggyBatchTransport *batch, int timeoutMs, CraggyBatchReply *replies, size_t maxReplies, size_t *numReplies, CraggyResult *result) {
+
+    *result = CraggyResultGeneralError;
+    *numReplies = 0;
+
+#if defined(CRAGGY_WITH_IO_URING)
+    if (batch->uring != NULL) {
+        craggy_receiveUring(batch, timeoutMs, replies, maxReplies, numReplies);
+        *result = CraggyResultSuccess;
+        return true;
+    }
+#endif
+
+    struct pollfd fds[2];
+    nfds_t numFds = 0;
+    if (batch->fd4 >= 0) {
+        fds[numFds].fd = batch->fd4;
+        fds[numFds++].events = POLLIN;
+    }
+    if (batch->fd6 >= 0) {
+        fds[numFds].fd = batch->fd6;
+        fds[numFds++].events = POLLIN;
+    }
+
+    if (numFds > 0) {
+        CRAGGY_STATS_START(start);
+        int r = poll(fds, numFds, timeoutMs);
+        CRAGGY_STATS_RECORD(CraggyStageWait, start);
+        if (r < 0 && errno != EINTR) {
+            ERROR_OCCURRED(CraggyResultNetworkInternalError);
+        }
+    }
+
+    const uint64_t now = craggy_monotonicUs();
+    size_t numBuffersUsed = 0;
+    size_t responseLens[CRAGGY_UDP_SEND_VECTOR_LENGTH];
+
+    for (nfds_t f = 0; f < numFds; f++) {
+        if ((fds[f].revents & POLLIN) == 0) {
+            continue;
+        }
+
+        while (numBuffersUsed < batch->numResponseBuffers && *numReplies < maxReplies) {
+            size_t room = batch->numResponseBuffers - numBuffersUsed;
+            if (room > maxReplies - *numReplies) {
+                room = maxReplies - *numReplies;
+            }
+            if (room > CRAGGY_UDP_SEND_VECTOR_LENGTH) {
+                room = CRAGGY_UDP_SEND_VECTOR_LENGTH;
+            }
+
+            const size_t numReceived = craggy_receiveReplies(batch, fds[f].fd, numBuffersUsed, room, responseLens);
+            if (numReceived == 0) {
+                break;
+            }
+
+            for (size_t i = 0; i < numReceived; i++) {
+                const size_t buffer = numBuffersUsed + i;
+                const craggy_rough_time_response_t *response = batch->responseBuffers + buffer * CRAGGY_UDP_MAX_RESPONSE_SIZE;
+                craggy_deliverReply(batch, &batch->responseAddresses[buffer], response, responseLens[i], now, replies, numReplies);
+            }
+            numBuffersUsed += numReceived;
+        }
+    }
+
+    craggy_releaseAnswered(batch);
+
+    *result = CraggyResultSuccess;
+
+error:
+    return *result == CraggyResultSuccess;
+}
+
+size_t craggy_batchTransportExpire(CraggyBatchTransport *batch, int maxAgeMs) {
+
+    const uint64_t now = craggy_monotonicUs();
+    size_t numExpired = 0;
+
+    // Oldest first, so stop at the first request young enough
+    while (batch->numOutstanding > 0) {
+        CraggyOutstandingRequest *entry = &batch->outstanding[batch->head];
+        if (entry->waiting) {
+            if (now - entry->sentAt <= (uint64_t) maxAgeMs * 1000) {
+                break;
+            }
+            entry->waiting = false;
+            craggy_removePending(batch, batch->head);
+            numExpired++;
+        }
+        batch->head = (batch->head + 1) % batch->maxOutstanding;
+        batch->numOutstanding--;
+    }
+    return numExpired;
+}
+
+void craggy_batchTransportClose(CraggyBatchTransport *batch) {
+    if (batch != NULL) {
+#if defined(CRAGGY_WITH_IO_URING)
+        // Before the sockets it receives on
+        craggy_uringClose(batch->uring);
+#endif
+        if (batch->fd4 >= 0) {
+            close(batch->fd4);
+        }
+        if (batch->fd6 >= 0) {
+            close(batch->fd6);
+        }
+#if defined(__linux__)
+        craggy_free(batch->responseVectors);
+        craggy_free(batch->responseMessages);
+#endif
+        craggy_free(batch->responseAddresses);
+        craggy_free(batch->responseBuffers);
+        craggy_free(batch->outstanding);
+        craggy_free(batch->pending);
+    }
+    craggy_free(batch);
+}
+
+void craggy_transportClose(CraggyTransport *transport) {
+    if (transport != NULL) {
+        if (transport->ops != NULL && transport->ops->close != NULL) {
+            transport->ops->close(transport->context);
+        }
+        craggy_disconnect(transport);
+        craggy_free(transport->address);
+    }
+    craggy_free(transport);
+}
+
+bool craggy_makeRequest(const char *address, const craggy_rough_time_request_t requestBuf, CraggyResult *result, craggy_rough_time_response_t *responseBuf, size_t *responseBufLen) {
+
+    CraggyTransport *transport = NULL;
+    if (!craggy_transportOpen(address, &transport, result)) {
+        return false;
+    }
+
+    bool success = craggy_transportRequest(transport, requestBuf, result, responseBuf, responseBufLen);
+    craggy_transportClose(transport);
+    return success;
+}
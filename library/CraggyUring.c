@@ -0,0 +1,467 @@
+/* Copyright 2020 Johan Lindquist
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define _GNU_SOURCE // struct mmsghdr
+
+#include <errno.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <linux/io_uring.h>
+
+#include "CraggyUring.h"
+#include "CraggyOS.h"
+
+/** Submission queue entries - a full send and the arming of both sockets */
+#define CRAGGY_URING_SQ_ENTRIES (2 * CRAGGY_URING_MAX_SEND)
+
+/** Most sockets received on */
+#define CRAGGY_URING_MAX_SOCKETS 2
+
+/** Identifies the buffer ring of the received datagrams */
+#define CRAGGY_URING_BUFFER_GROUP 0
+
+/** Largest ring of provided buffers, their ids being 16 bits */
+#define CRAGGY_URING_MAX_BUFFERS 32768
+
+/** Kinds of operation, in the high half of the user data of their completions - the low half is the index of the
+ * datagram sent or of the socket received on */
+#define CRAGGY_URING_SEND ((uint64_t) 1 << 32)
+#define CRAGGY_URING_RECEIVE ((uint64_t) 2 << 32)
+
+struct CraggyUring {
+    int fd;
+
+    void *rings;
+    size_t ringsLen;
+    struct io_uring_sqe *sqes;
+    size_t sqesLen;
+    _Atomic unsigned *sqHead;
+    _Atomic unsigned *sqTail;
+    unsigned *sqArray;
+    unsigned sqMask;
+    unsigned sqEntries;
+    // Entries written but not yet handed to the kernel
+    unsigned sqLocalTail;
+    unsigned numUnsubmitted;
+    _Atomic unsigned *cqHead;
+    _Atomic unsigned *cqTail;
+    struct io_uring_cqe *cqes;
+    unsigned cqMask;
+
+    // Buffers provided to the kernel.  Each holds the io_uring_recvmsg_out header, the address, then the datagram.
+    struct io_uring_buf_ring *bufferRing;
+    size_t bufferRingLen;
+    unsigned bufferRingMask;
+    uint16_t bufferRingTail;
+    uint8_t *buffers;
+    size_t bufferLen;
+    size_t maxDatagramLen;
+
+    // Buffers of the datagrams returned, until recycled
+    uint16_t *held;
+    size_t numHeld;
+
+    // Completions of receives reaped while waiting for sends, or not yet returned
+    struct io_uring_cqe *stash;
+    size_t stashSize;
+    size_t stashHead;
+    size_t numStashed;
+
+    int sockets[CRAGGY_URING_MAX_SOCKETS];
+    // Whether a multishot receive is in place on the socket - it ends when the kernel runs out of buffers
+    bool armed[CRAGGY_URING_MAX_SOCKETS];
+    size_t numSockets;
+    // Describes the layout of the buffers to the multishot receives: an address, no control data
+    struct msghdr receiveHeader;
+};
+
+static int craggy_uringEnter(const CraggyUring *ring, unsigned toSubmit, unsigned minComplete, unsigned flags, const void *arg, size_t argLen) {
+    return (int) syscall(__NR_io_uring_enter, ring->fd, toSubmit, minComplete, flags, arg, argLen);
+}
+
+static struct io_uring_sqe *craggy_uringGetSqe(CraggyUring *ring) {
+    if (ring->sqLocalTail - atomic_load_explicit(ring->sqHead, memory_order_acquire) >= ring->sqEntries) {
+        return NULL;
+    }
+    const unsigned index = ring->sqLocalTail & ring->sqMask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+    craggy_memset(sqe, 0, sizeof(*sqe));
+    ring->sqArray[index] = index;
+    ring->sqLocalTail++;
+    ring->numUnsubmitted++;
+    return sqe;
+}
+
+/* Hands the entries written to the kernel, waiting for completions as asked. */
+static bool craggy_uringSubmit(CraggyUring *ring, unsigned minComplete, unsigned flags, const void *arg, size_t argLen) {
+    atomic_store_explicit(ring->sqTail, ring->sqLocalTail, memory_order_release);
+    if (arg == NULL) {
+        argLen = _NSIG / 8;
+    }
+    for (;;) {
+        int r = craggy_uringEnter(ring, ring->numUnsubmitted, minComplete, flags, arg, argLen);
+        if (r >= 0) {
+            ring->numUnsubmitted -= (unsigned) r;
+            return true;
+        }
+        if (errno == ETIME) {
+            return true;
+        }
+        if (errno != EINTR) {
+            return false;
+        }
+    }
+}
+
+static void craggy_uringProvideBuffer(CraggyUring *ring, uint16_t bufferId) {
+    struct io_uring_buf *buffer = &ring->bufferRing->bufs[ring->bufferRingTail & ring->bufferRingMask];
+    buffer->addr = (uint64_t) (uintptr_t) (ring->buffers + (size_t) bufferId * ring->bufferLen);
+    buffer->len = (uint32_t) ring->bufferLen;
+    buffer->bid = bufferId;
+    ring->bufferRingTail++;
+}
+
+static void craggy_uringPublishBuffers(CraggyUring *ring) {
+    atomic_store_explicit((_Atomic uint16_t *) &ring->bufferRing->tail, ring->bufferRingTail, memory_order_release);
+}
+
+/* Takes the completions available off the queue: those of sends are counted into the results given, those of
+ * receives stashed in the order they came. */
+static void craggy_uringReap(CraggyUring *ring, int32_t *sendResults, size_t *numSendsDone) {
+    unsigned head = atomic_load_explicit(ring->cqHead, memory_order_relaxed);
+    const unsigned tail = atomic_load_explicit(ring->cqTail, memory_order_acquire);
+
+    for (; head != tail; head++) {
+        const struct io_uring_cqe *cqe = &ring->cqes[head & ring->cqMask];
+        const uint64_t kind = cqe->user_data & ~(uint64_t) UINT32_MAX;
+        const size_t index = cqe->user_data & UINT32_MAX;
+
+        if (kind == CRAGGY_URING_SEND) {
+            if (sendResults != NULL) {
+                sendResults[index] = cqe->res;
+                (*numSendsDone)++;
+            }
+        } else if (kind == CRAGGY_URING_RECEIVE) {
+            if (ring->numStashed < ring->stashSize) {
+                ring->stash[(ring->stashHead + ring->numStashed++) % ring->stashSize] = *cqe;
+            } else {
+                // Cannot happen as every completion stashed holds a buffer or ends the receive of its socket; were
+                // it to, the datagram is dropped
+                if (cqe->flags & IORING_CQE_F_BUFFER) {
+                    craggy_uringProvideBuffer(ring, (uint16_t) (cqe->flags >> IORING_CQE_BUFFER_SHIFT));
+                    craggy_uringPublishBuffers(ring);
+                }
+                if ((cqe->flags & IORING_CQE_F_MORE) == 0 && index < ring->numSockets) {
+                    ring->armed[index] = false;
+                }
+            }
+        }
+    }
+    atomic_store_explicit(ring->cqHead, head, memory_order_release);
+}
+
+/* Multishot receive, needing no more than one submission per socket, and provided buffers arrived together in 6.0 -
+ * as did zero copy send, which the kernel can be asked about. */
+static bool craggy_uringSupported(const CraggyUring *ring) {
+    const size_t probeLen = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = craggy_calloc(1, probeLen);
+    if (probe == NULL) {
+        return false;
+    }
+    bool supported = syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_PROBE, probe, 256) == 0 &&
+                     probe->last_op >= IORING_OP_SEND_ZC &&
+                     (probe->ops[IORING_OP_SEND_ZC].flags & IO_URING_OP_SUPPORTED) != 0 &&
+                     (probe->ops[IORING_OP_RECVMSG].flags & IO_URING_OP_SUPPORTED) != 0 &&
+                     (probe->ops[IORING_OP_SENDMSG].flags & IO_URING_OP_SUPPORTED) != 0;
+    craggy_free(probe);
+    return supported;
+}
+
+bool craggy_uringOpen(size_t numBuffers, size_t bufferLen, CraggyUring **ring) {
+
+    *ring = NULL;
+    if (numBuffers == 0 || numBuffers > CRAGGY_URING_MAX_BUFFERS) {
+        return false;
+    }
+
+    CraggyUring *r = craggy_calloc(1, sizeof(CraggyUring));
+    if (r == NULL) {
+        return false;
+    }
+    r->fd = -1;
+    r->rings = MAP_FAILED;
+    r->sqes = MAP_FAILED;
+    r->bufferRing = MAP_FAILED;
+
+    struct io_uring_params params;
+    craggy_memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = (unsigned) (2 * CRAGGY_URING_SQ_ENTRIES + numBuffers);
+    r->fd = (int) syscall(__NR_io_uring_setup, CRAGGY_URING_SQ_ENTRIES, &params);
+    if (r->fd < 0) {
+        goto error;
+    }
+
+    const unsigned requiredFeatures = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG;
+    if ((params.features & requiredFeatures) != requiredFeatures || !craggy_uringSupported(r)) {
+        goto error;
+    }
+
+    // Both queues share one mapping
+    const size_t sqLen = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    const size_t cqLen = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    r->ringsLen = sqLen > cqLen ? sqLen : cqLen;
+    r->rings = mmap(NULL, r->ringsLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+    r->sqesLen = params.sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = mmap(NULL, r->sqesLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+    if (r->rings == MAP_FAILED || r->sqes == MAP_FAILED) {
+        goto error;
+    }
+
+    uint8_t *rings = r->rings;
+    r->sqHead = (_Atomic unsigned *) (rings + params.sq_off.head);
+    r->sqTail = (_Atomic unsigned *) (rings + params.sq_off.tail);
+    r->sqArray = (unsigned *) (rings + params.sq_off.array);
+    r->sqMask = *(unsigned *) (rings + params.sq_off.ring_mask);
+    r->sqEntries = params.sq_entries;
+    r->sqLocalTail = atomic_load_explicit(r->sqTail, memory_order_relaxed);
+    r->cqHead = (_Atomic unsigned *) (rings + params.cq_off.head);
+    r->cqTail = (_Atomic unsigned *) (rings + params.cq_off.tail);
+    r->cqes = (struct io_uring_cqe *) (rings + params.cq_off.cqes);
+    r->cqMask = *(unsigned *) (rings + params.cq_off.ring_mask);
+
+    // The ring of buffers has to be page aligned, its size a power of two
+    unsigned ringEntries = 1;
+    while (ringEntries < numBuffers) {
+        ringEntries <<= 1U;
+    }
+    r->bufferRingMask = ringEntries - 1;
+    r->bufferRingLen = ringEntries * sizeof(struct io_uring_buf);
+    r->bufferRing = mmap(NULL, r->bufferRingLen, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (r->bufferRing == MAP_FAILED) {
+        goto error;
+    }
+
+    struct io_uring_buf_reg registration;
+    craggy_memset(&registration, 0, sizeof(registration));
+    registration.ring_addr = (uint64_t) (uintptr_t) r->bufferRing;
+    registration.ring_entries = ringEntries;
+    registration.bgid = CRAGGY_URING_BUFFER_GROUP;
+    if (syscall(__NR_io_uring_register, r->fd, IORING_REGISTER_PBUF_RING, &registration, 1) != 0) {
+        goto error;
+    }
+
+    // Header, address and datagram, rounded up to keep every buffer aligned
+    r->maxDatagramLen = bufferLen;
+    r->bufferLen = (sizeof(struct io_uring_recvmsg_out) + sizeof(struct sockaddr_storage) + bufferLen + 63) & ~(size_t) 63;
+    r->buffers = craggy_malloc(numBuffers * r->bufferLen);
+    r->held = craggy_calloc(numBuffers, sizeof(uint16_t));
+    r->stashSize = numBuffers + 2 * CRAGGY_URING_MAX_SOCKETS;
+    r->stash = craggy_calloc(r->stashSize, sizeof(struct io_uring_cqe));
+    if (r->buffers == NULL || r->held == NULL || r->stash == NULL) {
+        goto error;
+    }
+    for (size_t i = 0; i < numBuffers; i++) {
+        craggy_uringProvideBuffer(r, (uint16_t) i);
+    }
+    craggy_uringPublishBuffers(r);
+
+    r->receiveHeader.msg_namelen = sizeof(struct sockaddr_storage);
+
+    *ring = r;
+    return true;
+
+error:
+    craggy_uringClose(r);
+    return false;
+}
+
+bool craggy_uringWatch(CraggyUring *ring, int fd) {
+    if (ring->numSockets == CRAGGY_URING_MAX_SOCKETS) {
+        return false;
+    }
+    // Armed by the next receive
+    ring->sockets[ring->numSockets] = fd;
+    ring->armed[ring->numSockets] = false;
+    ring->numSockets++;
+    return true;
+}
+
+size_t craggy_uringSend(CraggyUring *ring, int fd, struct mmsghdr *messages, size_t numMessages) {
+
+    int32_t results[CRAGGY_URING_MAX_SEND];
+    size_t numQueued = 0;
+
+    for (; numQueued < numMessages && numQueued < CRAGGY_URING_MAX_SEND; numQueued++) {
+        struct io_uring_sqe *sqe = craggy_uringGetSqe(ring);
+        if (sqe == NULL) {
+            break;
+        }
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = fd;
+        sqe->addr = (uint64_t) (uintptr_t) &messages[numQueued].msg_hdr;
+        sqe->len = 1;
+        sqe->user_data = CRAGGY_URING_SEND | numQueued;
+        // Linked, so the sends go in order and a failure cancels the rest as with sendmmsg
+        sqe->flags = IOSQE_IO_LINK;
+        results[numQueued] = -ECANCELED;
+    }
+    if (numQueued == 0) {
+        return 0;
+    }
+    ring->sqes[(ring->sqLocalTail - 1) & ring->sqMask].flags &= (uint8_t) ~IOSQE_IO_LINK;
+
+    // The kernel may read the messages until their sends complete, so this waits for all sent
+    size_t numDone = 0;
+    size_t numExpected = numQueued;
+    while (numDone < numExpected) {
+        if (!craggy_uringSubmit(ring, 1, IORING_ENTER_GETEVENTS, NULL, 0) && ring->numUnsubmitted > 0) {
+            // Those that never got to the kernel are taken back, left cancelled
+            numExpected -= ring->numUnsubmitted;
+            ring->sqLocalTail -= ring->numUnsubmitted;
+            ring->numUnsubmitted = 0;
+        }
+        craggy_uringReap(ring, results, &numDone);
+    }
+
+    size_t numSent = 0;
+    while (numSent < numQueued && results[numSent] >= 0) {
+        messages[numSent].msg_len = (unsigned) results[numSent];
+        numSent++;
+    }
+    return numSent;
+}
+
+void craggy_uringRecycle(CraggyUring *ring) {
+    if (ring->numHeld == 0) {
+        return;
+    }
+    for (size_t i = 0; i < ring->numHeld; i++) {
+        craggy_uringProvideBuffer(ring, ring->held[i]);
+    }
+    ring->numHeld = 0;
+    craggy_uringPublishBuffers(ring);
+}
+
+/* Sets up a multishot receive on every socket whose last one ended, and waits for completions. */
+static void craggy_uringWait(CraggyUring *ring, int timeoutMs) {
+
+    for (size_t i = 0; i < ring->numSockets; i++) {
+        if (ring->armed[i]) {
+            continue;
+        }
+        struct io_uring_sqe *sqe = craggy_uringGetSqe(ring);
+        if (sqe == NULL) {
+            break;
+        }
+        sqe->opcode = IORING_OP_RECVMSG;
+        sqe->fd = ring->sockets[i];
+        sqe->addr = (uint64_t) (uintptr_t) &ring->receiveHeader;
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = CRAGGY_URING_BUFFER_GROUP;
+        sqe->user_data = CRAGGY_URING_RECEIVE | i;
+        ring->armed[i] = true;
+    }
+
+    const bool ready = atomic_load_explicit(ring->cqTail, memory_order_acquire) != atomic_load_explicit(ring->cqHead, memory_order_relaxed);
+    if (ready || timeoutMs == 0) {
+        if (ring->numUnsubmitted > 0) {
+            craggy_uringSubmit(ring, 0, 0, NULL, 0);
+        }
+        return;
+    }
+
+    struct __kernel_timespec timeout;
+    struct io_uring_getevents_arg arg;
+    craggy_memset(&arg, 0, sizeof(arg));
+    arg.sigmask_sz = _NSIG / 8;
+    if (timeoutMs > 0) {
+        timeout.tv_sec = timeoutMs / 1000;
+        timeout.tv_nsec = (long long) (timeoutMs % 1000) * 1000000;
+        arg.ts = (uint64_t) (uintptr_t) &timeout;
+    }
+    craggy_uringSubmit(ring, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+}
+
+size_t craggy_uringReceive(CraggyUring *ring, int timeoutMs, CraggyUringDatagram *datagrams, size_t maxDatagrams) {
+
+    if (ring->numSockets == 0) {
+        return 0;
+    }
+
+    // Only with nothing stashed are receives set up again, so each socket has at most one ended receive stashed
+    if (ring->numStashed == 0) {
+        craggy_uringWait(ring, timeoutMs);
+    }
+    craggy_uringReap(ring, NULL, NULL);
+
+    size_t numDatagrams = 0;
+    while (ring->numStashed > 0 && numDatagrams < maxDatagrams) {
+        const struct io_uring_cqe cqe = ring->stash[ring->stashHead];
+        ring->stashHead = (ring->stashHead + 1) % ring->stashSize;
+        ring->numStashed--;
+
+        const size_t socket = cqe.user_data & UINT32_MAX;
+        if ((cqe.flags & IORING_CQE_F_MORE) == 0 && socket < ring->numSockets) {
+            ring->armed[socket] = false;
+        }
+        if (cqe.res < 0 || (cqe.flags & IORING_CQE_F_BUFFER) == 0 || socket >= ring->numSockets) {
+            continue;
+        }
+
+        const uint16_t bufferId = (uint16_t) (cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+        ring->held[ring->numHeld++] = bufferId;
+
+        const uint8_t *buffer = ring->buffers + (size_t) bufferId * ring->bufferLen;
+        const struct io_uring_recvmsg_out *out = (const struct io_uring_recvmsg_out *) buffer;
+        if (out->flags & MSG_TRUNC) {
+            continue;
+        }
+
+        CraggyUringDatagram *datagram = &datagrams[numDatagrams++];
+        datagram->fd = ring->sockets[socket];
+        datagram->from = (const struct sockaddr_storage *) (buffer + sizeof(struct io_uring_recvmsg_out));
+        datagram->data = buffer + sizeof(struct io_uring_recvmsg_out) + ring->receiveHeader.msg_namelen;
+        datagram->len = out->payloadlen;
+    }
+    return numDatagrams;
+}
+
+void craggy_uringClose(CraggyUring *ring) {
+    if (ring != NULL) {
+        // Closing the ring cancels the receives and unregisters the buffers
+        if (ring->fd >= 0) {
+            close(ring->fd);
+        }
+        if (ring->rings != MAP_FAILED) {
+            munmap(ring->rings, ring->ringsLen);
+        }
+        if (ring->sqes != MAP_FAILED) {
+            munmap(ring->sqes, ring->sqesLen);
+        }
+        if (ring->bufferRing != MAP_FAILED) {
+            munmap(ring->bufferRing, ring->bufferRingLen);
+        }
+        craggy_free(ring->stash);
+        craggy_free(ring->held);
+        craggy_free(ring->buffers);
+    }
+    craggy_free(ring);
+}
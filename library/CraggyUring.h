@@ -0,0 +1,90 @@
+/* Copyright 2020 Johan Lindquist
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CRAGGY_CRAGGYURING_H
+#define CRAGGY_CRAGGYURING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/socket.h>
+
+/** An io_uring sending datagrams and receiving them on up to two sockets, for the batch transport.  Receiving is
+ * multishot: armed once per socket, each datagram arriving lands in one of the ring's own buffers and completes
+ * without a system call of its own. */
+typedef struct CraggyUring CraggyUring;
+
+/** A datagram received by {@link craggy_uringReceive}. */
+typedef struct {
+    int fd;
+    /** Points into one of the ring's buffers, valid until the next {@link craggy_uringRecycle} */
+    const uint8_t *data;
+    size_t len;
+    const struct sockaddr_storage *from;
+} CraggyUringDatagram;
+
+/** Sets up an io_uring.  Fails if the kernel lacks what is needed - multishot receive into a ring of provided
+ * buffers arrived in Linux 6.0 - or io_uring is not permitted, as under the default seccomp profile of containers.
+ *
+ * @param numBuffers Number of buffers to receive into
+ * @param bufferLen Largest datagram to receive
+ * @param ring Ring set up
+ * @return True if successful, otherwise false
+ */
+bool craggy_uringOpen(size_t numBuffers, size_t bufferLen, CraggyUring **ring);
+
+/** Starts receiving on a socket, at most two per ring.
+ *
+ * @param ring Ring opened using {@link craggy_uringOpen}
+ * @param fd Socket to receive on
+ * @return True if successful, otherwise false
+ */
+bool craggy_uringWatch(CraggyUring *ring, int fd);
+
+/** Sends datagrams one after the other, as sendmmsg would, using one system call.  A send failing cancels those
+ * after it.  Returns once all are done, so the messages need not outlive the call.
+ *
+ * @param ring Ring opened using {@link craggy_uringOpen}
+ * @param fd Socket to send on
+ * @param messages Datagrams to send - struct mmsghdr needs _GNU_SOURCE
+ * @param numMessages Number of datagrams, at most {@link CRAGGY_URING_MAX_SEND}
+ * @return Number of datagrams sent
+ */
+size_t craggy_uringSend(CraggyUring *ring, int fd, struct mmsghdr *messages, size_t numMessages);
+
+/** Most datagrams sent by one {@link craggy_uringSend} */
+#define CRAGGY_URING_MAX_SEND 64
+
+/** Hands back the buffers of all datagrams received, for receiving into again. */
+void craggy_uringRecycle(CraggyUring *ring);
+
+/** Returns the datagrams received, waiting up to the timeout specified if there are none.  Their buffers stay in use
+ * until {@link craggy_uringRecycle}, so no more than the ring's number of buffers can be returned in between.
+ *
+ * @param ring Ring opened using {@link craggy_uringOpen}
+ * @param timeoutMs Time to wait for a datagram, in milliseconds, negative to wait for ever
+ * @param datagrams Datagrams received
+ * @param maxDatagrams Size of the datagrams array
+ * @return Number of datagrams received
+ */
+size_t craggy_uringReceive(CraggyUring *ring, int timeoutMs, CraggyUringDatagram *datagrams, size_t maxDatagrams);
+
+/**
+ *
+ * @param ring
+ */
+void craggy_uringClose(CraggyUring *ring);
+
+#endif //CRAGGY_CRAGGYURING_H
@@ -0,0 +1,274 @@
+/* Copyright 2020 Johan Lindquist
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+#include "CraggyVerifyPool.h"
+#include "CraggyOS.h"
+
+#define ERROR_OCCURRED(x) *result = x; goto error;
+
+typedef struct {
+    pthread_t thread;
+    bool started;
+} CraggyVerifyWorker;
+
+struct CraggyVerifyPool {
+    const CraggyRootKeySet *rootKeys;
+    size_t cacheCapacity;
+
+    // Jobs waiting for a worker, oldest first
+    pthread_mutex_t lock;
+    pthread_cond_t available;
+    CraggyVerifyJob *pendingHead;
+    CraggyVerifyJob *pendingTail;
+    bool stopping;
+
+    // Finished jobs: an intrusive multi-producer single-consumer queue (Vyukov).  Workers push at the head, the
+    // consumer pops at the tail; stub keeps the queue from ever being empty.
+    _Atomic(CraggyVerifyJob *) finishedHead;
+    CraggyVerifyJob *finishedTail;
+    CraggyVerifyJob stub;
+
+    // Written to once per finished job, for the consumer to wait on
+    int notifyFds[2];
+
+    size_t numWorkers;
+    CraggyVerifyWorker *workers;
+};
+
+/* The next links are plain pointers in the public struct, so they are accessed through the atomic builtins. */
+static CraggyVerifyJob *craggy_loadNext(CraggyVerifyJob *job) {
+    return __atomic_load_n(&job->next, __ATOMIC_ACQUIRE);
+}
+
+static void craggy_pushFinished(CraggyVerifyPool *pool, CraggyVerifyJob *job) {
+    __atomic_store_n(&job->next, NULL, __ATOMIC_RELAXED);
+    CraggyVerifyJob *previous = atomic_exchange_explicit(&pool->finishedHead, job, memory_order_acq_rel);
+    // Between the exchange and this store the queue is briefly disconnected; the consumer sees it as empty
+    __atomic_store_n(&previous->next, job, __ATOMIC_RELEASE);
+}
+
+static CraggyVerifyJob *craggy_popFinished(CraggyVerifyPool *pool) {
+    CraggyVerifyJob *tail = pool->finishedTail;
+    CraggyVerifyJob *next = craggy_loadNext(tail);
+
+    if (tail == &pool->stub) {
+        if (next == NULL) {
+            return NULL;
+        }
+        pool->finishedTail = next;
+        tail = next;
+        next = craggy_loadNext(next);
+    }
+    if (next != NULL) {
+        pool->finishedTail = next;
+        return tail;
+    }
+
+    if (tail != atomic_load_explicit(&pool->finishedHead, memory_order_acquire)) {
+        // A push is under way, its job will be there next time
+        return NULL;
+    }
+
+    // tail is the last job: put the stub behind it so it can be handed out
+    craggy_pushFinished(pool, &pool->stub);
+    next = craggy_loadNext(tail);
+    if (next != NULL) {
+        pool->finishedTail = next;
+        return tail;
+    }
+    return NULL;
+}
+
+static void *craggy_runVerifyWorker(void *argument) {
+    CraggyVerifyPool *pool = argument;
+    CraggyClientContext *context = NULL;
+    CraggyResult result;
+
+    // Without a context responses are still verified, only without the prepared root keys and cache
+    if (!craggy_createClientContext(pool->rootKeys, pool->cacheCapacity, NULL, &context, &result)) {
+        context = NULL;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    while (true) {
+        while (pool->pendingHead == NULL && !pool->stopping) {
+            pthread_cond_wait(&pool->available, &pool->lock);
+        }
+        CraggyVerifyJob *job = pool->pendingHead;
+        if (job == NULL) {
+            break;
+        }
+        pool->pendingHead = job->next;
+        if (pool->pendingHead == NULL) {
+            pool->pendingTail = NULL;
+        }
+        pthread_mutex_unlock(&pool->lock);
+
+        if (context != NULL) {
+            craggy_contextProcessResponse(context, job->nonce, job->rootPublicKey, job->response, job->responseLen, &job->result, &job->time, &job->radius);
+        } else {
+            craggy_processResponse(job->nonce, job->rootPublicKey, job->response, job->responseLen, &job->result, &job->time, &job->radius);
+        }
+
+        craggy_pushFinished(pool, job);
+        // A full pipe already wakes the consumer, which then collects every finished job
+        const uint8_t notification = 1;
+        ssize_t written = write(pool->notifyFds[1], &notification, 1);
+        (void) written;
+
+        pthread_mutex_lock(&pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    if (context != NULL) {
+        craggy_destroyClientContext(context);
+    } else {
+        craggy_releaseThreadCryptoState();
+    }
+    return NULL;
+}
+
+bool craggy_createVerifyPool(size_t numWorkers, const CraggyRootKeySet *rootKeys, size_t cacheCapacity, CraggyVerifyPool **pool, CraggyResult *result) {
+
+    *result = CraggyResultGeneralError;
+
+    if (numWorkers == 0) {
+        *pool = NULL;
+        return false;
+    }
+
+    *pool = craggy_calloc(1, sizeof(CraggyVerifyPool));
+    if (*pool == NULL) {
+        return false;
+    }
+    (*pool)->rootKeys = rootKeys;
+    (*pool)->cacheCapacity = cacheCapacity;
+    (*pool)->notifyFds[0] = (*pool)->notifyFds[1] = -1;
+    (*pool)->finishedTail = &(*pool)->stub;
+    atomic_init(&(*pool)->finishedHead, &(*pool)->stub);
+    pthread_mutex_init(&(*pool)->lock, NULL);
+    pthread_cond_init(&(*pool)->available, NULL);
+
+    if (pipe((*pool)->notifyFds) != 0) {
+        (*pool)->notifyFds[0] = (*pool)->notifyFds[1] = -1;
+        ERROR_OCCURRED(CraggyResultInternalError);
+    }
+    for (size_t i = 0; i < 2; i++) {
+        if (fcntl((*pool)->notifyFds[i], F_SETFL, O_NONBLOCK) != 0 || fcntl((*pool)->notifyFds[i], F_SETFD, FD_CLOEXEC) != 0) {
+            ERROR_OCCURRED(CraggyResultInternalError);
+        }
+    }
+
+    (*pool)->workers = craggy_calloc(numWorkers, sizeof(CraggyVerifyWorker));
+    if ((*pool)->workers == NULL) {
+        ERROR_OCCURRED(CraggyResultInternalError);
+    }
+    (*pool)->numWorkers = numWorkers;
+
+    for (size_t i = 0; i < numWorkers; i++) {
+        CraggyVerifyWorker *worker = &(*pool)->workers[i];
+        if (pthread_create(&worker->thread, NULL, craggy_runVerifyWorker, *pool) != 0) {
+            ERROR_OCCURRED(CraggyResultInternalError);
+        }
+        worker->started = true;
+    }
+
+    *result = CraggyResultSuccess;
+    goto exit;
+
+error:
+    craggy_destroyVerifyPool(*pool);
+    *pool = NULL;
+
+exit:
+    return *result == CraggyResultSuccess;
+}
+
+void craggy_verifyPoolSubmit(CraggyVerifyPool *pool, CraggyVerifyJob *job) {
+    job->next = NULL;
+    job->result = CraggyResultGeneralError;
+
+    pthread_mutex_lock(&pool->lock);
+    if (pool->pendingTail != NULL) {
+        pool->pendingTail->next = job;
+    } else {
+        pool->pendingHead = job;
+    }
+    pool->pendingTail = job;
+    pthread_cond_signal(&pool->available);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+CraggyVerifyJob *craggy_verifyPoolPoll(CraggyVerifyPool *pool) {
+    // Notifications are drained before looking at the queue, so one arriving now is for a job not yet collected
+    uint8_t notifications[64];
+    while (read(pool->notifyFds[0], notifications, sizeof(notifications)) > 0) {
+    }
+    return craggy_popFinished(pool);
+}
+
+CraggyVerifyJob *craggy_verifyPoolWait(CraggyVerifyPool *pool, int timeoutMs) {
+    CraggyVerifyJob *job = craggy_verifyPoolPoll(pool);
+    while (job == NULL) {
+        struct pollfd fd = { .fd = pool->notifyFds[0], .events = POLLIN };
+        int r = poll(&fd, 1, timeoutMs);
+        if (r < 0 && errno == EINTR) {
+            continue;
+        }
+        job = craggy_verifyPoolPoll(pool);
+        if (r == 0 && job == NULL) {
+            break;
+        }
+    }
+    return job;
+}
+
+int craggy_verifyPoolGetFd(const CraggyVerifyPool *pool) {
+    return pool->notifyFds[0];
+}
+
+void craggy_destroyVerifyPool(CraggyVerifyPool *pool) {
+    if (pool == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = true;
+    pthread_cond_broadcast(&pool->available);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (size_t i = 0; i < pool->numWorkers; i++) {
+        if (pool->workers[i].started) {
+            pthread_join(pool->workers[i].thread, NULL);
+        }
+    }
+    craggy_free(pool->workers);
+
+    for (size_t i = 0; i < 2; i++) {
+        if (pool->notifyFds[i] >= 0) {
+            close(pool->notifyFds[i]);
+        }
+    }
+    pthread_cond_destroy(&pool->available);
+    pthread_mutex_destroy(&pool->lock);
+    craggy_free(pool);
+}
@@ -0,0 +1,110 @@
+/* Copyright 2020 Johan Lindquist
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CRAGGY_CRAGGYVERIFYPOOL_H
+#define CRAGGY_CRAGGYVERIFYPOOL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "CraggyClient.h"
+
+/** Largest response a job can hold. */
+#define CRAGGY_VERIFY_JOB_MAX_RESPONSE_SIZE (3 * CRAGGY_ROUGH_TIME_MIN_REQUEST_SIZE)
+
+/** A response to verify on a worker of a {@link CraggyVerifyPool}.  Owned by the caller, who must leave it alone from
+ * submitting it until getting it back from {@link craggy_verifyPoolPoll}.
+ */
+typedef struct CraggyVerifyJob {
+    craggy_rough_time_nonce_t nonce;
+    craggy_rough_time_public_key_t rootPublicKey;
+    uint8_t response[CRAGGY_VERIFY_JOB_MAX_RESPONSE_SIZE];
+    size_t responseLen;
+    /** Not touched by the pool */
+    void *userData;
+
+    /** Set by the worker verifying the response */
+    CraggyResult result;
+    craggy_rough_time_t time;
+    craggy_rough_time_radius_t radius;
+
+    /** Link of the queue the job is in, used by the pool only */
+    struct CraggyVerifyJob *next;
+} CraggyVerifyJob;
+
+/** Worker threads verifying responses off the thread receiving them, so the receiving thread stays free to timestamp
+ * packets as they arrive.  Each worker has a {@link CraggyClientContext} of its own, with its own delegation cache.
+ * Jobs are handed out under a lock; finished jobs come back through a lock-free queue.  Jobs may only be submitted
+ * and collected by one thread at a time.
+ */
+typedef struct CraggyVerifyPool CraggyVerifyPool;
+
+/** Starts the workers of a pool.
+ *
+ * @param numWorkers Number of worker threads, at least one
+ * @param rootKeys Prepared root keys shared by the workers, or NULL.  Must outlive the pool.
+ * @param cacheCapacity Number of delegations each worker caches, 0 for no caching
+ * @param pool Pool created
+ * @param result Result of the operation
+ * @return True if successful, otherwise false and {@link result} will indicate the error
+ */
+bool craggy_createVerifyPool(size_t numWorkers, const CraggyRootKeySet *rootKeys, size_t cacheCapacity, CraggyVerifyPool **pool, CraggyResult *result);
+
+/** Queues a job for the next free worker.
+ *
+ * @param pool Pool to verify on
+ * @param job Job to verify
+ */
+void craggy_verifyPoolSubmit(CraggyVerifyPool *pool, CraggyVerifyJob *job);
+
+/** Returns a finished job, if there is one, without blocking.
+ *
+ * @param pool Pool the jobs were submitted to
+ * @return A finished job, or NULL if none has finished since the last call
+ */
+CraggyVerifyJob *craggy_verifyPoolPoll(CraggyVerifyPool *pool);
+
+/** Waits for a job to finish.
+ *
+ * @param pool Pool the jobs were submitted to
+ * @param timeoutMs Time to wait, in milliseconds, or -1 to wait for ever
+ * @return A finished job, or NULL if none finished in time
+ */
+CraggyVerifyJob *craggy_verifyPoolWait(CraggyVerifyPool *pool, int timeoutMs);
+
+/** Returns a descriptor that becomes readable when jobs have finished, for waiting on along with sockets.  Reading it
+ * is left to {@link craggy_verifyPoolPoll}.
+ *
+ * @param pool
+ * @return Descriptor to poll for POLLIN
+ */
+int craggy_verifyPoolGetFd(const CraggyVerifyPool *pool);
+
+/** Stops the workers once they have finished the jobs queued, and releases the pool.  Finished jobs not collected
+ * are simply left to their owners.
+ *
+ * @param pool
+ */
+void craggy_destroyVerifyPool(CraggyVerifyPool *pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //CRAGGY_CRAGGYVERIFYPOOL_H
@@ -0,0 +1,213 @@
+/* Copyright 2020 Johan Lindquist
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "CraggyWarmStart.h"
+
+#include "CraggyOS.h"
+
+#define ERROR_OCCURRED(x) *result = x; goto error;
+
+#define CRAGGY_WARM_START_MAGIC "CRWS"
+
+/** Changed whenever the records do */
+#define CRAGGY_WARM_START_VERSION 1
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    // Size of a record, telling layouts of other machines apart
+    uint32_t recordLength;
+    uint32_t numRecords;
+} CraggyWarmStartHeader;
+
+typedef struct {
+    craggy_rough_time_public_key_t rootPublicKey;
+    uint8_t delegationHash[CRAGGY_ROUGH_TIME_HASH_LENGTH];
+    craggy_rough_time_public_key_t delegationPublicKey;
+    craggy_rough_time_t minTime;
+    // Zero if no delegation was saved
+    craggy_rough_time_t maxTime;
+    CraggyTransportState transport;
+} CraggyWarmStartRecord;
+
+struct CraggyWarmStart {
+    void *mapping;
+    size_t mappingLen;
+    const CraggyWarmStartRecord *records;
+    size_t numRecords;
+};
+
+bool craggy_warmStartLoad(const char *path, CraggyWarmStart **warmStart, CraggyResult *result) {
+
+    *result = CraggyResultGeneralError;
+
+    int fd = -1;
+
+    *warmStart = craggy_calloc(1, sizeof(CraggyWarmStart));
+    if (*warmStart == NULL) {
+        ERROR_OCCURRED(CraggyResultInternalError);
+    }
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        ERROR_OCCURRED(CraggyResultGeneralError);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        ERROR_OCCURRED(CraggyResultGeneralError);
+    }
+    if ((size_t) st.st_size < sizeof(CraggyWarmStartHeader)) {
+        ERROR_OCCURRED(CraggyResultParseError);
+    }
+
+    void *mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED) {
+        ERROR_OCCURRED(CraggyResultInternalError);
+    }
+    (*warmStart)->mapping = mapping;
+    (*warmStart)->mappingLen = st.st_size;
+
+    const CraggyWarmStartHeader *header = mapping;
+    if (craggy_memcmp(header->magic, CRAGGY_WARM_START_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != CRAGGY_WARM_START_VERSION || header->recordLength != sizeof(CraggyWarmStartRecord) ||
+        (*warmStart)->mappingLen != sizeof(CraggyWarmStartHeader) + (size_t) header->numRecords * sizeof(CraggyWarmStartRecord)) {
+        ERROR_OCCURRED(CraggyResultParseError);
+    }
+    (*warmStart)->records = (const CraggyWarmStartRecord *) (header + 1);
+    (*warmStart)->numRecords = header->numRecords;
+
+    *result = CraggyResultSuccess;
+    goto exit;
+
+error:
+    craggy_warmStartClose(*warmStart);
+    *warmStart = NULL;
+
+exit:
+    if (fd >= 0) {
+        close(fd);
+    }
+    return *result == CraggyResultSuccess;
+}
+
+const CraggyTransportState *craggy_warmStartRestore(const CraggyWarmStart *warmStart, const craggy_rough_time_public_key_t rootPublicKey, CraggyDelegationCache *cache, craggy_rough_time_t now) {
+
+    for (size_t i = 0; i < warmStart->numRecords; i++) {
+        const CraggyWarmStartRecord *record = &warmStart->records[i];
+        if (craggy_memcmp(record->rootPublicKey, rootPublicKey, CRAGGY_ROUGH_TIME_PUBLIC_KEY_LENGTH) != 0) {
+            continue;
+        }
+
+        if (cache != NULL && record->maxTime != 0 && record->minTime <= now && now <= record->maxTime) {
+            CraggyDelegation delegation;
+            craggy_memset(&delegation, 0, sizeof(delegation));
+            craggy_memcpy(delegation.rootPublicKey, record->rootPublicKey, CRAGGY_ROUGH_TIME_PUBLIC_KEY_LENGTH);
+            craggy_memcpy(delegation.delegationHash, record->delegationHash, CRAGGY_ROUGH_TIME_HASH_LENGTH);
+            craggy_memcpy(delegation.delegationPublicKey, record->delegationPublicKey, CRAGGY_ROUGH_TIME_PUBLIC_KEY_LENGTH);
+            delegation.minTime = record->minTime;
+            delegation.maxTime = record->maxTime;
+            craggy_storeDelegation(cache, &delegation);
+        }
+        return record->transport.retransmissionTimeout != 0 ? &record->transport : NULL;
+    }
+    return NULL;
+}
+
+bool craggy_warmStartSave(const char *path, const CraggyWarmStartServer *servers, size_t numServers, CraggyDelegationCache *cache, CraggyResult *result) {
+
+    *result = CraggyResultGeneralError;
+
+    int fd = -1;
+    char *tempPath = craggy_malloc(strlen(path) + sizeof(".tmp"));
+    if (tempPath == NULL) {
+        ERROR_OCCURRED(CraggyResultInternalError);
+    }
+    strcpy(tempPath, path);
+    strcat(tempPath, ".tmp");
+
+    fd = open(tempPath, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) {
+        ERROR_OCCURRED(CraggyResultGeneralError);
+    }
+
+    CraggyWarmStartHeader header;
+    craggy_memset(&header, 0, sizeof(header));
+    craggy_memcpy(header.magic, CRAGGY_WARM_START_MAGIC, sizeof(header.magic));
+    header.version = CRAGGY_WARM_START_VERSION;
+    header.recordLength = sizeof(CraggyWarmStartRecord);
+    header.numRecords = (uint32_t) numServers;
+    if (write(fd, &header, sizeof(header)) != sizeof(header)) {
+        ERROR_OCCURRED(CraggyResultGeneralError);
+    }
+
+    for (size_t i = 0; i < numServers; i++) {
+        CraggyWarmStartRecord record;
+        craggy_memset(&record, 0, sizeof(record));
+        craggy_memcpy(record.rootPublicKey, servers[i].rootPublicKey, CRAGGY_ROUGH_TIME_PUBLIC_KEY_LENGTH);
+
+        const CraggyDelegation *delegation = cache != NULL ? craggy_findDelegation(cache, servers[i].rootPublicKey) : NULL;
+        if (delegation != NULL) {
+            craggy_memcpy(record.delegationHash, delegation->delegationHash, CRAGGY_ROUGH_TIME_HASH_LENGTH);
+            craggy_memcpy(record.delegationPublicKey, delegation->delegationPublicKey, CRAGGY_ROUGH_TIME_PUBLIC_KEY_LENGTH);
+            record.minTime = delegation->minTime;
+            record.maxTime = delegation->maxTime;
+        }
+        if (servers[i].transport != NULL) {
+            craggy_transportGetState(servers[i].transport, &record.transport);
+        }
+
+        if (write(fd, &record, sizeof(record)) != sizeof(record)) {
+            ERROR_OCCURRED(CraggyResultGeneralError);
+        }
+    }
+
+    if (close(fd) != 0) {
+        fd = -1;
+        ERROR_OCCURRED(CraggyResultGeneralError);
+    }
+    fd = -1;
+    if (rename(tempPath, path) != 0) {
+        ERROR_OCCURRED(CraggyResultGeneralError);
+    }
+
+    *result = CraggyResultSuccess;
+    goto exit;
+
+error:
+    if (fd >= 0) {
+        close(fd);
+    }
+    if (tempPath != NULL) {
+        unlink(tempPath);
+    }
+
+exit:
+    craggy_free(tempPath);
+    return *result == CraggyResultSuccess;
+}
+
+void craggy_warmStartClose(CraggyWarmStart *warmStart) {
+    if (warmStart != NULL && warmStart->mapping != NULL) {
+        munmap(warmStart->mapping, warmStart->mappingLen);
+    }
+    craggy_free(warmStart);
+}
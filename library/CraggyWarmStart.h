@@ -0,0 +1,79 @@
+/* Copyright 2020 Johan Lindquist
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CRAGGY_CRAGGYWARMSTART_H
+#define CRAGGY_CRAGGYWARMSTART_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "CraggyDelegationCache.h"
+#include "CraggyTransport.h"
+#include "CraggyTypes.h"
+
+/** State kept across restarts in a file, so that a client starting again picks up where it left off: the delegations
+ * verified, the addresses servers' names resolved to and their round trip estimates.  The file is mapped rather than
+ * read and holds plain records in the byte order and layout of the machine writing it - it is meant for that machine
+ * only.  Delegations in it are taken as verified, so it has to be as well protected as the root keys configured. */
+typedef struct CraggyWarmStart CraggyWarmStart;
+
+/** A server whose state is saved by {@link craggy_warmStartSave}. */
+typedef struct {
+    /** The root public key of the server, keying its state */
+    const uint8_t *rootPublicKey;
+    /** Transport to the server, or NULL if it has none open */
+    const CraggyTransport *transport;
+} CraggyWarmStartServer;
+
+/** Maps a file saved using {@link craggy_warmStartSave}.
+ *
+ * @param path File to map
+ * @param warmStart State mapped
+ * @param result Result of the operation - CraggyResultParseError if the file was not saved by this version of the
+ * library, on this machine
+ * @return True if successful, otherwise false and {@link result} will indicate the error
+ */
+bool craggy_warmStartLoad(const char *path, CraggyWarmStart **warmStart, CraggyResult *result);
+
+/** Restores the state of a server: its delegation, if still valid, goes into the cache and its transport state is
+ * returned for {@link craggy_transportOpenFromState}.
+ *
+ * @param warmStart State loaded using {@link craggy_warmStartLoad}
+ * @param rootPublicKey The root public key of the server
+ * @param cache Delegation cache to restore the delegation to, or NULL
+ * @param now Current time, in microseconds from the epoch
+ * @return State of the server's transport, NULL if none was saved.  Valid until the state is closed.
+ */
+const CraggyTransportState *craggy_warmStartRestore(const CraggyWarmStart *warmStart, const craggy_rough_time_public_key_t rootPublicKey, CraggyDelegationCache *cache, craggy_rough_time_t now);
+
+/** Saves the state of servers, replacing the file atomically so that a mapping of the previous one stays intact.
+ *
+ * @param path File to save to
+ * @param servers Servers to save the state of
+ * @param numServers Number of servers
+ * @param cache Delegation cache holding the servers' delegations, or NULL
+ * @param result Result of the operation
+ * @return True if successful, otherwise false and {@link result} will indicate the error
+ */
+bool craggy_warmStartSave(const char *path, const CraggyWarmStartServer *servers, size_t numServers, CraggyDelegationCache *cache, CraggyResult *result);
+
+/**
+ *
+ * @param warmStart
+ */
+void craggy_warmStartClose(CraggyWarmStart *warmStart);
+
+#endif //CRAGGY_CRAGGYWARMSTART_H
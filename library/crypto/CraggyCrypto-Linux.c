@@ -13,23 +13,133 @@
  * limitations under the License.
  */
 
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stddef.h>
-#include <stdio.h>
-#include <assert.h>
+#include <unistd.h>
+
+#if defined(CRAGGY_HAVE_GETRANDOM)
+#include <sys/random.h>
+#endif
 
 #include "CraggyCrypto.h"
+#include "CraggyOS.h"
+
+/** Bytes of entropy each thread reads ahead, enough for 64 nonces.  Larger requests bypass the pool. */
+#define CRAGGY_ENTROPY_POOL_LENGTH 4096
+
+typedef struct {
+    uint8_t bytes[CRAGGY_ENTROPY_POOL_LENGTH];
+    // Unused bytes are at the end of the pool
+    size_t available;
+    // Fork generation the pool was filled in, see craggy_forkChild
+    uint_fast64_t generation;
+} CraggyEntropyPool;
+
+static _Thread_local CraggyEntropyPool entropyPool;
+
+static pthread_once_t entropyOnce = PTHREAD_ONCE_INIT;
+static atomic_int urandomFd = -1;
+static atomic_uint_fast64_t forkGeneration;
+
+// A child process starts out with a copy of its parent's pool - it must not hand out the same bytes
+static void craggy_forkChild(void)
+{
+    atomic_fetch_add(&forkGeneration, 1);
+}
+
+static void craggy_initEntropy(void)
+{
+    pthread_atfork(NULL, NULL, craggy_forkChild);
+#if !defined(CRAGGY_HAVE_GETRANDOM)
+    urandomFd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+#endif
+}
+
+/* Reads the bytes specified from the kernel, retrying short and interrupted reads. */
+static bool craggy_readEntropy(uint8_t *buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t r = -1;
+#if defined(CRAGGY_HAVE_GETRANDOM)
+        if (urandomFd < 0) {
+            r = getrandom(buf, len, 0 /* flags */);
+            if (r < 0 && errno == ENOSYS) {
+                // Kernel older than the C library - fall back to the device, kept open from here on
+                int fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+                if (fd < 0) {
+                    return false;
+                }
+                int expected = -1;
+                if (!atomic_compare_exchange_strong(&urandomFd, &expected, fd)) {
+                    close(fd);
+                }
+                continue;
+            }
+        }
+#endif
+        if (urandomFd >= 0) {
+            r = read(urandomFd, buf, len);
+        }
+        if (r < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        if (r == 0) {
+            return false;
+        }
+        buf += r;
+        len -= (size_t) r;
+    }
+    return true;
+}
 
 bool craggy_fillRandomBytes(uint8_t *randomBuf, size_t randomBufLen, CraggyResult *result)
 {
-    FILE *f = fopen("/dev/urandom", "rb");
-    if (f == NULL) {
-        *result = CraggyResultInternalError;
+    *result = CraggyResultInternalError;
+
+    if (pthread_once(&entropyOnce, craggy_initEntropy) != 0) {
         return false;
     }
-    size_t read = fread(randomBuf, 1, randomBufLen, f);
-    assert(read == randomBufLen);
-    fclose(f);
-    *result = CraggyResultSuccess;
 
+    if (randomBufLen >= CRAGGY_ENTROPY_POOL_LENGTH) {
+        if (!craggy_readEntropy(randomBuf, randomBufLen)) {
+            return false;
+        }
+        *result = CraggyResultSuccess;
+        return true;
+    }
+
+    CraggyEntropyPool *pool = &entropyPool;
+    const uint_fast64_t generation = atomic_load(&forkGeneration);
+    if (pool->generation != generation) {
+        pool->available = 0;
+        pool->generation = generation;
+    }
+
+    while (randomBufLen > 0) {
+        if (pool->available == 0) {
+            if (!craggy_readEntropy(pool->bytes, CRAGGY_ENTROPY_POOL_LENGTH)) {
+                return false;
+            }
+            pool->available = CRAGGY_ENTROPY_POOL_LENGTH;
+        }
+
+        const size_t len = randomBufLen < pool->available ? randomBufLen : pool->available;
+        uint8_t *bytes = pool->bytes + CRAGGY_ENTROPY_POOL_LENGTH - pool->available;
+        craggy_memcpy(randomBuf, bytes, len);
+        // Bytes handed out are not kept around
+        craggy_memset(bytes, 0, len);
+
+        pool->available -= len;
+        randomBuf += len;
+        randomBufLen -= len;
+    }
+
+    *result = CraggyResultSuccess;
     return true;
-}
\ No newline at end of file
+}
@@ -0,0 +1,229 @@
+/* Copyright 2020 Johan Lindquist
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* SHA512 over several messages at once, one message per lane of a vector register - the messages hashed in building
+ * a Merkle tree are short and all of the same length, so they pad identically and run through the same number of
+ * blocks.  The kernel is written once using GCC vector extensions and compiled for each instruction set; lanes the
+ * widest kernel available cannot fill fall back to the single buffer SHA512 of the crypto backend. */
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "CraggyCrypto.h"
+#include "CraggyOS.h"
+
+#define CRAGGY_SHA512_BLOCK_LENGTH 128
+
+static const uint64_t craggy_sha512K[80] = {
+    0x428a2f98d728ae22ULL, 0x7137449123ef65cdULL, 0xb5c0fbcfec4d3b2fULL, 0xe9b5dba58189dbbcULL,
+    0x3956c25bf348b538ULL, 0x59f111f1b605d019ULL, 0x923f82a4af194f9bULL, 0xab1c5ed5da6d8118ULL,
+    0xd807aa98a3030242ULL, 0x12835b0145706fbeULL, 0x243185be4ee4b28cULL, 0x550c7dc3d5ffb4e2ULL,
+    0x72be5d74f27b896fULL, 0x80deb1fe3b1696b1ULL, 0x9bdc06a725c71235ULL, 0xc19bf174cf692694ULL,
+    0xe49b69c19ef14ad2ULL, 0xefbe4786384f25e3ULL, 0x0fc19dc68b8cd5b5ULL, 0x240ca1cc77ac9c65ULL,
+    0x2de92c6f592b0275ULL, 0x4a7484aa6ea6e483ULL, 0x5cb0a9dcbd41fbd4ULL, 0x76f988da831153b5ULL,
+    0x983e5152ee66dfabULL, 0xa831c66d2db43210ULL, 0xb00327c898fb213fULL, 0xbf597fc7beef0ee4ULL,
+    0xc6e00bf33da88fc2ULL, 0xd5a79147930aa725ULL, 0x06ca6351e003826fULL, 0x142929670a0e6e70ULL,
+    0x27b70a8546d22ffcULL, 0x2e1b21385c26c926ULL, 0x4d2c6dfc5ac42aedULL, 0x53380d139d95b3dfULL,
+    0x650a73548baf63deULL, 0x766a0abb3c77b2a8ULL, 0x81c2c92e47edaee6ULL, 0x92722c851482353bULL,
+    0xa2bfe8a14cf10364ULL, 0xa81a664bbc423001ULL, 0xc24b8b70d0f89791ULL, 0xc76c51a30654be30ULL,
+    0xd192e819d6ef5218ULL, 0xd69906245565a910ULL, 0xf40e35855771202aULL, 0x106aa07032bbd1b8ULL,
+    0x19a4c116b8d2d0c8ULL, 0x1e376c085141ab53ULL, 0x2748774cdf8eeb99ULL, 0x34b0bcb5e19b48a8ULL,
+    0x391c0cb3c5c95a63ULL, 0x4ed8aa4ae3418acbULL, 0x5b9cca4f7763e373ULL, 0x682e6ff3d6b2b8a3ULL,
+    0x748f82ee5defb2fcULL, 0x78a5636f43172f60ULL, 0x84c87814a1f0ab72ULL, 0x8cc702081a6439ecULL,
+    0x90befffa23631e28ULL, 0xa4506cebde82bde9ULL, 0xbef9a3f7b2c67915ULL, 0xc67178f2e372532bULL,
+    0xca273eceea26619cULL, 0xd186b8c721c0c207ULL, 0xeada7dd6cde0eb1eULL, 0xf57d4f7fee6ed178ULL,
+    0x06f067aa72176fbaULL, 0x0a637dc5a2c898a6ULL, 0x113f9804bef90daeULL, 0x1b710b35131c471bULL,
+    0x28db77f523047d84ULL, 0x32caab7b40c72493ULL, 0x3c9ebe0a15c9bebcULL, 0x431d67c49c100d4cULL,
+    0x4cc5d4becb3e42b6ULL, 0x597f299cfc657e2aULL, 0x5fcb6fab3ad6faecULL, 0x6c44198c4a475817ULL,
+};
+
+static const uint64_t craggy_sha512H0[8] = {
+    0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL, 0x3c6ef372fe94f82bULL, 0xa54ff53a5f1d36f1ULL,
+    0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL, 0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL,
+};
+
+/** Length of the longest message batched, longer ones are hashed one at a time. */
+#define CRAGGY_SHA512_MAX_BATCH_MSG_LENGTH 1024
+
+#define CRAGGY_SHA512_MAX_BLOCKS ((1 + CRAGGY_SHA512_MAX_BATCH_MSG_LENGTH + 1 + 16 + CRAGGY_SHA512_BLOCK_LENGTH - 1) / CRAGGY_SHA512_BLOCK_LENGTH)
+
+/* The blocks of prefix || msg || padding, as shared by every message of a batch - only the bytes of the message itself
+ * differ from one lane to the next. */
+typedef struct {
+    size_t msgLen;
+    size_t numBlocks;
+    uint8_t blocks[CRAGGY_SHA512_MAX_BLOCKS][CRAGGY_SHA512_BLOCK_LENGTH];
+} CraggySHA512Padding;
+
+static void craggy_sha512InitPadding(uint8_t prefix, size_t msgLen, CraggySHA512Padding *padding) {
+    const size_t totalLen = 1 + msgLen;
+    const uint64_t bitLen = (uint64_t) totalLen * 8;
+
+    padding->msgLen = msgLen;
+    padding->numBlocks = (totalLen + 1 + 16 + CRAGGY_SHA512_BLOCK_LENGTH - 1) / CRAGGY_SHA512_BLOCK_LENGTH;
+
+    uint8_t *bytes = &padding->blocks[0][0];
+    const size_t paddedLen = padding->numBlocks * CRAGGY_SHA512_BLOCK_LENGTH;
+    craggy_memset(bytes, 0, paddedLen);
+    bytes[0] = prefix;
+    bytes[totalLen] = 0x80;
+    for (size_t i = 0; i < 8; i++) {
+        bytes[paddedLen - 1 - i] = (uint8_t) (bitLen >> (8 * i));
+    }
+}
+
+/* Writes the block specified of prefix || msg || padding. */
+static void craggy_sha512LoadBlock(const CraggySHA512Padding *padding, const uint8_t *msg, size_t block, uint8_t out[CRAGGY_SHA512_BLOCK_LENGTH]) {
+    // The message occupies bytes 1 to msgLen of the padded stream
+    const size_t start = block * CRAGGY_SHA512_BLOCK_LENGTH;
+    const size_t end = start + CRAGGY_SHA512_BLOCK_LENGTH;
+    const size_t msgStart = start < 1 ? 1 : start;
+    const size_t msgEnd = end < 1 + padding->msgLen ? end : 1 + padding->msgLen;
+
+    craggy_memcpy(out, padding->blocks[block], CRAGGY_SHA512_BLOCK_LENGTH);
+    if (msgStart < msgEnd) {
+        craggy_memcpy(out + msgStart - start, msg + msgStart - 1, msgEnd - msgStart);
+    }
+}
+
+static uint64_t craggy_loadBigEndian64(const uint8_t *in) {
+    uint64_t value;
+    craggy_memcpy(&value, in, sizeof(value));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    value = __builtin_bswap64(value);
+#endif
+    return value;
+}
+
+static void craggy_storeBigEndian64(uint8_t *out, uint64_t value) {
+    for (size_t i = 0; i < 8; i++) {
+        out[i] = (uint8_t) (value >> (56 - 8 * i));
+    }
+}
+
+#define CRAGGY_ROTR64(x, n) (((x) >> (n)) | ((x) << (64 - (n))))
+
+/* Defines a kernel hashing LANES messages at once, using vectors of LANES 64 bit words compiled for TARGET.  Message
+ * i starts at data + i * msgLen.  Vectors never cross a function boundary, so no ABI questions arise from the target
+ * of the caller not supporting them. */
+#define CRAGGY_DEFINE_SHA512_KERNEL(NAME, LANES, TARGET)                                                                 \
+typedef uint64_t NAME##_vector __attribute__((vector_size(8 * (LANES))));                                               \
+                                                                                                                        \
+TARGET static void NAME(const CraggySHA512Padding *padding, const uint8_t *data, uint8_t (*hashes)[CRAGGY_ROUGH_TIME_HASH_LENGTH]) { \
+    const size_t msgLen = padding->msgLen;                                                                              \
+    NAME##_vector state[8];                                                                                             \
+    for (size_t i = 0; i < 8; i++) {                                                                                    \
+        for (size_t lane = 0; lane < (LANES); lane++) {                                                                 \
+            state[i][lane] = craggy_sha512H0[i];                                                                        \
+        }                                                                                                               \
+    }                                                                                                                   \
+                                                                                                                        \
+    for (size_t block = 0; block < padding->numBlocks; block++) {                                                       \
+        uint8_t blocks[(LANES)][CRAGGY_SHA512_BLOCK_LENGTH];                                                            \
+        NAME##_vector w[16];                                                                                            \
+        for (size_t lane = 0; lane < (LANES); lane++) {                                                                 \
+            craggy_sha512LoadBlock(padding, data + lane * msgLen, block, blocks[lane]);                                 \
+        }                                                                                                               \
+        for (size_t t = 0; t < 16; t++) {                                                                               \
+            for (size_t lane = 0; lane < (LANES); lane++) {                                                             \
+                w[t][lane] = craggy_loadBigEndian64(blocks[lane] + 8 * t);                                              \
+            }                                                                                                           \
+        }                                                                                                               \
+                                                                                                                        \
+        NAME##_vector a = state[0], b = state[1], c = state[2], d = state[3];                                           \
+        NAME##_vector e = state[4], f = state[5], g = state[6], h = state[7];                                           \
+        for (size_t t = 0; t < 80; t++) {                                                                               \
+            if (t >= 16) {                                                                                              \
+                const NAME##_vector w2 = w[(t - 2) & 15], w15 = w[(t - 15) & 15];                                       \
+                const NAME##_vector s0 = CRAGGY_ROTR64(w15, 1) ^ CRAGGY_ROTR64(w15, 8) ^ (w15 >> 7);                    \
+                const NAME##_vector s1 = CRAGGY_ROTR64(w2, 19) ^ CRAGGY_ROTR64(w2, 61) ^ (w2 >> 6);                     \
+                w[t & 15] += s0 + s1 + w[(t - 7) & 15];                                                                 \
+            }                                                                                                           \
+            const NAME##_vector S1 = CRAGGY_ROTR64(e, 14) ^ CRAGGY_ROTR64(e, 18) ^ CRAGGY_ROTR64(e, 41);                \
+            const NAME##_vector ch = (e & f) ^ (~e & g);                                                                \
+            const NAME##_vector t1 = h + S1 + ch + craggy_sha512K[t] + w[t & 15];                                       \
+            const NAME##_vector S0 = CRAGGY_ROTR64(a, 28) ^ CRAGGY_ROTR64(a, 34) ^ CRAGGY_ROTR64(a, 39);                \
+            const NAME##_vector maj = (a & b) ^ (a & c) ^ (b & c);                                                      \
+            h = g;                                                                                                      \
+            g = f;                                                                                                      \
+            f = e;                                                                                                      \
+            e = d + t1;                                                                                                 \
+            d = c;                                                                                                      \
+            c = b;                                                                                                      \
+            b = a;                                                                                                      \
+            a = t1 + S0 + maj;                                                                                          \
+        }                                                                                                               \
+        state[0] += a; state[1] += b; state[2] += c; state[3] += d;                                                     \
+        state[4] += e; state[5] += f; state[6] += g; state[7] += h;                                                     \
+    }                                                                                                                   \
+                                                                                                                        \
+    for (size_t lane = 0; lane < (LANES); lane++) {                                                                     \
+        for (size_t i = 0; i < 8; i++) {                                                                                \
+            craggy_storeBigEndian64(hashes[lane] + 8 * i, state[i][lane]);                                              \
+        }                                                                                                               \
+    }                                                                                                                   \
+}
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define CRAGGY_SHA512_X86
+CRAGGY_DEFINE_SHA512_KERNEL(craggy_sha512x8, 8, __attribute__((target("avx512f"))))
+CRAGGY_DEFINE_SHA512_KERNEL(craggy_sha512x4, 4, __attribute__((target("avx2"))))
+#elif defined(__GNUC__) && defined(__aarch64__)
+#define CRAGGY_SHA512_NEON
+CRAGGY_DEFINE_SHA512_KERNEL(craggy_sha512x2, 2, )
+#endif
+
+static bool craggy_calculatePrefixedSHA512(uint8_t prefix, const uint8_t *msg, size_t msgLen, uint8_t hash[CRAGGY_ROUGH_TIME_HASH_LENGTH]) {
+    CraggySHA512Context context;
+    return craggy_initSHA512(&context) &&
+           craggy_updateSHA512(&context, &prefix, 1) &&
+           craggy_updateSHA512(&context, msg, msgLen) &&
+           craggy_finalSHA512(&context, hash);
+}
+
+bool craggy_calculateSHA512Batch(uint8_t prefix, const uint8_t *data, size_t msgLen, size_t numMsgs, uint8_t (*hashes)[CRAGGY_ROUGH_TIME_HASH_LENGTH]) {
+
+    size_t done = 0;
+
+#if defined(CRAGGY_SHA512_X86) || defined(CRAGGY_SHA512_NEON)
+    if (numMsgs > 1 && msgLen <= CRAGGY_SHA512_MAX_BATCH_MSG_LENGTH) {
+        CraggySHA512Padding padding;
+        craggy_sha512InitPadding(prefix, msgLen, &padding);
+#if defined(CRAGGY_SHA512_X86)
+        if (numMsgs >= 8 && __builtin_cpu_supports("avx512f")) {
+            for (; numMsgs - done >= 8; done += 8) {
+                craggy_sha512x8(&padding, data + done * msgLen, hashes + done);
+            }
+        }
+        if (numMsgs - done >= 4 && __builtin_cpu_supports("avx2")) {
+            for (; numMsgs - done >= 4; done += 4) {
+                craggy_sha512x4(&padding, data + done * msgLen, hashes + done);
+            }
+        }
+#else
+        for (; numMsgs - done >= 2; done += 2) {
+            craggy_sha512x2(&padding, data + done * msgLen, hashes + done);
+        }
+#endif
+    }
+#endif
+
+    for (; done < numMsgs; done++) {
+        if (!craggy_calculatePrefixedSHA512(prefix, data + done * msgLen, msgLen, hashes[done])) {
+            return false;
+        }
+    }
+    return true;
+}
@@ -13,16 +13,483 @@
  * limitations under the License.
  */
 
+#include <pthread.h>
+#include <stdlib.h>
+
 #include <ed25519.h>
 #include <sha512.h>
+#include <ge.h>
+#include <sc.h>
 
 #include "CraggyCrypto.h"
+#include "CraggyOS.h"
+
+/** Rows of the table of a prepared key, one per byte of a scalar */
+#define CRAGGY_KEY_TABLE_ROWS 32
+
+/** Multiples in each row - the magnitudes 1 to 8 of signed radix 16 digits */
+#define CRAGGY_KEY_TABLE_MULTIPLES 8
+
+/* A key prepared for verification: -A decompressed once, and its multiples j * 256^i * -A tabled as the base point's are
+ * for ge_scalarmult_base.  With the base point tabled the same way, once per process, a verification takes 128
+ * additions and 4 doublings where ge_double_scalarmult_vartime takes 256 doublings besides its additions, and
+ * decompresses the key and computes its multiples anew every time.  Each table takes 40KB. */
+struct CraggyPublicKey {
+    craggy_rough_time_public_key_t publicKey;
+    // Whether the key decodes to a point at all, nothing verifies with it otherwise
+    bool valid;
+    ge_cached multiples[CRAGGY_KEY_TABLE_ROWS][CRAGGY_KEY_TABLE_MULTIPLES];
+};
+
+/** Maximum number of signatures combined into one batch equation */
+#define CRAGGY_SIGNATURE_BATCH_SIZE 32
+
+/** Length of the random coefficients of the batch equation - 128 bits, as used by ed25519-donna */
+#define CRAGGY_BATCH_COEFFICIENT_LENGTH 16
+
+/** A point of the batch equation, with its scalar in signed sliding window form and its odd multiples. */
+typedef struct {
+    signed char slide[256];
+    ge_cached multiples[8]; /* P, 3P, 5P, 7P, 9P, 11P, 13P, 15P */
+} CraggyBatchPoint;
+
+/* Signed sliding window recoding, as used by ge_double_scalarmult_vartime. */
+static void craggy_slide(signed char *r, const unsigned char *a)
+{
+    for (int i = 0; i < 256; ++i) {
+        r[i] = 1 & (a[i >> 3] >> (i & 7));
+    }
+
+    for (int i = 0; i < 256; ++i) {
+        if (r[i]) {
+            for (int b = 1; b <= 6 && i + b < 256; ++b) {
+                if (r[i + b]) {
+                    if (r[i] + (r[i + b] << b) <= 15) {
+                        r[i] += r[i + b] << b;
+                        r[i + b] = 0;
+                    } else if (r[i] - (r[i + b] << b) >= -15) {
+                        r[i] -= r[i + b] << b;
+                        for (int k = i + b; k < 256; ++k) {
+                            if (!r[k]) {
+                                r[k] = 1;
+                                break;
+                            }
+                            r[k] = 0;
+                        }
+                    } else {
+                        break;
+                    }
+                }
+            }
+        }
+    }
+}
+
+static void craggy_prepareBatchPoint(CraggyBatchPoint *point, const ge_p3 *p, const unsigned char scalar[32])
+{
+    ge_p1p1 t;
+    ge_p3 p2;
+    ge_p3 u;
+
+    craggy_slide(point->slide, scalar);
+
+    ge_p3_to_cached(&point->multiples[0], p);
+    ge_p3_dbl(&t, p);
+    ge_p1p1_to_p3(&p2, &t);
+    for (int i = 1; i < 8; i++) {
+        ge_add(&t, &p2, &point->multiples[i - 1]);
+        ge_p1p1_to_p3(&u, &t);
+        ge_p3_to_cached(&point->multiples[i], &u);
+    }
+}
+
+/* Checks that sum(z_i * (s_i * B - R_i - h_i * A_i)) is the identity for random z_i, using one interleaved
+ * (Straus) multi-scalar multiplication for all A_i and R_i. */
+static bool craggy_verifyBatchEquation(const CraggySignatureBatchEntry *entries, const size_t numEntries, CraggyBatchPoint *points)
+{
+    static const unsigned char zero[32] = {0};
+    static const unsigned char identity[32] = {1};
+
+    uint8_t coefficients[CRAGGY_SIGNATURE_BATCH_SIZE * CRAGGY_BATCH_COEFFICIENT_LENGTH];
+    CraggyResult result;
+    if (!craggy_fillRandomBytes(coefficients, numEntries * CRAGGY_BATCH_COEFFICIENT_LENGTH, &result)) {
+        return false;
+    }
+
+    unsigned char baseScalar[32] = {0};
+
+    for (size_t i = 0; i < numEntries; i++) {
+        const CraggySignatureBatchEntry *entry = &entries[i];
+
+        if (entry->signature[63] & 224) {
+            return false;
+        }
+
+        // Both decoded negated, giving -A and -R
+        ge_p3 A;
+        ge_p3 R;
+        if (ge_frombytes_negate_vartime(&A, entry->publicKey) != 0 || ge_frombytes_negate_vartime(&R, entry->signature) != 0) {
+            return false;
+        }
+
+        unsigned char h[64];
+        sha512_context hashContext;
+        sha512_init(&hashContext);
+        sha512_update(&hashContext, entry->signature, 32);
+        sha512_update(&hashContext, entry->publicKey, CRAGGY_ROUGH_TIME_PUBLIC_KEY_LENGTH);
+        sha512_update(&hashContext, entry->msg, entry->msgLen);
+        sha512_final(&hashContext, h);
+        sc_reduce(h);
+
+        unsigned char z[32] = {0};
+        craggy_memcpy(z, coefficients + i * CRAGGY_BATCH_COEFFICIENT_LENGTH, CRAGGY_BATCH_COEFFICIENT_LENGTH);
+
+        unsigned char zh[32];
+        sc_muladd(zh, z, h, zero);
+        sc_muladd(baseScalar, z, entry->signature + 32, baseScalar);
+
+        craggy_prepareBatchPoint(&points[2 * i], &A, zh);
+        craggy_prepareBatchPoint(&points[2 * i + 1], &R, z);
+    }
+
+    const size_t numPoints = 2 * numEntries;
+
+    int i = 255;
+    for (; i > 0; --i) {
+        bool nonZero = false;
+        for (size_t j = 0; j < numPoints && !nonZero; j++) {
+            nonZero = points[j].slide[i] != 0;
+        }
+        if (nonZero) {
+            break;
+        }
+    }
+
+    ge_p2 r;
+    ge_p1p1 t;
+    ge_p3 u;
+
+    ge_p2_0(&r);
+    for (; i >= 0; --i) {
+        ge_p2_dbl(&t, &r);
+        for (size_t j = 0; j < numPoints; j++) {
+            const signed char digit = points[j].slide[i];
+            if (digit > 0) {
+                ge_p1p1_to_p3(&u, &t);
+                ge_add(&t, &u, &points[j].multiples[digit / 2]);
+            } else if (digit < 0) {
+                ge_p1p1_to_p3(&u, &t);
+                ge_sub(&t, &u, &points[j].multiples[(-digit) / 2]);
+            }
+        }
+        ge_p1p1_to_p2(&r, &t);
+    }
+
+    ge_p3 base;
+    ge_cached baseCached;
+    ge_scalarmult_base(&base, baseScalar);
+    ge_p3_to_cached(&baseCached, &base);
+    ge_p1p1_to_p3(&u, &t);
+    ge_add(&t, &u, &baseCached);
+    ge_p1p1_to_p2(&r, &t);
+
+    unsigned char check[32];
+    ge_tobytes(check, &r);
+    return craggy_memcmp(check, identity, sizeof(identity)) == 0;
+}
 
 bool craggy_verifySignature(const craggy_rough_time_public_key_t rootPublicKey, const uint8_t *signature, const uint8_t *msg, const size_t msgLen)
 {
     return ed25519_verify(signature,msg,msgLen,rootPublicKey) == 1;
 }
 
+/* ed25519_verify with the message hashed from its segments as they are. */
+bool craggy_verifySignatureSegments(const craggy_rough_time_public_key_t publicKey, const uint8_t *signature, const CraggyMessageSegment *segments, const size_t numSegments)
+{
+    unsigned char h[64];
+    unsigned char checker[32];
+    sha512_context hashContext;
+    ge_p3 A;
+    ge_p2 R;
+
+    if (signature[63] & 224) {
+        return false;
+    }
+
+    if (ge_frombytes_negate_vartime(&A, publicKey) != 0) {
+        return false;
+    }
+
+    sha512_init(&hashContext);
+    sha512_update(&hashContext, signature, 32);
+    sha512_update(&hashContext, publicKey, CRAGGY_ROUGH_TIME_PUBLIC_KEY_LENGTH);
+    for (size_t i = 0; i < numSegments; i++) {
+        sha512_update(&hashContext, segments[i].data, segments[i].len);
+    }
+    sha512_final(&hashContext, h);
+
+    sc_reduce(h);
+    ge_double_scalarmult_vartime(&R, h, &A, signature + 32);
+    ge_tobytes(checker, &R);
+
+    return craggy_memcmp(checker, signature, sizeof(checker)) == 0;
+}
+
+static void craggy_fillMultiples(ge_cached multiples[CRAGGY_KEY_TABLE_ROWS][CRAGGY_KEY_TABLE_MULTIPLES], const ge_p3 *point)
+{
+    ge_p1p1 t;
+    ge_p3 rowBase = *point;
+
+    for (int i = 0; i < CRAGGY_KEY_TABLE_ROWS; i++) {
+        ge_p3 multiple = rowBase;
+        ge_p3_to_cached(&multiples[i][0], &rowBase);
+        for (int j = 1; j < CRAGGY_KEY_TABLE_MULTIPLES; j++) {
+            ge_add(&t, &multiple, &multiples[i][0]);
+            ge_p1p1_to_p3(&multiple, &t);
+            ge_p3_to_cached(&multiples[i][j], &multiple);
+        }
+        // 256 times the base of the row is its eighth multiple doubled five times
+        for (int k = 0; k < 5; k++) {
+            ge_p3_dbl(&t, &multiple);
+            ge_p1p1_to_p3(&multiple, &t);
+        }
+        rowBase = multiple;
+    }
+}
+
+static void craggy_addKeyMultiple(ge_p3 *h, const ge_cached *row, const signed char digit)
+{
+    ge_p1p1 t;
+    if (digit > 0) {
+        ge_add(&t, h, &row[digit - 1]);
+        ge_p1p1_to_p3(h, &t);
+    } else if (digit < 0) {
+        ge_sub(&t, h, &row[-digit - 1]);
+        ge_p1p1_to_p3(h, &t);
+    }
+}
+
+/* Signed radix 16 digits of a scalar below 2^255, as in ge_scalarmult_base. */
+static void craggy_radix16(signed char e[64], const unsigned char *a)
+{
+    for (int i = 0; i < 32; i++) {
+        e[2 * i] = a[i] & 15;
+        e[2 * i + 1] = (a[i] >> 4) & 15;
+    }
+    signed char carry = 0;
+    for (int i = 0; i < 63; i++) {
+        e[i] += carry;
+        carry = (signed char) ((e[i] + 8) >> 4);
+        e[i] -= (signed char) (carry << 4);
+    }
+    e[63] += carry;
+}
+
+static ge_cached baseMultiples[CRAGGY_KEY_TABLE_ROWS][CRAGGY_KEY_TABLE_MULTIPLES];
+static pthread_once_t baseMultiplesOnce = PTHREAD_ONCE_INIT;
+
+static void craggy_fillBaseMultiples(void)
+{
+    static const unsigned char one[32] = {1};
+    ge_p3 B;
+    ge_scalarmult_base(&B, one);
+    craggy_fillMultiples(baseMultiples, &B);
+}
+
+/* Checks R == h * -A + s * B as ed25519_verify does, multiplying by the key and the base point from their tables. */
+static bool craggy_verifyWithTables(const CraggyPublicKey *key, const uint8_t *signature, const unsigned char h[32])
+{
+    pthread_once(&baseMultiplesOnce, craggy_fillBaseMultiples);
+
+    signed char eh[64];
+    signed char es[64];
+    craggy_radix16(eh, h);
+    craggy_radix16(es, signature + 32);
+
+    ge_p3 R;
+    ge_p1p1 t;
+    ge_p3_0(&R);
+    for (int i = 1; i < 64; i += 2) {
+        craggy_addKeyMultiple(&R, key->multiples[i / 2], eh[i]);
+        craggy_addKeyMultiple(&R, baseMultiples[i / 2], es[i]);
+    }
+    for (int k = 0; k < 4; k++) {
+        ge_p3_dbl(&t, &R);
+        ge_p1p1_to_p3(&R, &t);
+    }
+    for (int i = 0; i < 64; i += 2) {
+        craggy_addKeyMultiple(&R, key->multiples[i / 2], eh[i]);
+        craggy_addKeyMultiple(&R, baseMultiples[i / 2], es[i]);
+    }
+
+    unsigned char checker[32];
+    ge_p3_tobytes(checker, &R);
+    return craggy_memcmp(checker, signature, sizeof(checker)) == 0;
+}
+
+bool craggy_verifyPreparedSignatureSegments(const CraggyPublicKey *key, const uint8_t *signature, const CraggyMessageSegment *segments, const size_t numSegments)
+{
+    // As ed25519_verify, s of 2^253 and above is rejected - which also keeps its radix 16 digits in range
+    if (!key->valid || (signature[63] & 224)) {
+        return false;
+    }
+
+    unsigned char h[64];
+    sha512_context hashContext;
+    sha512_init(&hashContext);
+    sha512_update(&hashContext, signature, 32);
+    sha512_update(&hashContext, key->publicKey, CRAGGY_ROUGH_TIME_PUBLIC_KEY_LENGTH);
+    for (size_t i = 0; i < numSegments; i++) {
+        sha512_update(&hashContext, segments[i].data, segments[i].len);
+    }
+    sha512_final(&hashContext, h);
+    sc_reduce(h);
+
+    return craggy_verifyWithTables(key, signature, h);
+}
+
+bool craggy_publicKeyPrepare(const craggy_rough_time_public_key_t publicKey, CraggyPublicKey **key)
+{
+    *key = craggy_malloc(sizeof(CraggyPublicKey));
+    if (*key == NULL) {
+        return false;
+    }
+    craggy_memcpy((*key)->publicKey, publicKey, CRAGGY_ROUGH_TIME_PUBLIC_KEY_LENGTH);
+
+    // Negated, as verification wants it
+    ge_p3 point;
+    (*key)->valid = ge_frombytes_negate_vartime(&point, publicKey) == 0;
+    if ((*key)->valid) {
+        craggy_fillMultiples((*key)->multiples, &point);
+    }
+    return true;
+}
+
+bool craggy_verifyPreparedSignature(const CraggyPublicKey *key, const uint8_t *signature, const uint8_t *msg, const size_t msgLen)
+{
+    CraggyMessageSegment segment = { msg, msgLen };
+    return craggy_verifyPreparedSignatureSegments(key, signature, &segment, 1);
+}
+
+void craggy_publicKeyRelease(CraggyPublicKey *key)
+{
+    craggy_free(key);
+}
+
+void craggy_releaseThreadCryptoState(void)
+{
+    // Verification keeps no state between calls
+}
+
+struct CraggyPrivateKey {
+    craggy_rough_time_public_key_t publicKey;
+    /* Expanded form of the seed, as produced by ed25519_create_keypair */
+    unsigned char privateKey[64];
+};
+
+bool craggy_privateKeyCreate(const uint8_t seed[CRAGGY_ROUGH_TIME_PRIVATE_KEY_SEED_LENGTH], CraggyPrivateKey **key, craggy_rough_time_public_key_t publicKey)
+{
+    *key = craggy_malloc(sizeof(CraggyPrivateKey));
+    if (*key == NULL) {
+        return false;
+    }
+    ed25519_create_keypair((*key)->publicKey, (*key)->privateKey, seed);
+    craggy_memcpy(publicKey, (*key)->publicKey, CRAGGY_ROUGH_TIME_PUBLIC_KEY_LENGTH);
+    return true;
+}
+
+/* ed25519_sign with the message hashed from its segments as they are. */
+bool craggy_signSegments(const CraggyPrivateKey *key, const CraggyMessageSegment *segments, const size_t numSegments, uint8_t signature[CRAGGY_ROUGH_TIME_SIGNATURE_LENGTH])
+{
+    sha512_context hashContext;
+    unsigned char hram[64];
+    unsigned char r[64];
+    ge_p3 R;
+
+    sha512_init(&hashContext);
+    sha512_update(&hashContext, key->privateKey + 32, 32);
+    for (size_t i = 0; i < numSegments; i++) {
+        sha512_update(&hashContext, segments[i].data, segments[i].len);
+    }
+    sha512_final(&hashContext, r);
+
+    sc_reduce(r);
+    ge_scalarmult_base(&R, r);
+    ge_p3_tobytes(signature, &R);
+
+    sha512_init(&hashContext);
+    sha512_update(&hashContext, signature, 32);
+    sha512_update(&hashContext, key->publicKey, CRAGGY_ROUGH_TIME_PUBLIC_KEY_LENGTH);
+    for (size_t i = 0; i < numSegments; i++) {
+        sha512_update(&hashContext, segments[i].data, segments[i].len);
+    }
+    sha512_final(&hashContext, hram);
+
+    sc_reduce(hram);
+    sc_muladd(signature + 32, hram, key->privateKey, r);
+    return true;
+}
+
+void craggy_privateKeyRelease(CraggyPrivateKey *key)
+{
+    if (key != NULL) {
+        craggy_memset(key->privateKey, 0, sizeof(key->privateKey));
+    }
+    craggy_free(key);
+}
+
+bool craggy_verifySignatureBatch(CraggySignatureBatchEntry *entries, const size_t numEntries)
+{
+    const size_t maxPoints = 2 * (numEntries < CRAGGY_SIGNATURE_BATCH_SIZE ? numEntries : CRAGGY_SIGNATURE_BATCH_SIZE);
+    CraggyBatchPoint *points = NULL;
+    bool allValid = true;
+
+    for (size_t offset = 0; offset < numEntries; offset += CRAGGY_SIGNATURE_BATCH_SIZE) {
+        const size_t remaining = numEntries - offset;
+        const size_t batchSize = remaining < CRAGGY_SIGNATURE_BATCH_SIZE ? remaining : CRAGGY_SIGNATURE_BATCH_SIZE;
+
+        bool batchValid = false;
+        if (batchSize > 1) {
+            if (points == NULL) {
+                points = craggy_malloc(maxPoints * sizeof(CraggyBatchPoint));
+            }
+            batchValid = points != NULL && craggy_verifyBatchEquation(entries + offset, batchSize, points);
+        }
+
+        // Only when the batch fails do we need to find out which signatures are to blame
+        for (size_t i = offset; i < offset + batchSize; i++) {
+            if (batchValid) {
+                entries[i].valid = true;
+            } else if (entries[i].preparedKey != NULL) {
+                entries[i].valid = craggy_verifyPreparedSignature(entries[i].preparedKey, entries[i].signature, entries[i].msg, entries[i].msgLen);
+            } else {
+                entries[i].valid = craggy_verifySignature(entries[i].publicKey, entries[i].signature, entries[i].msg, entries[i].msgLen);
+            }
+            allValid = allValid && entries[i].valid;
+        }
+    }
+
+    craggy_free(points);
+    return allValid;
+}
+
+_Static_assert(sizeof(sha512_context) <= sizeof(CraggySHA512Context), "CraggySHA512Context too small for sha512_context");
+
+bool craggy_initSHA512(CraggySHA512Context *context)
+{
+    return sha512_init((sha512_context *) context) == 0;
+}
+
+bool craggy_updateSHA512(CraggySHA512Context *context, const uint8_t *msg, const size_t msgLen)
+{
+    return sha512_update((sha512_context *) context, msg, msgLen) == 0;
+}
+
+bool craggy_finalSHA512(CraggySHA512Context *context, uint8_t hash[CRAGGY_ROUGH_TIME_HASH_LENGTH])
+{
+    return sha512_final((sha512_context *) context, hash) == 0;
+}
+
 bool craggy_calculateSHA512(const uint8_t *msg, const size_t msgLen, uint8_t hash[CRAGGY_ROUGH_TIME_HASH_LENGTH])
 {
     sha512_context hashContext;
@@ -16,25 +16,280 @@
 #include <openssl/evp.h>
 #include <openssl/err.h>
 
+#include <stdatomic.h>
+#include <stdlib.h>
+
 #include "CraggyCrypto.h"
+#include "CraggyOS.h"
+
+/** Messages up to this length are gathered from their segments on the stack, longer ones on the heap */
+#define CRAGGY_GATHER_BUFFER_LENGTH 512
+
+/** Number of digest contexts each thread keeps initialised for its most recently used prepared keys */
+#define CRAGGY_VERIFY_CONTEXTS_PER_THREAD 4
+
+struct CraggyPublicKey {
+    EVP_PKEY *key;
+    // Unique for the lifetime of the process, so a thread's context is never mistaken for that of a released key
+    uint64_t serial;
+};
+
+typedef struct {
+    EVP_MD_CTX *context;
+    uint64_t keySerial;
+    uint64_t lastUsed;
+} CraggyVerifyContext;
+
+static atomic_uint_fast64_t keySerialCounter;
+
+// An Ed25519 EVP_MD_CTX can verify any number of signatures once initialised with a key, but the initialisation
+// allocates - so each thread holds on to the contexts of the keys it used last.
+static _Thread_local CraggyVerifyContext verifyContexts[CRAGGY_VERIFY_CONTEXTS_PER_THREAD];
+static _Thread_local uint64_t verifyContextUseCounter;
+
+static EVP_MD_CTX *craggy_getVerifyContext(const CraggyPublicKey *key)
+{
+    CraggyVerifyContext *slot = &verifyContexts[0];
+    for (size_t i = 0; i < CRAGGY_VERIFY_CONTEXTS_PER_THREAD; i++) {
+        if (verifyContexts[i].context != NULL && verifyContexts[i].keySerial == key->serial) {
+            verifyContexts[i].lastUsed = ++verifyContextUseCounter;
+            return verifyContexts[i].context;
+        }
+        if (verifyContexts[i].lastUsed < slot->lastUsed) {
+            slot = &verifyContexts[i];
+        }
+    }
+
+    if (slot->context == NULL) {
+        slot->context = EVP_MD_CTX_new();
+        if (slot->context == NULL) {
+            return NULL;
+        }
+    } else {
+        // Initialising a context used with another key is not enough, its old key would still be used
+        EVP_MD_CTX_reset(slot->context);
+    }
+
+    if (1 != EVP_DigestVerifyInit(slot->context, NULL, NULL, NULL, key->key)) {
+        slot->keySerial = 0;
+        return NULL;
+    }
+    slot->keySerial = key->serial;
+    slot->lastUsed = ++verifyContextUseCounter;
+    return slot->context;
+}
+
+void craggy_releaseThreadCryptoState(void)
+{
+    for (size_t i = 0; i < CRAGGY_VERIFY_CONTEXTS_PER_THREAD; i++) {
+        EVP_MD_CTX_free(verifyContexts[i].context);
+        verifyContexts[i].context = NULL;
+        verifyContexts[i].keySerial = 0;
+        verifyContexts[i].lastUsed = 0;
+    }
+}
+
+bool craggy_publicKeyPrepare(const craggy_rough_time_public_key_t publicKey, CraggyPublicKey **key)
+{
+    *key = craggy_calloc(1, sizeof(CraggyPublicKey));
+    if (*key == NULL) {
+        return false;
+    }
+
+    (*key)->key = EVP_PKEY_new_raw_public_key(EVP_PKEY_ED25519, NULL, publicKey, CRAGGY_ROUGH_TIME_PUBLIC_KEY_LENGTH);
+    if ((*key)->key == NULL) {
+        craggy_free(*key);
+        *key = NULL;
+        return false;
+    }
+    (*key)->serial = atomic_fetch_add(&keySerialCounter, 1) + 1;
+
+    return true;
+}
+
+bool craggy_verifyPreparedSignature(const CraggyPublicKey *key, const uint8_t *signature, const uint8_t *msg, const size_t msgLen)
+{
+    EVP_MD_CTX *md_ctx = craggy_getVerifyContext(key);
+    if (md_ctx == NULL) {
+        return false;
+    }
+    return 1 == EVP_DigestVerify(md_ctx, signature, CRAGGY_ROUGH_TIME_SIGNATURE_LENGTH, msg, msgLen);
+}
+
+void craggy_publicKeyRelease(CraggyPublicKey *key)
+{
+    if (key != NULL) {
+        // Contexts still holding the key keep their own reference to it
+        EVP_PKEY_free(key->key);
+    }
+    craggy_free(key);
+}
 
 bool craggy_verifySignature(const craggy_rough_time_public_key_t rootPublicKey, const uint8_t *signature, const uint8_t *msg, const size_t msgLen)
 {
     EVP_PKEY *key = EVP_PKEY_new_raw_public_key(EVP_PKEY_ED25519, NULL,rootPublicKey,CRAGGY_ROUGH_TIME_PUBLIC_KEY_LENGTH);
+    if (key == NULL) {
+        return false;
+    }
 
-    EVP_MD_CTX *md_ctx = EVP_MD_CTX_create();
-    EVP_MD_CTX_init(md_ctx);
+    EVP_MD_CTX *md_ctx = EVP_MD_CTX_new();
 
     int result = 0;
-    if (1 ==  EVP_DigestVerifyInit(md_ctx, NULL, NULL, NULL, key))
+    if (md_ctx != NULL && 1 == EVP_DigestVerifyInit(md_ctx, NULL, NULL, NULL, key))
     {
         result = EVP_DigestVerify(md_ctx, signature, CRAGGY_ROUGH_TIME_SIGNATURE_LENGTH, msg, msgLen);
     }
     EVP_MD_CTX_free(md_ctx);
+    EVP_PKEY_free(key);
 
     return result == 1;
 }
 
+/* Ed25519 in OpenSSL is one-shot only - EVP_DigestVerifyUpdate is not supported - so the segments have to be
+ * brought together.  A single segment is used as is. */
+static const uint8_t *craggy_gatherSegments(const CraggyMessageSegment *segments, const size_t numSegments, uint8_t *buffer, uint8_t **heapBuffer, size_t *msgLen)
+{
+    *heapBuffer = NULL;
+
+    if (numSegments == 1) {
+        *msgLen = segments[0].len;
+        return segments[0].data;
+    }
+
+    size_t len = 0;
+    for (size_t i = 0; i < numSegments; i++) {
+        len += segments[i].len;
+    }
+
+    uint8_t *msg = buffer;
+    if (len > CRAGGY_GATHER_BUFFER_LENGTH) {
+        msg = *heapBuffer = craggy_malloc(len);
+        if (msg == NULL) {
+            return NULL;
+        }
+    }
+
+    size_t offset = 0;
+    for (size_t i = 0; i < numSegments; i++) {
+        craggy_memcpy(msg + offset, segments[i].data, segments[i].len);
+        offset += segments[i].len;
+    }
+    *msgLen = len;
+    return msg;
+}
+
+bool craggy_verifySignatureSegments(const craggy_rough_time_public_key_t publicKey, const uint8_t *signature, const CraggyMessageSegment *segments, const size_t numSegments)
+{
+    uint8_t buffer[CRAGGY_GATHER_BUFFER_LENGTH];
+    uint8_t *heapBuffer;
+    size_t msgLen;
+
+    const uint8_t *msg = craggy_gatherSegments(segments, numSegments, buffer, &heapBuffer, &msgLen);
+    if (msg == NULL) {
+        return false;
+    }
+    bool valid = craggy_verifySignature(publicKey, signature, msg, msgLen);
+    craggy_free(heapBuffer);
+    return valid;
+}
+
+bool craggy_verifyPreparedSignatureSegments(const CraggyPublicKey *key, const uint8_t *signature, const CraggyMessageSegment *segments, const size_t numSegments)
+{
+    uint8_t buffer[CRAGGY_GATHER_BUFFER_LENGTH];
+    uint8_t *heapBuffer;
+    size_t msgLen;
+
+    const uint8_t *msg = craggy_gatherSegments(segments, numSegments, buffer, &heapBuffer, &msgLen);
+    if (msg == NULL) {
+        return false;
+    }
+    bool valid = craggy_verifyPreparedSignature(key, signature, msg, msgLen);
+    craggy_free(heapBuffer);
+    return valid;
+}
+
+struct CraggyPrivateKey {
+    EVP_PKEY *key;
+};
+
+bool craggy_privateKeyCreate(const uint8_t seed[CRAGGY_ROUGH_TIME_PRIVATE_KEY_SEED_LENGTH], CraggyPrivateKey **key, craggy_rough_time_public_key_t publicKey)
+{
+    *key = craggy_calloc(1, sizeof(CraggyPrivateKey));
+    if (*key == NULL) {
+        return false;
+    }
+
+    size_t publicKeyLen = CRAGGY_ROUGH_TIME_PUBLIC_KEY_LENGTH;
+    (*key)->key = EVP_PKEY_new_raw_private_key(EVP_PKEY_ED25519, NULL, seed, CRAGGY_ROUGH_TIME_PRIVATE_KEY_SEED_LENGTH);
+    if ((*key)->key == NULL || 1 != EVP_PKEY_get_raw_public_key((*key)->key, publicKey, &publicKeyLen)) {
+        craggy_privateKeyRelease(*key);
+        *key = NULL;
+        return false;
+    }
+    return true;
+}
+
+bool craggy_signSegments(const CraggyPrivateKey *key, const CraggyMessageSegment *segments, const size_t numSegments, uint8_t signature[CRAGGY_ROUGH_TIME_SIGNATURE_LENGTH])
+{
+    uint8_t buffer[CRAGGY_GATHER_BUFFER_LENGTH];
+    uint8_t *heapBuffer;
+    size_t msgLen;
+
+    const uint8_t *msg = craggy_gatherSegments(segments, numSegments, buffer, &heapBuffer, &msgLen);
+    if (msg == NULL) {
+        return false;
+    }
+
+    size_t signatureLen = CRAGGY_ROUGH_TIME_SIGNATURE_LENGTH;
+    EVP_MD_CTX *md_ctx = EVP_MD_CTX_new();
+    bool signed_ = md_ctx != NULL &&
+                   1 == EVP_DigestSignInit(md_ctx, NULL, NULL, NULL, key->key) &&
+                   1 == EVP_DigestSign(md_ctx, signature, &signatureLen, msg, msgLen);
+    EVP_MD_CTX_free(md_ctx);
+    craggy_free(heapBuffer);
+    return signed_;
+}
+
+void craggy_privateKeyRelease(CraggyPrivateKey *key)
+{
+    if (key != NULL) {
+        EVP_PKEY_free(key->key);
+    }
+    craggy_free(key);
+}
+
+bool craggy_verifySignatureBatch(CraggySignatureBatchEntry *entries, const size_t numEntries)
+{
+    // OpenSSL offers no batch verification of Ed25519 signatures
+    bool allValid = true;
+    for (size_t i = 0; i < numEntries; i++) {
+        if (entries[i].preparedKey != NULL) {
+            entries[i].valid = craggy_verifyPreparedSignature(entries[i].preparedKey, entries[i].signature, entries[i].msg, entries[i].msgLen);
+        } else {
+            entries[i].valid = craggy_verifySignature(entries[i].publicKey, entries[i].signature, entries[i].msg, entries[i].msgLen);
+        }
+        allValid = allValid && entries[i].valid;
+    }
+    return allValid;
+}
+
+_Static_assert(sizeof(SHA512_CTX) <= sizeof(CraggySHA512Context), "CraggySHA512Context too small for SHA512_CTX");
+
+bool craggy_initSHA512(CraggySHA512Context *context)
+{
+    return SHA512_Init((SHA512_CTX *) context) == 1;
+}
+
+bool craggy_updateSHA512(CraggySHA512Context *context, const uint8_t *msg, const size_t msgLen)
+{
+    return SHA512_Update((SHA512_CTX *) context, msg, msgLen) == 1;
+}
+
+bool craggy_finalSHA512(CraggySHA512Context *context, uint8_t hash[CRAGGY_ROUGH_TIME_HASH_LENGTH])
+{
+    return SHA512_Final(hash, (SHA512_CTX *) context) == 1;
+}
+
 bool craggy_calculateSHA512(const uint8_t *msg, const size_t msgLen, uint8_t hash[CRAGGY_ROUGH_TIME_HASH_LENGTH])
 {
     SHA512_CTX context;
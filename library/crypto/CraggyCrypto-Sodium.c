@@ -0,0 +1,230 @@
+/* Copyright 2020 Johan Lindquist
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+
+#include <sodium.h>
+
+#include "CraggyCrypto.h"
+#include "CraggyOS.h"
+
+/** Messages up to this length are gathered from their segments on the stack, longer ones on the heap */
+#define CRAGGY_GATHER_BUFFER_LENGTH 512
+
+/* libsodium verifies with its own field arithmetic, 51 bit limbs wherever the compiler has 128 bit integers - AArch64
+ * included - and a precomputed table of the base point, all in portable C.  It decompresses the key on every
+ * verification and offers no way to keep it, so a prepared key is the raw key. */
+struct CraggyPublicKey {
+    craggy_rough_time_public_key_t publicKey;
+};
+
+static pthread_once_t sodiumOnce = PTHREAD_ONCE_INIT;
+static bool sodiumReady;
+
+static void craggy_initSodium(void)
+{
+    sodiumReady = sodium_init() >= 0;
+}
+
+/* libsodium has to be initialised before any other of its functions is used. */
+static bool craggy_ensureSodium(void)
+{
+    pthread_once(&sodiumOnce, craggy_initSodium);
+    return sodiumReady;
+}
+
+void craggy_releaseThreadCryptoState(void)
+{
+    // Verification keeps no state between calls
+}
+
+bool craggy_publicKeyPrepare(const craggy_rough_time_public_key_t publicKey, CraggyPublicKey **key)
+{
+    if (!craggy_ensureSodium()) {
+        return false;
+    }
+
+    *key = craggy_malloc(sizeof(CraggyPublicKey));
+    if (*key == NULL) {
+        return false;
+    }
+    craggy_memcpy((*key)->publicKey, publicKey, CRAGGY_ROUGH_TIME_PUBLIC_KEY_LENGTH);
+    return true;
+}
+
+bool craggy_verifyPreparedSignature(const CraggyPublicKey *key, const uint8_t *signature, const uint8_t *msg, const size_t msgLen)
+{
+    return crypto_sign_verify_detached(signature, msg, msgLen, key->publicKey) == 0;
+}
+
+void craggy_publicKeyRelease(CraggyPublicKey *key)
+{
+    craggy_free(key);
+}
+
+bool craggy_verifySignature(const craggy_rough_time_public_key_t rootPublicKey, const uint8_t *signature, const uint8_t *msg, const size_t msgLen)
+{
+    if (!craggy_ensureSodium()) {
+        return false;
+    }
+    return crypto_sign_verify_detached(signature, msg, msgLen, rootPublicKey) == 0;
+}
+
+/* libsodium has no incremental Ed25519 - crypto_sign_ed25519ph is a different signature scheme - so the segments
+ * have to be brought together.  A single segment is used as is. */
+static const uint8_t *craggy_gatherSegments(const CraggyMessageSegment *segments, const size_t numSegments, uint8_t *buffer, uint8_t **heapBuffer, size_t *msgLen)
+{
+    *heapBuffer = NULL;
+
+    if (numSegments == 1) {
+        *msgLen = segments[0].len;
+        return segments[0].data;
+    }
+
+    size_t len = 0;
+    for (size_t i = 0; i < numSegments; i++) {
+        len += segments[i].len;
+    }
+
+    uint8_t *msg = buffer;
+    if (len > CRAGGY_GATHER_BUFFER_LENGTH) {
+        msg = *heapBuffer = craggy_malloc(len);
+        if (msg == NULL) {
+            return NULL;
+        }
+    }
+
+    size_t offset = 0;
+    for (size_t i = 0; i < numSegments; i++) {
+        craggy_memcpy(msg + offset, segments[i].data, segments[i].len);
+        offset += segments[i].len;
+    }
+    *msgLen = len;
+    return msg;
+}
+
+bool craggy_verifySignatureSegments(const craggy_rough_time_public_key_t publicKey, const uint8_t *signature, const CraggyMessageSegment *segments, const size_t numSegments)
+{
+    uint8_t buffer[CRAGGY_GATHER_BUFFER_LENGTH];
+    uint8_t *heapBuffer;
+    size_t msgLen;
+
+    const uint8_t *msg = craggy_gatherSegments(segments, numSegments, buffer, &heapBuffer, &msgLen);
+    if (msg == NULL) {
+        return false;
+    }
+    bool valid = craggy_verifySignature(publicKey, signature, msg, msgLen);
+    craggy_free(heapBuffer);
+    return valid;
+}
+
+bool craggy_verifyPreparedSignatureSegments(const CraggyPublicKey *key, const uint8_t *signature, const CraggyMessageSegment *segments, const size_t numSegments)
+{
+    uint8_t buffer[CRAGGY_GATHER_BUFFER_LENGTH];
+    uint8_t *heapBuffer;
+    size_t msgLen;
+
+    const uint8_t *msg = craggy_gatherSegments(segments, numSegments, buffer, &heapBuffer, &msgLen);
+    if (msg == NULL) {
+        return false;
+    }
+    bool valid = craggy_verifyPreparedSignature(key, signature, msg, msgLen);
+    craggy_free(heapBuffer);
+    return valid;
+}
+
+struct CraggyPrivateKey {
+    /* Seed followed by the public key, as produced by crypto_sign_seed_keypair */
+    unsigned char secretKey[crypto_sign_SECRETKEYBYTES];
+};
+
+bool craggy_privateKeyCreate(const uint8_t seed[CRAGGY_ROUGH_TIME_PRIVATE_KEY_SEED_LENGTH], CraggyPrivateKey **key, craggy_rough_time_public_key_t publicKey)
+{
+    if (!craggy_ensureSodium()) {
+        return false;
+    }
+
+    *key = craggy_malloc(sizeof(CraggyPrivateKey));
+    if (*key == NULL) {
+        return false;
+    }
+    if (crypto_sign_seed_keypair(publicKey, (*key)->secretKey, seed) != 0) {
+        craggy_privateKeyRelease(*key);
+        *key = NULL;
+        return false;
+    }
+    return true;
+}
+
+bool craggy_signSegments(const CraggyPrivateKey *key, const CraggyMessageSegment *segments, const size_t numSegments, uint8_t signature[CRAGGY_ROUGH_TIME_SIGNATURE_LENGTH])
+{
+    uint8_t buffer[CRAGGY_GATHER_BUFFER_LENGTH];
+    uint8_t *heapBuffer;
+    size_t msgLen;
+
+    const uint8_t *msg = craggy_gatherSegments(segments, numSegments, buffer, &heapBuffer, &msgLen);
+    if (msg == NULL) {
+        return false;
+    }
+    bool signed_ = crypto_sign_detached(signature, NULL, msg, msgLen, key->secretKey) == 0;
+    craggy_free(heapBuffer);
+    return signed_;
+}
+
+void craggy_privateKeyRelease(CraggyPrivateKey *key)
+{
+    if (key != NULL) {
+        sodium_memzero(key->secretKey, sizeof(key->secretKey));
+    }
+    craggy_free(key);
+}
+
+bool craggy_verifySignatureBatch(CraggySignatureBatchEntry *entries, const size_t numEntries)
+{
+    // libsodium offers no batch verification of Ed25519 signatures
+    bool allValid = true;
+    for (size_t i = 0; i < numEntries; i++) {
+        if (entries[i].preparedKey != NULL) {
+            entries[i].valid = craggy_verifyPreparedSignature(entries[i].preparedKey, entries[i].signature, entries[i].msg, entries[i].msgLen);
+        } else {
+            entries[i].valid = craggy_verifySignature(entries[i].publicKey, entries[i].signature, entries[i].msg, entries[i].msgLen);
+        }
+        allValid = allValid && entries[i].valid;
+    }
+    return allValid;
+}
+
+_Static_assert(sizeof(crypto_hash_sha512_state) <= sizeof(CraggySHA512Context), "CraggySHA512Context too small for crypto_hash_sha512_state");
+
+bool craggy_initSHA512(CraggySHA512Context *context)
+{
+    return crypto_hash_sha512_init((crypto_hash_sha512_state *) context) == 0;
+}
+
+bool craggy_updateSHA512(CraggySHA512Context *context, const uint8_t *msg, const size_t msgLen)
+{
+    return crypto_hash_sha512_update((crypto_hash_sha512_state *) context, msg, msgLen) == 0;
+}
+
+bool craggy_finalSHA512(CraggySHA512Context *context, uint8_t hash[CRAGGY_ROUGH_TIME_HASH_LENGTH])
+{
+    return crypto_hash_sha512_final((crypto_hash_sha512_state *) context, hash) == 0;
+}
+
+bool craggy_calculateSHA512(const uint8_t *msg, const size_t msgLen, uint8_t hash[CRAGGY_ROUGH_TIME_HASH_LENGTH])
+{
+    return crypto_hash_sha512(hash, msg, msgLen) == 0;
+}
@@ -22,8 +22,14 @@
 
 #include "serial_api/gpsd.h"
 #include "serial_api/gps.h"
+#include "serial_api/serial-driver.h"
 
 #include "gps-core.h"
+#include "capture.h"
+#include "rt_thread.h"
+#include "frame_queue.h"
+#include "pps.h"
+#include "time_tag.h"
 
 #define PRINT_MSG(f_, ...) printf((f_ "\n"), ##__VA_ARGS__)
 
@@ -53,17 +59,89 @@ struct fixsource_t
     char *device;
 };
 
-/* All the GPS simulators variables. */
+/* The parts of the receiver state shared with other threads, grouped into sections that a parse
+ * updates independently: only the sections the mask returned by ubx_parse names are published. */
 typedef struct
 {
-
+    gps_mask_t set;                 // Sections published so far
+
+    // GPS_SNAPSHOT_FIX, anything about position, velocity or time
+    struct gps_fix_t fix;
+    int leap_seconds;
+    // DOP_SET
+    struct dop_t dop;
+    // ONLINE_SET, raised by TIM-TP
+    timespec_t curr_time;
+    timespec_t tp_time;
+    // SATELLITE_SET
+    timespec_t skyview_time;
+    int satellites_used;
+    int satellites_visible;
+    struct satellite_t skyview[MAXCHANNELS];
+    // RAW_SET or MEASX_SET
+    struct rawdata_t raw;
+    // SUBFRAME_SET
+    struct subframe_t subframe;
+} gps_snapshot_t;
+
+#define GPS_SNAPSHOT_FIX (TIME_SET | TIMERR_SET | LATLON_SET | ALTITUDE_SET | SPEED_SET | TRACK_SET | CLIMB_SET | \
+                          STATUS_SET | MODE_SET | HERR_SET | VERR_SET | SPEEDERR_SET | TRACKERR_SET | CLIMBERR_SET | \
+                          ECEF_SET | VECEF_SET | NED_SET | VNED_SET | GPSTIME_SET)
+#define GPS_SNAPSHOT_ALL (GPS_SNAPSHOT_FIX | DOP_SET | ONLINE_SET | SATELLITE_SET | RAW_SET | MEASX_SET | SUBFRAME_SET)
+
+/* Receivers one process reads at most, each on a serial port and a thread of its own */
+#define GPS_MAX_RECEIVERS 8
+
+struct simulator;
+
+/* A receiver, the serial thread reading it and the thread decoding what it read. */
+typedef struct
+{
+    int index;
     char port_name[256];
+    // How the serial thread runs, pinned to a core and at a real-time priority if asked to
+    rt_thread_config_t rt;
+    struct simulator *simulator;
+    serial_port_t serial_port;
+    // Baud rate the receiver is switched to, with its messages cut down to those decoded, 0 to leave it as it is
+    unsigned int baud;
+
+    atomic_bool gps_serial_thread_exit;
+    atomic_bool gps_serial_thread_running;
+    pthread_mutex_t gps_serial_lock;
+    pthread_t gps_serial_thread;
+    pthread_cond_t gps_serial_init_done; // Condition signals GPS thread is running
+
+    // Frames as read, with the time they arrived, from the serial thread to the decode thread
+    frame_queue_t frames;
+    pthread_t gps_decode_thread;
+
+    // PPS source of the receiver, empty if none. Its edges are tagged with the time pulses the decode thread
+    // reads the announcements of
+    char pps_path[256];
+    bool pps_running;
+    pps_capture_t pps;
+    time_tagger_t time_tagger;
+
+    // Receiver state published by the decode thread. The thread updates the back snapshot without the lock, then
+    // swaps it to the front under the simulator's gps_fix_lock; readers hold the lock while they copy from the front
+    // snapshot.
+    unsigned long gps_snapshot_version;
+    unsigned long gps_fix_generation;
+    // When the bytes of the latest fix were read, on the monotonic clock
+    uint64_t gps_fix_monotonic_us;
+    int gps_snapshot_front;
+    // Sections the back snapshot missed in the last publication, owned by the decode thread
+    gps_mask_t gps_snapshot_back_stale;
+    gps_snapshot_t gps_snapshot[2];
+} gps_receiver_t;
 
+/* All the GPS simulators variables. */
+typedef struct simulator
+{
     atomic_bool main_exit;
     atomic_bool gps_thread_exit;
     atomic_bool gps_thread_running;
-    atomic_bool gps_serial_thread_exit;
-    atomic_bool gps_serial_thread_running;
 
     pid_t main_thread;
     pid_t serial_thread;
@@ -75,24 +153,24 @@ typedef struct
 
     timespec_t compensation;
     pthread_cond_t gps_init_done; // Condition signals GPS thread is running
-    pthread_mutex_t gps_serial_lock;
-    pthread_t gps_serial_thread;
-    pthread_cond_t gps_serial_init_done; // Condition signals GPS thread is running
     location_t location;                 // Simulator geo location
-    struct gps_device_t gpsdata;
+
+    gps_receiver_t receivers[GPS_MAX_RECEIVERS];
+    int num_receivers;
+
+    // Guards the snapshots of all receivers. gps_fix_ready is signalled when a publication of any receiver
+    // carries a new GPS time, so one thread can wait for the fixes of them all.
+    pthread_mutex_t gps_fix_lock;
+    pthread_cond_t gps_fix_ready;
     bool external_data_ready;
     bool pre_synch;
     bool synch;
     bool external;
     bool raw_set;
     bool skyview_set;
-    
-    volatile bool tp_lock;
-
 
+    // Session being recorded, NULL if none. The decode threads append the frames read
+    capture_writer_t *recording;
 } simulator_t;
 
-void set_thread_name(const char *name);
-int thread_to_core(int core_id);
-
 #endif /* GPS_SIM_H */
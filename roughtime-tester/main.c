@@ -16,6 +16,7 @@ Requirements: STANDARD POSIX code!! no wierd linux magic, no wierd mcu stuff.
 #include <getopt.h>
 #include <assert.h>
 #include <signal.h>
+#include <errno.h>
 
 #include <pthread.h>
 
@@ -25,34 +26,27 @@ Requirements: STANDARD POSIX code!! no wierd linux magic, no wierd mcu stuff.
 #include "base64.h"
 #include "CraggyTransport.h"
 #include "CraggyClient.h"
+#include "CraggyTimeExport.h"
+#include "CraggyClock.h"
+#include "CraggyProtocol.h"
 
 #include "serial_api/serial.h"
+#include "serial_api/driver_ubx.h"
 #include "others/log.h"
 #include "gps-sim.h"
 #include "gps-core.h"
+#include "sampler.h"
+#include "capture.h"
 
 int run = 1;
 
-simulator_t simulator;
+// How long the main loop waits for a fix before checking whether it should stop
+#define FIX_WAIT_TIMEOUT_MS 1000
 
-static u_int64_t TimeUs(clockid_t clock)
-{
-    struct timespec tv;
-    if (clock_gettime(clock, &tv))
-    {
-        abort();
-    }
-    u_int64_t ret = tv.tv_sec;
-    ret *= 1000000;
-    ret += tv.tv_nsec / 1000;
-    return ret;
-}
-
-// MonotonicUs returns the value of the monotonic clock in microseconds.
-u_int64_t MonotonicUs() { return TimeUs(CLOCK_MONOTONIC); }
+// Oldest a PPS edge may be to serve as the reference of a sample, a pulse missed included
+#define PULSE_MAX_AGE_NS 2100000000ULL
 
-// MonotonicUs returns the value of the realtime clock in microseconds.
-u_int64_t RealtimeUs() { return TimeUs(CLOCK_REALTIME); }
+simulator_t simulator;
 
 static void simulator_init(void)
 {
@@ -66,13 +60,246 @@ static void simulator_init(void)
     simulator.external_data_ready = false;
     simulator.raw_set = false;
     simulator.skyview_set = false;
+    simulator.recording = NULL;
 
     simulator.pre_synch = false;
     simulator.synch = false;
 
-    memset(&(simulator.gpsdata), 0, sizeof(struct gps_device_t));
-    pthread_cond_init(&simulator.gps_serial_init_done, NULL);
-    pthread_mutex_init(&simulator.gps_serial_lock, NULL);
+    simulator.num_receivers = 0;
+    for (int i = 0; i < GPS_MAX_RECEIVERS; i++)
+    {
+        gps_receiver_t *receiver = &simulator.receivers[i];
+        memset(receiver, 0, sizeof(gps_receiver_t));
+        receiver->index = i;
+        rt_thread_config_init(&receiver->rt);
+        time_tagger_init(&receiver->time_tagger);
+        receiver->simulator = &simulator;
+        pthread_cond_init(&receiver->gps_serial_init_done, NULL);
+        pthread_mutex_init(&receiver->gps_serial_lock, NULL);
+    }
+    pthread_cond_init(&simulator.gps_fix_ready, NULL);
+    pthread_mutex_init(&simulator.gps_fix_lock, NULL);
+}
+
+/*!
+ * Tags the last PPS edge of a receiver before the monotonic instant given with the time pulse it was
+ */
+static bool PulseBefore(gps_receiver_t *receiver, uint64_t monotonic_us, time_tag_t *tag)
+{
+    pps_edge_t edge;
+    if (!receiver->pps_running || pps_capture_edge_before(&receiver->pps, monotonic_us * 1000, &edge) != 0 ||
+        monotonic_us * 1000 - edge.assert_monotonic_ns > PULSE_MAX_AGE_NS)
+    {
+        return false;
+    }
+    return time_tagger_tag(&receiver->time_tagger, edge.assert_realtime_ns, edge.assert_monotonic_ns, edge.sequence, tag);
+}
+
+static void ReportSample(int receiver, const sampler_sample_t *sample)
+{
+    log_info("[%d] GPSTimestamp: %lf%s", receiver, sample->gnss_us, sample->interpolated ? "" : " (extrapolated)");
+    log_info("[%d] RAD[%lf] \t RTT[%lf] \t Time Delta: %lf", receiver, sample->radius_us / 1e6, sample->round_trip_us / 1e6, sample->offset_us / 1e6);
+
+    // With a PPS source the pulse before the midpoint is the reference, its edge stamped by the kernel rather
+    // than by the arrival of a message
+    time_tag_t tag;
+    if (PulseBefore(&simulator.receivers[receiver], sample->midpoint_us, &tag))
+    {
+        int64_t reference_ns = time_tag_utc_ns(&tag, sample->midpoint_us * 1000);
+        log_info("[%d] PPS pulse %lu: UTC %" PRIu64 ".%09" PRIu64 " at %" PRIu64 ".%09" PRIu64 ", qErr %" PRId32 "ps \t Time Delta: %lf",
+                 receiver, tag.sequence, tag.gnss_utc_ns / NSEC_PER_SEC, tag.gnss_utc_ns % NSEC_PER_SEC,
+                 tag.pulse_realtime_ns / NSEC_PER_SEC, tag.pulse_realtime_ns % NSEC_PER_SEC, tag.qerr_ps,
+                 ((double)sample->roughtime_us * 1000 - (double)reference_ns) / 1e9);
+    }
+}
+
+/*!
+ * Reports the samples of every receiver that can be stamped, all of them if flush is set
+ */
+static void ReportResults(sampler_t *samplers, int num_samplers, uint64_t now_us, bool flush)
+{
+    sampler_sample_t sample;
+    for (int i = 0; i < num_samplers; i++)
+    {
+        while (sampler_next_result(&samplers[i], now_us, flush, &sample))
+        {
+            ReportSample(i, &sample);
+        }
+    }
+}
+
+/*!
+ * True while a sample of any receiver waits for the fix after it
+ */
+static bool ResultsPending(const sampler_t *samplers, int num_samplers)
+{
+    for (int i = 0; i < num_samplers; i++)
+    {
+        if (samplers[i].num_pending > 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*!
+ * True if a query is due for any receiver
+ */
+static bool QueryDue(const sampler_t *samplers, int num_samplers, uint64_t now_us)
+{
+    for (int i = 0; i < num_samplers; i++)
+    {
+        if (sampler_due(&samplers[i], now_us))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*!
+ * Milliseconds until the first receiver with a fix has a query due, FIX_WAIT_TIMEOUT_MS if none has a fix yet
+ */
+static int QueryWaitMs(const sampler_t *samplers, int num_samplers, uint64_t now_us)
+{
+    int wait_ms = FIX_WAIT_TIMEOUT_MS;
+    for (int i = 0; i < num_samplers; i++)
+    {
+        if (samplers[i].num_fixes > 0 && sampler_wait_ms(&samplers[i], now_us) < wait_ms)
+        {
+            wait_ms = sampler_wait_ms(&samplers[i], now_us);
+        }
+    }
+    return wait_ms;
+}
+
+/*!
+ * Hands the result of a query to the sampler of every receiver with a fix, to be stamped against each GNSS time line
+ */
+static void AddSample(sampler_t *samplers, int num_samplers, const sampler_sample_t *sample)
+{
+    for (int i = 0; i < num_samplers; i++)
+    {
+        if (samplers[i].num_fixes > 0)
+        {
+            sampler_add_sample(&samplers[i], sample);
+        }
+    }
+}
+
+/*!
+ * Feeds a recorded session through the UBX decoder and the verification of its responses again, at the pace it was
+ * recorded or as fast as the capture can be read. Results are stamped from the recorded times, so a replay gives the
+ * results of the session
+ */
+static int ReplayCapture(const char *path, bool realtime, craggy_rough_time_public_key_t root_public_key, uint8_t intervals, double drift_threshold_us)
+{
+    capture_reader_t reader;
+    if (!capture_reader_open(&reader, path))
+    {
+        log_error("Could not read the capture %s: %s", path, strerror(errno));
+        return 1;
+    }
+
+    // A decoder and a sampler for each receiver recorded
+    struct gps_device_t *devices[GPS_MAX_RECEIVERS] = {NULL};
+    sampler_t samplers[GPS_MAX_RECEIVERS];
+    int num_samplers = 0;
+    capture_pacer_t pacer;
+    capture_pacer_init(&pacer);
+
+    craggy_rough_time_nonce_t nonce_bytes;
+    bool requested = false;
+    uint64_t sent_us = 0;
+    uint64_t now_us = 0;
+    unsigned long frames = 0;
+    unsigned long responses = 0;
+    unsigned long invalid = 0;
+
+    capture_record_t record;
+    while (run > 0 && capture_reader_next(&reader, &record))
+    {
+        if (realtime)
+        {
+            capture_pace(&pacer, record.timestamp_us);
+        }
+        now_us = record.timestamp_us;
+
+        if (record.type == CAPTURE_UBX_FRAME && record.source < GPS_MAX_RECEIVERS)
+        {
+            while (num_samplers <= record.source)
+            {
+                devices[num_samplers] = calloc(1, sizeof(struct gps_device_t));
+                if (devices[num_samplers] == NULL)
+                {
+                    goto exit;
+                }
+                gpsd_zero_satellites(&devices[num_samplers]->gpsdata);
+                gpsd_zero_raw(&devices[num_samplers]->gpsdata);
+                sampler_init(&samplers[num_samplers], (uint64_t)intervals * 1000000, drift_threshold_us);
+                num_samplers++;
+            }
+            struct gps_device_t *device = devices[record.source];
+            frames++;
+            // The decoder only reads the frame, straight from the mapping of the capture
+            gps_mask_t mask = ubx_parse(device, (unsigned char *)record.data, record.length);
+            if (mask & GPSTIME_SET)
+            {
+                timespec_t fix_time = device->gpsdata.fix.time;
+                sampler_add_fix(&samplers[record.source], record.timestamp_us, (fix_time.tv_sec + fix_time.tv_nsec * 1e-9) * 1e6);
+            }
+        }
+        else if (record.type == CAPTURE_ROUGHTIME_REQUEST)
+        {
+            const uint8_t *nonce;
+            requested = craggy_parseRequestNonce(record.data, record.length, &nonce);
+            if (requested)
+            {
+                memcpy(nonce_bytes, nonce, CRAGGY_ROUGH_TIME_NONCE_LENGTH);
+                sent_us = record.timestamp_us;
+            }
+        }
+        else if (record.type == CAPTURE_ROUGHTIME_RESPONSE && requested)
+        {
+            requested = false;
+            responses++;
+            craggy_rough_time_t timestamp;
+            uint32_t radius;
+            CraggyResult craggy_result;
+            if (craggy_processResponse(nonce_bytes, root_public_key, (craggy_rough_time_response_t *)record.data, record.length, &craggy_result, &timestamp, &radius))
+            {
+                sampler_sample_t sample;
+                sample.roughtime_us = timestamp;
+                sample.radius_us = radius;
+                sample.round_trip_us = record.timestamp_us - sent_us;
+                sample.midpoint_us = record.timestamp_us - sample.round_trip_us / 2;
+                AddSample(samplers, num_samplers, &sample);
+            }
+            else
+            {
+                log_error("Error parsing response: %d", craggy_result);
+                invalid++;
+            }
+        }
+
+        ReportResults(samplers, num_samplers, now_us, false);
+    }
+
+    ReportResults(samplers, num_samplers, now_us, true);
+    if (reader.offset != reader.size)
+    {
+        log_warn("The capture ends with a record cut short");
+    }
+    log_info("Replayed %lu UBX frames of %d receivers and %lu responses, %lu of them invalid", frames, num_samplers, responses, invalid);
+
+exit:
+    for (int i = 0; i < num_samplers; i++)
+    {
+        free(devices[i]);
+    }
+    capture_reader_close(&reader);
+    return 0;
 }
 
 void sig_handler(int sig)
@@ -87,7 +314,18 @@ void sig_handler(int sig)
 int main(int argc, char *argv[])
 {
     signal(SIGINT, sig_handler);
+    // Log records are written out by a thread of their own, so neither the serial thread nor a query waits on stderr
+    if (log_start_async() != 0)
+    {
+        log_warn("Could not start the log thread, logging synchronously");
+    }
+    simulator_init();
     CraggyResult craggyResult;
+    // Queries are timed with the CPU's counter where it is reliable, falling back to clock_gettime
+    if (!craggy_clockCalibrate(&craggyResult))
+    {
+        log_info("No reliable CPU counter, timestamps come from clock_gettime");
+    }
 
     struct timespec timeout;
 
@@ -100,25 +338,52 @@ int main(int argc, char *argv[])
         {"intervals", optional_argument, 0, 'i'},
         {"repreats", optional_argument, 0, 'r'},
         {"gpsport", optional_argument, 0, 'p'},
+        {"shm", required_argument, 0, 's'},
+        {"ubx", required_argument, 0, 'u'},
+        {"drift", required_argument, 0, 'd'},
+        {"record", required_argument, 0, 'w'},
+        {"replay", required_argument, 0, 'R'},
+        {"realtime", no_argument, 0, 'T'},
+        {"cores", required_argument, 0, 'C'},
+        {"query-core", required_argument, 0, 'Q'},
+        {"fifo", required_argument, 0, 'F'},
+        {"lock-memory", no_argument, 0, 'L'},
+        {"pps", required_argument, 0, 'P'},
+        {"baud", required_argument, 0, 'b'},
         {0, 0, 0, 0}};
 
     int c;
 
     char *hostname = NULL;
+    CraggyTransport *transport = NULL;
+    CraggyTimeExport *timeExport = NULL;
+    int shmUnit = -1;
     char *nonce = NULL;
     char *publicKey = NULL;
-    char *gpsPort = NULL;
+    char *cores = NULL;
+    int numPps = 0;
+    int queryCore = -1;
+    int priority = 0;
+    unsigned int baud = 0;
+    bool lockMemory = false;
     uint8_t repeats = 1;
     uint8_t intervals = 1;
+    double driftThresholdUs = 0;
+    char *recordPath = NULL;
+    char *replayPath = NULL;
+    bool realtime = false;
+    capture_writer_t recording = {-1};
 
     char byte;
     int avb = 0;
 
+    ubx_dispatch_init();
+
     while (1)
     {
 
         int option_index = 0;
-        c = getopt_long(argc, argv, "h:k:n:i:r:p:", long_options, &option_index);
+        c = getopt_long(argc, argv, "h:k:n:i:r:p:s:u:d:w:R:TC:Q:F:LP:b:", long_options, &option_index);
 
         /* Detect the end of the options. */
         if (c == -1)
@@ -152,7 +417,47 @@ int main(int argc, char *argv[])
             break;
 
         case 'p':
-            gpsPort = strcpy(simulator.port_name, optarg);
+            // Once for every receiver
+            if (simulator.num_receivers == GPS_MAX_RECEIVERS)
+            {
+                printf("At most %d receivers can be read\n", GPS_MAX_RECEIVERS);
+                log_stop_async();
+                return 1;
+            }
+            snprintf(simulator.receivers[simulator.num_receivers].port_name, sizeof(simulator.receivers[0].port_name), "%s", optarg);
+            simulator.num_receivers++;
+            break;
+
+        case 'P':
+            // Once for every receiver with a PPS source, in the order the receivers are given
+            if (numPps == GPS_MAX_RECEIVERS)
+            {
+                printf("At most %d PPS sources can be read\n", GPS_MAX_RECEIVERS);
+                log_stop_async();
+                return 1;
+            }
+            snprintf(simulator.receivers[numPps].pps_path, sizeof(simulator.receivers[0].pps_path), "%s", optarg);
+            numPps++;
+            break;
+
+        case 'C':
+            // Cores to pin the serial threads to, in the order the receivers are given
+            cores = optarg;
+            break;
+
+        case 'Q':
+            // Core to pin the thread sending the queries to
+            queryCore = atoi(optarg);
+            break;
+
+        case 'F':
+            // SCHED_FIFO priority of the threads timestamping frames and round trips
+            priority = atoi(optarg);
+            break;
+
+        case 'L':
+            // Keeps page faults out of the timing-critical threads
+            lockMemory = true;
             break;
 
         case 'i':
@@ -165,6 +470,50 @@ int main(int argc, char *argv[])
             printf("Will poll for %d times\n", repeats);
             break;
 
+        case 's':
+            shmUnit = atoi(optarg);
+            break;
+
+        case 'd':
+            // Sample faster while the offset moves by more than this many microseconds between samples
+            driftThresholdUs = atof(optarg);
+            break;
+
+        case 'w':
+            recordPath = malloc(strlen(optarg) + 1);
+            recordPath = strcpy(recordPath, optarg);
+            break;
+
+        case 'R':
+            replayPath = malloc(strlen(optarg) + 1);
+            replayPath = strcpy(replayPath, optarg);
+            break;
+
+        case 'T':
+            // Replays at the pace the session was recorded
+            realtime = true;
+            break;
+
+        case 'b':
+            // Baud rate to switch the receivers to, turning off the UBX messages not decoded
+            baud = (unsigned int)strtoul(optarg, NULL, 10);
+            if (serial_baud_to_speed(baud) == B0)
+            {
+                printf("Unsupported baud rate %s\n", optarg);
+                log_stop_async();
+                return 1;
+            }
+            break;
+
+        case 'u':
+            // UBX messages to decode besides, or prefixed by '-' instead of, the default ones
+            if (!ubx_configure_messages(optarg))
+            {
+                log_stop_async();
+                return 1;
+            }
+            break;
+
         case '?':
             /* getopt_long already printed an error message. */
             break;
@@ -174,26 +523,14 @@ int main(int argc, char *argv[])
         }
     }
 
-    if (publicKey == NULL || hostname == NULL || gpsPort == NULL)
+    if (publicKey == NULL || (replayPath == NULL && (hostname == NULL || simulator.num_receivers == 0)))
     {
-        printf("usage: roughtimetester -h <hostname:port> -k <public key> -p </dev/gps>");
+        printf("usage: roughtimetester -h <hostname:port> -k <public key> -p </dev/gps> (-p </dev/gps1> ...) (-P </dev/pps0> ...) (-C <core>,<core>...) (-Q <query core>) (-F <SCHED_FIFO priority>) (-L, lock memory) (-s <NTP SHM unit>) (-u <UBX messages, e.g. NAV-SAT,-NAV-PVT>) (-b <baud, e.g. 460800, configuring the receivers>) (-i <seconds between queries>) (-d <drift in us that speeds up sampling>) (-w <capture to record>)\n"
+               "       roughtimetester -k <public key> -R <capture to replay> (-T, in real time) (-i <seconds between queries>) (-d <drift in us>)");
+        log_stop_async();
         return 1;
     }
 
-    // Prepare to spawn thread for external receiver
-    pthread_create(&simulator.gps_serial_thread, NULL, gps_serial_thread_ep, &simulator);
-    pthread_mutex_lock(&(simulator.gps_serial_lock));
-    int ret = pthread_cond_timedwait(&(simulator.gps_serial_init_done), &(simulator.gps_serial_lock), &timeout);
-    pthread_mutex_unlock(&(simulator.gps_serial_lock));
-    if (ret == ETIMEDOUT)
-    {
-        log_error("Time out waiting for External GPS thread. Running?");
-    }
-    else
-    {
-        log_info("Started External GPS thread - data is coming in now");
-    }
-
     craggy_rough_time_public_key_t rootPublicKey;
     size_t base64DecodedRootPublicKeyLen = 0;
     unsigned char *base64DecodedRootPublicKey = base64_decode((const unsigned char *)publicKey, strlen(publicKey), &base64DecodedRootPublicKeyLen);
@@ -206,6 +543,98 @@ int main(int argc, char *argv[])
     memcpy(&rootPublicKey, base64DecodedRootPublicKey, CRAGGY_ROUGH_TIME_PUBLIC_KEY_LENGTH);
     free(base64DecodedRootPublicKey);
 
+    for (int i = 0; cores != NULL && i < simulator.num_receivers; i++)
+    {
+        char *end;
+        simulator.receivers[i].rt.core = (int)strtol(cores, &end, 10);
+        if (end == cores)
+        {
+            simulator.receivers[i].rt.core = -1;
+        }
+        cores = *end == ',' ? end + 1 : NULL;
+    }
+    for (int i = 0; i < simulator.num_receivers; i++)
+    {
+        simulator.receivers[i].rt.priority = priority;
+        simulator.receivers[i].baud = baud;
+        simulator.receivers[i].rt.prefault_stack = lockMemory ? RT_THREAD_PREFAULT_STACK : 0;
+    }
+
+    if (replayPath != NULL)
+    {
+        ReplayCapture(replayPath, realtime, rootPublicKey, intervals, driftThresholdUs);
+        goto exit;
+    }
+
+    if (recordPath != NULL)
+    {
+        if (!capture_open(&recording, recordPath))
+        {
+            log_error("Could not record to %s: %s", recordPath, strerror(errno));
+            goto error;
+        }
+        simulator.recording = &recording;
+    }
+
+    // Prepare to spawn a thread for every external receiver
+    for (int i = 0; i < simulator.num_receivers; i++)
+    {
+        gps_receiver_t *receiver = &simulator.receivers[i];
+        pthread_create(&receiver->gps_serial_thread, NULL, gps_serial_thread_ep, receiver);
+        clock_gettime(CLOCK_REALTIME, &timeout);
+        timeout.tv_sec += 2;
+        pthread_mutex_lock(&(receiver->gps_serial_lock));
+        int ret = 0;
+        // The thread may well be running before we get to wait
+        while (!receiver->gps_serial_thread_running && ret != ETIMEDOUT)
+        {
+            ret = pthread_cond_timedwait(&(receiver->gps_serial_init_done), &(receiver->gps_serial_lock), &timeout);
+        }
+        pthread_mutex_unlock(&(receiver->gps_serial_lock));
+        if (ret == ETIMEDOUT)
+        {
+            log_error("Time out waiting for External GPS thread %d. Running?", i);
+        }
+        else
+        {
+            log_info("Started External GPS thread %d - data is coming in now", i);
+        }
+    }
+
+    // The edges of a receiver's PPS source, tagged with the TIM-TP announcements of its pulses, are the reference
+    // its samples are compared with besides its fixes
+    for (int i = 0; i < simulator.num_receivers; i++)
+    {
+        gps_receiver_t *receiver = &simulator.receivers[i];
+        if (receiver->pps_path[0] == '\0')
+        {
+            continue;
+        }
+        receiver->pps_running = pps_capture_start(&receiver->pps, receiver->pps_path, &receiver->rt) == 0;
+        if (!receiver->pps_running)
+        {
+            log_warn("Could not capture the PPS source %s of receiver %d, comparing with its fixes only", receiver->pps_path, i);
+        }
+    }
+
+    // Locked once the threads are up: their stacks are locked whole, and a thread created after mlockall with
+    // MCL_FUTURE fails outright where its stack is over RLIMIT_MEMLOCK
+    if (lockMemory)
+    {
+        int rtResult = rt_lock_memory();
+        if (rtResult != 0)
+        {
+            log_warn("Could not lock memory: %s", strerror(rtResult));
+        }
+    }
+    // Set up after the serial threads were created, which would otherwise inherit its core
+    rt_thread_config_t queryThread = {queryCore, priority, lockMemory ? RT_THREAD_PREFAULT_STACK : 0};
+    int rtResult = rt_thread_setup(&queryThread, "roughtime-query");
+    if (rtResult != 0)
+    {
+        log_warn("Could not set up the query thread (core %d, priority %d): %s", queryCore, priority, strerror(rtResult));
+    }
+
     craggy_rough_time_request_t requestBuf;
     memset(requestBuf, 0, sizeof(craggy_rough_time_request_t));
 
@@ -233,24 +662,93 @@ int main(int argc, char *argv[])
         }
     }
 
-    while (repeats > 0)
+    if (!craggy_transportOpen(hostname, &transport, &craggyResult))
     {
-        if (simulator.tp_lock)
+        log_error("Error opening transport: %d", craggyResult);
+        goto error;
+    }
+
+    if (shmUnit >= 0 && !craggy_timeExportOpen(shmUnit, &timeExport, &craggyResult))
+    {
+        log_error("Error attaching to NTP shared memory unit %d: %d", shmUnit, craggyResult);
+        goto error;
+    }
+
+    // Kernel timestamps keep scheduling delays out of the round-trip time, where the platform offers them
+    craggy_transportEnableTimestamps(transport, false, &craggyResult);
+
+    // Queries are made at their own rate, the serial threads parsing on meanwhile; each result is stamped with
+    // the GNSS time of every receiver, interpolated between the fixes around it. One query serves all receivers,
+    // so they are all compared with the same authenticated time
+    sampler_t samplers[GPS_MAX_RECEIVERS];
+    gps_fix_t fixes[GPS_MAX_RECEIVERS];
+    memset(fixes, 0, sizeof(fixes));
+    for (int i = 0; i < simulator.num_receivers; i++)
+    {
+        sampler_init(&samplers[i], (uint64_t)intervals * 1000000, driftThresholdUs);
+    }
+    int queries = 0;
+
+    while ((queries < repeats || ResultsPending(samplers, simulator.num_receivers)) && run > 0)
+    {
+        uint64_t now_us = craggy_monotonicUs();
+        // Until the next query, unless none can be made before a fix comes in
+        int wait_ms = queries < repeats ? QueryWaitMs(samplers, simulator.num_receivers, now_us) : FIX_WAIT_TIMEOUT_MS;
+        if (wait_ms > FIX_WAIT_TIMEOUT_MS)
+        {
+            wait_ms = FIX_WAIT_TIMEOUT_MS;
+        }
+        // Sleeps until a serial thread hands over a fix or a query is due, fixes arriving meanwhile being folded into one
+        if (gps_wait_for_fix(&simulator, fixes, wait_ms))
         {
+            for (int i = 0; i < simulator.num_receivers; i++)
+            {
+                if (fixes[i].fresh)
+                {
+                    sampler_add_fix(&samplers[i], fixes[i].monotonic_us, (fixes[i].time.tv_sec + fixes[i].time.tv_nsec * 1e-9) * 1e6);
+                }
+            }
+        }
+
+        now_us = craggy_monotonicUs();
+        ReportResults(samplers, simulator.num_receivers, now_us, false);
 
+        // Due as soon as any receiver's sampler has it due, all of them starting the next interval from here
+        if (queries < repeats && QueryDue(samplers, simulator.num_receivers, now_us))
+        {
+            for (int i = 0; i < simulator.num_receivers; i++)
+            {
+                sampler_query_started(&samplers[i], now_us);
+            }
             if (craggy_createRequest(nonceBytes, requestBuf))
             {
 
                 log_info("--------------- START ---------------");
                 craggy_rough_time_t timestamp;
                 uint32_t radius;
-                const uint32_t start_us = MonotonicUs();
+                const u_int64_t start_us = craggy_monotonicUs();
 
                 size_t responseBufLen = CRAGGY_ROUGH_TIME_MIN_REQUEST_SIZE * 3;
                 craggy_rough_time_response_t responseBuf[responseBufLen];
+                CraggyTransportTimestamps timestamps;
 
-                if (craggy_makeRequest(hostname, requestBuf, &craggyResult, responseBuf, &responseBufLen))
+                if (craggy_transportRequestWithTimestamps(transport, requestBuf, &craggyResult, responseBuf, &responseBufLen, &timestamps))
                 {
+                    // The round trip ends as the response arrives, its verification is not part of it
+                    const uint64_t end_us = craggy_monotonicUs();
+                    uint64_t round_trip_us = end_us - start_us;
+                    uint64_t end_realtime_us = craggy_realtimeUs();
+                    if (timestamps.sent != 0 && timestamps.received != 0)
+                    {
+                        round_trip_us = (timestamps.received - timestamps.sent) / 1000;
+                        end_realtime_us = timestamps.received / 1000;
+                    }
+                    if (simulator.recording != NULL)
+                    {
+                        // Stamped so that a replay measures the round trip as it was measured here
+                        capture_write(simulator.recording, CAPTURE_ROUGHTIME_REQUEST, 0, end_us - round_trip_us, requestBuf, sizeof(requestBuf));
+                        capture_write(simulator.recording, CAPTURE_ROUGHTIME_RESPONSE, 0, end_us, responseBuf, responseBufLen);
+                    }
 
                     if (!craggy_processResponse(nonceBytes, rootPublicKey, responseBuf, responseBufLen, &craggyResult, &timestamp, &radius))
                     {
@@ -258,16 +756,24 @@ int main(int argc, char *argv[])
                         goto error;
                     }
 
+                    // The server's midpoint is compared with GNSS at the middle of the round trip
+                    sampler_sample_t sample;
+                    sample.roughtime_us = timestamp;
+                    sample.radius_us = radius;
+                    sample.round_trip_us = round_trip_us;
+                    sample.midpoint_us = end_us - round_trip_us / 2;
+                    AddSample(samplers, simulator.num_receivers, &sample);
+                    queries++;
+
                     // We assume that the path to the Roughtime server is symmetric and thus add
                     // half the round-trip time to the server's timestamp to produce our estimate
                     // of the current time.
-                    const uint32_t end_us = MonotonicUs();
-                    const uint32_t end_realtime_us = RealtimeUs();
-                    timestamp += (end_us - start_us) / 2;
-
+                    timestamp += round_trip_us / 2;
+                    if (timeExport != NULL)
+                    {
+                        craggy_timeExportPublish(timeExport, timestamp, radius, end_realtime_us);
+                    }
                     log_info("Craggy Timestamp: %ld", timestamp);
-                    log_info("GPSTimestamp: %lf", (simulator.gpsdata.gpsdata.fix.time.tv_sec + simulator.gpsdata.gpsdata.fix.time.tv_nsec * 1e-9) * 1e6);
-                    log_info("RAD[%lf] \t Time Delta: %lf", radius/1e6, (timestamp - (simulator.gpsdata.gpsdata.fix.time.tv_sec + simulator.gpsdata.gpsdata.fix.time.tv_nsec * 1e-9) * 1e6) / 1e6);
                 }
                 else
                 {
@@ -276,11 +782,12 @@ int main(int argc, char *argv[])
                 }
                 log_info("--------------- STOP ---------------");
             }
-            repeats--;
-            simulator.tp_lock = false;
         }
     }
 
+    // Samples still waiting for a later fix are stamped from the fixes there are
+    ReportResults(samplers, simulator.num_receivers, craggy_monotonicUs(), true);
+
     log_warn("Terminating.... ");
 
     goto exit;
@@ -288,8 +795,31 @@ error:
     assert(result != 0);
 
 exit:
+    craggy_timeExportClose(timeExport);
+    craggy_transportClose(transport);
     free(hostname);
     free(publicKey);
-    simulator.gps_serial_thread_exit = true;
+    for (int i = 0; i < simulator.num_receivers; i++)
+    {
+        simulator.receivers[i].gps_serial_thread_exit = true;
+        if (simulator.receivers[i].pps_running)
+        {
+            pps_capture_stop(&simulator.receivers[i].pps);
+            simulator.receivers[i].pps_running = false;
+        }
+    }
+    if (simulator.recording != NULL)
+    {
+        // The serial threads may still be appending frames
+        for (int i = 0; i < simulator.num_receivers; i++)
+        {
+            pthread_join(simulator.receivers[i].gps_serial_thread, NULL);
+        }
+        simulator.recording = NULL;
+    }
+    capture_close(&recording);
+    free(recordPath);
+    free(replayPath);
+    log_stop_async();
     return 0;
 }
@@ -20,10 +20,21 @@
  * IN THE SOFTWARE.
  */
 
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <errno.h>
+
 #include "log.h"
 
 #define MAX_CALLBACKS 32
 
+/* Records queued for the async thread, a power of two */
+#define RING_SIZE 1024
+#define RECORD_TEXT_LEN 256
+
 typedef struct {
   log_LogFn fn;
   void *udata;
@@ -38,6 +49,30 @@ static struct {
   Callback callbacks[MAX_CALLBACKS];
 } L;
 
+typedef struct {
+  /* Stream position the slot is free for, or one past that once written */
+  atomic_size_t sequence;
+  time_t time;
+  const char *file;
+  int line;
+  int level;
+  char text[RECORD_TEXT_LEN];
+} Record;
+
+static struct {
+  Record ring[RING_SIZE];
+  atomic_size_t enqueue_pos;
+  size_t dequeue_pos;      /* the async thread's alone */
+  atomic_bool running;
+  atomic_bool stop;
+  atomic_bool sleeping;
+  atomic_int writers;      /* callers between checking running and queueing */
+  atomic_ulong dropped;
+  unsigned long dropped_reported;
+  sem_t wakeup;
+  pthread_t thread;
+} A;
+
 
 static const char *level_strings[] = {
   "TRACE", "DEBUG", "INFO", "WARN", "ERROR", "FATAL"
@@ -128,41 +163,198 @@ int log_add_fp(FILE *fp, int level) {
 }
 
 
-static void init_event(log_Event *ev, void *udata) {
-  if (!ev->time) {
-    time_t t = time(NULL);
-    ev->time = localtime(&t);
+static bool wanted(int level) {
+  if (!L.quiet && level >= L.level) { return true; }
+  for (int i = 0; i < MAX_CALLBACKS && L.callbacks[i].fn; i++) {
+    if (level >= L.callbacks[i].level) { return true; }
   }
-  ev->udata = udata;
+  return false;
 }
 
 
-void log_log(int level, const char *file, int line, const char *fmt, ...) {
-  log_Event ev = {
-    .fmt   = fmt,
-    .file  = file,
-    .line  = line,
-    .level = level,
-  };
-
-  lock();
+static void dispatch(log_Event *ev, time_t t, va_list ap) {
+  struct tm tm;
+  ev->time = localtime_r(&t, &tm);
 
-  if (!L.quiet && level >= L.level) {
-    init_event(&ev, stderr);
-    va_start(ev.ap, fmt);
-    stdout_callback(&ev);
-    va_end(ev.ap);
+  if (!L.quiet && ev->level >= L.level) {
+    ev->udata = stderr;
+    va_copy(ev->ap, ap);
+    stdout_callback(ev);
+    va_end(ev->ap);
   }
 
   for (int i = 0; i < MAX_CALLBACKS && L.callbacks[i].fn; i++) {
     Callback *cb = &L.callbacks[i];
-    if (level >= cb->level) {
-      init_event(&ev, cb->udata);
-      va_start(ev.ap, fmt);
-      cb->fn(&ev);
-      va_end(ev.ap);
+    if (ev->level >= cb->level) {
+      ev->udata = cb->udata;
+      va_copy(ev->ap, ap);
+      cb->fn(ev);
+      va_end(ev->ap);
+    }
+  }
+}
+
+
+static void dispatch_text(log_Event *ev, time_t t, const char *fmt, ...) {
+  va_list ap;
+  va_start(ap, fmt);
+  dispatch(ev, t, ap);
+  va_end(ap);
+}
+
+
+static void enqueue(int level, const char *file, int line, const char *fmt, va_list ap) {
+  size_t pos = atomic_load_explicit(&A.enqueue_pos, memory_order_relaxed);
+  Record *r;
+
+  for (;;) {
+    r = &A.ring[pos & (RING_SIZE - 1)];
+    size_t seq = atomic_load_explicit(&r->sequence, memory_order_acquire);
+    intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+    if (diff == 0) {
+      if (atomic_compare_exchange_weak_explicit(&A.enqueue_pos, &pos, pos + 1,
+                                                memory_order_relaxed, memory_order_relaxed)) {
+        break;
+      }
+    } else if (diff < 0) {
+      /* Full: the thread is behind, and the caller must not wait for it */
+      atomic_fetch_add_explicit(&A.dropped, 1, memory_order_relaxed);
+      return;
+    } else {
+      pos = atomic_load_explicit(&A.enqueue_pos, memory_order_relaxed);
     }
   }
 
-  unlock();
+  r->time = time(NULL);
+  r->file = file;
+  r->line = line;
+  r->level = level;
+  vsnprintf(r->text, sizeof(r->text), fmt, ap);
+  atomic_store(&r->sequence, pos + 1);
+
+  /* Only a thread gone to sleep needs waking, which keeps the semaphore off the common path */
+  if (atomic_exchange(&A.sleeping, false)) {
+    sem_post(&A.wakeup);
+  }
+}
+
+
+static bool queued(void) {
+  Record *r = &A.ring[A.dequeue_pos & (RING_SIZE - 1)];
+  return atomic_load(&r->sequence) == A.dequeue_pos + 1;
+}
+
+
+static void drain(void) {
+  while (queued()) {
+    Record *r = &A.ring[A.dequeue_pos & (RING_SIZE - 1)];
+    log_Event ev = {
+      .fmt   = "%s",
+      .file  = r->file,
+      .line  = r->line,
+      .level = r->level,
+    };
+    dispatch_text(&ev, r->time, "%s", r->text);
+    atomic_store_explicit(&r->sequence, A.dequeue_pos + RING_SIZE, memory_order_release);
+    A.dequeue_pos++;
+  }
+
+  unsigned long dropped = atomic_load_explicit(&A.dropped, memory_order_relaxed);
+  if (dropped != A.dropped_reported) {
+    log_Event ev = { .fmt = "%lu log record(s) dropped", .file = __FILE__, .line = __LINE__, .level = LOG_WARN };
+    dispatch_text(&ev, time(NULL), ev.fmt, dropped - A.dropped_reported);
+    A.dropped_reported = dropped;
+  }
+}
+
+
+static void *async_thread(void *arg) {
+  (void)arg;
+  for (;;) {
+    drain();
+    if (atomic_load(&A.stop)) {
+      break;
+    }
+    atomic_store(&A.sleeping, true);
+    if (queued() || atomic_load(&A.stop)) {
+      atomic_store(&A.sleeping, false);
+      continue;
+    }
+    while (sem_wait(&A.wakeup) != 0 && errno == EINTR) {
+    }
+  }
+  return NULL;
+}
+
+
+int log_start_async(void) {
+  if (atomic_load(&A.running)) {
+    return 0;
+  }
+  for (size_t i = 0; i < RING_SIZE; i++) {
+    atomic_init(&A.ring[i].sequence, i);
+  }
+  atomic_store(&A.enqueue_pos, 0);
+  A.dequeue_pos = 0;
+  atomic_store(&A.stop, false);
+  atomic_store(&A.sleeping, false);
+  if (sem_init(&A.wakeup, 0, 0) != 0) {
+    return -1;
+  }
+  if (pthread_create(&A.thread, NULL, async_thread, NULL) != 0) {
+    sem_destroy(&A.wakeup);
+    return -1;
+  }
+  atomic_store(&A.running, true);
+  return 0;
+}
+
+
+void log_stop_async(void) {
+  if (!atomic_load(&A.running)) {
+    return;
+  }
+  atomic_store(&A.running, false);
+  /* Whoever saw it running is queueing a last record, the rest log themselves from now on */
+  while (atomic_load(&A.writers) != 0) {
+    sched_yield();
+  }
+  atomic_store(&A.stop, true);
+  sem_post(&A.wakeup);
+  pthread_join(A.thread, NULL);
+  sem_destroy(&A.wakeup);
+}
+
+
+unsigned long log_dropped(void) {
+  return atomic_load_explicit(&A.dropped, memory_order_relaxed);
+}
+
+
+void log_log(int level, const char *file, int line, const char *fmt, ...) {
+  if (!wanted(level)) {
+    return;
+  }
+
+  va_list ap;
+  va_start(ap, fmt);
+
+  atomic_fetch_add(&A.writers, 1);
+  if (atomic_load(&A.running)) {
+    enqueue(level, file, line, fmt, ap);
+    atomic_fetch_sub(&A.writers, 1);
+  } else {
+    atomic_fetch_sub(&A.writers, 1);
+    log_Event ev = {
+      .fmt   = fmt,
+      .file  = file,
+      .line  = line,
+      .level = level,
+    };
+    lock();
+    dispatch(&ev, time(NULL), ap);
+    unlock();
+  }
+
+  va_end(ap);
 }
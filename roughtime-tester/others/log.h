@@ -30,12 +30,26 @@ typedef void (*log_LockFn)(bool lock, void *udata);
 
 enum { LOG_TRACE, LOG_DEBUG, LOG_INFO, LOG_WARN, LOG_ERROR, LOG_FATAL };
 
-#define log_trace(...) log_log(LOG_TRACE, __FILE__, __LINE__, __VA_ARGS__)
-#define log_debug(...) log_log(LOG_DEBUG, __FILE__, __LINE__, __VA_ARGS__)
-#define log_info(...)  log_log(LOG_INFO,  __FILE__, __LINE__, __VA_ARGS__)
-#define log_warn(...)  log_log(LOG_WARN,  __FILE__, __LINE__, __VA_ARGS__)
-#define log_error(...) log_log(LOG_ERROR, __FILE__, __LINE__, __VA_ARGS__)
-#define log_fatal(...) log_log(LOG_FATAL, __FILE__, __LINE__, __VA_ARGS__)
+/*
+ * Records below LOG_MIN_LEVEL are compiled out, arguments and all - for
+ * instance with -DLOG_MIN_LEVEL=LOG_INFO. The runtime level still applies
+ * to the rest.
+ */
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL LOG_TRACE
+#endif
+
+#define log_at(level, ...) \
+  do { \
+    if ((level) >= LOG_MIN_LEVEL) { log_log((level), __FILE__, __LINE__, __VA_ARGS__); } \
+  } while (0)
+
+#define log_trace(...) log_at(LOG_TRACE, __VA_ARGS__)
+#define log_debug(...) log_at(LOG_DEBUG, __VA_ARGS__)
+#define log_info(...)  log_at(LOG_INFO,  __VA_ARGS__)
+#define log_warn(...)  log_at(LOG_WARN,  __VA_ARGS__)
+#define log_error(...) log_at(LOG_ERROR, __VA_ARGS__)
+#define log_fatal(...) log_at(LOG_FATAL, __VA_ARGS__)
 
 const char* log_level_string(int level);
 void log_set_lock(log_LockFn fn, void *udata);
@@ -44,6 +58,18 @@ void log_set_quiet(bool enable);
 int log_add_callback(log_LogFn fn, void *udata, int level);
 int log_add_fp(FILE *fp, int level);
 
+/*
+ * Hands records to a background thread through a lock-free ring, which
+ * writes them out, rather than writing them in the calling thread. The
+ * message is formatted by the caller; time, prefix and output are left to
+ * the thread. Records finding the ring full are dropped and counted, never
+ * waited for. Returns 0, or -1 if the thread could not be started.
+ */
+int log_start_async(void);
+/* Writes out the records still queued and returns to logging in the caller */
+void log_stop_async(void);
+unsigned long log_dropped(void);
+
 void log_log(int level, const char *file, int line, const char *fmt, ...);
 
 #endif
@@ -18,6 +18,7 @@
 #include <string.h>
 
 #include "bits.h"
+#include "bitfield.h"
 
 /* extract a (zero-origin) bitfield from a buffer) as an
  * unsigned uint64_t
@@ -34,27 +35,15 @@
 uint64_t ubits(unsigned char buf[], unsigned int start,
                unsigned int width, bool le)
 {
-    uint64_t fld = 0;
+    uint64_t fld;
     unsigned int i;
-    unsigned end;
 
     assert(width <= sizeof(uint64_t) * CHAR_BIT);
     if (0 == width ||
         56 < width) {
         return 0;
     }
-    for (i = start / CHAR_BIT;
-         i < (start + width + CHAR_BIT - 1) / CHAR_BIT; i++) {
-        fld <<= CHAR_BIT;
-        fld |= (uint64_t)buf[i];
-    }
-
-    end = (start + width) % CHAR_BIT;
-    if (0 != end) {
-        fld >>= (CHAR_BIT - end);
-    }
-
-    fld &= ~(~0ULL << width);
+    fld = bitfield_get(buf, start, width);
 
     if (le) {
         // extraction as a little-endian requested
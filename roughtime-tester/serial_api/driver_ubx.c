@@ -22,6 +22,7 @@
 #include "gpsd_config.h" /* must be before all includes */
 
 #include <assert.h>
+#include <errno.h>
 #include <math.h>
 #include <stdbool.h>
 #include <stdio.h>
@@ -40,6 +41,8 @@
 
 #include "../others/log.h"
 
+#include "CraggyTrace.h"
+
 /*
  * Some high-precision messages provide data where the main part is a
  * signed 32-bit integer (same as the standard-precision versions),
@@ -682,13 +685,27 @@ ubx_msg_nav_status(struct gps_device_t *session, unsigned char *buf,
 /**
  * Navigation time to leap second: UBX-NAV-TIMELS
  *
- * Sets leap_notify if leap second is < 23 hours away.
+ * Keeps the GPS-UTC offset current across leap second events.
  * Not in u-blox 5
  */
 gps_mask_t
 ubx_msg_nav_timels(struct gps_device_t *session, unsigned char *buf,
                    size_t data_len)
 {
+    uint8_t valid; /* Validity Flags */
+
+    if (24 > data_len)
+    {
+        return 0;
+    }
+
+    session->iTOW = getleu32(buf, 0);
+    valid = getub(buf, 23);
+    // Valid current leap seconds, GPS-UTC, as gpsd_gpstime_resolv() subtracts
+    if (valid & 1)
+    {
+        session->gpsdata.leap_seconds = (int)getsb(buf, 9);
+    }
     return 0;
 }
 
@@ -1185,9 +1202,12 @@ ubx_msg_nav_sbas(struct gps_device_t *session, unsigned char *buf,
  * u-blox 9, message version 1
  */
 gps_mask_t ubx_msg_rxm_measx(struct gps_device_t *session,
-                             const unsigned char *buf,
+                             unsigned char *buf,
                              size_t data_len)
 {
+    (void) session;
+    (void) buf;
+    (void) data_len;
     return 0;
 }
 
@@ -1198,9 +1218,12 @@ gps_mask_t ubx_msg_rxm_measx(struct gps_device_t *session,
  * u-blox 9, message version 1
  */
 gps_mask_t ubx_msg_rxm_rawx(struct gps_device_t *session,
-                            const unsigned char *buf,
+                            unsigned char *buf,
                             size_t data_len)
 {
+    (void) session;
+    (void) buf;
+    (void) data_len;
     return 0;
 }
 
@@ -1330,6 +1353,10 @@ ubx_msg_tim_svin(struct gps_device_t *session, unsigned char *buf,
 
 /**
  * Time Pulse Timedata - UBX-TIM-TP
+ *
+ * Announces the time of the next time pulse, and how far off the true top
+ * of the second the receiver will put it.  Only pulses on a UTC time base
+ * are taken, with their week and time of week already counting leap seconds.
  */
 gps_mask_t
 ubx_msg_tim_tp(struct gps_device_t *session, unsigned char *buf,
@@ -1337,7 +1364,6 @@ ubx_msg_tim_tp(struct gps_device_t *session, unsigned char *buf,
 {
     timespec_t time = (timespec_t){0, 0};
     clock_gettime(CLOCK_REALTIME, &time);
-    // log_warn("TP @ : %ld - %ld", time.tv_sec, time.tv_nsec);
     session->gpsdata.currTime = time;
     gps_mask_t mask = ONLINE_SET;
     uint32_t towMS;
@@ -1348,11 +1374,6 @@ ubx_msg_tim_tp(struct gps_device_t *session, unsigned char *buf,
     uint8_t refInfo;
     timespec_t ts_tow;
 
-    // reliable cycle - empty all data
-    memset(&session->gpsdata.skyview, '\0', sizeof(&session->gpsdata.skyview));
-    memset(&session->gpsdata.raw, '\0', sizeof(&session->gpsdata.raw));
-    session->gpsdata.satellites_visible = 0;
-
     if (16 > data_len)
     {
         return 0;
@@ -1370,34 +1391,313 @@ ubx_msg_tim_tp(struct gps_device_t *session, unsigned char *buf,
     if (3 == (flags & 0x03) &&
         0 == towSubMS)
     {
-
-        // leap already added!?!?
-        int saved_leap = session->context->leap_seconds;
-        // remove it!
-        session->context->leap_seconds = 0;
-
         /* good, save qErr and qErr_time */
         MSTOTS(&ts_tow, towMS);
         session->gpsdata.tpTime = ts_tow;
-        // session->gpsdata.qErr_time = gpsd_gpstime_resolv(session, week, ts_tow);
-
-        // restore leap
+        session->gpsdata.qErr = qErr;
+        session->gpsdata.qErr_time.tv_sec = GPS_EPOCH + (time_t)week * SECS_PER_WEEK + ts_tow.tv_sec;
+        session->gpsdata.qErr_time.tv_nsec = ts_tow.tv_nsec;
+        mask |= TIMEPULSE_SET;
     }
 
-    // /* cast for 32 bit compatibility */
-    // log_debug("TIM-TP: towMS %lu, towSubMS %lu, qErr %ld week %u "
-    //           "flags %#x, refInfo %#x\n",
-    //           (unsigned long)towMS, (unsigned long)towSubMS, (long)qErr,
-    //           week, flags, refInfo);
+    log_trace("TIM-TP: towMS %lu, towSubMS %lu, qErr %ld week %u flags %#x, refInfo %#x",
+              (unsigned long)towMS, (unsigned long)towSubMS, (long)qErr,
+              week, flags, refInfo);
     return mask;
 }
 
+/*
+ * Handlers by message: one table per class, indexed by message id.
+ *
+ * Only what a handler is registered for can be enabled; the rest of the
+ * 256 entries of a class stay empty.
+ */
+typedef struct
+{
+    const char *name;
+    ubx_msg_handler_t handler;
+    /* Enabled by ubx_dispatch_init */
+    bool default_on;
+} ubx_msg_entry_t;
+
+#define UBX_MSG(msgid_, name_, handler_, default_on_) \
+    [(msgid_)&0xff] = {(name_), (handler_), (default_on_)}
+
+static const ubx_msg_entry_t ubx_msgs_esf[256] = {
+    UBX_MSG(UBX_ESF_ALG, "ESF-ALG", ubx_msg_esf_alg, false),
+    UBX_MSG(UBX_ESF_INS, "ESF-INS", ubx_msg_esf_ins, false),
+    UBX_MSG(UBX_ESF_MEAS, "ESF-MEAS", ubx_msg_esf_meas, false),
+    UBX_MSG(UBX_ESF_RAW, "ESF-RAW", ubx_msg_esf_raw, false),
+    UBX_MSG(UBX_ESF_STATUS, "ESF-STATUS", ubx_msg_esf_status, false),
+};
+
+static const ubx_msg_entry_t ubx_msgs_hnr[256] = {
+    UBX_MSG(UBX_HNR_ATT, "HNR-ATT", ubx_msg_hnr_att, false),
+    UBX_MSG(UBX_HNR_INS, "HNR-INS", ubx_msg_hnr_ins, false),
+    UBX_MSG(UBX_HNR_PVT, "HNR-PVT", ubx_msg_hnr_pvt, false),
+};
+
+static const ubx_msg_entry_t ubx_msgs_inf[256] = {
+    UBX_MSG(UBX_INF_DEBUG, "INF-DEBUG", ubx_msg_inf, false),
+    UBX_MSG(UBX_INF_ERROR, "INF-ERROR", ubx_msg_inf, false),
+    UBX_MSG(UBX_INF_NOTICE, "INF-NOTICE", ubx_msg_inf, false),
+    UBX_MSG(UBX_INF_TEST, "INF-TEST", ubx_msg_inf, false),
+    UBX_MSG(UBX_INF_USER, "INF-USER", ubx_msg_inf, false),
+    UBX_MSG(UBX_INF_WARNING, "INF-WARNING", ubx_msg_inf, false),
+};
+
+static const ubx_msg_entry_t ubx_msgs_log[256] = {
+    UBX_MSG(UBX_LOG_BATCH, "LOG-BATCH", ubx_msg_log_batch, false),
+    UBX_MSG(UBX_LOG_INFO, "LOG-INFO", ubx_msg_log_info, false),
+    UBX_MSG(UBX_LOG_RETRIEVEPOS, "LOG-RETRIEVEPOS", ubx_msg_log_retrievepos, false),
+    UBX_MSG(UBX_LOG_RETRIEVEPOSEXTRA, "LOG-RETRIEVEPOSEXTRA", ubx_msg_log_retrieveposextra, false),
+};
+
+static const ubx_msg_entry_t ubx_msgs_mon[256] = {
+    UBX_MSG(UBX_MON_RXBUF, "MON-RXBUF", ubx_msg_mon_rxbuf, false),
+    UBX_MSG(UBX_MON_TXBUF, "MON-TXBUF", ubx_msg_mon_txbuf, false),
+    UBX_MSG(UBX_MON_VER, "MON-VER", ubx_msg_mon_ver, false),
+};
+
+static const ubx_msg_entry_t ubx_msgs_nav[256] = {
+    UBX_MSG(UBX_NAV_CLOCK, "NAV-CLOCK", ubx_msg_nav_clock, false),
+    UBX_MSG(UBX_NAV_DGPS, "NAV-DGPS", ubx_msg_nav_dgps, false),
+    UBX_MSG(UBX_NAV_DOP, "NAV-DOP", ubx_msg_nav_dop, false),
+    UBX_MSG(UBX_NAV_EELL, "NAV-EELL", ubx_msg_nav_eell, false),
+    UBX_MSG(UBX_NAV_EOE, "NAV-EOE", ubx_msg_nav_eoe, false),
+    UBX_MSG(UBX_NAV_HPPOSECEF, "NAV-HPPOSECEF", ubx_msg_nav_hpposecef, false),
+    UBX_MSG(UBX_NAV_HPPOSLLH, "NAV-HPPOSLLH", ubx_msg_nav_hpposllh, false),
+    UBX_MSG(UBX_NAV_POSECEF, "NAV-POSECEF", ubx_msg_nav_posecef, false),
+    UBX_MSG(UBX_NAV_POSLLH, "NAV-POSLLH", ubx_msg_nav_posllh, false),
+    UBX_MSG(UBX_NAV_PVT, "NAV-PVT", ubx_msg_nav_pvt, true),
+    UBX_MSG(UBX_NAV_RELPOSNED, "NAV-RELPOSNED", ubx_msg_nav_relposned, false),
+    UBX_MSG(UBX_NAV_SAT, "NAV-SAT", ubx_msg_nav_sat, false),
+    UBX_MSG(UBX_NAV_SBAS, "NAV-SBAS", ubx_msg_nav_sbas, false),
+    /* UBX-NAV-SOL deprecated in u-blox 6, gone in u-blox 9 and 10, use UBX-NAV-PVT instead */
+    UBX_MSG(UBX_NAV_SOL, "NAV-SOL", ubx_msg_nav_sol, false),
+    UBX_MSG(UBX_NAV_STATUS, "NAV-STATUS", ubx_msg_nav_status, false),
+    /* UBX-NAV-SVINFO deprecated, use UBX-NAV-SAT instead */
+    UBX_MSG(UBX_NAV_SVINFO, "NAV-SVINFO", ubx_msg_nav_svinfo, false),
+    UBX_MSG(UBX_NAV_TIMEGAL, "NAV-TIMEGAL", ubx_msg_nav_timegal, false),
+    UBX_MSG(UBX_NAV_TIMEGPS, "NAV-TIMEGPS", ubx_msg_nav_timegps, true),
+    UBX_MSG(UBX_NAV_TIMELS, "NAV-TIMELS", ubx_msg_nav_timels, false),
+    UBX_MSG(UBX_NAV_TIMEUTC, "NAV-TIMEUTC", ubx_msg_nav_timeutc, false),
+    UBX_MSG(UBX_NAV_VELECEF, "NAV-VELECEF", ubx_msg_nav_velecef, false),
+    UBX_MSG(UBX_NAV_VELNED, "NAV-VELNED", ubx_msg_nav_velned, false),
+};
+
+static const ubx_msg_entry_t ubx_msgs_rxm[256] = {
+    UBX_MSG(UBX_RXM_MEASX, "RXM-MEASX", ubx_msg_rxm_measx, false),
+    UBX_MSG(UBX_RXM_RAWX, "RXM-RAWX", ubx_msg_rxm_rawx, false),
+    UBX_MSG(UBX_RXM_SFRB, "RXM-SFRB", ubx_msg_rxm_sfrb, false),
+    UBX_MSG(UBX_RXM_SFRBX, "RXM-SFRBX", ubx_msg_rxm_sfrbx, false),
+    UBX_MSG(UBX_RXM_SVSI, "RXM-SVSI", ubx_msg_rxm_svsi, false),
+};
+
+static const ubx_msg_entry_t ubx_msgs_tim[256] = {
+    UBX_MSG(UBX_TIM_SVIN, "TIM-SVIN", ubx_msg_tim_svin, false),
+    UBX_MSG(UBX_TIM_TP, "TIM-TP", ubx_msg_tim_tp, true),
+};
+
+static const ubx_msg_entry_t *const ubx_msg_classes[256] = {
+    [UBX_CLASS_ESF] = ubx_msgs_esf,
+    [UBX_CLASS_HNR] = ubx_msgs_hnr,
+    [UBX_CLASS_INF] = ubx_msgs_inf,
+    [UBX_CLASS_LOG] = ubx_msgs_log,
+    [UBX_CLASS_MON] = ubx_msgs_mon,
+    [UBX_CLASS_NAV] = ubx_msgs_nav,
+    [UBX_CLASS_RXM] = ubx_msgs_rxm,
+    [UBX_CLASS_TIM] = ubx_msgs_tim,
+};
+
+/*
+ * One bit per class/id: messages not enabled are dropped on this test alone.
+ * Written only while the serial thread is not parsing.
+ */
+static uint32_t ubx_msg_enabled[65536 / 32];
+
+static bool ubx_msg_is_enabled(unsigned short msgid)
+{
+    return (ubx_msg_enabled[msgid >> 5] >> (msgid & 31)) & 1;
+}
+
+static const ubx_msg_entry_t *ubx_msg_lookup(unsigned short msgid)
+{
+    const ubx_msg_entry_t *class_msgs = ubx_msg_classes[msgid >> 8];
+    if (class_msgs == NULL || class_msgs[msgid & 0xff].handler == NULL)
+    {
+        return NULL;
+    }
+    return &class_msgs[msgid & 0xff];
+}
+
+void ubx_dispatch_init(void)
+{
+    memset(ubx_msg_enabled, 0, sizeof(ubx_msg_enabled));
+    for (unsigned int msgid = 0; msgid < 65536; msgid++)
+    {
+        const ubx_msg_entry_t *entry = ubx_msg_lookup((unsigned short)msgid);
+        if (entry != NULL && entry->default_on)
+        {
+            ubx_msg_enabled[msgid >> 5] |= 1u << (msgid & 31);
+        }
+    }
+}
+
+bool ubx_enable_message(const char *name, bool enable)
+{
+    for (unsigned int msgid = 0; msgid < 65536; msgid++)
+    {
+        const ubx_msg_entry_t *entry = ubx_msg_lookup((unsigned short)msgid);
+        if (entry == NULL || strcmp(entry->name, name) != 0)
+        {
+            continue;
+        }
+        if (enable)
+        {
+            ubx_msg_enabled[msgid >> 5] |= 1u << (msgid & 31);
+        }
+        else
+        {
+            ubx_msg_enabled[msgid >> 5] &= ~(1u << (msgid & 31));
+        }
+        return true;
+    }
+    return false;
+}
+
+bool ubx_configure_messages(const char *list)
+{
+    char name[32];
+
+    while (*list != '\0')
+    {
+        size_t len = strcspn(list, ",");
+        const char *item = list;
+        bool enable = true;
+
+        list += len;
+        if (*list == ',')
+        {
+            list++;
+        }
+        if (len > 0 && (*item == '-' || *item == '+'))
+        {
+            enable = *item == '+';
+            item++;
+            len--;
+        }
+        if (len == 0)
+        {
+            continue;
+        }
+        if (len >= sizeof(name))
+        {
+            log_error("Unknown UBX message %.*s", (int)len, item);
+            return false;
+        }
+        memcpy(name, item, len);
+        name[len] = '\0';
+        if (!ubx_enable_message(name, enable))
+        {
+            log_error("Unknown UBX message %s", name);
+            return false;
+        }
+        log_info("UBX-%s %s", name, enable ? "enabled" : "disabled");
+    }
+    return true;
+}
+
+bool ubx_send(int fd, unsigned short msgid, const unsigned char *payload,
+               size_t len)
+{
+    unsigned char frame[UBX_PREFIX_LEN + 64 + 2];
+    unsigned char ck_a = 0, ck_b = 0;
+    size_t frame_len = UBX_PREFIX_LEN + len + 2;
+
+    if (len > 64)
+    {
+        return false;
+    }
+    frame[0] = 0xb5;
+    frame[1] = 0x62;
+    frame[UBX_CLASS_OFFSET] = (unsigned char)(msgid >> 8);
+    frame[UBX_TYPE_OFFSET] = (unsigned char)(msgid & 0xff);
+    putle16(frame, 4, len);
+    if (len > 0)
+    {
+        memcpy(&frame[UBX_PREFIX_LEN], payload, len);
+    }
+    // 8-bit Fletcher over class, id, length and payload
+    for (size_t i = UBX_CLASS_OFFSET; i < UBX_PREFIX_LEN + len; i++)
+    {
+        ck_a += frame[i];
+        ck_b += ck_a;
+    }
+    frame[UBX_PREFIX_LEN + len] = ck_a;
+    frame[UBX_PREFIX_LEN + len + 1] = ck_b;
+
+    for (size_t written = 0; written < frame_len;)
+    {
+        ssize_t ret = write(fd, &frame[written], frame_len - written);
+        if (ret < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            log_error("Could not send UBX %02x %02x: %s", msgid >> 8,
+                      msgid & 0xff, strerror(errno));
+            return false;
+        }
+        written += (size_t)ret;
+    }
+    return true;
+}
+
+bool ubx_configure_port(int fd, unsigned int baud)
+{
+    unsigned char payload[UBX_CFG_LEN];
+
+    // UBX-CFG-PRT for UART1: 8N1 at the rate given, anything in, only UBX out
+    memset(payload, 0, sizeof(payload));
+    payload[0] = USART1_ID;
+    putle32(payload, 4, 0x000008d0);
+    putle32(payload, 8, baud);
+    putle16(payload, 12, UBX_PROTOCOL_MASK | NMEA_PROTOCOL_MASK |
+                             RTCM_PROTOCOL_MASK);
+    putle16(payload, 14, UBX_PROTOCOL_MASK);
+    return ubx_send(fd, UBX_CFG_PRT, payload, sizeof(payload));
+}
+
+bool ubx_configure_rates(int fd)
+{
+    unsigned char payload[3];
+
+    for (unsigned int msgid = 0; msgid < 65536; msgid++)
+    {
+        if (ubx_msg_lookup((unsigned short)msgid) == NULL)
+        {
+            continue;
+        }
+        // UBX-CFG-MSG for the port the message arrives on: every solution if decoded, never otherwise
+        payload[0] = (unsigned char)(msgid >> 8);
+        payload[1] = (unsigned char)(msgid & 0xff);
+        payload[2] = ubx_msg_is_enabled((unsigned short)msgid) ? 1 : 0;
+        if (!ubx_send(fd, UBX_CFG_MSG, payload, sizeof(payload)))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
 gps_mask_t ubx_parse(struct gps_device_t *session, unsigned char *buf,
                      size_t len)
 {
     size_t data_len;
     unsigned short msgid;
-    gps_mask_t mask = 0;
+    const ubx_msg_entry_t *entry;
 
     // the packet at least contains a head long enough for an empty message
     if (UBX_PREFIX_LEN > len)
@@ -1405,138 +1705,21 @@ gps_mask_t ubx_parse(struct gps_device_t *session, unsigned char *buf,
         return 0;
     }
 
-    // session->cycle_end_reliable = true;
-    session->iTOW = -1; // set by decoder
-
-    // extract message id and length
-    msgid = (buf[2] << 8) | buf[3];
+    // extract message id, and drop the message unless it is wanted
+    msgid = (buf[UBX_CLASS_OFFSET] << 8) | buf[UBX_TYPE_OFFSET];
+    if (!ubx_msg_is_enabled(msgid))
+    {
+        return 0;
+    }
+    entry = ubx_msg_lookup(msgid);
     data_len = (size_t)getleu16(buf, 4);
 
-    switch (msgid)
-    {
-    case UBX_ACK_ACK:
-        if (2 <= data_len)
-        {
-        }
-        break;
-    case UBX_ACK_NAK:
-        if (2 <= data_len)
-        {
-        }
-        break;
-    case UBX_NAV_CLOCK:
-        log_debug("UBX-NAV-CLOCK");
-        // mask = ubx_msg_nav_clock(session, &buf[UBX_PREFIX_LEN], data_len);
-    case UBX_NAV_DOP:
-        log_debug("UBX-NAV_DOP");
-        // DOP seems to be the last NAV sent in a cycle, unless NAV-EOE
-        // mask = ubx_msg_nav_dop(session, &buf[UBX_PREFIX_LEN], data_len);
-        break;
-    case UBX_NAV_PVT:
-        log_debug("UBX-NAV-PVT");
-        mask = ubx_msg_nav_pvt(session, &buf[UBX_PREFIX_LEN], data_len);
-        break;
-    case UBX_NAV_RELPOSNED:
-        log_debug("UBX-NAV-RELPOSNED");
-        // mask = ubx_msg_nav_relposned(session, &buf[UBX_PREFIX_LEN], data_len);
-        break;
-    case UBX_NAV_RESETODO:
-        log_debug("UBX-NAV-RESETODO");
-        break;
-    case UBX_NAV_SAT:
-        log_debug("UBX-NAV-SAT");
-       //mask = ubx_msg_nav_sat(session, &buf[UBX_PREFIX_LEN], data_len);
-        break;
-    case UBX_NAV_SBAS:
-        log_debug("UBX-NAV-SBAS");
-        // mask = ubx_msg_nav_sbas(session, &buf[UBX_PREFIX_LEN], data_len);
-        break;
-    case UBX_NAV_SIG:
-        log_debug("UBX-NAV-SIG");
-        break;
-    case UBX_NAV_SOL:
-        /* UBX-NAV-SOL deprecated in u-blox 6, gone in u-blox 9 and 10.
-         * Use UBX-NAV-PVT instead */
-        log_debug("UBX-NAV-SOL");
-        // mask = ubx_msg_nav_sol(session, &buf[UBX_PREFIX_LEN], data_len);
-        break;
-    case UBX_NAV_STATUS:
-        log_debug("UBX-RXM-STATUS");
-        // mask = ubx_msg_nav_status(session, &buf[UBX_PREFIX_LEN], data_len);
-        break;
-    case UBX_NAV_SVIN:
-        log_debug("UBX-RXM-SVIN");
-        // mask = ubx_msg_tim_svin(session, &buf[UBX_PREFIX_LEN], data_len);
-        break;
-    case UBX_NAV_SVINFO:
-        // UBX-NAV-SVINFO deprecated, use UBX-NAV-SAT instead
-        log_debug("UBX-NAV-SVINFO");
-        // mask = ubx_msg_nav_svinfo(session, &buf[UBX_PREFIX_LEN], data_len);
-        break;
-    case UBX_NAV_TIMEBDS:
-        log_debug("UBX-NAV-TIMEBDS");
-        break;
-    case UBX_NAV_TIMEGAL:
-        // mask = ubx_msg_nav_timegal(session, &buf[UBX_PREFIX_LEN], data_len);
-        log_debug("UBX-NAV-TIMEGAL");
-        break;
-    case UBX_NAV_TIMEGLO:
-        log_debug("UBX-NAV-TIMEGLO");
-        break;
-    case UBX_NAV_TIMEGPS:
-        log_info("UBX-NAV-TIMEGPS");
-        mask = ubx_msg_nav_timegps(session, &buf[UBX_PREFIX_LEN], data_len);
-        break;
-    case UBX_NAV_TIMELS:
-        // mask = ubx_msg_nav_timels(session, &buf[UBX_PREFIX_LEN], data_len);
-        break;
-    case UBX_NAV_TIMEQZSS:
-        log_debug("UBX-NAV-TIMEQZSS");
-        break;
-    case UBX_NAV_TIMEUTC:
-        //mask = ubx_msg_nav_timeutc(session, &buf[UBX_PREFIX_LEN], data_len);
-        break;
-    case UBX_RXM_ALM:
-        log_debug("UBX-RXM-ALM");
-        break;
-    case UBX_RXM_EPH:
-        log_debug("UBX-RXM-EPH");
-        break;
-    case UBX_RXM_MEASX:
-        log_debug("UBX-RXM-MEASX");
-        //mask = ubx_msg_rxm_measx(session, &buf[UBX_PREFIX_LEN], data_len);
-        break;
-    case UBX_RXM_RAWX:
-        log_debug("UBX-RXM-RAWX");
-        //mask = ubx_msg_rxm_rawx(session, &buf[UBX_PREFIX_LEN], data_len);
-        break;
-    case UBX_RXM_SFRB:
-        log_debug("UBX-RXM-SFRB");
-        //mask = ubx_msg_rxm_sfrb(session, &buf[UBX_PREFIX_LEN], data_len);
-        break;
-    case UBX_RXM_SFRBX:
-        log_debug("UBX-RXM-SFRBX");
-        //mask = ubx_msg_rxm_sfrbx(session, &buf[UBX_PREFIX_LEN], data_len);
-        break;
-    case UBX_TIM_DOSC:
-        log_debug("UBX-TIM-DOSC");
-        break;
-    case UBX_TIM_SMEAS:
-        log_debug("UBX-TIM-SMEAS");
-        break;
-    case UBX_TIM_TM:
-        log_debug("UBX-TIM-TM");
-        break;
-    case UBX_TIM_TP:
-        log_debug("UBX-TIM-TP");
-        mask = ubx_msg_tim_tp(session, &buf[UBX_PREFIX_LEN], data_len);
-        break;
-    case UBX_TIM_TOS:
-        log_debug("UBX-TIM-TOS");
-        break;
+    // session->cycle_end_reliable = true;
+    session->iTOW = -1; // set by decoder
 
-    default:
-        log_debug("No clue what happened - unkn packet");
-    }
-    return mask | ONLINE_SET;
+    log_trace("UBX-%s", entry->name);
+    CRAGGY_PROBE2(ubx_parse__start, msgid, data_len);
+    gps_mask_t mask = entry->handler(session, &buf[UBX_PREFIX_LEN], data_len) | ONLINE_SET;
+    CRAGGY_PROBE2(ubx_parse__done, msgid, mask);
+    return mask;
 }
@@ -284,6 +284,56 @@ typedef enum
 #define POW2_M27 7.450580596923828e-009
 #define POW2_M24 5.960464477539063e-008
 
+/*
+ * Decoder of one UBX message payload, returning what it set
+ */
+typedef gps_mask_t (*ubx_msg_handler_t)(struct gps_device_t *session,
+                                        unsigned char *buf, size_t data_len);
+
+/*
+ * Enables the messages handled by default - NAV-PVT, NAV-TIMEGPS and TIM-TP -
+ * and disables all others. Call before the first ubx_parse.
+ */
+void ubx_dispatch_init(void);
+
+/*
+ * Enables or disables a message by name, such as "NAV-SAT". Returns false if
+ * no handler is registered for it. Not to be called while ubx_parse runs.
+ */
+bool ubx_enable_message(const char *name, bool enable);
+
+/*
+ * Applies a comma separated list of message names, each enabled unless
+ * prefixed by '-': "NAV-SAT,RXM-RAWX,-NAV-PVT". Returns false on the first
+ * unknown name.
+ */
+bool ubx_configure_messages(const char *list);
+
+/*
+ * Frames a payload of up to 64 bytes as a UBX message and writes it to the
+ * receiver. Returns false if the write failed.
+ */
+bool ubx_send(int fd, unsigned short msgid, const unsigned char *payload,
+               size_t len);
+
+/*
+ * Sends UBX-CFG-PRT switching UART1 to the baud rate given, sending only UBX.
+ * The receiver answers at the old rate and switches after; the port has to
+ * follow.
+ */
+bool ubx_configure_port(int fd, unsigned int baud);
+
+/*
+ * Sends UBX-CFG-MSG for every message with a handler, turning on the enabled
+ * ones once per solution and turning off all others, so that only what is
+ * decoded takes up the line.
+ */
+bool ubx_configure_rates(int fd);
+
+/*
+ * Decodes a whole frame, sync word to checksum, with the handler registered
+ * for its class and id. Messages not enabled return 0 without being looked at.
+ */
 gps_mask_t ubx_parse(struct gps_device_t *session, unsigned char *buf,
                      size_t len);
 gps_mask_t ubx_msg_log_batch(struct gps_device_t *session,
@@ -2763,8 +2763,9 @@ struct gps_data_t {
 #define GPSTIME_SET     (1llu<<46)
 #define MEASX_SET       (1llu<<47)
 #define REPORT_SET      (1llu<<48)
+#define TIMEPULSE_SET   (1llu<<49)      /* qErr and qErr_time of the next pulse */
 
-#define SET_HIGH_BIT    49
+#define SET_HIGH_BIT    50
     timespec_t online;          /* NZ if GPS is on line, 0 if not.
                                  *
                                  * Note: gpsd clears this time when sentences
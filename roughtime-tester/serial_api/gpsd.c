@@ -196,7 +196,8 @@ unsigned int isgps_parity(isgps30bits_t th)
 
 const char *gps_maskdump(gps_mask_t set)
 {
-    static char buf[242];
+    // Each receiver's serial thread dumps the masks of its own parses
+    static _Thread_local char buf[242];
     const struct {
         gps_mask_t      mask;
         const char      *name;
@@ -246,6 +247,7 @@ const char *gps_maskdump(gps_mask_t set)
         {IMU_SET,	"IMU"},
         {CLOCK_SET,	"CLOCK"},
         {GALTIME_SET,	"GALTIME"},
+        {TIMEPULSE_SET,	"TIMEPULSE"},
         {RAW_IS,	"RAW"},
         {USED_IS,	"USED"},
         {DRIVER_IS,	"DRIVER"},
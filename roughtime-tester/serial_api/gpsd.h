@@ -191,6 +191,13 @@ extern "C"
  */
 #define MAX_PACKET_LENGTH 9216 /* 4 + 16 + (256 * 32) + 2 + fudge */
 
+/*
+ * GPS and QZSS subframes remembered by satellite, 32 of each, and by
+ * page: subframes 1 to 3, then 4 and 5 by their page SV ID.
+ */
+#define SUBFRAME_SEEN_SATS 64
+#define SUBFRAME_SEEN_PAGES (3 + 64)
+
 /*
  * UTC of second 0 of week 0 of the first rollover period of GPS time.
  * Used to compute UTC from GPS time. Also, the threshold value
@@ -613,6 +620,8 @@ extern "C"
         int fixcnt;               /* count of fixes from this device */
         int last_word_gal;        // last subframe word from Galileo
         int last_svid3_gal;       // last SVID3 from Galileo
+        // fingerprints of the subframes last decoded, zero if none
+        uint64_t subframe_seen[SUBFRAME_SEEN_SATS][SUBFRAME_SEEN_PAGES];
         struct gps_fix_t newdata; /* where drivers put their data */
         struct gps_fix_t lastfix; /* not quite yet ready for oldfix */
         struct gps_fix_t oldfix;  /* previous fix for error modeling */
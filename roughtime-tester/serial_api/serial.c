@@ -6,9 +6,11 @@
  *
  * PUBLIC FUNCTIONS :
  *       void *gps_serial_thread_ep(void *arg)
+ *       bool gps_wait_for_fix(simulator_t *simulator, gps_fix_t *fixes, int timeout_ms)
+ *       unsigned long gps_read_snapshot(simulator_t *simulator, int receiver_index, gps_mask_t sections, gps_snapshot_t *snapshot)
  *
  * NOTES :
- *       This function handles the serial port thread.
+ *       This function handles the serial port thread, one per receiver.
  *       This handles the data incoming from a reference receiver
  *       Requires UBLOX receiver (M8T, F9P or above)
  *       Requires NAV-PVT, RXM-MEASX, RXM-RAWX, TIM-TP messages
@@ -33,33 +35,34 @@
 
 #include <unistd.h>
 #include <sys/stat.h>
-#include <sys/ioctl.h>
+#include <poll.h>
 
 #include <sys/time.h>
 
 #include "serial-driver.h"
 #include "driver_ubx.h"
+#include "ubx_framer.h"
 #include "gpsd.h"
 
 #include <signal.h>
 #include "../others/log.h"
 #include "../gps-sim.h"
 #include "serial.h"
+
+#include "CraggyTrace.h"
 #include "../others/log.h"
+#include "CraggyClock.h"
 
 /*
  * Define how many full cycles we want to wait untill we are pretty sure the GPS data we have is decent
  */
 
 #define BACKOFF 6
+
 /*
- * Which serial port to connect to
- * TODO: move this to a config file so we don't have to recompile all the time
+ * How long the serial thread waits for data before checking whether it should exit
  */
-serial_port_t serial_port;
-
-uint8_t ret = 0;
-
+#define SERIAL_POLL_TIMEOUT_MS 200
 /*
  * Holds all the svIDs (It is not used actually)
  * TODO: remove
@@ -82,37 +85,186 @@ void print_hex(unsigned char *s, int len)
 }
 
 /*!
- * Thread main function
+ * Copies the sections specified from the receiver state
  */
+static void snapshot_from_device(gps_snapshot_t *snapshot, const struct gps_device_t *device, gps_mask_t sections)
+{
+    const struct gps_data_t *data = &device->gpsdata;
 
-void *gps_serial_thread_ep(void *arg)
+    if (sections & GPS_SNAPSHOT_FIX)
+    {
+        snapshot->fix = data->fix;
+        snapshot->leap_seconds = data->leap_seconds;
+    }
+    if (sections & DOP_SET)
+    {
+        snapshot->dop = data->dop;
+    }
+    if (sections & ONLINE_SET)
+    {
+        snapshot->curr_time = data->currTime;
+        snapshot->tp_time = data->tpTime;
+    }
+    if (sections & SATELLITE_SET)
+    {
+        snapshot->skyview_time = data->skyview_time;
+        snapshot->satellites_used = data->satellites_used;
+        snapshot->satellites_visible = data->satellites_visible;
+        memcpy(snapshot->skyview, data->skyview, sizeof(snapshot->skyview));
+    }
+    if (sections & (RAW_SET | MEASX_SET))
+    {
+        snapshot->raw = data->raw;
+    }
+    if (sections & SUBFRAME_SET)
+    {
+        snapshot->subframe = data->subframe;
+    }
+}
+
+/*!
+ * Copies the sections specified from one snapshot to another
+ */
+static void snapshot_copy(gps_snapshot_t *to, const gps_snapshot_t *from, gps_mask_t sections)
 {
-    log_set_level(LOG_INFO);
-    bool run = true;
+    if (sections & GPS_SNAPSHOT_FIX)
+    {
+        to->fix = from->fix;
+        to->leap_seconds = from->leap_seconds;
+    }
+    if (sections & DOP_SET)
+    {
+        to->dop = from->dop;
+    }
+    if (sections & ONLINE_SET)
+    {
+        to->curr_time = from->curr_time;
+        to->tp_time = from->tp_time;
+    }
+    if (sections & SATELLITE_SET)
+    {
+        to->skyview_time = from->skyview_time;
+        to->satellites_used = from->satellites_used;
+        to->satellites_visible = from->satellites_visible;
+        memcpy(to->skyview, from->skyview, sizeof(to->skyview));
+    }
+    if (sections & (RAW_SET | MEASX_SET))
+    {
+        to->raw = from->raw;
+    }
+    if (sections & SUBFRAME_SET)
+    {
+        to->subframe = from->subframe;
+    }
+    to->set = from->set & sections;
+}
+
+/*!
+ * Publishes the sections a parse changed. The back snapshot - which no reader looks at - is brought up to date
+ * with this change and with the one it missed while it was at the front, then swapped in
+ */
+static void publish_update(gps_receiver_t *receiver, const struct gps_device_t *device, gps_mask_t mask, uint64_t rx_us)
+{
+    simulator_t *simulator = receiver->simulator;
 
-    // Main simulator object
-    simulator_t *simulator = (simulator_t *)(arg);
+    mask &= GPS_SNAPSHOT_ALL;
+    if (mask == 0)
+    {
+        return;
+    }
 
-    /*!
-     * Open serial port -> configs are in the serial port driver
-     * TODO: move into configuration file externally or at least in the header file
-     * Possibly we should get these from the main thread object, by creating the serial object there
-     *  */
-    ret = serial_port_init_port(simulator->port_name, &serial_port);
-    ret = serial_port_open_port(&serial_port);
+    int front = receiver->gps_snapshot_front;
+    int back = 1 - front;
+    snapshot_from_device(&receiver->gps_snapshot[back], device, mask | receiver->gps_snapshot_back_stale);
+    receiver->gps_snapshot[back].set = receiver->gps_snapshot[front].set | mask;
 
-    /*!
-     * Bunch of different params used for reading packets
-     * avb: data we get avb at the serial port
-     * multi_fragment_offset: position in the frame for packets that are made of multiple fragments
-     */
-    size_t avb = 0;
-    size_t multi_fragment_offset = 0;
-    size_t packet_len = 0;
-    size_t expected_len = 0;
+    pthread_mutex_lock(&simulator->gps_fix_lock);
+    receiver->gps_snapshot_front = back;
+    receiver->gps_snapshot_version++;
+    if (mask & GPSTIME_SET)
+    {
+        receiver->gps_fix_generation++;
+        receiver->gps_fix_monotonic_us = rx_us;
+        pthread_cond_broadcast(&simulator->gps_fix_ready);
+        CRAGGY_PROBE2(fix__publish, receiver->gps_fix_generation, rx_us);
+    }
+    pthread_mutex_unlock(&simulator->gps_fix_lock);
+
+    // The old front, now at the back, lacks exactly this change
+    receiver->gps_snapshot_back_stale = mask;
+}
+
+unsigned long gps_read_snapshot(simulator_t *simulator, int receiver_index, gps_mask_t sections, gps_snapshot_t *snapshot)
+{
+    gps_receiver_t *receiver = &simulator->receivers[receiver_index];
+
+    pthread_mutex_lock(&simulator->gps_fix_lock);
+    snapshot_copy(snapshot, &receiver->gps_snapshot[receiver->gps_snapshot_front], sections);
+    unsigned long version = receiver->gps_snapshot_version;
+    pthread_mutex_unlock(&simulator->gps_fix_lock);
+    return version;
+}
+
+/*!
+ * Takes the fixes of the receivers newer than the ones taken last, under gps_fix_lock
+ */
+static bool take_fixes(simulator_t *simulator, gps_fix_t *fixes)
+{
+    bool fresh = false;
+    for (int i = 0; i < simulator->num_receivers; i++)
+    {
+        const gps_receiver_t *receiver = &simulator->receivers[i];
+        fixes[i].fresh = receiver->gps_fix_generation != fixes[i].generation;
+        if (fixes[i].fresh)
+        {
+            fixes[i].generation = receiver->gps_fix_generation;
+            fixes[i].time = receiver->gps_snapshot[receiver->gps_snapshot_front].fix.time;
+            fixes[i].monotonic_us = receiver->gps_fix_monotonic_us;
+            fresh = true;
+        }
+    }
+    return fresh;
+}
+
+bool gps_wait_for_fix(simulator_t *simulator, gps_fix_t *fixes, int timeout_ms)
+{
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+    if (deadline.tv_nsec >= NSEC_PER_SEC)
+    {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= NSEC_PER_SEC;
+    }
+
+    bool fresh;
+    int wait = 0;
+    CRAGGY_PROBE(fix__wait);
+    pthread_mutex_lock(&simulator->gps_fix_lock);
+    while (!(fresh = take_fixes(simulator, fixes)) && wait != ETIMEDOUT)
+    {
+        wait = pthread_cond_timedwait(&simulator->gps_fix_ready, &simulator->gps_fix_lock, &deadline);
+    }
+    pthread_mutex_unlock(&simulator->gps_fix_lock);
+    CRAGGY_PROBE1(fix__take, fresh);
+    return fresh;
+}
+
+/*!
+ * Decode thread: parses the frames the serial thread queued and publishes what they changed
+ */
+static void *gps_decode_thread_ep(void *arg)
+{
+    log_set_level(LOG_INFO);
+
+    gps_receiver_t *receiver = (gps_receiver_t *)(arg);
+    simulator_t *simulator = receiver->simulator;
+
+    char thread_name[16];
+    snprintf(thread_name, sizeof(thread_name), "gps-decode-%d", receiver->index);
+    rt_thread_set_name(thread_name);
 
-    timespec_t actual_time = (timespec_t){0, 0};
-    timespec_t rx_time = (timespec_t){0, 0};
     timespec_t rx_time_start = (timespec_t){0, 0};
     timespec_t rx_time_stop = (timespec_t){0, 0};
     timespec_t rx_time_delta = (timespec_t){0, 0};
@@ -121,96 +273,187 @@ void *gps_serial_thread_ep(void *arg)
     struct gps_device_t device;
     gps_mask_t mask = 0;
 
-    // PPS structures
-    int num;
-    int avail_mode;
-    int i = 0;
-    int ret;
-
     memset(&device, 0, sizeof(struct gps_device_t));
     gpsd_zero_satellites(&device.gpsdata);
     gpsd_zero_raw(&device.gpsdata);
 
-    unsigned char msg_buf[1024];
-    unsigned char rx_buf[1024];
-    memset(msg_buf, 0, 1024);
-    memset(rx_buf, 0, 1024);
-    bool sent_once = false;
-    bool sent_raw = false;
-    bool sent_skyview = false;
+    unsigned char *frame;
+    size_t frame_len;
+    uint64_t rx_us;
+    // Frames still queued when told to exit are decoded, so a recording holds all that was read
+    while (frame_queue_wait(&receiver->frames, SERIAL_POLL_TIMEOUT_MS) || receiver->gps_serial_thread_exit == false)
+    {
+        while (frame_queue_peek(&receiver->frames, &frame, &frame_len, &rx_us))
+        {
+            clock_gettime(CLOCK_REALTIME, &rx_time_start);
+            log_trace("[%d] MSG FULL Len: %zu %02x%02x", device.gpsdata.subframe.subframe_num, frame_len, frame[2], frame[3]);
+            if (simulator->recording != NULL)
+            {
+                capture_write(simulator->recording, CAPTURE_UBX_FRAME, receiver->index, rx_us, frame, frame_len);
+            }
+            mask = ubx_parse(&device, frame, frame_len);
+            frame_queue_pop(&receiver->frames);
+            log_debug("Mask: %s", gps_maskdump(mask));
+
+            clock_gettime(CLOCK_REALTIME, &rx_time_stop);
+            timespec_sub(&rx_time_delta, &rx_time_stop, &rx_time_start);
+            timespec_add(&rx_time_total, &rx_time_total, &rx_time_delta);
+
+            // Only what the message changed is handed over, rather than the whole device
+            publish_update(receiver, &device, mask, rx_us);
+            if (mask & TIMEPULSE_SET)
+            {
+                time_tagger_announce(&receiver->time_tagger, rx_us * 1000,
+                                     (uint64_t)device.gpsdata.qErr_time.tv_sec * NSEC_PER_SEC + device.gpsdata.qErr_time.tv_nsec,
+                                     (int32_t)device.gpsdata.qErr);
+            }
+            if (GPSTIME_SET == (mask & GPSTIME_SET))
+            {
+                log_info("RX Time: %lf", rx_time_total.tv_sec + rx_time_total.tv_nsec * 1e-9);
+            }
+        }
+    }
+    return NULL;
+}
+
+/*!
+ * Switches the receiver to its baud rate and turns off the messages not decoded. The port
+ * configuration is sent at the rate the port was opened at and again at the new one, so that a
+ * receiver left at the new rate by an earlier run is configured too.
+ */
+static void gps_configure_receiver(gps_receiver_t *receiver)
+{
+    int fd = receiver->serial_port.port_descriptor;
+
+    ubx_configure_port(fd, receiver->baud);
+    tcdrain(fd);
+    // The receiver acknowledges at the old rate before switching
+    usleep(100000);
+    if (set_interface_attribs(fd, serial_baud_to_speed(receiver->baud), 0) != 0)
+    {
+        log_error("Could not switch %s to %u baud", receiver->port_name, receiver->baud);
+        return;
+    }
+    receiver->serial_port.speed = serial_baud_to_speed(receiver->baud);
+    if (!ubx_configure_port(fd, receiver->baud) || !ubx_configure_rates(fd))
+    {
+        log_error("Could not configure the messages of %s", receiver->port_name);
+        return;
+    }
+    tcdrain(fd);
+    log_info("Receiver %d at %u baud, sending only the messages decoded", receiver->index, receiver->baud);
+}
+
+/*!
+ * Thread main function
+ */
+
+void *gps_serial_thread_ep(void *arg)
+{
+    log_set_level(LOG_INFO);
+
+    // Each receiver is read by a thread of its own, holding all it works on
+    gps_receiver_t *receiver = (gps_receiver_t *)(arg);
+
+    char thread_name[16];
+    snprintf(thread_name, sizeof(thread_name), "gps-serial-%d", receiver->index);
+    // Pinned and ahead of the other threads, frames are read and stamped without waiting for a core another thread holds
+    int rt_result = rt_thread_setup(&receiver->rt, thread_name);
+    if (rt_result != 0)
+    {
+        log_warn("Could not set up the thread of receiver %d (core %d, priority %d): %s", receiver->index,
+                 receiver->rt.core, receiver->rt.priority, strerror(rt_result));
+    }
 
-    int count_raw = 0;
-    int count_measx = 0;
+    /*!
+     * Open serial port -> configs are in the serial port driver
+     *  */
+    serial_port_init_port(receiver->port_name, &receiver->serial_port);
+    serial_port_open_port(&receiver->serial_port);
+    if (receiver->baud != 0 && receiver->serial_port.is_open)
+    {
+        gps_configure_receiver(receiver);
+    }
 
-    // initialize things for the packet parser
+    bool decoding = false;
 
-    // setup the 1pps source
-    struct timespec timeout = {2, 0};
+    /*!
+     * Frames are reassembled in a ring buffer: reads end anywhere, mid frame or after several frames
+     */
+    ubx_framer_t *framer = malloc(sizeof(ubx_framer_t));
+    if (framer == NULL)
+    {
+        log_error("Could not allocate the UBX framer");
+        goto end_gps_thread;
+    }
+    ubx_framer_init(framer);
+
+    // The decode thread runs at the default policy and wherever the scheduler puts it: it must not hold up reads
+    if (!frame_queue_init(&receiver->frames))
+    {
+        log_error("Could not allocate the frame queue of receiver %d", receiver->index);
+        goto end_gps_thread;
+    }
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&attr, SCHED_OTHER);
+    decoding = pthread_create(&receiver->gps_decode_thread, &attr, gps_decode_thread_ep, receiver) == 0;
+    pthread_attr_destroy(&attr);
+    if (!decoding)
+    {
+        log_error("Could not start the decode thread of receiver %d", receiver->index);
+        goto end_gps_thread;
+    }
 
-    int count = 0;
+    struct pollfd serial_poll = {receiver->serial_port.port_descriptor, POLLIN, 0};
 
     do
     {
-        if (simulator->gps_serial_thread_running == false)
+        if (receiver->gps_serial_thread_running == false)
         {
-            simulator->gps_serial_thread_running = true;
-            pthread_cond_signal(&(simulator->gps_serial_init_done));
-            log_info("Started gps loop");
+            pthread_mutex_lock(&(receiver->gps_serial_lock));
+            receiver->gps_serial_thread_running = true;
+            pthread_cond_signal(&(receiver->gps_serial_init_done));
+            pthread_mutex_unlock(&(receiver->gps_serial_lock));
+            log_info("Started gps loop of receiver %d on %s", receiver->index, receiver->port_name);
         }
-        clock_gettime(CLOCK_REALTIME, &rx_time_start);
-        ioctl(serial_port.port_descriptor, FIONREAD, &avb);
-        if (avb > 0)
-        { // print_hex(rx_buf, ret);
-            ret = read(serial_port.port_descriptor, &rx_buf, avb);
-            if (rx_buf[0] == 0xb5 && rx_buf[1] == 0x62)
-            {
-                expected_len = rx_buf[4] | rx_buf[5] << 8;
-                log_trace("RX Fragment %d %02x%02x EXP Len: %ld Read time: [%ld.%ld]", ret, rx_buf[0], rx_buf[1], expected_len, rx_time_delta.tv_sec, rx_time_delta.tv_nsec);
 
-                multi_fragment_offset = 0;
-                packet_len = 0;
-            }
-            else
-            {
-                multi_fragment_offset = multi_fragment_offset + ret;
-                log_trace("Multifragment packet: %d", multi_fragment_offset);
-            }
-            packet_len += ret;
-            memcpy(&msg_buf[multi_fragment_offset], &rx_buf, ret);
-            memset(rx_buf, 0, 1024);
-            clock_gettime(CLOCK_REALTIME, &rx_time_stop);
-            timespec_sub(&rx_time_delta, &rx_time_stop, &rx_time_start);
-            timespec_add(&rx_time_total, &rx_time_total, &rx_time_delta);
-            if (packet_len == expected_len + 8)
-            {
-                clock_gettime(CLOCK_REALTIME, &rx_time_start);
-                mask = 0;
-                log_trace("[%ld.%ld] [%d] MSG FULL Len: %ld %x%x ", rx_time.tv_sec, rx_time.tv_nsec, device.gpsdata.subframe.subframe_num, packet_len, msg_buf[0], msg_buf[1]);
-                mask = ubx_parse(&device, msg_buf, packet_len);
-                memset(msg_buf, 0, 1024);
-                log_debug("[Tvalid: %d ] Mask: %s", simulator->tp_lock, gps_maskdump(mask));
-
-                clock_gettime(CLOCK_REALTIME, &rx_time_stop);
-                timespec_sub(&rx_time_delta, &rx_time_stop, &rx_time_start);
-                timespec_add(&rx_time_total, &rx_time_total, &rx_time_delta);
-
-                if (GPSTIME_SET == (mask & GPSTIME_SET))
-                {
-                    simulator->tp_lock = true;
-                    log_info("RX Time: %lf", rx_time_total.tv_sec + rx_time_total.tv_nsec * 1e-9);
-                }
-
-                multi_fragment_offset = 0;
-                packet_len = 0;
-                simulator->gpsdata = device;
-            }
+        // Block until the receiver sends something, waking up now and then to check for exit
+        if (poll(&serial_poll, 1, SERIAL_POLL_TIMEOUT_MS) <= 0 || !(serial_poll.revents & POLLIN))
+        {
+            continue;
         }
-    } while (simulator->gps_serial_thread_exit == false);
+        ssize_t ret = ubx_framer_fill(framer, receiver->serial_port.port_descriptor);
+        if (ret <= 0)
+        {
+            continue;
+        }
+        // Fixes completed by these bytes are taken to have arrived now, however long decoding takes
+        uint64_t rx_us = craggy_monotonicUs();
+
+        unsigned char *frame;
+        size_t frame_len;
+        while (ubx_framer_next(framer, &frame, &frame_len))
+        {
+            // A decode thread that fell this far behind loses frames rather than delaying the next read
+            frame_queue_push(&receiver->frames, frame, frame_len, rx_us);
+        }
+    } while (receiver->gps_serial_thread_exit == false);
+
+    log_info("Receiver %d UBX frames: %lu, bad checksums: %lu, bytes skipped: %lu, frames dropped: %lu", receiver->index,
+             framer->frames, framer->bad_checksums, framer->skipped_bytes, receiver->frames.dropped);
 
 end_gps_thread:
+    receiver->gps_serial_thread_exit = true;
+    if (decoding)
+    {
+        pthread_join(receiver->gps_decode_thread, NULL);
+    }
+    frame_queue_destroy(&receiver->frames);
+    free(framer);
     printf("Exit Serial thread\n");
-    serial_port_close(serial_port.port_descriptor);
-    simulator->gps_serial_thread_exit = true;
-    pthread_cond_signal(&(simulator->gps_serial_init_done));
+    serial_port_close(&receiver->serial_port);
+    pthread_cond_signal(&(receiver->gps_serial_init_done));
     pthread_exit(NULL);
-}
\ No newline at end of file
+}
@@ -2,7 +2,38 @@
 #define SERIAL_H
 
 #include "serial-driver.h"
+#include "../gps-sim.h"
 
+/*
+ * Reads the receiver passed, a gps_receiver_t of the simulator, until told to exit. Frames are only
+ * timestamped here and decoded by a thread the serial thread starts, so decoding never delays a read.
+ */
 void *gps_serial_thread_ep(void *arg);
 
+/*
+ * The latest fix taken from a receiver.
+ */
+typedef struct
+{
+    unsigned long generation;
+    // Set if the last wait took this fix
+    bool fresh;
+    timespec_t time;
+    // When the fix arrived, on the monotonic clock
+    uint64_t monotonic_us;
+} gps_fix_t;
+
+/*
+ * Waits up to timeout_ms for a fix of any receiver newer than the one taken last. fixes holds an entry per
+ * receiver, zeroed before the first wait; the entries of receivers with a newer fix are updated and marked
+ * fresh, all fixes arriving meanwhile being taken at once. Returns false on timeout.
+ */
+bool gps_wait_for_fix(simulator_t *simulator, gps_fix_t *fixes, int timeout_ms);
+
+/*
+ * Copies the sections specified (GPS_SNAPSHOT_FIX, SATELLITE_SET, ...) of the latest state of a receiver,
+ * all from the same publication. Returns the version of the publication, 0 if nothing was published yet.
+ */
+unsigned long gps_read_snapshot(simulator_t *simulator, int receiver_index, gps_mask_t sections, gps_snapshot_t *snapshot);
+
 #endif /* SERIAL_H */
\ No newline at end of file
@@ -136,6 +136,43 @@ static void subframe_almanac(const struct gpsd_errout_t *errout,
     almp->d_af0    = pow(2.0, -20) * almp->af0;
 }
 
+/*
+ * Satellites repeat their ephemeris every 30 seconds and their almanac
+ * pages every 12.5 minutes.  True if a subframe is the same as the one
+ * last decoded from the satellite for its page, so that decoding it
+ * again would change nothing.  Words 0 (TLM) and 1 (HOW, holding the
+ * TOW) are left out, as they differ every time.
+ */
+static bool subframe_repeats(struct gps_device_t *session,
+                             unsigned int gnssId, unsigned int tSVID,
+                             const uint32_t words[])
+{
+    unsigned int subframe_num = (words[1] >> 2) & BITMASK(3);
+    unsigned int sat, page, i;
+    uint64_t fp = 14695981039346656037ULL;    // FNV-1a
+
+    if (1 > subframe_num || 5 < subframe_num) {
+        return false;
+    }
+    sat = (GNSSID_QZSS == gnssId ? 32 : 0) + ((tSVID - 1) & 31);
+    if (3 >= subframe_num) {
+        page = subframe_num - 1;
+    } else {
+        page = 3 + ((words[2] >> 16) & BITMASK(6));
+    }
+
+    for (i = 2; i < 10; i++) {
+        fp = (fp ^ (words[i] & BITMASK(24))) * 1099511628211ULL;
+    }
+    fp |= 1;        // zero for none seen
+
+    if (session->subframe_seen[sat][page] == fp) {
+        return true;
+    }
+    session->subframe_seen[sat][page] = fp;
+    return false;
+}
+
 gps_mask_t gpsd_interpret_subframe(struct gps_device_t *session,
                                    unsigned int gnssId, unsigned int tSVID,
                                    uint32_t words[])
@@ -155,8 +192,6 @@ gps_mask_t gpsd_interpret_subframe(struct gps_device_t *session,
     /* FIXME!! I really doubt this is Big Endian compatible */
     uint8_t preamble;
     struct subframe_t *subp = &session->gpsdata.subframe;
-    init_subframe(&session->gpsdata.subframe, gnssId, (uint8_t)tSVID);
-
 
     preamble = (uint8_t)((words[0] >> 16) & BITMASK(8));
     if (preamble == 0x8b) {
@@ -167,6 +202,11 @@ gps_mask_t gpsd_interpret_subframe(struct gps_device_t *session,
     if (preamble != 0x74) {
         return 0;
     }
+    /* nothing new, leave what was decoded last in place */
+    if (subframe_repeats(session, gnssId, tSVID, words)) {
+        return 0;
+    }
+    init_subframe(&session->gpsdata.subframe, gnssId, (uint8_t)tSVID);
     subp->integrity = (bool)((words[0] >> 1) & 1);
     /* The subframe ID is in the Hand Over Word (page 80) */
     // subframe_num is 1 to 5
@@ -0,0 +1,398 @@
+/* Copyright 2020 Johan Lindquist
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "base64.h"
+#include "responder.h"
+#include "CraggyProtocol.h"
+#include "CraggyClock.h"
+
+#define SERVER_DEFAULT_PORT 2002
+#define SERVER_DEFAULT_RADIUS 1000000
+#define SERVER_DEFAULT_BATCH_SIZE 64
+
+// SERVER_MAX_REQUEST_SIZE is the largest request answered, all a UDP datagram can hold without fragmenting on Ethernet.
+#define SERVER_MAX_REQUEST_SIZE 1472
+
+// SERVER_DELEGATION_VALIDITY is how long, in microseconds, the delegation created at startup stays valid.
+#define SERVER_DELEGATION_VALIDITY (30 * 24 * 3600 * UINT64_C(1000000))
+
+// SERVER_RECEIVE_BUFFER_SIZE is the socket receive buffer asked for, to ride out bursts of requests.  The kernel caps
+// it at net.core.rmem_max.
+#define SERVER_RECEIVE_BUFFER_SIZE (4 * 1024 * 1024)
+
+// SERVER_POLL_TIMEOUT is how long, in milliseconds, a worker waits for requests before checking whether to stop.
+#define SERVER_POLL_TIMEOUT 200
+
+typedef struct
+{
+    const Responder *responder;
+    size_t batchSize;
+    pthread_t thread;
+    int fd;
+    uint64_t numRequests;
+    uint64_t numBatches;
+    uint64_t numDropped;
+} Worker;
+
+static atomic_bool running = true;
+
+// OpenSocket binds a UDP socket to the port shared by all workers, the kernel spreading requests over them.
+static int OpenSocket(uint16_t port)
+{
+    int fd = socket(AF_INET6, SOCK_DGRAM, 0);
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    const int on = 1;
+    const int off = 0;
+    const int receiveBufferSize = SERVER_RECEIVE_BUFFER_SIZE;
+    const struct timeval timeout = {.tv_sec = 0, .tv_usec = SERVER_POLL_TIMEOUT * 1000};
+    struct sockaddr_in6 address = {.sin6_family = AF_INET6, .sin6_port = htons(port), .sin6_addr = in6addr_any};
+
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) ||
+        setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off)) ||
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &receiveBufferSize, sizeof(receiveBufferSize)) ||
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) ||
+        bind(fd, (struct sockaddr *) &address, sizeof(address)))
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// ExtractNonce returns false for requests that are not to be answered - too short to rule out amplification, or
+// without a nonce.
+static bool ExtractNonce(const uint8_t *request, size_t requestLen, craggy_rough_time_nonce_t nonce)
+{
+    const uint8_t *data;
+
+    if (requestLen < CRAGGY_ROUGH_TIME_MIN_REQUEST_SIZE || !craggy_parseRequestNonce(request, requestLen, &data))
+    {
+        return false;
+    }
+    memcpy(nonce, data, CRAGGY_ROUGH_TIME_NONCE_LENGTH);
+    return true;
+}
+
+// RunWorker answers requests in batches of whatever has arrived by the time the previous batch was answered, up to
+// the batch size: recvmmsg waits for the first request only, so a lightly loaded server still answers straight away.
+static void *RunWorker(void *argument)
+{
+    Worker *worker = argument;
+    const size_t batchSize = worker->batchSize;
+
+    uint8_t (*requests)[SERVER_MAX_REQUEST_SIZE] = calloc(batchSize, sizeof(*requests));
+    ResponderResponse *responses = calloc(batchSize, sizeof(ResponderResponse));
+    size_t *responseLens = calloc(batchSize, sizeof(size_t));
+    craggy_rough_time_nonce_t *nonces = calloc(batchSize, sizeof(craggy_rough_time_nonce_t));
+    struct sockaddr_in6 *addresses = calloc(batchSize, sizeof(struct sockaddr_in6));
+    struct mmsghdr *received = calloc(batchSize, sizeof(struct mmsghdr));
+    struct mmsghdr *sent = calloc(batchSize, sizeof(struct mmsghdr));
+    struct iovec *receivedVectors = calloc(batchSize, sizeof(struct iovec));
+    struct iovec *sentVectors = calloc(batchSize, sizeof(struct iovec));
+    size_t *senders = calloc(batchSize, sizeof(size_t));
+
+    if (requests == NULL || responses == NULL || responseLens == NULL || nonces == NULL || addresses == NULL ||
+        received == NULL || sent == NULL || receivedVectors == NULL || sentVectors == NULL || senders == NULL)
+    {
+        fprintf(stderr, "Worker out of memory\n");
+        goto exit;
+    }
+
+    while (atomic_load(&running))
+    {
+        for (size_t i = 0; i < batchSize; i++)
+        {
+            receivedVectors[i] = (struct iovec) {.iov_base = requests[i], .iov_len = sizeof(requests[i])};
+            received[i].msg_hdr = (struct msghdr) {
+                .msg_name = &addresses[i],
+                .msg_namelen = sizeof(addresses[i]),
+                .msg_iov = &receivedVectors[i],
+                .msg_iovlen = 1};
+        }
+
+        int numReceived = recvmmsg(worker->fd, received, batchSize, MSG_WAITFORONE, NULL);
+        if (numReceived <= 0)
+        {
+            continue;
+        }
+
+        size_t numNonces = 0;
+        for (int i = 0; i < numReceived; i++)
+        {
+            const bool truncated = (received[i].msg_hdr.msg_flags & MSG_TRUNC) != 0;
+            if (!truncated && ExtractNonce(requests[i], received[i].msg_len, nonces[numNonces]))
+            {
+                senders[numNonces++] = i;
+            }
+        }
+        worker->numRequests += numReceived;
+        worker->numDropped += numReceived - numNonces;
+        if (numNonces == 0)
+        {
+            continue;
+        }
+
+        if (!RespondToBatch(worker->responder, nonces, numNonces, craggy_realtimeUs(), responses, responseLens))
+        {
+            worker->numDropped += numNonces;
+            continue;
+        }
+        worker->numBatches++;
+
+        for (size_t i = 0; i < numNonces; i++)
+        {
+            sentVectors[i] = (struct iovec) {.iov_base = responses[i], .iov_len = responseLens[i]};
+            sent[i].msg_hdr = (struct msghdr) {
+                .msg_name = &addresses[senders[i]],
+                .msg_namelen = received[senders[i]].msg_hdr.msg_namelen,
+                .msg_iov = &sentVectors[i],
+                .msg_iovlen = 1};
+        }
+
+        // Responses the socket buffer has no room for are dropped, the clients will retry
+        for (size_t numSent = 0; numSent < numNonces;)
+        {
+            int n = sendmmsg(worker->fd, sent + numSent, numNonces - numSent, 0);
+            if (n < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (n <= 0)
+            {
+                worker->numDropped += numNonces - numSent;
+                break;
+            }
+            numSent += n;
+        }
+    }
+
+exit:
+    free(requests);
+    free(responses);
+    free(responseLens);
+    free(nonces);
+    free(addresses);
+    free(received);
+    free(sent);
+    free(receivedVectors);
+    free(sentVectors);
+    free(senders);
+    return NULL;
+}
+
+// LoadRootKey reads the seed of the root key from seedPath, or generates a new one if none is specified.
+static CraggyPrivateKey *LoadRootKey(const char *seedPath, craggy_rough_time_public_key_t publicKey)
+{
+    uint8_t seed[CRAGGY_ROUGH_TIME_PRIVATE_KEY_SEED_LENGTH];
+    CraggyPrivateKey *key = NULL;
+    CraggyResult craggyResult;
+
+    if (seedPath != NULL)
+    {
+        FILE *file = fopen(seedPath, "rb");
+        if (file == NULL)
+        {
+            fprintf(stderr, "Failed to open %s: %s\n", seedPath, strerror(errno));
+            return NULL;
+        }
+        size_t seedLen = fread(seed, 1, sizeof(seed), file);
+        fclose(file);
+        if (seedLen != sizeof(seed))
+        {
+            fprintf(stderr, "%s must hold a %d byte seed\n", seedPath, CRAGGY_ROUGH_TIME_PRIVATE_KEY_SEED_LENGTH);
+            return NULL;
+        }
+    }
+    else if (!craggy_fillRandomBytes(seed, sizeof(seed), &craggyResult))
+    {
+        fprintf(stderr, "Failed to generate root key (%d)\n", craggyResult);
+        return NULL;
+    }
+
+    if (!craggy_privateKeyCreate(seed, &key, publicKey))
+    {
+        fprintf(stderr, "Failed to create root key\n");
+        key = NULL;
+    }
+    memset(seed, 0, sizeof(seed));
+    return key;
+}
+
+int main(int argc, char *argv[])
+{
+    int result = 1;
+
+    static struct option long_options[] = {
+        {"port", required_argument, 0, 'p'},
+        {"threads", required_argument, 0, 't'},
+        {"key", required_argument, 0, 'k'},
+        {"radius", required_argument, 0, 'r'},
+        {"batch", required_argument, 0, 'b'},
+        {0, 0, 0, 0}};
+
+    int port = SERVER_DEFAULT_PORT;
+    long numWorkers = sysconf(_SC_NPROCESSORS_ONLN);
+    const char *seedPath = NULL;
+    long radius = SERVER_DEFAULT_RADIUS;
+    long batchSize = SERVER_DEFAULT_BATCH_SIZE;
+    int c;
+
+    while ((c = getopt_long(argc, argv, "p:t:k:r:b:", long_options, NULL)) != -1)
+    {
+        switch (c)
+        {
+        case 'p':
+            port = atoi(optarg);
+            break;
+
+        case 't':
+            numWorkers = atol(optarg);
+            break;
+
+        case 'k':
+            seedPath = optarg;
+            break;
+
+        case 'r':
+            radius = atol(optarg);
+            break;
+
+        case 'b':
+            batchSize = atol(optarg);
+            break;
+
+        default:
+            printf("usage: craggy-server (-p <port>) (-t <threads>) (-k <root key seed file>) (-r <radius us>) (-b <batch size, at most %d>)\n", RESPONDER_MAX_BATCH_SIZE);
+            return 1;
+        }
+    }
+
+    if (port <= 0 || port > UINT16_MAX || numWorkers < 1 || radius < 0 || radius > UINT32_MAX ||
+        batchSize < 1 || batchSize > RESPONDER_MAX_BATCH_SIZE)
+    {
+        printf("usage: craggy-server (-p <port>) (-t <threads>) (-k <root key seed file>) (-r <radius us>) (-b <batch size, at most %d>)\n", RESPONDER_MAX_BATCH_SIZE);
+        return 1;
+    }
+
+    craggy_rough_time_public_key_t rootPublicKey;
+    Responder *responder = NULL;
+    Worker *workers = NULL;
+    long numStarted = 0;
+
+    CraggyPrivateKey *rootKey = LoadRootKey(seedPath, rootPublicKey);
+    if (rootKey == NULL)
+    {
+        goto exit;
+    }
+
+    size_t encodedKeyLen;
+    unsigned char *encodedKey = base64_encode(rootPublicKey, CRAGGY_ROUGH_TIME_PUBLIC_KEY_LENGTH, &encodedKeyLen);
+    if (encodedKey == NULL)
+    {
+        goto exit;
+    }
+    // base64_encode ends the output with a newline
+    printf("Root public key: %s", encodedKey);
+    free(encodedKey);
+
+    if (!CreateResponder(rootKey, radius, SERVER_DELEGATION_VALIDITY, &responder))
+    {
+        fprintf(stderr, "Failed to create delegation\n");
+        goto exit;
+    }
+
+    // Workers inherit the mask, leaving the signals to be waited for here
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+    workers = calloc(numWorkers, sizeof(Worker));
+    if (workers == NULL)
+    {
+        goto exit;
+    }
+
+    for (; numStarted < numWorkers; numStarted++)
+    {
+        Worker *worker = &workers[numStarted];
+        worker->responder = responder;
+        worker->batchSize = batchSize;
+        worker->fd = OpenSocket(port);
+        if (worker->fd < 0)
+        {
+            fprintf(stderr, "Failed to bind port %d: %s\n", port, strerror(errno));
+            break;
+        }
+        if (pthread_create(&worker->thread, NULL, RunWorker, worker))
+        {
+            close(worker->fd);
+            break;
+        }
+    }
+
+    if (numStarted == numWorkers)
+    {
+        printf("Serving on port %d with %ld thread(s), batches of up to %ld\n", port, numWorkers, batchSize);
+        fflush(stdout);
+
+        int signal;
+        sigwait(&signals, &signal);
+        result = 0;
+    }
+    atomic_store(&running, false);
+
+    uint64_t numRequests = 0, numBatches = 0, numDropped = 0;
+    for (long i = 0; i < numStarted; i++)
+    {
+        pthread_join(workers[i].thread, NULL);
+        close(workers[i].fd);
+        numRequests += workers[i].numRequests;
+        numBatches += workers[i].numBatches;
+        numDropped += workers[i].numDropped;
+    }
+    if (result == 0)
+    {
+        printf("Received %" PRIu64 " request(s), answered in %" PRIu64 " batch(es), %" PRIu64 " dropped\n", numRequests, numBatches, numDropped);
+    }
+
+exit:
+    free(workers);
+    DestroyResponder(responder);
+    craggy_privateKeyRelease(rootKey);
+    return result;
+}
@@ -0,0 +1,149 @@
+/* Copyright 2020 Johan Lindquist
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "responder.h"
+#include "CraggyMerkle.h"
+#include "CraggyProtocol.h"
+#include "CraggyClock.h"
+
+#define RESPONDER_DELEGATION_CONTEXT "RoughTime v1 delegation signature--"
+#define RESPONDER_RESPONSE_CONTEXT "RoughTime v1 response signature"
+
+// Header and data of DELE {PUBK, MINT, MAXT} and CERT {SIG, DELE}
+#define RESPONDER_DELEGATION_LENGTH (4 + 2 * 4 + 3 * 4 + CRAGGY_ROUGH_TIME_PUBLIC_KEY_LENGTH + 2 * sizeof(craggy_rough_time_t))
+#define RESPONDER_CERTIFICATE_LENGTH (4 + 1 * 4 + 2 * 4 + CRAGGY_ROUGH_TIME_SIGNATURE_LENGTH + RESPONDER_DELEGATION_LENGTH)
+
+// Header and data of SREP {RADI, MIDP, ROOT}
+#define RESPONDER_SIGNED_RESPONSE_LENGTH (4 + 2 * 4 + 3 * 4 + sizeof(uint32_t) + sizeof(craggy_rough_time_t) + CRAGGY_ROUGH_TIME_HASH_LENGTH)
+
+struct Responder
+{
+    CraggyPrivateKey *delegationKey;
+    uint32_t radius;
+    uint8_t certificate[RESPONDER_CERTIFICATE_LENGTH];
+    size_t certificateLen;
+};
+
+// SignWithContext signs the context string, including its terminating NUL, followed by the message.
+static bool SignWithContext(const CraggyPrivateKey *key, const char *context, const uint8_t *msg, size_t msgLen, uint8_t signature[CRAGGY_ROUGH_TIME_SIGNATURE_LENGTH])
+{
+    const CraggyMessageSegment segments[] = {
+        {(const uint8_t *) context, strlen(context) + 1},
+        {msg, msgLen}};
+    return craggy_signSegments(key, segments, 2, signature);
+}
+
+bool CreateResponder(const CraggyPrivateKey *rootKey, uint32_t radius, uint64_t validity, Responder **outResponder)
+{
+    CraggyResult craggyResult;
+    uint8_t seed[CRAGGY_ROUGH_TIME_PRIVATE_KEY_SEED_LENGTH];
+    craggy_rough_time_public_key_t delegationPublicKey;
+
+    Responder *responder = calloc(1, sizeof(Responder));
+    if (responder == NULL)
+    {
+        return false;
+    }
+    responder->radius = radius;
+
+    bool created = craggy_fillRandomBytes(seed, sizeof(seed), &craggyResult) &&
+                   craggy_privateKeyCreate(seed, &responder->delegationKey, delegationPublicKey);
+    memset(seed, 0, sizeof(seed));
+    if (!created)
+    {
+        DestroyResponder(responder);
+        return false;
+    }
+
+    const craggy_rough_time_t minTime = craggy_realtimeUs();
+    const craggy_rough_time_t maxTime = minTime + validity;
+    CraggyTagData delegationTags[] = {
+        {CRAGGY_TAG_PUBK, delegationPublicKey, CRAGGY_ROUGH_TIME_PUBLIC_KEY_LENGTH},
+        {CRAGGY_TAG_MINT, (const uint8_t *) &minTime, sizeof(minTime)},
+        {CRAGGY_TAG_MAXT, (const uint8_t *) &maxTime, sizeof(maxTime)}};
+
+    uint8_t delegation[RESPONDER_DELEGATION_LENGTH];
+    size_t delegationLen;
+    uint8_t delegationSignature[CRAGGY_ROUGH_TIME_SIGNATURE_LENGTH];
+    CraggyTagData certificateTags[] = {
+        {CRAGGY_TAG_SIG, delegationSignature, sizeof(delegationSignature)},
+        {CRAGGY_TAG_DELE, delegation, sizeof(delegation)}};
+
+    if (!craggy_buildMessage(delegationTags, 3, delegation, sizeof(delegation), &delegationLen) ||
+        !SignWithContext(rootKey, RESPONDER_DELEGATION_CONTEXT, delegation, delegationLen, delegationSignature) ||
+        !craggy_buildMessage(certificateTags, 2, responder->certificate, sizeof(responder->certificate), &responder->certificateLen))
+    {
+        DestroyResponder(responder);
+        return false;
+    }
+
+    *outResponder = responder;
+    return true;
+}
+
+bool RespondToBatch(const Responder *responder, const craggy_rough_time_nonce_t *nonces, size_t numNonces, craggy_rough_time_t midpoint, ResponderResponse *responses, size_t *responseLens)
+{
+    CraggyResult craggyResult;
+    CraggyMerkleTree *tree;
+
+    if (numNonces > RESPONDER_MAX_BATCH_SIZE || !craggy_createMerkleTree(nonces, numNonces, &tree, &craggyResult))
+    {
+        return false;
+    }
+
+    // The signed part of the response is the same for the whole batch, only PATH and INDX differ between requests
+    uint8_t signedResponse[RESPONDER_SIGNED_RESPONSE_LENGTH];
+    size_t signedResponseLen;
+    uint8_t signature[CRAGGY_ROUGH_TIME_SIGNATURE_LENGTH];
+    CraggyTagData signedResponseTags[] = {
+        {CRAGGY_TAG_RADI, (const uint8_t *) &responder->radius, sizeof(responder->radius)},
+        {CRAGGY_TAG_MIDP, (const uint8_t *) &midpoint, sizeof(midpoint)},
+        {CRAGGY_TAG_ROOT, craggy_getMerkleRoot(tree), CRAGGY_ROUGH_TIME_HASH_LENGTH}};
+
+    bool responded = craggy_buildMessage(signedResponseTags, 3, signedResponse, sizeof(signedResponse), &signedResponseLen) &&
+                     SignWithContext(responder->delegationKey, RESPONDER_RESPONSE_CONTEXT, signedResponse, signedResponseLen, signature);
+
+    uint8_t path[CRAGGY_ROUGH_TIME_MAX_TREE_DEPTH * CRAGGY_ROUGH_TIME_HASH_LENGTH];
+    const size_t pathLen = craggy_getMerklePathLength(tree);
+    for (size_t i = 0; i < numNonces && responded; i++)
+    {
+        const uint32_t index = i;
+        CraggyTagData responseTags[] = {
+            {CRAGGY_TAG_SIG, signature, sizeof(signature)},
+            {CRAGGY_TAG_PATH, path, pathLen},
+            {CRAGGY_TAG_SREP, signedResponse, signedResponseLen},
+            {CRAGGY_TAG_CERT, responder->certificate, responder->certificateLen},
+            {CRAGGY_TAG_INDX, (const uint8_t *) &index, sizeof(index)}};
+
+        responded = craggy_getMerklePath(tree, i, path, sizeof(path)) &&
+                    craggy_buildMessage(responseTags, 5, responses[i], RESPONDER_MAX_RESPONSE_SIZE, &responseLens[i]);
+    }
+
+    craggy_destroyMerkleTree(tree);
+    return responded;
+}
+
+void DestroyResponder(Responder *responder)
+{
+    if (responder != NULL)
+    {
+        craggy_privateKeyRelease(responder->delegationKey);
+    }
+    free(responder);
+}
@@ -0,0 +1,50 @@
+/* Copyright 2020 Johan Lindquist
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CRAGGY_SERVER_RESPONDER_H
+#define CRAGGY_SERVER_RESPONDER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "CraggyCrypto.h"
+#include "CraggyTypes.h"
+
+// RESPONDER_MAX_BATCH_SIZE is the largest number of requests answered with one signature.  A tree over this many nonces
+// has a path of 10 hashes, which keeps every response within the minimum request size.
+#define RESPONDER_MAX_BATCH_SIZE 1024
+
+// RESPONDER_MAX_RESPONSE_SIZE is the size of the buffer each response is built in.
+#define RESPONDER_MAX_RESPONSE_SIZE CRAGGY_ROUGH_TIME_MIN_REQUEST_SIZE
+
+typedef uint8_t ResponderResponse[RESPONDER_MAX_RESPONSE_SIZE];
+
+// Responder holds the delegation of the server, created and signed by the root key when the responder is.  It is only
+// read once created, so any number of threads can respond using the same responder.
+typedef struct Responder Responder;
+
+// CreateResponder delegates to a freshly generated key, valid from now for validity microseconds, and signs the
+// delegation with rootKey.  Every response carries the radius specified, in microseconds.
+bool CreateResponder(const CraggyPrivateKey *rootKey, uint32_t radius, uint64_t validity, Responder **responder);
+
+// RespondToBatch answers the nonces of a batch of requests, all sharing one Merkle tree and one signed SREP with the
+// midpoint specified.  Response i, of length responseLens[i], is written to responses[i].
+bool RespondToBatch(const Responder *responder, const craggy_rough_time_nonce_t *nonces, size_t numNonces, craggy_rough_time_t midpoint, ResponderResponse *responses, size_t *responseLens);
+
+// DestroyResponder releases the delegation key of the responder.
+void DestroyResponder(Responder *responder);
+
+#endif // CRAGGY_SERVER_RESPONDER_H
@@ -0,0 +1,87 @@
+/* Copyright 2020 Johan Lindquist
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "CraggyClient.h"
+#include "fixtures.h"
+
+// Offset of the value of a tag at the top level of a message, 0 if the message has no such tag.
+static size_t FindTag(const uint8_t *message, size_t messageLen, const char tag[4])
+{
+    const uint32_t numTags = (uint32_t)message[0] | (uint32_t)message[1] << 8 | (uint32_t)message[2] << 16 | (uint32_t)message[3] << 24;
+    const size_t headerLen = 4 + (numTags - 1) * 4 + numTags * 4;
+    for (uint32_t i = 0; i < numTags && headerLen <= messageLen; i++)
+    {
+        if (memcmp(message + 4 + (numTags - 1) * 4 + i * 4, tag, 4) != 0)
+        {
+            continue;
+        }
+        if (i == 0)
+        {
+            return headerLen;
+        }
+        const uint8_t *offset = message + 4 + (i - 1) * 4;
+        return headerLen + ((size_t)offset[0] | (size_t)offset[1] << 8 | (size_t)offset[2] << 16 | (size_t)offset[3] << 24);
+    }
+    return 0;
+}
+
+// Check processes a response whose INDX has the bits given flipped, expecting the result given.
+static bool Check(const char *name, const uint8_t *nonce, const uint8_t *response, size_t responseLen, uint32_t flipped, CraggyResult expected)
+{
+    uint8_t buffer[1024];
+    memcpy(buffer, response, responseLen);
+    const size_t indx = FindTag(buffer, responseLen, "INDX");
+    if (indx == 0 || indx + 4 > responseLen)
+    {
+        printf("FAIL %s: no INDX\n", name);
+        return false;
+    }
+    for (int i = 0; i < 4; i++)
+    {
+        buffer[indx + i] ^= (uint8_t)(flipped >> (8 * i));
+    }
+
+    uint8_t nonceCopy[64];
+    uint8_t rootPublicKey[32];
+    memcpy(nonceCopy, nonce, sizeof(nonceCopy));
+    memcpy(rootPublicKey, benchRootPublicKey, sizeof(rootPublicKey));
+    CraggyResult result;
+    craggy_rough_time_t time;
+    craggy_rough_time_radius_t radius;
+    const bool valid = craggy_processResponse(nonceCopy, rootPublicKey, buffer, responseLen, &result, &time, &radius);
+    if (valid ? expected != CraggyResultSuccess : result != expected)
+    {
+        printf("FAIL %s: result %d, expected %d\n", name, valid ? CraggyResultSuccess : result, expected);
+        return false;
+    }
+    printf("ok %s\n", name);
+    return true;
+}
+
+int main(void)
+{
+    bool ok = true;
+    ok &= Check("unbatched response as sent", benchSingleNonce, benchSingleResponse, sizeof(benchSingleResponse), 0, CraggyResultSuccess);
+    ok &= Check("unbatched response with INDX 1 and no PATH", benchSingleNonce, benchSingleResponse, sizeof(benchSingleResponse), 1, CraggyResultAuthenticationHashError);
+    ok &= Check("batched response as sent", benchBatchedNonce, benchBatchedResponse, sizeof(benchBatchedResponse), 0, CraggyResultSuccess);
+    ok &= Check("batched response with INDX bit beyond PATH", benchBatchedNonce, benchBatchedResponse, sizeof(benchBatchedResponse), 1U << 4, CraggyResultAuthenticationHashError);
+    ok &= Check("batched response with high INDX byte", benchBatchedNonce, benchBatchedResponse, sizeof(benchBatchedResponse), 0x80000000U, CraggyResultAuthenticationHashError);
+    return ok ? 0 : 1;
+}